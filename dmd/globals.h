@@ -254,6 +254,12 @@ struct Param
     uint32_t hashThreshold; // MD5 hash symbols larger than this threshold (0 = no hashing)
 
     bool outputSourceLocations; // if true, output line tables.
+
+    bool ctfeBytecode; // use the bytecode CTFE engine where possible
+    bool ctfeArena;    // free the temporaries of each CTFE evaluation afterwards
+    bool assumeAsserts; // keep unchecked assert conditions as optimizer assumptions
+    bool entryInvariantsOnly; // don't check invariants on exit of member functions
+    bool foreachRangeIndexing; // lower foreach over indexable ranges to counted loops
 #endif
 };
 
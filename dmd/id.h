@@ -48,6 +48,8 @@ public:
     static Identifier *xopCmp;
     static Identifier *xtoHash;
     static Identifier *empty;
+    static Identifier *apply;
+    static Identifier *applyReverse;
     static Identifier *ctfe;
     static Identifier *_arguments;
     static Identifier *_argptr;
@@ -71,6 +73,7 @@ public:
     static Identifier *LDC_inline_ir;
     static Identifier *LDC_extern_weak;
     static Identifier *LDC_profile_instr;
+    static Identifier *LDC_loop;
     static Identifier *dcReflect;
     static Identifier *criticalenter;
     static Identifier *criticalexit;
@@ -78,12 +81,20 @@ public:
     static Identifier *udaSection;
     static Identifier *udaOptStrategy;
     static Identifier *udaTarget;
+    static Identifier *udaTargetClones;
     static Identifier *udaAssumeUsed;
     static Identifier *udaWeak;
+    static Identifier *udaRestrict;
+    static Identifier *udaAssumeAligned;
+    static Identifier *optimizeLayout;
+    static Identifier *udaOptimizeLayout;
+    static Identifier *udaColdField;
     static Identifier *udaAllocSize;
     static Identifier *udaLLVMAttr;
     static Identifier *udaLLVMFastMathFlag;
     static Identifier *udaKernel;
+    static Identifier *udaLaunchBounds;
+    static Identifier *udaMaxRegisters;
     static Identifier *udaCompute;
     static Identifier *udaDynamicCompile;
     static Identifier *udaDynamicCompileConst;
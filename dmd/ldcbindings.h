@@ -11,6 +11,7 @@
 #define LDC_DDMD_LDCBINDINGS_H
 
 #include "expression.h"
+#include "init.h"
 #include <cstdint>
 
 using uint = uint32_t;
@@ -38,6 +39,7 @@ ComExp *createComExp(const Loc &, Expression *);
 NegExp *createNegExp(const Loc &, Expression *);
 AddrExp *createAddrExp(const Loc &, Expression *);
 DsymbolExp *createDsymbolExp(const Loc &, Dsymbol *, bool = false);
+ExpInitializer *createExpInitializer(const Loc &, Expression *);
 Expression *createExpression(const Loc &loc, TOK op, int size);
 TypeDelegate *createTypeDelegate(Type *t);
 TypeIdentifier *createTypeIdentifier(const Loc &loc, Identifier *ident);
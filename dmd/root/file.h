@@ -55,6 +55,10 @@ struct File
     }
 
     void remove();              // delete file
+
+#if IN_LLVM
+    void releaseBuffer();       // free or unmap the buffer read by read()
+#endif
 };
 
 #endif
@@ -34,6 +34,9 @@ struct Mem
     static void xfree(void *p);
     static void *xmallocdup(void *o, d_size_t size);
     static void error();
+#if IN_LLVM
+    static bool isGCEnabled();
+#endif
 };
 
 extern Mem mem;
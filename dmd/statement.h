@@ -276,6 +276,11 @@ public:
     Expression *condition;
     Loc endloc;                 // location of ';' after while
 
+#if IN_LLVM
+    // name/value pairs of applied pragma(LDC_loop) hints (value may be null)
+    Expressions *ldcLoopHints;
+#endif
+
     Statement *syntaxCopy();
     bool hasBreak();
     bool hasContinue();
@@ -297,6 +302,11 @@ public:
     // treat that label as referring to this loop.
     Statement *relatedLabeled;
 
+#if IN_LLVM
+    // name/value pairs of applied pragma(LDC_loop) hints (value may be null)
+    Expressions *ldcLoopHints;
+#endif
+
     Statement *syntaxCopy();
     Statement *scopeCode(Scope *sc, Statement **sentry, Statement **sexit, Statement **sfinally);
     Statement *getRelatedLabeled() { return relatedLabeled ? relatedLabeled : this; }
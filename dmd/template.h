@@ -85,6 +85,12 @@ public:
 
 #if IN_LLVM
     const char *intrinsicName;
+
+    // Statistics for -ftemplate-stats
+    unsigned numInstances;      // distinct instances
+    unsigned numDedupHits;      // instantiations reusing an existing instance
+    double semanticTime;        // in seconds, excluding nested instances
+    double codegenTime;         // in seconds, excluding nested instances
 #endif
 
     Dsymbol *syntaxCopy(Dsymbol *);
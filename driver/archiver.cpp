@@ -9,7 +9,10 @@
 
 #include "errors.h"
 #include "globals.h"
+#include "driver/archiver.h"
 #include "driver/cl_options.h"
+#include "driver/timereport.h"
+#include "driver/toobj.h"
 #include "driver/tool.h"
 #include "gen/logger.h"
 #include "llvm/ADT/Triple.h"
@@ -20,6 +23,7 @@
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/Errc.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 
 #if LDC_LLVM_VER >= 500
@@ -28,7 +32,9 @@
 #include "llvm/LibDriver/LibDriver.h"
 #endif
 
+#include <algorithm>
 #include <cstring>
+#include <thread>
 
 using namespace llvm;
 
@@ -66,17 +72,39 @@ void fail(Error E, StringRef Context = {}) {
     return 1; \
   }
 
-int addMember(std::vector<NewArchiveMember> &Members, StringRef FileName,
-              int Pos = -1) {
+/// Returns the number of threads for opening new members, as requested by -j.
+unsigned getThreadCount(size_t NumMembers) {
+  if (NumMembers <= 1)
+    return 1;
+  const unsigned N = opts::parallelJobs == 0
+                         ? std::max(1u, std::thread::hardware_concurrency())
+                         : opts::parallelJobs;
+  return std::min<size_t>(N, NumMembers);
+}
+
+Expected<NewArchiveMember> getNewMember(StringRef FileName) {
+  // Object files emitted to memory only; the buffer identifier is the basename.
+  if (auto buffer = getInMemoryObjectFile(FileName))
+    return NewArchiveMember(*buffer);
+
   Expected<NewArchiveMember> NMOrErr =
       NewArchiveMember::getFile(FileName, Deterministic);
-  failIfError(NMOrErr.takeError(), FileName);
 
 #if LDC_LLVM_VER >= 500
-  // Use the basename of the object path for the member name.
-  NMOrErr->MemberName = sys::path::filename(NMOrErr->MemberName);
+  // Use the basename of the object path for the member name. Thin archives
+  // need the path though, as the member is looked up relative to the archive.
+  if (NMOrErr && !Thin)
+    NMOrErr->MemberName = sys::path::filename(NMOrErr->MemberName);
 #endif
 
+  return NMOrErr;
+}
+
+int addMember(std::vector<NewArchiveMember> &Members, StringRef FileName,
+              int Pos = -1) {
+  Expected<NewArchiveMember> NMOrErr = getNewMember(FileName);
+  failIfError(NMOrErr.takeError(), FileName);
+
   if (Pos == -1)
     Members.push_back(std::move(*NMOrErr));
   else
@@ -136,14 +164,45 @@ int computeNewArchiveMembers(object::Archive *OldArchive,
   const int InsertPos = Ret.size();
   for (unsigned I = 0; I != Members.size(); ++I)
     Ret.insert(Ret.begin() + InsertPos, NewArchiveMember());
-  int Pos = InsertPos;
-  for (auto &Member : Members) {
-    if (int Status = addMember(Ret, Member, Pos))
-      return Status;
-    ++Pos;
+
+  const unsigned NumThreads = getThreadCount(Members.size());
+  if (NumThreads <= 1) {
+    int Pos = InsertPos;
+    for (auto &Member : Members) {
+      if (int Status = addMember(Ret, Member, Pos))
+        return Status;
+      ++Pos;
+    }
+    return 0;
   }
 
-  return 0;
+  // Open the new members concurrently, which pays off for many members on
+  // file systems with a high latency. Errors are reported in member order.
+  std::vector<std::unique_ptr<Expected<NewArchiveMember>>> NewMembers(
+      Members.size());
+  {
+    ThreadPool Pool(NumThreads);
+    for (size_t I = 0; I != Members.size(); ++I) {
+      Pool.async([&NewMembers, I] {
+        NewMembers[I] = llvm::make_unique<Expected<NewArchiveMember>>(
+            getNewMember(Members[I]));
+      });
+    }
+    Pool.wait();
+  }
+
+  int Status = 0;
+  for (size_t I = 0; I != Members.size(); ++I) {
+    auto &NMOrErr = *NewMembers[I];
+    if (!NMOrErr) {
+      fail(NMOrErr.takeError(), Members[I]);
+      Status = 1;
+    } else {
+      Ret[InsertPos + I] = std::move(*NMOrErr);
+    }
+  }
+
+  return Status;
 }
 
 object::Archive::Kind getDefaultForHost() {
@@ -227,13 +286,14 @@ namespace {
 
 int internalAr(ArrayRef<const char *> args) {
   if (args.size() < 4 || strcmp(args[0], "llvm-ar") != 0 ||
-      strcmp(args[1], "rcs") != 0) {
+      (strcmp(args[1], "rcs") != 0 && strcmp(args[1], "rcsT") != 0)) {
     llvm_unreachable(
-        "Expected archiver command line: llvm-ar rcs <archive file> "
+        "Expected archiver command line: llvm-ar rcs[T] <archive file> "
         "<object file> ...");
     return -1;
   }
 
+  llvm_ar::Thin = args[1][3] == 'T';
   llvm_ar::ArchiveName = args[2];
 
   auto membersSlice = args.slice(3);
@@ -260,14 +320,39 @@ int internalLib(ArrayRef<const char *> args) {
 static llvm::cl::opt<std::string> ar("ar", llvm::cl::desc("Archiver"),
                                      llvm::cl::Hidden, llvm::cl::ZeroOrMore);
 
+static llvm::cl::opt<bool> thinArchive(
+    "thin-archive", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Create a thin static library referencing the object files "
+                   "instead of copying them (not supported for MSVC targets)"),
+    llvm::cl::cat(opts::linkingCategory));
+
+bool canCreateStaticLibraryFromMemory() {
+  return global.params.lib && global.params.cleanupObjectFiles && ar.empty() &&
+         !thinArchive &&
+         !global.params.targetTriple->isWindowsMSVCEnvironment();
+}
+
 int createStaticLibrary() {
   Logger::println("*** Creating static library ***");
+  timereport::Scope timeScope("Archiving");
 
   const bool isTargetMSVC =
       global.params.targetTriple->isWindowsMSVCEnvironment();
 
   const bool useInternalArchiver = ar.empty();
 
+  if (thinArchive) {
+    if (isTargetMSVC) {
+      error(Loc(), "-thin-archive is not supported for MSVC targets");
+      fatal();
+    }
+    // The archive only references the object files, so they must be kept.
+    if (global.params.cleanupObjectFiles) {
+      error(Loc(), "-thin-archive cannot be combined with -cleanup-obj");
+      fatal();
+    }
+  }
+
   // find archiver
   std::string tool;
   if (useInternalArchiver) {
@@ -286,7 +371,7 @@ int createStaticLibrary() {
 
   // ask ar to create a new library
   if (!isTargetMSVC) {
-    args.push_back("rcs");
+    args.push_back(thinArchive ? "rcsT" : "rcs");
   }
 
   // ask lib.exe to be quiet
@@ -16,4 +16,11 @@
  */
 int createStaticLibrary();
 
+/**
+ * Indicates whether the object files for the static library don't need to be
+ * written to disk, i.e., whether they are removed afterwards anyway and the
+ * internal archiver can read them from memory.
+ */
+bool canCreateStaticLibraryFromMemory();
+
 #endif // !LDC_DRIVER_ARCHIVER_H
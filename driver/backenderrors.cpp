@@ -0,0 +1,77 @@
+//===-- backenderrors.cpp -------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/backenderrors.h"
+
+#include "dmd/errors.h"
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+thread_local bool isWorkerThread = false;
+
+std::mutex deferredErrorsMutex;
+std::vector<std::pair<Loc, std::string>> deferredErrors;
+
+std::string formatMessage(const char *format, va_list ap) {
+  va_list apCopy;
+  va_copy(apCopy, ap);
+  const int length = vsnprintf(nullptr, 0, format, apCopy);
+  va_end(apCopy);
+  if (length <= 0)
+    return std::string();
+
+  std::string message(length + 1, '\0');
+  vsnprintf(&message[0], message.size(), format, ap);
+  message.resize(length);
+  return message;
+}
+}
+
+BackendWorkerScope::BackendWorkerScope() { isWorkerThread = true; }
+
+BackendWorkerScope::~BackendWorkerScope() { isWorkerThread = false; }
+
+bool isBackendWorkerThread() { return isWorkerThread; }
+
+void backendError(const Loc &loc, const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  if (!isWorkerThread) {
+    verror(loc, format, ap);
+    va_end(ap);
+    fatal();
+  }
+  std::string message = formatMessage(format, ap);
+  va_end(ap);
+
+  std::lock_guard<std::mutex> lock(deferredErrorsMutex);
+  deferredErrors.emplace_back(loc, std::move(message));
+}
+
+void reportBackendErrors() {
+  if (isWorkerThread)
+    return;
+
+  std::vector<std::pair<Loc, std::string>> errors;
+  {
+    std::lock_guard<std::mutex> lock(deferredErrorsMutex);
+    errors.swap(deferredErrors);
+  }
+  if (errors.empty())
+    return;
+
+  for (const auto &e : errors)
+    error(e.first, "%s", e.second.c_str());
+  fatal();
+}
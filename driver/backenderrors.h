@@ -0,0 +1,48 @@
+//===-- driver/backenderrors.h - Errors on backend threads ------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The frontend's error reporting (error(), global.errors, fatal()) isn't
+// thread-safe. Code which may run on a backend worker thread therefore reports
+// errors via backendError(); the errors of workers are collected and reported
+// by the main thread after joining them (reportBackendErrors()).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_BACKENDERRORS_H
+#define LDC_DRIVER_BACKENDERRORS_H
+
+#include "dmd/globals.h"
+
+/// Marks the calling thread as a backend worker for the lifetime of the
+/// object.
+class BackendWorkerScope {
+public:
+  BackendWorkerScope();
+  ~BackendWorkerScope();
+  BackendWorkerScope(const BackendWorkerScope &) = delete;
+  BackendWorkerScope &operator=(const BackendWorkerScope &) = delete;
+};
+
+/// Returns whether the calling thread is a backend worker, which shouldn't
+/// start a thread pool of its own.
+bool isBackendWorkerThread();
+
+/// On the main thread, reports the error and aborts the compilation. On a
+/// worker, only records the error; the caller then has to skip whatever
+/// depends on the failed operation.
+D_ATTRIBUTE_FORMAT(2, 3)
+void backendError(const Loc &loc, const char *format, ...);
+
+/// Reports the errors recorded by workers in the order they occurred, and
+/// aborts the compilation if there were any. To be called after joining the
+/// workers; a no-op on a worker itself (which may run a nested pool), whose
+/// errors are then reported once the main thread has joined it.
+void reportBackendErrors();
+
+#endif
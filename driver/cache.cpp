@@ -18,22 +18,42 @@
 // changes that trigger recompilation of many files but with little effective
 // changes (in the extreme case, adding a comment in a "globals.d").
 //
-// The current limitation is that hashing and cache look-up are done with
-// whole-module granularity. Future work could attempt to do this for module
-// "fragments".
+// By default, hashing and cache look-up are done with whole-module
+// granularity. With -cache-fragments=<N>, each module is split into <N>
+// fragments (with llvm::SplitModule) before optimization, which are hashed,
+// cached and emitted (to separate object files) independently. A small change
+// then only invalidates the fragment(s) containing the changed symbols, at the
+// cost of losing inlining across fragments.
 //
 // The hash depends on the IR code (obviously), but also on the compiler+LLVM
 // versions and several compile flags (e.g. -O*, -mcpu, and -mattr).
 //
+// Optionally (-cache-optimized-ir, default with LTO), the optimized IR is
+// cached too, under the same hash as a .bc entry. A hit skips the optimizer,
+// which is the only cache tier applicable to LTO builds (emitting bitcode).
+//
+// With -cache-compression, object files are stored zlib-compressed and
+// decompressed into the output file when recovered. Entries of both formats
+// can coexist in a cache directory. Pruning limits apply to the compressed
+// size.
+//
+// Stores of and accesses to cache entries are recorded in an index file, so
+// that pruning doesn't need to walk the cache directory (see cache_index.cpp).
+//
 //===----------------------------------------------------------------------===//
 
 #include "driver/cache.h"
 
 #include "dmd/errors.h"
+#include "dmd/globals.h"
+#include "driver/backenderrors.h"
+#include "driver/cache_index.h"
 #include "driver/cache_pruning.h"
 #include "driver/cl_options.h"
 #include "driver/cl_options_sanitizers.h"
+#include "driver/exe_path.h"
 #include "driver/ldc-version.h"
+#include "driver/timereport.h"
 #include "gen/logger.h"
 #include "gen/optimizer.h"
 
@@ -44,10 +64,25 @@
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/Support/TimeValue.h"
 #endif
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/Compression.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
+#if LDC_LLVM_VER >= 400
+#include "llvm/Support/xxhash.h"
+#endif
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <memory>
 
 // Include close() declaration.
 #if !defined(_MSC_VER) && !defined(__MINGW32__)
@@ -139,6 +174,21 @@ llvm::cl::opt<unsigned> pruneSizeLimitPercentage(
         "space (default: 75%). Implies -cache-prune."),
     llvm::cl::value_desc("perc"), llvm::cl::init(75));
 
+enum class PruneMode { Sync, Thread, Process };
+llvm::cl::opt<PruneMode> pruneMode(
+    "cache-prune-mode", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Set how the cache is pruned (default: sync)."),
+    llvm::cl::init(PruneMode::Sync),
+    clEnumValues(
+        clEnumValN(PruneMode::Sync, "sync",
+                   "Prune based on the cache index after codegen"),
+        clEnumValN(PruneMode::Thread, "thread",
+                   "Prune based on the cache index on a background thread, "
+                   "concurrently to linking"),
+        clEnumValN(PruneMode::Process, "process",
+                   "Spawn a detached ldc-prune-cache process (which walks the "
+                   "cache directory)")));
+
 enum class RetrievalMode { Copy, HardLink, AnyLink, SymLink };
 llvm::cl::opt<RetrievalMode> cacheRecoveryMode(
     "cache-retrieval", llvm::cl::ZeroOrMore,
@@ -155,6 +205,60 @@ llvm::cl::opt<RetrievalMode> cacheRecoveryMode(
         clEnumValN(RetrievalMode::SymLink, "symlink",
                    "Create a symbolic link to the cache file")));
 
+llvm::cl::opt<std::string> remoteCache(
+    "cache-remote", llvm::cl::ZeroOrMore, llvm::cl::value_desc("url|dir"),
+    llvm::cl::desc(
+        "Share cached object files via a remote store, with the -cache "
+        "directory as local write-through cache. Either an http(s):// URL of "
+        "a store supporting GET and PUT of <url>/<entry> (requires curl), or "
+        "a (shared/network) directory (experimental)."));
+
+llvm::cl::opt<bool> cacheOptimizedIR(
+    "cache-optimized-ir", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Also cache the optimized LLVM IR of modules, so that a hit "
+                   "skips the optimizer even if machine codegen is needed. "
+                   "Enabled by default with -flto, for which object files "
+                   "aren't cached."));
+
+llvm::cl::opt<std::string> cacheStats(
+    "cache-stats", llvm::cl::ZeroOrMore, llvm::cl::ValueOptional,
+    llvm::cl::value_desc("text|json"),
+    llvm::cl::desc("Print statistics of this invocation and cumulative ones for "
+                   "the cache directory, as 'text' (default) or 'json'"));
+
+enum class Compression { None, Fast, Default, Size };
+llvm::cl::opt<Compression> cacheCompression(
+    "cache-compression", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Store cached object files zlib-compressed (default: "
+                   "none). Compressed entries are decompressed when "
+                   "retrieved, regardless of -cache-retrieval."),
+    llvm::cl::init(Compression::None),
+    clEnumValues(
+        clEnumValN(Compression::None, "none", "Store object files as is"),
+        clEnumValN(Compression::Fast, "fast", "Fastest compression"),
+        clEnumValN(Compression::Default, "default", "Default zlib level"),
+        clEnumValN(Compression::Size, "size", "Best compression")));
+
+enum class HashAlgorithm { MD5, XXHash64 };
+#if LDC_LLVM_VER >= 400
+llvm::cl::opt<HashAlgorithm> cacheHashAlgorithm(
+    "cache-hash", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Set the hash function for cache keys (default: xxhash)."),
+    llvm::cl::init(HashAlgorithm::XXHash64),
+    clEnumValues(clEnumValN(HashAlgorithm::MD5, "md5",
+                            "MD5 (slower, cryptographic)"),
+                 clEnumValN(HashAlgorithm::XXHash64, "xxhash",
+                            "64-bit xxHash and bitcode size (fast)")));
+#else
+// xxHash is only available with LLVM 4.0+.
+llvm::cl::opt<HashAlgorithm> cacheHashAlgorithm(
+    "cache-hash", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Set the hash function for cache keys (default: md5)."),
+    llvm::cl::init(HashAlgorithm::MD5),
+    clEnumValues(clEnumValN(HashAlgorithm::MD5, "md5",
+                            "MD5 (slower, cryptographic)")));
+#endif
+
 bool isPruningEnabled() {
   if (pruneEnabled)
     return true;
@@ -206,11 +310,190 @@ public:
   }
 };
 
+// Cache entries are object files by default, or optimized bitcode (.bc) for
+// the optimized IR tier.
+std::string getCacheEntryName(llvm::StringRef cacheObjectHash,
+                              const char *extension = global.obj_ext) {
+  return (llvm::Twine("ircache_") + cacheObjectHash + "." + extension).str();
+}
+
 void storeCacheFileName(llvm::StringRef cacheObjectHash,
-                        llvm::SmallString<128> &filePath) {
+                        llvm::SmallString<128> &filePath,
+                        const char *extension = global.obj_ext) {
   filePath = opts::cacheDir;
-  llvm::sys::path::append(filePath, llvm::Twine("ircache_") + cacheObjectHash +
-                                        "." + global.obj_ext);
+  llvm::sys::path::append(filePath,
+                          getCacheEntryName(cacheObjectHash, extension));
+}
+
+/// A store shared between machines (e.g., CI workers), backing the local
+/// cache directory. Failures are never fatal; they just result in cache
+/// misses.
+class RemoteStore {
+public:
+  virtual ~RemoteStore() = default;
+
+  /// Downloads the entry with the given name to `localFile`.
+  /// Returns true if the entry was found.
+  virtual bool fetch(llvm::StringRef entryName, llvm::StringRef localFile) = 0;
+
+  /// Uploads `localFile` as entry with the given name.
+  virtual void store(llvm::StringRef entryName, llvm::StringRef localFile) = 0;
+};
+
+/// A remote store in a directory, e.g., on a network share.
+class DirectoryStore : public RemoteStore {
+  std::string directory;
+
+  void entryPath(llvm::StringRef entryName, llvm::SmallString<128> &path) {
+    path = directory;
+    llvm::sys::path::append(path, entryName);
+  }
+
+public:
+  explicit DirectoryStore(std::string directory)
+      : directory(std::move(directory)) {}
+
+  bool fetch(llvm::StringRef entryName, llvm::StringRef localFile) override {
+    llvm::SmallString<128> path;
+    entryPath(entryName, path);
+    return llvm::sys::fs::exists(path.c_str()) &&
+           !llvm::sys::fs::copy_file(path.c_str(), localFile);
+  }
+
+  void store(llvm::StringRef entryName, llvm::StringRef localFile) override {
+    llvm::SmallString<128> path;
+    entryPath(entryName, path);
+    if (llvm::sys::fs::exists(path.c_str()))
+      return;
+
+    // Store atomically, as other machines may access the entry concurrently.
+    llvm::SmallString<128> tempFile;
+    if (llvm::sys::fs::create_directories(directory) ||
+        llvm::sys::fs::createUniqueFile(llvm::Twine(path) + ".tmp%%%%%%%",
+                                        tempFile)) {
+      IF_LOG Logger::println("Could not create temp file in remote cache %s",
+                             directory.c_str());
+      return;
+    }
+    if (llvm::sys::fs::copy_file(localFile, tempFile.c_str()) ||
+        llvm::sys::fs::rename(tempFile.c_str(), path.c_str())) {
+      IF_LOG Logger::println("Failed to store %s in remote cache",
+                             entryName.str().c_str());
+      llvm::sys::fs::remove(tempFile.c_str());
+    }
+  }
+};
+
+/// A remote store accessed via HTTP GET and PUT requests, using curl.
+/// Compatible with simple HTTP key-value caches, e.g., WebDAV servers or
+/// Bazel-style HTTP remote caches.
+class HTTPStore : public RemoteStore {
+  std::string baseURL;
+  std::string curl;
+
+  bool runCurl(std::vector<std::string> args) {
+    args.insert(args.begin(), {curl, "--silent", "--fail", "--location"});
+#if LDC_LLVM_VER >= 700
+    std::vector<llvm::StringRef> argv(args.begin(), args.end());
+    auto envVars = llvm::None;
+#else
+    std::vector<const char *> cargs;
+    for (const auto &arg : args)
+      cargs.push_back(arg.c_str());
+    cargs.push_back(nullptr); // terminate with null
+    auto argv = &cargs[0];
+    auto envVars = nullptr;
+#endif
+    std::string errstr;
+    const int status = llvm::sys::ExecuteAndWait(curl, argv, envVars,
+#if LDC_LLVM_VER >= 600
+                                                 {},
+#else
+                                                 nullptr,
+#endif
+                                                 0, 0, &errstr);
+    if (status != 0) {
+      IF_LOG Logger::println("curl failed with status %d %s", status,
+                             errstr.c_str());
+    }
+    return status == 0;
+  }
+
+public:
+  HTTPStore(llvm::StringRef url, std::string curl)
+      : baseURL(url.rtrim('/')), curl(std::move(curl)) {}
+
+  bool fetch(llvm::StringRef entryName, llvm::StringRef localFile) override {
+    if (runCurl({"--output", localFile.str(), baseURL + "/" + entryName.str()}))
+      return true;
+    llvm::sys::fs::remove(localFile);
+    return false;
+  }
+
+  void store(llvm::StringRef entryName, llvm::StringRef localFile) override {
+    runCurl({"--upload-file", localFile.str(),
+             baseURL + "/" + entryName.str()});
+  }
+};
+
+std::unique_ptr<RemoteStore> createRemoteStore() {
+  if (remoteCache.empty())
+    return nullptr;
+
+  llvm::StringRef location = remoteCache;
+  if (location.startswith("http://") || location.startswith("https://")) {
+    auto curl = llvm::sys::findProgramByName("curl");
+    if (!curl) {
+      backendError(Loc(), "-cache-remote: failed to locate curl");
+      return nullptr;
+    }
+    IF_LOG Logger::println("Using HTTP remote cache at %s", location.data());
+    return llvm::make_unique<HTTPStore>(location, curl.get());
+  }
+
+  llvm::SmallString<128> directory(location);
+  llvm::sys::fs::make_absolute(directory);
+  IF_LOG Logger::println("Using remote cache directory %s", directory.c_str());
+  return llvm::make_unique<DirectoryStore>(directory.str());
+}
+
+/// Returns the remote store or null if -cache-remote wasn't specified.
+RemoteStore *getRemoteStore() {
+  static std::unique_ptr<RemoteStore> store = createRemoteStore();
+  return store.get();
+}
+
+/// Tries to fetch a cache entry from the remote store into the local cache
+/// directory. Returns true upon success.
+bool fetchFromRemoteStore(const llvm::SmallString<128> &cacheFile) {
+  RemoteStore *remote = getRemoteStore();
+  if (!remote)
+    return false;
+
+  if (!llvm::sys::fs::exists(opts::cacheDir) &&
+      llvm::sys::fs::create_directories(opts::cacheDir))
+    return false;
+
+  // Download to a temporary file first, then rename atomically (see
+  // cacheObjectFile()).
+  llvm::SmallString<128> tempFile;
+  if (llvm::sys::fs::createUniqueFile(llvm::Twine(cacheFile) + ".tmp%%%%%%%",
+                                      tempFile))
+    return false;
+
+  if (!remote->fetch(llvm::sys::path::filename(cacheFile), tempFile)) {
+    IF_LOG Logger::println("Cache object not found in remote store.");
+    llvm::sys::fs::remove(tempFile.c_str());
+    return false;
+  }
+
+  if (llvm::sys::fs::rename(tempFile.c_str(), cacheFile.c_str())) {
+    llvm::sys::fs::remove(tempFile.c_str());
+    return false;
+  }
+
+  IF_LOG Logger::println("Cache object fetched from remote store.");
+  return true;
 }
 
 // Output to `hash_os` all commandline flags, and try to skip the ones that have
@@ -273,6 +556,9 @@ void outputIR2ObjRelevantCmdlineArgs(llvm::raw_ostream &hash_os) {
       // All  "-cache..." options can be ignored
       if (strncmp(arg + 1, "cache", 5) == 0)
         continue;
+      // "-j..." only affects the number of backend threads
+      if (arg[1] == 'j' && (!arg[2] || arg[2] == '='))
+        continue;
       // Ignore "-lib"
       if (arg[1] == 'l' && arg[2] == 'i' && arg[3] == 'b' && !arg[4])
         continue;
@@ -283,6 +569,11 @@ void outputIR2ObjRelevantCmdlineArgs(llvm::raw_ostream &hash_os) {
       if (strcmp(arg + 1, "unittest") == 0) {
         continue;
       }
+      // The remapped paths are already included in the IR hash, and the
+      // original prefixes differ between checkouts.
+      if (strncmp(arg + 1, "ffile-prefix-map", 16) == 0 ||
+          strncmp(arg + 1, "fdebug-prefix-map", 17) == 0)
+        continue;
 
       // All arguments following -run can safely be ignored
       if (strcmp(arg + 1, "run") == 0) {
@@ -290,8 +581,17 @@ void outputIR2ObjRelevantCmdlineArgs(llvm::raw_ostream &hash_os) {
       }
     }
 
-    // If we reach here, add the argument to the hash.
-    hash_os << arg;
+    // If we reach here, add the argument to the hash. Source file paths (and
+    // paths given as "-option=<path>") are remapped with -ffile-prefix-map,
+    // so that different checkouts of the same sources share cache entries.
+    const char *value = arg[0] == '-' ? strchr(arg, '=') : nullptr;
+    if (arg[0] != '-')
+      hash_os << opts::remapFilePath(arg);
+    else if (value)
+      hash_os << llvm::StringRef(arg, value + 1 - arg)
+              << opts::remapFilePath(value + 1);
+    else
+      hash_os << arg;
   }
 
   // Adding these options to the hash should not be needed after adding all
@@ -324,13 +624,9 @@ void outputIR2ObjRelevantEnvironmentOpts(llvm::raw_ostream &hash_os) {
   // There are no relevant environment options at the moment.
 }
 
-} // anonymous namespace
-
-namespace cache {
-
-void calculateModuleHash(llvm::Module *m, llvm::SmallString<32> &str) {
-  raw_hash_ostream hash_os;
-
+// Output to `hash_os` everything besides the IR that the object file output
+// depends on.
+void outputCompilerAndFlags(llvm::raw_ostream &hash_os) {
   // Let hash depend on the compiler version:
   hash_os << global.ldc_version << global.version << global.llvm_version
           << ldc::built_with_Dcompiler_version;
@@ -340,33 +636,440 @@ void calculateModuleHash(llvm::Module *m, llvm::SmallString<32> &str) {
   // for hashing:
   outputIR2ObjRelevantCmdlineArgs(hash_os);
   outputIR2ObjRelevantEnvironmentOpts(hash_os);
+}
+
+/// Returns everything besides the IR that the object file output depends on,
+/// to be hashed together with the IR. Computed once per process.
+const std::string &getCompilerAndFlagsHashPrefix() {
+  static const std::string prefix = [] {
+    std::string str;
+    llvm::raw_string_ostream os(str);
+    outputCompilerAndFlags(os);
+    os.flush();
+    return str;
+  }();
+  return prefix;
+}
+
+/// Hashes the compiler/flags prefix and the bitcode with xxHash64. The result
+/// is the 64-bit hash, followed by the bitcode size to further reduce the
+/// probability of collisions, as 32 hex digits (like an MD5 hash, which the
+/// cache pruning file pattern relies on).
+void hashWithXXHash(llvm::StringRef bitcode, llvm::StringRef salt,
+                    llvm::SmallString<32> &str) {
+#if LDC_LLVM_VER >= 400
+  const uint64_t bitcodeHash = llvm::xxHash64(bitcode);
+  llvm::SmallString<128> keyed(getCompilerAndFlagsHashPrefix());
+  keyed.append(salt.begin(), salt.end());
+  keyed.append(reinterpret_cast<const char *>(&bitcodeHash),
+               reinterpret_cast<const char *>(&bitcodeHash) +
+                   sizeof(bitcodeHash));
+  const uint64_t hash = llvm::xxHash64(keyed);
+
+  str.clear();
+  llvm::raw_svector_ostream os(str);
+  os << llvm::format_hex_no_prefix(hash, 16)
+     << llvm::format_hex_no_prefix(bitcode.size(), 16);
+#else
+  llvm_unreachable("-cache-hash=xxhash requires LLVM 4.0+");
+#endif
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Cache statistics (see -cache-stats).
+// The counters are atomic, as the cache may be accessed by parallel backend
+// threads. Times are in microseconds.
+enum Stat {
+  Lookups,
+  Hits,
+  Misses,
+  IRHits,
+  IRMisses,
+  BytesStored,
+  BytesRecovered,
+  Evictions,
+  HashTime,
+  LookupTime,
+  StoreTime,
+  RecoverTime,
+  PruneTime,
+  NumStats
+};
+const char *const statNames[NumStats] = {
+    "lookups",        "hits",          "misses",
+    "ir_hits",        "ir_misses",
+    "bytes_stored",   "bytes_recovered", "evictions",
+    "hash_time_us",   "lookup_time_us", "store_time_us",
+    "recover_time_us", "prune_time_us"};
+std::atomic<uint64_t> statValues[NumStats];
+
+void addStat(Stat stat, uint64_t value) { statValues[stat] += value; }
+
+/// Adds the lifetime of the timer to a time statistic (and to the time report,
+/// see -ftime-report).
+class StatTimer {
+  Stat stat;
+  std::chrono::steady_clock::time_point start;
+  timereport::Scope timeScope;
+
+public:
+  explicit StatTimer(Stat stat)
+      : stat(stat), start(std::chrono::steady_clock::now()),
+        timeScope("IR-to-object cache") {}
+  ~StatTimer() {
+    addStat(stat, std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count());
+  }
+};
+
+uint64_t getFileSize(llvm::StringRef file) {
+  uint64_t size = 0;
+  return llvm::sys::fs::file_size(file, size) ? 0 : size;
+}
+
+/// Writes `contents` to a temporary file next to `path` and renames it to
+/// `path`, so that readers never see a partially written file. Returns false
+/// upon error.
+bool writeFileAtomically(llvm::StringRef path, llvm::StringRef contents) {
+  int fd;
+  llvm::SmallString<128> tempFile;
+  if (llvm::sys::fs::createUniqueFile(llvm::Twine(path) + ".tmp%%%%%%%", fd,
+                                      tempFile))
+    return false;
+
+  bool failed;
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    os << contents;
+    os.close();
+    failed = os.has_error();
+    os.clear_error();
+  }
+  if (failed || llvm::sys::fs::rename(tempFile.c_str(), path)) {
+    llvm::sys::fs::remove(tempFile.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Compressed cache entries start with this magic, followed by the size of the
+// object file as 64-bit little-endian integer and the zlib stream. Object
+// files of all supported formats start differently.
+const char compressedEntryMagic[] = {'L', 'D', 'C', 'Z', 'O', 'B', 'J', '1'};
+const size_t compressedEntryHeaderSize = sizeof(compressedEntryMagic) + 8;
+
+bool isCompressedEntry(llvm::StringRef contents) {
+  return contents.size() >= compressedEntryHeaderSize &&
+         contents.startswith(llvm::StringRef(compressedEntryMagic,
+                                             sizeof(compressedEntryMagic)));
+}
+
+bool isCompressedFile(llvm::StringRef file) {
+  auto header =
+      llvm::MemoryBuffer::getFileSlice(file, compressedEntryHeaderSize, 0);
+  return header && isCompressedEntry((*header)->getBuffer());
+}
+
+llvm::zlib::CompressionLevel getCompressionLevel() {
+  switch (cacheCompression) {
+  case Compression::Fast:
+    return llvm::zlib::BestSpeedCompression;
+  case Compression::Size:
+    return llvm::zlib::BestSizeCompression;
+  default:
+    return llvm::zlib::DefaultCompression;
+  }
+}
 
+/// Compresses an object file to a cache entry. Returns false upon error.
+bool compressEntry(llvm::StringRef object, llvm::SmallVectorImpl<char> &entry) {
+  llvm::SmallVector<char, 0> compressed;
+#if LDC_LLVM_VER >= 500
+  if (auto err = llvm::zlib::compress(object, compressed,
+                                      getCompressionLevel())) {
+    IF_LOG Logger::println("Compression failed: %s",
+                           llvm::toString(std::move(err)).c_str());
+    return false;
+  }
+#else
+  if (llvm::zlib::compress(object, compressed, getCompressionLevel()) !=
+      llvm::zlib::StatusOK) {
+    IF_LOG Logger::println("Compression failed");
+    return false;
+  }
+#endif
+
+  const uint64_t size = object.size();
+  entry.clear();
+  entry.append(std::begin(compressedEntryMagic),
+               std::end(compressedEntryMagic));
+  for (unsigned i = 0; i < 8; ++i)
+    entry.push_back(static_cast<char>((size >> (8 * i)) & 0xFF));
+  entry.append(compressed.begin(), compressed.end());
+  return true;
+}
+
+/// Decompresses a compressed cache entry. Returns false upon error.
+bool decompressEntry(llvm::StringRef entry,
+                     llvm::SmallVectorImpl<char> &object) {
+  uint64_t size = 0;
+  for (unsigned i = 0; i < 8; ++i) {
+    size |= static_cast<uint64_t>(static_cast<unsigned char>(
+                entry[sizeof(compressedEntryMagic) + i]))
+            << (8 * i);
+  }
+  const auto compressed = entry.substr(compressedEntryHeaderSize);
+#if LDC_LLVM_VER >= 500
+  if (auto err = llvm::zlib::uncompress(compressed, object, size)) {
+    IF_LOG Logger::println("Decompression failed: %s",
+                           llvm::toString(std::move(err)).c_str());
+    return false;
+  }
+#else
+  if (llvm::zlib::uncompress(compressed, object, size) !=
+      llvm::zlib::StatusOK) {
+    IF_LOG Logger::println("Decompression failed");
+    return false;
+  }
+#endif
+  return object.size() == size;
+}
+
+/// Returns the path of the file holding the cumulative statistics of the
+/// cache directory.
+void getStatsFileName(llvm::SmallString<128> &filePath) {
+  filePath = opts::cacheDir;
+  llvm::sys::path::append(filePath, "ircache_stats");
+}
+
+/// Reads the cumulative statistics of the cache directory (lines of
+/// `<name> <value>`).
+void readCumulativeStats(uint64_t (&values)[NumStats]) {
+  for (auto &value : values)
+    value = 0;
+
+  llvm::SmallString<128> statsFile;
+  getStatsFileName(statsFile);
+  auto buffer = llvm::MemoryBuffer::getFile(statsFile);
+  if (!buffer)
+    return;
+
+  llvm::SmallVector<llvm::StringRef, 16> lines;
+  buffer.get()->getBuffer().split(lines, '\n', -1, /*KeepEmpty=*/false);
+  for (auto line : lines) {
+    const auto pair = line.split(' ');
+    for (int i = 0; i < NumStats; ++i) {
+      if (pair.first == statNames[i]) {
+        pair.second.trim().getAsInteger(10, values[i]);
+        break;
+      }
+    }
+  }
+}
+
+/// Atomically replaces the cumulative statistics of the cache directory.
+/// Concurrent compiler invocations may lose each other's updates, so the
+/// cumulative numbers are approximate.
+void writeCumulativeStats(const uint64_t (&values)[NumStats]) {
+  llvm::SmallString<128> statsFile;
+  getStatsFileName(statsFile);
+
+  int fd;
+  llvm::SmallString<128> tempFile;
+  if (llvm::sys::fs::createUniqueFile(llvm::Twine(statsFile) + ".tmp%%%%%%%",
+                                      fd, tempFile))
+    return;
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    for (int i = 0; i < NumStats; ++i)
+      os << statNames[i] << ' ' << values[i] << '\n';
+  }
+  if (llvm::sys::fs::rename(tempFile.c_str(), statsFile.c_str()))
+    llvm::sys::fs::remove(tempFile.c_str());
+}
+
+void printStats(llvm::raw_ostream &os, bool json,
+                const uint64_t (&invocation)[NumStats],
+                const uint64_t (&cumulative)[NumStats]) {
+  if (json) {
+    const auto printObject = [&os](const uint64_t(&values)[NumStats]) {
+      os << '{';
+      for (int i = 0; i < NumStats; ++i)
+        os << (i ? ", " : "") << '"' << statNames[i] << "\": " << values[i];
+      os << '}';
+    };
+    os << "{\"cache_dir\": \"";
+    os.write_escaped(opts::cacheDir);
+    os << "\", \"invocation\": ";
+    printObject(invocation);
+    os << ", \"cumulative\": ";
+    printObject(cumulative);
+    os << "}\n";
+    return;
+  }
+
+  os << "Cache statistics for " << opts::cacheDir
+     << " (this invocation / cumulative):\n";
+  for (int i = 0; i < NumStats; ++i) {
+    os << "  " << statNames[i] << ':';
+    os.indent(18 - std::strlen(statNames[i]))
+        << invocation[i] << " / " << cumulative[i] << '\n';
+  }
+  const uint64_t lookups = invocation[Lookups];
+  if (lookups) {
+    os << "  hit rate: "
+       << llvm::format("%.1f%%", 100.0 * invocation[Hits] / lookups) << '\n';
+  }
+}
+
+// The background pruning thread (-cache-prune-mode=thread). The destructor of
+// a std::async future blocks at program exit until pruning has finished.
+std::future<size_t> pruningThread;
+
+void startPruningThread() {
+  // Copy all parameters, the thread may outlive the cl::opts.
+  const std::string cacheDir = opts::cacheDir;
+  const unsigned interval = pruneInterval;
+  const unsigned expiration = pruneExpiration;
+  const uint64_t sizeLimit = pruneSizeLimitInBytes;
+  const unsigned sizeLimitPercentage = pruneSizeLimitPercentage;
+
+  IF_LOG Logger::println("Prune cache on a background thread");
+  pruningThread = std::async(std::launch::async, [=]() {
+    return pruneCacheUsingIndex(cacheDir, interval, expiration, sizeLimit,
+                                sizeLimitPercentage);
+  });
+}
+
+/// Spawns a detached ldc-prune-cache process. Returns false if that failed.
+bool spawnPruningProcess() {
+  auto tool = llvm::sys::findProgramByName("ldc-prune-cache",
+                                           {exe_path::getBinDir()});
+  if (!tool) {
+    IF_LOG Logger::println("ldc-prune-cache not found, prune in-process");
+    return false;
+  }
+
+  std::vector<std::string> args = {
+      tool.get(),
+      ("--interval=" + llvm::Twine(pruneInterval.getValue())).str(),
+      ("--expiry=" + llvm::Twine(pruneExpiration.getValue())).str(),
+      ("--max-bytes=" + llvm::Twine(pruneSizeLimitInBytes.getValue())).str(),
+      ("--max-percentage-of-avail=" +
+       llvm::Twine(pruneSizeLimitPercentage.getValue()))
+          .str(),
+      opts::cacheDir};
 #if LDC_LLVM_VER >= 700
-  llvm::WriteBitcodeToFile(*m, hash_os);
+  std::vector<llvm::StringRef> argv(args.begin(), args.end());
+  auto envVars = llvm::None;
 #else
-  llvm::WriteBitcodeToFile(m, hash_os);
+  std::vector<const char *> cargs;
+  for (const auto &arg : args)
+    cargs.push_back(arg.c_str());
+  cargs.push_back(nullptr); // terminate with null
+  auto argv = &cargs[0];
+  auto envVars = nullptr;
 #endif
-  hash_os.resultAsString(str);
-  IF_LOG Logger::println("Module's LLVM bitcode hash is: %s", str.c_str());
+  std::string errstr;
+  bool failed = false;
+  IF_LOG Logger::println("Spawn %s", tool.get().c_str());
+  llvm::sys::ExecuteNoWait(tool.get(), argv, envVars,
+#if LDC_LLVM_VER >= 600
+                           {},
+#else
+                           nullptr,
+#endif
+                           0, &errstr, &failed);
+  if (failed) {
+    IF_LOG Logger::println("Failed to spawn ldc-prune-cache: %s",
+                           errstr.c_str());
+  }
+  return !failed;
+}
+
+} // anonymous namespace
+
+namespace cache {
+
+void calculateModuleHash(llvm::Module *m, llvm::SmallString<32> &str,
+                         llvm::StringRef salt) {
+  StatTimer timer(HashTime);
+  const auto start = std::chrono::steady_clock::now();
+
+  if (cacheHashAlgorithm == HashAlgorithm::MD5) {
+    // Stream the bitcode straight into the hasher.
+    raw_hash_ostream hash_os;
+    hash_os << getCompilerAndFlagsHashPrefix() << salt;
+#if LDC_LLVM_VER >= 700
+    llvm::WriteBitcodeToFile(*m, hash_os);
+#else
+    llvm::WriteBitcodeToFile(m, hash_os);
+#endif
+    hash_os.resultAsString(str);
+  } else {
+    // xxHash needs the data in one piece.
+    llvm::SmallVector<char, 0> bitcode;
+    llvm::raw_svector_ostream os(bitcode);
+#if LDC_LLVM_VER >= 700
+    llvm::WriteBitcodeToFile(*m, os);
+#else
+    llvm::WriteBitcodeToFile(m, os);
+#endif
+    hashWithXXHash(llvm::StringRef(bitcode.data(), bitcode.size()), salt, str);
+  }
+
+  IF_LOG Logger::println("Module's LLVM bitcode hash is: %s (took %.3f ms)",
+                         str.c_str(), millisecondsSince(start));
+}
+
+void calculateBitcodeHash(llvm::StringRef bitcode, llvm::SmallString<32> &str) {
+  StatTimer timer(HashTime);
+  const auto start = std::chrono::steady_clock::now();
+
+  if (cacheHashAlgorithm == HashAlgorithm::MD5) {
+    raw_hash_ostream hash_os;
+    hash_os << getCompilerAndFlagsHashPrefix() << bitcode;
+    hash_os.resultAsString(str);
+  } else {
+    hashWithXXHash(bitcode, "", str);
+  }
+
+  IF_LOG Logger::println("LLVM bitcode hash is: %s (took %.3f ms)",
+                         str.c_str(), millisecondsSince(start));
 }
 
 std::string cacheLookup(llvm::StringRef cacheObjectHash) {
   if (opts::cacheDir.empty())
     return "";
 
+  StatTimer timer(LookupTime);
+  addStat(Lookups, 1);
+
+  llvm::SmallString<128> filePath;
+  storeCacheFileName(cacheObjectHash, filePath);
+
   if (!llvm::sys::fs::exists(opts::cacheDir)) {
     IF_LOG Logger::println("Cache directory does not exist, no object found.");
-    return "";
+  } else if (llvm::sys::fs::exists(filePath.c_str())) {
+    IF_LOG Logger::println("Cache object found! %s", filePath.c_str());
+    addStat(Hits, 1);
+    return filePath.str().str();
   }
 
-  llvm::SmallString<128> filePath;
-  storeCacheFileName(cacheObjectHash, filePath);
-  if (llvm::sys::fs::exists(filePath.c_str())) {
+  if (fetchFromRemoteStore(filePath)) {
     IF_LOG Logger::println("Cache object found! %s", filePath.c_str());
+    addStat(Hits, 1);
     return filePath.str().str();
   }
 
   IF_LOG Logger::println("Cache object not found.");
+  addStat(Misses, 1);
   return "";
 }
 
@@ -375,16 +1078,26 @@ void cacheObjectFile(llvm::StringRef objectFile,
   if (opts::cacheDir.empty())
     return;
 
+  StatTimer timer(StoreTime);
+
+  if (cacheCompression != Compression::None && !llvm::zlib::isAvailable()) {
+    backendError(Loc(),
+                 "-cache-compression requires LLVM to be built with zlib");
+    return;
+  }
+
   if (!llvm::sys::fs::exists(opts::cacheDir) &&
       llvm::sys::fs::create_directories(opts::cacheDir)) {
-    error(Loc(), "Unable to create cache directory: %s",
-          opts::cacheDir.c_str());
-    fatal();
+    backendError(Loc(), "Unable to create cache directory: %s",
+                 opts::cacheDir.c_str());
+    return;
   }
 
   // To prevent bad cache files, add files to the cache atomically: first copy
   // to a temporary file and then rename that temp file to the cache entry
-  // filename (rename is atomic).
+  // filename (rename is atomic). Concurrent readers thus either see no entry
+  // or a complete one, and concurrent stores of the same entry (with equal
+  // contents) are harmless.
 
   llvm::SmallString<128> cacheFile;
   storeCacheFileName(cacheObjectHash, cacheFile);
@@ -392,106 +1105,375 @@ void cacheObjectFile(llvm::StringRef objectFile,
   llvm::SmallString<128> tempFile;
   if (llvm::sys::fs::createUniqueFile(llvm::Twine(cacheFile) + ".tmp%%%%%%%",
                                       tempFile)) {
-    error(Loc(), "Could not create name of temporary file in the cache.");
-    fatal();
+    backendError(Loc(),
+                 "Could not create name of temporary file in the cache.");
+    return;
   }
 
-  IF_LOG Logger::println("Copy object file to temp file: %s to %s",
-                         objectFile.str().c_str(), tempFile.c_str());
-  if (llvm::sys::fs::copy_file(objectFile, tempFile.c_str())) {
-    error(Loc(), "Failed to copy object file to cache: %s to %s",
-          objectFile.str().c_str(), tempFile.c_str());
-    fatal();
+  if (cacheCompression != Compression::None) {
+    IF_LOG Logger::println("Compress object file to temp file: %s to %s",
+                           objectFile.str().c_str(), tempFile.c_str());
+    auto buffer = llvm::MemoryBuffer::getFile(objectFile);
+    llvm::SmallVector<char, 0> entry;
+    std::error_code ec;
+    if (buffer && compressEntry((*buffer)->getBuffer(), entry)) {
+      llvm::raw_fd_ostream os(tempFile, ec, llvm::sys::fs::F_None);
+      os.write(entry.data(), entry.size());
+    }
+    if (!buffer || entry.empty() || ec) {
+      backendError(Loc(), "Failed to compress object file to cache: %s to %s",
+                   objectFile.str().c_str(), tempFile.c_str());
+      llvm::sys::fs::remove(tempFile.c_str());
+      return;
+    }
+  } else {
+    IF_LOG Logger::println("Copy object file to temp file: %s to %s",
+                           objectFile.str().c_str(), tempFile.c_str());
+    if (llvm::sys::fs::copy_file(objectFile, tempFile.c_str())) {
+      backendError(Loc(), "Failed to copy object file to cache: %s to %s",
+                   objectFile.str().c_str(), tempFile.c_str());
+      return;
+    }
   }
   IF_LOG Logger::println("Rename temp file to cache file: %s to %s",
                          tempFile.c_str(), cacheFile.c_str());
   if (llvm::sys::fs::rename(tempFile.c_str(), cacheFile.c_str())) {
-    error(Loc(), "Failed to rename temp file to cache file: %s to %s",
-          tempFile.c_str(), cacheFile.c_str());
-    fatal();
+    llvm::sys::fs::remove(tempFile.c_str());
+    // On Windows, an existing entry can't be replaced while it is in use, e.g.
+    // after being stored by a concurrent invocation and linked to.
+    if (llvm::sys::fs::exists(cacheFile.c_str())) {
+      IF_LOG Logger::println("Cache file has been stored concurrently: %s",
+                             cacheFile.c_str());
+      return;
+    }
+    backendError(Loc(), "Failed to rename temp file to cache file: %s to %s",
+                 tempFile.c_str(), cacheFile.c_str());
+    return;
+  }
+
+  // The index (and thus pruning) accounts for the size of the stored entry,
+  // i.e., the compressed size.
+  const uint64_t cacheFileSize = getFileSize(cacheFile);
+  addStat(BytesStored, cacheFileSize);
+  recordIndexEntry(opts::cacheDir, getCacheEntryName(cacheObjectHash),
+                   cacheFileSize);
+
+  if (RemoteStore *remote = getRemoteStore()) {
+    IF_LOG Logger::println("Store object file in remote cache");
+    remote->store(getCacheEntryName(cacheObjectHash), cacheFile);
   }
 }
 
-void recoverObjectFile(llvm::StringRef cacheObjectHash,
+bool recoverObjectFile(llvm::StringRef cacheObjectHash,
                        llvm::StringRef objectFile) {
+  StatTimer timer(RecoverTime);
+
   llvm::SmallString<128> cacheFile;
   storeCacheFileName(cacheObjectHash, cacheFile);
 
+  // The entry may have been pruned by a concurrent invocation since the
+  // lookup; the object file then needs to be generated after all.
+  const auto pruned = [&cacheFile]() {
+    if (llvm::sys::fs::exists(cacheFile.c_str()))
+      return false;
+    IF_LOG Logger::println("Cache object was pruned concurrently: %s",
+                           cacheFile.c_str());
+    return true;
+  };
+
   // Remove the potentially pre-existing output file.
   llvm::sys::fs::remove(objectFile);
 
-  switch (cacheRecoveryMode) {
-  case RetrievalMode::Copy: {
-    IF_LOG Logger::println("Copy cached object file: %s -> %s",
-                           cacheFile.c_str(), objectFile.str().c_str());
-    if (llvm::sys::fs::copy_file(cacheFile.c_str(), objectFile)) {
-      error(Loc(), "Failed to copy the cached file: %s -> %s",
-            cacheFile.c_str(), objectFile.str().c_str());
-      fatal();
+  if (cacheRecoveryMode == RetrievalMode::Copy ||
+      isCompressedFile(cacheFile)) {
+    // Read the entry once, so that it can't change or vanish while copying,
+    // and rename the copy into place, so the output is never partial.
+    // Compressed entries can't be linked to; they are decompressed straight
+    // into the output file.
+    auto buffer = llvm::MemoryBuffer::getFile(cacheFile);
+    if (!buffer) {
+      if (pruned())
+        return false;
+      backendError(Loc(), "Failed to read the cached file: %s",
+                   cacheFile.c_str());
+      return false;
     }
-  } break;
-  case RetrievalMode::HardLink: {
-    IF_LOG Logger::println("HardLink output to cached object file: %s -> %s",
-                           objectFile.str().c_str(), cacheFile.c_str());
-    if (createHardLink(cacheFile.c_str(), objectFile.str().c_str())) {
-      error(Loc(), "Failed to create a hard link to the cached file: %s -> %s",
-            cacheFile.c_str(), objectFile.str().c_str());
-      fatal();
+
+    llvm::StringRef contents = (*buffer)->getBuffer();
+    llvm::SmallVector<char, 0> object;
+    if (isCompressedEntry(contents)) {
+      IF_LOG Logger::println("Decompress cached object file: %s -> %s",
+                             cacheFile.c_str(), objectFile.str().c_str());
+      if (!llvm::zlib::isAvailable()) {
+        backendError(Loc(),
+                     "Cached file %s is compressed, which requires LLVM to be "
+                     "built with zlib",
+                     cacheFile.c_str());
+        return false;
+      }
+      if (!decompressEntry(contents, object)) {
+        backendError(Loc(), "Failed to decompress the cached file: %s",
+                     cacheFile.c_str());
+        return false;
+      }
+      contents = llvm::StringRef(object.data(), object.size());
+    } else {
+      IF_LOG Logger::println("Copy cached object file: %s -> %s",
+                             cacheFile.c_str(), objectFile.str().c_str());
     }
-  } break;
-  case RetrievalMode::AnyLink: {
-    IF_LOG Logger::println("Link output to cached object file: %s -> %s",
-                           objectFile.str().c_str(), cacheFile.c_str());
-    if (llvm::sys::fs::create_link(cacheFile.c_str(), objectFile)) {
-      error(Loc(), "Failed to create a link to the cached file: %s -> %s",
-            cacheFile.c_str(), objectFile.str().c_str());
-      fatal();
+
+    if (!writeFileAtomically(objectFile, contents)) {
+      backendError(Loc(), "Failed to copy the cached file: %s -> %s",
+                   cacheFile.c_str(), objectFile.str().c_str());
+      return false;
     }
-  } break;
-  case RetrievalMode::SymLink: {
-    IF_LOG Logger::println("SymLink output to cached object file: %s -> %s",
-                           objectFile.str().c_str(), cacheFile.c_str());
-    if (createSymLink(cacheFile.c_str(), objectFile.str().c_str())) {
-      error(Loc(),
+  } else {
+    switch (cacheRecoveryMode) {
+    case RetrievalMode::Copy:
+      llvm_unreachable("handled above");
+    case RetrievalMode::HardLink: {
+      IF_LOG Logger::println(
+          "HardLink output to cached object file: %s -> %s",
+          objectFile.str().c_str(), cacheFile.c_str());
+      if (createHardLink(cacheFile.c_str(), objectFile.str().c_str())) {
+        if (pruned())
+          return false;
+        backendError(
+            Loc(), "Failed to create a hard link to the cached file: %s -> %s",
+            cacheFile.c_str(), objectFile.str().c_str());
+        return false;
+      }
+    } break;
+    case RetrievalMode::AnyLink: {
+      IF_LOG Logger::println("Link output to cached object file: %s -> %s",
+                             objectFile.str().c_str(), cacheFile.c_str());
+      if (llvm::sys::fs::create_link(cacheFile.c_str(), objectFile)) {
+        if (pruned())
+          return false;
+        backendError(Loc(),
+                     "Failed to create a link to the cached file: %s -> %s",
+                     cacheFile.c_str(), objectFile.str().c_str());
+        return false;
+      }
+    } break;
+    case RetrievalMode::SymLink: {
+      // Note that the symbolic link dangles if the entry is pruned before
+      // linking.
+      IF_LOG Logger::println("SymLink output to cached object file: %s -> %s",
+                             objectFile.str().c_str(), cacheFile.c_str());
+      if (createSymLink(cacheFile.c_str(), objectFile.str().c_str())) {
+        backendError(
+            Loc(),
             "Failed to create a symbolic link to the cached file: %s -> %s",
             cacheFile.c_str(), objectFile.str().c_str());
-      fatal();
+        return false;
+      }
+      if (pruned()) {
+        llvm::sys::fs::remove(objectFile);
+        return false;
+      }
+    } break;
     }
-  } break;
   }
 
+  const uint64_t cacheFileSize = getFileSize(cacheFile);
+  addStat(BytesRecovered, cacheFileSize);
+  recordIndexEntry(opts::cacheDir, getCacheEntryName(cacheObjectHash),
+                   cacheFileSize);
+
   // We reset the modification time to "now" such that the pruning algorithm
   // sees that the file should be kept over older files.
   // On some systems the last accessed time is not automatically updated so set
   // it explicitly here. Because the file will really only be accessed later
   // during linking, it's not perfect but it's the best we can do.
-  {
-    int FD;
-    if (llvm::sys::fs::openFileForWrite(cacheFile.c_str(), FD,
+  // This is best-effort only, as the entry may be pruned concurrently. Make
+  // sure not to recreate it (as an empty file) in that case.
+  int FD;
+  if (pruned() ||
+      llvm::sys::fs::openFileForWrite(cacheFile.c_str(), FD,
 #if LDC_LLVM_VER >= 700
-                                        llvm::sys::fs::CD_OpenExisting,
+                                      llvm::sys::fs::CD_OpenExisting,
 #endif
-                                        llvm::sys::fs::F_Append)) {
-      error(Loc(), "Failed to open the cached file for writing: %s",
-            cacheFile.c_str());
-      fatal();
-    }
+                                      llvm::sys::fs::F_Append)) {
+    return true;
+  }
+  if (llvm::sys::fs::setLastModificationAndAccessTime(FD, getTimeNow())) {
+    IF_LOG Logger::println(
+        "Failed to set the cached file modification time: %s",
+        cacheFile.c_str());
+  }
+  close(FD);
+  return true;
+}
 
-    if (llvm::sys::fs::setLastModificationAndAccessTime(FD, getTimeNow())) {
-      error(Loc(), "Failed to set the cached file modification time: %s",
-            cacheFile.c_str());
-      fatal();
+void pruneCache() {
+  if (opts::cacheDir.empty() || !isPruningEnabled())
+    return;
+
+  switch (pruneMode) {
+  case PruneMode::Sync: {
+    StatTimer timer(PruneTime);
+    addStat(Evictions,
+            pruneCacheUsingIndex(opts::cacheDir, pruneInterval,
+                                 pruneExpiration, pruneSizeLimitInBytes,
+                                 pruneSizeLimitPercentage));
+  } break;
+  case PruneMode::Thread:
+    startPruningThread();
+    break;
+  case PruneMode::Process:
+    if (!spawnPruningProcess()) {
+      StatTimer timer(PruneTime);
+      addStat(Evictions, ::pruneCache(opts::cacheDir.data(),
+                                      opts::cacheDir.size(), pruneInterval,
+                                      pruneExpiration, pruneSizeLimitInBytes,
+                                      pruneSizeLimitPercentage));
     }
+    break;
+  }
+}
+
+bool isOptimizedIRCacheEnabled(bool doLTO) {
+  if (opts::cacheDir.empty())
+    return false;
+  if (cacheOptimizedIR.getNumOccurrences() > 0)
+    return cacheOptimizedIR;
+  return doLTO;
+}
+
+std::unique_ptr<llvm::Module> lookupOptimizedIR(llvm::StringRef moduleHash,
+                                                llvm::LLVMContext &context) {
+  StatTimer timer(LookupTime);
+
+  llvm::SmallString<128> filePath;
+  storeCacheFileName(moduleHash, filePath, "bc");
+
+  if (!llvm::sys::fs::exists(filePath.c_str()) &&
+      !fetchFromRemoteStore(filePath)) {
+    IF_LOG Logger::println("Cached optimized IR not found.");
+    addStat(IRMisses, 1);
+    return nullptr;
+  }
 
-    close(FD);
+  llvm::SMDiagnostic err;
+  auto module = llvm::parseIRFile(filePath, err, context);
+  if (!module) {
+    // Corrupt entry (e.g., truncated by a full disk); evict it.
+    IF_LOG Logger::println("Failed to load cached optimized IR %s: %s",
+                           filePath.c_str(), err.getMessage().str().c_str());
+    llvm::sys::fs::remove(filePath.c_str());
+    addStat(IRMisses, 1);
+    return nullptr;
   }
+
+  IF_LOG Logger::println("Cached optimized IR found! %s", filePath.c_str());
+  addStat(IRHits, 1);
+  const uint64_t size = getFileSize(filePath);
+  addStat(BytesRecovered, size);
+  recordIndexEntry(opts::cacheDir, getCacheEntryName(moduleHash, "bc"), size);
+  return module;
 }
 
-void pruneCache() {
-  if (!opts::cacheDir.empty() && isPruningEnabled()) {
-    ::pruneCache(opts::cacheDir.data(), opts::cacheDir.size(), pruneInterval,
-                 pruneExpiration, pruneSizeLimitInBytes,
-                 pruneSizeLimitPercentage);
+void cacheOptimizedIR(llvm::Module *m, llvm::StringRef moduleHash) {
+  StatTimer timer(StoreTime);
+
+  if (!llvm::sys::fs::exists(opts::cacheDir) &&
+      llvm::sys::fs::create_directories(opts::cacheDir)) {
+    backendError(Loc(), "Unable to create cache directory: %s",
+                 opts::cacheDir.c_str());
+    return;
+  }
+
+  // Write to a temp file first and rename atomically (see cacheObjectFile()).
+  llvm::SmallString<128> cacheFile;
+  storeCacheFileName(moduleHash, cacheFile, "bc");
+
+  int fd;
+  llvm::SmallString<128> tempFile;
+  if (llvm::sys::fs::createUniqueFile(llvm::Twine(cacheFile) + ".tmp%%%%%%%",
+                                      fd, tempFile)) {
+    backendError(Loc(),
+                 "Could not create name of temporary file in the cache.");
+    return;
+  }
+
+  IF_LOG Logger::println("Write optimized IR to cache file: %s",
+                         cacheFile.c_str());
+  uint64_t size;
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+#if LDC_LLVM_VER >= 700
+    llvm::WriteBitcodeToFile(*m, os);
+#else
+    llvm::WriteBitcodeToFile(m, os);
+#endif
+    size = os.tell();
+  }
+  if (llvm::sys::fs::rename(tempFile.c_str(), cacheFile.c_str())) {
+    backendError(Loc(), "Failed to rename temp file to cache file: %s to %s",
+                 tempFile.c_str(), cacheFile.c_str());
+    return;
+  }
+  addStat(BytesStored, size);
+
+  const auto entryName = getCacheEntryName(moduleHash, "bc");
+  recordIndexEntry(opts::cacheDir, entryName, size);
+
+  if (RemoteStore *remote = getRemoteStore()) {
+    IF_LOG Logger::println("Store optimized IR in remote cache");
+    remote->store(entryName, cacheFile);
+  }
+}
+
+bool getPruningPolicy(PruningPolicy &policy) {
+  if (!isPruningEnabled())
+    return false;
+
+  policy.interval = pruneInterval;
+  policy.expiration = pruneExpiration;
+  policy.sizeLimitPercentage = pruneSizeLimitPercentage;
+  policy.sizeLimitInBytes = pruneSizeLimitInBytes;
+  return true;
+}
+
+std::string getThinLTOCacheDir() {
+  if (opts::cacheDir.empty())
+    return "";
+
+  llvm::SmallString<128> dir(opts::cacheDir);
+  llvm::sys::path::append(dir, "thinlto");
+  return dir.str().str();
+}
+
+void reportStatistics() {
+  if (opts::cacheDir.empty())
+    return;
+
+  uint64_t invocation[NumStats];
+  for (int i = 0; i < NumStats; ++i)
+    invocation[i] = statValues[i];
+
+  uint64_t cumulative[NumStats];
+  readCumulativeStats(cumulative);
+
+  // Only touch the cumulative statistics if the cache was actually used.
+  if (invocation[Lookups] || invocation[IRHits] || invocation[IRMisses] ||
+      invocation[Evictions]) {
+    for (int i = 0; i < NumStats; ++i)
+      cumulative[i] += invocation[i];
+    if (llvm::sys::fs::exists(opts::cacheDir))
+      writeCumulativeStats(cumulative);
+  }
+
+  if (cacheStats.getNumOccurrences() == 0)
+    return;
+
+  const bool json = cacheStats == "json";
+  if (!json && !cacheStats.empty() && cacheStats != "text") {
+    error(Loc(), "unknown -cache-stats format '%s', use 'text' or 'json'",
+          cacheStats.c_str());
+    return;
   }
+  printStats(llvm::outs(), json, invocation, cumulative);
 }
 } // namespace cache
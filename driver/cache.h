@@ -10,25 +10,67 @@
 #ifndef LDC_DRIVER_IR2OBJ_CACHE_H
 #define LDC_DRIVER_IR2OBJ_CACHE_H
 
+#include <memory>
 #include <string>
 
+#include "llvm/ADT/StringRef.h"
+
 namespace llvm {
+class LLVMContext;
 class Module;
-class StringRef;
 template <unsigned> class SmallString;
 }
 
 namespace cache {
 
-void calculateModuleHash(llvm::Module *m, llvm::SmallString<32> &str);
+/// `salt` is hashed together with the module, e.g. to tell apart the
+/// DCompute targets, whose IR doesn't include the target version.
+void calculateModuleHash(llvm::Module *m, llvm::SmallString<32> &str,
+                         llvm::StringRef salt = "");
+/// Like calculateModuleHash(), but for an already serialized module (e.g., a
+/// fragment of a module, see -cache-fragments).
+void calculateBitcodeHash(llvm::StringRef bitcode, llvm::SmallString<32> &str);
 std::string cacheLookup(llvm::StringRef cacheObjectHash);
 void cacheObjectFile(llvm::StringRef objectFile,
                      llvm::StringRef cacheObjectHash);
-void recoverObjectFile(llvm::StringRef cacheObjectHash,
+/// Recovers the object file found by cacheLookup(). Returns false if the entry
+/// has been pruned by a concurrent invocation in the meantime, or if
+/// recovering it failed on a backend worker (see backendError()), in which
+/// case the object file needs to be generated after all.
+bool recoverObjectFile(llvm::StringRef cacheObjectHash,
                        llvm::StringRef objectFile);
 
+/// Returns whether the optimized IR tier is used (-cache-optimized-ir).
+bool isOptimizedIRCacheEnabled(bool doLTO);
+/// Loads the cached optimized IR for the (unoptimized) module hash into
+/// `context`. Returns null if not found.
+std::unique_ptr<llvm::Module> lookupOptimizedIR(llvm::StringRef moduleHash,
+                                                llvm::LLVMContext &context);
+/// Stores the optimized module `m` in the cache under the (unoptimized)
+/// module hash.
+void cacheOptimizedIR(llvm::Module *m, llvm::StringRef moduleHash);
+
 /// Prune the cache to avoid filling up disk space.
 void pruneCache();
+
+/// The -cache-prune* settings, for forwarding them to linker plugins.
+struct PruningPolicy {
+  unsigned interval;                   // seconds
+  unsigned expiration;                 // seconds
+  unsigned sizeLimitPercentage;        // of the available space
+  unsigned long long sizeLimitInBytes; // 0 if unlimited
+};
+/// Returns false if cache pruning is disabled.
+bool getPruningPolicy(PruningPolicy &policy);
+
+/// Returns the directory the linker's ThinLTO plugin caches its compiled
+/// objects in (a subdirectory of the -cache directory), or an empty string if
+/// the cache is disabled.
+std::string getThinLTOCacheDir();
+
+/// Update the cumulative statistics of the cache directory and print them
+/// together with the ones for this invocation if requested (-cache-stats).
+void reportStatistics();
 }
 
 #endif
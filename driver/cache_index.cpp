@@ -0,0 +1,398 @@
+//===-- driver/cache_index.cpp --------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The index is an append-only text file `ircache_index` in the cache
+// directory. Each store of and each access to a cache entry appends a line
+//   <entry file name> <size in bytes> <access time in seconds since epoch>
+// The last access of an entry wins. Appending a single short line is atomic on
+// all relevant file systems, so concurrent compiler invocations can update the
+// index without locking.
+//
+// Pruning reads the index instead of walking (and stat'ing) the whole cache
+// directory, removes expired and - if the size limit is exceeded - least
+// recently used entries, and compacts the index to one line per remaining
+// entry. Lines appended by other invocations while pruning are preserved.
+// Independent of pruning, the index is compacted whenever it has grown by
+// another compactionIntervalBytes, so that it doesn't grow without bound.
+// Removing an entry is safe while other invocations use the cache: entries are
+// only ever replaced atomically, readers fall back to codegen if an entry
+// vanishes after their lookup, and temporary files are only removed once they
+// are stale.
+//
+// Cache entries added by a compiler without index support (or removed by the
+// ldc-prune-cache tool) are not reflected in the index. When there is no index
+// yet, it is created once by walking the cache directory.
+//
+// This file must not use the Logger, as pruning may run on a background thread
+// (see -cache-prune-mode).
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/cache_index.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#if LDC_LLVM_VER >= 400
+#include "llvm/Support/Chrono.h"
+#endif
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+const char *const indexFileName = "ircache_index";
+// Shared with the ldc-prune-cache tool (cache_pruning.d).
+const char *const timestampFileName = "ircache_prune_timestamp";
+// Temporary files younger than this may still be written by a concurrent
+// invocation (see cacheObjectFile()).
+const uint64_t staleTempFileSeconds = 3600;
+// The index is compacted whenever an appended line crosses a multiple of this
+// size.
+const uint64_t compactionIntervalBytes = 1 << 20;
+
+struct IndexEntry {
+  uint64_t size = 0;
+  uint64_t lastAccess = 0; // seconds since epoch
+};
+
+uint64_t secondsSinceEpoch() {
+  using namespace std::chrono;
+  return duration_cast<seconds>(system_clock::now().time_since_epoch())
+      .count();
+}
+
+uint64_t lastModificationTime(const llvm::sys::fs::file_status &status) {
+#if LDC_LLVM_VER >= 400
+  return llvm::sys::toTimeT(status.getLastModificationTime());
+#else
+  return status.getLastModificationTime().toEpochTime();
+#endif
+}
+
+// Returns true for LDC's cache file names,
+// e.g. "ircache_00a13b6f918d18f9f9de499fc661ec0d.o" (or .obj/.bc).
+bool isCacheFileName(llvm::StringRef name) {
+  if (!name.startswith("ircache_"))
+    return false;
+  name = name.drop_front(8);
+  if (name.size() < 32 ||
+      name.take_front(32).find_first_not_of("0123456789abcdef") !=
+          llvm::StringRef::npos)
+    return false;
+  name = name.drop_front(32);
+  return name == ".o" || name == ".obj" || name == ".bc";
+}
+
+// Returns true for left-over temporary files of cacheObjectFile(),
+// e.g. "ircache_00a13b6f918d18f9f9de499fc661ec0d.o.tmpa1B2c3D".
+bool isCacheTempFileName(llvm::StringRef name) {
+  const auto parts = name.rsplit(".tmp");
+  return parts.second.size() == 7 && isCacheFileName(parts.first);
+}
+
+void getFileNameInCache(llvm::StringRef cacheDir, llvm::StringRef name,
+                        llvm::SmallString<128> &path) {
+  path = cacheDir;
+  llvm::sys::path::append(path, name);
+}
+
+/// Parses the index lines in `contents` into `entries`.
+void parseIndex(llvm::StringRef contents,
+                llvm::StringMap<IndexEntry> &entries) {
+  while (!contents.empty()) {
+    llvm::StringRef line;
+    std::tie(line, contents) = contents.split('\n');
+
+    llvm::StringRef name, size, time;
+    std::tie(name, line) = line.split(' ');
+    std::tie(size, time) = line.split(' ');
+    IndexEntry parsed;
+    if (!isCacheFileName(name) || size.getAsInteger(10, parsed.size) ||
+        time.trim().getAsInteger(10, parsed.lastAccess))
+      continue; // skip malformed (e.g., truncated) lines
+
+    auto &entry = entries[name];
+    entry.size = parsed.size;
+    entry.lastAccess = std::max(entry.lastAccess, parsed.lastAccess);
+  }
+}
+
+/// Fills `entries` by walking the cache directory, and removes stale left-over
+/// temporary files on the way.
+void scanCacheDirectory(llvm::StringRef cacheDir, uint64_t now,
+                        llvm::StringMap<IndexEntry> &entries) {
+  std::error_code ec;
+  for (llvm::sys::fs::directory_iterator it(cacheDir, ec), end;
+       it != end && !ec; it.increment(ec)) {
+    const llvm::StringRef path = it->path();
+    const llvm::StringRef name = llvm::sys::path::filename(path);
+    llvm::sys::fs::file_status status;
+    if (isCacheTempFileName(name)) {
+      if (!llvm::sys::fs::status(path, status) &&
+          lastModificationTime(status) + staleTempFileSeconds < now)
+        llvm::sys::fs::remove(path);
+      continue;
+    }
+    if (!isCacheFileName(name) || llvm::sys::fs::status(path, status) ||
+        !llvm::sys::fs::is_regular_file(status))
+      continue;
+
+    auto &entry = entries[name];
+    entry.size = status.getSize();
+    entry.lastAccess = lastModificationTime(status);
+  }
+}
+
+/// Reads the contents of the open file `fd` beyond `offset`.
+llvm::StringRef readBeyond(int fd, llvm::StringRef name, uint64_t offset,
+                           std::unique_ptr<llvm::MemoryBuffer> &buffer) {
+  auto result = llvm::MemoryBuffer::getOpenFile(
+      fd, name, /*FileSize=*/-1, /*RequiresNullTerminator=*/false,
+      /*IsVolatile=*/true);
+  if (!result)
+    return llvm::StringRef();
+  buffer = std::move(result.get());
+  if (buffer->getBufferSize() <= offset)
+    return llvm::StringRef();
+  return buffer->getBuffer().drop_front(offset);
+}
+
+/// Atomically replaces the index by the `entries`, followed by everything
+/// appended to the index file beyond `readOffset` in the meantime.
+void writeIndex(llvm::StringRef indexFile,
+                const std::vector<const llvm::StringMapEntry<IndexEntry> *>
+                    &entries,
+                size_t readOffset) {
+  // Keep the old index file open, so that lines appended to it until the
+  // rename below can be carried over to the new one afterwards.
+  int oldFd;
+  if (llvm::sys::fs::openFileForRead(indexFile, oldFd))
+    oldFd = -1;
+
+  int fd;
+  llvm::SmallString<128> tempFile;
+  if (llvm::sys::fs::createUniqueFile(llvm::Twine(indexFile) + ".tmp%%%%%%%",
+                                      fd, tempFile)) {
+    if (oldFd != -1)
+      llvm::sys::Process::SafelyCloseFileDescriptor(oldFd);
+    return;
+  }
+  uint64_t copiedSize = readOffset;
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+    for (const auto *entry : entries) {
+      os << entry->getKey() << ' ' << entry->getValue().size << ' '
+         << entry->getValue().lastAccess << '\n';
+    }
+
+    if (oldFd != -1) {
+      std::unique_ptr<llvm::MemoryBuffer> buffer;
+      const auto appended = readBeyond(oldFd, indexFile, readOffset, buffer);
+      os << appended;
+      copiedSize += appended.size();
+    }
+  }
+  if (llvm::sys::fs::rename(tempFile.c_str(), indexFile)) {
+    llvm::sys::fs::remove(tempFile.c_str());
+  } else if (oldFd != -1) {
+    // Invocations which opened the old index before the rename may have
+    // appended to it since. The window for appends after this final read is
+    // a single open() and write(), which is acceptable for a best-effort
+    // index.
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    const auto appended = readBeyond(oldFd, indexFile, copiedSize, buffer);
+    if (!appended.empty()) {
+      std::error_code ec;
+      llvm::raw_fd_ostream os(indexFile, ec, llvm::sys::fs::F_Append);
+      if (!ec)
+        os << appended;
+    }
+  }
+  if (oldFd != -1)
+    llvm::sys::Process::SafelyCloseFileDescriptor(oldFd);
+}
+
+/// Compacts the index to one line per entry.
+void compactIndex(llvm::StringRef indexFile) {
+  auto buffer = llvm::MemoryBuffer::getFile(indexFile);
+  if (!buffer)
+    return;
+  llvm::StringMap<IndexEntry> entries;
+  parseIndex(buffer.get()->getBuffer(), entries);
+
+  std::vector<const llvm::StringMapEntry<IndexEntry> *> remaining;
+  remaining.reserve(entries.size());
+  for (const auto &entry : entries)
+    remaining.push_back(&entry);
+  writeIndex(indexFile, remaining, buffer.get()->getBufferSize());
+}
+
+// Returns uint64_t max when the available disk space could not be determined.
+uint64_t getAvailableDiskSpace(llvm::StringRef path) {
+#if LDC_LLVM_VER >= 500
+  llvm::sys::fs::space_info info;
+  if (!llvm::sys::fs::disk_space(path, info))
+    return info.available;
+#endif
+  return std::numeric_limits<uint64_t>::max();
+}
+
+bool isSizeAboveMaximum(uint64_t cacheSize, uint64_t availableSpace,
+                        uint64_t sizeLimitBytes, unsigned sizeLimitPercentage) {
+  if (availableSpace == 0)
+    return true;
+  if (sizeLimitBytes > 0 && cacheSize > sizeLimitBytes)
+    return true;
+  return (100 * cacheSize) / availableSpace > sizeLimitPercentage;
+}
+
+/// Checks if the prune interval has passed, and if so, updates the pruning
+/// timestamp.
+bool hasPruneIntervalPassed(llvm::StringRef cacheDir,
+                            unsigned pruneIntervalSeconds, uint64_t now) {
+  llvm::SmallString<128> timestampFile;
+  getFileNameInCache(cacheDir, timestampFileName, timestampFile);
+
+  llvm::sys::fs::file_status status;
+  if (pruneIntervalSeconds != 0 &&
+      !llvm::sys::fs::status(timestampFile, status) &&
+      lastModificationTime(status) + pruneIntervalSeconds >= now)
+    return false;
+
+  std::error_code ec;
+  llvm::raw_fd_ostream touch(timestampFile, ec, llvm::sys::fs::F_None);
+  return true;
+}
+
+/// Removes a cache file. Returns true if the entry is to be dropped from the
+/// index, i.e., if the file was removed or didn't exist anymore.
+bool removeCacheFile(llvm::StringRef cacheDir, llvm::StringRef name,
+                     size_t &numEvicted) {
+  llvm::SmallString<128> path;
+  getFileNameInCache(cacheDir, name, path);
+  if (!llvm::sys::fs::exists(path))
+    return true;
+  if (llvm::sys::fs::remove(path))
+    return false;
+  ++numEvicted;
+  return true;
+}
+
+} // anonymous namespace
+
+namespace cache {
+
+void recordIndexEntry(llvm::StringRef cacheDir, llvm::StringRef entryName,
+                      uint64_t size) {
+  llvm::SmallString<128> indexFile;
+  getFileNameInCache(cacheDir, indexFileName, indexFile);
+
+  llvm::SmallString<128> line;
+  {
+    llvm::raw_svector_ostream os(line);
+    os << entryName << ' ' << size << ' ' << secondsSinceEpoch() << '\n';
+  }
+  {
+    // The line is buffered and written with a single write() upon
+    // destruction.
+    std::error_code ec;
+    llvm::raw_fd_ostream os(indexFile, ec, llvm::sys::fs::F_Append);
+    if (ec)
+      return; // the index is best-effort only
+    os << line;
+  }
+
+  // Compact the index if this line has crossed a multiple of the compaction
+  // interval (i.e., typically in just one of concurrent invocations).
+  uint64_t indexSize;
+  if (!llvm::sys::fs::file_size(indexFile, indexSize) &&
+      indexSize >= line.size() &&
+      indexSize / compactionIntervalBytes !=
+          (indexSize - line.size()) / compactionIntervalBytes)
+    compactIndex(indexFile);
+}
+
+size_t pruneCacheUsingIndex(llvm::StringRef cacheDir,
+                            unsigned pruneIntervalSeconds,
+                            unsigned expireIntervalSeconds,
+                            uint64_t sizeLimitBytes,
+                            unsigned sizeLimitPercentage) {
+  if (!llvm::sys::fs::exists(cacheDir))
+    return 0;
+
+  const uint64_t now = secondsSinceEpoch();
+  if (!hasPruneIntervalPassed(cacheDir, pruneIntervalSeconds, now))
+    return 0;
+
+  sizeLimitPercentage = std::min(sizeLimitPercentage, 100u);
+  const bool willPruneForSize = sizeLimitBytes > 0 || sizeLimitPercentage < 100;
+
+  llvm::SmallString<128> indexFile;
+  getFileNameInCache(cacheDir, indexFileName, indexFile);
+
+  llvm::StringMap<IndexEntry> entries;
+  size_t readOffset = 0;
+  if (auto buffer = llvm::MemoryBuffer::getFile(indexFile)) {
+    readOffset = buffer.get()->getBufferSize();
+    parseIndex(buffer.get()->getBuffer(), entries);
+  } else {
+    scanCacheDirectory(cacheDir, now, entries);
+  }
+
+  size_t numEvicted = 0;
+
+  // Prune for expiry.
+  std::vector<const llvm::StringMapEntry<IndexEntry> *> remaining;
+  uint64_t cacheSize = 0;
+  remaining.reserve(entries.size());
+  for (const auto &entry : entries) {
+    if (entry.getValue().lastAccess + expireIntervalSeconds < now &&
+        removeCacheFile(cacheDir, entry.getKey(), numEvicted))
+      continue;
+    cacheSize += entry.getValue().size;
+    remaining.push_back(&entry);
+  }
+
+  // Prune for size, least recently accessed entries first.
+  uint64_t availableSpace = getAvailableDiskSpace(cacheDir);
+  availableSpace = std::max(availableSpace, availableSpace + cacheSize);
+  if (willPruneForSize &&
+      isSizeAboveMaximum(cacheSize, availableSpace, sizeLimitBytes,
+                         sizeLimitPercentage)) {
+    std::sort(remaining.begin(), remaining.end(),
+              [](const llvm::StringMapEntry<IndexEntry> *a,
+                 const llvm::StringMapEntry<IndexEntry> *b) {
+                return a->getValue().lastAccess < b->getValue().lastAccess;
+              });
+    for (auto &entry : remaining) {
+      if (!isSizeAboveMaximum(cacheSize, availableSpace, sizeLimitBytes,
+                              sizeLimitPercentage))
+        break;
+      if (removeCacheFile(cacheDir, entry->getKey(), numEvicted)) {
+        cacheSize -= entry->getValue().size;
+        entry = nullptr;
+      }
+    }
+    remaining.erase(std::remove(remaining.begin(), remaining.end(), nullptr),
+                    remaining.end());
+  }
+
+  writeIndex(indexFile, remaining, readOffset);
+  return numEvicted;
+}
+}
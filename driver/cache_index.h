@@ -0,0 +1,43 @@
+//===-- driver/cache_index.h ------------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Index of the cache directory, recording the size and last access time of
+// each cache entry. Allows pruning the cache without walking the directory.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_CACHE_INDEX_H
+#define LDC_DRIVER_CACHE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace llvm {
+class StringRef;
+}
+
+namespace cache {
+
+/// Records a store of, or an access to, the cache file `entryName` (a file
+/// name in cacheDir) of `size` bytes in the index of cacheDir.
+void recordIndexEntry(llvm::StringRef cacheDir, llvm::StringRef entryName,
+                      uint64_t size);
+
+/// Prunes cacheDir based on its index only, with the same scheme and
+/// parameters as the ldc-prune-cache tool (see cache_pruning.d). If there is no
+/// index yet, it is created by walking the cache directory once.
+/// Returns the number of evicted cache files.
+size_t pruneCacheUsingIndex(llvm::StringRef cacheDir,
+                            unsigned pruneIntervalSeconds,
+                            unsigned expireIntervalSeconds,
+                            uint64_t sizeLimitBytes,
+                            unsigned sizeLimitPercentage);
+}
+
+#endif
@@ -12,8 +12,10 @@
 
 #include "globals.h"
 
-void pruneCache(const char *cacheDirectoryPtr, d_size_t cacheDirectoryLen,
-                uint32_t pruneIntervalSeconds, uint32_t expireIntervalSeconds,
-                uinteger_t sizeLimitBytes, uint32_t sizeLimitPercentage);
+// Returns the number of evicted cache files.
+d_size_t pruneCache(const char *cacheDirectoryPtr, d_size_t cacheDirectoryLen,
+                    uint32_t pruneIntervalSeconds,
+                    uint32_t expireIntervalSeconds, uinteger_t sizeLimitBytes,
+                    uint32_t sizeLimitPercentage);
 
 #endif
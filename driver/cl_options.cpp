@@ -72,6 +72,13 @@ static cl::opt<ubyte, true> useDeprecated(
 
 cl::opt<bool> compileOnly("c", cl::desc("Do not link"), cl::ZeroOrMore);
 
+// Evaluated by dmd/root/rmem.d before parsing the command line.
+static cl::opt<bool>
+    lowmem("lowmem", cl::ZeroOrMore,
+           cl::desc("Enable the garbage collector for the LDC front-end. "
+                    "This reduces the compiler memory requirements but "
+                    "increases compile times."));
+
 static cl::opt<bool, true> createStaticLib("lib", cl::ZeroOrMore,
                                            cl::desc("Create static library"),
                                            cl::location(global.params.lib));
@@ -131,6 +138,45 @@ static cl::opt<ubyte, true> debugInfo(
         clEnumValN(3, "gline-tables-only", "Add line tables only")),
     cl::location(global.params.symdebug), cl::init(0));
 
+cl::opt<bool> debugTypesSection(
+    "fdebug-types-section", cl::ZeroOrMore,
+    cl::desc("Emit struct and class debug info into DWARF type units, which "
+             "the linker deduplicates across object files (ELF only)"));
+
+#if LDC_LLVM_VER >= 500
+cl::opt<std::string> compressDebugSections(
+    "gz", cl::ZeroOrMore, cl::ValueOptional,
+    cl::value_desc("none|zlib|zlib-gnu"),
+    cl::desc("Compress the debug sections of object files and binaries "
+             "(default: zlib)"));
+#endif
+
+#if LDC_LLVM_VER >= 700
+cl::opt<bool> splitDwarf(
+    "gsplit-dwarf", cl::ZeroOrMore,
+    cl::desc("Write the bulk of the debug info to a separate .dwo file next "
+             "to each object file (ELF only)"));
+#endif
+
+cl::list<std::string> filePrefixMap(
+    "ffile-prefix-map", cl::ZeroOrMore, cl::value_desc("old=new"),
+    cl::desc("Replace the <old> prefix of file paths by <new> in debug info, "
+             "assert and bounds check messages and the cache key"));
+static cl::alias debugPrefixMap("fdebug-prefix-map",
+                                cl::desc("Alias for -ffile-prefix-map"),
+                                cl::aliasopt(filePrefixMap));
+
+std::string remapFilePath(llvm::StringRef path) {
+  // Like GCC, the last matching mapping wins.
+  for (auto it = filePrefixMap.rbegin(), end = filePrefixMap.rend();
+       it != end; ++it) {
+    const auto mapping = llvm::StringRef(*it).split('=');
+    if (!mapping.first.empty() && path.startswith(mapping.first))
+      return (mapping.second + path.substr(mapping.first.size())).str();
+  }
+  return path.str();
+}
+
 cl::opt<bool> noAsm("noasm", cl::desc("Disallow use of inline assembler"),
                     cl::ZeroOrMore);
 
@@ -359,10 +405,53 @@ cl::opt<bool, true>
     singleObj("singleobj", cl::desc("Create only a single output object file"),
               cl::ZeroOrMore, cl::location(global.params.oneobj));
 
+cl::opt<unsigned> parallelJobs(
+    "j", cl::ZeroOrMore, cl::value_desc("N"), cl::init(1),
+    cl::desc("Read imported source files ahead, and optimize and emit the "
+             "object files of up to <N> modules or DCompute targets in "
+             "parallel (0: one per hardware thread; experimental)"));
+
+cl::opt<bool> contextPerModule(
+    "context-per-module", cl::ZeroOrMore,
+    cl::desc("Generate each module in a fresh LLVM context, freed after "
+             "emitting the module's object file (bounds the memory use of "
+             "compilations with many modules; slower)"));
+
 cl::opt<uint32_t, true> hashThreshold(
     "hash-threshold", cl::ZeroOrMore, cl::location(global.params.hashThreshold),
     cl::desc("Hash symbol names longer than this threshold (experimental)"));
 
+cl::opt<bool, true> ctfeBytecode(
+    "ctfe-bytecode", cl::ZeroOrMore, cl::location(global.params.ctfeBytecode),
+    cl::desc("Compile functions on integral values to bytecode for CTFE "
+             "(experimental)"));
+
+cl::opt<bool, true> ctfeArena(
+    "ctfe-arena", cl::ZeroOrMore, cl::location(global.params.ctfeArena),
+    cl::desc("Free the memory of temporary values after each compile-time "
+             "function evaluation (experimental)"));
+
+cl::opt<bool, true> assumeAsserts(
+    "fassume-asserts", cl::ZeroOrMore,
+    cl::location(global.params.assumeAsserts),
+    cl::desc("Let the optimizer assume the side-effect-free conditions of "
+             "disabled asserts and in-contracts to hold (undefined behavior "
+             "if violated)"));
+
+cl::opt<bool, true> entryInvariantsOnly(
+    "invariants-entry-only", cl::ZeroOrMore,
+    cl::location(global.params.entryInvariantsOnly),
+    cl::desc("Only check the invariants on entry of public member functions "
+             "and on exit of constructors, not on exit of member functions"));
+
+cl::opt<bool, true> foreachRangeIndexing(
+    "foreach-range-indexing", cl::ZeroOrMore,
+    cl::location(global.params.foreachRangeIndexing),
+    cl::desc("Lower foreach over struct ranges with length and opIndex to "
+             "counted loops over r[i], skipping the empty/front/popFront "
+             "calls (changes the behavior of ranges whose primitives have "
+             "side effects)"));
+
 cl::opt<bool> linkonceTemplates(
     "linkonce-templates", cl::ZeroOrMore,
     cl::desc(
@@ -373,6 +462,17 @@ cl::opt<bool> disableLinkerStripDead(
     cl::desc("Do not try to remove unused symbols during linking"),
     cl::cat(linkingCategory));
 
+cl::opt<bool> strictAliasing(
+    "fstrict-aliasing", cl::ZeroOrMore,
+    cl::desc("Let the optimizer assume that scalar values are only accessed "
+             "through their own type, byte-sized types or union members "
+             "(type-based alias analysis)"));
+
+cl::opt<bool> splitStack(
+    "fsplit-stack", cl::ZeroOrMore,
+    cl::desc("Emit split-stack prologues growing the stack on demand in "
+             "discontiguous segments (requires libgcc and the gold linker)"));
+
 // Math options
 bool fFastMath; // Storage for the dynamically created ffast-math option.
 llvm::FastMathFlags defaultFMF;
@@ -419,6 +519,19 @@ cl::opt<unsigned char, true, CoverageParser> coverageAnalysis(
              "minimum required coverage)"),
     cl::ValueOptional, cl::init(127));
 
+cl::opt<CoverageIncrement> coverageIncrement(
+    "cov-increment", cl::ZeroOrMore,
+    cl::desc("Set the type of the -cov line count increments"),
+    cl::init(CoverageIncrement_Atomic),
+    clEnumValues(
+        clEnumValN(CoverageIncrement_Atomic, "atomic",
+                   "Atomic increments (default)"),
+        clEnumValN(CoverageIncrement_NonAtomic, "non-atomic",
+                   "Non-atomic increments, counts of lines executed by "
+                   "several threads concurrently may be too low"),
+        clEnumValN(CoverageIncrement_Boolean, "boolean",
+                   "Only set the counters to 1, no read-modify-write")));
+
 cl::opt<LTOKind> ltoMode(
     "flto", cl::ZeroOrMore, cl::desc("Set LTO mode, requires linker support"),
     cl::init(LTO_None),
@@ -427,6 +540,19 @@ cl::opt<LTOKind> ltoMode(
         clEnumValN(LTO_Thin, "thin",
                    "Parallel importing and codegen (faster than 'full')")));
 
+cl::opt<std::string> thinLTOIndexFile(
+    "fthinlto-index", cl::ZeroOrMore, cl::value_desc("filename"),
+    cl::desc("Distributed ThinLTO: compile the single ThinLTO bitcode object "
+             "file given on the command line to the native object file "
+             "specified with -of, using the summary index file written by a "
+             "-fthinlto-index-only link"));
+
+cl::opt<bool> wholeProgramVtables(
+    "fwhole-program-vtables", cl::ZeroOrMore,
+    cl::desc("Devirtualize virtual calls based on the class hierarchy of the "
+             "compiled modules, which must not be subclassed elsewhere. "
+             "Requires -singleobj or -flto=full"));
+
 #if LDC_LLVM_VER >= 400
 cl::opt<std::string>
     saveOptimizationRecord("fsave-optimization-record",
@@ -448,6 +574,17 @@ cl::opt<std::string>
                        cl::desc("Prefix to prepend to the generated kernel files."),
                        cl::init("kernels"),
                        cl::value_desc("prefix"));
+cl::opt<bool> dcomputeKernelArgs(
+    "mdcompute-kernel-args", cl::ZeroOrMore,
+    cl::desc("Write the offsets, sizes and address spaces of the kernel "
+             "arguments of each DCompute target to a .kargs file next to the "
+             "kernels"));
+#endif
+#if LDC_LLVM_SUPPORTED_TARGET_NVPTX
+cl::opt<bool> dcomputeCUDAFatbin(
+    "mdcompute-cuda-fatbin", cl::ZeroOrMore,
+    cl::desc("Assemble the PTX of all CUDA targets with ptxas and package the "
+             "cubins together with the PTX into <prefix>_cuda_<bits>.fatbin"));
 #endif
 
 #if defined(LDC_DYNAMIC_COMPILE)
@@ -461,6 +598,17 @@ cl::opt<bool> dynamicCompileTlsWorkaround(
     cl::desc("Enable dynamic compilation TLS workaround"),
     cl::init(true),
     cl::Hidden);
+
+cl::opt<unsigned> dynamicCompileTiered(
+    "dynamic-compile-tiered",
+    cl::desc("Run the ahead-of-time compiled @dynamicCompile functions until "
+             "one of them was called <n> times, then compile all dynamic "
+             "code in the background (0 = disabled)"),
+    cl::value_desc("n"), cl::init(0));
+
+cl::opt<bool> dynamicCompileCompressIR(
+    "dynamic-compile-compress-ir", cl::ZeroOrMore,
+    cl::desc("Compress the embedded bitcode of the dynamic code with zlib"));
 #endif
 
 static cl::extrahelp footer(
@@ -76,8 +76,12 @@ extern cl::opt<bool> m64bits;
 extern cl::opt<std::string> mTargetTriple;
 extern cl::opt<std::string> mABI;
 extern FloatABI::Type floatABI;
+extern cl::opt<unsigned> parallelJobs;
+extern cl::opt<bool> contextPerModule;
 extern cl::opt<bool> linkonceTemplates;
 extern cl::opt<bool> disableLinkerStripDead;
+extern cl::opt<bool> strictAliasing;
+extern cl::opt<bool> splitStack;
 
 // Math options
 extern bool fFastMath;
@@ -93,6 +97,29 @@ extern std::vector<std::string> debugArgs;
 void createClashingOptions();
 void hideLLVMOptions();
 
+// Coverage options
+enum CoverageIncrement {
+  CoverageIncrement_Atomic,
+  CoverageIncrement_NonAtomic,
+  CoverageIncrement_Boolean,
+};
+extern cl::opt<CoverageIncrement> coverageIncrement;
+
+extern cl::opt<bool> debugTypesSection;
+#if LDC_LLVM_VER >= 500
+extern cl::opt<std::string> compressDebugSections;
+#endif
+#if LDC_LLVM_VER >= 700
+extern cl::opt<bool> splitDwarf;
+#else
+constexpr bool splitDwarf = false;
+#endif
+
+// -ffile-prefix-map=<old>=<new>
+extern cl::list<std::string> filePrefixMap;
+/// Applies the -ffile-prefix-map mappings to the given file path.
+std::string remapFilePath(llvm::StringRef path);
+
 // LTO options
 enum LTOKind {
   LTO_None,
@@ -102,6 +129,9 @@ enum LTOKind {
 extern cl::opt<LTOKind> ltoMode;
 inline bool isUsingLTO() { return ltoMode != LTO_None; }
 inline bool isUsingThinLTO() { return ltoMode == LTO_Thin; }
+extern cl::opt<std::string> thinLTOIndexFile;
+
+extern cl::opt<bool> wholeProgramVtables;
 
 #if LDC_LLVM_VER >= 400
 extern cl::opt<std::string> saveOptimizationRecord;
@@ -109,11 +139,17 @@ extern cl::opt<std::string> saveOptimizationRecord;
 #if LDC_LLVM_SUPPORTED_TARGET_SPIRV || LDC_LLVM_SUPPORTED_TARGET_NVPTX
 extern cl::list<std::string> dcomputeTargets;
 extern cl::opt<std::string> dcomputeFilePrefix;
+extern cl::opt<bool> dcomputeKernelArgs;
+#endif
+#if LDC_LLVM_SUPPORTED_TARGET_NVPTX
+extern cl::opt<bool> dcomputeCUDAFatbin;
 #endif
 
 #if defined(LDC_DYNAMIC_COMPILE)
 extern cl::opt<bool> enableDynamicCompile;
 extern cl::opt<bool> dynamicCompileTlsWorkaround;
+extern cl::opt<unsigned> dynamicCompileTiered;
+extern cl::opt<bool> dynamicCompileCompressIR;
 #else
 constexpr bool enableDynamicCompile = false;
 #endif
@@ -52,6 +52,14 @@ cl::opt<std::string> ASTPGOInstrUseFile(
     cl::ValueRequired);
 
 #if LDC_LLVM_VER >= 500
+/// Option for using a sample profile (e.g. converted from `perf` data with
+/// create_llvm_prof) for PGO
+cl::opt<std::string> SamplePGOUseFile(
+    "fprofile-sample-use", cl::ZeroOrMore, cl::value_desc("filename"),
+    cl::desc("Use sample profile data for profile-guided optimization "
+             "(implies -gline-tables-only if no debug info is requested)"),
+    cl::ValueRequired);
+
 cl::opt<int> fXRayInstructionThreshold(
     "fxray-instruction-threshold", cl::value_desc("value"),
     cl::desc("Sets the minimum function size to instrument with XRay"),
@@ -71,6 +79,12 @@ cl::opt<bool>
                         cl::desc("Instrument function entry and exit with "
                                  "GCC-compatible profiling calls"));
 
+cl::opt<unsigned> instrumentFunctionsThreshold(
+    "finstrument-functions-threshold", cl::value_desc("value"),
+    cl::desc("Don't instrument functions with less than this number of "
+             "(unoptimized) IR instructions with -finstrument-functions"),
+    cl::init(0), cl::ZeroOrMore);
+
 // DMD-style profiling (`dmd -profile`)
 static cl::opt<bool> dmdFunctionTrace(
     "fdmd-trace-functions", cl::ZeroOrMore,
@@ -113,6 +127,15 @@ void initializeInstrumentationOptionsFromCmdline(const llvm::Triple &triple) {
     pgoMode = PGO_IRBasedUse;
     initFromPathString(global.params.datafileInstrProf, IRPGOInstrUseFile);
   }
+#if LDC_LLVM_VER >= 500
+  else if (!SamplePGOUseFile.empty()) {
+    pgoMode = PGO_SampleBasedUse;
+    initFromPathString(global.params.datafileInstrProf, SamplePGOUseFile);
+    // Samples are mapped to IR by their source locations.
+    if (!global.params.symdebug)
+      global.params.symdebug = 3;
+  }
+#endif
 
   if (dmdFunctionTrace)
     global.params.trace = true;
@@ -26,6 +26,7 @@ namespace opts {
 namespace cl = llvm::cl;
 
 extern cl::opt<bool> instrumentFunctions;
+extern cl::opt<unsigned> instrumentFunctionsThreshold;
 
 #if LDC_LLVM_VER >= 500
 extern cl::opt<bool> fXRayInstrument;
@@ -45,13 +46,15 @@ enum PGOKind {
   PGO_ASTBasedUse,
   PGO_IRBasedInstr,
   PGO_IRBasedUse,
+  PGO_SampleBasedUse,
 };
 extern PGOKind pgoMode;
 inline bool isInstrumentingForPGO() {
   return pgoMode == PGO_ASTBasedInstr || pgoMode == PGO_IRBasedInstr;
 }
 inline bool isUsingPGOProfile() {
-  return pgoMode == PGO_ASTBasedUse || pgoMode == PGO_IRBasedUse;
+  return pgoMode == PGO_ASTBasedUse || pgoMode == PGO_IRBasedUse ||
+         pgoMode == PGO_SampleBasedUse;
 }
 inline bool isInstrumentingForASTBasedPGO() {
   return pgoMode == PGO_ASTBasedInstr;
@@ -61,6 +64,9 @@ inline bool isInstrumentingForIRBasedPGO() {
   return pgoMode == PGO_IRBasedInstr;
 }
 inline bool isUsingIRBasedPGOProfile() { return pgoMode == PGO_IRBasedUse; }
+inline bool isUsingSampleBasedPGOProfile() {
+  return pgoMode == PGO_SampleBasedUse;
+}
 
 } // namespace opts
 #endif // LDC_DRIVER_CL_OPTIONS_INSTRUMENTATION_H
@@ -38,6 +38,12 @@ cl::list<std::string> fSanitizeBlacklist(
 
 std::unique_ptr<llvm::SpecialCaseList> sanitizerBlacklist;
 
+cl::opt<bool> fSanitizeAddressSkipBoundsChecked(
+    "fsanitize-address-skip-bounds-checked", cl::ZeroOrMore, cl::init(true),
+    cl::desc("Don't instrument accesses of array elements in @safe code with "
+             "AddressSanitizer if they are bounds checked or known to be in "
+             "bounds"));
+
 #ifdef ENABLE_COVERAGE_SANITIZER
 cl::list<std::string> fSanitizeCoverage(
     "fsanitize-coverage", cl::CommaSeparated,
@@ -183,6 +189,20 @@ llvm::SanitizerCoverageOptions getSanitizerCoverageOptions() {
 }
 #endif
 
+bool isSanitizerCoverageTraceCmpEnabled() {
+#ifdef ENABLE_COVERAGE_SANITIZER
+  return isSanitizerEnabled(CoverageSanitizer) &&
+         sanitizerCoverageOptions.TraceCmp;
+#else
+  return false;
+#endif
+}
+
+bool isSanitizerAddressSkipBoundsCheckedEnabled() {
+  return isSanitizerEnabled(AddressSanitizer) &&
+         fSanitizeAddressSkipBoundsChecked;
+}
+
 // Output to `hash_os` all optimization settings that influence object code
 // output and that are not observable in the IR before running LLVM passes. This
 // is used to calculate the hash use for caching that uniquely identifies the
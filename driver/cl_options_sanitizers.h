@@ -53,6 +53,15 @@ void initializeSanitizerOptionsFromCmdline();
 llvm::SanitizerCoverageOptions getSanitizerCoverageOptions();
 #endif
 
+/// Returns whether comparisons are traced for the fuzzer
+/// (-fsanitize-coverage=trace-cmp, implied by -fsanitize=fuzzer).
+bool isSanitizerCoverageTraceCmpEnabled();
+
+/// Returns whether bounds-checked array element accesses in @safe code are
+/// excluded from the AddressSanitizer instrumentation
+/// (-fsanitize-address-skip-bounds-checked).
+bool isSanitizerAddressSkipBoundsCheckedEnabled();
+
 void outputSanitizerSettings(llvm::raw_ostream &hash_os);
 
 bool functionIsInSanitizerBlacklist(FuncDeclaration *funcDecl);
@@ -13,18 +13,35 @@
 #include "mars.h"
 #include "module.h"
 #include "scope.h"
+#include "driver/backenderrors.h"
 #include "driver/cl_options.h"
 #include "driver/cl_options_instrumentation.h"
 #include "driver/linker.h"
+#include "driver/optimizationsummary.h"
+#include "driver/targetmachine.h"
+#include "driver/timereport.h"
 #include "driver/toobj.h"
+#include "gen/llvmhelpers.h"
 #include "gen/logger.h"
 #include "gen/modules.h"
 #include "gen/runtime.h"
+#include "gen/typinf.h"
 #include "gen/dynamiccompile.h"
+#include "ir/irtype.h"
+#if LDC_LLVM_VER >= 400
+#include "llvm/Bitcode/BitcodeWriter.h"
+#else
+#include "llvm/Bitcode/ReaderWriter.h"
+#endif
+#include "llvm/IRReader/IRReader.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/YAMLTraits.h"
+#include <thread>
 
 /// The module with the frontend-generated C main() definition.
 extern Module *entrypoint; // defined in dmd/mars.d
@@ -41,7 +58,7 @@ namespace llvm {
 namespace {
 
 std::unique_ptr<llvm::ToolOutputFile>
-createAndSetDiagnosticsOutputFile(IRState &irs, llvm::LLVMContext &ctx,
+createAndSetDiagnosticsOutputFile(Module &dmodule, llvm::LLVMContext &ctx,
                                   llvm::StringRef filename) {
   std::unique_ptr<llvm::ToolOutputFile> diagnosticsOutputFile;
 
@@ -60,9 +77,9 @@ createAndSetDiagnosticsOutputFile(IRState &irs, llvm::LLVMContext &ctx,
     diagnosticsOutputFile = llvm::make_unique<llvm::ToolOutputFile>(
         diagnosticsFilename, EC, llvm::sys::fs::F_None);
     if (EC) {
-      irs.dmodule->error("Could not create file %s: %s",
-                         diagnosticsFilename.c_str(), EC.message().c_str());
-      fatal();
+      backendError(dmodule.loc, "Could not create file %s: %s",
+                   diagnosticsFilename.c_str(), EC.message().c_str());
+      return nullptr;
     }
 
     ctx.setDiagnosticsOutputFile(
@@ -82,6 +99,51 @@ createAndSetDiagnosticsOutputFile(IRState &irs, llvm::LLVMContext &ctx,
   return diagnosticsOutputFile;
 }
 
+/// Drops all cached LLVM types (and related objects) outside of the IRState,
+/// before switching to another LLVMContext.
+void resetContextCaches() {
+  IrType::resetAll();
+  freeRuntime();
+}
+
+/// Parses the serialized module into a fresh LLVMContext owned by the calling
+/// (worker) thread, then optimizes and writes it.
+void writeSerializedModule(
+    llvm::StringRef bitcode, const std::string &filename, Module *dmodule,
+    const llvm::TargetMachine &mainTarget,
+    std::shared_ptr<const optimizationsummary::DisplayNames> displayNames) {
+  llvm::LLVMContext context;
+  if (!global.params.output_ll) {
+    context.setDiscardValueNames(true);
+  }
+
+  std::unique_ptr<llvm::TargetMachine> target(
+      cloneTargetMachine(mainTarget));
+  gTargetMachine = target.get();
+
+  llvm::SMDiagnostic err;
+  std::unique_ptr<llvm::Module> module = llvm::parseIR(
+      llvm::MemoryBufferRef(bitcode, filename), err, context);
+  if (!module) {
+    backendError(dmodule->loc,
+                 "Could not re-read LLVM module for parallel codegen: %s",
+                 err.getMessage().str().c_str());
+    return;
+  }
+
+  std::unique_ptr<llvm::ToolOutputFile> diagnosticsOutputFile =
+      createAndSetDiagnosticsOutputFile(*dmodule, context, filename);
+  auto optimizationSummary = optimizationsummary::start(
+      *dmodule, context, filename, std::move(displayNames));
+
+  writeModule(module.get(), filename.c_str());
+
+  if (diagnosticsOutputFile)
+    diagnosticsOutputFile->keep();
+  if (optimizationSummary)
+    optimizationSummary->finish();
+}
+
 } // anonymous namespace
 
 namespace {
@@ -175,12 +237,27 @@ void emitLLVMUsedArray(IRState &irs) {
 }
 
 namespace ldc {
+unsigned getBackendThreadCount() {
+  // The logger isn't thread-safe.
+  if (Logger::enabled())
+    return 1;
+  if (opts::parallelJobs == 0)
+    return std::max(1u, std::thread::hardware_concurrency());
+  return opts::parallelJobs;
+}
+
 CodeGenerator::CodeGenerator(llvm::LLVMContext &context, bool singleObj)
     : context_(context), moduleCount_(0), singleObj_(singleObj), ir_(nullptr) {
   // Set the context to discard value names when not generating textual IR.
   if (!global.params.output_ll) {
     context_.setDiscardValueNames(true);
   }
+
+  // There's only a single module with -singleobj.
+  const unsigned numThreads = singleObj_ ? 1 : getBackendThreadCount();
+  if (numThreads > 1) {
+    backendPool_ = llvm::make_unique<llvm::ThreadPool>(numThreads);
+  }
 }
 
 CodeGenerator::~CodeGenerator() {
@@ -195,6 +272,11 @@ CodeGenerator::~CodeGenerator() {
 
     writeAndFreeLLModule(filename);
   }
+
+  if (backendPool_) {
+    backendPool_->wait();
+    reportBackendErrors();
+  }
 }
 
 void CodeGenerator::prepareLLModule(Module *m) {
@@ -206,10 +288,23 @@ void CodeGenerator::prepareLLModule(Module *m) {
 
   assert(!ir_);
 
+  llvm::LLVMContext *context = &context_;
+  if (opts::contextPerModule && !singleObj_) {
+    moduleContext_ = llvm::make_unique<llvm::LLVMContext>();
+    if (!global.params.output_ll) {
+      moduleContext_->setDiscardValueNames(true);
+    }
+    context = moduleContext_.get();
+    setGlobalContext(context);
+    // Types may have been built in the global context before codegen.
+    resetContextCaches();
+  }
+
   // See http://llvm.org/bugs/show_bug.cgi?id=11479 – just use the source file
   // name, as it should not collide with a symbol name used somewhere in the
   // module.
-  ir_ = new IRState(m->srcfile->toChars(), context_);
+  ir_ = new IRState(m->srcfile->toChars(), *context);
+  ir_->module.setSourceFileName(opts::remapFilePath(m->srcfile->toChars()));
   ir_->module.setTargetTriple(global.params.targetTriple->str());
   ir_->module.setDataLayout(*gDataLayout);
 
@@ -243,9 +338,11 @@ void CodeGenerator::writeAndFreeLLModule(const char *filename) {
 
   ir_->DBuilder.Finalize();
   generateBitcodeForDynamicCompile(ir_);
+  finalizeTLSModels(ir_->module);
 
   emitLLVMUsedArray(*ir_);
   emitLinkerOptions(*ir_, ir_->module, ir_->context());
+  eraseUnreferencedTypeInfos(*ir_);
 
   // Emit ldc version as llvm.ident metadata.
   llvm::NamedMDNode *IdentMetadata =
@@ -255,16 +352,60 @@ void CodeGenerator::writeAndFreeLLModule(const char *filename) {
   llvm::Metadata *IdentNode[] = {llvm::MDString::get(ir_->context(), Version)};
   IdentMetadata->addOperand(llvm::MDNode::get(ir_->context(), IdentNode));
 
-  std::unique_ptr<llvm::ToolOutputFile> diagnosticsOutputFile =
-      createAndSetDiagnosticsOutputFile(*ir_, context_, filename);
-
-  writeModule(&ir_->module, filename);
-
-  if (diagnosticsOutputFile)
-    diagnosticsOutputFile->keep();
+  if (backendPool_) {
+    writeLLModuleInBackground(filename);
+  } else {
+    std::unique_ptr<llvm::ToolOutputFile> diagnosticsOutputFile =
+        createAndSetDiagnosticsOutputFile(*ir_->dmodule, ir_->context(),
+                                          filename);
+    auto optimizationSummary = optimizationsummary::start(
+        *ir_->dmodule, ir_->context(), filename,
+        optimizationsummary::collectDisplayNames(*ir_));
+
+    writeModule(&ir_->module, filename);
+
+    if (diagnosticsOutputFile)
+      diagnosticsOutputFile->keep();
+    if (optimizationSummary)
+      optimizationSummary->finish();
+  }
 
   delete ir_;
   ir_ = nullptr;
+
+  if (moduleContext_) {
+    // Nothing referring to the module's context may outlive it.
+    resetContextCaches();
+    setGlobalContext(nullptr);
+    moduleContext_.reset();
+  }
+}
+
+void CodeGenerator::writeLLModuleInBackground(const char *filename) {
+  // An LLVMContext (and everything in it) must only be used by one thread at a
+  // time, so hand the finished module over as serialized bitcode, to be
+  // re-materialized in a worker-owned context.
+  auto bitcode = std::make_shared<llvm::SmallVector<char, 0>>();
+  {
+    llvm::raw_svector_ostream os(*bitcode);
+#if LDC_LLVM_VER >= 700
+    llvm::WriteBitcodeToFile(ir_->module, os);
+#else
+    llvm::WriteBitcodeToFile(&ir_->module, os);
+#endif
+  }
+
+  std::string file = filename;
+  Module *dmodule = ir_->dmodule;
+  const llvm::TargetMachine *mainTarget = gTargetMachine;
+  std::shared_ptr<const optimizationsummary::DisplayNames> displayNames;
+  if (optimizationsummary::isEnabled())
+    displayNames = optimizationsummary::collectDisplayNames(*ir_);
+  backendPool_->async([bitcode, file, dmodule, mainTarget, displayNames]() {
+    BackendWorkerScope workerScope;
+    writeSerializedModule(llvm::StringRef(bitcode->data(), bitcode->size()),
+                          file, dmodule, *mainTarget, displayNames);
+  });
 }
 
 namespace {
@@ -304,6 +445,7 @@ void CodeGenerator::emit(Module *m) {
 
   prepareLLModule(m);
 
+  timereport::Scope timeScope("IR generation", nullptr, m->toPrettyChars());
   codegenModule(ir_, m);
   if (m == rootHasMain) {
     codegenModule(ir_, entrypoint);
@@ -21,9 +21,18 @@
 #define LDC_DRIVER_CODEGENERATOR_H
 
 #include "gen/irstate.h"
+#include <memory>
+
+namespace llvm {
+class ThreadPool;
+}
 
 namespace ldc {
 
+/// Returns the number of threads to use for optimizing and emitting code in
+/// parallel, as requested by -j.
+unsigned getBackendThreadCount();
+
 class CodeGenerator {
 public:
   CodeGenerator(llvm::LLVMContext &context, bool singleObj);
@@ -34,11 +43,17 @@ private:
   void prepareLLModule(Module *m);
   void finishLLModule(Module *m);
   void writeAndFreeLLModule(const char *filename);
+  void writeLLModuleInBackground(const char *filename);
 
   llvm::LLVMContext &context_;
+  /// The context of the current module with -context-per-module, else null.
+  std::unique_ptr<llvm::LLVMContext> moduleContext_;
   int moduleCount_;
   bool const singleObj_;
   IRState *ir_;
+  /// Worker threads for optimizing and emitting finished modules while the
+  /// next module is being generated; null if running serially (-j=1).
+  std::unique_ptr<llvm::ThreadPool> backendPool_;
 };
 }
 
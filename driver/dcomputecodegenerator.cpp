@@ -8,11 +8,14 @@
 //===----------------------------------------------------------------------===//
 
 #include "driver/dcomputecodegenerator.h"
+#include "driver/backenderrors.h"
 #include "driver/cl_options.h"
+#include "driver/codegenerator.h"
 #include "dmd/errors.h"
 #include "gen/cl_helpers.h"
 #include "ir/irdsymbol.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ThreadPool.h"
 #include <array>
 #include <string>
 #include <algorithm>
@@ -88,9 +91,28 @@ void DComputeCodeGenManager::emit(Module *m) {
 }
 
 void DComputeCodeGenManager::writeModules() {
-  for (auto &target : targets) {
-    target->writeModule();
+  // IR generation shares the frontend's per-symbol state and is done target by
+  // target, but the finished modules can be optimized and written in parallel
+  // as requested by -j.
+  const unsigned numThreads =
+      std::min<unsigned>(ldc::getBackendThreadCount(), targets.size());
+
+  if (numThreads <= 1) {
+    for (auto &target : targets) {
+      target->writeModule();
+    }
+  } else {
+    llvm::ThreadPool pool(numThreads);
+    for (auto &target : targets) {
+      target->writeModuleInBackground(pool);
+    }
+    pool.wait();
+    reportBackendErrors();
   }
+
+#if LDC_LLVM_SUPPORTED_TARGET_NVPTX
+  writeCUDAFatbinary(targets);
+#endif
 }
 
 DComputeCodeGenManager::~DComputeCodeGenManager() {
@@ -0,0 +1,247 @@
+//===-- driver/gcallocreport.cpp ------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Each GC-allocating druntime call is tagged with a metadata node describing
+// the allocation site during IR generation; all sites of a module are listed
+// in named metadata as well. This way, the information survives handing the
+// module over to a backend thread as bitcode. After optimization, sites whose
+// call is still present are reported as heap allocations, and the
+// GarbageCollect2Stack pass records the sites it promoted to the stack or
+// removed as unused. Sites vanishing otherwise were eliminated by other
+// optimizations (or inlined and dropped as dead code).
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/gcallocreport.h"
+
+#include "errors.h"
+#include "globals.h"
+#include "gen/metadata.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gcallocreport {
+
+namespace {
+
+llvm::cl::opt<std::string> reportFile(
+    "gc-alloc-report", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Write a report of the GC allocations emitted by the "
+                   "compiler, with execution counts (requires "
+                   "-fprofile-instr-use) and whether they were promoted to "
+                   "the stack or removed, to <file>"),
+    llvm::cl::value_desc("file"));
+
+/// Druntime functions allocating GC memory, and the kind of allocation.
+const struct {
+  const char *function;
+  const char *kind;
+} allocatingFunctions[] = {
+    {"_aaGetY", "AA insertion"},
+    {"_d_allocclass", "class"},
+    {"_d_allocclassBitmap", "class"},
+    {"_d_allocmemory", "closure"},
+    {"_d_allocmemoryBitmap", "struct"},
+    {"_d_allocmemoryT", "struct"},
+    {"_d_arrayappendT", "array append"},
+    {"_d_arrayappendcTX", "array append"},
+    {"_d_arrayappendcd", "array append"},
+    {"_d_arrayappendwd", "array append"},
+    {"_d_arraycatT", "array concatenation"},
+    {"_d_arraycatnTX", "array concatenation"},
+    {"_d_arraysetlengthT", "array length"},
+    {"_d_arraysetlengthiT", "array length"},
+    {"_d_assocarrayliteralTX", "AA literal"},
+    {"_d_newarrayT", "array"},
+    {"_d_newarrayU", "array"},
+    {"_d_newarrayiT", "array"},
+    {"_d_newarraymTX", "array"},
+    {"_d_newarraymiTX", "array"},
+    {"_d_newclass", "class"},
+    {"_d_newitemBitmap", "item"},
+    {"_d_newitemT", "item"},
+    {"_d_newitemiT", "item"},
+    {"_d_tlab_refill", "thread-local buffer"},
+};
+
+const char *getAllocationKind(llvm::StringRef function) {
+  for (const auto &f : allocatingFunctions) {
+    if (function == f.function)
+      return f.kind;
+  }
+  return nullptr;
+}
+
+// Locations of the next calls to the requested druntime functions, from IR
+// generation (single-threaded).
+llvm::StringMap<std::string> pendingLocations;
+uint64_t nextSiteIndex = 0;
+
+enum class Result { Heap, Promoted, Removed, Eliminated };
+
+struct Site {
+  std::string location;
+  std::string kind;
+  std::string function;
+  int64_t count;
+  Result result;
+};
+
+std::mutex sitesMutex;
+std::vector<Site> sites;
+
+llvm::StringRef getString(const llvm::MDNode *node, unsigned i) {
+  return llvm::cast<llvm::MDString>(node->getOperand(i))->getString();
+}
+
+int64_t getInt(const llvm::MDNode *node, unsigned i) {
+  return llvm::mdconst::extract<llvm::ConstantInt>(node->getOperand(i))
+      ->getSExtValue();
+}
+
+void addNamedNodes(const llvm::Module &m, const char *name,
+                   llvm::DenseSet<const llvm::MDNode *> &set) {
+  if (auto named = m.getNamedMetadata(name)) {
+    for (const llvm::MDNode *node : named->operands())
+      set.insert(node);
+  }
+}
+
+const char *getResultString(Result r) {
+  switch (r) {
+  case Result::Heap:
+    return "heap";
+  case Result::Promoted:
+    return "stack";
+  case Result::Removed:
+    return "unused";
+  case Result::Eliminated:
+    return "removed";
+  }
+  llvm_unreachable("Unknown result");
+}
+
+} // anonymous namespace
+
+bool isEnabled() { return !reportFile.empty(); }
+
+void noteRuntimeFunction(const Loc &loc, llvm::StringRef name) {
+  if (!isEnabled() || !getAllocationKind(name))
+    return;
+  const char *location = loc.toChars();
+  pendingLocations[name] = location ? location : "";
+}
+
+void tagCall(llvm::Instruction &call, const llvm::Function &callee,
+             int64_t count) {
+  auto it = pendingLocations.find(callee.getName());
+  if (it == pendingLocations.end())
+    return;
+
+  auto &ctx = call.getContext();
+  auto i64 = llvm::Type::getInt64Ty(ctx);
+  llvm::Metadata *ops[] = {
+      llvm::MDString::get(ctx, it->second),
+      llvm::MDString::get(ctx, getAllocationKind(callee.getName())),
+      llvm::MDString::get(ctx, callee.getName()),
+      llvm::ConstantAsMetadata::get(llvm::ConstantInt::get(i64, count, true)),
+      llvm::ConstantAsMetadata::get(
+          llvm::ConstantInt::get(i64, nextSiteIndex++))};
+  auto node = llvm::MDNode::get(ctx, ops);
+  call.setMetadata(GC_ALLOC_SITE, node);
+  call.getModule()->getOrInsertNamedMetadata(GC_ALLOC_SITES)->addOperand(node);
+  pendingLocations.erase(it);
+}
+
+void collect(const llvm::Module &m) {
+  if (!isEnabled())
+    return;
+  auto allSites = m.getNamedMetadata(GC_ALLOC_SITES);
+  if (!allSites)
+    return;
+
+  llvm::DenseSet<const llvm::MDNode *> remaining, promoted, removed;
+  const unsigned kindID = m.getContext().getMDKindID(GC_ALLOC_SITE);
+  for (const auto &f : m) {
+    for (const auto &bb : f) {
+      for (const auto &i : bb) {
+        if (auto node = i.getMetadata(kindID))
+          remaining.insert(node);
+      }
+    }
+  }
+  addNamedNodes(m, GC_ALLOC_PROMOTED, promoted);
+  addNamedNodes(m, GC_ALLOC_REMOVED, removed);
+
+  std::lock_guard<std::mutex> lock(sitesMutex);
+  for (const llvm::MDNode *node : allSites->operands()) {
+    // A site may have been inlined into several functions; it counts as heap
+    // allocation if any of its calls is left.
+    const Result result = remaining.count(node)
+                              ? Result::Heap
+                              : promoted.count(node)
+                                    ? Result::Promoted
+                                    : removed.count(node) ? Result::Removed
+                                                          : Result::Eliminated;
+    sites.push_back({getString(node, 0), getString(node, 1),
+                     getString(node, 2), getInt(node, 3), result});
+  }
+}
+
+void write() {
+  if (!isEnabled())
+    return;
+
+  std::error_code ec;
+  llvm::raw_fd_ostream os(reportFile, ec, llvm::sys::fs::F_Text);
+  if (ec) {
+    error(Loc(), "Could not create GC allocation report file %s: %s",
+          reportFile.c_str(), ec.message().c_str());
+    return;
+  }
+
+  std::stable_sort(sites.begin(), sites.end(),
+                   [](const Site &a, const Site &b) {
+                     if (a.count != b.count)
+                       return a.count > b.count;
+                     return a.location < b.location;
+                   });
+
+  unsigned numHeap = 0;
+  for (const auto &s : sites)
+    numHeap += s.result == Result::Heap;
+
+  os << "GC allocation report: " << sites.size() << " sites, " << numHeap
+     << " left on the heap\n";
+  os << "(results: heap, stack = promoted by GarbageCollect2Stack, unused = "
+        "removed by GarbageCollect2Stack, removed = eliminated otherwise)\n\n";
+  for (const auto &s : sites) {
+    if (s.count < 0) {
+      os << "           ?";
+    } else {
+      os << llvm::format_decimal(s.count, 12);
+    }
+    os << "  " << llvm::left_justify(getResultString(s.result), 7) << "  "
+       << llvm::left_justify(s.kind, 19) << "  " << s.location << "  ("
+       << s.function << ")\n";
+  }
+}
+
+} // namespace gcallocreport
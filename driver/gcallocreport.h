@@ -0,0 +1,53 @@
+//===-- driver/gcallocreport.h ----------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Report of the GC-allocating druntime calls emitted by LDC, with their
+// execution counts (with PGO) and whether the optimizer got rid of them
+// (-gc-alloc-report).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_GCALLOCREPORT_H
+#define LDC_DRIVER_GCALLOCREPORT_H
+
+#include "llvm/ADT/StringRef.h"
+#include <cstdint>
+
+struct Loc;
+namespace llvm {
+class Function;
+class Instruction;
+class Module;
+}
+
+namespace gcallocreport {
+
+/// Whether -gc-alloc-report is enabled.
+bool isEnabled();
+
+/// Remembers the location of the next call to the given druntime function,
+/// if it allocates GC memory.
+void noteRuntimeFunction(const Loc &loc, llvm::StringRef name);
+
+/// Tags a call to a druntime function previously passed to
+/// noteRuntimeFunction() as allocation site, with the given execution count
+/// (-1 if unknown).
+void tagCall(llvm::Instruction &call, const llvm::Function &callee,
+             int64_t count);
+
+/// Records the fate of the allocation sites in the optimized module.
+/// Thread-safe.
+void collect(const llvm::Module &m);
+
+/// Writes the report for all collected modules.
+void write();
+
+}
+
+#endif
@@ -0,0 +1,333 @@
+//===-- driver/gcsectionsreport.cpp ---------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// With -function-sections/-data-sections (the default where --gc-sections is
+// used), each removed section corresponds to a single symbol. The linker
+// only prints the section and object file names, so the sizes are looked up
+// in the object files; sections in archive members are reported with
+// unknown size. The retained symbols and their sizes are read from the
+// symbol table of the linked binary.
+//
+// Both lists are attributed to the scope of each D symbol, i.e., its parent
+// module/aggregate, or its template instance, as far as that can be told
+// from the mangled name.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/gcsectionsreport.h"
+
+#include "errors.h"
+#include "globals.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+llvm::cl::opt<std::string> reportFile(
+    "gc-sections-report", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Write a report of the sections removed by the linker's "
+                   "--gc-sections and the symbols retained in the binary, "
+                   "with sizes and attributed to D scopes, to <file>"),
+    llvm::cl::value_desc("file"));
+
+const uint64_t unknownSize = ~0ull;
+
+struct Entry {
+  std::string symbol;
+  std::string file; // only for removed sections
+  uint64_t size;
+};
+
+struct ScopeTotals {
+  unsigned count = 0;
+  uint64_t size = 0;
+};
+
+/// Returns the symbol name a -function-sections/-data-sections section name
+/// is derived from.
+llvm::StringRef getSymbolName(llvm::StringRef section) {
+  // Longest prefixes first.
+  static const char *const prefixes[] = {
+      ".data.rel.ro.local.", ".data.rel.ro.", ".data.rel.local.",
+      ".data.rel.",          ".rodata.",      ".text.",
+      ".tdata.",             ".tbss.",        ".data.",
+      ".bss."};
+  for (const char *prefix : prefixes) {
+    if (section.startswith(prefix))
+      return section.drop_front(strlen(prefix));
+  }
+  return section;
+}
+
+bool readLName(llvm::StringRef &mangled, llvm::StringRef &name) {
+  size_t numDigits = 0;
+  while (numDigits < mangled.size() && isdigit(mangled[numDigits]))
+    ++numDigits;
+  size_t length;
+  if (numDigits == 0 ||
+      mangled.substr(0, numDigits).getAsInteger(10, length) ||
+      numDigits + length > mangled.size())
+    return false;
+  name = mangled.substr(numDigits, length);
+  mangled = mangled.drop_front(numDigits + length);
+  return true;
+}
+
+/// Returns the scope a symbol is attributed to: the qualified name of its
+/// parent for plain D symbols, and the template instance (`a.b.foo!(...)`)
+/// for symbols in instances.
+std::string getScope(llvm::StringRef symbol) {
+  // Strip a leading underscore added on Darwin.
+  if (symbol.startswith("__D"))
+    symbol = symbol.drop_front();
+  if (!symbol.startswith("_D"))
+    return "<non-D>";
+
+  llvm::StringRef mangled = symbol.drop_front(2);
+  llvm::SmallVector<llvm::StringRef, 8> parts;
+  llvm::StringRef name;
+  while (readLName(mangled, name))
+    parts.push_back(name);
+
+  std::string scope;
+  const bool isTemplateInstance =
+      mangled.startswith("__T") || mangled.startswith("__U");
+  if (!isTemplateInstance) {
+    // The last part is the symbol itself.
+    if (parts.size() > 1)
+      parts.pop_back();
+  }
+  for (auto part : parts) {
+    if (!scope.empty())
+      scope += '.';
+    scope += part;
+  }
+  if (isTemplateInstance) {
+    mangled = mangled.drop_front(3);
+    if (readLName(mangled, name)) {
+      if (!scope.empty())
+        scope += '.';
+      scope += name;
+      scope += "!(...)";
+    }
+  }
+  return scope.empty() ? "<unknown>" : scope;
+}
+
+/// Parses a --print-gc-sections line of ld.bfd, gold or LLD.
+bool parseRemovedSection(llvm::StringRef line, llvm::StringRef &section,
+                         llvm::StringRef &file) {
+  const llvm::StringRef marker = "removing unused section ";
+  const size_t pos = line.find(marker);
+  if (pos == llvm::StringRef::npos)
+    return false;
+  llvm::StringRef rest = line.drop_front(pos + marker.size()).rtrim();
+
+  // ld.bfd: '<section>' in file '<file>'
+  // gold, older LLD: from '<section>' in file '<file>'
+  const llvm::StringRef inFile = "' in file '";
+  const size_t inFilePos = rest.find(inFile);
+  if (inFilePos != llvm::StringRef::npos) {
+    const size_t start = rest.find('\'');
+    if (start >= inFilePos || !rest.endswith("'"))
+      return false;
+    section = rest.slice(start + 1, inFilePos);
+    file = rest.slice(inFilePos + inFile.size(), rest.size() - 1);
+    return true;
+  }
+
+  // LLD: <file>:(<section>)
+  const size_t sectionPos = rest.rfind(":(");
+  if (sectionPos == llvm::StringRef::npos || !rest.endswith(")"))
+    return false;
+  file = rest.take_front(sectionPos);
+  section = rest.slice(sectionPos + 2, rest.size() - 1);
+  return true;
+}
+
+class SectionSizes {
+  // Keyed by object file, then by section name.
+  std::map<std::string, std::map<std::string, uint64_t>> files;
+
+  const std::map<std::string, uint64_t> &getSections(const std::string &file) {
+    auto it = files.find(file);
+    if (it != files.end())
+      return it->second;
+
+    auto &sections = files[file];
+    // Archive members (`lib.a(member.o)`) aren't looked up.
+    if (!llvm::sys::fs::is_regular_file(file))
+      return sections;
+
+    auto binary = llvm::object::ObjectFile::createObjectFile(file);
+    if (!binary) {
+      llvm::consumeError(binary.takeError());
+      return sections;
+    }
+    for (const auto &section : binary->getBinary()->sections()) {
+      llvm::StringRef name;
+      if (section.getName(name))
+        continue;
+      // Keep the first one of equally named (COMDAT) sections.
+      sections.emplace(name.str(), section.getSize());
+    }
+    return sections;
+  }
+
+public:
+  uint64_t lookup(llvm::StringRef file, llvm::StringRef section) {
+    const auto &sections = getSections(file.str());
+    auto it = sections.find(section.str());
+    return it == sections.end() ? unknownSize : it->second;
+  }
+};
+
+void readRetainedSymbols(llvm::StringRef binaryPath,
+                         std::vector<Entry> &retained) {
+  auto binary = llvm::object::ObjectFile::createObjectFile(binaryPath);
+  if (!binary) {
+    llvm::consumeError(binary.takeError());
+    warning(Loc(), "-gc-sections-report: cannot read symbols of %s",
+            binaryPath.str().c_str());
+    return;
+  }
+
+  for (const auto &sym :
+       llvm::object::computeSymbolSizes(*binary->getBinary())) {
+    if (sym.second == 0)
+      continue;
+    auto type = sym.first.getType();
+    if (!type) {
+      llvm::consumeError(type.takeError());
+      continue;
+    }
+    if (*type != llvm::object::SymbolRef::ST_Function &&
+        *type != llvm::object::SymbolRef::ST_Data)
+      continue;
+    auto name = sym.first.getName();
+    if (!name) {
+      llvm::consumeError(name.takeError());
+      continue;
+    }
+    retained.push_back({name->str(), "", sym.second});
+  }
+}
+
+void printSize(llvm::raw_ostream &os, uint64_t size) {
+  if (size == unknownSize)
+    os << "         ?";
+  else
+    os << llvm::format_decimal(size, 10);
+}
+
+void printEntries(llvm::raw_ostream &os, const char *title,
+                  std::vector<Entry> &entries) {
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const Entry &a, const Entry &b) {
+                     // unknown sizes last
+                     const uint64_t sa = a.size == unknownSize ? 0 : a.size;
+                     const uint64_t sb = b.size == unknownSize ? 0 : b.size;
+                     return sa > sb;
+                   });
+
+  std::map<std::string, ScopeTotals> scopes;
+  uint64_t totalSize = 0;
+  for (const auto &e : entries) {
+    auto &totals = scopes[getScope(e.symbol)];
+    ++totals.count;
+    if (e.size != unknownSize) {
+      totals.size += e.size;
+      totalSize += e.size;
+    }
+  }
+
+  std::vector<std::pair<std::string, ScopeTotals>> sortedScopes(
+      scopes.begin(), scopes.end());
+  std::stable_sort(sortedScopes.begin(), sortedScopes.end(),
+                   [](const std::pair<std::string, ScopeTotals> &a,
+                      const std::pair<std::string, ScopeTotals> &b) {
+                     return a.second.size > b.second.size;
+                   });
+
+  os << title << ": " << entries.size() << " (" << totalSize << " bytes)\n\n";
+  os << "  By scope:\n";
+  for (const auto &s : sortedScopes) {
+    os << "  " << llvm::format_decimal(s.second.size, 10) << "  "
+       << llvm::format_decimal(s.second.count, 6) << "  " << s.first << '\n';
+  }
+  os << "\n  Symbols:\n";
+  for (const auto &e : entries) {
+    os << "  ";
+    printSize(os, e.size);
+    os << "  " << e.symbol;
+    if (!e.file.empty())
+      os << "  (" << e.file << ')';
+    os << '\n';
+  }
+  os << '\n';
+}
+
+} // anonymous namespace
+
+namespace gcsectionsreport {
+
+bool isEnabled() { return !reportFile.empty(); }
+
+void process(llvm::StringRef linkerOutputFile, llvm::StringRef binaryPath) {
+  std::vector<Entry> removed;
+  SectionSizes sectionSizes;
+
+  auto buffer = llvm::MemoryBuffer::getFile(linkerOutputFile);
+  if (buffer) {
+    llvm::SmallVector<llvm::StringRef, 64> lines;
+    (*buffer)->getBuffer().split(lines, '\n', -1, /*KeepEmpty=*/false);
+    for (auto line : lines) {
+      llvm::StringRef section, file;
+      if (!parseRemovedSection(line, section, file)) {
+        llvm::errs() << line << '\n';
+        continue;
+      }
+      removed.push_back({getSymbolName(section).str(), file.str(),
+                         sectionSizes.lookup(file, section)});
+    }
+  }
+
+  if (binaryPath.empty())
+    return;
+
+  std::vector<Entry> retained;
+  readRetainedSymbols(binaryPath, retained);
+
+  std::error_code ec;
+  llvm::raw_fd_ostream os(reportFile, ec, llvm::sys::fs::F_Text);
+  if (ec) {
+    error(Loc(), "cannot write -gc-sections-report file '%s': %s",
+          reportFile.c_str(), ec.message().c_str());
+    return;
+  }
+
+  os << "GC sections report for " << binaryPath << "\n\n";
+  printEntries(os, "Removed sections", removed);
+  printEntries(os, "Retained symbols", retained);
+}
+
+}
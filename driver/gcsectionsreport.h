@@ -0,0 +1,33 @@
+//===-- driver/gcsectionsreport.h -------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Report of the sections removed by the linker's --gc-sections and of the
+// symbols retained in the linked binary (-gc-sections-report).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_GCSECTIONSREPORT_H
+#define LDC_DRIVER_GCSECTIONSREPORT_H
+
+#include "llvm/ADT/StringRef.h"
+
+namespace gcsectionsreport {
+
+/// Whether -gc-sections-report is enabled.
+bool isEnabled();
+
+/// Parses the linker diagnostics captured in `linkerOutputFile` (as printed
+/// with --print-gc-sections), forwards all other lines to stderr and writes
+/// the report. The retained symbols are read from `binaryPath`, unless it is
+/// empty (i.e., linking failed).
+void process(llvm::StringRef linkerOutputFile, llvm::StringRef binaryPath);
+
+}
+
+#endif
@@ -0,0 +1,124 @@
+//===-- driver/importprefetch.cpp -----------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The worker threads are started on the first request and never joined; the
+// prefetcher is leaked so that they can't outlive it at program exit.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/importprefetch.h"
+
+#include "file.h"
+#include "rmem.h"
+#include "driver/cl_options.h"
+#include "llvm/ADT/StringMap.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+/// Returns the number of threads requested by -j, including the main thread.
+unsigned getThreadCount() {
+  if (opts::parallelJobs == 0)
+    return std::max(1u, std::thread::hardware_concurrency());
+  return opts::parallelJobs;
+}
+
+enum class State { Queued, Reading, Done, Taken };
+
+struct Job {
+  File *file = nullptr;
+  State state = State::Queued;
+};
+
+class Prefetcher {
+  std::mutex mutex;
+  std::condition_variable jobQueued;
+  std::condition_variable jobDone;
+  // All requested files by name; the entries have stable addresses.
+  llvm::StringMap<Job> jobs;
+  std::deque<Job *> queue;
+  bool started = false;
+
+  void work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      jobQueued.wait(lock, [this] { return !queue.empty(); });
+      Job *job = queue.front();
+      queue.pop_front();
+      // The main thread may have taken it meanwhile and read it itself.
+      if (job->state != State::Queued)
+        continue;
+
+      job->state = State::Reading;
+      lock.unlock();
+      job->file->read(); // errors are reported when the main thread retries
+      lock.lock();
+      job->state = State::Done;
+      jobDone.notify_all();
+    }
+  }
+
+public:
+  void add(const char *filename) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Job &job = jobs[filename];
+    if (job.file)
+      return;
+    job.file = File::create(filename);
+
+    if (!started) {
+      started = true;
+      const unsigned numWorkers = std::max(2u, getThreadCount()) - 1;
+      for (unsigned i = 0; i < numWorkers; ++i)
+        std::thread([this] { work(); }).detach();
+    }
+
+    queue.push_back(&job);
+    jobQueued.notify_one();
+  }
+
+  File *take(const char *filename) {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = jobs.find(filename);
+    if (it == jobs.end())
+      return nullptr;
+    Job &job = it->second;
+    jobDone.wait(lock, [&job] { return job.state != State::Reading; });
+    if (job.state == State::Taken)
+      return nullptr;
+    job.state = State::Taken;
+    return job.file;
+  }
+};
+
+Prefetcher &getPrefetcher() {
+  static Prefetcher *prefetcher = new Prefetcher;
+  return *prefetcher;
+}
+
+} // anonymous namespace
+
+bool isImportPrefetchingEnabled() {
+  // With -lowmem, the Files and their buffers are allocated from the D GC,
+  // which neither scans the prefetcher's (C++) job table nor knows about the
+  // worker threads.
+  return getThreadCount() > 1 && !mem.isGCEnabled();
+}
+
+void prefetchImport(const char *filename) { getPrefetcher().add(filename); }
+
+File *takePrefetchedImport(const char *filename) {
+  if (!isImportPrefetchingEnabled())
+    return nullptr;
+  return getPrefetcher().take(filename);
+}
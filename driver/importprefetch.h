@@ -0,0 +1,38 @@
+//===-- driver/importprefetch.h ---------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// With -j, the source files of imported modules are read by worker threads
+// while the frontend parses the importing modules, so that they are usually in
+// memory by the time semantic analysis loads them. Lexing and parsing stay on
+// the main thread, as the identifier table, the frontend's allocator and the
+// error reporting aren't thread-safe. Prefetching is disabled with -lowmem, as
+// the worker threads can't allocate from the D GC.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_IMPORTPREFETCH_H
+#define LDC_DRIVER_IMPORTPREFETCH_H
+
+struct File;
+
+// For the frontend (dmd/dmodule.d), on the main thread.
+
+bool isImportPrefetchingEnabled();
+
+/// Starts reading the source file in the background, unless that has been
+/// done before.
+void prefetchImport(const char *filename);
+
+/// Returns the File whose reading was started by prefetchImport(), after
+/// waiting for the read to finish, or null if the file hasn't been
+/// prefetched or has been taken already. The File hasn't been read if an
+/// error occurred; Module.read() then retries and reports it.
+File *takePrefetchedImport(const char *filename);
+
+#endif
@@ -17,6 +17,9 @@
 // is contrary to what C compilers do, where CFLAGS is usually handled by the
 // build system.
 //
+// If built with LDC_LDMD_IN_PROCESS, LDC is linked in and its driver invoked
+// directly, instead of executing ldc2.
+//
 //===----------------------------------------------------------------------===//
 
 #ifndef LDC_EXE_NAME
@@ -195,6 +198,7 @@ Where:\n\
   -J=<directory>   look for string imports also in directory\n\
   -L=<linkerflag>  pass linkerflag to link\n\
   -lib             generate library rather than object files\n\
+  -lowmem          enable garbage collection for the compiler\n\
   -m32             generate 32 bit code\n"
 #if 0
 "  -m32mscoff       generate 32 bit code and write MS-COFF object files\n"
@@ -685,16 +689,27 @@ std::string locateBinary(std::string exeName) {
 // In driver/main.d
 int main(int argc, char **argv);
 
-int cppmain(int argc, char **argv) {
+#if LDC_LDMD_IN_PROCESS
+// In driver/main.cpp
+int cppmain(int argc, char **argv);
+#endif
+
+// Called from driver/ldmd.d
+int ldmdmain(int argc, char **argv) {
   exe_path::initialize(argv[0]);
 
   std::string ldcExeName = LDC_EXE_NAME;
 #ifdef _WIN32
   ldcExeName += ".exe";
 #endif
-  const std::string ldcPath = locateBinary(ldcExeName);
+  std::string ldcPath = locateBinary(ldcExeName);
   if (ldcPath.empty()) {
+#if LDC_LDMD_IN_PROCESS
+    // ldc2 is still executed for printing its version and help texts.
+    ldcPath = exe_path::prependBinDir(ldcExeName.c_str());
+#else
     error("Could not locate " LDC_EXE_NAME " executable.");
+#endif
   }
 
   // We need to manually set up argv[0] and the terminating NULL.
@@ -705,6 +720,11 @@ int cppmain(int argc, char **argv) {
 
   args.push_back(nullptr);
 
+#if LDC_LDMD_IN_PROCESS
+  // No command line length limit, so no need for a response file.
+  return cppmain(static_cast<int>(args.size() - 1),
+                 const_cast<char **>(args.data()));
+#else
   // Check if we can get away without a response file.
   const size_t totalLen = std::accumulate(
       args.begin(), args.end() - 1,
@@ -742,4 +762,5 @@ int cppmain(int argc, char **argv) {
   }
 
   return rc;
+#endif
 }
@@ -8,13 +8,16 @@
 //===----------------------------------------------------------------------===//
 
 #include "errors.h"
+#include "driver/cache.h"
 #include "driver/cl_options.h"
 #include "driver/cl_options_instrumentation.h"
 #include "driver/cl_options_sanitizers.h"
 #include "driver/configfile.h"
 #include "driver/exe_path.h"
+#include "driver/gcsectionsreport.h"
 #include "driver/ldc-version.h"
 #include "driver/linker.h"
+#include "driver/symbolordering.h"
 #include "driver/tool.h"
 #include "gen/irstate.h"
 #include "gen/logger.h"
@@ -31,6 +34,19 @@
 
 //////////////////////////////////////////////////////////////////////////////
 
+static llvm::cl::opt<unsigned> ltoJobs(
+    "flto-jobs", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Number of parallel ThinLTO backend jobs during linking "
+                   "(default: number of hardware threads)"),
+    llvm::cl::value_desc("N"), llvm::cl::init(0));
+
+static llvm::cl::opt<bool> thinLTOIndexOnly(
+    "fthinlto-index-only", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Distributed ThinLTO: only write an individual summary "
+                   "index (<object>.thinlto.bc) and import list "
+                   "(<object>.imports) per bitcode object file when linking, "
+                   "for separate -fthinlto-index backend jobs"));
+
 static llvm::cl::opt<std::string>
     ltoLibrary("flto-binary", llvm::cl::ZeroOrMore,
                llvm::cl::desc("Set the linker LTO plugin library file (e.g. "
@@ -49,7 +65,10 @@ class ArgsBuilder {
 public:
   std::vector<std::string> args;
 
-  virtual ~ArgsBuilder() = default;
+  virtual ~ArgsBuilder() {
+    for (const auto &file : tempFiles)
+      llvm::sys::fs::remove(file);
+  }
 
   void build(llvm::StringRef outputPath,
              const std::vector<std::string> &defaultLibNames);
@@ -68,8 +87,13 @@ private:
   virtual void addTargetFlags();
 
   void addLTOGoldPluginFlags();
+  void addThinLTOCacheAndJobsFlags();
   void addDarwinLTOFlags();
   void addLTOLinkFlags();
+  void addSymbolOrderingFlags();
+
+  // Files referenced by the arguments, removed after linking.
+  std::vector<std::string> tempFiles;
 
   virtual void addLdFlag(const llvm::Twine &flag) {
     args.push_back(("-Wl," + flag).str());
@@ -125,6 +149,23 @@ void ArgsBuilder::addLTOGoldPluginFlags() {
   if (opts::isUsingThinLTO())
     addLdFlag("-plugin-opt=thinlto");
 
+  if (opts::isUsingThinLTO() && thinLTOIndexOnly) {
+    if (useInternalLLDForLinking() || opts::linker == "lld") {
+#if LDC_LLVM_VER >= 700
+      addLdFlag("--thinlto-index-only");
+      addLdFlag("--thinlto-emit-imports-files");
+#else
+      error(Loc(), "-fthinlto-index-only requires LLD 7.0+");
+      fatal();
+#endif
+    } else {
+      addLdFlag("-plugin-opt=thinlto-index-only");
+      addLdFlag("-plugin-opt=thinlto-emit-imports-files");
+    }
+  }
+
+  addThinLTOCacheAndJobsFlags();
+
   const auto cpu = gTargetMachine->getTargetCPU();
   if (!cpu.empty())
     addLdFlag(llvm::Twine("-plugin-opt=mcpu=") + cpu);
@@ -135,6 +176,12 @@ void ArgsBuilder::addLTOGoldPluginFlags() {
   optChars[13] = '0' + std::min<char>(optLevel(), 3);
   addLdFlag(optChars);
 
+  // The sample profile is applied again when optimizing at link-time.
+  if (opts::isUsingSampleBasedPGOProfile()) {
+    addLdFlag(llvm::Twine("-plugin-opt=sample-profile=") +
+              global.params.datafileInstrProf);
+  }
+
 #if LDC_LLVM_VER >= 400
   const llvm::TargetOptions &TO = gTargetMachine->Options;
   if (TO.FunctionSections)
@@ -168,6 +215,71 @@ void ArgsBuilder::addDarwinLTOFlags() {
     args.push_back("-lto_library");
     args.push_back(std::move(dylibPath));
   }
+
+  if (!opts::isUsingThinLTO())
+    return;
+
+  if (thinLTOIndexOnly) {
+    error(Loc(), "-fthinlto-index-only is not supported by ld64");
+    fatal();
+  }
+
+  // ld64 has dedicated switches for the ThinLTO cache.
+  const std::string cacheDir = cache::getThinLTOCacheDir();
+  if (!cacheDir.empty()) {
+    addLdFlag("-cache_path_lto", cacheDir);
+    cache::PruningPolicy policy;
+    if (cache::getPruningPolicy(policy)) {
+      addLdFlag("-prune_interval_lto", llvm::Twine(policy.interval));
+      addLdFlag("-prune_after_lto", llvm::Twine(policy.expiration));
+      addLdFlag("-max_relative_cache_size_lto",
+                llvm::Twine(policy.sizeLimitPercentage));
+    }
+  }
+  if (ltoJobs > 0) {
+    addLdFlag("-mllvm",
+              llvm::Twine("-threads=") + llvm::Twine(ltoJobs.getValue()));
+  }
+}
+
+/// Reuses the objects compiled by the ThinLTO backend across links by putting
+/// them into the -cache directory, pruned according to the -cache-prune*
+/// settings, and forwards -flto-jobs.
+void ArgsBuilder::addThinLTOCacheAndJobsFlags() {
+  if (!opts::isUsingThinLTO())
+    return;
+
+  // LLD understands its own options only.
+  const bool isLLD = useInternalLLDForLinking() || opts::linker == "lld";
+
+#if LDC_LLVM_VER >= 400
+  const std::string cacheDir = cache::getThinLTOCacheDir();
+  if (!cacheDir.empty()) {
+    addLdFlag((isLLD ? "--thinlto-cache-dir=" : "-plugin-opt=cache-dir=") +
+              cacheDir);
+
+#if LDC_LLVM_VER >= 500
+    cache::PruningPolicy policy;
+    if (cache::getPruningPolicy(policy)) {
+      // see llvm::parseCachePruningPolicy()
+      std::string str;
+      llvm::raw_string_ostream os(str);
+      os << (isLLD ? "--thinlto-cache-policy=" : "-plugin-opt=cache-policy=")
+         << "prune_interval=" << policy.interval
+         << "s:prune_after=" << policy.expiration
+         << "s:cache_size=" << policy.sizeLimitPercentage << '%';
+      if (policy.sizeLimitInBytes > 0)
+        os << ":cache_size_bytes=" << policy.sizeLimitInBytes;
+      addLdFlag(os.str());
+    }
+#endif
+  }
+#endif
+
+  if (ltoJobs > 0) {
+    addLdFlag(llvm::Twine(isLLD ? "--thinlto-jobs=" : "-plugin-opt=jobs=") +
+              llvm::Twine(ltoJobs.getValue()));
+  }
 }
 
 /// Adds the required linker flags for LTO builds to args.
@@ -478,6 +590,8 @@ void ArgsBuilder::build(llvm::StringRef outputPath,
     addLTOLinkFlags();
 
   addLinker();
+  if (symbolordering::isEnabled())
+    addSymbolOrderingFlags();
   addUserSwitches();
 
   // lib dirs
@@ -511,6 +625,29 @@ void ArgsBuilder::build(llvm::StringRef outputPath,
     // https://sourceware.org/bugzilla/show_bug.cgi?id=19161
     if (!opts::disableLinkerStripDead && !opts::isInstrumentingForPGO()) {
       addLdFlag("--gc-sections");
+      if (gcsectionsreport::isEnabled() && !useInternalLLDForLinking())
+        addLdFlag("--print-gc-sections");
+    }
+  }
+
+#if LDC_LLVM_VER >= 500
+  // Keep the debug sections compressed in the linked binary.
+  if (opts::compressDebugSections.getNumOccurrences() > 0 &&
+      global.params.symdebug &&
+      global.params.targetTriple->isOSBinFormatELF()) {
+    const auto &type = opts::compressDebugSections;
+    addLdFlag(llvm::Twine("--compress-debug-sections=") +
+              (type.empty() ? llvm::StringRef("zlib") : llvm::StringRef(type)));
+  }
+#endif
+
+  // Let gold/lld build an index of the split DWARF units' names, sparing gdb
+  // reading all .dwo files on startup.
+  if (opts::splitDwarf && global.params.symdebug &&
+      global.params.targetTriple->isOSBinFormatELF()) {
+    if (opts::linker.empty() ? global.params.isLinux
+                             : (opts::linker == "gold" || opts::linker == "lld")) {
+      addLdFlag("--gdb-index");
     }
   }
 
@@ -521,6 +658,38 @@ void ArgsBuilder::build(llvm::StringRef outputPath,
 
 //////////////////////////////////////////////////////////////////////////////
 
+void ArgsBuilder::addSymbolOrderingFlags() {
+  const auto &triple = *global.params.targetTriple;
+  const bool isLLD = useInternalLLDForLinking() || opts::linker == "lld";
+  const bool isGold = opts::linker == "gold" ||
+                      (opts::linker.empty() && global.params.isLinux);
+  if (!triple.isOSBinFormatMachO() &&
+      !(triple.isOSBinFormatELF() && (isLLD || isGold))) {
+    warning(Loc(), "Ordering symbols requires linking with lld, gold or ld64, "
+                   "ignoring it");
+    return;
+  }
+
+  // gold only orders sections.
+  const bool sectionNames = !triple.isOSBinFormatMachO() && !isLLD;
+  const std::string file = symbolordering::createOrderingFile(sectionNames);
+  if (file.empty())
+    return;
+  tempFiles.push_back(file);
+
+  if (triple.isOSBinFormatMachO()) {
+    addLdFlag("-order_file", file);
+  } else if (isLLD) {
+    addLdFlag("--symbol-ordering-file", file);
+    // Symbols of the profile may have been discarded or inlined.
+    addLdFlag("--no-warn-symbol-ordering");
+  } else {
+    addLdFlag("--section-ordering-file", file);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 void ArgsBuilder::addLinker() {
   if (!opts::linker.empty()) {
     args.push_back("-fuse-ld=" + opts::linker);
@@ -661,8 +830,20 @@ class LdArgsBuilder : public ArgsBuilder {
 
 int linkObjToBinaryGcc(llvm::StringRef outputPath,
                        const std::vector<std::string> &defaultLibNames) {
+  if (gcsectionsreport::isEnabled() &&
+      (global.params.targetTriple->getOS() != llvm::Triple::Linux ||
+       opts::disableLinkerStripDead || opts::isInstrumentingForPGO())) {
+    warning(Loc(), "-gc-sections-report requires linking with --gc-sections "
+                   "for a Linux target, ignoring it");
+  }
+
 #if LDC_WITH_LLD && LDC_LLVM_VER >= 600
   if (useInternalLLDForLinking()) {
+    if (gcsectionsreport::isEnabled()) {
+      warning(Loc(), "-gc-sections-report is not supported with the internal "
+                     "LLD, ignoring it");
+    }
+
     LdArgsBuilder argsBuilder;
     argsBuilder.build(outputPath, defaultLibNames);
 
@@ -718,5 +899,18 @@ int linkObjToBinaryGcc(llvm::StringRef outputPath,
   logstr << "\n"; // FIXME where's flush ?
 
   // try to call linker
-  return executeToolAndWait(tool, argsBuilder.args, global.params.verbose);
+  if (!gcsectionsreport::isEnabled())
+    return executeToolAndWait(tool, argsBuilder.args, global.params.verbose);
+
+  // Capture the --print-gc-sections output for the report.
+  llvm::SmallString<128> linkerOutput;
+  if (llvm::sys::fs::createTemporaryFile("ldc-linker", "txt", linkerOutput)) {
+    error(Loc(), "failed to create temporary file for -gc-sections-report");
+    return 1;
+  }
+  const int status = executeToolAndWait(tool, argsBuilder.args,
+                                        global.params.verbose, linkerOutput);
+  gcsectionsreport::process(linkerOutput, status == 0 ? outputPath : "");
+  llvm::sys::fs::remove(linkerOutput);
+  return status;
 }
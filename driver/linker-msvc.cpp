@@ -14,10 +14,12 @@
 #include "driver/configfile.h"
 #include "driver/exe_path.h"
 #include "driver/linker.h"
+#include "driver/symbolordering.h"
 #include "driver/tool.h"
 #include "gen/logger.h"
 
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
 #include "llvm/Support/Path.h"
 
 #if LDC_WITH_LLD
@@ -159,6 +161,16 @@ int linkObjToBinaryMSVC(llvm::StringRef outputPath,
     args.push_back("ws2_32.lib");
   }
 
+  // function order, removed after linking
+  llvm::FileRemover orderingFileRemover;
+  if (symbolordering::isEnabled()) {
+    const std::string orderingFile = symbolordering::createOrderingFile(false);
+    if (!orderingFile.empty()) {
+      orderingFileRemover.setFile(orderingFile);
+      args.push_back("/ORDER:@" + orderingFile);
+    }
+  }
+
   // additional linker switches
   auto addSwitch = [&](std::string str) {
     if (str.length() > 2) {
@@ -10,6 +10,7 @@
 #include "driver/linker.h"
 #include "errors.h"
 #include "driver/cl_options.h"
+#include "driver/timereport.h"
 #include "driver/tool.h"
 #include "gen/llvm.h"
 #include "gen/logger.h"
@@ -207,6 +208,7 @@ static std::string gExePath;
 
 int linkObjToBinary() {
   Logger::println("*** Linking executable ***");
+  timereport::Scope timeScope("Linking");
 
   // remember output path for later
   gExePath = getOutputName();
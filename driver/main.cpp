@@ -27,10 +27,13 @@
 #include "driver/configfile.h"
 #include "driver/dcomputecodegenerator.h"
 #include "driver/exe_path.h"
+#include "driver/gcallocreport.h"
 #include "driver/ldc-version.h"
 #include "driver/linker.h"
 #include "driver/plugins.h"
 #include "driver/targetmachine.h"
+#include "driver/toobj.h"
+#include "driver/timereport.h"
 #include "gen/cl_helpers.h"
 #include "gen/irstate.h"
 #include "gen/ldctraits.h"
@@ -38,6 +41,7 @@
 #include "gen/llvm.h"
 #include "gen/llvmhelpers.h"
 #include "gen/logger.h"
+#include "gen/mangling.h"
 #include "gen/metadata.h"
 #include "gen/modules.h"
 #include "gen/objcgen.h"
@@ -287,6 +291,9 @@ void expandResponseFiles(llvm::BumpPtrAllocator &A,
 /// Returns a list of source file names.
 void parseCommandLine(int argc, char **argv, Strings &sourceFiles,
                       bool &helpOnly) {
+  using Clock = std::chrono::steady_clock;
+  const auto parseStart = Clock::now();
+
   global.params.argv0 = exe_path::getExePath().data();
 
   // Set up `opts::allArguments`, the combined list of command line arguments.
@@ -304,7 +311,9 @@ void parseCommandLine(int argc, char **argv, Strings &sourceFiles,
   const char *explicitConfFile = tryGetExplicitConfFile(allArguments);
   const std::string cfg_triple = tryGetExplicitTriple(allArguments).getTriple();
   // just ignore errors for now, they are still printed
+  const auto configStart = Clock::now();
   cfg_file.read(explicitConfFile, cfg_triple.c_str());
+  const auto configEnd = Clock::now();
 
   cfg_file.extendCommandLine(allArguments);
 
@@ -324,6 +333,14 @@ void parseCommandLine(int argc, char **argv, Strings &sourceFiles,
                               const_cast<char **>(allArguments.data()),
                               "LDC - the LLVM D compiler\n");
 
+  // The time report only knows about itself now. Static initialization
+  // includes registering all (LLVM) command line options.
+  timereport::addPhase("Static initialization", timereport::getProcessStart(),
+                       parseStart);
+  timereport::addPhase("Command line parsing", parseStart, Clock::now());
+  timereport::addPhase("Config file", configStart, configEnd,
+                       "Command line parsing");
+
   helpOnly = opts::printTargetFeaturesHelp();
   if (helpOnly) {
     auto triple = llvm::Triple(cfg_triple);
@@ -549,6 +566,17 @@ void parseCommandLine(int argc, char **argv, Strings &sourceFiles,
     error(Loc(), "-soname can be used only when building a shared library");
   }
 
+  if (opts::wholeProgramVtables) {
+#if LDC_LLVM_VER >= 500
+    if (!global.params.oneobj && opts::ltoMode != opts::LTO_Full) {
+      error(Loc(), "-fwhole-program-vtables requires -singleobj or -flto=full");
+    }
+#else
+    error(Loc(), "-fwhole-program-vtables requires LDC to be built against "
+                 "LLVM 5.0 or later");
+#endif
+  }
+
   global.params.hdrStripPlainFunctions = !opts::hdrKeepAllBodies;
   global.params.disableRedZone = opts::disableRedZone();
 }
@@ -762,6 +790,12 @@ void registerPredefinedTargetVersions() {
     VersionCondition::addPredefinedGlobalIdent("D_PIC");
   }
 
+  // Lets druntime switch the split-stack context (__splitstack_*) together
+  // with the fiber stacks.
+  if (opts::splitStack) {
+    VersionCondition::addPredefinedGlobalIdent("LDC_SplitStack");
+  }
+
   if (arch == llvm::Triple::x86 || arch == llvm::Triple::x86_64) {
     /* LDC doesn't support DMD's core.simd interface.
     if (traitsTargetHasFeature("sse2"))
@@ -1026,6 +1060,32 @@ int cppmain(int argc, char **argv) {
       global.obj_ext = "obj";
   }
 
+  // Composite types are identified by their mangled names, so that LLVM can
+  // put each of them into a type unit in a COMDAT section.
+  if (opts::debugTypesSection && global.params.symdebug) {
+    if (!global.params.targetTriple->isOSBinFormatELF()) {
+      warning(Loc(), "-fdebug-types-section is only supported for ELF targets");
+    } else {
+      auto &map = llvm::cl::getRegisteredOptions();
+      auto it = map.find("generate-type-units");
+      if (it != map.end())
+        it->second->addOccurrence(0, "generate-type-units", "true");
+    }
+  }
+
+  // LLVM only emits split-stack prologues (calling libgcc's __morestack) for
+  // these ELF targets.
+  if (opts::splitStack) {
+    const auto &triple = *global.params.targetTriple;
+    const auto arch = triple.getArch();
+    if (!triple.isOSBinFormatELF() ||
+        (arch != llvm::Triple::x86 && arch != llvm::Triple::x86_64 &&
+         arch != llvm::Triple::arm && arch != llvm::Triple::thumb)) {
+      error(Loc(), "-fsplit-stack is only supported for x86, x86_64 and ARM "
+                   "ELF targets");
+    }
+  }
+
   // allocate the target abi
   gABI = TargetABI::getTarget();
 
@@ -1042,6 +1102,18 @@ int cppmain(int argc, char **argv) {
 
   loadAllPlugins();
 
+  // Distributed ThinLTO backend job: no D modules involved.
+  if (!opts::thinLTOIndexFile.empty()) {
+    if (files.dim != 1 || !global.params.objname) {
+      error(Loc(), "-fthinlto-index requires exactly one bitcode object file "
+                   "and -of");
+      fatal();
+    }
+    runThinLTOBackend(files[0], opts::thinLTOIndexFile.c_str(),
+                      global.params.objname);
+    return EXIT_SUCCESS;
+  }
+
   Strings libmodules;
   return mars_mainBody(files, libmodules);
 }
@@ -1051,6 +1123,14 @@ void addDefaultVersionIdentifiers() { registerPredefinedVersions(); }
 void codegenModules(Modules &modules) {
   // Generate one or more object/IR/bitcode files/dcompute kernels.
   if (global.params.obj && !modules.empty()) {
+    // Make the cache directory absolute upfront, before the backend possibly
+    // spawns worker threads accessing it.
+    if (!opts::cacheDir.empty()) {
+      llvm::SmallString<128> cacheDir(opts::cacheDir.c_str());
+      llvm::sys::fs::make_absolute(cacheDir);
+      opts::cacheDir = cacheDir.c_str();
+    }
+
     ldc::CodeGenerator cg(getGlobalContext(), global.params.oneobj);
     DComputeCodeGenManager dccg(getGlobalContext());
     std::vector<Module *> computeModules;
@@ -1095,12 +1175,17 @@ void codegenModules(Modules &modules) {
 
       dccg.writeModules();
     }
+
+    writeHashedSymbolMap();
+
     // We may have removed all object files, if so don't link.
     if (global.params.objfiles.dim == 0)
       global.params.link = false;
   }
 
+  gcallocreport::write();
   cache::pruneCache();
+  cache::reportStatistics();
 
   freeRuntime();
   llvm::llvm_shutdown();
@@ -0,0 +1,369 @@
+//===-- driver/optimizationsummary.cpp ------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Instead of serializing every remark like -fsave-optimization-record, a
+// diagnostic handler wrapping the context's previous one counts the missed
+// inlines and non-vectorized loops, together with the reasons given by the
+// inliner and loop vectorizer, per function while the module is optimized.
+// The D names of the functions are collected during IR generation, so no
+// demangling is needed. The result is written as JSON, with the functions of
+// each D module sorted by hotness (with PGO) and number of missed
+// optimizations.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/optimizationsummary.h"
+
+#include "declaration.h"
+#include "errors.h"
+#include "hdrgen.h" // for parametersTypeToChars()
+#include "module.h"
+#include "mtype.h"
+#include "driver/cl_options_instrumentation.h"
+#include "gen/irstate.h"
+#include "ir/irfunction.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#if LDC_LLVM_VER >= 600
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#endif
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace cl = llvm::cl;
+
+namespace optimizationsummary {
+
+#if LDC_LLVM_VER >= 600
+
+namespace {
+
+cl::opt<std::string>
+    summaryFile("fsave-optimization-summary", cl::value_desc("filename"),
+                cl::desc("Write a JSON summary of the missed inlines and "
+                         "non-vectorized loops per D function and module"),
+                cl::ValueOptional);
+
+cl::opt<unsigned> hotnessThreshold(
+    "optimization-summary-hotness-threshold", cl::ZeroOrMore,
+    cl::value_desc("N"),
+    cl::desc("Only summarize remarks with a profile-based hotness of at least "
+             "<N> (requires PGO)"),
+    cl::init(0));
+
+const char *const inlinePass = "inline";
+const char *const vectorizePass = "loop-vectorize";
+
+enum class RemarkKind { None, Passed, Missed, Analysis };
+
+RemarkKind getRemarkKind(const llvm::DiagnosticInfo &di) {
+  switch (di.getKind()) {
+  case llvm::DK_OptimizationRemark:
+  case llvm::DK_MachineOptimizationRemark:
+    return RemarkKind::Passed;
+  case llvm::DK_OptimizationRemarkMissed:
+  case llvm::DK_MachineOptimizationRemarkMissed:
+    return RemarkKind::Missed;
+  case llvm::DK_OptimizationRemarkAnalysis:
+  case llvm::DK_OptimizationRemarkAnalysisFPCommute:
+  case llvm::DK_OptimizationRemarkAnalysisAliasing:
+  case llvm::DK_MachineOptimizationRemarkAnalysis:
+    return RemarkKind::Analysis;
+  default:
+    return RemarkKind::None;
+  }
+}
+
+struct FunctionStats {
+  uint64_t hotness = 0;
+  unsigned missedInlines = 0;
+  unsigned notVectorizedLoops = 0;
+  std::map<std::string, unsigned> reasons;
+
+  unsigned missed() const { return missedInlines + notVectorizedLoops; }
+};
+
+using Stats = llvm::StringMap<FunctionStats>;
+
+/// Counts the relevant remarks and forwards everything else to the previous
+/// handler. Remarks only enabled for the summary are swallowed, so that they
+/// aren't printed.
+class SummaryHandler : public llvm::DiagnosticHandler {
+public:
+  SummaryHandler(std::unique_ptr<llvm::DiagnosticHandler> previous,
+                 Stats &stats)
+      : previous(std::move(previous)), stats(stats) {}
+
+  std::unique_ptr<llvm::DiagnosticHandler> previous;
+
+  bool isAnalysisRemarkEnabled(llvm::StringRef passName) const override {
+    return passName == vectorizePass ||
+           previous->isAnalysisRemarkEnabled(passName);
+  }
+  bool isMissedOptRemarkEnabled(llvm::StringRef passName) const override {
+    return passName == inlinePass || passName == vectorizePass ||
+           previous->isMissedOptRemarkEnabled(passName);
+  }
+  bool isPassedOptRemarkEnabled(llvm::StringRef passName) const override {
+    return previous->isPassedOptRemarkEnabled(passName);
+  }
+  bool isAnyRemarkEnabled() const override { return true; }
+
+  bool handleDiagnostics(const llvm::DiagnosticInfo &di) override {
+    const RemarkKind kind = getRemarkKind(di);
+    if (kind == RemarkKind::None)
+      return previous->handleDiagnostics(di);
+
+    const auto &remark = llvm::cast<llvm::DiagnosticInfoOptimizationBase>(di);
+    record(kind, remark);
+
+    const llvm::StringRef passName = remark.getPassName();
+    const bool enabledByPrevious =
+        kind == RemarkKind::Passed
+            ? previous->isPassedOptRemarkEnabled(passName)
+            : kind == RemarkKind::Missed
+                  ? previous->isMissedOptRemarkEnabled(passName)
+                  : previous->isAnalysisRemarkEnabled(passName);
+    if (!enabledByPrevious)
+      return true;
+    return previous->handleDiagnostics(di);
+  }
+
+private:
+  Stats &stats;
+
+  void record(RemarkKind kind,
+              const llvm::DiagnosticInfoOptimizationBase &remark) {
+    const llvm::StringRef passName = remark.getPassName();
+    const bool isInline = passName == inlinePass;
+    const bool isVectorize = passName == vectorizePass;
+    if (!(isInline && kind == RemarkKind::Missed) &&
+        !(isVectorize && kind != RemarkKind::Passed)) {
+      return;
+    }
+
+    const uint64_t hotness = remark.getHotness() ? *remark.getHotness() : 0;
+    if (hotnessThreshold > 0 && hotness < hotnessThreshold)
+      return;
+
+    auto &fs = stats[remark.getFunction().getName()];
+    fs.hotness = std::max(fs.hotness, hotness);
+
+    if (kind == RemarkKind::Missed) {
+      if (isInline) {
+        ++fs.missedInlines;
+      } else {
+        ++fs.notVectorizedLoops;
+        // The vectorizer's reasons are given by its analysis remarks.
+        return;
+      }
+    }
+    ++fs.reasons[(passName + ":" + remark.getRemarkName()).str()];
+  }
+};
+
+void writeString(llvm::raw_ostream &os, llvm::StringRef str) {
+  os << '"';
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (c < 0x20) {
+      os << llvm::format("\\u%04x", c);
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+void writeReasons(llvm::raw_ostream &os,
+                  const std::map<std::string, unsigned> &reasons) {
+  os << '{';
+  bool first = true;
+  for (const auto &reason : reasons) {
+    if (!first)
+      os << ", ";
+    first = false;
+    writeString(os, reason.first);
+    os << ": " << reason.second;
+  }
+  os << '}';
+}
+
+struct ModuleSummary {
+  unsigned missedInlines = 0;
+  unsigned notVectorizedLoops = 0;
+  std::map<std::string, unsigned> reasons;
+  std::vector<const Stats::value_type *> functions;
+};
+
+class CollectorImpl : public Collector {
+public:
+  CollectorImpl(Module &dmodule, llvm::LLVMContext &ctx,
+                std::string objFilename, std::string filename,
+                std::shared_ptr<const DisplayNames> names)
+      : dmodule(dmodule), ctx(ctx), objFilename(std::move(objFilename)),
+        filename(std::move(filename)), names(std::move(names)) {
+    ctx.setDiagnosticHandler(
+        llvm::make_unique<SummaryHandler>(ctx.getDiagnosticHandler(), stats));
+    if (opts::isUsingPGOProfile())
+      ctx.setDiagnosticsHotnessRequested(true);
+  }
+
+  void finish() override {
+    auto handler = ctx.getDiagnosticHandler();
+    ctx.setDiagnosticHandler(
+        std::move(static_cast<SummaryHandler &>(*handler).previous));
+    write();
+  }
+
+private:
+  Module &dmodule;
+  llvm::LLVMContext &ctx;
+  std::string objFilename;
+  std::string filename;
+  std::shared_ptr<const DisplayNames> names;
+  Stats stats;
+
+  const DisplayName *lookup(llvm::StringRef irName) const {
+    auto it = names->find(irName);
+    return it == names->end() ? nullptr : &it->second;
+  }
+
+  void write() {
+    std::map<std::string, ModuleSummary> modules;
+    std::map<std::string, unsigned> totalReasons;
+    for (const auto &entry : stats) {
+      const DisplayName *name = lookup(entry.first());
+      // Functions without D name stem from bitcode files passed on the
+      // command line, or were generated by LLVM.
+      auto &ms = modules[name ? name->module : ""];
+      ms.missedInlines += entry.second.missedInlines;
+      ms.notVectorizedLoops += entry.second.notVectorizedLoops;
+      for (const auto &reason : entry.second.reasons) {
+        ms.reasons[reason.first] += reason.second;
+        totalReasons[reason.first] += reason.second;
+      }
+      ms.functions.push_back(&entry);
+    }
+
+    std::error_code ec;
+    llvm::raw_fd_ostream os(filename, ec, llvm::sys::fs::F_Text);
+    if (ec) {
+      dmodule.error("Could not create file %s: %s", filename.c_str(),
+                    ec.message().c_str());
+      fatal();
+    }
+
+    os << "{\n  \"object\": ";
+    writeString(os, objFilename);
+    os << ",\n  \"reasons\": ";
+    writeReasons(os, totalReasons);
+    os << ",\n  \"modules\": [";
+    bool firstModule = true;
+    for (auto &module : modules) {
+      auto &ms = module.second;
+      std::sort(ms.functions.begin(), ms.functions.end(),
+                [](const Stats::value_type *a, const Stats::value_type *b) {
+                  if (a->second.hotness != b->second.hotness)
+                    return a->second.hotness > b->second.hotness;
+                  if (a->second.missed() != b->second.missed())
+                    return a->second.missed() > b->second.missed();
+                  return a->first() < b->first();
+                });
+
+      os << (firstModule ? "\n" : ",\n") << "    {\n      \"module\": ";
+      firstModule = false;
+      writeString(os, module.first);
+      os << ",\n      \"missedInlines\": " << ms.missedInlines
+         << ",\n      \"notVectorizedLoops\": " << ms.notVectorizedLoops
+         << ",\n      \"reasons\": ";
+      writeReasons(os, ms.reasons);
+      os << ",\n      \"functions\": [";
+      bool firstFunction = true;
+      for (const auto *entry : ms.functions) {
+        const auto &fs = entry->second;
+        const DisplayName *name = lookup(entry->first());
+        os << (firstFunction ? "\n" : ",\n") << "        {\"name\": ";
+        firstFunction = false;
+        writeString(os, name ? llvm::StringRef(name->function)
+                             : entry->first());
+        os << ", \"mangled\": ";
+        writeString(os, entry->first());
+        if (fs.hotness)
+          os << ", \"hotness\": " << fs.hotness;
+        os << ", \"missedInlines\": " << fs.missedInlines
+           << ", \"notVectorizedLoops\": " << fs.notVectorizedLoops
+           << ", \"reasons\": ";
+        writeReasons(os, fs.reasons);
+        os << '}';
+      }
+      os << "\n      ]\n    }";
+    }
+    os << "\n  ]\n}\n";
+  }
+};
+
+} // anonymous namespace
+
+bool isEnabled() { return summaryFile.getNumOccurrences() > 0; }
+
+std::unique_ptr<Collector> start(Module &dmodule, llvm::LLVMContext &ctx,
+                                 llvm::StringRef objFilename,
+                                 std::shared_ptr<const DisplayNames> names) {
+  if (!isEnabled())
+    return nullptr;
+
+  llvm::SmallString<128> filename;
+  if (!summaryFile.empty()) {
+    filename = summaryFile.getValue();
+  } else {
+    filename = objFilename;
+    llvm::sys::path::replace_extension(filename, "opt-summary.json");
+  }
+
+  return llvm::make_unique<CollectorImpl>(dmodule, ctx, objFilename.str(),
+                                          filename.str(), std::move(names));
+}
+
+#else // LDC_LLVM_VER < 600
+
+bool isEnabled() { return false; }
+
+std::unique_ptr<Collector> start(Module &, llvm::LLVMContext &,
+                                 llvm::StringRef,
+                                 std::shared_ptr<const DisplayNames>) {
+  return nullptr;
+}
+
+#endif
+
+std::shared_ptr<const DisplayNames> collectDisplayNames(IRState &irs) {
+  auto names = std::make_shared<DisplayNames>();
+  for (FuncDeclaration *fd : irs.definedFunctions) {
+    DisplayName name;
+    name.function = fd->toPrettyChars();
+    if (fd->type->ty == Tfunction) {
+      auto tf = static_cast<TypeFunction *>(fd->type);
+      name.function += parametersTypeToChars(tf->parameters, tf->varargs);
+    }
+    if (Module *m = fd->getModule())
+      name.module = m->toPrettyChars();
+    (*names)[getIrFunc(fd)->getLLVMFunc()->getName()] = std::move(name);
+  }
+  return names;
+}
+
+}
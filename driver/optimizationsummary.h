@@ -0,0 +1,62 @@
+//===-- driver/optimizationsummary.h ----------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Summary of the missed inlining and loop vectorization remarks, aggregated
+// per D function and module (-fsave-optimization-summary).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_OPTIMIZATIONSUMMARY_H
+#define LDC_DRIVER_OPTIMIZATIONSUMMARY_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include <memory>
+#include <string>
+
+class Module;
+struct IRState;
+namespace llvm {
+class LLVMContext;
+}
+
+namespace optimizationsummary {
+
+/// Whether -fsave-optimization-summary is enabled.
+bool isEnabled();
+
+struct DisplayName {
+  std::string function; // qualified name with parameter types
+  std::string module;
+};
+
+/// D names of the functions defined in an IR module, keyed by IR name.
+using DisplayNames = llvm::StringMap<DisplayName>;
+
+/// Returns the D names of irs.definedFunctions.
+std::shared_ptr<const DisplayNames> collectDisplayNames(IRState &irs);
+
+class Collector {
+public:
+  virtual ~Collector() = default;
+
+  /// Restores the previous diagnostic handler of the context and writes the
+  /// summary file.
+  virtual void finish() = 0;
+};
+
+/// Starts collecting the optimization remarks emitted in `ctx` while
+/// optimizing the given object file. Returns null if the summary isn't
+/// enabled.
+std::unique_ptr<Collector> start(Module &dmodule, llvm::LLVMContext &ctx,
+                                 llvm::StringRef objFilename,
+                                 std::shared_ptr<const DisplayNames> names);
+}
+
+#endif
@@ -9,6 +9,15 @@
 //
 // Implements functionality related to plugins (`-plugin=...`).
 //
+// Two kinds of plugins are supported:
+// - Pass plugins (LLVM 7+) export an `llvmGetPassPluginInfo()` function,
+//   like plugins for LLVM's `opt -load-pass-plugin`. Their callback registers
+//   the plugin's passes at the extension points of the new pass manager's
+//   pipeline, e.g., `registerScalarOptimizerLateEPCallback()` (after the D
+//   passes) or `registerVectorizerStartEPCallback()`.
+// - Other plugins register themselves with LDC/LLVM in static constructors,
+//   e.g., using `llvm::RegisterStandardPasses` for the legacy pass manager.
+//
 //===----------------------------------------------------------------------===//
 
 #include "driver/plugins.h"
@@ -18,6 +27,11 @@
 #include "errors.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/DynamicLibrary.h"
+#if LDC_LLVM_VER >= 700
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include <vector>
+#endif
 
 namespace {
 namespace cl = llvm::cl;
@@ -26,10 +40,15 @@ cl::list<std::string>
     pluginFiles("plugin", cl::CommaSeparated, cl::desc("Plugins to load."),
                 cl::value_desc("<dynamic_library.so, lib2.so>"));
 
+#if LDC_LLVM_VER >= 700
+std::vector<llvm::PassPlugin> passPlugins;
+#endif
+
 } // anonymous namespace
 
-/// Loads all plugins. The static constructor of each plugin should take care of
-/// the plugins registering themself with the rest of LDC/LLVM.
+/// Loads all plugins. Pass plugins are kept for registering their passes with
+/// the optimization pipeline; the static constructor of other plugins should
+/// take care of the plugins registering themself with the rest of LDC/LLVM.
 void loadAllPlugins() {
   for (auto &filename : pluginFiles) {
     std::string errorString;
@@ -37,12 +56,42 @@ void loadAllPlugins() {
                                                           &errorString)) {
       error(Loc(), "Error loading plugin '%s': %s", filename.c_str(),
             errorString.c_str());
+      continue;
+    }
+
+#if LDC_LLVM_VER >= 700
+    const auto library =
+        llvm::sys::DynamicLibrary::getPermanentLibrary(filename.c_str());
+    if (!library.getAddressOfSymbol("llvmGetPassPluginInfo"))
+      continue;
+
+    auto plugin = llvm::PassPlugin::Load(filename);
+    if (!plugin) {
+      error(Loc(), "Error loading plugin '%s': %s", filename.c_str(),
+            llvm::toString(plugin.takeError()).c_str());
+      continue;
     }
+    passPlugins.push_back(*plugin);
+#endif
   }
 }
 
+#if LDC_LLVM_VER >= 700
+bool hasPassPlugins() { return !passPlugins.empty(); }
+
+void registerPassPluginCallbacks(llvm::PassBuilder &builder) {
+  for (auto &plugin : passPlugins)
+    plugin.registerPassBuilderCallbacks(builder);
+}
+#endif
+
 #else // #if LDC_ENABLE_PLUGINS
 
 void loadAllPlugins() {}
 
+#if LDC_LLVM_VER >= 700
+bool hasPassPlugins() { return false; }
+void registerPassPluginCallbacks(llvm::PassBuilder &) {}
+#endif
+
 #endif // LDC_ENABLE_PLUGINS
@@ -10,6 +10,22 @@
 #ifndef LDC_DRIVER_PLUGINS_H
 #define LDC_DRIVER_PLUGINS_H
 
+#if LDC_LLVM_VER >= 700
+namespace llvm {
+class PassBuilder;
+}
+#endif
+
 void loadAllPlugins();
 
+#if LDC_LLVM_VER >= 700
+/// Returns whether any pass plugins (exporting `llvmGetPassPluginInfo()`) have
+/// been loaded. Their passes are only run by the new pass manager.
+bool hasPassPlugins();
+
+/// Lets the loaded pass plugins register their callbacks, e.g., for the
+/// pipeline extension points.
+void registerPassPluginCallbacks(llvm::PassBuilder &builder);
+#endif
+
 #endif // LDC_DRIVER_PLUGINS_H
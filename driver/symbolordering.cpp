@@ -0,0 +1,147 @@
+//===-- driver/symbolordering.cpp -----------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The order is either given by the user, e.g. as recorded from a startup
+// trace, or derived from the -fprofile-instr-use profile: all functions which
+// were called, by decreasing entry count. The linker gets it in its own
+// format, i.e. as symbol names (lld, ld64, link.exe) or as the names of the
+// -function-sections sections (gold).
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/symbolordering.h"
+
+#include "errors.h"
+#include "globals.h"
+#include "driver/cl_options_instrumentation.h"
+#include "gen/irstate.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ProfileData/InstrProfReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace {
+
+llvm::cl::opt<std::string> orderingFile(
+    "symbol-ordering-file", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Place the functions listed in <file> (one symbol per "
+                   "line) first and in that order when linking"),
+    llvm::cl::value_desc("file"));
+
+llvm::cl::opt<bool> profileOrdering(
+    "fprofile-symbol-ordering", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Place the functions called in the -fprofile-instr-use "
+                   "profile first when linking, by decreasing entry count"));
+
+bool readOrderingFile(std::vector<std::string> &symbols) {
+  auto buffer = llvm::MemoryBuffer::getFile(orderingFile);
+  if (!buffer) {
+    error(Loc(), "-symbol-ordering-file: cannot read '%s'",
+          orderingFile.c_str());
+    return false;
+  }
+  llvm::SmallVector<llvm::StringRef, 0> lines;
+  (*buffer)->getBuffer().split(lines, '\n', -1, false);
+  for (auto line : lines) {
+    line = line.trim();
+    if (!line.empty() && line.front() != '#')
+      symbols.push_back(line.str());
+  }
+  return true;
+}
+
+bool readProfile(std::vector<std::string> &symbols) {
+  if (!opts::isUsingPGOProfile() || opts::isUsingSampleBasedPGOProfile()) {
+    error(Loc(), "-fprofile-symbol-ordering requires -fprofile-instr-use");
+    return false;
+  }
+
+  auto readerOrErr =
+      llvm::IndexedInstrProfReader::create(global.params.datafileInstrProf);
+  if (auto E = readerOrErr.takeError()) {
+    handleAllErrors(std::move(E), [&](const llvm::ErrorInfoBase &EI) {
+      error(Loc(), "Could not read profile file '%s': %s",
+            global.params.datafileInstrProf, EI.message().c_str());
+    });
+    return false;
+  }
+
+  // The first counter of each function counts its entries. Functions with
+  // internal linkage are recorded as "<file>:<name>".
+  llvm::StringMap<uint64_t> counts;
+  for (const auto &record : *readerOrErr.get()) {
+    if (record.Counts.empty() || record.Counts[0] == 0)
+      continue;
+    llvm::StringRef name = record.Name;
+    const auto colon = name.rfind(':');
+    if (colon != llvm::StringRef::npos)
+      name = name.drop_front(colon + 1);
+    auto &count = counts[name];
+    count = std::max(count, record.Counts[0]);
+  }
+
+  std::vector<std::pair<uint64_t, llvm::StringRef>> sorted;
+  for (const auto &entry : counts)
+    sorted.emplace_back(entry.second, entry.first());
+  std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<uint64_t, llvm::StringRef> &a,
+               const std::pair<uint64_t, llvm::StringRef> &b) {
+              return a.first != b.first ? a.first > b.first
+                                        : a.second < b.second;
+            });
+  for (const auto &entry : sorted)
+    symbols.push_back(entry.second.str());
+  return true;
+}
+
+} // anonymous namespace
+
+namespace symbolordering {
+
+bool isEnabled() { return !orderingFile.empty() || profileOrdering; }
+
+std::string createOrderingFile(bool sectionNames) {
+  std::vector<std::string> symbols;
+  if (!(orderingFile.empty() ? readProfile(symbols)
+                             : readOrderingFile(symbols)) ||
+      symbols.empty()) {
+    return "";
+  }
+
+  llvm::SmallString<128> path;
+  int fd;
+  if (llvm::sys::fs::createTemporaryFile("ldc-symbol-order", "txt", fd,
+                                         path)) {
+    error(Loc(), "failed to create temporary file for the symbol order");
+    return "";
+  }
+
+  const char prefix = gTargetMachine->createDataLayout().getGlobalPrefix();
+  llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+  for (const auto &symbol : symbols) {
+    if (sectionNames) {
+      // Profiled hot functions get the .text.hot prefix.
+      os << ".text.hot." << symbol << '\n';
+      os << ".text." << symbol << '\n';
+    } else {
+      if (prefix != '\0')
+        os << prefix;
+      os << symbol << '\n';
+    }
+  }
+  return path.str().str();
+}
+
+}
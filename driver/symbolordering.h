@@ -0,0 +1,34 @@
+//===-- driver/symbolordering.h ---------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Function order for the linker (-symbol-ordering-file,
+// -fprofile-symbol-ordering), packing hot code together.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_SYMBOLORDERING_H
+#define LDC_DRIVER_SYMBOLORDERING_H
+
+#include <string>
+
+namespace symbolordering {
+
+/// Whether the functions are to be ordered when linking, which requires
+/// -function-sections for ELF targets.
+bool isEnabled();
+
+/// Writes the functions to place first, one per line and hottest first, to a
+/// temporary file and returns its path. With `sectionNames`, the names of
+/// their -function-sections sections are written instead of the symbol names.
+/// Returns an empty string if there is nothing to order; errors are reported.
+std::string createOrderingFile(bool sectionNames);
+
+}
+
+#endif
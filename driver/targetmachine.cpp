@@ -14,6 +14,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "driver/cl_options.h"
+#include "driver/symbolordering.h"
 #include "driver/targetmachine.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringSwitch.h"
@@ -22,6 +23,7 @@
 #include "llvm/MC/SubtargetFeature.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Compression.h"
 #include "llvm/Support/TargetParser.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
@@ -100,7 +102,7 @@ static const char *getABI(const llvm::Triple &triple) {
   }
 }
 
-extern llvm::TargetMachine *gTargetMachine;
+extern thread_local llvm::TargetMachine *gTargetMachine;
 
 MipsABI::Type getMipsABI() {
   // eabi can only be set on the commandline
@@ -479,6 +481,33 @@ createTargetMachine(const std::string targetTriple, const std::string arch,
     targetOptions.DataSections = true;
   }
 
+  // Ordering functions at link-time requires a section per function, except
+  // for Mach-O, where ld64 orders by symbol.
+  if (symbolordering::isEnabled() && !triple.isOSBinFormatMachO()) {
+    targetOptions.FunctionSections = true;
+  }
+
+#if LDC_LLVM_VER >= 500
+  if (opts::compressDebugSections.getNumOccurrences() > 0) {
+    const auto &type = opts::compressDebugSections;
+    if (type.empty() || type == "zlib") {
+      targetOptions.CompressDebugSections = llvm::DebugCompressionType::Z;
+    } else if (type == "zlib-gnu") {
+      targetOptions.CompressDebugSections = llvm::DebugCompressionType::GNU;
+    } else if (type != "none") {
+      error(Loc(), "unknown debug section compression '%s' for -gz",
+            type.c_str());
+      fatal();
+    }
+    if (targetOptions.CompressDebugSections !=
+            llvm::DebugCompressionType::None &&
+        !llvm::zlib::isAvailable()) {
+      error(Loc(), "-gz requires LLVM to be built with zlib");
+      fatal();
+    }
+  }
+#endif
+
 #if LDC_LLVM_VER >= 700
   // On Android, we depend on a custom TLS emulation scheme implemented in our
   // LLVM fork. LLVM 7+ enables regular emutls by default; prevent that.
@@ -502,6 +531,14 @@ createTargetMachine(const std::string targetTriple, const std::string arch,
                                      codeGenOptLevel);
 }
 
+llvm::TargetMachine *cloneTargetMachine(const llvm::TargetMachine &target) {
+  return target.getTarget().createTargetMachine(
+      target.getTargetTriple().str(), target.getTargetCPU(),
+      target.getTargetFeatureString(), target.Options,
+      target.getRelocationModel(), target.getCodeModel(),
+      target.getOptLevel());
+}
+
 ComputeBackend::Type getComputeTargetType(llvm::Module* m) {
   llvm::Triple::ArchType a = llvm::Triple(m->getTargetTriple()).getArch();
   if (a == llvm::Triple::spir || a == llvm::Triple::spir64)
@@ -65,6 +65,13 @@ createTargetMachine(std::string targetTriple, std::string arch, std::string cpu,
                     llvm::CodeGenOpt::Level codeGenOptLevel,
                     bool noLinkerStripDead);
 
+/**
+ * Creates a new TargetMachine with the same target, CPU, features, options and
+ * code generation settings as the given one.
+ * Used to give each parallel backend thread its own TargetMachine.
+ */
+llvm::TargetMachine *cloneTargetMachine(const llvm::TargetMachine &target);
+
 /**
  * Returns the Mips ABI which is used for code generation.
  *
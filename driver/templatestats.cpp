@@ -0,0 +1,154 @@
+//===-- driver/templatestats.cpp ------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The times are self times, i.e., the time spent in nested template instances
+// is only accounted to their templates, so that the times of all templates add
+// up. The report is printed to stderr at program exit.
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/templatestats.h"
+
+#include "template.h"
+#include "driver/timereport.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/CommandLine.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+llvm::cl::opt<bool> templateStats(
+    "ftemplate-stats", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Print the number of instances and the semantic analysis "
+                   "and IR generation times of the most expensive templates"));
+
+llvm::cl::opt<unsigned> templateStatsTop(
+    "ftemplate-stats-top", llvm::cl::ZeroOrMore, llvm::cl::init(20),
+    llvm::cl::value_desc("n"),
+    llvm::cl::desc("Number of templates listed by -ftemplate-stats "
+                   "(default: 20, 0: all)"));
+
+struct Frame {
+  TemplateDeclaration *td;
+  TemplateInstance *ti;
+  bool codegen;
+  std::chrono::steady_clock::time_point start;
+  double nestedSeconds;
+};
+
+// The template instances being analyzed or generated, innermost last.
+std::vector<Frame> frames;
+
+// In order of the first instantiation.
+std::vector<TemplateDeclaration *> templates;
+llvm::DenseSet<TemplateDeclaration *> seenTemplates;
+
+bool isEnabled() { return templateStats || timereport::isTraceEnabled(); }
+
+void printReport() {
+  std::vector<TemplateDeclaration *> sorted = templates;
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](TemplateDeclaration *a, TemplateDeclaration *b) {
+                     return a->semanticTime + a->codegenTime >
+                            b->semanticTime + b->codegenTime;
+                   });
+
+  unsigned numInstances = 0;
+  unsigned numDedupHits = 0;
+  for (auto td : templates) {
+    numInstances += td->numInstances;
+    numDedupHits += td->numDedupHits;
+  }
+
+  std::fprintf(stderr,
+               "===---------------------------------------------------------"
+               "----------===\n"
+               "                         LDC template statistics\n"
+               "===---------------------------------------------------------"
+               "----------===\n"
+               "  %u templates, %u instances, %u reused instances\n"
+               "  (Times exclude nested template instances.)\n\n"
+               "  Semantic (s)  Codegen (s)  Instances     Reused  Template\n",
+               static_cast<unsigned>(templates.size()), numInstances,
+               numDedupHits);
+
+  if (templateStatsTop && sorted.size() > templateStatsTop)
+    sorted.resize(templateStatsTop);
+  for (auto td : sorted) {
+    std::fprintf(stderr, "  %12.4f  %11.4f  %9u  %9u  %s at %s\n",
+                 td->semanticTime, td->codegenTime, td->numInstances,
+                 td->numDedupHits, td->toPrettyChars(), td->loc.toChars());
+  }
+  std::fflush(stderr);
+}
+
+void begin(TemplateDeclaration *td, TemplateInstance *ti, bool codegen) {
+  if (templateStats && seenTemplates.insert(td).second) {
+    if (templates.empty())
+      std::atexit(&printReport);
+    templates.push_back(td);
+  }
+  frames.push_back({td, ti, codegen, std::chrono::steady_clock::now(), 0});
+}
+
+void end() {
+  const auto frame = frames.back();
+  frames.pop_back();
+
+  const auto now = std::chrono::steady_clock::now();
+  const double seconds =
+      std::chrono::duration<double>(now - frame.start).count();
+  if (!frames.empty())
+    frames.back().nestedSeconds += seconds;
+
+  const double selfSeconds = std::max(seconds - frame.nestedSeconds, 0.0);
+  if (frame.codegen)
+    frame.td->codegenTime += selfSeconds;
+  else
+    frame.td->semanticTime += selfSeconds;
+
+  if (timereport::isTraceEnabled()) {
+    timereport::addTraceEvent(frame.codegen ? "Template IR generation"
+                                            : "Template instantiation",
+                              frame.ti->toPrettyChars(), frame.start, now);
+  }
+}
+
+} // anonymous namespace
+
+namespace templatestats {
+
+CodegenScope::CodegenScope(TemplateInstance *ti) : active(false) {
+  if (!isEnabled())
+    return;
+  if (auto td = ti->tempdecl->isTemplateDeclaration()) {
+    begin(td, ti, true);
+    active = true;
+  }
+}
+
+CodegenScope::~CodegenScope() {
+  if (active)
+    end();
+}
+}
+
+void templateStatsBegin(TemplateDeclaration *td, TemplateInstance *ti) {
+  if (isEnabled())
+    begin(td, ti, false);
+}
+
+void templateStatsEnd() {
+  if (isEnabled())
+    end();
+}
@@ -0,0 +1,43 @@
+//===-- driver/templatestats.h ----------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Per-template statistics of the instances, reused instances, semantic
+// analysis and IR generation times (-ftemplate-stats); the instantiations
+// also show up in the -ftime-trace output.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_TEMPLATESTATS_H
+#define LDC_DRIVER_TEMPLATESTATS_H
+
+class TemplateDeclaration;
+class TemplateInstance;
+
+namespace templatestats {
+
+/// Adds its lifetime, excluding nested template instances, to the IR
+/// generation time of the instance's template.
+class CodegenScope {
+  bool active;
+
+public:
+  explicit CodegenScope(TemplateInstance *ti);
+  ~CodegenScope();
+
+  CodegenScope(const CodegenScope &) = delete;
+  CodegenScope &operator=(const CodegenScope &) = delete;
+};
+}
+
+// For the frontend, which can't use RAII scopes: brackets the semantic
+// analysis of a template instance.
+void templateStatsBegin(TemplateDeclaration *td, TemplateInstance *ti);
+void templateStatsEnd();
+
+#endif
@@ -0,0 +1,364 @@
+//===-- driver/timereport.cpp ---------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The report is printed to stderr at program exit, so that it includes
+// linking and is printed even if compilation fails. The same holds for the
+// trace (-ftime-trace), which records each entered phase as a span in the
+// Chrome trace event format (chrome://tracing, speedscope, Perfetto).
+//
+//===----------------------------------------------------------------------===//
+
+#include "driver/timereport.h"
+
+#include "globals.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#if _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+llvm::cl::opt<bool> timeReport(
+    "ftime-report", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Print the wall time and peak memory usage of the compiler "
+                   "phases, including LDC's own optimization passes"));
+
+llvm::cl::opt<bool> timeTrace(
+    "ftime-trace", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Write a trace of the compiler phases in the Chrome trace "
+                   "event format (see -ftime-trace-file)"));
+
+llvm::cl::opt<std::string> timeTraceFile(
+    "ftime-trace-file", llvm::cl::ZeroOrMore, llvm::cl::value_desc("file"),
+    llvm::cl::desc("The -ftime-trace output file (default: the first object "
+                   "file with extension .time-trace)"));
+
+const std::chrono::steady_clock::time_point processStart =
+    std::chrono::steady_clock::now();
+
+struct Phase {
+  std::string name;
+  std::string parent;
+  double seconds = 0;
+  unsigned count = 0;
+  uint64_t peakRSS = 0; // after the phase, in bytes
+};
+
+// In order of the first entry.
+std::vector<Phase> phases;
+std::mutex phasesMutex;
+
+// The phases entered via timeReportBeginPhase(): name, detail, start.
+std::vector<
+    std::tuple<const char *, std::string, std::chrono::steady_clock::time_point>>
+    frontendPhases;
+
+struct TraceEvent {
+  std::string name;
+  std::string detail;
+  uint64_t start; // in microseconds since processStart
+  uint64_t duration;
+  unsigned thread;
+};
+
+// Guarded by phasesMutex.
+std::vector<TraceEvent> traceEvents;
+std::vector<std::thread::id> traceThreads;
+
+// Returns 0 if unknown.
+uint64_t getPeakRSS() {
+#if _WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return 0;
+#if __APPLE__
+  return usage.ru_maxrss; // bytes
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
+
+// Requires phasesMutex to be locked.
+Phase &getPhase(const char *name) {
+  for (auto &phase : phases) {
+    if (phase.name == name)
+      return phase;
+  }
+  phases.emplace_back();
+  phases.back().name = name;
+  return phases.back();
+}
+
+void printRow(double seconds, double total, unsigned count, uint64_t peakRSS,
+              int indent, const char *name) {
+  std::fprintf(stderr, "%11.4f  %5.1f%%  %7u  ", seconds,
+               total > 0 ? 100 * seconds / total : 0.0, count);
+  if (peakRSS)
+    std::fprintf(stderr, "%11.1f", peakRSS / (1024.0 * 1024.0));
+  else
+    std::fprintf(stderr, "%11s", "-");
+  std::fprintf(stderr, "  %*s%s\n", indent, "", name);
+}
+
+void printReport() {
+  std::lock_guard<std::mutex> lock(phasesMutex);
+
+  const double total = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - processStart)
+                           .count();
+
+  std::fprintf(stderr,
+               "===---------------------------------------------------------"
+               "----------===\n"
+               "                            LDC time report\n"
+               "===---------------------------------------------------------"
+               "----------===\n"
+               "  Total wall time: %.4f seconds, peak RSS: %.1f MB\n"
+               "  (Phases running on multiple threads (-j) are summed up.)\n\n"
+               "   Wall (s)   Total    Calls  Peak RSS/MB  Phase\n",
+               total, getPeakRSS() / (1024.0 * 1024.0));
+
+  for (const auto &phase : phases) {
+    if (!phase.parent.empty())
+      continue;
+    printRow(phase.seconds, total, phase.count, phase.peakRSS, 0,
+             phase.name.c_str());
+
+    double childSeconds = 0;
+    bool hasChildren = false;
+    for (const auto &child : phases) {
+      if (child.parent != phase.name)
+        continue;
+      hasChildren = true;
+      childSeconds += child.seconds;
+      printRow(child.seconds, total, child.count, 0, 2, child.name.c_str());
+    }
+    if (hasChildren) {
+      const double rest = phase.seconds > childSeconds
+                              ? phase.seconds - childSeconds
+                              : 0.0;
+      printRow(rest, total, phase.count, 0, 2, "(other)");
+    }
+  }
+  std::fflush(stderr);
+}
+
+uint64_t microsecondsSinceProcessStart(
+    std::chrono::steady_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(time -
+                                                               processStart)
+      .count();
+}
+
+// Requires phasesMutex to be locked.
+unsigned getTraceThread() {
+  const auto id = std::this_thread::get_id();
+  for (size_t i = 0; i < traceThreads.size(); ++i) {
+    if (traceThreads[i] == id)
+      return i;
+  }
+  traceThreads.push_back(id);
+  return traceThreads.size() - 1;
+}
+
+// Requires phasesMutex to be locked.
+void addTraceEventLocked(const char *name, const char *detail,
+                         std::chrono::steady_clock::time_point start,
+                         std::chrono::steady_clock::time_point end) {
+  traceEvents.emplace_back();
+  auto &event = traceEvents.back();
+  event.name = name;
+  if (detail)
+    event.detail = detail;
+  event.start = microsecondsSinceProcessStart(start);
+  event.duration = microsecondsSinceProcessStart(end) - event.start;
+  event.thread = getTraceThread();
+}
+
+void addPhaseTime(const char *name, std::chrono::steady_clock::time_point start,
+                  std::chrono::steady_clock::time_point end,
+                  const char *detail = nullptr) {
+  const uint64_t peakRSS = getPeakRSS();
+  std::lock_guard<std::mutex> lock(phasesMutex);
+  auto &phase = getPhase(name);
+  phase.seconds += std::chrono::duration<double>(end - start).count();
+  ++phase.count;
+  if (peakRSS > phase.peakRSS)
+    phase.peakRSS = peakRSS;
+
+  if (timeTrace)
+    addTraceEventLocked(name, detail, start, end);
+}
+
+void writeJSONString(llvm::raw_ostream &os, llvm::StringRef str) {
+  os << '"';
+  for (const char c : str) {
+    if (c == '"' || c == '\\')
+      os << '\\' << c;
+    else if (static_cast<unsigned char>(c) < 0x20)
+      os << ' ';
+    else
+      os << c;
+  }
+  os << '"';
+}
+
+std::string getTraceFileName() {
+  if (!timeTraceFile.empty())
+    return timeTraceFile;
+  llvm::SmallString<128> name(
+      global.params.objfiles.dim ? global.params.objfiles[0] : "ldc");
+  llvm::sys::path::replace_extension(name, "time-trace");
+  return name.str();
+}
+
+void writeTrace() {
+  std::lock_guard<std::mutex> lock(phasesMutex);
+
+  const auto filename = getTraceFileName();
+  std::error_code errinfo;
+  llvm::raw_fd_ostream os(filename, errinfo, llvm::sys::fs::F_Text);
+  if (errinfo) {
+    std::fprintf(stderr, "Error: cannot write time trace file '%s': %s\n",
+                 filename.c_str(), errinfo.message().c_str());
+    return;
+  }
+
+  os << "{\"traceEvents\":[\n";
+  bool first = true;
+  for (const auto &event : traceEvents) {
+    if (!first)
+      os << ",\n";
+    first = false;
+    os << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+       << ",\"ts\":" << event.start << ",\"dur\":" << event.duration
+       << ",\"name\":";
+    writeJSONString(os, event.name);
+    if (!event.detail.empty()) {
+      os << ",\"args\":{\"detail\":";
+      writeJSONString(os, event.detail);
+      os << '}';
+    }
+    os << '}';
+  }
+  os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+void atExit() {
+  if (timeReport)
+    printReport();
+  if (timeTrace)
+    writeTrace();
+}
+
+void registerAtExit() {
+  static std::once_flag atExitRegistered;
+  std::call_once(atExitRegistered, [] { std::atexit(&atExit); });
+}
+
+void registerPhase(const char *name, const char *parent) {
+  registerAtExit();
+
+  std::lock_guard<std::mutex> lock(phasesMutex);
+  auto &phase = getPhase(name);
+  if (parent && phase.parent.empty()) {
+    phase.parent = parent;
+    getPhase(parent); // list the parent even if it is never entered
+  }
+}
+
+} // anonymous namespace
+
+namespace timereport {
+
+bool isEnabled() { return timeReport || timeTrace; }
+
+Scope::Scope(const char *name, const char *parent, const char *detail)
+    : name(isEnabled() ? name : nullptr) {
+  if (this->name) {
+    registerPhase(name, parent);
+    if (detail && timeTrace)
+      this->detail = detail;
+    start = std::chrono::steady_clock::now();
+  }
+}
+
+Scope::~Scope() {
+  if (name) {
+    addPhaseTime(name, start, std::chrono::steady_clock::now(),
+                 detail.empty() ? nullptr : detail.c_str());
+  }
+}
+
+void addPhase(const char *name, std::chrono::steady_clock::time_point start,
+              std::chrono::steady_clock::time_point end, const char *parent) {
+  if (!isEnabled())
+    return;
+  registerPhase(name, parent);
+  addPhaseTime(name, start, end);
+}
+
+bool isTraceEnabled() { return timeTrace; }
+
+void addTraceEvent(const char *name, const char *detail,
+                   std::chrono::steady_clock::time_point start,
+                   std::chrono::steady_clock::time_point end) {
+  if (!timeTrace)
+    return;
+  registerAtExit();
+  std::lock_guard<std::mutex> lock(phasesMutex);
+  addTraceEventLocked(name, detail, start, end);
+}
+
+std::chrono::steady_clock::time_point getProcessStart() { return processStart; }
+}
+
+void timeReportBeginPhase(const char *name, const char *parent,
+                          const char *detail) {
+  if (!timereport::isEnabled())
+    return;
+  registerPhase(name, parent);
+  frontendPhases.emplace_back(name, detail && timeTrace ? detail : "",
+                              std::chrono::steady_clock::now());
+}
+
+void timeReportEndPhase() {
+  if (frontendPhases.empty())
+    return;
+  const auto phase = frontendPhases.back();
+  frontendPhases.pop_back();
+  const auto &detail = std::get<1>(phase);
+  addPhaseTime(std::get<0>(phase), std::get<2>(phase),
+               std::chrono::steady_clock::now(),
+               detail.empty() ? nullptr : detail.c_str());
+}
@@ -0,0 +1,67 @@
+//===-- driver/timereport.h -------------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Wall time and peak memory report of the compiler phases (-ftime-report)
+// and a trace of them (-ftime-trace).
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_DRIVER_TIMEREPORT_H
+#define LDC_DRIVER_TIMEREPORT_H
+
+#include <chrono>
+#include <string>
+
+namespace timereport {
+
+/// Whether -ftime-report or -ftime-trace is enabled.
+bool isEnabled();
+
+/// Adds its lifetime to the wall time of a phase. Phases can be entered
+/// multiple times and from multiple threads; the times are summed up.
+/// A `parent` phase is reported with a breakdown of its child phases.
+/// The optional `detail`, e.g., a module name, only shows up in the trace.
+class Scope {
+  const char *name;
+  std::string detail;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  explicit Scope(const char *name, const char *parent = nullptr,
+                 const char *detail = nullptr);
+  ~Scope();
+
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+};
+
+/// Adds a finished phase, for phases before -ftime-report has been parsed.
+void addPhase(const char *name, std::chrono::steady_clock::time_point start,
+              std::chrono::steady_clock::time_point end,
+              const char *parent = nullptr);
+
+/// Whether -ftime-trace is enabled.
+bool isTraceEnabled();
+
+/// Adds a span to the -ftime-trace output without accounting it to a phase,
+/// e.g., for events nested in phases or too numerous for the report.
+void addTraceEvent(const char *name, const char *detail,
+                   std::chrono::steady_clock::time_point start,
+                   std::chrono::steady_clock::time_point end);
+
+/// Returns the (approximate) time the process was started at.
+std::chrono::steady_clock::time_point getProcessStart();
+}
+
+// For the frontend (dmd/mars.d), which can't use RAII scopes.
+void timeReportBeginPhase(const char *name, const char *parent = nullptr,
+                          const char *detail = nullptr);
+void timeReportEndPhase();
+
+#endif
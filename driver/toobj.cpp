@@ -9,13 +9,19 @@
 
 #include "driver/toobj.h"
 
+#include "driver/archiver.h"
+#include "driver/backenderrors.h"
 #include "driver/cl_options.h"
 #include "driver/cache.h"
+#include "driver/codegenerator.h"
+#include "driver/gcallocreport.h"
 #include "driver/targetmachine.h"
+#include "driver/timereport.h"
 #include "driver/tool.h"
 #include "gen/irstate.h"
 #include "gen/logger.h"
 #include "gen/optimizer.h"
+#include "rmem.h"
 #include "llvm/IR/AssemblyAnnotationWriter.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Analysis/ModuleSummaryAnalysis.h"
@@ -26,11 +32,27 @@
 #include "llvm/Bitcode/ReaderWriter.h"
 #endif
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IRReader/IRReader.h"
+#if LDC_LLVM_VER >= 500
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/IR/ModuleSummaryIndex.h"
+#include "llvm/LTO/LTO.h"
+#include "llvm/LTO/LTOBackend.h"
+#include "llvm/Transforms/IPO/FunctionImport.h"
+#endif
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Program.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#if LDC_LLVM_VER >= 400
+#include "llvm/Support/xxhash.h"
+#else
+#include "llvm/Support/MD5.h"
+#endif
 #ifdef LDC_LLVM_SUPPORTED_TARGET_SPIRV
 #include "llvm/Support/SPIRV.h"
 #endif
@@ -42,23 +64,44 @@
 #include "llvm/Target/TargetSubtargetInfo.h"
 #endif
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
 #include "llvm/IR/Module.h"
 #include <cstddef>
 #include <fstream>
+#include <mutex>
 
 static llvm::cl::opt<bool>
     NoIntegratedAssembler("no-integrated-as", llvm::cl::ZeroOrMore,
                           llvm::cl::Hidden,
                           llvm::cl::desc("Disable integrated assembler"));
 
+static llvm::cl::opt<unsigned> singleObjPartitions(
+    "singleobj-partitions", llvm::cl::ZeroOrMore, llvm::cl::value_desc("N"),
+    llvm::cl::init(1),
+    llvm::cl::desc("With -singleobj, split the optimized module into <N> "
+                   "partitions for parallel machine codegen, resulting in <N> "
+                   "object files (experimental)"));
+
+static llvm::cl::opt<unsigned> cacheFragments(
+    "cache-fragments", llvm::cl::ZeroOrMore, llvm::cl::value_desc("N"),
+    llvm::cl::init(1),
+    llvm::cl::desc("With -cache, split each module into <N> fragments that are "
+                   "cached separately, resulting in <N> object files. Trades "
+                   "cross-fragment inlining for finer-grained cache hits "
+                   "(experimental)"));
+
 namespace {
 
 // based on llc code, University of Illinois Open Source License
 void codegenModule(llvm::TargetMachine &Target, llvm::Module &m,
-                   llvm::raw_fd_ostream &out,
-                   llvm::TargetMachine::CodeGenFileType fileType) {
+                   llvm::raw_pwrite_stream &out,
+                   llvm::TargetMachine::CodeGenFileType fileType,
+                   llvm::raw_fd_ostream *dwoOut = nullptr) {
   using namespace llvm;
 
+  timereport::Scope timeScope("Machine codegen", nullptr,
+                              m.getModuleIdentifier().c_str());
+
 // Create a PassManager to hold and optimize the collection of passes we are
 // about to build.
   legacy::PassManager Passes;
@@ -70,7 +113,8 @@ void codegenModule(llvm::TargetMachine &Target, llvm::Module &m,
     llvm::createSPIRVWriterPass(out)->runOnModule(m);
     IF_LOG Logger::println("Success.");
 #else
-    error(Loc(), "Trying to target SPIRV, but LDC is not built to do so!");
+    backendError(Loc(),
+                 "Trying to target SPIRV, but LDC is not built to do so!");
 #endif
 
     return;
@@ -89,7 +133,7 @@ void codegenModule(llvm::TargetMachine &Target, llvm::Module &m,
           Passes,
           out, // Output file
 #if LDC_LLVM_VER >= 700
-          nullptr, // DWO output file
+          dwoOut, // DWO output file
 #endif
           // Always generate assembly for ptx as it is an assembly format
           // The PTX backend fails if we pass anything else.
@@ -131,8 +175,7 @@ static void assemble(const std::string &asmpath, const std::string &objpath) {
   // Run the compiler to assembly the program.
   int R = executeToolAndWait(getGcc(), args, global.params.verbose);
   if (R) {
-    error(Loc(), "Error while invoking external assembler.");
-    fatal();
+    backendError(Loc(), "Error while invoking external assembler.");
   }
 }
 
@@ -263,6 +306,22 @@ public:
   }
 };
 
+// Object files kept in memory for the archiver, keyed by their file name.
+std::mutex inMemoryObjectsMutex;
+llvm::StringMap<llvm::SmallVector<char, 0>> inMemoryObjects;
+
+void writeObjectFileToMemory(llvm::Module *m, const char *filename) {
+  IF_LOG Logger::println("Writing object file to memory: %s", filename);
+  llvm::SmallVector<char, 0> buffer;
+  {
+    llvm::raw_svector_ostream out(buffer);
+    codegenModule(*gTargetMachine, *m, out,
+                  llvm::TargetMachine::CGFT_ObjectFile);
+  }
+  std::lock_guard<std::mutex> lock(inMemoryObjectsMutex);
+  inMemoryObjects[filename] = std::move(buffer);
+}
+
 void writeObjectFile(llvm::Module *m, const char *filename) {
   IF_LOG Logger::println("Writing object file to: %s", filename);
   std::error_code errinfo;
@@ -270,16 +329,252 @@ void writeObjectFile(llvm::Module *m, const char *filename) {
     llvm::raw_fd_ostream out(filename, errinfo, llvm::sys::fs::F_None);
     if (!errinfo)
     {
+#if LDC_LLVM_VER >= 700
+      if (opts::splitDwarf && global.params.symdebug &&
+          global.params.targetTriple->isOSBinFormatELF()) {
+        const auto dwoPath = getSplitDwarfFileName(filename);
+        IF_LOG Logger::println("Writing split DWARF to: %s", dwoPath.c_str());
+        llvm::raw_fd_ostream dwoOut(dwoPath, errinfo, llvm::sys::fs::F_None);
+        if (errinfo) {
+          backendError(Loc(), "cannot write split DWARF file '%s': %s",
+                       dwoPath.c_str(), errinfo.message().c_str());
+          return;
+        }
+        auto &mcOptions = gTargetMachine->Options.MCOptions;
+        mcOptions.SplitDwarfFile = dwoPath;
+        codegenModule(*gTargetMachine, *m, out,
+                      llvm::TargetMachine::CGFT_ObjectFile, &dwoOut);
+        mcOptions.SplitDwarfFile.clear();
+        return;
+      }
+#endif
       codegenModule(*gTargetMachine, *m, out,
                     llvm::TargetMachine::CGFT_ObjectFile);
     } else {
-      error(Loc(), "cannot write object file '%s': %s", filename,
-            errinfo.message().c_str());
-      fatal();
+      backendError(Loc(), "cannot write object file '%s': %s", filename,
+                   errinfo.message().c_str());
     }
   }
 }
 
+/// Returns the name of the object file for the n-th (n > 0) partition of a
+/// module to be written to `filename`, e.g., `foo.part1.o` for `foo.o`.
+std::string getPartitionObjectFileName(const char *filename, unsigned n) {
+  llvm::SmallString<128> buffer(filename);
+  llvm::sys::path::replace_extension(
+      buffer, llvm::Twine("part") + llvm::Twine(n) + "." + global.obj_ext);
+  return buffer.str();
+}
+
+/// Gives all local symbols names that are unique across modules.
+/// SplitModule turns local symbols referenced across partitions into hidden
+/// globals, which would otherwise clash with equally named ones in the
+/// partitions of other modules when linking.
+void makeLocalNamesUnique(llvm::Module &m) {
+#if LDC_LLVM_VER >= 400
+  const std::string suffix =
+      "." + llvm::utohexstr(llvm::xxHash64(m.getModuleIdentifier()));
+#else
+  llvm::MD5 hasher;
+  hasher.update(m.getModuleIdentifier());
+  llvm::MD5::MD5Result result;
+  hasher.final(result);
+  llvm::SmallString<32> hash;
+  llvm::MD5::stringifyResult(result, hash);
+  const std::string suffix = ("." + hash).str();
+#endif
+  const auto rename = [&suffix](llvm::GlobalValue &gv) {
+    if (!gv.hasLocalLinkage())
+      return;
+    if (gv.hasName())
+      gv.setName(gv.getName() + suffix);
+    else
+      gv.setName("ldc.unnamed" + suffix);
+  };
+  for (auto &f : m.functions())
+    rename(f);
+  for (auto &gv : m.globals())
+    rename(gv);
+  for (auto &ga : m.aliases())
+    rename(ga);
+}
+
+/// Splits (a copy of) the module into the given number of partitions, which
+/// are serialized so that each one can be re-materialized in a separate
+/// LLVMContext owned by the thread processing it.
+void splitIntoBitcodePartitions(
+    llvm::Module &m, unsigned numPartitions,
+    std::vector<llvm::SmallVector<char, 0>> &partitions) {
+  IF_LOG Logger::println("Splitting module into %u partitions", numPartitions);
+
+  auto clone = llvm::CloneModule(
+#if LDC_LLVM_VER >= 700
+      m
+#else
+      &m
+#endif
+      );
+  makeLocalNamesUnique(*clone);
+
+  llvm::SplitModule(std::move(clone), numPartitions,
+                    [&partitions](std::unique_ptr<llvm::Module> part) {
+                      partitions.emplace_back();
+                      llvm::raw_svector_ostream os(partitions.back());
+#if LDC_LLVM_VER >= 700
+                      llvm::WriteBitcodeToFile(*part, os);
+#else
+                      llvm::WriteBitcodeToFile(part.get(), os);
+#endif
+                    },
+                    /*PreserveLocals=*/false);
+}
+
+/// Re-materializes a partition serialized by splitIntoBitcodePartitions().
+/// Returns null (after reporting the error) if that fails.
+std::unique_ptr<llvm::Module>
+parsePartition(const llvm::SmallVector<char, 0> &bitcode,
+               const std::string &name, llvm::LLVMContext &context) {
+  llvm::SMDiagnostic err;
+  std::unique_ptr<llvm::Module> part = llvm::parseIR(
+      llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()),
+                            name),
+      err, context);
+  if (!part) {
+    backendError(Loc(), "cannot re-read module partition for %s: %s",
+                 name.c_str(), err.getMessage().str().c_str());
+  }
+  return part;
+}
+
+/// Returns the object file names for the partitions of a module to be
+/// written to `filename`. The first partition is written to `filename`.
+std::vector<std::string> getPartitionObjectFileNames(const char *filename,
+                                                     size_t numPartitions) {
+  std::vector<std::string> filenames;
+  filenames.push_back(filename);
+  for (unsigned i = 1; i < numPartitions; ++i)
+    filenames.push_back(getPartitionObjectFileName(filename, i));
+  return filenames;
+}
+
+/// Appends the object files of all partitions but the first one to the list
+/// of object files to be linked/archived.
+void addPartitionObjectFiles(const std::vector<std::string> &filenames) {
+  for (size_t i = 1; i < filenames.size(); ++i)
+    global.params.objfiles.push(mem.xstrdup(filenames[i].c_str()));
+}
+
+/// Splits the (optimized) module into the given number of partitions and
+/// emits each one to a separate object file in parallel.
+void writePartitionedObjectFiles(llvm::Module *m, const char *filename,
+                                 unsigned numPartitions) {
+  std::vector<llvm::SmallVector<char, 0>> partitions;
+  splitIntoBitcodePartitions(*m, numPartitions, partitions);
+  const auto filenames = getPartitionObjectFileNames(filename, partitions.size());
+
+  const unsigned numThreads = std::min(
+      static_cast<unsigned>(partitions.size()), ldc::getBackendThreadCount());
+  const llvm::TargetMachine *mainTarget = gTargetMachine;
+  {
+    llvm::ThreadPool pool(numThreads);
+    for (size_t i = 0; i < partitions.size(); ++i) {
+      pool.async([&partitions, &filenames, mainTarget, i]() {
+        BackendWorkerScope workerScope;
+        llvm::LLVMContext context;
+        auto part = parsePartition(partitions[i], filenames[i], context);
+        if (!part)
+          return;
+
+        std::unique_ptr<llvm::TargetMachine> target(
+            cloneTargetMachine(*mainTarget));
+        gTargetMachine = target.get();
+        writeObjectFile(part.get(), filenames[i].c_str());
+      });
+    }
+    pool.wait();
+  }
+  reportBackendErrors();
+
+  addPartitionObjectFiles(filenames);
+}
+
+/// Optimizes a fragment serialized by splitIntoBitcodePartitions() in a fresh
+/// LLVMContext, writes it for gTargetMachine and adds it to the cache.
+void writeFragmentObjectFile(const llvm::SmallVector<char, 0> &bitcode,
+                             const std::string &filename,
+                             llvm::StringRef hash) {
+  llvm::LLVMContext context;
+  if (!global.params.output_ll) {
+    context.setDiscardValueNames(true);
+  }
+  auto fragment = parsePartition(bitcode, filename, context);
+  if (!fragment)
+    return;
+
+  ldc_optimize_module(fragment.get());
+  writeObjectFile(fragment.get(), filename.c_str());
+  cache::cacheObjectFile(filename, hash);
+}
+
+/// Splits the (unoptimized) module into the given number of fragments, each
+/// of which is hashed and looked up in the cache separately. Only the missing
+/// fragments are optimized and emitted (in parallel unless running on a -j
+/// worker already), and then added to the cache.
+void writeCachedFragmentObjectFiles(llvm::Module *m, const char *filename,
+                                    unsigned numFragments) {
+  std::vector<llvm::SmallVector<char, 0>> fragments;
+  splitIntoBitcodePartitions(*m, numFragments, fragments);
+  const auto filenames = getPartitionObjectFileNames(filename, fragments.size());
+
+  std::vector<llvm::SmallString<32>> hashes(fragments.size());
+  std::vector<size_t> misses;
+  for (size_t i = 0; i < fragments.size(); ++i) {
+    cache::calculateBitcodeHash(
+        llvm::StringRef(fragments[i].data(), fragments[i].size()), hashes[i]);
+    if (cache::cacheLookup(hashes[i]).empty() ||
+        !cache::recoverObjectFile(hashes[i], filenames[i])) {
+      misses.push_back(i);
+    }
+  }
+
+  IF_LOG Logger::println("%u of %u module fragments need to be compiled",
+                         static_cast<unsigned>(misses.size()),
+                         static_cast<unsigned>(fragments.size()));
+
+  const unsigned numThreads = std::min(static_cast<unsigned>(misses.size()),
+                                       ldc::getBackendThreadCount());
+  // A -j worker already runs in parallel with the other modules' workers, so
+  // it writes its fragments itself instead of starting a nested pool.
+  if (numThreads <= 1 || isBackendWorkerThread()) {
+    for (size_t i : misses)
+      writeFragmentObjectFile(fragments[i], filenames[i], hashes[i]);
+  } else {
+    const llvm::TargetMachine *mainTarget = gTargetMachine;
+    llvm::ThreadPool pool(numThreads);
+    for (size_t i : misses) {
+      pool.async([&fragments, &filenames, &hashes, mainTarget, i]() {
+        BackendWorkerScope workerScope;
+        std::unique_ptr<llvm::TargetMachine> target(
+            cloneTargetMachine(*mainTarget));
+        gTargetMachine = target.get();
+        writeFragmentObjectFile(fragments[i], filenames[i], hashes[i]);
+      });
+    }
+    pool.wait();
+    reportBackendErrors();
+  }
+
+  addPartitionObjectFiles(filenames);
+}
+
+/// Returns the number of object file partitions to emit for `m`.
+unsigned getNumObjectPartitions(llvm::Module *m) {
+  if (!global.params.oneobj || singleObjPartitions <= 1 ||
+      getComputeTargetType(m) != ComputeBackend::None)
+    return 1;
+  return singleObjPartitions;
+}
+
 bool shouldAssembleExternally() {
   // There is no integrated assembler on AIX because XCOFF is not supported.
   // Starting with LLVM 3.5 the integrated assembler can be used with MinGW.
@@ -292,6 +587,14 @@ bool shouldOutputObjectFile() {
   return global.params.output_o && !shouldAssembleExternally();
 }
 
+/// Returns whether the module can be split into separately cached fragments.
+/// Only plain object file output is supported.
+bool canUseCacheFragments(llvm::Module *m) {
+  return !global.params.output_bc && !global.params.output_ll &&
+         !global.params.output_s && !shouldAssembleExternally() &&
+         getComputeTargetType(m) == ComputeBackend::None;
+}
+
 bool shouldDoLTO(llvm::Module *m) {
 #if LDC_LLVM_VER == 309
   // LLVM 3.9 bug: can't do ThinLTO with modules that have module-scope inline
@@ -304,45 +607,90 @@ bool shouldDoLTO(llvm::Module *m) {
 }
 } // end of anonymous namespace
 
+llvm::Optional<llvm::MemoryBufferRef>
+getInMemoryObjectFile(llvm::StringRef filename) {
+  std::lock_guard<std::mutex> lock(inMemoryObjectsMutex);
+  auto it = inMemoryObjects.find(filename);
+  if (it == inMemoryObjects.end())
+    return llvm::None;
+  const auto &buffer = it->second;
+  return llvm::MemoryBufferRef(llvm::StringRef(buffer.data(), buffer.size()),
+                               llvm::sys::path::filename(it->first()));
+}
+
+std::string getSplitDwarfFileName(const char *objfile) {
+  llvm::SmallString<128> buffer(objfile);
+  llvm::sys::path::replace_extension(buffer, "dwo");
+  return buffer.str();
+}
+
 void writeModule(llvm::Module *m, const char *filename) {
   const bool doLTO = shouldDoLTO(m);
   const bool outputObj = shouldOutputObjectFile();
   const bool assembleExternally = shouldAssembleExternally();
 
-  // Use cached object code if possible.
-  // TODO: combine LDC's cache and LTO (the advantage is skipping the IR
-  // optimization).
-  const bool useIR2ObjCache = !opts::cacheDir.empty() && outputObj && !doLTO;
+  // make sure the output directory exists
+  const auto directory = llvm::sys::path::parent_path(filename);
+  if (!directory.empty()) {
+    if (auto ec = llvm::sys::fs::create_directories(directory)) {
+      backendError(Loc(), "failed to create output directory: %s\n%s",
+                   directory.data(), ec.message().c_str());
+      return;
+    }
+  }
+
+  // Use cached object code if possible. LTO builds can only use the
+  // optimized IR tier below. DCompute kernels are cached per target by
+  // DComputeTarget instead.
+  // The cache doesn't store split DWARF files.
+  const bool useIR2ObjCache = !opts::cacheDir.empty() && outputObj && !doLTO &&
+                              !opts::splitDwarf &&
+                              getComputeTargetType(m) == ComputeBackend::None;
+  const unsigned numPartitions = getNumObjectPartitions(m);
+  // Whole-module caching stores a single object file per module.
+  const bool useWholeModuleCache = useIR2ObjCache && numPartitions == 1;
   llvm::SmallString<32> moduleHash;
   if (useIR2ObjCache) {
-    llvm::SmallString<128> cacheDir(opts::cacheDir.c_str());
-    llvm::sys::fs::make_absolute(cacheDir);
-    opts::cacheDir = cacheDir.c_str();
-
     IF_LOG Logger::println("Use IR-to-Object cache in %s",
                            opts::cacheDir.c_str());
     LOG_SCOPE
 
-    cache::calculateModuleHash(m, moduleHash);
-    std::string cacheFile = cache::cacheLookup(moduleHash);
-    if (!cacheFile.empty()) {
-      cache::recoverObjectFile(moduleHash, filename);
+    if (cacheFragments > 1 && canUseCacheFragments(m)) {
+      writeCachedFragmentObjectFiles(m, filename, cacheFragments);
       return;
     }
+
+    if (useWholeModuleCache) {
+      cache::calculateModuleHash(m, moduleHash);
+      std::string cacheFile = cache::cacheLookup(moduleHash);
+      if (!cacheFile.empty() && cache::recoverObjectFile(moduleHash, filename))
+        return;
+    }
   }
 
-  // run optimizer
-  ldc_optimize_module(m);
+  // Use cached optimized IR if possible, otherwise run the optimizer.
+  std::unique_ptr<llvm::Module> cachedIR;
+  const bool useOptimizedIRCache =
+      cache::isOptimizedIRCacheEnabled(doLTO) &&
+      getComputeTargetType(m) == ComputeBackend::None;
+  if (useOptimizedIRCache) {
+    IF_LOG Logger::println("Use optimized IR cache in %s",
+                           opts::cacheDir.c_str());
+    LOG_SCOPE
+    if (moduleHash.empty())
+      cache::calculateModuleHash(m, moduleHash);
+    cachedIR = cache::lookupOptimizedIR(moduleHash, m->getContext());
+  }
 
-  // make sure the output directory exists
-  const auto directory = llvm::sys::path::parent_path(filename);
-  if (!directory.empty()) {
-    if (auto ec = llvm::sys::fs::create_directories(directory)) {
-      error(Loc(), "failed to create output directory: %s\n%s",
-            directory.data(), ec.message().c_str());
-      fatal();
-    }
+  if (cachedIR) {
+    // The original module is still owned (and freed) by the caller.
+    m = cachedIR.get();
+  } else {
+    ldc_optimize_module(m);
+    if (useOptimizedIRCache)
+      cache::cacheOptimizedIR(m, moduleHash);
   }
+  gcallocreport::collect(*m);
 
   const auto outputFlags = {global.params.output_o, global.params.output_bc,
                             global.params.output_ll, global.params.output_s};
@@ -369,9 +717,9 @@ void writeModule(llvm::Module *m, const char *filename) {
     std::error_code errinfo;
     llvm::raw_fd_ostream bos(bcpath.c_str(), errinfo, llvm::sys::fs::F_None);
     if (bos.has_error()) {
-      error(Loc(), "cannot write LLVM bitcode file '%s': %s", bcpath.c_str(),
-            errinfo.message().c_str());
-      fatal();
+      backendError(Loc(), "cannot write LLVM bitcode file '%s': %s",
+                   bcpath.c_str(), errinfo.message().c_str());
+      return;
     }
 
 #if LDC_LLVM_VER >= 700
@@ -411,9 +759,9 @@ void writeModule(llvm::Module *m, const char *filename) {
     std::error_code errinfo;
     llvm::raw_fd_ostream aos(llpath.c_str(), errinfo, llvm::sys::fs::F_None);
     if (aos.has_error()) {
-      error(Loc(), "cannot write LLVM IR file '%s': %s", llpath.c_str(),
-            errinfo.message().c_str());
-      fatal();
+      backendError(Loc(), "cannot write LLVM IR file '%s': %s",
+                   llpath.c_str(), errinfo.message().c_str());
+      return;
     }
     AssemblyAnnotator annotator(m->getDataLayout());
     m->print(aos, &annotator);
@@ -447,8 +795,8 @@ void writeModule(llvm::Module *m, const char *filename) {
                         llvm::TargetMachine::CGFT_AssemblyFile);
         }
       } else {
-        error(Loc(), "cannot write asm: %s", errinfo.message().c_str());
-        fatal();
+        backendError(Loc(), "cannot write asm: %s", errinfo.message().c_str());
+        return;
       }
     }
 
@@ -461,10 +809,140 @@ void writeModule(llvm::Module *m, const char *filename) {
     }
   }
 
-  if (writeObj) {
+  if (writeObj && numPartitions > 1) {
+    writePartitionedObjectFiles(m, filename, numPartitions);
+  } else if (writeObj && !useWholeModuleCache && !opts::splitDwarf &&
+             canCreateStaticLibraryFromMemory()) {
+    writeObjectFileToMemory(m, filename);
+  } else if (writeObj) {
     writeObjectFile(m, filename);
-    if (useIR2ObjCache) {
+    if (useWholeModuleCache) {
       cache::cacheObjectFile(filename, moduleHash);
     }
   }
 }
+
+//////////////////////////////////////////////////////////////////////////////
+
+#if LDC_LLVM_VER >= 500
+namespace {
+llvm::Expected<llvm::BitcodeModule>
+findThinLTOModule(llvm::MemoryBufferRef buffer) {
+  auto modules = llvm::getBitcodeModuleList(buffer);
+  if (!modules)
+    return modules.takeError();
+
+  for (auto &bm : *modules) {
+    auto ltoInfo = bm.getLTOInfo();
+    if (ltoInfo && ltoInfo->IsThinLTO)
+      return bm;
+  }
+
+  return llvm::make_error<llvm::StringError>("no ThinLTO module found",
+                                             llvm::inconvertibleErrorCode());
+}
+} // anonymous namespace
+#endif
+
+void runThinLTOBackend(const char *inputFile, const char *indexFile,
+                       const char *outputFile) {
+#if LDC_LLVM_VER < 500
+  error(Loc(), "-fthinlto-index requires LDC to be built against LLVM 5.0+");
+  fatal();
+#else
+  using namespace llvm;
+
+  IF_LOG Logger::println("Running ThinLTO backend for %s using index %s",
+                         inputFile, indexFile);
+  LOG_SCOPE
+
+  auto index = getModuleSummaryIndexForFile(indexFile);
+  if (!index) {
+    error(Loc(), "cannot load ThinLTO index file %s: %s", indexFile,
+          toString(index.takeError()).c_str());
+    fatal();
+  }
+  ModuleSummaryIndex &combinedIndex = **index;
+
+  LLVMContext context;
+  SMDiagnostic diag;
+  std::unique_ptr<Module> m = parseIRFile(inputFile, diag, context);
+  if (!m) {
+    error(Loc(), "cannot load bitcode object file %s: %s", inputFile,
+          diag.getMessage().str().c_str());
+    fatal();
+  }
+
+  // The individual index contains exactly the summaries of the values to be
+  // imported into this module (plus the module's own ones).
+  FunctionImporter::ImportMapTy importList;
+  for (auto &entry : combinedIndex) {
+    if (entry.second.SummaryList.empty())
+      continue; // undefined reference
+    auto &summary = entry.second.SummaryList[0];
+    if (summary->modulePath() == m->getModuleIdentifier())
+      continue;
+#if LDC_LLVM_VER >= 700
+    importList[summary->modulePath()].insert(entry.first);
+#else
+    importList[summary->modulePath()][entry.first] = 1;
+#endif
+  }
+
+  std::vector<std::unique_ptr<MemoryBuffer>> ownedImports;
+  MapVector<StringRef, BitcodeModule> moduleMap;
+  for (auto &import : importList) {
+    auto buffer = MemoryBuffer::getFile(import.first());
+    if (!buffer) {
+      error(Loc(), "cannot load imported bitcode object file %s: %s",
+            import.first().str().c_str(),
+            buffer.getError().message().c_str());
+      fatal();
+    }
+    auto bm = findThinLTOModule(**buffer);
+    if (!bm) {
+      error(Loc(), "cannot load imported bitcode object file %s: %s",
+            import.first().str().c_str(), toString(bm.takeError()).c_str());
+      fatal();
+    }
+    moduleMap.insert({import.first(), *bm});
+    ownedImports.push_back(std::move(*buffer));
+  }
+
+  StringMap<GVSummaryMapTy> moduleToDefinedGVSummaries;
+  combinedIndex.collectDefinedGVSummariesPerModule(moduleToDefinedGVSummaries);
+
+  std::error_code errinfo;
+  auto out = llvm::make_unique<raw_fd_ostream>(outputFile, errinfo,
+                                               sys::fs::F_None);
+  if (errinfo) {
+    error(Loc(), "cannot write object file '%s': %s", outputFile,
+          errinfo.message().c_str());
+    fatal();
+  }
+  auto addStream = [&](size_t) {
+    return llvm::make_unique<lto::NativeObjectStream>(std::move(out));
+  };
+
+  lto::Config conf;
+  conf.CPU = gTargetMachine->getTargetCPU();
+  SmallVector<StringRef, 8> features;
+  gTargetMachine->getTargetFeatureString().split(features, ',', -1,
+                                                 /*KeepEmpty=*/false);
+  for (auto feature : features)
+    conf.MAttrs.push_back(feature.str());
+  conf.Options = gTargetMachine->Options;
+  conf.RelocModel = gTargetMachine->getRelocationModel();
+  conf.CodeModel = gTargetMachine->getCodeModel();
+  conf.CGOptLevel = codeGenOptLevel();
+  conf.OptLevel = std::min<unsigned>(optLevel(), 3);
+
+  if (Error err = lto::thinBackend(
+          conf, -1, addStream, *m, combinedIndex, importList,
+          moduleToDefinedGVSummaries[m->getModuleIdentifier()], moduleMap)) {
+    error(Loc(), "ThinLTO backend failed for %s: %s", inputFile,
+          toString(std::move(err)).c_str());
+    fatal();
+  }
+#endif
+}
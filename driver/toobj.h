@@ -14,10 +14,30 @@
 #ifndef LDC_DRIVER_TOOBJ_H
 #define LDC_DRIVER_TOOBJ_H
 
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <string>
+
 namespace llvm {
 class Module;
 }
 
 void writeModule(llvm::Module *m, const char *filename);
 
+/// Returns the contents of an object file which was only emitted to memory
+/// for the internal archiver, or None if it was written to disk.
+llvm::Optional<llvm::MemoryBufferRef>
+getInMemoryObjectFile(llvm::StringRef filename);
+
+/// Returns the name of the split DWARF (.dwo) file for an object file.
+std::string getSplitDwarfFileName(const char *objfile);
+
+/// Distributed ThinLTO backend: optimizes and codegens the ThinLTO bitcode
+/// object file `inputFile` to the native object file `outputFile`, importing
+/// from other bitcode objects as listed in the individual summary index file
+/// written by a `-fthinlto-index-only` link.
+void runThinLTOBackend(const char *inputFile, const char *indexFile,
+                       const char *outputFile);
+
 #endif
@@ -166,7 +166,8 @@ std::vector<const char *> getFullArgs(const char *tool,
 ////////////////////////////////////////////////////////////////////////////////
 
 int executeToolAndWait(const std::string &tool_,
-                       std::vector<std::string> const &args, bool verbose) {
+                       std::vector<std::string> const &args, bool verbose,
+                       llvm::StringRef errorOutputFile) {
   const auto tool = findProgramByName(tool_);
   if (tool.empty()) {
     error(Loc(), "failed to locate %s", tool_.c_str());
@@ -187,14 +188,20 @@ int executeToolAndWait(const std::string &tool_,
   auto envVars = nullptr;
 #endif
 
-  // Execute tool.
-  std::string errstr;
-  if (int status = llvm::sys::ExecuteAndWait(tool, argv, envVars,
 #if LDC_LLVM_VER >= 600
-                                             {},
+  llvm::Optional<llvm::StringRef> redirects[] = {llvm::None, llvm::None,
+                                                 llvm::None};
+  if (!errorOutputFile.empty())
+    redirects[2] = errorOutputFile;
 #else
-                                             nullptr,
+  const llvm::StringRef *redirects[] = {nullptr, nullptr, nullptr};
+  if (!errorOutputFile.empty())
+    redirects[2] = &errorOutputFile;
 #endif
+
+  // Execute tool.
+  std::string errstr;
+  if (int status = llvm::sys::ExecuteAndWait(tool, argv, envVars, redirects,
                                              0, 0, &errstr)) {
     error(Loc(), "%s failed with status: %d", tool.c_str(), status);
     if (!errstr.empty()) {
@@ -38,9 +38,11 @@ std::vector<const char *> getFullArgs(const char *tool,
                                       const std::vector<std::string> &args,
                                       bool printVerbose);
 
+// Redirects the tool's stderr to `errorOutputFile` if non-empty.
 int executeToolAndWait(const std::string &tool,
                        std::vector<std::string> const &args,
-                       bool verbose = false);
+                       bool verbose = false,
+                       llvm::StringRef errorOutputFile = llvm::StringRef());
 
 #ifdef _WIN32
 
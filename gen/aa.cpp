@@ -81,21 +81,9 @@ DLValue *DtoAAIndex(Loc &loc, Type *type, DValue *aa, DValue *key,
   // Only check bounds for rvalues ('aa[key]').
   // Lvalue use ('aa[key] = value') auto-adds an element.
   if (!lvalue && gIR->emitArrayBoundsChecks()) {
-    llvm::BasicBlock *okbb = gIR->insertBB("aaboundsok");
-    llvm::BasicBlock *failbb = gIR->insertBBAfter(okbb, "aaboundscheckfail");
-
     LLValue *nullaa = LLConstant::getNullValue(ret->getType());
     LLValue *cond = gIR->ir->CreateICmpNE(nullaa, ret, "aaboundscheck");
-    gIR->ir->CreateCondBr(cond, okbb, failbb);
-
-    // set up failbb to call the array bounds error runtime function
-
-    gIR->scope() = IRScope(failbb);
-
-    DtoBoundsCheckFailCall(gIR, loc);
-
-    // if ok, proceed in okbb
-    gIR->scope() = IRScope(okbb);
+    DtoBoundsCheckBranch(loc, cond, "aaboundsok");
   }
   return new DLValue(type, ret);
 }
@@ -63,6 +63,9 @@ public:
     if (!isPOD(rt))
       return true;
 
+    if (passInWordRegs(tf, rt))
+      return false;
+
     return passIndirectlyByValue(rt);
   }
 
@@ -91,6 +94,10 @@ public:
       // compiler magic: pass va_list args implicitly by reference
       arg.byref = true;
       arg.ltype = arg.ltype->getPointerTo();
+    } else if (passInWordRegs(fty.type, t) &&
+               !(t->ty == Tstruct && isHFA(static_cast<TypeStruct *>(t)))) {
+      // LDC-specific: up to 4 words in x0-x7 (returned in x0-x3)
+      compositeToArray64.applyTo(arg);
     } else if (!isReturnVal && passIndirectlyByValue(t)) {
       byvalRewrite.applyTo(arg);
     }
@@ -41,6 +41,7 @@
 #include "gen/logger.h"
 #include "gen/tollvm.h"
 #include "ir/irfunction.h"
+#include <algorithm>
 #include <cassert>
 #include <map>
 #include <string>
@@ -218,6 +219,7 @@ struct X86_64TargetABI : TargetABI {
   X86_64_C_struct_rewrite struct_rewrite;
   ImplicitByvalRewrite byvalRewrite;
   IndirectByvalRewrite indirectByvalRewrite;
+  CompositeToArray64 compositeToArray64;
 
   bool returnInArg(TypeFunction *tf, bool needsThis) override;
 
@@ -254,6 +256,9 @@ bool X86_64TargetABI::returnInArg(TypeFunction *tf, bool) {
   }
 
   Type *rt = tf->next->toBasetype();
+  if (passInWordRegs(tf, rt))
+    return false;
+
   return dmd_abi::passByVal(rt);
 }
 
@@ -262,6 +267,9 @@ bool X86_64TargetABI::passByVal(TypeFunction *tf, Type *t) {
   if (tf->linkage == LINKcpp && !isPOD(t))
     return false;
 
+  if (passInWordRegs(tf, t))
+    return false;
+
   return dmd_abi::passByVal(t->toBasetype());
 }
 
@@ -284,6 +292,15 @@ void X86_64TargetABI::rewriteArgument(IrFuncTy &fty, IrFuncTyArg &arg,
     return;
   }
 
+  // LDC-specific: split up into 3-4 GP registers; LLVM passes the excess
+  // words on the stack and returns via hidden pointer if need be
+  if (passInWordRegs(fty.type, t)) {
+    compositeToArray64.applyTo(arg);
+    const int words = (t->size() + 7) / 8;
+    regCount.int_regs = std::max(0, regCount.int_regs - words);
+    return;
+  }
+
   LLType *abiTy = getAbiType(t);
   if (abiTy && !LLTypeMemoryLayout::typesAreEquivalent(abiTy, originalLType)) {
     IF_LOG {
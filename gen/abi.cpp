@@ -27,6 +27,7 @@
 #include "gen/tollvm.h"
 #include "ir/irfunction.h"
 #include "ir/irfuncty.h"
+#include "llvm/Support/CommandLine.h"
 #include <algorithm>
 
 //////////////////////////////////////////////////////////////////////////////
@@ -231,6 +232,24 @@ bool TargetABI::isPOD(Type *t, bool excludeStructsWithCtor) {
   return sd->isPOD() && !(excludeStructsWithCtor && hasCtor(sd));
 }
 
+static llvm::cl::opt<bool> dAggregatesInRegs(
+    "fd-aggregates-in-regs", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("(experimental) Pass and return POD structs and static "
+                   "arrays of up to 32 bytes in registers for extern(D) "
+                   "functions on x86-64 and AArch64. Changes the D ABI, so "
+                   "all D code incl. druntime/Phobos must be compiled with it"));
+
+bool TargetABI::passInWordRegs(TypeFunction *tf, Type *t) {
+  if (!dAggregatesInRegs || tf->linkage != LINKd || tf->varargs == 1)
+    return false;
+  t = t->toBasetype();
+  if (t->ty != Tstruct && t->ty != Tsarray)
+    return false;
+  // smaller aggregates are passed in registers by the C ABI already
+  const auto size = t->size();
+  return size > 16 && size <= 32 && isPOD(t);
+}
+
 bool TargetABI::canRewriteAsInt(Type *t, bool include64bit) {
   auto size = t->toBasetype()->size();
   return size == 1 || size == 2 || size == 4 || (include64bit && size == 8);
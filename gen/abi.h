@@ -183,6 +183,12 @@ struct TargetABI {
   /// produce the rewriteType: an array of that floating point type
   static bool isHFA(TypeStruct *t, llvm::Type **rewriteType = nullptr, const int maxFloats = 4);
 
+  /// Returns true if the D type is a POD struct or static array of 17 to 32
+  /// bytes which is to be passed and returned as array of up to 4 i64 words,
+  /// i.e., in general-purpose registers, for extern(D) functions
+  /// (-fd-aggregates-in-regs, 64-bit targets only).
+  static bool passInWordRegs(TypeFunction *tf, Type *t);
+
 protected:
 
   /// Returns true if the D type is an aggregate:
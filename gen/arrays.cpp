@@ -15,6 +15,7 @@
 #include "init.h"
 #include "module.h"
 #include "mtype.h"
+#include "driver/cl_options_sanitizers.h"
 #include "gen/dvalue.h"
 #include "gen/funcgenstate.h"
 #include "gen/irstate.h"
@@ -22,9 +23,26 @@
 #include "gen/llvmhelpers.h"
 #include "gen/logger.h"
 #include "gen/runtime.h"
+#include "gen/tbaa.h"
 #include "gen/tollvm.h"
 #include "ir/irfunction.h"
 #include "ir/irmodule.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/CommandLine.h"
+
+static llvm::cl::opt<bool> inlineAppend(
+    "inline-append", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Inline appending single elements to local slices while "
+                   "they have capacity left. The capacity is cached and "
+                   "reserved in the GC, so don't use assumeSafeAppend() on "
+                   "these slices"));
+
+static llvm::cl::opt<bool> contiguousMulDimNew(
+    "contiguous-muldim-new", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Allocate two-dimensional arrays (`new T[][](n, m)`) as a "
+                   "single GC block holding the rows and all elements. Using "
+                   "assumeSafeAppend on the array of rows is unsafe then"));
 
 static void DtoSetArray(DValue *array, LLValue *dim, LLValue *ptr);
 
@@ -111,42 +129,49 @@ static void DtoArrayInit(Loc &loc, LLValue *ptr, LLValue *length,
   IF_LOG Logger::println("DtoArrayInit");
   LOG_SCOPE;
 
-  // Let's first optimize all zero/i8 initializations down to a memset.
+  // Let's first optimize all initializations with a repeated byte (zero, i8,
+  // constants like int.max or -1, ...) down to a memset.
   // This simplifies codegen later on as llvm null's have no address!
   if (!elementValue->isLVal() || !DtoIsInMemoryOnly(elementValue->type)) {
     LLValue *val = DtoRVal(elementValue);
-    LLConstant *constantVal = isaConstant(val);
-    bool isNullConstant = (constantVal && constantVal->isNullValue());
-    if (isNullConstant || val->getType() == LLType::getInt8Ty(gIR->context())) {
+    LLValue *byteVal = nullptr;
+    if (LLConstant *constantVal = isaConstant(val)) {
+      byteVal = llvm::isBytewiseValue(constantVal);
+    } else if (val->getType() == LLType::getInt8Ty(gIR->context())) {
+      byteVal = val;
+    }
+    if (byteVal) {
       LLValue *size = length;
       size_t elementSize = getTypeAllocSize(val->getType());
       if (elementSize != 1) {
         size = gIR->ir->CreateMul(length, DtoConstSize_t(elementSize),
                                   ".arraysize");
       }
-      DtoMemSet(ptr, isNullConstant ? DtoConstUbyte(0) : val, size);
+      DtoMemSet(ptr, byteVal, size);
       return;
     }
   }
 
   // create blocks
+  llvm::BasicBlock *entrybb = gIR->scopebb();
   llvm::BasicBlock *condbb = gIR->insertBB("arrayinit.cond");
   llvm::BasicBlock *bodybb = gIR->insertBBAfter(condbb, "arrayinit.body");
   llvm::BasicBlock *endbb = gIR->insertBBAfter(bodybb, "arrayinit.end");
 
-  // initialize iterator
-  LLValue *itr = DtoAllocaDump(DtoConstSize_t(0), 0, "arrayinit.itr");
-
   // move into the for condition block, ie. start the loop
   assert(!gIR->scopereturned());
-  llvm::BranchInst::Create(condbb, gIR->scopebb());
+  llvm::BranchInst::Create(condbb, entrybb);
 
   // replace current scope
   gIR->scope() = IRScope(condbb);
 
+  // The iterator is a phi instead of a stack slot, so that the loop is in a
+  // shape the loop vectorizer handles even before mem2reg.
+  llvm::PHINode *itr = gIR->ir->CreatePHI(DtoSize_t(), 2, "arrayinit.itr");
+  itr->addIncoming(DtoConstSize_t(0), entrybb);
+
   // create the condition
-  LLValue *cond_val =
-      gIR->ir->CreateICmpNE(DtoLoad(itr), length, "arrayinit.condition");
+  LLValue *cond_val = gIR->ir->CreateICmpNE(itr, length, "arrayinit.condition");
 
   // conditional branch
   assert(!gIR->scopereturned());
@@ -155,15 +180,15 @@ static void DtoArrayInit(Loc &loc, LLValue *ptr, LLValue *length,
   // rewrite scope
   gIR->scope() = IRScope(bodybb);
 
-  LLValue *itr_val = DtoLoad(itr);
   // assign array element value
   DLValue arrayelem(elementValue->type->toBasetype(),
-                    DtoGEP1(ptr, itr_val, true, "arrayinit.arrayelem"));
+                    DtoGEP1(ptr, itr, true, "arrayinit.arrayelem"));
   DtoAssign(loc, &arrayelem, elementValue, TOKblit);
 
   // increment iterator
-  DtoStore(gIR->ir->CreateAdd(itr_val, DtoConstSize_t(1), "arrayinit.new_itr"),
-           itr);
+  itr->addIncoming(
+      gIR->ir->CreateAdd(itr, DtoConstSize_t(1), "arrayinit.new_itr"),
+      gIR->scopebb());
 
   // loop
   llvm::BranchInst::Create(condbb, gIR->scopebb());
@@ -211,6 +236,87 @@ static bool arrayNeedsPostblit(Type *t) {
   return false;
 }
 
+// Returns the struct declaration if the elements of array type t are structs
+// whose postblit and destructor can be called directly, i.e., without going
+// through the TypeInfo-based runtime hooks.
+static StructDeclaration *getInlineElementOpsStruct(Type *t) {
+  Type *elemType = t->nextOf()->toBasetype();
+  if (elemType->ty != Tstruct) {
+    return nullptr;
+  }
+  StructDeclaration *sd = static_cast<TypeStruct *>(elemType)->sym;
+  if (sd->postblit && (sd->postblit->storage_class & STCdisable)) {
+    return nullptr;
+  }
+  return sd;
+}
+
+static bool isNothrow(FuncDeclaration *fd) {
+  return fd && fd->type->ty == Tfunction &&
+         static_cast<TypeFunction *>(fd->type)->isnothrow;
+}
+
+// Calls the aggregate postblit or destructor fd on the struct at ptr.
+static void callElementOp(Loc &loc, FuncDeclaration *fd, LLValue *ptr) {
+  DtoResolveFunction(fd);
+  Expressions args;
+  DFuncValue dfn(fd, DtoCallee(fd), ptr);
+  DtoCallFunction(loc, Type::basic[Tvoid], &dfn, &args);
+}
+
+// Emits a loop over the indices [0, length), in reverse order if the i1
+// `reverse` is set, and invokes body for each of them.
+template <typename F>
+static void emitElementLoop(LLValue *length, LLValue *reverse, F body) {
+  llvm::BasicBlock *entrybb = gIR->scopebb();
+  llvm::BasicBlock *condbb = gIR->insertBB("arrayops.cond");
+  llvm::BasicBlock *bodybb = gIR->insertBBAfter(condbb, "arrayops.body");
+  llvm::BasicBlock *endbb = gIR->insertBBAfter(bodybb, "arrayops.end");
+
+  assert(!gIR->scopereturned());
+  llvm::BranchInst::Create(condbb, entrybb);
+  gIR->scope() = IRScope(condbb);
+
+  llvm::PHINode *itr = gIR->ir->CreatePHI(DtoSize_t(), 2, "arrayops.itr");
+  itr->addIncoming(DtoConstSize_t(0), entrybb);
+  LLValue *condVal = gIR->ir->CreateICmpNE(itr, length, "arrayops.condition");
+  llvm::BranchInst::Create(bodybb, endbb, condVal, gIR->scopebb());
+
+  gIR->scope() = IRScope(bodybb);
+  LLValue *index = itr;
+  if (reverse) {
+    LLValue *reverseIndex = gIR->ir->CreateSub(
+        gIR->ir->CreateSub(length, DtoConstSize_t(1)), itr);
+    index = gIR->ir->CreateSelect(reverse, reverseIndex, itr, "arrayops.idx");
+  }
+  body(index);
+
+  itr->addIncoming(
+      gIR->ir->CreateAdd(itr, DtoConstSize_t(1), "arrayops.new_itr"),
+      gIR->scopebb());
+  llvm::BranchInst::Create(condbb, gIR->scopebb());
+
+  gIR->scope() = IRScope(endbb);
+}
+
+// Assigns a new value to the struct at dst the way the runtime hooks do: the
+// old value is moved to tmp, the new one is blitted over and postblitted,
+// then the old value is destroyed.
+static void assignElement(Loc &loc, StructDeclaration *sd, bool postblit,
+                          LLValue *dst, LLValue *src, LLValue *tmp,
+                          LLValue *elementSize) {
+  if (sd->dtor) {
+    DtoMemCpy(tmp, dst, elementSize);
+  }
+  DtoMemCpy(dst, src, elementSize);
+  if (postblit && sd->postblit) {
+    callElementOp(loc, sd->postblit, dst);
+  }
+  if (sd->dtor) {
+    callElementOp(loc, sd->dtor, tmp);
+  }
+}
+
 // Does array assignment (or initialization) from another array of the same
 // element type or from an appropriate single element.
 void DtoArrayAssign(Loc &loc, DValue *lhs, DValue *rhs, int op,
@@ -244,6 +350,10 @@ void DtoArrayAssign(Loc &loc, DValue *lhs, DValue *rhs, int op,
   LLValue *lhsPtr = DtoBitCast(realLhsPtr, getVoidPtrType());
   LLValue *lhsLength = DtoArrayLen(lhs);
 
+  // Arrays of structs get inline postblit/destructor loops instead of the
+  // TypeInfo-based runtime hooks where the semantics are the same.
+  StructDeclaration *const inlineOpsStruct = getInlineElementOpsStruct(t);
+
   auto computeSize = [](LLValue *length, size_t elementSize) {
     return elementSize == 1
                ? length
@@ -264,19 +374,47 @@ void DtoArrayAssign(Loc &loc, DValue *lhs, DValue *rhs, int op,
     const bool needsPostblit = (op != TOKblit && arrayNeedsPostblit(t) &&
                                 (!canSkipPostblit || t2->ty == Tarray));
 
+    const size_t elementSize = getTypeAllocSize(DtoMemType(elemType));
+    const bool knownInBounds =
+        isConstructing || (t->ty == Tsarray && t2->ty == Tsarray);
+    const bool checksEnabled = global.params.useAssert == CHECKENABLEon ||
+                               gIR->emitArrayBoundsChecks();
+
     if (!needsDestruction && !needsPostblit) {
       // fast version
-      const size_t elementSize = getTypeAllocSize(DtoMemType(elemType));
       LLValue *lhsSize = computeSize(lhsLength, elementSize);
 
       if (rhs->isNull()) {
         DtoMemSetZero(lhsPtr, lhsSize);
       } else {
         LLValue *rhsSize = computeSize(rhsLength, elementSize);
-        const bool knownInBounds =
-            isConstructing || (t->ty == Tsarray && t2->ty == Tsarray);
         copySlice(loc, lhsPtr, lhsSize, rhsPtr, rhsSize, knownInBounds);
       }
+    } else if (isConstructing && inlineOpsStruct && !rhs->isNull() &&
+               isNothrow(inlineOpsStruct->postblit)) {
+      // Blit all elements at once, then postblit them. As the postblit can't
+      // throw, there are no partially constructed arrays to clean up.
+      DtoMemCpy(lhsPtr, rhsPtr, computeSize(lhsLength, elementSize));
+      emitElementLoop(lhsLength, nullptr, [&](LLValue *index) {
+        callElementOp(loc, inlineOpsStruct->postblit,
+                      DtoGEP1(realLhsPtr, index, true, "arrayops.elem"));
+      });
+    } else if (!isConstructing && inlineOpsStruct && !rhs->isNull() &&
+               (!checksEnabled || knownInBounds)) {
+      // Like _d_arrayassign_l/_r (without the length checks): iterate
+      // backwards if the destination starts inside the source.
+      LLValue *tmpSwap = DtoAlloca(elemType, "arrayAssign.tmpSwap");
+      LLValue *rhsEnd = DtoGEP1(realRhsArrayPtr, rhsLength, true);
+      LLValue *reverse = gIR->ir->CreateAnd(
+          gIR->ir->CreateICmpULT(realRhsArrayPtr, realLhsPtr),
+          gIR->ir->CreateICmpULT(realLhsPtr, rhsEnd), "arrayops.reverse");
+      LLValue *elementSizeVal = DtoConstSize_t(elementSize);
+      emitElementLoop(lhsLength, reverse, [&](LLValue *index) {
+        assignElement(loc, inlineOpsStruct, !canSkipPostblit,
+                      DtoGEP1(realLhsPtr, index, true, "arrayops.elem"),
+                      DtoGEP1(realRhsArrayPtr, index, true), tmpSwap,
+                      elementSizeVal);
+      });
     } else if (isConstructing) {
       LLFunction *fn = getRuntimeFunction(loc, gIR->module, "_d_arrayctor");
       LLCallSite call = gIR->CreateCallOrInvoke(fn, DtoTypeInfoOf(elemType),
@@ -298,8 +436,10 @@ void DtoArrayAssign(Loc &loc, DValue *lhs, DValue *rhs, int op,
     // scalar rhs:
     // T[]  = T     T[n][]  = T
     // T[n] = T     T[n][m] = T
-    const bool needsPostblit =
-        (op != TOKblit && !canSkipPostblit && arrayNeedsPostblit(t));
+    // An rvalue can only be moved into a single element, so all copies need
+    // to be postblitted like with _d_arraysetassign, regardless of
+    // canSkipPostblit.
+    const bool needsPostblit = (op != TOKblit && arrayNeedsPostblit(t));
 
     if (!needsDestruction && !needsPostblit) {
       // fast version
@@ -317,6 +457,27 @@ void DtoArrayAssign(Loc &loc, DValue *lhs, DValue *rhs, int op,
                 : gIR->ir->CreateExactUDiv(lhsSize, DtoConstSize_t(rhsSize));
       }
       DtoArrayInit(loc, actualPtr, actualLength, rhs);
+    } else if (inlineOpsStruct && t2->ty == Tstruct &&
+               static_cast<TypeStruct *>(t2)->sym == inlineOpsStruct &&
+               (!isConstructing || isNothrow(inlineOpsStruct->postblit))) {
+      if (isConstructing) {
+        // A (vectorizable) blit loop, then the postblit loop.
+        DtoArrayInit(loc, realLhsPtr, lhsLength, rhs);
+        emitElementLoop(lhsLength, nullptr, [&](LLValue *index) {
+          callElementOp(loc, inlineOpsStruct->postblit,
+                        DtoGEP1(realLhsPtr, index, true, "arrayops.elem"));
+        });
+      } else {
+        LLValue *value = makeLValue(loc, rhs);
+        LLValue *tmpSwap = DtoAlloca(elemType, "arrayAssign.tmpSwap");
+        LLValue *elementSizeVal =
+            DtoConstSize_t(getTypeAllocSize(DtoMemType(elemType)));
+        emitElementLoop(lhsLength, nullptr, [&](LLValue *index) {
+          assignElement(loc, inlineOpsStruct, needsPostblit,
+                        DtoGEP1(realLhsPtr, index, true, "arrayops.elem"),
+                        value, tmpSwap, elementSizeVal);
+        });
+      }
     } else {
       LLFunction *fn = getRuntimeFunction(loc, gIR->module,
                                           isConstructing ? "_d_arraysetctor"
@@ -464,10 +625,11 @@ LLConstant *DtoConstArrayInitializer(ArrayInitializer *arrinit,
   }
 
   // we need to make a global with the data, so we have a pointer to the array
-  // Important: don't make the gvar constant, since this const initializer might
-  // be used as an initializer for a static T[] - where modifying contents is
-  // allowed.
-  auto gvar = new LLGlobalVariable(gIR->module, constarr->getType(), false,
+  // Important: don't make the gvar constant for mutable elements, since this
+  // const initializer might be used as an initializer for a static T[] - where
+  // modifying contents is allowed.
+  const bool isConstant = elemty->isImmutable() || elemty->isConst();
+  auto gvar = new LLGlobalVariable(gIR->module, constarr->getType(), isConstant,
                                    LLGlobalValue::InternalLinkage, constarr,
                                    ".constarray");
 
@@ -617,10 +779,7 @@ void initializeArrayLiteral(IRState *p, ArrayLiteralExp *ale, LLValue *dstMem) {
     if (elemCount <= 4) {
       DtoStore(constarr, DtoBitCast(dstMem, getPtrToType(constarr->getType())));
     } else {
-      auto gvar = new llvm::GlobalVariable(gIR->module, constarr->getType(),
-                                           true, LLGlobalValue::InternalLinkage,
-                                           constarr, ".arrayliteral");
-      gvar->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+      auto gvar = p->getPooledConstant(constarr, ".arrayliteral");
       DtoMemCpy(dstMem, gvar,
                 DtoConstSize_t(getTypeAllocSize(constarr->getType())));
     }
@@ -664,6 +823,47 @@ static DSliceValue *getSlice(Type *arrayType, LLValue *array) {
 }
 
 ////////////////////////////////////////////////////////////////////////////////
+namespace {
+// The alignment of GC blocks.
+const unsigned gcBlockAlignment = 16;
+
+// Allocates an array of over-aligned elements by allocating enough additional
+// elements to return an aligned slice into the GC block. Appending to it
+// reallocates, as the slice doesn't start at the beginning of the block.
+DSliceValue *newOverAlignedDynArray(Loc &loc, Type *arrayType, Type *eltType,
+                                    LLValue *arrayLen, unsigned alignment,
+                                    bool defaultInit) {
+  IF_LOG Logger::println("over-aligned elements (%u bytes)", alignment);
+
+  const uint64_t eltSize = getTypeAllocSize(DtoMemType(eltType));
+  const uint64_t extraBytes = alignment - gcBlockAlignment;
+  const uint64_t extraElements = (extraBytes + eltSize - 1) / eltSize;
+
+  LLFunction *fn = getRuntimeFunction(loc, gIR->module, "_d_newarrayU");
+  LLValue *allocLen = gIR->ir->CreateAdd(
+      arrayLen, DtoConstSize_t(extraElements), ".alloclen");
+  LLValue *block = gIR->CreateCallOrInvoke(fn, DtoTypeInfoOf(arrayType),
+                                           allocLen, ".gc_mem")
+                       .getInstruction();
+
+  // Round the pointer up to the alignment.
+  LLValue *base = DtoExtractValue(block, 1, ".ptr");
+  LLValue *misalignment = gIR->ir->CreateAnd(
+      gIR->ir->CreateNeg(gIR->ir->CreatePtrToInt(base, DtoSize_t())),
+      DtoConstSize_t(alignment - 1), ".misalignment");
+  LLValue *ptr = DtoGEP1(DtoBitCast(base, getVoidPtrType()), misalignment,
+                         /*inBounds=*/true, ".aligned");
+  ptr = DtoBitCast(ptr, DtoPtrToType(eltType));
+
+  if (defaultInit) {
+    LLConstant *init = DtoConstInitializer(loc, eltType);
+    DtoArrayInit(loc, ptr, arrayLen, new DConstValue(eltType, init));
+  }
+
+  return new DSliceValue(arrayType, arrayLen, ptr);
+}
+}
+
 DSliceValue *DtoNewDynArray(Loc &loc, Type *arrayType, DValue *dim,
                             bool defaultInit) {
   IF_LOG Logger::println("DtoNewDynArray : %s", arrayType->toChars());
@@ -673,6 +873,13 @@ DSliceValue *DtoNewDynArray(Loc &loc, Type *arrayType, DValue *dim,
   Type *eltType = arrayType->toBasetype()->nextOf();
   bool zeroInit = eltType->isZeroInit();
 
+  const unsigned alignment = DtoAlignment(eltType);
+  if (alignment > gcBlockAlignment) {
+    assert(DtoType(dim->type) == DtoSize_t());
+    return newOverAlignedDynArray(loc, arrayType, eltType, DtoRVal(dim),
+                                  alignment, defaultInit);
+  }
+
   const char *fnname = defaultInit
                            ? (zeroInit ? "_d_newarrayT" : "_d_newarrayiT")
                            : "_d_newarrayU";
@@ -694,17 +901,10 @@ DSliceValue *DtoNewDynArray(Loc &loc, Type *arrayType, DValue *dim,
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-DSliceValue *DtoNewMulDimDynArray(Loc &loc, Type *arrayType, DValue **dims,
-                                  size_t ndims) {
-  IF_LOG Logger::println("DtoNewMulDimDynArray : %s", arrayType->toChars());
-  LOG_SCOPE;
-
-  // get value type
-  Type *vtype = arrayType->toBasetype();
-  for (size_t i = 0; i < ndims; ++i) {
-    vtype = vtype->nextOf();
-  }
-
+namespace {
+// Calls _d_newarraymTX/_d_newarraymiTX, allocating each sub-array separately.
+LLValue *callNewArraym(Loc &loc, Type *arrayType, Type *vtype, DValue **dims,
+                       size_t ndims) {
   // get runtime function
   const char *fnname =
       vtype->isZeroInit() ? "_d_newarraymTX" : "_d_newarraymiTX";
@@ -733,9 +933,7 @@ DSliceValue *DtoNewMulDimDynArray(Loc &loc, Type *arrayType, DValue **dims,
 
     llvm::Constant *dims = llvm::ConstantArray::get(
         llvm::ArrayType::get(DtoSize_t(), ndims), argsdims);
-    auto gvar = new llvm::GlobalVariable(gIR->module, dims->getType(), true,
-                                         LLGlobalValue::InternalLinkage, dims,
-                                         ".dimsarray");
+    auto gvar = gIR->getPooledConstant(dims, ".dimsarray");
     array = llvm::ConstantExpr::getBitCast(gvar, getPtrToType(dims->getType()));
   } else {
     // Build static array for dimensions
@@ -753,9 +951,143 @@ DSliceValue *DtoNewMulDimDynArray(Loc &loc, Type *arrayType, DValue **dims,
            DtoGEPi(darray, 0, 1, ".ptr"));
 
   // call allocator
-  LLValue *newptr =
-      gIR->CreateCallOrInvoke(fn, arrayTypeInfo, DtoLoad(darray), ".gc_mem")
+  return gIR->CreateCallOrInvoke(fn, arrayTypeInfo, DtoLoad(darray), ".gc_mem")
+      .getInstruction();
+}
+
+// Computes a * b (or a + b), or'ing an overflow into `overflow`.
+LLValue *arithWithOverflow(llvm::Intrinsic::ID id, LLValue *a, LLValue *b,
+                           LLValue *&overflow) {
+  llvm::Function *fn =
+      llvm::Intrinsic::getDeclaration(&gIR->module, id, DtoSize_t());
+  LLValue *res = gIR->ir->CreateCall(fn, {a, b});
+  LLValue *o = DtoExtractValue(res, 1);
+  overflow = overflow ? gIR->ir->CreateOr(overflow, o) : o;
+  return DtoExtractValue(res, 0);
+}
+
+/// Allocates `new T[][](rows, cols)` as a single GC block: the `rows` slices
+/// followed by the elements of all rows. Falls back to the runtime if the
+/// size computation overflows (which then throws).
+///
+/// Appending to a row reallocates it (except for the last one, which is
+/// extended in place), as the row slices don't end at the end of the used
+/// part of the block.
+///
+/// The block is typed as ubyte[]/void*[], so it must only be used for element
+/// types without destructors (which the GC would never run).
+LLValue *newMatrixContiguous(Loc &loc, Type *arrayType, Type *vtype,
+                             DValue **dims) {
+  IF_LOG Logger::println("Allocating contiguous two-dimensional array");
+  LOG_SCOPE;
+
+  const uint64_t ptrSize = gDataLayout->getPointerSize();
+  LLType *rowType = DtoType(vtype->arrayOf());
+  LLType *elemType = DtoMemType(vtype);
+  LLValue *rows = DtoRVal(dims[0]);
+  LLValue *cols = DtoRVal(dims[1]);
+
+  LLValue *overflow = nullptr;
+  LLValue *numElements =
+      arithWithOverflow(llvm::Intrinsic::umul_with_overflow, rows, cols,
+                        overflow);
+  LLValue *dataSize = arithWithOverflow(
+      llvm::Intrinsic::umul_with_overflow, numElements,
+      DtoConstSize_t(getTypeAllocSize(elemType)), overflow);
+  LLValue *rowsSize = arithWithOverflow(
+      llvm::Intrinsic::umul_with_overflow, rows,
+      DtoConstSize_t(getTypeAllocSize(rowType)), overflow);
+  LLValue *totalSize = arithWithOverflow(llvm::Intrinsic::uadd_with_overflow,
+                                         rowsSize, dataSize, overflow);
+
+  llvm::BasicBlock *fastbb = gIR->insertBB("newmatrix.contiguous");
+  llvm::BasicBlock *slowbb = gIR->insertBBAfter(fastbb, "newmatrix.runtime");
+  llvm::BasicBlock *endbb = gIR->insertBBAfter(slowbb, "newmatrix.end");
+  gIR->ir->CreateCondBr(overflow, slowbb, fastbb);
+
+  // The block only needs to be scanned if the elements contain pointers; the
+  // row slices point into the block itself.
+  gIR->scope() = IRScope(fastbb);
+  LLValue *blockTypeInfo;
+  LLValue *blockLength;
+  if (vtype->hasPointers()) {
+    blockTypeInfo = DtoTypeInfoOf(Type::tvoidptr->arrayOf());
+    LLValue *rem = gIR->ir->CreateURem(totalSize, DtoConstSize_t(ptrSize));
+    blockLength = gIR->ir->CreateAdd(
+        gIR->ir->CreateUDiv(totalSize, DtoConstSize_t(ptrSize)),
+        gIR->ir->CreateZExt(gIR->ir->CreateICmpNE(rem, DtoConstSize_t(0)),
+                            DtoSize_t()));
+  } else {
+    blockTypeInfo = DtoTypeInfoOf(Type::tuns8->arrayOf());
+    blockLength = totalSize;
+  }
+  LLFunction *fn = getRuntimeFunction(loc, gIR->module, "_d_newarrayU");
+  LLValue *block =
+      gIR->CreateCallOrInvoke(fn, blockTypeInfo, blockLength, ".gc_mem")
           .getInstruction();
+  LLValue *base = DtoExtractValue(block, 1, ".ptr");
+  LLValue *rowsPtr = DtoBitCast(base, getPtrToType(rowType));
+  LLValue *data = DtoBitCast(DtoGEP1(base, rowsSize, /*inBounds=*/true),
+                             getPtrToType(elemType));
+
+  // Initialize the elements.
+  LLConstant *init = DtoConstInitializer(loc, vtype);
+  DtoArrayInit(loc, data, numElements, new DConstValue(vtype, init));
+
+  // Initialize the rows.
+  llvm::BasicBlock *loopbb = gIR->insertBBBefore(slowbb, "newmatrix.rows");
+  llvm::BasicBlock *loopendbb = gIR->insertBBBefore(slowbb, "newmatrix.done");
+  llvm::BasicBlock *loopentrybb = gIR->scopebb();
+  gIR->ir->CreateCondBr(gIR->ir->CreateICmpNE(rows, DtoConstSize_t(0)), loopbb,
+                        loopendbb);
+  gIR->scope() = IRScope(loopbb);
+  llvm::PHINode *index = gIR->ir->CreatePHI(DtoSize_t(), 2, "newmatrix.row");
+  index->addIncoming(DtoConstSize_t(0), loopentrybb);
+  LLValue *rowData =
+      DtoGEP1(data, gIR->ir->CreateMul(index, cols), /*inBounds=*/true);
+  DtoStore(DtoSlice(rowData, cols),
+           DtoGEP1(rowsPtr, index, /*inBounds=*/true));
+  LLValue *nextIndex = gIR->ir->CreateAdd(index, DtoConstSize_t(1), "", true);
+  index->addIncoming(nextIndex, loopbb);
+  gIR->ir->CreateCondBr(gIR->ir->CreateICmpULT(nextIndex, rows), loopbb,
+                        loopendbb);
+
+  gIR->scope() = IRScope(loopendbb);
+  LLValue *fastResult = DtoAggrPair(block->getType(), rows, base);
+  llvm::BranchInst::Create(endbb, loopendbb);
+
+  gIR->scope() = IRScope(slowbb);
+  LLValue *slowResult = callNewArraym(loc, arrayType, vtype, dims, 2);
+  assert(slowResult->getType() == block->getType());
+  llvm::BasicBlock *slowendbb = gIR->scopebb();
+  llvm::BranchInst::Create(endbb, slowendbb);
+
+  gIR->scope() = IRScope(endbb);
+  llvm::PHINode *res = gIR->ir->CreatePHI(block->getType(), 2, ".newmatrix");
+  res->addIncoming(fastResult, loopendbb);
+  res->addIncoming(slowResult, slowendbb);
+  return res;
+}
+} // anonymous namespace
+
+DSliceValue *DtoNewMulDimDynArray(Loc &loc, Type *arrayType, DValue **dims,
+                                  size_t ndims) {
+  IF_LOG Logger::println("DtoNewMulDimDynArray : %s", arrayType->toChars());
+  LOG_SCOPE;
+
+  // get value type
+  Type *vtype = arrayType->toBasetype();
+  for (size_t i = 0; i < ndims; ++i) {
+    vtype = vtype->nextOf();
+  }
+
+  LLValue *newptr;
+  if (contiguousMulDimNew && ndims == 2 && !vtype->needsDestruction() &&
+      vtype->alignsize() <= 2 * gDataLayout->getPointerSize()) {
+    newptr = newMatrixContiguous(loc, arrayType, vtype, dims);
+  } else {
+    newptr = callNewArraym(loc, arrayType, vtype, dims, ndims);
+  }
 
   IF_LOG Logger::cout() << "final ptr = " << *newptr << '\n';
 
@@ -794,7 +1126,114 @@ DSliceValue *DtoResizeDynArray(Loc &loc, Type *arrayType, DValue *array,
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void DtoCatAssignElement(Loc &loc, DValue *array, Expression *exp) {
+/// Returns the capacity cache {ptr, length, capacity} for appending to the
+/// local slice variable `vd` with -inline-append, or null if not applicable.
+///
+/// Reserving the capacity marks the unconstructed elements as used in the GC
+/// block, so only element types whose garbage is harmless are eligible: no
+/// destructor or postblit (druntime would run them on the reserved elements)
+/// and no pointers (the precise GC would scan them).
+static llvm::AllocaInst *getAppendCache(VarDeclaration *vd) {
+  if (!inlineAppend || !vd || vd->isDataseg() ||
+      (vd->storage_class & (STCref | STCout | STClazy | STCmanifest))) {
+    return nullptr;
+  }
+
+  Type *elemType = vd->type->toBasetype()->nextOf()->toBasetype();
+  if (elemType->needsDestruction() || arrayNeedsPostblit(vd->type) ||
+      elemType->hasPointers()) {
+    return nullptr;
+  }
+
+  llvm::AllocaInst *&cache = gIR->funcGen().appendCaches[vd];
+  if (!cache) {
+    LLType *sizeTy = DtoSize_t();
+    LLStructType *type = LLStructType::get(
+        gIR->context(), {getVoidPtrType(), sizeTy, sizeTy}, false);
+    cache = DtoRawAlloca(type, 0, ".appendCache");
+    new llvm::StoreInst(llvm::Constant::getNullValue(type), cache,
+                        gIR->topallocapoint());
+  }
+  return cache;
+}
+
+/// Appends a single uninitialized element to the slice `array` inline if its
+/// (cached) capacity allows it, otherwise via druntime.
+///
+/// The cache is only valid as long as the slice's ptr and length are the ones
+/// it was created for. The capacity is reserved by extending the length of
+/// the slice in the GC block to the full capacity (while keeping the length
+/// of the local slice), so that no other slices are appended in place into
+/// the reserved elements.
+static void DtoInlineAppendElement(Loc &loc, DValue *array,
+                                   llvm::AllocaInst *cache) {
+  Type *arrayType = array->type->toBasetype();
+  LLValue *arrayLVal = DtoLVal(array);
+  LLValue *typeInfo = DtoTypeInfoOf(arrayType);
+
+  LLValue *cachedPtrPtr = DtoGEPi(cache, 0, 0, ".cachedPtr");
+  LLValue *cachedLenPtr = DtoGEPi(cache, 0, 1, ".cachedLength");
+  LLValue *cachedCapPtr = DtoGEPi(cache, 0, 2, ".cachedCapacity");
+
+  LLValue *length = DtoArrayLen(array);
+  LLValue *ptr = DtoBitCast(DtoArrayPtr(array), getVoidPtrType());
+  LLValue *cachedLength = DtoLoad(cachedLenPtr);
+  LLValue *fits = gIR->ir->CreateAnd(
+      gIR->ir->CreateAnd(gIR->ir->CreateICmpEQ(ptr, DtoLoad(cachedPtrPtr)),
+                         gIR->ir->CreateICmpEQ(length, cachedLength)),
+      gIR->ir->CreateICmpULT(length, DtoLoad(cachedCapPtr)), ".appendFits");
+
+  llvm::BasicBlock *fastbb = gIR->insertBB("appendfast");
+  llvm::BasicBlock *slowbb = gIR->insertBBAfter(fastbb, "appendslow");
+  llvm::BasicBlock *reservebb = gIR->insertBBAfter(slowbb, "appendreserve");
+  llvm::BasicBlock *updatebb = gIR->insertBBAfter(reservebb, "appendupdate");
+  llvm::BasicBlock *endbb = gIR->insertBBAfter(updatebb, "appendend");
+  gIR->ir->CreateCondBr(fits, fastbb, slowbb);
+
+  // Fast path: just bump the length.
+  gIR->scope() = IRScope(fastbb);
+  LLValue *newLength = gIR->ir->CreateAdd(length, DtoConstSize_t(1));
+  DtoStore(newLength, DtoGEPi(arrayLVal, 0, 0, ".length"));
+  DtoStore(newLength, cachedLenPtr);
+  llvm::BranchInst::Create(endbb, gIR->scopebb());
+
+  // Slow path: append via druntime, then reserve the remaining capacity.
+  gIR->scope() = IRScope(slowbb);
+  LLFunction *fn = getRuntimeFunction(loc, gIR->module, "_d_arrayappendcTX");
+  LLValue *arrayPtr =
+      DtoBitCast(arrayLVal, fn->getFunctionType()->getParamType(1));
+  gIR->CreateCallOrInvoke(fn, typeInfo, arrayPtr, DtoConstSize_t(1),
+                          ".appendedArray");
+  LLValue *appendedLength = DtoArrayLen(array);
+  LLFunction *capacityFn =
+      getRuntimeFunction(loc, gIR->module, "_d_arraysetcapacity");
+  LLValue *capacity =
+      gIR->CreateCallOrInvoke(capacityFn, typeInfo, DtoConstSize_t(0),
+                              DtoBitCast(arrayLVal, capacityFn->getFunctionType()
+                                                        ->getParamType(2)),
+                              ".capacity")
+          .getInstruction();
+  gIR->ir->CreateCondBr(gIR->ir->CreateICmpUGT(capacity, appendedLength),
+                        reservebb, updatebb);
+
+  gIR->scope() = IRScope(reservebb);
+  gIR->CreateCallOrInvoke(fn, typeInfo, arrayPtr,
+                          gIR->ir->CreateSub(capacity, appendedLength),
+                          ".reservedArray");
+  DtoStore(appendedLength, DtoGEPi(arrayLVal, 0, 0, ".length"));
+  llvm::BranchInst::Create(updatebb, gIR->scopebb());
+
+  gIR->scope() = IRScope(updatebb);
+  DtoStore(DtoBitCast(DtoArrayPtr(array), getVoidPtrType()), cachedPtrPtr);
+  DtoStore(appendedLength, cachedLenPtr);
+  DtoStore(capacity, cachedCapPtr);
+  llvm::BranchInst::Create(endbb, gIR->scopebb());
+
+  gIR->scope() = IRScope(endbb);
+}
+
+void DtoCatAssignElement(Loc &loc, DValue *array, Expression *exp,
+                         VarDeclaration *arrayVar) {
   IF_LOG Logger::println("DtoCatAssignElement");
   LOG_SCOPE;
 
@@ -805,13 +1244,18 @@ void DtoCatAssignElement(Loc &loc, DValue *array, Expression *exp) {
   // Evaluate the expression to be appended first; it may affect the array.
   DValue *expVal = toElem(exp);
 
-  // The druntime function extends the slice in-place (length += 1, ptr
-  // potentially moved to a new block).
-  LLFunction *fn = getRuntimeFunction(loc, gIR->module, "_d_arrayappendcTX");
-  gIR->CreateCallOrInvoke(
-      fn, DtoTypeInfoOf(arrayType),
-      DtoBitCast(DtoLVal(array), fn->getFunctionType()->getParamType(1)),
-      DtoConstSize_t(1), ".appendedArray");
+  if (llvm::AllocaInst *cache = getAppendCache(arrayVar)) {
+    DtoInlineAppendElement(loc, array, cache);
+  } else {
+    // The druntime function extends the slice in-place (length += 1, ptr
+    // potentially moved to a new block).
+    LLFunction *fn =
+        getRuntimeFunction(loc, gIR->module, "_d_arrayappendcTX");
+    gIR->CreateCallOrInvoke(
+        fn, DtoTypeInfoOf(arrayType),
+        DtoBitCast(DtoLVal(array), fn->getFunctionType()->getParamType(1)),
+        DtoConstSize_t(1), ".appendedArray");
+  }
 
   // Assign to the new last element.
   LLValue *newLength = DtoArrayLen(array);
@@ -953,6 +1397,58 @@ DSliceValue *DtoAppendDCharToUnicodeString(Loc &loc, DValue *arr,
   return DtoAppendDChar(loc, arr, exp, "_d_arrayappendwd");
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+/// Reports the memcmp to libFuzzer (if linked in) like the memcmp interceptors
+/// of the sanitizer runtimes do, which don't see the calls LLVM expands inline.
+static void emitMemcmpFuzzerHook(IRState &irs, llvm::ArrayRef<LLValue *> args,
+                                 LLValue *result) {
+  LLType *voidPtrTy = getVoidPtrType();
+  LLType *params[] = {voidPtrTy, voidPtrTy, voidPtrTy, DtoSize_t(),
+                      LLType::getInt32Ty(irs.context())};
+  auto hookTy = LLFunctionType::get(LLType::getVoidTy(irs.context()), params,
+                                    false);
+  auto hook = llvm::cast<LLFunction>(
+      irs.module.getOrInsertFunction("__sanitizer_weak_hook_memcmp", hookTy));
+  hook->setLinkage(LLGlobalValue::ExternalWeakLinkage);
+
+  llvm::BasicBlock *hookbb = irs.insertBB("memcmp.hook");
+  llvm::BasicBlock *contbb = irs.insertBBAfter(hookbb, "memcmp.cont");
+  irs.ir->CreateCondBr(
+      irs.ir->CreateICmpNE(hook, getNullPtr(hook->getType())), hookbb,
+      contbb);
+
+  irs.scope() = IRScope(hookbb);
+  // libFuzzer tells comparisons apart by their caller PC; use the address of
+  // this block.
+  LLValue *pc = llvm::BlockAddress::get(irs.topfunc(), hookbb);
+  irs.ir->CreateCall(hook, {DtoBitCast(pc, voidPtrTy), args[0], args[1],
+                            args[2], result});
+  irs.ir->CreateBr(contbb);
+
+  irs.scope() = IRScope(contbb);
+}
+
+llvm::CallInst *callMemcmp(Loc &loc, IRState &irs, LLValue *l_ptr,
+                           LLValue *r_ptr, LLValue *numElements) {
+  assert(l_ptr && r_ptr && numElements);
+  LLFunction *fn = getRuntimeFunction(loc, gIR->module, "memcmp");
+  assert(fn);
+  auto sizeInBytes = numElements;
+  size_t elementSize = getTypeAllocSize(l_ptr->getType()->getContainedType(0));
+  if (elementSize != 1) {
+    sizeInBytes = irs.ir->CreateMul(sizeInBytes, DtoConstSize_t(elementSize));
+  }
+  // Call memcmp.
+  LLValue *args[] = {DtoBitCast(l_ptr, getVoidPtrType()),
+                     DtoBitCast(r_ptr, getVoidPtrType()), sizeInBytes};
+  llvm::CallInst *call = irs.ir->CreateCall(fn, args);
+  if (opts::isSanitizerCoverageTraceCmpEnabled()) {
+    emitMemcmpFuzzerHook(irs, args, call);
+  }
+  return call;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 namespace {
 // helper for eq and cmp
@@ -996,11 +1492,15 @@ bool validCompareWithMemcmpType(Type *t) {
     return validCompareWithMemcmpType(elemType);
   }
 
-  case Tstruct:
-    // TODO: Implement when structs can be compared with memcmp. Remember that
-    // structs can have a user-defined opEquals, alignment padding bytes (in
-    // arrays), and padding bytes.
-    return false;
+  case Tstruct: {
+    // Structs without a user-defined or generated member-wise opEquals are
+    // compared bitwise, including padding bytes, like the runtime does via
+    // TypeInfo_Struct.equals.
+    StructDeclaration *sd = static_cast<TypeStruct *>(t)->sym;
+    return sd->fields.dim != 0 && !sd->hasIdentityEquals &&
+           !needOpEquals(sd) &&
+           !search_function(sd, Identifier::idPool("opEquals"));
+  }
 
   case Tvoid:
   case Tint8:
@@ -1051,23 +1551,6 @@ bool validCompareWithMemcmp(DValue *l, DValue *r) {
   return validCompareWithMemcmpType(elemType);
 }
 
-// Create a call instruction to memcmp.
-llvm::CallInst *callMemcmp(Loc &loc, IRState &irs, LLValue *l_ptr,
-                           LLValue *r_ptr, LLValue *numElements) {
-  assert(l_ptr && r_ptr && numElements);
-  LLFunction *fn = getRuntimeFunction(loc, gIR->module, "memcmp");
-  assert(fn);
-  auto sizeInBytes = numElements;
-  size_t elementSize = getTypeAllocSize(l_ptr->getType()->getContainedType(0));
-  if (elementSize != 1) {
-    sizeInBytes = irs.ir->CreateMul(sizeInBytes, DtoConstSize_t(elementSize));
-  }
-  // Call memcmp.
-  LLValue *args[] = {DtoBitCast(l_ptr, getVoidPtrType()),
-                     DtoBitCast(r_ptr, getVoidPtrType()), sizeInBytes};
-  return irs.ir->CreateCall(fn, args);
-}
-
 /// Compare `l` and `r` using memcmp. No checks are done for validity.
 ///
 /// This function can deal with comparisons of static and dynamic arrays
@@ -1104,6 +1587,7 @@ LLValue *DtoArrayEqCmp_memcmp(Loc &loc, DValue *l, DValue *r, IRState &irs) {
   // return 0 (equality) when the length is zero.
   irs.scope() = IRScope(memcmpBB);
   auto memcmpAnswer = callMemcmp(loc, irs, l_ptr, r_ptr, l_length);
+  memcmpBB = irs.scopebb(); // callMemcmp may have added blocks
   irs.ir->CreateBr(memcmpEndBB);
 
   // Merge the result of length check and memcmp call into a phi node.
@@ -1115,6 +1599,125 @@ LLValue *DtoArrayEqCmp_memcmp(Loc &loc, DValue *l, DValue *r, IRState &irs) {
 
   return phi;
 }
+
+/// When `true` is returned, elements of type `t` can be compared for equality
+/// inline by `emitElementEquals`. This covers floating-point types, which must
+/// not be compared bitwise, and structs with a compiler-generated member-wise
+/// opEquals whose fields can be compared inline. Fields of structs without
+/// generated opEquals are compared bitwise, including padding.
+bool validCompareElementwiseType(Type *t, unsigned depth = 0) {
+  t = t->toBasetype();
+  if (t->isfloating()) {
+    return !t->iscomplex();
+  }
+  if (t->ty != Tstruct) {
+    return t->ty != Tvoid && t->ty != Tsarray && validCompareWithMemcmpType(t);
+  }
+  if (validCompareWithMemcmpType(t)) {
+    return true;
+  }
+
+  // Keep the emitted code small.
+  if (depth > 2) {
+    return false;
+  }
+  StructDeclaration *sd = static_cast<TypeStruct *>(t)->sym;
+  if (sd->isUnionDeclaration() || sd->aliasthis || sd->fields.dim == 0 ||
+      sd->fields.dim > 8 || sd->hasIdentityEquals || !needOpEquals(sd) ||
+      search_function(sd, Identifier::idPool("opEquals"))) {
+    return false;
+  }
+  for (auto field : sd->fields) {
+    if (field->overlapped ||
+        !validCompareElementwiseType(field->type, depth + 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Returns whether the elements at `lptr` and `rptr` of type `t` are equal,
+/// as an i1. See `validCompareElementwiseType`.
+LLValue *emitElementEquals(Type *t, LLValue *lptr, LLValue *rptr,
+                           IRState &irs) {
+  t = t->toBasetype();
+  if (t->ty != Tstruct) {
+    LLValue *lval = DtoLoad(lptr);
+    LLValue *rval = DtoLoad(rptr);
+    return t->isfloating() ? irs.ir->CreateFCmpOEQ(lval, rval)
+                           : irs.ir->CreateICmpEQ(lval, rval);
+  }
+
+  // Bitwise comparable structs, see `validCompareWithMemcmpType`.
+  if (validCompareWithMemcmpType(t)) {
+    LLValue *size = DtoConstSize_t(getTypeAllocSize(DtoType(t)));
+    return irs.ir->CreateICmpEQ(DtoMemCmp(lptr, rptr, size), DtoConstInt(0));
+  }
+
+  // Compare the fields, ignoring padding bytes.
+  StructDeclaration *sd = static_cast<TypeStruct *>(t)->sym;
+  LLValue *lbytes = DtoBitCast(lptr, getVoidPtrType());
+  LLValue *rbytes = DtoBitCast(rptr, getVoidPtrType());
+  LLValue *res = nullptr;
+  for (auto field : sd->fields) {
+    LLType *fieldPtrType = DtoPtrToType(field->type);
+    LLValue *offset = DtoConstSize_t(field->offset);
+    LLValue *lfield =
+        DtoBitCast(DtoGEP1(lbytes, offset, /*inBounds=*/true), fieldPtrType);
+    LLValue *rfield =
+        DtoBitCast(DtoGEP1(rbytes, offset, /*inBounds=*/true), fieldPtrType);
+    LLValue *eq = emitElementEquals(field->type, lfield, rfield, irs);
+    res = res ? irs.ir->CreateAnd(res, eq) : eq;
+  }
+  return res;
+}
+
+/// Compares `l` and `r` for equality in an inline loop over the elements.
+/// Returns an i1.
+///
+/// The loop doesn't exit early on the first mismatch, but accumulates the
+/// result, so that LLVM can vectorize it.
+LLValue *DtoArrayEquals_elementwise(Loc &loc, DValue *l, DValue *r,
+                                    IRState &irs) {
+  IF_LOG Logger::println("Comparing arrays element-wise");
+
+  Type *elemType = l->type->toBasetype()->nextOf()->toBasetype();
+  LLValue *l_ptr = DtoArrayPtr(l);
+  LLValue *r_ptr = DtoBitCast(DtoArrayPtr(r), l_ptr->getType());
+  LLValue *length = DtoArrayLen(l);
+  LLType *i1 = LLType::getInt1Ty(irs.context());
+
+  // Enter the loop if the lengths are equal and non-zero.
+  LLValue *lengthsEqual = irs.ir->CreateICmpEQ(length, DtoArrayLen(r));
+  LLValue *nonEmpty = irs.ir->CreateICmpNE(length, DtoConstSize_t(0));
+  llvm::BasicBlock *incomingBB = irs.scopebb();
+  llvm::BasicBlock *loopBB = irs.insertBB("arrayeq.loop");
+  llvm::BasicBlock *endBB = irs.insertBBAfter(loopBB, "arrayeq.end");
+  irs.ir->CreateCondBr(irs.ir->CreateAnd(lengthsEqual, nonEmpty), loopBB,
+                       endBB);
+
+  irs.scope() = IRScope(loopBB);
+  llvm::PHINode *index = irs.ir->CreatePHI(DtoSize_t(), 2, "arrayeq.index");
+  llvm::PHINode *accum = irs.ir->CreatePHI(i1, 2, "arrayeq.accum");
+  index->addIncoming(DtoConstSize_t(0), incomingBB);
+  accum->addIncoming(LLConstant::getAllOnesValue(i1), incomingBB);
+
+  LLValue *eq = emitElementEquals(
+      elemType, DtoGEP1(l_ptr, index, /*inBounds=*/true),
+      DtoGEP1(r_ptr, index, /*inBounds=*/true), irs);
+  LLValue *nextAccum = irs.ir->CreateAnd(accum, eq);
+  LLValue *nextIndex = irs.ir->CreateAdd(index, DtoConstSize_t(1), "", true);
+  index->addIncoming(nextIndex, irs.scopebb());
+  accum->addIncoming(nextAccum, irs.scopebb());
+  irs.ir->CreateCondBr(irs.ir->CreateICmpULT(nextIndex, length), loopBB,
+                       endBB);
+
+  irs.scope() = IRScope(endBB);
+  llvm::PHINode *res = irs.ir->CreatePHI(i1, 2, "arrayeq.result");
+  res->addIncoming(lengthsEqual, incomingBB);
+  res->addIncoming(nextAccum, loopBB);
+  return res;
+}
 } // end anonymous namespace
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1132,6 +1735,12 @@ LLValue *DtoArrayEquals(Loc &loc, TOK op, DValue *l, DValue *r) {
     const auto predicate = eqTokToICmpPred(op);
     const auto memcmp_result = DtoArrayEqCmp_memcmp(loc, l, r, *gIR);
     res = gIR->ir->CreateICmp(predicate, memcmp_result, DtoConstInt(0));
+  } else if (l->type->toBasetype()->equivalent(r->type->toBasetype()) &&
+             validCompareElementwiseType(l->type->toBasetype()->nextOf())) {
+    res = DtoArrayEquals_elementwise(loc, l, r, *gIR);
+    if (op == TOKnotequal) {
+      res = gIR->ir->CreateNot(res);
+    }
   } else {
     res = DtoArrayEqCmp_impl(loc, "_adEq2", l, r, true);
     const auto predicate = eqTokToICmpPred(op, /* invert = */ true);
@@ -1189,7 +1798,10 @@ LLValue *DtoArrayLen(DValue *v) {
       return DtoConstSize_t(0);
     }
     if (v->isLVal()) {
-      return DtoLoad(DtoGEPi(DtoLVal(v), 0, 0), ".len");
+      LLValue *lval = DtoLVal(v);
+      LLValue *len = DtoLoad(DtoGEPi(lval, 0, 0), ".len");
+      addTBAAMetadata(len, Type::tsize_t, lval);
+      return len;
     }
     return gIR->ir->CreateExtractValue(DtoRVal(v), 0, ".len");
   }
@@ -1217,7 +1829,9 @@ LLValue *DtoArrayPtr(DValue *v) {
     if (v->isNull()) {
       ptr = getNullPtr(wantedLLPtrType);
     } else if (v->isLVal()) {
-      ptr = DtoLoad(DtoGEPi(DtoLVal(v), 0, 1), ".ptr");
+      LLValue *lval = DtoLVal(v);
+      ptr = DtoLoad(DtoGEPi(lval, 0, 1), ".ptr");
+      addTBAAMetadata(ptr, Type::tvoidptr, lval);
     } else {
       ptr = gIR->ir->CreateExtractValue(DtoRVal(v), 1, ".ptr");
     }
@@ -1340,13 +1954,83 @@ void DtoIndexBoundsCheck(Loc &loc, DValue *arr, DValue *index) {
   llvm::Value *cond = gIR->ir->CreateICmp(cmpop, DtoRVal(index),
                                           DtoArrayLen(arr), "bounds.cmp");
 
-  llvm::BasicBlock *okbb = gIR->insertBB("bounds.ok");
-  llvm::BasicBlock *failbb = gIR->insertBBAfter(okbb, "bounds.fail");
-  gIR->ir->CreateCondBr(cond, okbb, failbb);
+  DtoBoundsCheckBranch(loc, cond);
+}
+
+namespace {
+FuncGenState::BoundsCheckFailure *getSharedBoundsCheckFailure(IRState *irs) {
+  // The C assert message is built per location.
+  if (global.params.checkAction == CHECKACTION_C) {
+    return nullptr;
+  }
+
+  // The call throws, so it must unwind to the landing pad of the current
+  // cleanup scope. MSVC funclets rule out sharing blocks across them.
+  FuncGenState &funcGen = irs->funcGen();
+  llvm::BasicBlock *landingPad = nullptr;
+  if (!funcGen.scopes.empty()) {
+    if (useMSVCEH()) {
+      return nullptr;
+    }
+    landingPad = funcGen.scopes.getLandingPad();
+  }
 
-  // set up failbb to call the array bounds error runtime function
-  gIR->scope() = IRScope(failbb);
-  DtoBoundsCheckFailCall(gIR, loc);
+  auto it = funcGen.boundsCheckFailures.find(landingPad);
+  if (it != funcGen.boundsCheckFailures.end()) {
+    return &it->second;
+  }
+
+  // Emit the block at the end of the function, out of the way of the hot code.
+  llvm::BasicBlock *const savedBB = irs->scopebb();
+  const auto debugLoc = irs->ir->getCurrentDebugLocation();
+  auto bb = llvm::BasicBlock::Create(irs->context(), "bounds.fail",
+                                     irs->topfunc());
+  irs->scope() = IRScope(bb);
+  // The call stands for multiple locations.
+  if (debugLoc) {
+    irs->ir->SetCurrentDebugLocation(
+        llvm::DebugLoc::get(0, 0, debugLoc.getScope()));
+  }
+
+  Loc loc;
+  llvm::Function *errorfn =
+      getRuntimeFunction(loc, irs->module, "_d_arraybounds");
+  LLFunctionType *fnType = errorfn->getFunctionType();
+  auto file = irs->ir->CreatePHI(fnType->getParamType(0), 2, "bounds.file");
+  auto line = irs->ir->CreatePHI(fnType->getParamType(1), 2, "bounds.line");
+  irs->CreateCallOrInvoke(errorfn, file, line);
+  // the function does not return
+  irs->ir->CreateUnreachable();
+
+  irs->scope() = IRScope(savedBB);
+  irs->ir->SetCurrentDebugLocation(debugLoc);
+
+  auto &failure = funcGen.boundsCheckFailures[landingPad];
+  failure = {bb, file, line};
+  return &failure;
+}
+}
+
+void DtoBoundsCheckBranch(Loc &loc, LLValue *okCond, const char *okName) {
+  llvm::BasicBlock *okbb = gIR->insertBB(okName);
+  // Mark the failure as unlikely, like __builtin_expect does in clang. Among
+  // others, this lets the bounds check elimination pass version loops.
+  llvm::MDBuilder mdBuilder(gIR->context());
+  auto weights = mdBuilder.createBranchWeights(2000, 1);
+
+  if (auto failure = getSharedBoundsCheckFailure(gIR)) {
+    Module *const module = gIR->func()->decl->getModule();
+    failure->file->addIncoming(DtoModuleFileName(module, loc), gIR->scopebb());
+    failure->line->addIncoming(DtoConstUint(loc.linnum), gIR->scopebb());
+    gIR->ir->CreateCondBr(okCond, okbb, failure->block, weights);
+  } else {
+    llvm::BasicBlock *failbb = gIR->insertBBAfter(okbb, "bounds.fail");
+    gIR->ir->CreateCondBr(okCond, okbb, failbb, weights);
+
+    // set up failbb to call the array bounds error runtime function
+    gIR->scope() = IRScope(failbb);
+    DtoBoundsCheckFailCall(gIR, loc);
+  }
 
   // if ok, proceed in okbb
   gIR->scope() = IRScope(okbb);
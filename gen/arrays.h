@@ -25,6 +25,7 @@ class Expression;
 struct IRState;
 struct Loc;
 class Type;
+class VarDeclaration;
 
 llvm::StructType *DtoArrayType(Type *arrayTy);
 llvm::StructType *DtoArrayType(LLType *elemTy);
@@ -66,7 +67,9 @@ DSliceValue *DtoNewMulDimDynArray(Loc &loc, Type *arrayType, DValue **dims,
 DSliceValue *DtoResizeDynArray(Loc &loc, Type *arrayType, DValue *array,
                                llvm::Value *newdim);
 
-void DtoCatAssignElement(Loc &loc, DValue *arr, Expression *exp);
+/// `arrayVar` is the variable appended to, if `arr` is one.
+void DtoCatAssignElement(Loc &loc, DValue *arr, Expression *exp,
+                         VarDeclaration *arrayVar = nullptr);
 DSliceValue *DtoCatAssignArray(Loc &loc, DValue *arr, Expression *exp);
 DSliceValue *DtoCatArrays(Loc &loc, Type *type, Expression *e1, Expression *e2);
 DSliceValue *DtoAppendDCharToString(Loc &loc, DValue *arr, Expression *exp);
@@ -75,6 +78,11 @@ DSliceValue *DtoAppendDCharToUnicodeString(Loc &loc, DValue *arr,
 
 LLValue *DtoArrayEquals(Loc &loc, TOK op, DValue *l, DValue *r);
 
+/// Calls memcmp, comparing `numElements` elements of the pointee type of
+/// `l_ptr`.
+llvm::CallInst *callMemcmp(Loc &loc, IRState &irs, LLValue *l_ptr,
+                           LLValue *r_ptr, LLValue *numElements);
+
 LLValue *DtoDynArrayIs(TOK op, DValue *l, DValue *r);
 
 LLValue *DtoArrayCastLength(Loc &loc, LLValue *len, LLType *elemty,
@@ -88,6 +96,12 @@ DValue *DtoCastArray(Loc &loc, DValue *val, Type *to);
 // generates an array bounds check
 void DtoIndexBoundsCheck(Loc &loc, DValue *arr, DValue *index);
 
+/// Continues in a new block if okCond holds, and otherwise branches to a block
+/// throwing the range error for the given location. Such blocks are shared by
+/// the bounds checks of a function where possible.
+void DtoBoundsCheckBranch(Loc &loc, LLValue *okCond,
+                          const char *okName = "bounds.ok");
+
 /// Inserts a call to the druntime function that throws the range error, with
 /// the given location.
 void DtoBoundsCheckFailCall(IRState *p, Loc &loc);
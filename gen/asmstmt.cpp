@@ -18,6 +18,7 @@
 #include "declaration.h"
 #include "dsymbol.h"
 
+#include <algorithm>
 #include <cassert>
 #include <deque>
 #include <cstring>
@@ -379,6 +380,15 @@ void AsmStatement_toIR(InlineAsmStatement *stmt, IRState *irs) {
     asmblock->clobs.insert(clobstr);
   }
 
+  // Memory operands are only outputs if written. Writes through registers
+  // clobber memory, and pushing/popping clobbers the stack pointer.
+  if (clobbers_mem || !output_values.empty() ||
+      std::find_if(clobbers.begin(), clobbers.end(), [](const std::string &c) {
+        return c == "esp" || c == "rsp";
+      }) != clobbers.end()) {
+    asmblock->writesMemory = true;
+  }
+
   IF_LOG {
     {
       Logger::println("Output values:");
@@ -695,10 +705,19 @@ void CompoundAsmStatement_toIR(CompoundAsmStatement *stmt, IRState *p) {
     Logger::undent();
   }
 
-  llvm::InlineAsm *ia = llvm::InlineAsm::get(fty, code, out_c, true);
+  // `asm pure` blocks which don't write memory only depend on their inputs
+  // and the memory they read, so they don't need to be treated as having side
+  // effects, allowing the optimizer to CSE, hoist or remove them.
+  const bool isPure = (stmt->stc & STCpure) && !asmblock->writesMemory &&
+                      outargs.empty();
+
+  llvm::InlineAsm *ia = llvm::InlineAsm::get(fty, code, out_c, !isPure);
 
   llvm::CallInst *call = p->ir->CreateCall(
       ia, args, retty == LLType::getVoidTy(gIR->context()) ? "" : "asm");
+  if (isPure) {
+    call->setOnlyReadsMemory();
+  }
 
   IF_LOG Logger::cout() << "Complete asm statement: " << *call << '\n';
 
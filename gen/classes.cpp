@@ -20,6 +20,7 @@
 #include "gen/irstate.h"
 #include "gen/llvmhelpers.h"
 #include "gen/logger.h"
+#include "gen/mangling.h"
 #include "gen/nested.h"
 #include "gen/optimizer.h"
 #include "gen/rttibuilder.h"
@@ -29,6 +30,7 @@
 #include "ir/iraggr.h"
 #include "ir/irfunction.h"
 #include "ir/irtypeclass.h"
+#include "driver/cl_options.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -73,15 +75,35 @@ void DtoResolveClass(ClassDeclaration *cd) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+static unsigned build_classinfo_flags(ClassDeclaration *cd);
+
+// Initializes small stack-allocated instances by storing the static
+// initializer directly instead of copying it from the init symbol, which
+// allows promoting the instance to registers.
+static bool storeInitImage(TypeClass *tc, LLValue *dst, unsigned alignment) {
+  const unsigned maxSize = 128;
+  if (tc->sym->structsize > maxSize) {
+    return false;
+  }
+
+  LLConstant *init = getIrAggr(tc->sym)->getDefaultInit();
+  LLValue *ptr = DtoBitCast(dst, getPtrToType(init->getType()));
+  gIR->ir->CreateAlignedStore(init, ptr, alignment);
+  return true;
+}
+
 DValue *DtoNewClass(Loc &loc, TypeClass *tc, NewExp *newexp) {
   // resolve type
   DtoResolveClass(tc->sym);
 
   // allocate
   LLValue *mem;
+  bool isInitialized = false;
   if (newexp->onstack) {
-    mem = DtoRawAlloca(DtoType(tc)->getContainedType(0), DtoAlignment(tc),
+    const unsigned alignment = DtoAlignment(tc);
+    mem = DtoRawAlloca(DtoType(tc)->getContainedType(0), alignment,
                        ".newclass_alloca");
+    isInitialized = storeInitImage(tc, mem, alignment);
   }
   // custom allocator
   else if (newexp->allocator) {
@@ -92,17 +114,39 @@ DValue *DtoNewClass(Loc &loc, TypeClass *tc, NewExp *newexp) {
   }
   // default allocator
   else {
-    llvm::Function *fn =
-        getRuntimeFunction(loc, gIR->module, "_d_allocclass");
     LLConstant *ci = DtoBitCast(getIrAggr(tc->sym)->getClassInfoSymbol(),
                                 DtoType(getClassInfoType()));
-    mem =
-        gIR->CreateCallOrInvoke(fn, ci, ".newclass_gc_alloc").getInstruction();
+    // Instances needing finalization or allocated by means other than the GC
+    // (COM classes) go through _d_allocclass.
+    const unsigned flags = build_classinfo_flags(tc->sym);
+    mem = nullptr;
+    if (!(flags & (ClassFlags::hasDtor | ClassFlags::isCOMclass |
+                   ClassFlags::isCPPclass))) {
+      mem = DtoThreadLocalAlloc(
+          loc, getTypeAllocSize(DtoType(tc)->getContainedType(0)),
+          !(flags & ClassFlags::noPointers), ci, ".newclass_gc_alloc");
+    }
+    LLConstant *bitmap = nullptr;
+    if (!mem && !(flags & (ClassFlags::noPointers | ClassFlags::isCOMclass)))
+      bitmap = getPointerBitmapForAlloc(tc);
+    if (bitmap) {
+      llvm::Function *fn =
+          getRuntimeFunction(loc, gIR->module, "_d_allocclassBitmap");
+      mem = gIR->CreateCallOrInvoke(fn, ci, bitmap, ".newclass_gc_alloc")
+                .getInstruction();
+    } else if (!mem) {
+      llvm::Function *fn =
+          getRuntimeFunction(loc, gIR->module, "_d_allocclass");
+      mem = gIR->CreateCallOrInvoke(fn, ci, ".newclass_gc_alloc")
+                .getInstruction();
+    }
     mem = DtoBitCast(mem, DtoType(tc), ".newclass_gc");
   }
 
   // init
-  DtoInitClass(tc, mem);
+  if (!isInitialized) {
+    DtoInitClass(tc, mem);
+  }
 
   // init inner-class outer reference
   if (newexp->thisexp) {
@@ -168,6 +212,13 @@ void DtoInitClass(TypeClass *tc, LLValue *dst) {
     return;
   }
 
+  // Mostly zero initializers are cheaper to zero and patch up than to copy.
+  if (DtoSparseInitialize(dst, getIrAggr(tc->sym)->getDefaultInit(),
+                          Target::ptrsize * firstDataIdx,
+                          tc->sym->structsize)) {
+    return;
+  }
+
   LLValue *dstarr = DtoGEPi(dst, 0, firstDataIdx);
 
   // init symbols might not have valid types
@@ -192,11 +243,6 @@ void DtoFinalizeClass(Loc &loc, LLValue *inst) {
 ////////////////////////////////////////////////////////////////////////////////
 
 void DtoFinalizeScopeClass(Loc &loc, LLValue *inst, ClassDeclaration *cd) {
-  if (!isOptimizationEnabled()) {
-    DtoFinalizeClass(loc, inst);
-    return;
-  }
-
   assert(cd);
   // As of 2.077, the front-end doesn't emit the implicit delete() for C++
   // classes, so this code assumes D classes.
@@ -353,7 +399,7 @@ static void resolveObjectAndClassInfoClasses() {
   DtoResolveClass(Type::typeinfoclass);
 }
 
-DValue *DtoDynamicCastObject(Loc &loc, DValue *val, Type *_to) {
+static LLValue *callDynamicCastObject(Loc &loc, LLValue *obj, Type *_to) {
   // call:
   // Object _d_dynamic_cast(Object o, ClassInfo c)
 
@@ -364,7 +410,6 @@ DValue *DtoDynamicCastObject(Loc &loc, DValue *val, Type *_to) {
   resolveObjectAndClassInfoClasses();
 
   // Object o
-  LLValue *obj = DtoRVal(val);
   obj = DtoBitCast(obj, funcTy->getParamType(0));
   assert(funcTy->getParamType(0) == obj->getType());
 
@@ -383,7 +428,72 @@ DValue *DtoDynamicCastObject(Loc &loc, DValue *val, Type *_to) {
   LLValue *ret = gIR->CreateCallOrInvoke(func, obj, cinfo).getInstruction();
 
   // cast return value
-  ret = DtoBitCast(ret, DtoType(_to));
+  return DtoBitCast(ret, DtoType(_to));
+}
+
+DValue *DtoDynamicCastObject(Loc &loc, DValue *val, Type *_to) {
+  LLValue *obj = DtoRVal(val);
+
+  TypeClass *to = static_cast<TypeClass *>(_to->toBasetype());
+  ClassDeclaration *cd = to->sym;
+  if (cd->isInterfaceDeclaration() || cd->classKind != ClassKind::d) {
+    return new DImValue(_to, callDynamicCastObject(loc, obj, _to));
+  }
+
+  // Objects whose dynamic type is exactly the target class are cast inline,
+  // by comparing their ClassInfo (vtbl[0]) with the target's. For final
+  // classes, there is no other way for the cast to succeed, so druntime isn't
+  // called at all - except on Windows, where a ClassInfo may be duplicated
+  // across DLLs and druntime falls back to comparing the class names.
+  DtoResolveClass(cd);
+  const bool isFinal = (cd->storage_class & STCfinal) &&
+                       !global.params.targetTriple->isOSWindows();
+  LLType *toType = DtoType(_to);
+  LLValue *null = LLConstant::getNullValue(toType);
+
+  llvm::BasicBlock *entryBB = gIR->scopebb();
+  llvm::BasicBlock *checkBB = gIR->insertBB("dyncast.check");
+  llvm::BasicBlock *callBB =
+      isFinal ? nullptr : gIR->insertBBAfter(checkBB, "dyncast.call");
+  llvm::BasicBlock *endBB =
+      gIR->insertBBAfter(isFinal ? checkBB : callBB, "dyncast.end");
+
+  LLValue *isNull = gIR->ir->CreateICmpEQ(
+      obj, LLConstant::getNullValue(obj->getType()), ".nullcheck");
+  gIR->ir->CreateCondBr(isNull, endBB, checkBB);
+
+  gIR->scope() = IRScope(checkBB);
+  LLType *vtblType = getPtrToType(getVoidPtrType());
+  LLValue *vtbl = DtoLoad(DtoBitCast(obj, getPtrToType(vtblType)), "vtbl");
+  LLValue *classInfo = DtoLoad(vtbl, "classinfo");
+  LLValue *isExact = gIR->ir->CreateICmpEQ(
+      classInfo,
+      DtoBitCast(getIrAggr(cd)->getClassInfoSymbol(), getVoidPtrType()),
+      ".exactcheck");
+  LLValue *exact = DtoBitCast(obj, toType);
+  if (isFinal) {
+    exact = gIR->ir->CreateSelect(isExact, exact, null);
+    gIR->ir->CreateBr(endBB);
+  } else {
+    gIR->ir->CreateCondBr(isExact, endBB, callBB);
+  }
+
+  LLValue *called = nullptr;
+  if (callBB) {
+    gIR->scope() = IRScope(callBB);
+    called = callDynamicCastObject(loc, obj, _to);
+    // The call may have been emitted as invoke, terminating the block.
+    callBB = gIR->scopebb();
+    gIR->ir->CreateBr(endBB);
+  }
+
+  gIR->scope() = IRScope(endBB);
+  llvm::PHINode *ret = gIR->ir->CreatePHI(toType, callBB ? 3 : 2, ".dyncast");
+  ret->addIncoming(null, entryBB);
+  ret->addIncoming(exact, checkBB);
+  if (callBB) {
+    ret->addIncoming(called, callBB);
+  }
 
   return new DImValue(_to, ret);
 }
@@ -424,6 +534,34 @@ DValue *DtoDynamicCastInterface(Loc &loc, DValue *val, Type *_to) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+#if LDC_LLVM_VER >= 500
+llvm::MDString *getVtblTypeId(ClassDeclaration *cd) {
+  // The whole hierarchy below a class is only known if it is defined in one of
+  // the compiled modules, and not an interface or C++/COM class.
+  if (!opts::wholeProgramVtables || cd->isInterfaceDeclaration() ||
+      cd->isCPPclass() || cd->isCOMclass()) {
+    return nullptr;
+  }
+  Module *m = cd->getModule();
+  if (!m || !m->isRoot()) {
+    return nullptr;
+  }
+  return llvm::MDString::get(gIR->context(),
+                             getIRMangledVTableSymbolName(cd));
+}
+
+void addVtblTypeMetadata(ClassDeclaration *cd, llvm::GlobalVariable *vtbl) {
+  // The vtbl is compatible with the ones of all base classes.
+  for (ClassDeclaration *c = cd; c; c = c->baseClass) {
+    if (auto typeId = getVtblTypeId(c)) {
+      vtbl->addTypeMetadata(0, typeId);
+    }
+  }
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+
 LLValue *DtoVirtualFunctionPointer(DValue *inst, FuncDeclaration *fdecl,
                                    const char *name) {
   // sanity checks
@@ -443,6 +581,16 @@ LLValue *DtoVirtualFunctionPointer(DValue *inst, FuncDeclaration *fdecl,
   funcval = DtoGEPi(funcval, 0, 0);
   // load vtbl ptr
   funcval = DtoLoad(funcval);
+#if LDC_LLVM_VER >= 500
+  // let -fwhole-program-vtables devirtualize the call
+  if (auto typeId = getVtblTypeId(
+          static_cast<TypeClass *>(inst->type->toBasetype())->sym)) {
+    LLValue *args[] = {DtoBitCast(funcval, getVoidPtrType()),
+                       llvm::MetadataAsValue::get(gIR->context(), typeId)};
+    LLValue *test = gIR->ir->CreateCall(GET_INTRINSIC_DECL(type_test), args);
+    gIR->ir->CreateCall(GET_INTRINSIC_DECL(assume), test);
+  }
+#endif
   // index vtbl
   std::string vtblname = name;
   vtblname.append("@vtbl");
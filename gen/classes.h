@@ -22,6 +22,10 @@ class CtorDeclaration;
 class FuncDeclaration;
 class NewExp;
 class TypeClass;
+namespace llvm {
+class GlobalVariable;
+class MDString;
+}
 
 /// Resolves the llvm type for a class declaration
 void DtoResolveClass(ClassDeclaration *cd);
@@ -43,4 +47,14 @@ DValue *DtoDynamicCastInterface(Loc &loc, DValue *val, Type *to);
 llvm::Value *DtoVirtualFunctionPointer(DValue *inst, FuncDeclaration *fdecl,
                                        const char *name);
 
+#if LDC_LLVM_VER >= 500
+/// Returns the type identifier of the vtbl of `cd` for
+/// -fwhole-program-vtables, or null if calls via its vtbl must not be
+/// devirtualized.
+llvm::MDString *getVtblTypeId(ClassDeclaration *cd);
+
+/// Adds the type identifiers of `cd` and its base classes to its vtbl.
+void addVtblTypeMetadata(ClassDeclaration *cd, llvm::GlobalVariable *vtbl);
+#endif
+
 #endif
@@ -297,6 +297,22 @@ DImValue *DtoComplexMul(Loc &loc, Type *type, DRValue *lhs, DRValue *rhs) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Divides both parts of a complex number by the same real divisor. If
+// reciprocal math is allowed (-ffast-math, @fastmath), multiplies them by the
+// reciprocal instead, trading one of the two divisions for a multiplication.
+static void DtoComplexPartsDiv(llvm::Value *&re, llvm::Value *&im,
+                               llvm::Value *divisor) {
+  if (gIR->ir->getFastMathFlags().allowReciprocal()) {
+    llvm::Value *one = llvm::ConstantFP::get(divisor->getType(), 1.0);
+    llvm::Value *rcp = gIR->ir->CreateFDiv(one, divisor, "rcp");
+    re = gIR->ir->CreateFMul(re, rcp, "res_re");
+    im = gIR->ir->CreateFMul(im, rcp, "res_im");
+  } else {
+    re = gIR->ir->CreateFDiv(re, divisor, "res_re");
+    im = gIR->ir->CreateFDiv(im, divisor, "res_im");
+  }
+}
+
 DImValue *DtoComplexDiv(Loc &loc, Type *type, DRValue *lhs, DRValue *rhs) {
   llvm::Value *lhs_re, *lhs_im, *rhs_re, *rhs_im, *res_re, *res_im;
 
@@ -307,15 +323,16 @@ DImValue *DtoComplexDiv(Loc &loc, Type *type, DRValue *lhs, DRValue *rhs) {
 
   // if divisor is only real, division is simple
   if (rhs_re && !rhs_im) {
-    if (lhs_re) {
+    if (lhs_re && lhs_im) {
+      res_re = lhs_re;
+      res_im = lhs_im;
+      DtoComplexPartsDiv(res_re, res_im, rhs_re);
+    } else if (lhs_re) {
       res_re = gIR->ir->CreateFDiv(lhs_re, rhs_re, "re_divby_re");
+      res_im = lhs_im;
     } else {
       res_re = lhs_re;
-    }
-    if (lhs_im) {
       res_im = gIR->ir->CreateFDiv(lhs_im, rhs_re, "im_divby_re");
-    } else {
-      res_im = lhs_im;
     }
   }
   // if divisor is only imaginary, division is simple too
@@ -360,8 +377,7 @@ DImValue *DtoComplexDiv(Loc &loc, Type *type, DRValue *lhs, DRValue *rhs) {
     tmp2 = gIR->ir->CreateFMul(rhs_im, rhs_im, "rhs_imsq");
     denom = gIR->ir->CreateFAdd(tmp1, tmp2, "denom");
 
-    res_re = gIR->ir->CreateFDiv(res_re, denom, "res_re");
-    res_im = gIR->ir->CreateFDiv(res_im, denom, "res_im");
+    DtoComplexPartsDiv(res_re, res_im, denom);
   }
 
   LLValue *res = DtoAggrPair(DtoType(type), res_re, res_im);
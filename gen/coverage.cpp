@@ -11,8 +11,47 @@
 
 #include "mars.h"
 #include "module.h"
+#include "driver/cl_options.h"
 #include "gen/irstate.h"
 #include "gen/logger.h"
+#include "gen/tollvm.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/ValueHandle.h"
+
+namespace {
+// The line count increments emitted into the current basic block. All
+// instructions of a block are executed equally often, so further increments of
+// the same line (several statements on a line, unrolled loops, ...) can be
+// folded into the first one instead of touching the counter again.
+llvm::BasicBlock *incrementsBlock = nullptr;
+llvm::DenseMap<unsigned, llvm::WeakVH> incrementsInBlock;
+
+bool foldIntoPreviousIncrement(unsigned line) {
+  llvm::BasicBlock *bb = gIR->scopebb();
+  if (bb != incrementsBlock) {
+    incrementsBlock = bb;
+    incrementsInBlock.clear();
+    return false;
+  }
+
+  auto it = incrementsInBlock.find(line);
+  if (it == incrementsInBlock.end() || !it->second)
+    return false;
+  auto inst = llvm::cast<llvm::Instruction>(it->second);
+  if (inst->getParent() != bb)
+    return false;
+
+  // The counter only records whether the line was executed.
+  if (opts::coverageIncrement == opts::CoverageIncrement_Boolean)
+    return true;
+
+  // Bump the constant of the atomicrmw resp. add.
+  auto count = llvm::cast<llvm::ConstantInt>(inst->getOperand(1));
+  inst->setOperand(1, llvm::ConstantInt::get(count->getType(),
+                                             count->getZExtValue() + 1));
+  return true;
+}
+} // anonymous namespace
 
 void emitCoverageLinecountInc(Loc &loc) {
   Module *m = gIR->dmodule;
@@ -31,15 +70,38 @@ void emitCoverageLinecountInc(Loc &loc) {
   IF_LOG Logger::println("Coverage: increment _d_cover_data[%d]", line);
   LOG_SCOPE;
 
+  if (foldIntoPreviousIncrement(line)) {
+    IF_LOG Logger::println("folded into previous increment in this block");
+    return;
+  }
+
   // Get GEP into _d_cover_data array
   LLConstant *idxs[] = {DtoConstUint(0), DtoConstUint(line)};
   LLValue *ptr = llvm::ConstantExpr::getGetElementPtr(
       LLArrayType::get(LLType::getInt32Ty(gIR->context()), m->numlines),
       m->d_cover_data, idxs, true);
 
-  // Do an atomic increment, so this works when multiple threads are executed.
-  gIR->ir->CreateAtomicRMW(llvm::AtomicRMWInst::Add, ptr, DtoConstUint(1),
-                           llvm::AtomicOrdering::Monotonic);
+  LLValue *increment = nullptr;
+  switch (opts::coverageIncrement) {
+  case opts::CoverageIncrement_Atomic:
+    // Do an atomic increment, so this works when multiple threads are executed.
+    increment = gIR->ir->CreateAtomicRMW(llvm::AtomicRMWInst::Add, ptr,
+                                         DtoConstUint(1),
+                                         llvm::AtomicOrdering::Monotonic);
+    break;
+  case opts::CoverageIncrement_NonAtomic: {
+    // Much cheaper under contention, but concurrent increments may be lost.
+    LLValue *count = gIR->ir->CreateLoad(ptr, "cov.count");
+    increment = gIR->ir->CreateAdd(count, DtoConstUint(1));
+    gIR->ir->CreateStore(increment, ptr);
+    break;
+  }
+  case opts::CoverageIncrement_Boolean:
+    // Lines are only reported as executed or not.
+    increment = gIR->ir->CreateStore(DtoConstUint(1), ptr);
+    break;
+  }
+  incrementsInBlock[line] = increment;
 
   unsigned num_sizet_bits = gDataLayout->getTypeSizeInBits(DtoSize_t());
   unsigned idx = line / num_sizet_bits;
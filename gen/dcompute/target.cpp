@@ -13,14 +13,71 @@
 #include "dmd/mars.h"
 #include "dmd/module.h"
 #include "dmd/scope.h"
+#include "driver/backenderrors.h"
 #include "driver/linker.h"
 #include "driver/toobj.h"
+#include "driver/cache.h"
 #include "driver/cl_options.h"
+#include "driver/targetmachine.h"
 #include "gen/dcompute/target.h"
 #include "gen/llvmhelpers.h"
+#include "gen/logger.h"
 #include "gen/runtime.h"
+#if LDC_LLVM_VER >= 400
+#include "llvm/Bitcode/BitcodeWriter.h"
+#else
+#include "llvm/Bitcode/ReaderWriter.h"
+#endif
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Target/TargetMachine.h"
+#include <algorithm>
+#include <memory>
 #include <string>
 
+namespace {
+/// Writes the kernel module, or recovers the PTX/SPIR-V binary from the
+/// IR-to-object cache. The IR doesn't include the target version, so it is
+/// hashed together with `targetKey`.
+void writeKernelModule(llvm::Module *m, const std::string &path,
+                       const std::string &targetKey) {
+  // Other outputs, e.g. -output-ll, are only produced by ::writeModule.
+  const bool useCache = !opts::cacheDir.empty() && global.params.output_o &&
+                        !global.params.output_bc && !global.params.output_ll &&
+                        !global.params.output_s;
+  llvm::SmallString<32> moduleHash;
+  if (useCache) {
+    IF_LOG Logger::println("Use IR-to-Object cache in %s",
+                           opts::cacheDir.c_str());
+    LOG_SCOPE
+    cache::calculateModuleHash(m, moduleHash, targetKey);
+    if (!cache::cacheLookup(moduleHash).empty() &&
+        cache::recoverObjectFile(moduleHash, path)) {
+      return;
+    }
+  }
+
+  ::writeModule(m, path.c_str());
+
+  if (useCache) {
+    cache::cacheObjectFile(path, moduleHash);
+  }
+}
+} // anonymous namespace
+
+std::string DComputeTarget::getTargetKey() const {
+  std::string key;
+  llvm::raw_string_ostream os(key);
+  os << short_name << tversion;
+  return os.str();
+}
+
 void DComputeTarget::doCodeGen(Module *m) {
   // process module members
   for (unsigned k = 0; k < m->members->dim; k++) {
@@ -43,17 +100,123 @@ void DComputeTarget::emit(Module *m) {
   doCodeGen(m);
 }
 
-void DComputeTarget::writeModule() {
-  addMetadata();
-
+const char *DComputeTarget::getModulePath() const {
   std::string filename;
   llvm::raw_string_ostream os(filename);
   os << opts::dcomputeFilePrefix << '_' << short_name << tversion << '_'
      << (global.params.is64bit ? 64 : 32) << '.' << binSuffix;
 
-  const char *path = FileName::combine(global.params.objdir, os.str().c_str());
+  return FileName::combine(global.params.objdir, os.str().c_str());
+}
+
+void DComputeTarget::addKernelArgs(llvm::Function *llf) {
+  if (!opts::dcomputeKernelArgs)
+    return;
+
+  // One line per kernel (name, number of arguments, size of the packed
+  // argument buffer), followed by one line per argument (offset, size,
+  // alignment and nominal DCompute address space of pointers, -1 otherwise).
+  // The arguments are packed at their ABI alignment, as in CUDA's parameter
+  // buffer.
+  const llvm::DataLayout &dl = _ir->module.getDataLayout();
+  std::string args;
+  llvm::raw_string_ostream os(args);
+  uint64_t offset = 0;
+  for (llvm::Type *ty : llf->getFunctionType()->params()) {
+    const uint64_t size = dl.getTypeAllocSize(ty);
+    const unsigned align = dl.getABITypeAlignment(ty);
+    offset = llvm::alignTo(offset, align);
+    int addrspace = -1;
+    if (auto ptrTy = llvm::dyn_cast<llvm::PointerType>(ty)) {
+      const auto it = std::find(mapping.begin(), mapping.end(),
+                                static_cast<int>(ptrTy->getAddressSpace()));
+      if (it != mapping.end())
+        addrspace = static_cast<int>(it - mapping.begin());
+    }
+    os << "  " << offset << ' ' << size << ' ' << align << ' ' << addrspace
+       << '\n';
+    offset += size;
+  }
+
+  llvm::raw_string_ostream kernel(kernelArgs);
+  kernel << llf->getName() << ' ' << llf->arg_size() << ' ' << offset << '\n'
+         << os.str();
+}
+
+void DComputeTarget::writeKernelArgs() {
+  if (!opts::dcomputeKernelArgs)
+    return;
+
+  llvm::SmallString<128> path(getModulePath());
+  llvm::sys::path::replace_extension(path, "kargs");
+
+  std::error_code errinfo;
+  llvm::raw_fd_ostream out(path, errinfo, llvm::sys::fs::F_Text);
+  if (errinfo) {
+    error(Loc(), "cannot write kernel argument file '%s': %s", path.c_str(),
+          errinfo.message().c_str());
+    return;
+  }
+  out << kernelArgs;
+}
+
+void DComputeTarget::writeModule() {
+  addMetadata();
+  writeKernelArgs();
+
+  // ::writeModule() emits code for gTargetMachine. The host's target machine
+  // is restored by the DComputeCodeGenManager once all targets are written.
+  gTargetMachine = targetMachine;
+  writeKernelModule(&_ir->module, getModulePath(), getTargetKey());
+
+  delete _ir;
+  _ir = nullptr;
+}
+
+void DComputeTarget::writeModuleInBackground(llvm::ThreadPool &pool) {
+  addMetadata();
+  writeKernelArgs();
+
+  // The module lives in the LLVMContext shared with all other targets, so
+  // hand it over as bitcode to be re-materialized in a worker-owned context.
+  auto bitcode = std::make_shared<llvm::SmallVector<char, 0>>();
+  {
+    llvm::raw_svector_ostream os(*bitcode);
+#if LDC_LLVM_VER >= 700
+    llvm::WriteBitcodeToFile(_ir->module, os);
+#else
+    llvm::WriteBitcodeToFile(&_ir->module, os);
+#endif
+  }
+
+  std::string path = getModulePath();
+  std::string targetKey = getTargetKey();
+  const llvm::TargetMachine *mainTarget = targetMachine;
+  pool.async([bitcode, path, targetKey, mainTarget]() {
+    BackendWorkerScope workerScope;
+    llvm::LLVMContext context;
+    if (!global.params.output_ll) {
+      context.setDiscardValueNames(true);
+    }
+
+    std::unique_ptr<llvm::TargetMachine> target(
+        cloneTargetMachine(*mainTarget));
+    gTargetMachine = target.get();
+
+    llvm::SMDiagnostic err;
+    std::unique_ptr<llvm::Module> module = llvm::parseIR(
+        llvm::MemoryBufferRef(llvm::StringRef(bitcode->data(), bitcode->size()),
+                              path),
+        err, context);
+    if (!module) {
+      backendError(Loc(),
+                   "Could not re-read LLVM module for parallel codegen: %s",
+                   err.getMessage().str().c_str());
+      return;
+    }
 
-  ::writeModule(&_ir->module, path);
+    writeKernelModule(module.get(), path, targetKey);
+  });
 
   delete _ir;
   _ir = nullptr;
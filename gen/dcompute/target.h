@@ -11,14 +11,17 @@
 #define LDC_GEN_DCOMPUTE_TARGET_H
 
 #include "gen/irstate.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Function.h"
 #include <array>
+#include <string>
 
 namespace llvm {
 class Module;
 class Function;
 class TargetMachine;
+class ThreadPool;
 }
 
 class Module;
@@ -48,13 +51,36 @@ public:
   void emit(Module *m);
   void doCodeGen(Module *m);
   void writeModule();
+  // Writes the module on a thread of `pool`, with its own copy of the target
+  // machine.
+  void writeModuleInBackground(llvm::ThreadPool &pool);
 
   virtual void addMetadata() = 0;
   virtual void addKernelMetadata(FuncDeclaration *df, llvm::Function *llf) = 0;
+
+  // Records the argument layout of a kernel after the ABI rewrites, for
+  // -mdcompute-kernel-args.
+  void addKernelArgs(llvm::Function *llf);
+
+  // Path of the written PTX/SPIR-V file.
+  const char *getModulePath() const;
+
+private:
+  // e.g. "cuda350", distinguishes the kernel binaries in the cache.
+  std::string getTargetKey() const;
+
+  // Writes the recorded kernel argument layouts next to the module.
+  void writeKernelArgs();
+
+  // The contents of the .kargs file, see addKernelArgs().
+  std::string kernelArgs;
 };
 
 #if LDC_LLVM_SUPPORTED_TARGET_NVPTX
 DComputeTarget *createCUDATarget(llvm::LLVMContext &c, int sm);
+// Assembles the PTX of all CUDA targets with ptxas and packages the cubins
+// and the PTX into a single fatbinary, if requested by -mdcompute-cuda-fatbin.
+void writeCUDAFatbinary(llvm::ArrayRef<DComputeTarget *> targets);
 #endif
 
 #if LDC_LLVM_SUPPORTED_TARGET_SPIRV
@@ -16,10 +16,28 @@
 #include "gen/logger.h"
 #include "gen/optimizer.h"
 #include "gen/to_string.h"
+#include "gen/uda.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/Scalar.h"
+#include "driver/cl_options.h"
 #include "driver/targetmachine.h"
+#include "driver/tool.h"
+#include "dmd/errors.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Path.h"
 #include <cstring>
+#include <string>
+#include <vector>
+
+namespace cl = llvm::cl;
+
+static cl::opt<std::string>
+    ptxas("ptxas", cl::ZeroOrMore, cl::value_desc("path"),
+          cl::desc("ptxas to use for -mdcompute-cuda-fatbin"));
+
+static cl::opt<std::string>
+    fatbinary("fatbinary", cl::ZeroOrMore, cl::value_desc("path"),
+              cl::desc("fatbinary to use for -mdcompute-cuda-fatbin"));
 
 namespace {
 class TargetCUDA : public DComputeTarget {
@@ -53,17 +71,30 @@ public:
   }
 
   void addKernelMetadata(FuncDeclaration *df, llvm::Function *llf) override {
-    // TODO: Handle Function attibutes
     llvm::NamedMDNode *na =
         _ir->module.getOrInsertNamedMetadata("nvvm.annotations");
     llvm::Metadata *fn = llvm::ConstantAsMetadata::get(llf);
-    llvm::Metadata *kstr = llvm::MDString::get(ctx, "kernel");
-    llvm::Metadata *one = llvm::ConstantAsMetadata::get(
-        llvm::ConstantInt::get(llvm::IntegerType::get(ctx, 32), 1));
+    auto addAnnotation = [&](const char *name, unsigned value) {
+      llvm::Metadata *arr[] = {
+          fn, llvm::MDString::get(ctx, name),
+          llvm::ConstantAsMetadata::get(
+              llvm::ConstantInt::get(llvm::IntegerType::get(ctx, 32), value))};
+      na->addOperand(llvm::MDTuple::get(ctx, arr));
+    };
+
+    addAnnotation("kernel", 1);
 
-    llvm::Metadata *arr[] = {fn, kstr, one};
-    llvm::MDNode *tup = llvm::MDTuple::get(ctx, arr);
-    na->addOperand(tup);
+    // Let ptxas limit register usage so that the requested number of threads
+    // (and blocks per multiprocessor) can actually be resident.
+    unsigned maxThreads, minBlocks;
+    if (getLaunchBoundsAttr(df, maxThreads, minBlocks)) {
+      addAnnotation("maxntidx", maxThreads);
+      if (minBlocks)
+        addAnnotation("minctasm", minBlocks);
+    }
+    unsigned maxRegisters;
+    if (getMaxRegistersAttr(df, maxRegisters))
+      addAnnotation("maxnreg", maxRegisters);
   }
 };
 } // anonymous namespace.
@@ -72,4 +103,55 @@ DComputeTarget *createCUDATarget(llvm::LLVMContext &c, int sm) {
   return new TargetCUDA(c, sm);
 };
 
+void writeCUDAFatbinary(llvm::ArrayRef<DComputeTarget *> targets) {
+  if (!opts::dcomputeCUDAFatbin || !global.params.output_o)
+    return;
+
+  const bool is64 = global.params.is64bit;
+  std::vector<std::string> fatbinArgs;
+  std::string ptxasPath;
+  for (auto target : targets) {
+    if (target->target != DComputeTarget::CUDA)
+      continue;
+
+    if (ptxasPath.empty())
+      ptxasPath = getProgram("ptxas", &ptxas);
+
+    const std::string sm = ldc::to_string(target->tversion / 10);
+    const std::string ptx = target->getModulePath();
+    llvm::SmallString<128> cubin(ptx);
+    llvm::sys::path::replace_extension(cubin, "cubin");
+
+    std::vector<std::string> args = {"-arch=sm_" + sm, is64 ? "-m64" : "-m32",
+                                     "-o", cubin.str().str(), ptx};
+    if (executeToolAndWait(ptxasPath, args, global.params.verbose) != 0) {
+      error(Loc(), "ptxas failed for %s", ptx.c_str());
+      fatal();
+    }
+
+    // The SASS for the exact architecture, plus the PTX for the driver to
+    // JIT on newer GPUs.
+    fatbinArgs.push_back("--image=profile=sm_" + sm + ",file=" +
+                         cubin.str().str());
+    fatbinArgs.push_back("--image=profile=compute_" + sm + ",file=" + ptx);
+  }
+
+  if (fatbinArgs.empty())
+    return;
+
+  std::string filename;
+  llvm::raw_string_ostream os(filename);
+  os << opts::dcomputeFilePrefix << "_cuda_" << (is64 ? 64 : 32)
+     << ".fatbin";
+  const char *path = FileName::combine(global.params.objdir, os.str().c_str());
+
+  fatbinArgs.insert(fatbinArgs.begin(),
+                    {std::string("--create=") + path, is64 ? "-64" : "-32"});
+  if (executeToolAndWait(getProgram("fatbinary", &fatbinary), fatbinArgs,
+                         global.params.verbose) != 0) {
+    error(Loc(), "fatbinary failed for %s", path);
+    fatal();
+  }
+}
+
 #endif // LDC_LLVM_SUPPORTED_TARGET_NVPTX
@@ -14,6 +14,7 @@
 #include "dmd/template.h"
 #include "gen/abi-spirv.h"
 #include "gen/logger.h"
+#include "driver/cl_options.h"
 #include "llvm/Transforms/Scalar.h"
 #include "id.h"
 #include <cstring>
@@ -53,15 +54,51 @@ public:
     _ir->dcomputetarget = this;
   }
 
+  // Returns the OpenCL extensions required by the builtins called in the
+  // module, e.g., the subgroup functions (declared by the dcompute library).
+  llvm::SmallVector<llvm::Metadata *, 2> getUsedExtensions() {
+    bool subgroups = false, intelSubgroups = false;
+    for (const llvm::Function &f : _ir->module) {
+      if (!f.isDeclaration())
+        continue;
+      const auto name = f.getName();
+      if (name.find("intel_sub_group_") != llvm::StringRef::npos) {
+        intelSubgroups = true;
+      } else if (name.find("sub_group_") != llvm::StringRef::npos) {
+        subgroups = true;
+      }
+    }
+
+    llvm::SmallVector<llvm::Metadata *, 2> extensions;
+    if (subgroups)
+      extensions.push_back(llvm::MDString::get(ctx, "cl_khr_subgroups"));
+    if (intelSubgroups)
+      extensions.push_back(llvm::MDString::get(ctx, "cl_intel_subgroups"));
+    return extensions;
+  }
+
   // Adapted from clang
   void addMetadata() override {
     // opencl.ident?
     // spirv.Source // debug only
     // stuff from clang's CGSPIRMetadataAdder.cpp
-    // opencl.used.extensions
     // opencl.used.optional.core.features
-    // opencl.compiler.options
-    // opencl.enable.FP_CONTRACT (-ffast-math)
+
+    // The SPIR-V translator declares the extensions and the capabilities of
+    // the builtins used by the kernels.
+    _ir->module.getOrInsertNamedMetadata("opencl.used.extensions")
+        ->addOperand(llvm::MDNode::get(ctx, getUsedExtensions()));
+
+    // -ffast-math: let the OpenCL runtime compile the kernels with relaxed
+    // math and contract floating-point operations.
+    if (opts::fFastMath) {
+      llvm::Metadata *options[] = {
+          llvm::MDString::get(ctx, "-cl-fast-relaxed-math")};
+      _ir->module.getOrInsertNamedMetadata("opencl.compiler.options")
+          ->addOperand(llvm::MDNode::get(ctx, options));
+      _ir->module.getOrInsertNamedMetadata("opencl.enable.FP_CONTRACT");
+    }
+
     llvm::Metadata *SPIRVerElts[] = {
         llvm::ConstantAsMetadata::get(
             llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), 1)),
@@ -16,6 +16,7 @@
 #include "nspace.h"
 #include "rmem.h"
 #include "template.h"
+#include "driver/templatestats.h"
 #include "gen/classes.h"
 #include "gen/functions.h"
 #include "gen/irstate.h"
@@ -202,6 +203,9 @@ public:
 
       llvm::GlobalVariable *vtbl = ir->getVtblSymbol();
       defineGlobal(vtbl, ir->getVtblInit(), decl);
+#if LDC_LLVM_VER >= 500
+      addVtblTypeMetadata(decl, vtbl);
+#endif
 
       ir->defineInterfaceVtbls();
 
@@ -381,6 +385,7 @@ public:
       }
     }
 
+    templatestats::CodegenScope statsScope(decl);
     for (auto &m : *decl->members) {
       m->accept(this);
     }
@@ -11,6 +11,7 @@
 
 #include "driver/cl_options.h"
 #include "driver/ldc-version.h"
+#include "driver/toobj.h"
 #include "gen/functions.h"
 #include "gen/irstate.h"
 #include "gen/llvmhelpers.h"
@@ -166,6 +167,7 @@ ldc::DIFile ldc::DIBuilder::CreateFile(Loc &loc) {
     filename = IR->dmodule->srcfile->toChars();
   llvm::SmallString<128> path(filename);
   llvm::sys::fs::make_absolute(path);
+  path = opts::remapFilePath(path);
 
   return DBuilder.createFile(llvm::sys::path::filename(path),
                              llvm::sys::path::parent_path(path));
@@ -727,6 +729,17 @@ bool isOpaqueEnumType(Type *type) {
 }
 
 ldc::DIType ldc::DIBuilder::CreateTypeDescription(Type *type) {
+  const auto it = TypeDescriptionCache.find(type);
+  if (it != TypeDescriptionCache.end())
+    return it->second;
+
+  // Not inserted before, as the map may grow for nested types.
+  const auto ret = CreateUncachedTypeDescription(type);
+  TypeDescriptionCache[type].reset(ret);
+  return ret;
+}
+
+ldc::DIType ldc::DIBuilder::CreateUncachedTypeDescription(Type *type) {
   // Check for opaque enum first, Bugzilla 13792
   if (isOpaqueEnumType(type)) {
     const auto ed = static_cast<TypeEnum *>(type)->sym;
@@ -821,6 +834,7 @@ void ldc::DIBuilder::EmitCompileUnit(Module *m) {
   // prepare srcpath
   llvm::SmallString<128> srcpath(m->srcfile->name->toChars());
   llvm::sys::fs::make_absolute(srcpath);
+  srcpath = opts::remapFilePath(srcpath);
 
   // prepare producer name string
   auto producerName = std::string("LDC ") + ldc::ldc_version + " (LLVM " +
@@ -835,6 +849,14 @@ void ldc::DIBuilder::EmitCompileUnit(Module *m) {
   IR->module.addModuleFlag(llvm::Module::Warning, "Debug Info Version",
                            llvm::DEBUG_METADATA_VERSION);
 
+  // With -gsplit-dwarf, the skeleton CU refers to the .dwo of the object file.
+  std::string splitName;
+  if (opts::splitDwarf && global.params.targetTriple->isOSBinFormatELF()) {
+    splitName = getSplitDwarfFileName(
+        global.params.oneobj ? global.params.objfiles[0]
+                             : m->objfile->name->toChars());
+  }
+
   CUNode = DBuilder.createCompileUnit(
       global.params.symdebug == 2 ? llvm::dwarf::DW_LANG_C
                                   : llvm::dwarf::DW_LANG_D,
@@ -848,9 +870,15 @@ void ldc::DIBuilder::EmitCompileUnit(Module *m) {
       isOptimizationEnabled(), // isOptimized
       llvm::StringRef(),       // Flags TODO
       1,                       // Runtime Version TODO
-      llvm::StringRef(),       // SplitName
+      splitName,               // SplitName
       getDebugEmissionKind(),  // DebugEmissionKind
       0                        // DWOId
+#if LDC_LLVM_VER >= 700
+      ,
+      true,                    // SplitDebugInlining
+      false,                   // DebugInfoForProfiling
+      !splitName.empty()       // GnuPubnames (for the linker's --gdb-index)
+#endif
   );
 }
 
@@ -69,6 +69,13 @@ class DIBuilder {
 
   llvm::DenseMap<Declaration*, llvm::TypedTrackingMDRef<llvm::MDNode>> StaticDataMemberCache;
 
+  /// The type descriptions created for this compile unit (shared by all D
+  /// modules in -singleobj builds). Tracking references, as the descriptions
+  /// of aggregates may still be temporary nodes while their members are
+  /// described.
+  llvm::DenseMap<Type *, llvm::TypedTrackingMDRef<llvm::DIType>>
+      TypeDescriptionCache;
+
   DICompileUnit GetCU() {
     return CUNode;
   }
@@ -188,6 +195,7 @@ private:
   DISubroutineType CreateEmptyFunctionType();
   DIType CreateDelegateType(Type *type);
   DIType CreateTypeDescription(Type *type);
+  DIType CreateUncachedTypeDescription(Type *type);
   DICompositeType CreateCompositeTypeDescription(Type *type);
 
   bool mustEmitFullDebugInfo();
@@ -14,6 +14,7 @@
 #include "gen/llvmhelpers.h"
 #include "gen/logger.h"
 #include "gen/optimizer.h"
+#include "gen/tbaa.h"
 #include "gen/tollvm.h"
 #include "llvm/IR/MDBuilder.h"
 
@@ -46,6 +47,26 @@ LLValue *DtoLVal(DValue *v) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+DValueArena *currentArena = nullptr;
+}
+
+DValueArena::DValueArena() : outer(currentArena) { currentArena = this; }
+
+DValueArena::~DValueArena() {
+  assert(currentArena == this);
+  currentArena = outer;
+}
+
+void *DValueArena::allocate(size_t size) {
+  // The global arena, never freed.
+  static auto globalAllocator = new llvm::BumpPtrAllocator();
+  auto &allocator = currentArena ? currentArena->allocator : *globalAllocator;
+  return allocator.Allocate(size, alignof(std::max_align_t));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 DValue::DValue(Type *t, LLValue *v) : type(t), val(v) {
   assert(type);
   assert(val);
@@ -121,6 +142,7 @@ DRValue *DLValue::getRVal() {
   }
 
   LLValue *rval = DtoLoad(val);
+  addTBAAMetadata(rval, type, val);
   if (type->toBasetype()->ty == Tbool) {
     assert(rval->getType() == llvm::Type::getInt8Ty(gIR->context()));
 
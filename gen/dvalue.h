@@ -18,6 +18,8 @@
 #define LDC_GEN_DVALUE_H
 
 #include "root.h"
+#include "llvm/Support/Allocator.h"
+#include <cstddef>
 
 class Type;
 class Dsymbol;
@@ -40,6 +42,26 @@ class DSpecialRefValue;
 class DSliceValue;
 class DFuncValue;
 
+/// Owns the memory of all DValues allocated while it is the innermost arena.
+/// Arenas nest; FuncGenState has one, so the DValues of a function body are
+/// freed when its codegen is finished. Outside of any arena, DValues are
+/// allocated in a global arena which is never freed.
+///
+/// DValues are never deleted individually and must not outlive their arena.
+class DValueArena {
+  llvm::BumpPtrAllocator allocator;
+  DValueArena *const outer;
+
+public:
+  DValueArena();
+  ~DValueArena();
+
+  DValueArena(DValueArena const &) = delete;
+  DValueArena &operator=(DValueArena const &) = delete;
+
+  static void *allocate(size_t size);
+};
+
 /// Represents an immutable pair of LLVM value and associated D type.
 class DValue {
 public:
@@ -47,6 +69,9 @@ public:
 
   virtual ~DValue() = default;
 
+  static void *operator new(size_t size) { return DValueArena::allocate(size); }
+  static void operator delete(void *) {}
+
   /// Returns true iff the value can be accessed at the end of the entry basic
   /// block of the current function, in the sense that it is either not derived
   /// from an llvm::Instruction (but from a global, constant, etc.) or that
@@ -20,7 +20,9 @@
 #include "gen/llvm.h"
 #include "ir/irfunction.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/TypeBuilder.h"
+#include "llvm/Support/Compression.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
 
@@ -29,6 +31,7 @@ namespace {
 enum { ApiVersion = LDC_DYNAMIC_COMPILE_API_VERSION };
 
 const char *DynamicCompileModulesHeadName = "dynamiccompile_modules_head";
+const char *DynamicCompilePromoteName = "_d_dynamic_compile_promote";
 
 llvm::GlobalValue *getPredefinedSymbol(llvm::Module &module,
                                        llvm::StringRef name, llvm::Type *type) {
@@ -704,6 +707,44 @@ void setupModuleCtor(IRState *irs, llvm::GlobalVariable *irData,
   llvm::appendToGlobalCtors(irs->module, runtimeCompiledCtor, 0);
 }
 
+// Compressed bitcode starts with this magic, followed by the uncompressed size
+// as 32-bit little-endian integer and the zlib stream.
+// Must be in sync with jit-rt.
+const char compressedIRMagic[] = {'L', 'D', 'C', 'Z'};
+
+void compressBitcode(llvm::SmallString<1024> &bitcode) {
+  if (!llvm::zlib::isAvailable()) {
+    error(Loc(), "-dynamic-compile-compress-ir requires LLVM to be built with "
+                 "zlib");
+    fatal();
+  }
+
+  llvm::SmallVector<char, 0> compressed;
+#if LDC_LLVM_VER >= 500
+  if (auto err = llvm::zlib::compress(bitcode, compressed,
+                                      llvm::zlib::BestSizeCompression)) {
+    error(Loc(), "cannot compress dynamic compile bitcode: %s",
+          llvm::toString(std::move(err)).c_str());
+    fatal();
+  }
+#else
+  if (llvm::zlib::compress(bitcode, compressed,
+                           llvm::zlib::BestSizeCompression) !=
+      llvm::zlib::StatusOK) {
+    error(Loc(), "cannot compress dynamic compile bitcode");
+    fatal();
+  }
+#endif
+
+  const auto size = static_cast<uint32_t>(bitcode.size());
+  bitcode.clear();
+  bitcode.append(std::begin(compressedIRMagic), std::end(compressedIRMagic));
+  for (unsigned i = 0; i < 4; ++i) {
+    bitcode.push_back(static_cast<char>((size >> (8 * i)) & 0xFF));
+  }
+  bitcode.append(compressed.begin(), compressed.end());
+}
+
 void setupModuleBitcodeData(const llvm::Module &srcModule, IRState *irs,
                             const GlobalValsMap &globalVals) {
   assert(nullptr != irs);
@@ -715,6 +756,9 @@ void setupModuleBitcodeData(const llvm::Module &srcModule, IRState *irs,
 #else
   llvm::WriteBitcodeToFile(&srcModule, os);
 #endif
+  if (opts::dynamicCompileCompressIR) {
+    compressBitcode(str);
+  }
 
   auto runtimeCompiledIr = new llvm::GlobalVariable(
       irs->module, llvm::Type::getInt8PtrTy(irs->context()), true,
@@ -748,8 +792,43 @@ llvm::Function *duplicateFunc(llvm::Module &module, const llvm::Function *src) {
   return ret;
 }
 
-void createThunkFunc(llvm::Module &module, const llvm::Function *src,
-                     llvm::Function *dst, llvm::GlobalVariable *thunkVar) {
+// With -dynamic-compile-tiered, the thunk initially calls the ahead-of-time
+// compiled function and counts the calls, the n-th call starts compiling all
+// dynamic code in the background.
+void countThunkCalls(llvm::IRBuilder<> &builder, llvm::Module &module,
+                     llvm::Function *src, llvm::Function *dst,
+                     llvm::Value *thunkPtr, llvm::GlobalVariable *counterVar) {
+  auto &context = module.getContext();
+  auto countBB = llvm::BasicBlock::Create(context, "count", dst);
+  auto promoteBB = llvm::BasicBlock::Create(context, "promote", dst);
+  auto callBB = llvm::BasicBlock::Create(context, "call", dst);
+  llvm::MDBuilder mdBuilder(context);
+
+  auto isAot = builder.CreateICmpEQ(thunkPtr, src);
+  builder.CreateCondBr(isAot, countBB, callBB);
+
+  builder.SetInsertPoint(countBB);
+  auto count = builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, counterVar,
+                                       builder.getInt32(1),
+                                       llvm::AtomicOrdering::Monotonic);
+  auto isHot = builder.CreateICmpEQ(
+      count, builder.getInt32(opts::dynamicCompileTiered - 1));
+  builder.CreateCondBr(isHot, promoteBB, callBB,
+                       mdBuilder.createBranchWeights(1, 1000));
+
+  builder.SetInsertPoint(promoteBB);
+  auto promoteFunc = llvm::cast<llvm::Function>(getPredefinedSymbol(
+      module, DynamicCompilePromoteName,
+      llvm::FunctionType::get(llvm::Type::getVoidTy(context), false)));
+  builder.CreateCall(promoteFunc);
+  builder.CreateBr(callBB);
+
+  builder.SetInsertPoint(callBB);
+}
+
+void createThunkFunc(llvm::Module &module, llvm::Function *src,
+                     llvm::Function *dst, llvm::GlobalVariable *thunkVar,
+                     llvm::GlobalVariable *counterVar) {
   assert(nullptr != src);
   assert(nullptr != dst);
   assert(nullptr != thunkVar);
@@ -757,7 +836,13 @@ void createThunkFunc(llvm::Module &module, const llvm::Function *src,
   auto bb = llvm::BasicBlock::Create(module.getContext(), "", dst);
   llvm::IRBuilder<> builder(module.getContext());
   builder.SetInsertPoint(bb);
+  // The jit runtime may publish new code from a background thread.
   auto thunkPtr = builder.CreateLoad(thunkVar);
+  thunkPtr->setAtomic(llvm::AtomicOrdering::Acquire);
+  thunkPtr->setAlignment(module.getDataLayout().getPointerABIAlignment(0));
+  if (nullptr != counterVar) {
+    countThunkCalls(builder, module, src, dst, thunkPtr, counterVar);
+  }
   llvm::SmallVector<llvm::Value *, 6> args;
   for (auto &arg : dst->args()) {
     args.push_back(&arg);
@@ -836,12 +921,24 @@ void defineDynamicCompiledFunction(IRState *irs, IrFunction *func) {
     auto it = irs->dynamicCompiledFunctions.find(srcFunc);
     assert(irs->dynamicCompiledFunctions.end() != it);
     auto thunkVarType = srcFunc->getFunctionType()->getPointerTo();
+    const bool tiered = opts::dynamicCompileTiered != 0;
+    llvm::Constant *thunkInit = srcFunc;
+    if (!tiered) {
+      thunkInit = llvm::ConstantPointerNull::get(thunkVarType);
+    }
     auto thunkVar = new llvm::GlobalVariable(
         irs->module, thunkVarType, false, llvm::GlobalValue::PrivateLinkage,
-        llvm::ConstantPointerNull::get(thunkVarType),
-        ".rtcompile_thunkvar_" + srcFunc->getName());
+        thunkInit, ".rtcompile_thunkvar_" + srcFunc->getName());
+    llvm::GlobalVariable *counterVar = nullptr;
+    if (tiered) {
+      auto counterType = llvm::Type::getInt32Ty(irs->context());
+      counterVar = new llvm::GlobalVariable(
+          irs->module, counterType, false, llvm::GlobalValue::PrivateLinkage,
+          llvm::ConstantInt::get(counterType, 0),
+          ".rtcompile_counter_" + srcFunc->getName());
+    }
     auto dstFunc = it->second.thunkFunc;
-    createThunkFunc(irs->module, srcFunc, dstFunc, thunkVar);
+    createThunkFunc(irs->module, srcFunc, dstFunc, thunkVar, counterVar);
     it->second.thunkVar = thunkVar;
   }
 }
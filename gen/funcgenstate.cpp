@@ -9,6 +9,7 @@
 
 #include "gen/funcgenstate.h"
 
+#include "driver/gcallocreport.h"
 #include "gen/llvm.h"
 #include "gen/llvmhelpers.h"
 #include "gen/ms-cxx-helper.h"
@@ -101,3 +102,12 @@ llvm::BasicBlock *SwitchCaseTargets::getOrCreate(Statement *stmt,
 FuncGenState::FuncGenState(IrFunction &irFunc, IRState &irs)
     : irFunc(irFunc), scopes(irs), jumpTargets(scopes), switchTargets(),
       irs(irs) {}
+
+void FuncGenState::tagGCAllocation(llvm::Instruction *call,
+                                   llvm::Function *callee) {
+  if (!gcallocreport::isEnabled())
+    return;
+  const int64_t count =
+      pgo.haveRegionCounts() ? pgo.getCurrentRegionCount() : -1;
+  gcallocreport::tagCall(*call, *callee, count);
+}
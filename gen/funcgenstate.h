@@ -15,22 +15,26 @@
 #ifndef LDC_GEN_FUNCGENSTATE_H
 #define LDC_GEN_FUNCGENSTATE_H
 
+#include "gen/dvalue.h"
 #include "gen/irstate.h"
 #include "gen/pgo_ASTbased.h"
 #include "gen/trycatchfinally.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/CallSite.h"
 #include <vector>
 
 class Identifier;
 struct IRState;
 class Statement;
+class VarDeclaration;
 
 namespace llvm {
 class AllocaInst;
 class BasicBlock;
 class Constant;
 class MDNode;
+class PHINode;
 class Value;
 }
 
@@ -173,6 +177,9 @@ public:
   FuncGenState(FuncGenState const &) = delete;
   FuncGenState &operator=(FuncGenState const &) = delete;
 
+  // Frees the DValues of the function body when the state is destroyed.
+  DValueArena dvalueArena;
+
   // The function code is being generated for.
   IrFunction &irFunc;
 
@@ -199,6 +206,39 @@ public:
   /// value.
   llvm::AllocaInst *retValSlot = nullptr;
 
+  /// The stack slots of the local variables whose lifetimes have been started
+  /// by DtoVarDeclaration(), in declaration order. The lifetimes are ended at
+  /// the end of the innermost enclosing scope statement, see
+  /// DtoEndScopedLifetimes().
+  std::vector<llvm::AllocaInst *> scopedLocals;
+
+  /// Locals with disjoint lifetimes which are allocated in the sret slot in
+  /// addition to the frontend's NRVO variable, see findSretLocals().
+  llvm::SmallPtrSet<VarDeclaration *, 4> sretLocals;
+
+  /// The cached capacity of local slices which single elements are appended
+  /// to (-inline-append), see DtoCatAssignElement().
+  llvm::DenseMap<VarDeclaration *, llvm::AllocaInst *> appendCaches;
+
+  /// Pointers to array elements which are known to be valid, i.e., bounds
+  /// checked in @safe code. Loads and stores through them aren't instrumented
+  /// by AddressSanitizer (-fsanitize-address-skip-bounds-checked).
+  llvm::SmallPtrSet<llvm::Value *, 16> validElementPointers;
+
+  /// Pointers to (parts of) overlapping fields, whose accesses aren't tagged
+  /// with type-based alias analysis metadata (-fstrict-aliasing).
+  llvm::SmallPtrSet<llvm::Value *, 8> tbaaUnionPointers;
+
+  /// A block calling the array bounds error function, shared by all bounds
+  /// checks with the same landing pad (null for plain calls). The file and line
+  /// are passed as phis, see DtoBoundsCheckBranch().
+  struct BoundsCheckFailure {
+    llvm::BasicBlock *block;
+    llvm::PHINode *file;
+    llvm::PHINode *line;
+  };
+  llvm::DenseMap<llvm::BasicBlock *, BoundsCheckFailure> boundsCheckFailures;
+
   /// Emits a call or invoke to the given callee, depending on whether there
   /// are catches/cleanups active or not.
   template <typename T>
@@ -207,6 +247,9 @@ public:
 
 private:
   IRState &irs;
+
+  /// Tags GC-allocating druntime calls for -gc-alloc-report.
+  void tagGCAllocation(llvm::Instruction *call, llvm::Function *callee);
 };
 
 template <typename T>
@@ -233,6 +276,7 @@ llvm::CallSite FuncGenState::callOrInvoke(llvm::Value *callee, const T &args,
     llvm::CallInst *call = irs.ir->CreateCall(callee, args, BundleList, name);
     if (calleeFn) {
       call->setAttributes(calleeFn->getAttributes());
+      tagGCAllocation(call, calleeFn);
     }
     return call;
   }
@@ -244,6 +288,7 @@ llvm::CallSite FuncGenState::callOrInvoke(llvm::Value *callee, const T &args,
       callee, postinvoke, landingPad, args, BundleList, name);
   if (calleeFn) {
     invoke->setAttributes(calleeFn->getAttributes());
+    tagGCAllocation(invoke, calleeFn);
   }
 
   irs.scope() = IRScope(postinvoke);
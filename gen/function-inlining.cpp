@@ -10,61 +10,163 @@
 #include "gen/function-inlining.h"
 
 #include "declaration.h"
+#include "errors.h"
 #include "globals.h"
 #include "id.h"
 #include "module.h"
+#include "mtype.h"
 #include "statement.h"
 #include "template.h"
+#include "gen/functions.h"
 #include "gen/logger.h"
 #include "gen/optimizer.h"
 #include "gen/recursivevisitor.h"
 #include "gen/uda.h"
+#include "llvm/Support/CommandLine.h"
+#include <cstdio>
 
 namespace {
 
-/// An ASTVisitor that checks whether the number of statements is larger than a
-/// certain number.
-struct MoreThanXStatements : public StoppableVisitor {
-  /// Are there more or fewer statements than `threshold`?.
-  unsigned threshold;
-  /// The statement count.
-  unsigned count;
+llvm::cl::opt<unsigned> inlineCostThreshold(
+    "cross-module-inlining-threshold", llvm::cl::ZeroOrMore, llvm::cl::Hidden,
+    llvm::cl::init(20),
+    llvm::cl::desc("Maximum estimated cost of a function to be made available "
+                   "for cross-module inlining (halved with -Os/-Oz)"));
+
+llvm::cl::opt<unsigned> inlineCallCost(
+    "cross-module-inlining-call-cost", llvm::cl::ZeroOrMore, llvm::cl::Hidden,
+    llvm::cl::init(3),
+    llvm::cl::desc("Cross-module inlining cost of a call or allocation"));
+
+llvm::cl::opt<unsigned> inlineLoopMultiplier(
+    "cross-module-inlining-loop-multiplier", llvm::cl::ZeroOrMore,
+    llvm::cl::Hidden, llvm::cl::init(3),
+    llvm::cl::desc("Cross-module inlining cost multiplier for loop bodies"));
+
+llvm::cl::opt<unsigned> inlineTemplateDepthCost(
+    "cross-module-inlining-template-depth-cost", llvm::cl::ZeroOrMore,
+    llvm::cl::Hidden, llvm::cl::init(2),
+    llvm::cl::desc("Cross-module inlining cost per nesting level of template "
+                   "instances"));
+
+llvm::cl::opt<unsigned> inlineLazyMultiplier(
+    "cross-module-inlining-lazy-multiplier", llvm::cl::ZeroOrMore,
+    llvm::cl::Hidden, llvm::cl::init(2),
+    llvm::cl::desc("Cross-module inlining threshold multiplier for functions "
+                   "with lazy parameters"));
+
+llvm::cl::opt<bool> inlineReport(
+    "cross-module-inlining-report", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Report the cross-module inlining candidate decisions"));
+
+/// An ASTVisitor that estimates the cost of inlining a function body: each
+/// statement costs 1 and each call or allocation `inlineCallCost` (an
+/// unresolved call may well be an inexpensive operator or property though),
+/// all weighted by `inlineLoopMultiplier` per enclosing loop.
+/// Stops as soon as the cost exceeds `threshold`.
+struct InlineCostEstimator : public StoppableVisitor {
+  const unsigned threshold;
+  const unsigned weight;
+  unsigned cost = 0;
+
+  InlineCostEstimator(unsigned threshold, unsigned weight)
+      : threshold(threshold), weight(weight) {}
+
+  bool exceeded() const { return cost > threshold; }
+
+  void add(unsigned c) {
+    cost += c * weight;
+    // Skip the rest once exceeded.
+    if (exceeded())
+      stop = true;
+  }
 
-  explicit MoreThanXStatements(unsigned X) : threshold(X), count(0) {}
+  /// Adds the weighted cost of a loop body; skips the children of the loop.
+  void addLoop(Statement *body) {
+    add(1);
+    if (body && !exceeded()) {
+      InlineCostEstimator nested(threshold - cost,
+                                 weight * inlineLoopMultiplier);
+      RecursiveWalker walker(&nested);
+      body->accept(&walker);
+      cost += nested.cost;
+    }
+    stop = true;
+  }
 
   using StoppableVisitor::visit;
 
-  void visit(Statement *stmt) override {
-    count++;
-    if (count > threshold)
-      stop = true;
-  }
-  void visit(Expression *exp) override {}
-  void visit(Declaration *decl) override {}
-  void visit(Initializer *init) override {}
-  void visit(Dsymbol *) override {}
+  void visit(Statement *) override { add(1); }
+  void visit(WhileStatement *stmt) override { addLoop(stmt->_body); }
+  void visit(DoStatement *stmt) override { addLoop(stmt->_body); }
+  void visit(ForStatement *stmt) override { addLoop(stmt->_body); }
+  void visit(ForeachStatement *stmt) override { addLoop(stmt->_body); }
+  void visit(ForeachRangeStatement *stmt) override { addLoop(stmt->_body); }
+
+  void visit(Expression *) override { stop = exceeded(); }
+  void visit(CallExp *) override { add(inlineCallCost); }
+  void visit(NewExp *) override { add(inlineCallCost); }
+  void visit(NewAnonClassExp *) override { add(inlineCallCost); }
+
+  void visit(Declaration *) override { stop = exceeded(); }
+  void visit(Initializer *) override { stop = exceeded(); }
+  void visit(Dsymbol *) override { stop = exceeded(); }
 };
 
-// Use a heuristic to determine if it could make sense to inline this fdecl.
+/// Returns the number of template instances the function is nested in.
+unsigned getTemplateInstanceDepth(FuncDeclaration &fdecl) {
+  unsigned depth = 0;
+  for (Dsymbol *s = fdecl.toParent(); s; s = s->toParent()) {
+    if (s->isTemplateInstance())
+      ++depth;
+  }
+  return depth;
+}
+
+void reportDecision(FuncDeclaration &fdecl, bool candidate, const char *why) {
+  if (inlineReport) {
+    message(fdecl.loc, "cross-module inlining %s `%s`: %s",
+            candidate ? "candidate" : "rejected", fdecl.toPrettyChars(), why);
+  }
+}
+
+// Use a cost model to determine if it could make sense to inline this fdecl.
+// In the end, LLVM will make the decision whether to _actually_ inline; this
+// keeps the compile time bounded by not analyzing and emitting functions LLVM
+// would never inline.
 // Note: isInlineCandidate is called _before_ semantic3 analysis of fdecl.
 bool isInlineCandidate(FuncDeclaration &fdecl) {
-  // Giving maximum inlining potential to LLVM should be possible, but we
-  // restrict it to save some compile time.
-  // return true;
-
-  // TODO: make the heuristic more sophisticated?
-  // In the end, LLVM will make the decision whether to _actually_ inline.
-  // The statement count threshold is completely arbitrary. Also, all
-  // statements are weighed the same.
-
-  unsigned statementThreshold = 10;
-  MoreThanXStatements statementCounter(statementThreshold);
-  RecursiveWalker walker(&statementCounter, false);
-  fdecl.fbody->accept(&walker);
-
-  IF_LOG Logger::println("Contains %u statements or more (threshold = %u).",
-                         statementCounter.count, statementThreshold);
-  return statementCounter.count <= statementThreshold;
+  // LLVM doesn't inline functions using va_start.
+  if (fdecl.type && fdecl.type->ty == Tfunction &&
+      static_cast<TypeFunction *>(fdecl.type)->varargs == 1) {
+    reportDecision(fdecl, false, "variadic");
+    return false;
+  }
+
+  unsigned threshold = inlineCostThreshold;
+  if (isOptimizingForSize())
+    threshold /= 2;
+  // Inlining folds in the delegate literals of lazy arguments.
+  if (fdecl.type && fdecl.type->ty == Tfunction &&
+      hasLazyParameters(static_cast<TypeFunction *>(fdecl.type)))
+    threshold *= inlineLazyMultiplier;
+
+  InlineCostEstimator estimator(threshold, 1);
+  estimator.add(getTemplateInstanceDepth(fdecl) * inlineTemplateDepthCost);
+  if (!estimator.exceeded()) {
+    RecursiveWalker walker(&estimator);
+    fdecl.fbody->accept(&walker);
+  }
+
+  IF_LOG Logger::println("Estimated cost: %u%s (threshold = %u).",
+                         estimator.cost, estimator.exceeded() ? " or more" : "",
+                         threshold);
+
+  char why[64];
+  snprintf(why, sizeof(why), "cost %u%s, threshold %u", estimator.cost,
+           estimator.exceeded() ? "+" : "", threshold);
+  reportDecision(fdecl, !estimator.exceeded(), why);
+  return !estimator.exceeded();
 }
 
 } // end anonymous namespace
@@ -167,7 +269,9 @@ bool defineAsExternallyAvailable(FuncDeclaration &fdecl) {
     return false;
   }
 
-  if (fdecl.inlining != PINLINEalways && !isInlineCandidate(fdecl))
+  if (fdecl.inlining == PINLINEalways)
+    reportDecision(fdecl, true, "pragma(inline, true)");
+  else if (!isInlineCandidate(fdecl))
     return false;
 
   IF_LOG Logger::println("Potential inlining candidate");
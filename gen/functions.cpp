@@ -21,6 +21,7 @@
 #include "driver/cl_options.h"
 #include "driver/cl_options_instrumentation.h"
 #include "driver/cl_options_sanitizers.h"
+#include "driver/optimizationsummary.h"
 #include "gen/abi.h"
 #include "gen/arrays.h"
 #include "gen/classes.h"
@@ -36,26 +37,41 @@
 #include "gen/logger.h"
 #include "gen/mangling.h"
 #include "gen/nested.h"
+#include "gen/nrvo.h"
 #include "gen/optimizer.h"
 #include "gen/pgo_ASTbased.h"
 #include "gen/pragma.h"
 #include "gen/runtime.h"
 #include "gen/dynamiccompile.h"
 #include "gen/scope_exit.h"
+#include "gen/targetclones.h"
 #include "gen/tollvm.h"
 #include "gen/uda.h"
 #include "ir/irfunction.h"
 #include "ir/irmodule.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
+#include <algorithm>
 #include <iostream>
 
 static bool isMainFunction(FuncDeclaration *fd) {
   return fd->isMain() || (global.params.betterC && fd->isCMain());
 }
 
+bool hasLazyParameters(TypeFunction *f) {
+  for (size_t i = 0, n = Parameter::dim(f->parameters); i < n; ++i) {
+    if (Parameter::getNth(f->parameters, i)->storageClass & STClazy)
+      return true;
+  }
+  return false;
+}
+
 llvm::FunctionType *DtoFunctionType(Type *type, IrFuncTy &irFty, Type *thistype,
                                     Type *nesttype, FuncDeclaration *fd) {
   IF_LOG Logger::println("DtoFunctionType(%s)", type->toChars());
@@ -115,8 +131,11 @@ llvm::FunctionType *DtoFunctionType(Type *type, IrFuncTy &irFty, Type *thistype,
     if (fd && fd->isCtorDeclaration()) {
       attrs.add(LLAttribute::Returned);
     }
-    newIrFty.arg_this =
-        new IrFuncTyArg(thistype, thistype->toBasetype()->ty == Tstruct, attrs);
+    const bool isStructThis = thistype->toBasetype()->ty == Tstruct;
+    if (isStructThis) {
+      attrs.addDereferenceable(thistype->size());
+    }
+    newIrFty.arg_this = new IrFuncTyArg(thistype, isStructThis, attrs);
     ++nextLLArgIdx;
   } else if (nesttype) {
     // Add the context pointer for nested functions
@@ -165,6 +184,7 @@ llvm::FunctionType *DtoFunctionType(Type *type, IrFuncTy &irFty, Type *thistype,
     // Whether the parameter is passed by LLVM value or as a pointer to the
     // alloca/….
     bool passPointer = arg->storageClass & (STCref | STCout);
+    const bool isRestrict = hasRestrictUDA(arg);
 
     Type *loweredDType = arg->type;
     AttrBuilder attrs;
@@ -177,6 +197,9 @@ llvm::FunctionType *DtoFunctionType(Type *type, IrFuncTy &irFty, Type *thistype,
     } else if (passPointer) {
       // ref/out
       attrs.addDereferenceable(loweredDType->size());
+      if (loweredDType->isImmutable()) {
+        attrs.add(LLAttribute::NoAlias).add(LLAttribute::ReadOnly);
+      }
     } else {
       if (abi->passByVal(f, loweredDType)) {
         // LLVM ByVal parameters are pointers to a copy in the function
@@ -187,11 +210,32 @@ llvm::FunctionType *DtoFunctionType(Type *type, IrFuncTy &irFty, Type *thistype,
       } else {
         // Add sext/zext as needed.
         attrs.add(DtoShouldExtend(loweredDType));
+
+        // With -dip1000, a `scope` pointer or class reference (but not a
+        // `return scope` one) of a @safe/@trusted function doesn't escape the
+        // call; @system code isn't checked. This lets the
+        // GarbageCollect2Stack pass promote GC allocations passed to it.
+        const auto ty = loweredDType->toBasetype()->ty;
+        if (global.params.vsafe && f->trust >= TRUSTtrusted &&
+            (ty == Tpointer || ty == Tclass) &&
+            (arg->storageClass & (STCscope | STCreturn)) == STCscope) {
+          attrs.add(LLAttribute::NoCapture);
+        }
+
+        // Immutable data isn't modified by anyone during the call, so a
+        // pointer to it can't alias any modified memory.
+        if (ty == Tpointer && loweredDType->nextOf()->isImmutable()) {
+          attrs.add(LLAttribute::NoAlias).add(LLAttribute::ReadOnly);
+        } else if (ty == Tpointer && isRestrict) {
+          attrs.add(LLAttribute::NoAlias);
+        }
       }
     }
 
     newIrFty.args.push_back(new IrFuncTyArg(loweredDType, passPointer, attrs));
     newIrFty.args.back()->parametersIdx = i;
+    newIrFty.args.back()->restrictSlice =
+        isRestrict && loweredDType->toBasetype()->ty == Tarray;
     ++nextLLArgIdx;
   }
 
@@ -481,6 +525,40 @@ void applyXRayAttributes(FuncDeclaration &fdecl, llvm::Function &func) {
   }
 }
 
+
+/// Maps the D attributes pure and nothrow to LLVM memory and unwind
+/// attributes, which LLVM can't infer for functions defined in other modules.
+void applyPurityAndNothrowAttributes(FuncDeclaration &fdecl, TypeFunction &f,
+                                     const IrFuncTy &irFty,
+                                     llvm::Function &func) {
+  // Errors may still be thrown by nothrow functions, so make sure they can be
+  // unwound through.
+  if (f.isnothrow && gABI->needsUnwindTables()) {
+    func.addFnAttr(LLAttribute::NoUnwind);
+  }
+
+  // debug statements are allowed to be impure
+  if (global.params.debuglevel || global.params.debugids || fdecl.naked)
+    return;
+
+  // The purity of non-D functions isn't checked by the compiler.
+  if (f.linkage != LINKd)
+    return;
+
+  const PURE purity = fdecl.isPure();
+  if (purity < PUREconst || irFty.arg_nest || f.varargs == 1)
+    return;
+
+  // A strongly or const pure function may allocate GC memory, so its calls
+  // can only be merged if it doesn't return (or write) any references.
+  // Pure functions may read immutable globals, which may be initialized by a
+  // module constructor, so neither readnone nor argmemonly are safe.
+  const bool returnsValue = !f.isref && !irFty.arg_sret && f.next &&
+                            !f.next->toBasetype()->hasPointers();
+  if (returnsValue) {
+    func.addFnAttr(LLAttribute::ReadOnly);
+  }
+}
 } // anonymous namespace
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -583,6 +661,8 @@ void DtoDeclareFunction(FuncDeclaration *fdecl) {
     if (global.params.disableRedZone) {
       func->addFnAttr(LLAttribute::NoRedZone);
     }
+    applyPurityAndNothrowAttributes(*fdecl, *f, getIrFunc(fdecl)->irFty,
+                                    *func);
   }
 
   // First apply the TargetMachine attributes, such that they can be overridden
@@ -617,6 +697,20 @@ void DtoDeclareFunction(FuncDeclaration *fdecl) {
       irFunc->setAlwaysInline();
     } else if (fdecl->inlining == PINLINEnever) {
       irFunc->setNeverInline();
+    } else if (hasLazyParameters(f)) {
+      // Inlining a function with lazy parameters allows LLVM to fold in the
+      // delegate literals of the arguments, e.g., to turn `if (cond) arg()`
+      // into a plain branch.
+      func->addFnAttr(llvm::Attribute::InlineHint);
+    } else if (fdecl->fes) {
+      // The body of a foreach over an opApply is only called through the
+      // delegate parameter of opApply. Once opApply has been inlined or
+      // specialized for the body (see SpecializeFunctions), the call is direct
+      // and the body is to be inlined into the loop, leaving no per-iteration
+      // indirect call and allowing the frame to be promoted to the stack.
+      func->addFnAttr(llvm::Attribute::AlwaysInline);
+    } else if (fdecl->ident == Id::apply || fdecl->ident == Id::applyReverse) {
+      func->addFnAttr(llvm::Attribute::InlineHint);
     }
   }
 
@@ -845,6 +939,224 @@ bool eraseDummyAfterReturnBB(llvm::BasicBlock *bb) {
   return false;
 }
 
+// Checks whether the function is an instance of druntime's
+// core.internal.arrayop.arrayOp, which implements the array operations like
+// `a[] = b[] * c[]` the frontend lowers to `_arrayOp` calls.
+bool isArrayOpInstance(FuncDeclaration *fd) {
+  TemplateInstance *ti =
+      fd->parent ? fd->parent->isTemplateInstance() : nullptr;
+  if (!ti || !ti->tempdecl || !ti->tempdecl->ident ||
+      strcmp(ti->tempdecl->ident->toChars(), "arrayOp") != 0) {
+    return false;
+  }
+  Module *m = ti->tempdecl->getModule();
+  return m && strcmp(m->toPrettyChars(), "core.internal.arrayop") == 0;
+}
+
+// The slices of an array operation must not overlap (except for being
+// identical, which doesn't create any loop-carried dependencies), so the
+// innermost loops of an arrayOp instance are parallel wrt. all non-stack
+// memory accesses. Marks them as such and explicitly enables vectorization,
+// freeing the loop vectorizer from emitting runtime overlap checks and
+// scalar fallbacks.
+void addArrayOpLoopMetadata(llvm::Function *func) {
+  llvm::DominatorTree domTree(*func);
+  llvm::LoopInfo loopInfo(domTree);
+  llvm::LLVMContext &ctx = func->getContext();
+
+  llvm::SmallVector<llvm::Loop *, 4> worklist(loopInfo.begin(),
+                                              loopInfo.end());
+  while (!worklist.empty()) {
+    llvm::Loop *loop = worklist.pop_back_val();
+    if (!loop->empty()) {
+      worklist.append(loop->begin(), loop->end());
+      continue;
+    }
+
+    llvm::Metadata *vectorizeEnable[] = {
+        llvm::MDString::get(ctx, "llvm.loop.vectorize.enable"),
+        llvm::ConstantAsMetadata::get(llvm::ConstantInt::getTrue(ctx))};
+    llvm::Metadata *ops[] = {nullptr, llvm::MDNode::get(ctx, vectorizeEnable)};
+    llvm::MDNode *loopID = llvm::MDNode::getDistinct(ctx, ops);
+    loopID->replaceOperandWith(0, loopID);
+    loop->setLoopID(loopID);
+
+    for (llvm::BasicBlock *bb : loop->blocks()) {
+      for (llvm::Instruction &inst : *bb) {
+        LLValue *ptr = nullptr;
+        if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+          ptr = load->getPointerOperand();
+        } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+          ptr = store->getPointerOperand();
+        } else {
+          continue;
+        }
+        // loop counters etc. before mem2reg
+        if (llvm::isa<llvm::AllocaInst>(
+                llvm::GetUnderlyingObject(ptr, *gDataLayout))) {
+          continue;
+        }
+        inst.setMetadata("llvm.mem.parallel_loop_access", loopID);
+      }
+    }
+  }
+}
+
+// Optimizes a function marked @optStrategy("hot") more aggressively than
+// the rest of the module (e.g., with -Os): its innermost loops are
+// explicitly enabled for vectorization and unrolling, which raises the
+// unrolling thresholds to the pragma ones, and its direct callees get an
+// inline hint.
+void addHotFunctionHints(llvm::Function *func) {
+  llvm::DominatorTree domTree(*func);
+  llvm::LoopInfo loopInfo(domTree);
+  llvm::LLVMContext &ctx = func->getContext();
+
+  llvm::SmallVector<llvm::Loop *, 4> worklist(loopInfo.begin(),
+                                              loopInfo.end());
+  while (!worklist.empty()) {
+    llvm::Loop *loop = worklist.pop_back_val();
+    if (!loop->empty()) {
+      worklist.append(loop->begin(), loop->end());
+      continue;
+    }
+    // keep explicit loop metadata
+    if (loop->getLoopID()) {
+      continue;
+    }
+
+    llvm::Metadata *vectorizeEnable[] = {
+        llvm::MDString::get(ctx, "llvm.loop.vectorize.enable"),
+        llvm::ConstantAsMetadata::get(llvm::ConstantInt::getTrue(ctx))};
+    llvm::Metadata *unrollEnable =
+        llvm::MDString::get(ctx, "llvm.loop.unroll.enable");
+    llvm::Metadata *ops[] = {nullptr, llvm::MDNode::get(ctx, vectorizeEnable),
+                             llvm::MDNode::get(ctx, unrollEnable)};
+    llvm::MDNode *loopID = llvm::MDNode::getDistinct(ctx, ops);
+    loopID->replaceOperandWith(0, loopID);
+    loop->setLoopID(loopID);
+  }
+
+  for (llvm::BasicBlock &bb : *func) {
+    for (llvm::Instruction &inst : bb) {
+      llvm::CallSite call(&inst);
+      if (!call) {
+        continue;
+      }
+      llvm::Function *callee = call.getCalledFunction();
+      if (callee && callee != func && !callee->isIntrinsic() &&
+          !callee->hasFnAttribute(llvm::Attribute::NoInline) &&
+          !callee->hasFnAttribute(llvm::Attribute::Cold)) {
+        callee->addFnAttr(llvm::Attribute::InlineHint);
+      }
+    }
+  }
+}
+
+// A @restrict slice is passed as aggregate, but noalias is only valid for
+// pointer parameters. So the body is moved to an internal always-inline
+// implementation which additionally takes the slice pointers as noalias
+// parameters; the inliner preserves that as scoped alias metadata when
+// inlining it into the original function, which forwards to it.
+void emitRestrictSliceImpl(IrFunction *irFunc) {
+  llvm::Function *func = irFunc->getLLVMFunc();
+  if (func->isVarArg() || func->hasFnAttribute(llvm::Attribute::Naked) ||
+      func->hasFnAttribute(llvm::Attribute::OptimizeNone)) {
+    return;
+  }
+
+  const IrFuncTy &irFty = irFunc->irFty;
+  const size_t numExplicitArgs = irFty.args.size();
+  const size_t firstExplicitArg = func->arg_size() - numExplicitArgs;
+  llvm::SmallVector<unsigned, 4> sliceArgs;
+  for (size_t k = 0; k < numExplicitArgs; ++k) {
+    const IrFuncTyArg *arg = irFty.args[k];
+    if (!arg->restrictSlice || arg->rewrite || arg->byref) {
+      continue;
+    }
+    auto st = llvm::dyn_cast<llvm::StructType>(arg->ltype);
+    if (!st || st->getNumElements() != 2 ||
+        !st->getElementType(1)->isPointerTy()) {
+      continue;
+    }
+    const size_t llIdx = irFty.reverseParams ? numExplicitArgs - k - 1 : k;
+    sliceArgs.push_back(firstExplicitArg + llIdx);
+  }
+  if (sliceArgs.empty()) {
+    return;
+  }
+
+  IF_LOG Logger::println("Moving body to implementation with %u noalias "
+                         "slice pointers",
+                         static_cast<unsigned>(sliceArgs.size()));
+
+  llvm::FunctionType *fnType = func->getFunctionType();
+  llvm::SmallVector<llvm::Type *, 8> paramTypes(fnType->param_begin(),
+                                                fnType->param_end());
+  for (unsigned i : sliceArgs) {
+    paramTypes.push_back(
+        llvm::cast<llvm::StructType>(fnType->getParamType(i))
+            ->getElementType(1));
+  }
+  auto impl = llvm::Function::Create(
+      llvm::FunctionType::get(fnType->getReturnType(), paramTypes, false),
+      llvm::GlobalValue::InternalLinkage, func->getName() + ".restrict",
+      func->getParent());
+  impl->copyAttributesFrom(func);
+  impl->setLinkage(llvm::GlobalValue::InternalLinkage);
+  impl->setVisibility(llvm::GlobalValue::DefaultVisibility);
+  impl->setDLLStorageClass(llvm::GlobalValue::DefaultStorageClass);
+  impl->setComdat(nullptr);
+  impl->removeFnAttr(llvm::Attribute::NoInline);
+  impl->addFnAttr(llvm::Attribute::AlwaysInline);
+  for (size_t j = 0; j < sliceArgs.size(); ++j) {
+    impl->addAttribute(AttrSet::FirstArgIndex + func->arg_size() + j,
+                       LLAttribute::NoAlias);
+  }
+
+  impl->getBasicBlockList().splice(impl->begin(), func->getBasicBlockList());
+  if (llvm::DISubprogram *sp = func->getSubprogram()) {
+    impl->setSubprogram(sp);
+    func->setSubprogram(nullptr);
+  }
+
+  // Rebuild the slices from the lengths and the noalias pointers.
+  llvm::IRBuilder<> b(&impl->getEntryBlock(), impl->getEntryBlock().begin());
+  auto implArg = impl->arg_begin();
+  for (auto arg = func->arg_begin(); arg != func->arg_end(); ++arg, ++implArg) {
+    implArg->takeName(&*arg);
+    llvm::Value *replacement = &*implArg;
+    auto it = std::find(sliceArgs.begin(), sliceArgs.end(), arg->getArgNo());
+    if (it != sliceArgs.end()) {
+      llvm::Value *ptr = &*std::next(
+          impl->arg_begin(), func->arg_size() + (it - sliceArgs.begin()));
+      ptr->setName(implArg->getName() + ".ptr");
+      replacement = b.CreateInsertValue(&*implArg, ptr, 1);
+    }
+    arg->replaceAllUsesWith(replacement);
+  }
+
+  // The original function forwards to the implementation.
+  b.SetInsertPoint(llvm::BasicBlock::Create(func->getContext(), "", func));
+  llvm::SmallVector<llvm::Value *, 8> args;
+  for (auto &arg : func->args()) {
+    args.push_back(&arg);
+  }
+  for (unsigned i : sliceArgs) {
+    llvm::Value *slice = &*std::next(func->arg_begin(), i);
+    args.push_back(b.CreateExtractValue(slice, 1));
+  }
+  llvm::CallInst *call = b.CreateCall(impl, args);
+  call->setCallingConv(impl->getCallingConv());
+  call->setAttributes(impl->getAttributes());
+  call->setTailCall();
+  if (fnType->getReturnType()->isVoidTy()) {
+    b.CreateRetVoid();
+  } else {
+    b.CreateRet(call);
+  }
+}
+
 } // anonymous namespace
 
 void DtoDefineFunction(FuncDeclaration *fd, bool linkageAvailableExternally) {
@@ -993,6 +1305,10 @@ void DtoDefineFunction(FuncDeclaration *fd, bool linkageAvailableExternally) {
     return;
   }
 
+  if (optimizationsummary::isEnabled()) {
+    gIR->definedFunctions.push_back(fd);
+  }
+
   SCOPE_EXIT {
     if (irFunc->isDynamicCompiled()) {
       defineDynamicCompiledFunction(gIR, irFunc);
@@ -1031,6 +1347,9 @@ void DtoDefineFunction(FuncDeclaration *fd, bool linkageAvailableExternally) {
   if (gABI->needsUnwindTables()) {
     func->addFnAttr(LLAttribute::UWTable);
   }
+  if (opts::splitStack) {
+    func->addFnAttr("split-stack");
+  }
   if (opts::isAnySanitizerEnabled() &&
       !opts::functionIsInSanitizerBlacklist(fd)) {
     // Set the required sanitizer attribute.
@@ -1127,8 +1446,12 @@ void DtoDefineFunction(FuncDeclaration *fd, bool linkageAvailableExternally) {
   }
 
   // define all explicit parameters
-  if (fd->parameters)
+  if (fd->parameters) {
     defineParameters(irFty, *fd->parameters);
+    for (auto vd : *fd->parameters) {
+      DtoAssumeAlignedUDA(vd, getIrParameter(vd)->value);
+    }
+  }
 
   // Initialize PGO state for this function
   funcGen.pgo.assignRegionCounters(fd, func);
@@ -1169,6 +1492,11 @@ void DtoDefineFunction(FuncDeclaration *fd, bool linkageAvailableExternally) {
     }
   }
 
+  if (irFunc->sretArg) {
+    findSretLocals(fd, irFunc->sretArg->getType()->getPointerElementType(),
+                   funcGen.sretLocals);
+  }
+
   funcGen.pgo.emitCounterIncrement(fd->fbody);
   funcGen.pgo.setCurrentStmt(fd->fbody);
 
@@ -1218,9 +1546,33 @@ void DtoDefineFunction(FuncDeclaration *fd, bool linkageAvailableExternally) {
     allocaPoint = nullptr;
   }
 
+  pruneInstrumentationFnCalls(fd, func);
+
+  if (isArrayOpInstance(fd)) {
+    addArrayOpLoopMetadata(func);
+  }
+
+  if (irFunc->hot) {
+    addHotFunctionHints(func);
+  }
+
+  if (!irFunc->isDynamicCompiled()) {
+    emitRestrictSliceImpl(irFunc);
+  }
+
   if (gIR->dcomputetarget && hasKernelAttr(fd)) {
     auto fn = gIR->module.getFunction(fd->mangleString);
     gIR->dcomputetarget->addKernelMetadata(fd, fn);
+    gIR->dcomputetarget->addKernelArgs(fn);
+  }
+
+  // Available-externally copies keep the plain body for inlining; the
+  // defining module dispatches.
+  if (!linkageAvailableExternally) {
+    addHotTargetClones(irFunc);
+    if (!irFunc->targetClones.empty()) {
+      emitTargetClones(irFunc);
+    }
   }
 }
 
@@ -1244,6 +1596,16 @@ DValue *DtoArgument(Parameter *fnarg, Expression *argexp) {
   if (fnarg && (fnarg->storageClass & STClazy)) {
     assert(argexp->type->toBasetype()->ty == Tdelegate);
     assert(!arg->isLVal());
+    // The delegate literal is only called by the callee; make it cheap to
+    // inline once the callee has been inlined.
+    if (argexp->op == TOKfunction) {
+      FuncDeclaration *literal = static_cast<FuncExp *>(argexp)->fd;
+      if (isIrFuncCreated(literal)) {
+        LLFunction *func = getIrFunc(literal)->getLLVMFunc();
+        if (func && !func->hasFnAttribute(llvm::Attribute::NoInline))
+          func->addFnAttr(llvm::Attribute::InlineHint);
+      }
+    }
     return arg;
   }
 
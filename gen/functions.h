@@ -23,6 +23,7 @@ struct IRAsmBlock;
 struct IrFuncTy;
 class Parameter;
 class Type;
+class TypeFunction;
 namespace llvm {
 class FunctionType;
 }
@@ -42,4 +43,7 @@ void emitABIReturnAsmStmt(IRAsmBlock *asmblock, Loc &loc,
 
 DValue *DtoArgument(Parameter *fnarg, Expression *argexp);
 
+/// Returns whether the function type has a lazy parameter.
+bool hasLazyParameters(TypeFunction *f);
+
 #endif
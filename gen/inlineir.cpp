@@ -14,6 +14,7 @@
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/AsmParser/Parser.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
 namespace {
 
@@ -116,6 +117,7 @@ DValue *DtoInlineIRExpr(Loc &loc, FuncDeclaration *fdecl,
   assert(tinst);
 
   // 1. Define the inline function (define a new function for each call)
+  llvm::Function *fun = nullptr;
   {
     // The magic inlineIR template is one of
     // pragma(LDC_inline_ir)
@@ -156,12 +158,16 @@ DValue *DtoInlineIRExpr(Loc &loc, FuncDeclaration *fdecl,
     assert(args);
     Objects &arg_types = args->objects;
 
+    // The IR text is built without the function name, which is inserted
+    // after the `@` of the definition; the nameless text is the cache key.
     std::string str;
     llvm::raw_string_ostream stream(str);
     if (!prefix.empty()) {
       stream << prefix << "\n";
     }
-    stream << "define " << *DtoType(ret) << " @" << mangled_name << "(";
+    stream << "define " << *DtoType(ret) << " @";
+    const size_t nameOffset = stream.str().size();
+    stream << "(";
 
     for (size_t i = 0;;) {
       Type *ty = isType(arg_types[i]);
@@ -191,30 +197,47 @@ DValue *DtoInlineIRExpr(Loc &loc, FuncDeclaration *fdecl,
     if (!suffix.empty()) {
       stream << "\n" << suffix;
     }
+    stream.flush();
+
+    // Parsing is expensive, so reuse an identical function defined earlier in
+    // this module by cloning it.
+    auto cached = gIR->inlineIRCache.find(str);
+    if (cached != gIR->inlineIRCache.end()) {
+      IF_LOG Logger::println("Cloning cached inline IR function");
+      llvm::ValueToValueMapTy vmap;
+      fun = llvm::CloneFunction(cached->second.function, vmap);
+      fun->setName(mangled_name);
+      fun->setAttributes(cached->second.attributes);
+    } else {
+      std::string irText = str;
+      irText.insert(nameOffset, mangled_name);
 
-    llvm::SMDiagnostic err;
+      llvm::SMDiagnostic err;
 
-    std::unique_ptr<llvm::Module> m =
-        llvm::parseAssemblyString(stream.str().c_str(), err, gIR->context());
+      std::unique_ptr<llvm::Module> m =
+          llvm::parseAssemblyString(irText.c_str(), err, gIR->context());
 
-    std::string errstr = err.getMessage();
-    if (!errstr.empty()) {
-      error(tinst->loc,
-            "can't parse inline LLVM IR:\n`%s`\n%s\n%s\nThe input string "
-            "was:\n`%s`",
-            err.getLineContents().str().c_str(),
-            (std::string(err.getColumnNo(), ' ') + '^').c_str(), errstr.c_str(),
-            stream.str().c_str());
-    }
+      std::string errstr = err.getMessage();
+      if (!errstr.empty()) {
+        error(tinst->loc,
+              "can't parse inline LLVM IR:\n`%s`\n%s\n%s\nThe input string "
+              "was:\n`%s`",
+              err.getLineContents().str().c_str(),
+              (std::string(err.getColumnNo(), ' ') + '^').c_str(),
+              errstr.c_str(), irText.c_str());
+      }
+
+      m->setDataLayout(gIR->module.getDataLayout());
 
-    m->setDataLayout(gIR->module.getDataLayout());
+      llvm::Linker(gIR->module).linkInModule(std::move(m));
 
-    llvm::Linker(gIR->module).linkInModule(std::move(m));
+      fun = gIR->module.getFunction(mangled_name);
+      gIR->inlineIRCache[str] = {fun, fun->getAttributes()};
+    }
   }
 
   // 2. Call the function that was just defined and return the returnvalue
   {
-    llvm::Function *fun = gIR->module.getFunction(mangled_name);
 
     // Apply some parent function attributes to the inlineIR function too. This
     // is needed e.g. when the parent function has "unsafe-fp-math"="true"
@@ -18,7 +18,7 @@
 #include <cstdarg>
 
 IRState *gIR = nullptr;
-llvm::TargetMachine *gTargetMachine = nullptr;
+thread_local llvm::TargetMachine *gTargetMachine = nullptr;
 const llvm::DataLayout *gDataLayout = nullptr;
 TargetABI *gABI = nullptr;
 
@@ -140,6 +140,18 @@ bool IRState::emitArrayBoundsChecks() {
   return t->ty == Tfunction && ((TypeFunction *)t)->trust == TRUSTsafe;
 }
 
+LLGlobalVariable *IRState::getPooledConstant(LLConstant *initializer,
+                                             const char *name) {
+  LLGlobalVariable *&gvar = constantPool[initializer];
+  if (!gvar) {
+    gvar = new LLGlobalVariable(module, initializer->getType(), true,
+                                LLGlobalValue::PrivateLinkage, initializer,
+                                name);
+    gvar->setUnnamedAddr(LLGlobalValue::UnnamedAddr::Global);
+  }
+  return gvar;
+}
+
 LLConstant *IRState::setGlobalVarInitializer(LLGlobalVariable *&globalVar,
                                              LLConstant *initializer) {
   if (initializer->getType() == globalVar->getType()->getContainedType(0)) {
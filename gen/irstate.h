@@ -22,13 +22,16 @@
 #include <vector>
 #include "aggregate.h"
 #include "root.h"
+#include "gen/attributes.h"
 #include "gen/dibuilder.h"
 #include "gen/objcgen.h"
 #include "ir/iraggr.h"
 #include "ir/irvar.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ProfileData/InstrProfReader.h"
 #include "llvm/IR/CallSite.h"
+#include "llvm/IR/ValueHandle.h"
 
 namespace llvm {
 class LLVMContext;
@@ -42,7 +45,9 @@ struct TargetABI;
 class DComputeTarget;
 
 extern IRState *gIR;
-extern llvm::TargetMachine *gTargetMachine;
+// Thread-local so that parallel backend workers (see -j) can each use their
+// own TargetMachine.
+extern thread_local llvm::TargetMachine *gTargetMachine;
 extern const llvm::DataLayout *gDataLayout;
 extern TargetABI *gABI;
 
@@ -101,9 +106,12 @@ struct IRAsmBlock {
   bool retemu; // emulate abi ret with a temporary
   LLValue *(*retfixup)(IRBuilderHelper b, LLValue *orig); // Modifies retval
 
+  // whether any asm statement may write memory or the stack
+  bool writesMemory;
+
   explicit IRAsmBlock(CompoundAsmStatement *b)
       : outputcount(0), asmBlock(b), retty(nullptr), retn(0), retemu(false),
-        retfixup(nullptr) {}
+        retfixup(nullptr), writesMemory(false) {}
 };
 
 // represents the LLVM module (object file)
@@ -196,16 +204,33 @@ public:
   // eliminated.
   std::vector<LLConstant *> usedArray;
 
+  // TypeInfo definitions, erased before emission if unreferenced, see
+  // eraseUnreferencedTypeInfos().
+  std::vector<llvm::WeakVH> typeInfoDefinitions;
+
   /// Whether to emit array bounds checking in the current function.
   bool emitArrayBoundsChecks();
 
-  // Global variables bound to string literals.  Once created such a
-  // variable is reused whenever the same string literal is
-  // referenced in the module.  Caching them per module prevents the
-  // duplication of identical literals.
-  llvm::StringMap<llvm::GlobalVariable *> stringLiteral1ByteCache;
-  llvm::StringMap<llvm::GlobalVariable *> stringLiteral2ByteCache;
-  llvm::StringMap<llvm::GlobalVariable *> stringLiteral4ByteCache;
+  // Read-only globals whose address isn't significant (string literals,
+  // constant array literals etc.), keyed by their initializer. LLVM uniques
+  // constants by content, so identical payloads share a single global per
+  // module, i.e., across all D modules of a -singleobj build.
+  llvm::DenseMap<llvm::Constant *, llvm::GlobalVariable *> constantPool;
+
+  // Returns the private unnamed_addr constant global with the given
+  // initializer, creating it (with the given name) on first use. Such globals
+  // are eligible for the linker's mergeable constant/string sections.
+  llvm::GlobalVariable *getPooledConstant(llvm::Constant *initializer,
+                                          const char *name);
+
+  // Functions defined by pragma(LDC_inline_ir) templates, keyed by their IR
+  // text, together with their attributes as parsed. Further instantiations
+  // with identical IR text clone the function instead of parsing it again.
+  struct InlineIRFunction {
+    llvm::Function *function;
+    LLAttributeSet attributes;
+  };
+  llvm::StringMap<InlineIRFunction> inlineIRCache;
 
   // Sets the initializer for a global LL variable.
   // If the types don't match, this entails creating a new helper global
@@ -222,6 +247,9 @@ public:
   // setGlobalVarInitializer().
   void replaceGlobals();
 
+  // Functions defined in this module, for -fsave-optimization-summary.
+  std::vector<FuncDeclaration *> definedFunctions;
+
   // List of functions with cpu or features attributes overriden by user
   std::vector<IrFunction *> targetCpuOrFeaturesOverridden;
 
@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "gen/llvmhelpers.h"
+#include "driver/cl_options.h"
 #include "gen/cl_helpers.h"
 #include "declaration.h"
 #include "expression.h"
@@ -22,20 +23,26 @@
 #include "gen/llvm.h"
 #include "gen/logger.h"
 #include "gen/nested.h"
+#include "gen/optimizer.h"
 #include "gen/mangling.h"
+#include "gen/pointerbitmap.h"
 #include "gen/pragma.h"
 #include "gen/runtime.h"
+#include "gen/structs.h"
+#include "gen/tbaa.h"
 #include "gen/tollvm.h"
 #include "gen/typinf.h"
 #include "gen/uda.h"
 #include "id.h"
 #include "init.h"
+#include "ir/iraggr.h"
 #include "ir/irfunction.h"
 #include "ir/irmodule.h"
 #include "ir/irtypeaggr.h"
 #include "mars.h"
 #include "module.h"
 #include "template.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/MC/MCAsmInfo.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/Utils/ModuleUtils.h"
@@ -45,18 +52,41 @@
 #include "llvm/Support/CommandLine.h"
 #include "gen/dynamiccompile.h"
 
-llvm::cl::opt<llvm::GlobalVariable::ThreadLocalMode> clThreadModel(
-    "fthread-model", llvm::cl::ZeroOrMore, llvm::cl::desc("Thread model"),
-    llvm::cl::init(llvm::GlobalVariable::GeneralDynamicTLSModel),
+// NotThreadLocal stands for "not specified": general-dynamic, refined to
+// local-exec/initial-exec by finalizeTLSModels() when linking an executable.
+static llvm::cl::opt<llvm::GlobalVariable::ThreadLocalMode> clTLSModel(
+    "ftls-model", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("TLS model for thread-local variables (default: "
+                   "local-exec/initial-exec when linking an executable, "
+                   "global-dynamic otherwise)"),
+    llvm::cl::init(llvm::GlobalVariable::NotThreadLocal),
     clEnumValues(clEnumValN(llvm::GlobalVariable::GeneralDynamicTLSModel,
-                            "global-dynamic",
-                            "Global dynamic TLS model (default)"),
+                            "global-dynamic", "Global dynamic TLS model"),
                  clEnumValN(llvm::GlobalVariable::LocalDynamicTLSModel,
                             "local-dynamic", "Local dynamic TLS model"),
                  clEnumValN(llvm::GlobalVariable::InitialExecTLSModel,
-                            "initial-exec", "Initial exec TLS model"),
+                            "initial-exec",
+                            "Initial exec TLS model (not for dlopen()ed "
+                            "shared libraries)"),
                  clEnumValN(llvm::GlobalVariable::LocalExecTLSModel,
-                            "local-exec", "Local exec TLS model")));
+                            "local-exec",
+                            "Local exec TLS model (executables only)")));
+
+static llvm::cl::alias clThreadModel("fthread-model",
+                                     llvm::cl::desc("Alias for -ftls-model"),
+                                     llvm::cl::aliasopt(clTLSModel));
+
+static llvm::cl::opt<bool> threadLocalAlloc(
+    "fthread-local-alloc", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("(experimental) Inline a thread-local bump-pointer fast "
+                   "path for small GC allocations of statically known size; "
+                   "requires a druntime providing _d_tlabs/_d_tlab_refill"));
+
+static llvm::cl::opt<bool> lifetimeMarkers(
+    "lifetime-markers", llvm::cl::ZeroOrMore, llvm::cl::init(true),
+    llvm::cl::desc("Emit llvm.lifetime markers for local variables when "
+                   "optimizing, so that variables of disjoint scopes can share "
+                   "stack slots"));
 
 /******************************************************************************
  * Simple Triple helpers for DFE
@@ -78,31 +108,177 @@ bool isMusl() {
  * Global context
  ******************************************************************************/
 static llvm::ManagedStatic<llvm::LLVMContext> GlobalContext;
+static llvm::LLVMContext *CurrentContext = nullptr;
+
+llvm::LLVMContext &getGlobalContext() {
+  return CurrentContext ? *CurrentContext : *GlobalContext;
+}
 
-llvm::LLVMContext &getGlobalContext() { return *GlobalContext; }
+void setGlobalContext(llvm::LLVMContext *context) { CurrentContext = context; }
 
 /******************************************************************************
  * DYNAMIC MEMORY HELPERS
  ******************************************************************************/
 
+// The thread-local allocation buffers (TLABs) shared with druntime:
+//   extern(C) struct { void* cur; void* end; }[tlabCount] _d_tlabs; // TLS
+// There is one buffer per power-of-2 size class from 16 to 2048 bytes, for
+// blocks with (even index) and without pointers (odd index, NO_SCAN). The
+// free parts of the buffers are zero-filled.
+//   extern(C) void* _d_tlab_refill(size_t index, const TypeInfo ti);
+// refills the buffer `index` and returns a zero-filled block of it.
+static const uint64_t tlabMinSize = 16;
+static const uint64_t tlabMaxSize = 2048;
+static const unsigned tlabCount = 2 * 8;
+
+LLValue *DtoThreadLocalAlloc(Loc &loc, uint64_t size, bool hasPointers,
+                             LLValue *typeInfo, const char *name) {
+  if (!threadLocalAlloc || size > tlabMaxSize)
+    return nullptr;
+  // The buffers don't track per-block pointer bitmaps.
+  if (hasPointers && isPointerBitmapEnabled())
+    return nullptr;
+
+  unsigned sizeClass = 0;
+  uint64_t classSize = tlabMinSize;
+  while (classSize < size) {
+    classSize *= 2;
+    ++sizeClass;
+  }
+  const unsigned index = 2 * sizeClass + (hasPointers ? 0 : 1);
+  assert(index < tlabCount);
+
+  llvm::Function *refill =
+      getRuntimeFunction(loc, gIR->module, "_d_tlab_refill");
+
+  LLType *voidPtrTy = getVoidPtrType();
+  llvm::GlobalVariable *tlabs = declareGlobal(
+      loc, gIR->module, LLArrayType::get(voidPtrTy, 2 * tlabCount),
+      "_d_tlabs", /*isConstant=*/false, /*isThreadLocal=*/true);
+
+  LLValue *curSlot = DtoGEPi(tlabs, 0, 2 * index, ".tlab.cur_ptr");
+  LLValue *endSlot = DtoGEPi(tlabs, 0, 2 * index + 1, ".tlab.end_ptr");
+  LLValue *cur = DtoLoad(curSlot, ".tlab.cur");
+  LLValue *next =
+      DtoGEP1(cur, DtoConstSize_t(classSize), /*inBounds=*/false, ".tlab.next");
+  LLValue *fits =
+      gIR->ir->CreateICmpULE(next, DtoLoad(endSlot, ".tlab.end"), ".tlab.fits");
+
+  llvm::BasicBlock *fastbb = gIR->insertBB("tlab.fast");
+  llvm::BasicBlock *slowbb = gIR->insertBBAfter(fastbb, "tlab.refill");
+  llvm::BasicBlock *endbb = gIR->insertBBAfter(slowbb, "tlab.done");
+  auto branch = gIR->ir->CreateCondBr(fits, fastbb, slowbb);
+  branch->setMetadata(
+      llvm::LLVMContext::MD_prof,
+      llvm::MDBuilder(gIR->context()).createBranchWeights(1000, 1));
+
+  gIR->scope() = IRScope(fastbb);
+  DtoStore(next, curSlot);
+  llvm::BranchInst::Create(endbb, fastbb);
+
+  gIR->scope() = IRScope(slowbb);
+  LLValue *refilled =
+      gIR->CreateCallOrInvoke(
+             refill, DtoConstSize_t(index),
+             DtoBitCast(typeInfo, refill->getFunctionType()->getParamType(1)),
+             ".tlab.refilled")
+          .getInstruction();
+  llvm::BasicBlock *slowendbb = gIR->scopebb();
+  llvm::BranchInst::Create(endbb, slowendbb);
+
+  gIR->scope() = IRScope(endbb);
+  llvm::PHINode *mem = gIR->ir->CreatePHI(voidPtrTy, 2, name);
+  mem->addIncoming(cur, fastbb);
+  mem->addIncoming(refilled, slowendbb);
+  return mem;
+}
+
+LLConstant *getPointerBitmapForAlloc(Type *type) {
+  // Blocks without pointers aren't scanned at all (NO_SCAN).
+  if (!isPointerBitmapEnabled() || !type->hasPointers())
+    return nullptr;
+  return DtoPointerBitmapOf(type);
+}
+
 LLValue *DtoNew(Loc &loc, Type *newtype) {
-  // get runtime function
-  llvm::Function *fn = getRuntimeFunction(loc, gIR->module, "_d_allocmemoryT");
   // get type info
   LLConstant *ti = DtoTypeInfoOf(newtype);
   assert(isaPointer(ti));
-  // call runtime allocator
-  LLValue *mem = gIR->CreateCallOrInvoke(fn, ti, ".gc_mem").getInstruction();
+  // the memory is initialized by the caller
+  LLValue *mem =
+      DtoThreadLocalAlloc(loc, getTypeAllocSize(DtoType(newtype)),
+                          newtype->hasPointers(), ti, ".gc_mem");
+  if (!mem) {
+    // call runtime allocator
+    if (LLConstant *bitmap = getPointerBitmapForAlloc(newtype)) {
+      llvm::Function *fn =
+          getRuntimeFunction(loc, gIR->module, "_d_allocmemoryBitmap");
+      mem = gIR->CreateCallOrInvoke(fn, ti, bitmap, ".gc_mem")
+                .getInstruction();
+    } else {
+      llvm::Function *fn =
+          getRuntimeFunction(loc, gIR->module, "_d_allocmemoryT");
+      mem = gIR->CreateCallOrInvoke(fn, ti, ".gc_mem").getInstruction();
+    }
+  }
   // cast
   return DtoBitCast(mem, DtoPtrToType(newtype), ".gc_mem");
 }
 
 LLValue *DtoNewStruct(Loc &loc, TypeStruct *newtype) {
-  llvm::Function *fn = getRuntimeFunction(
-      loc, gIR->module,
-      newtype->isZeroInit(newtype->sym->loc) ? "_d_newitemT" : "_d_newitemiT");
+  const bool isZeroInit = newtype->isZeroInit(newtype->sym->loc);
   LLConstant *ti = DtoTypeInfoOf(newtype);
-  LLValue *mem = gIR->CreateCallOrInvoke(fn, ti, ".gc_struct").getInstruction();
+
+  // Structs with destructors need to be finalized by the GC.
+  if (!newtype->sym->dtor) {
+    LLType *structType = DtoType(newtype);
+    if (LLValue *mem = DtoThreadLocalAlloc(loc, getTypeAllocSize(structType),
+                                           newtype->hasPointers(), ti,
+                                           ".gc_struct")) {
+      mem = DtoBitCast(mem, getPtrToType(structType), ".gc_struct");
+      if (!isZeroInit) {
+        DtoResolveStruct(newtype->sym);
+        IrAggr *irAggr = getIrAggr(newtype->sym);
+        if (!DtoSparseInitialize(mem, irAggr->getDefaultInit(), 0,
+                                 getTypeStoreSize(structType),
+                                 /*isZeroed=*/true)) {
+          DtoMemCpy(mem, irAggr->getInitSymbol(),
+                    DtoConstSize_t(getTypeAllocSize(structType)));
+        }
+      }
+      return mem;
+    }
+  }
+
+  LLValue *mem;
+  if (LLConstant *bitmap = getPointerBitmapForAlloc(newtype)) {
+    // initializes the memory like _d_newitem[i]T
+    llvm::Function *fn =
+        getRuntimeFunction(loc, gIR->module, "_d_newitemBitmap");
+    mem = gIR->CreateCallOrInvoke(fn, ti, bitmap, ".gc_struct")
+              .getInstruction();
+  } else {
+    // Allocate zeroed memory and patch up mostly zero initializers instead
+    // of having the runtime copy them.
+    LLConstant *init = nullptr;
+    uint64_t initSize = 0;
+    if (!isZeroInit) {
+      DtoResolveStruct(newtype->sym);
+      init = getIrAggr(newtype->sym)->getDefaultInit();
+      initSize = getTypeStoreSize(DtoType(newtype));
+      if (!canSparseInitialize(init, 0, initSize)) {
+        init = nullptr;
+      }
+    }
+    const bool zeroed = isZeroInit || init;
+    llvm::Function *fn = getRuntimeFunction(
+        loc, gIR->module, zeroed ? "_d_newitemT" : "_d_newitemiT");
+    mem = gIR->CreateCallOrInvoke(fn, ti, ".gc_struct").getInstruction();
+    if (init) {
+      mem = DtoBitCast(mem, DtoPtrToType(newtype), ".gc_struct");
+      DtoSparseInitialize(mem, init, 0, initSize, /*isZeroed=*/true);
+    }
+  }
   return DtoBitCast(mem, DtoPtrToType(newtype), ".gc_struct");
 }
 
@@ -301,8 +477,8 @@ void DtoAssert(Module *M, Loc &loc, DValue *msg) {
 }
 
 void DtoCAssert(Module *M, Loc &loc, LLValue *msg) {
-  const auto file = DtoConstCString(loc.filename ? loc.filename
-                                                 : M->srcfile->name->toChars());
+  const auto file = DtoConstCString(opts::remapFilePath(
+      loc.filename ? loc.filename : M->srcfile->name->toChars()).c_str());
   const auto line = DtoConstUint(loc.linnum);
   const auto fn = getCAssertFunction(loc, gIR->module);
 
@@ -344,8 +520,8 @@ void DtoCAssert(Module *M, Loc &loc, LLValue *msg) {
  ******************************************************************************/
 
 LLConstant *DtoModuleFileName(Module *M, const Loc &loc) {
-  return DtoConstString(loc.filename ? loc.filename
-                                     : M->srcfile->name->toChars());
+  return DtoConstString(opts::remapFilePath(
+      loc.filename ? loc.filename : M->srcfile->name->toChars()).c_str());
 }
 
 /******************************************************************************
@@ -379,7 +555,8 @@ void DtoAssign(Loc &loc, DValue *lhs, DValue *rhs, int op,
   assert(t->ty != Tvoid && "Cannot assign values of type void.");
 
   if (t->ty == Tbool) {
-    DtoStoreZextI8(DtoRVal(rhs), DtoLVal(lhs));
+    LLValue *l = DtoLVal(lhs);
+    addTBAAMetadata(DtoStoreZextI8(DtoRVal(rhs), l), t, l);
   } else if (t->ty == Tstruct) {
     // don't copy anything to empty structs
     if (static_cast<TypeStruct *>(t)->sym->fields.dim > 0) {
@@ -411,7 +588,7 @@ void DtoAssign(Loc &loc, DValue *lhs, DValue *rhs, int op,
       Logger::cout() << "r : " << *r << '\n';
     }
     r = DtoBitCast(r, l->getType()->getContainedType(0));
-    DtoStore(r, l);
+    addTBAAMetadata(DtoStore(r, l), t, l);
   } else if (t->iscomplex()) {
     LLValue *dst = DtoLVal(lhs);
     LLValue *src = DtoRVal(DtoCast(loc, rhs, lhs->type));
@@ -441,7 +618,7 @@ void DtoAssign(Loc &loc, DValue *lhs, DValue *rhs, int op,
       assert(r->getType() == lit);
 #endif
     }
-    gIR->ir->CreateStore(r, l);
+    addTBAAMetadata(DtoStore(r, l), t, l);
   }
 }
 
@@ -943,6 +1120,53 @@ void DtoResolveVariable(VarDeclaration *vd) {
  ******************************************************************************/
 
 // TODO: Merge with DtoRawVarDeclaration!
+void DtoAssumeAlignedUDA(VarDeclaration *vd, LLValue *lval) {
+  const unsigned alignment = getAssumeAlignedUDA(vd);
+  if (!alignment) {
+    return;
+  }
+
+  LLValue *ptr = DtoLoad(lval);
+  if (vd->type->toBasetype()->ty == Tarray) {
+    ptr = DtoExtractValue(ptr, 1, ".ptr");
+  }
+  gIR->ir->CreateAlignmentAssumption(*gDataLayout, ptr, alignment);
+}
+
+/// Starts the lifetime of a local variable's stack slot, to be ended by
+/// DtoEndScopedLifetimes().
+static void startLifetime(VarDeclaration *vd, llvm::AllocaInst *slot) {
+  if (!lifetimeMarkers || optLevel() == 0 || gIR->dcomputetarget)
+    return;
+  // A goto may skip the declaration of void-initialized variables, i.e.,
+  // they may be used without the lifetime having been started.
+  if (!vd->_init || vd->_init->isVoidInitializer())
+    return;
+  if (slot->isArrayAllocation())
+    return;
+
+  const uint64_t size = getTypeAllocSize(slot->getAllocatedType());
+  gIR->ir->CreateLifetimeStart(slot, gIR->ir->getInt64(size));
+  gIR->funcGen().scopedLocals.push_back(slot);
+}
+
+void DtoEndScopedLifetimes(size_t numOuterLocals) {
+  auto &scopedLocals = gIR->funcGen().scopedLocals;
+  if (scopedLocals.size() <= numOuterLocals)
+    return;
+
+  // The lifetimes stay active on other paths leaving the scope (jumps,
+  // returns, exceptions), which is merely conservative.
+  if (!gIR->scopereturned()) {
+    for (size_t i = scopedLocals.size(); i-- > numOuterLocals;) {
+      llvm::AllocaInst *slot = scopedLocals[i];
+      const uint64_t size = getTypeAllocSize(slot->getAllocatedType());
+      gIR->ir->CreateLifetimeEnd(slot, gIR->ir->getInt64(size));
+    }
+  }
+  scopedLocals.resize(numOuterLocals);
+}
+
 void DtoVarDeclaration(VarDeclaration *vd) {
   assert(!vd->isDataseg() &&
          "Statics/globals are handled in DtoDeclarationExp.");
@@ -967,6 +1191,7 @@ void DtoVarDeclaration(VarDeclaration *vd) {
   } else if (gIR->func()->sretArg &&
              ((gIR->func()->decl->nrvo_can &&
                gIR->func()->decl->nrvo_var == vd) ||
+              gIR->funcGen().sretLocals.count(vd) ||
               (vd->isResult() && !isSpecialRefVar(vd)))) {
     // Named Return Value Optimization (NRVO):
     // T f() {
@@ -997,6 +1222,10 @@ void DtoVarDeclaration(VarDeclaration *vd) {
     irLocal->value = allocainst;
 
     gIR->DBuilder.EmitLocalVariable(allocainst, vd);
+
+    if (auto slot = llvm::dyn_cast<llvm::AllocaInst>(allocainst)) {
+      startLifetime(vd, slot);
+    }
   }
 
   IF_LOG Logger::cout() << "llvm value for decl: " << *getIrLocal(vd)->value
@@ -1009,6 +1238,11 @@ void DtoVarDeclaration(VarDeclaration *vd) {
       toElem(ex->exp);
     }
   }
+
+  // The alignment can only be assumed for the initial value.
+  if (!isSpecialRefVar(vd)) {
+    DtoAssumeAlignedUDA(vd, getIrLocal(vd)->value);
+  }
 }
 
 DValue *DtoDeclarationExp(Dsymbol *declaration) {
@@ -1702,20 +1936,6 @@ llvm::Constant *DtoConstSymbolAddress(Loc &loc, Declaration *decl) {
   llvm_unreachable("Taking constant address not implemented.");
 }
 
-llvm::StringMap<llvm::GlobalVariable *> *
-stringLiteralCacheForType(Type *charType) {
-  switch (charType->size()) {
-  default:
-    llvm_unreachable("Unknown char type");
-  case 1:
-    return &gIR->stringLiteral1ByteCache;
-  case 2:
-    return &gIR->stringLiteral2ByteCache;
-  case 4:
-    return &gIR->stringLiteral4ByteCache;
-  }
-}
-
 llvm::Constant *buildStringLiteralConstant(StringExp *se, bool zeroTerm) {
   Type *dtype = se->type->toBasetype();
   Type *cty = dtype->nextOf()->toBasetype();
@@ -1772,12 +1992,16 @@ llvm::GlobalVariable *declareGlobal(const Loc &loc, llvm::Module &module,
   // Use a command line option for the thread model.
   // On PPC there is only local-exec available - in this case just ignore the
   // command line.
-  const auto tlsModel =
-      isThreadLocal
-          ? (global.params.targetTriple->getArch() == llvm::Triple::ppc
-                 ? llvm::GlobalVariable::LocalExecTLSModel
-                 : clThreadModel.getValue())
-          : llvm::GlobalVariable::NotThreadLocal;
+  auto tlsModel = llvm::GlobalVariable::NotThreadLocal;
+  if (isThreadLocal) {
+    if (global.params.targetTriple->getArch() == llvm::Triple::ppc) {
+      tlsModel = llvm::GlobalVariable::LocalExecTLSModel;
+    } else if (clTLSModel != llvm::GlobalVariable::NotThreadLocal) {
+      tlsModel = clTLSModel;
+    } else {
+      tlsModel = llvm::GlobalVariable::GeneralDynamicTLSModel;
+    }
+  }
 
   return new llvm::GlobalVariable(module, type, isConstant,
                                   llvm::GlobalValue::ExternalLinkage, nullptr,
@@ -1806,6 +2030,30 @@ llvm::GlobalVariable *defineGlobal(const Loc &loc, llvm::Module &module,
   return global;
 }
 
+void finalizeTLSModels(llvm::Module &module) {
+  // Only refine the default model, and only if we know the object files end
+  // up in an executable: its own thread-locals are then part of the static
+  // TLS block at a link-time constant offset from the thread pointer (incl.
+  // the ldc.tls_anchor of gen/modules.cpp), and the ones defined elsewhere
+  // live in the executable or in a shared library loaded at startup.
+  if (clTLSModel != llvm::GlobalVariable::NotThreadLocal ||
+      !global.params.link || global.params.dll || global.params.lib ||
+      !global.params.targetTriple->isOSBinFormatELF()) {
+    return;
+  }
+
+  for (auto &gvar : module.globals()) {
+    if (gvar.getThreadLocalMode() !=
+            llvm::GlobalVariable::GeneralDynamicTLSModel ||
+        gvar.hasExternalWeakLinkage()) {
+      continue;
+    }
+    gvar.setThreadLocalMode(gvar.isDeclaration()
+                                ? llvm::GlobalVariable::InitialExecTLSModel
+                                : llvm::GlobalVariable::LocalExecTLSModel);
+  }
+}
+
 FuncDeclaration *getParentFunc(Dsymbol *sym) {
   if (!sym) {
     return nullptr;
@@ -1880,6 +2128,11 @@ LLValue *DtoIndexAggregate(LLValue *src, AggregateDeclaration *ad,
   // Cast the (possibly void*) pointer to the canonical variable type.
   val = DtoBitCast(val, DtoPtrToType(vd->type));
 
+  // Overlapping fields may be type-punned.
+  if (vd->overlapped || isTBAAUnionPointer(src)) {
+    addTBAAUnionPointer(val);
+  }
+
   IF_LOG Logger::cout() << "Value: " << *val << '\n';
   return val;
 }
@@ -31,8 +31,19 @@ template <class T> using ArrayParam = llvm::ArrayRef<T>;
 bool isMusl();
 
 llvm::LLVMContext& getGlobalContext();
+/// Makes getGlobalContext() return the given context (e.g., the one of the
+/// current module with -context-per-module); null restores the default one.
+void setGlobalContext(llvm::LLVMContext *context);
 
 // dynamic memory helpers
+/// Allocates `size` bytes of zero-filled GC memory via the inline thread-local
+/// fast path (-fthread-local-alloc). Returns null if that is disabled or not
+/// applicable to the size.
+LLValue *DtoThreadLocalAlloc(Loc &loc, uint64_t size, bool hasPointers,
+                             LLValue *typeInfo, const char *name);
+/// Returns the pointer bitmap to pass to the typed allocation hooks for a
+/// GC-allocated `type` containing pointers (-fgc-pointer-bitmaps), or null.
+LLConstant *getPointerBitmapForAlloc(Type *type);
 LLValue *DtoNew(Loc &loc, Type *newtype);
 LLValue *DtoNewStruct(Loc &loc, TypeStruct *newtype);
 void DtoDeleteMemory(Loc &loc, DValue *ptr);
@@ -117,8 +128,17 @@ TemplateInstance *DtoIsTemplateInstance(Dsymbol *s);
 void DtoResolveDsymbol(Dsymbol *dsym);
 void DtoResolveVariable(VarDeclaration *var);
 
+/// Lets the optimizer assume the pointer stored in the pointer/slice lvalue
+/// of 'var' to be aligned as specified by @ldc.attributes.assumeAligned.
+void DtoAssumeAlignedUDA(VarDeclaration *var, LLValue *lval);
+
 // declaration inside a declarationexp
 void DtoVarDeclaration(VarDeclaration *var);
+
+/// Ends the lifetimes of the local variables declared since
+/// `funcGen().scopedLocals` had the given size, at the end of a scope statement.
+void DtoEndScopedLifetimes(size_t numOuterLocals);
+
 DValue *DtoDeclarationExp(Dsymbol *declaration);
 LLValue *DtoRawVarDeclaration(VarDeclaration *var, LLValue *addr = nullptr);
 
@@ -239,11 +259,6 @@ LLConstant *toConstantArray(LLType *ct, LLArrayType *at, T *str, size_t len,
   return LLConstantArray::get(at, vals);
 }
 
-/// Returns the cache for string literals of the given character type (for the
-/// current IRState).
-llvm::StringMap<llvm::GlobalVariable *> *
-stringLiteralCacheForType(Type *charType);
-
 llvm::Constant *buildStringLiteralConstant(StringExp *se, bool zeroTerm);
 
 /// Tries to declare an LLVM global. If a variable with the same mangled name
@@ -270,6 +285,11 @@ llvm::GlobalVariable *defineGlobal(const Loc &loc, llvm::Module &module,
                                    llvm::GlobalValue::LinkageTypes linkage,
                                    bool isConstant, bool isThreadLocal = false);
 
+/// Switches the thread-local globals of the module from the default
+/// general-dynamic TLS model to local-exec (definitions) and initial-exec
+/// (declarations) when linking an executable and no -ftls-model is given.
+void finalizeTLSModels(llvm::Module &module);
+
 FuncDeclaration *getParentFunc(Dsymbol *sym);
 
 void Declaration_codegen(Dsymbol *decl);
@@ -47,6 +47,7 @@ void Stream::writeValue(std::ostream &OS, const llvm::Value &V) {
 bool _Logger_enabled;
 
 namespace Logger {
+#ifndef LDC_DISABLE_LOGGER
 static std::string indent_str;
 
 static llvm::cl::opt<bool, true>
@@ -115,6 +116,8 @@ void print(const char *fmt, ...) {
     va_end(va);
   }
 }
+#endif // LDC_DISABLE_LOGGER
+
 void attention(Loc &loc, const char *fmt, ...) {
   va_list va;
   va_start(va, fmt);
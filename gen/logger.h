@@ -96,6 +96,26 @@ extern bool _Logger_enabled;
 
 namespace Logger {
 
+void attention(Loc loc, const char *fmt, ...) IS_PRINTF(2);
+
+#ifdef LDC_DISABLE_LOGGER
+
+// The log is compiled out (CMake option LDC_DISABLE_LOGGER), turning all
+// IF_LOG blocks into dead code.
+inline void indent() {}
+inline void undent() {}
+inline Stream cout() { return Stream(nullptr); }
+inline void printIndentation() {}
+inline void println(const char *fmt, ...) IS_PRINTF(1);
+inline void println(const char *fmt, ...) {}
+inline void print(const char *fmt, ...) IS_PRINTF(1);
+inline void print(const char *fmt, ...) {}
+inline void enable() {}
+inline void disable() {}
+constexpr bool enabled() { return false; }
+
+#else
+
 void indent();
 void undent();
 Stream cout();
@@ -106,15 +126,25 @@ inline void enable() { _Logger_enabled = true; }
 inline void disable() { _Logger_enabled = false; }
 inline bool enabled() { return _Logger_enabled; }
 
-void attention(Loc loc, const char *fmt, ...) IS_PRINTF(2);
-
 struct LoggerScope {
-  LoggerScope() { Logger::indent(); }
-  ~LoggerScope() { Logger::undent(); }
+  LoggerScope() {
+    if (enabled())
+      Logger::indent();
+  }
+  ~LoggerScope() {
+    if (enabled())
+      Logger::undent();
+  }
 };
+
+#endif
 }
 
+#ifdef LDC_DISABLE_LOGGER
+#define LOG_SCOPE
+#else
 #define LOG_SCOPE Logger::LoggerScope _logscope;
+#endif
 
 #define IF_LOG if (Logger::enabled())
 
@@ -14,16 +14,37 @@
 #include "gen/mangling.h"
 
 #include "dmd/declaration.h"
+#include "dmd/errors.h"
 #include "dmd/dsymbol.h"
 #include "dmd/identifier.h"
 #include "dmd/module.h"
 #include "gen/abi.h"
 #include "gen/irstate.h"
 #include "gen/to_string.h"
+#include "ir/irdsymbol.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+#include <map>
 
 namespace {
 
+llvm::cl::opt<std::string> hashedSymbolMap(
+    "hashed-symbol-map", llvm::cl::ZeroOrMore,
+    llvm::cl::value_desc("filename"),
+    llvm::cl::desc("Write the original names of the symbols hashed because of "
+                   "-hash-threshold to <filename>"));
+
+// Hashed mangle => original mangle, sorted for a stable map file.
+std::map<std::string, std::string> hashedSymbols;
+
+void recordHashedSymbol(const std::string &hashed, std::string original) {
+  if (!hashedSymbolMap.empty()) {
+    hashedSymbols.emplace(hashed, std::move(original));
+  }
+}
+
 // TODO: Disable hashing of symbols that are defined in libdruntime and
 // libphobos. This would enable hashing thresholds below the largest symbol in
 // libdruntime/phobos.
@@ -98,6 +119,13 @@ std::string hashSymbolName(llvm::StringRef name, Dsymbol *symb) {
 }
 
 std::string getIRMangledName(FuncDeclaration *fdecl, LINK link) {
+  // The linkage is fixed per function, see DtoDeclareFunction(), so the cached
+  // mangle is valid for every call.
+  std::string &cached = fdecl->ir->irMangle;
+  if (!cached.empty()) {
+    return cached;
+  }
+
   std::string mangledName = mangleExact(fdecl);
 
   // Hash the name if necessary
@@ -106,23 +134,28 @@ std::string getIRMangledName(FuncDeclaration *fdecl, LINK link) {
       (mangledName.length() > global.params.hashThreshold)) {
 
     auto hashedName = hashSymbolName(mangledName, fdecl);
+    std::string original = std::move(mangledName);
     mangledName = "_D" + hashedName + "Z";
+    recordHashedSymbol(mangledName, std::move(original));
   }
 
-  // TODO: Cache the result?
-
-  return getIRMangledFuncName(std::move(mangledName), link);
+  cached = getIRMangledFuncName(std::move(mangledName), link);
+  return cached;
 }
 
 std::string getIRMangledName(VarDeclaration *vd) {
+  std::string &cached = vd->ir->irMangle;
+  if (!cached.empty()) {
+    return cached;
+  }
+
   OutBuffer mangleBuf;
   mangleToBuffer(vd, &mangleBuf);
 
   // TODO: is hashing of variable names necessary?
 
-  // TODO: Cache the result?
-
-  return getIRMangledVarName(mangleBuf.peekString(), vd->linkage);
+  cached = getIRMangledVarName(mangleBuf.peekString(), vd->linkage);
+  return cached;
 }
 
 std::string getIRMangledFuncName(std::string baseMangle, LINK link) {
@@ -142,7 +175,8 @@ std::string getIRMangledAggregateName(AggregateDeclaration *ad,
   mangleToBuffer(ad, &mangleBuf);
   llvm::StringRef mangledAggrName = mangleBuf.peekString();
 
-  if (shouldHashAggrName(mangledAggrName)) {
+  const bool hash = shouldHashAggrName(mangledAggrName);
+  if (hash) {
     ret += hashSymbolName(mangledAggrName, ad);
   } else {
     ret += mangledAggrName;
@@ -151,6 +185,11 @@ std::string getIRMangledAggregateName(AggregateDeclaration *ad,
   if (suffix)
     ret += suffix;
 
+  if (hash) {
+    recordHashedSymbol(ret, ("_D" + mangledAggrName + (suffix ? suffix : ""))
+                                .str());
+  }
+
   return getIRMangledVarName(std::move(ret), LINKd);
 }
 }
@@ -189,3 +228,22 @@ std::string getIRMangledModuleRefSymbolName(const char *moduleMangle) {
   return getIRMangledVarName(
       (llvm::Twine("_D") + moduleMangle + "11__moduleRefZ").str(), LINKd);
 }
+
+void writeHashedSymbolMap() {
+  if (hashedSymbolMap.empty()) {
+    return;
+  }
+
+  std::error_code errinfo;
+  llvm::raw_fd_ostream os(hashedSymbolMap, errinfo, llvm::sys::fs::F_Text);
+  if (errinfo) {
+    error(Loc(), "cannot write hashed symbol map '%s': %s",
+          hashedSymbolMap.c_str(), errinfo.message().c_str());
+    fatal();
+  }
+
+  // One `<hashed mangle> <original mangle>` line per symbol.
+  for (const auto &entry : hashedSymbols) {
+    os << entry.first << ' ' << entry.second << '\n';
+  }
+}
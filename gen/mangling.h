@@ -43,4 +43,8 @@ std::string getIRMangledInterfaceInfosSymbolName(ClassDeclaration *cd);
 std::string getIRMangledModuleInfoSymbolName(Module *module);
 std::string getIRMangledModuleRefSymbolName(const char *moduleMangle);
 
+/// Writes the -hashed-symbol-map file (if requested), mapping the names hashed
+/// because of -hash-threshold to their original mangles.
+void writeHashedSymbolMap();
+
 #endif // LDC_GEN_MANGLING_H
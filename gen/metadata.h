@@ -48,4 +48,17 @@ enum ClassDataFields {
   CD_NumFields /// The number of fields in ClassInfo metadata
 };
 
+// *** Metadata for GC allocation sites (-gc-alloc-report) ***
+
+/// Attached to the druntime calls allocating GC memory. The node consists of
+/// the location, allocation kind, druntime function name, execution count
+/// and a unique site index.
+#define GC_ALLOC_SITE "ldc.gc_alloc_site"
+/// Named metadata listing all allocation sites of a module.
+#define GC_ALLOC_SITES "llvm.ldc.gc_alloc.sites"
+/// Named metadata listing the sites promoted to the stack / removed as unused
+/// by the GarbageCollect2Stack pass.
+#define GC_ALLOC_PROMOTED "llvm.ldc.gc_alloc.promoted"
+#define GC_ALLOC_REMOVED "llvm.ldc.gc_alloc.removed"
+
 #endif
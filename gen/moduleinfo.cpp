@@ -17,6 +17,7 @@
 #include "gen/mangling.h"
 #include "gen/rttibuilder.h"
 #include "gen/runtime.h"
+#include "gen/tollvm.h"
 #include "ir/irfunction.h"
 #include "ir/irmodule.h"
 #include "ir/irtype.h"
@@ -311,3 +312,44 @@ llvm::GlobalVariable *genModuleInfo(Module *m) {
   setLinkage({LLGlobalValue::ExternalLinkage, supportsCOMDAT()}, moduleInfoSym);
   return moduleInfoSym;
 }
+
+bool isLeafModule(Module *m) {
+  if (m->needModuleInfo() || getIrModule(m)->coverageCtor) {
+    return false;
+  }
+
+  ClassDeclarations aclasses;
+  for (auto s : *m->members) {
+    s->addLocalClass(&aclasses);
+  }
+  for (auto cd : aclasses) {
+    if (!cd->isInterfaceDeclaration()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+llvm::Constant *getLeafModulesPlaceholder() {
+  const char *name = "ldc.leaf_ModuleInfo";
+  if (auto existing = gIR->module.getGlobalVariable(name, true)) {
+    return existing;
+  }
+
+  const auto i32Ty = LLType::getInt32Ty(gIR->context());
+  llvm::Constant *fields[] = {
+      LLConstantInt::get(i32Ty, MInew | MIstandalone),
+      LLConstantInt::get(i32Ty, 0), // index
+      llvm::ConstantDataArray::getString(gIR->context(), "(leaf modules)")};
+  const auto init = LLConstantStruct::getAnon(fields);
+
+  auto placeholder = new LLGlobalVariable(gIR->module, init->getType(), false,
+                                          LLGlobalValue::LinkOnceODRLinkage,
+                                          init, name);
+  placeholder->setVisibility(LLGlobalValue::HiddenVisibility);
+  if (supportsCOMDAT()) {
+    placeholder->setComdat(gIR->module.getOrInsertComdat(name));
+  }
+  return placeholder;
+}
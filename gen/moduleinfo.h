@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 namespace llvm {
+class Constant;
 class GlobalVariable;
 }
 class Module;
@@ -18,3 +19,12 @@ class Module;
 /// Note that this just creates data itself, and is not concerned with emitting
 /// a reference pointing to it to register the module with the runtime.
 llvm::GlobalVariable *genModuleInfo(Module *m);
+
+/// Returns whether the given module's ModuleInfo doesn't have to be registered
+/// with the runtime, i.e., whether the module has no ctors/dtors/unittests,
+/// no imports needing ordering (needmoduleinfo) and no local classes.
+bool isLeafModule(Module *m);
+
+/// Returns the minimal, standalone ModuleInfo registered once per DSO in place
+/// of all its leaf modules (linkonce_odr, hidden).
+llvm::Constant *getLeafModulesPlaceholder();
@@ -22,17 +22,20 @@
 #include "statement.h"
 #include "target.h"
 #include "template.h"
+#include "ldcbindings.h"
 #include "driver/cl_options_instrumentation.h"
 #include "gen/abi.h"
 #include "gen/arrays.h"
 #include "gen/functions.h"
 #include "gen/irstate.h"
+#include "gen/recursivevisitor.h"
 #include "gen/llvm.h"
 #include "gen/llvmhelpers.h"
 #include "gen/logger.h"
 #include "gen/mangling.h"
 #include "gen/moduleinfo.h"
 #include "gen/optimizer.h"
+#include "gen/pgo_ASTbased.h"
 #include "gen/runtime.h"
 #include "gen/structs.h"
 #include "gen/tollvm.h"
@@ -40,6 +43,7 @@
 #include "ir/irfunction.h"
 #include "ir/irmodule.h"
 #include "ir/irvar.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
@@ -65,6 +69,19 @@ static llvm::cl::opt<bool, true>
              llvm::cl::desc("Write object files with fully qualified names"),
              llvm::cl::location(global.params.fullyQualifiedObjectFiles));
 
+static llvm::cl::opt<bool> elideLeafModuleInfo(
+    "elide-leaf-moduleinfo", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Don't register the ModuleInfos of modules without "
+                   "ctors/dtors, unittests and classes with the runtime (they "
+                   "won't be visited by `foreach (m; ModuleInfo)`)"));
+
+static llvm::cl::opt<bool> foldStaticCtorInitializers(
+    "fold-static-ctor-initializers", llvm::cl::ZeroOrMore,
+    llvm::cl::init(true),
+    llvm::cl::desc("When optimizing, evaluate the construction of immutable "
+                   "module-level variables in static constructors at compile "
+                   "time if possible, emitting them as read-only data"));
+
 void Module::checkAndAddOutputFile(File *file) {
   static std::map<std::string, Module *> files;
 
@@ -311,7 +328,8 @@ llvm::Function *buildRegisterDSO(RegistryStyle style, llvm::Value *dsoSlot,
   return fn;
 }
 
-void emitModuleRefToSection(RegistryStyle style, std::string moduleMangle,
+void emitModuleRefToSection(RegistryStyle style,
+                            const std::string &thismrefIRMangle,
                             llvm::Constant *thisModuleInfo) {
   assert(style == RegistryStyle::sectionMSVC ||
          style == RegistryStyle::sectionELF ||
@@ -330,8 +348,6 @@ void emitModuleRefToSection(RegistryStyle style, std::string moduleMangle,
           ? ".minfo"
           : style == RegistryStyle::sectionDarwin ? "__DATA,.minfo" : "__minfo";
 
-  const auto thismrefIRMangle =
-      getIRMangledModuleRefSymbolName(moduleMangle.c_str());
   auto thismref = defineDSOGlobal(thismrefIRMangle,
                                   DtoBitCast(thisModuleInfo, moduleInfoPtrTy));
   thismref->setSection(moduleInfoRefsSectionName);
@@ -554,9 +570,30 @@ void loadInstrProfileData(IRState *irs) {
 }
 
 void registerModuleInfo(Module *m) {
+  // The ModuleInfo is emitted in any case, as it may still be referenced
+  // (e.g., by _d_switch_error).
   const auto moduleInfoSym = genModuleInfo(m);
   const auto style = getModuleRegistryStyle();
 
+  if (elideLeafModuleInfo && isLeafModule(m)) {
+    IF_LOG Logger::println("Not registering ModuleInfo of leaf module %s",
+                           m->toPrettyChars());
+    // Without any .minfo reference, the DSO wouldn't be registered with
+    // _d_dso_registry, so register a single shared placeholder instead.
+    const char *leafRefName = "ldc.leaf_moduleRef";
+    if ((style == RegistryStyle::sectionELF ||
+         style == RegistryStyle::sectionDarwin) &&
+        !gIR->module.getGlobalVariable(leafRefName, true)) {
+      emitModuleRefToSection(style, leafRefName, getLeafModulesPlaceholder());
+      // Make sure the DSO ends up with a single reference.
+      if (supportsCOMDAT()) {
+        gIR->module.getGlobalVariable(leafRefName, true)
+            ->setComdat(gIR->module.getOrInsertComdat(leafRefName));
+      }
+    }
+    return;
+  }
+
   OutBuffer mangleBuf;
   mangleToBuffer(m, &mangleBuf);
   const char *mangle = mangleBuf.peekString();
@@ -565,11 +602,165 @@ void registerModuleInfo(Module *m) {
     const auto miCtor = build_module_reference_and_ctor(mangle, moduleInfoSym);
     AppendFunctionToLLVMGlobalCtorsDtors(miCtor, 65535, true);
   } else {
-    emitModuleRefToSection(style, mangle, moduleInfoSym);
+    emitModuleRefToSection(style, getIRMangledModuleRefSymbolName(mangle),
+                           moduleInfoSym);
   }
 }
 }
 
+namespace {
+/// Counts the references to each variable.
+struct VarReferenceCounter : public StoppableVisitor {
+  llvm::DenseMap<VarDeclaration *, unsigned> counts;
+
+  using StoppableVisitor::visit;
+
+  void visit(Statement *) override {}
+  void visit(Expression *) override {}
+  void visit(SymbolExp *e) override {
+    if (auto vd = e->var->isVarDeclaration())
+      ++counts[vd];
+  }
+  void visit(Declaration *) override {}
+  void visit(Initializer *) override {}
+  void visit(Dsymbol *) override {}
+};
+
+void collectStaticCtors(Dsymbols *members,
+                        std::vector<FuncDeclaration *> &ctors) {
+  if (!members)
+    return;
+  for (auto s : *members) {
+    if (auto ad = s->isAttribDeclaration()) {
+      collectStaticCtors(ad->include(nullptr), ctors);
+    } else if (auto fd = s->isStaticCtorDeclaration()) { // incl. shared ones
+      if (fd->fbody)
+        ctors.push_back(fd);
+    }
+  }
+}
+
+/// Returns whether the CTFE result `e` can be emitted as a static initializer,
+/// i.e., doesn't contain associative arrays, class instances or pointers into
+/// the CTFE heap.
+bool isStaticInitializer(Expression *e) {
+  switch (e->op) {
+  case TOKint64:
+  case TOKfloat64:
+  case TOKcomplex80:
+  case TOKnull:
+  case TOKstring:
+    return true;
+  case TOKarrayliteral: {
+    auto ale = static_cast<ArrayLiteralExp *>(e);
+    for (auto el : *ale->elements) {
+      if (!(el ? isStaticInitializer(el)
+               : ale->basis && isStaticInitializer(ale->basis))) {
+        return false;
+      }
+    }
+    return true;
+  }
+  case TOKstructliteral:
+    for (auto el : *static_cast<StructLiteralExp *>(e)->elements) {
+      if (el && !isStaticInitializer(el))
+        return false;
+    }
+    return true;
+  case TOKsymoff: {
+    // the address of a global or function
+    Declaration *var = static_cast<SymOffExp *>(e)->var;
+    if (auto vd = var->isVarDeclaration())
+      return vd->isDataseg();
+    auto fd = var->isFuncDeclaration();
+    return fd && !fd->isNested();
+  }
+  default:
+    return false;
+  }
+}
+
+/// Tries to turn `var = value` into a static initializer for var.
+bool foldConstruction(Module *m, ExpStatement *stmt,
+                      const llvm::DenseMap<VarDeclaration *, unsigned> &refs) {
+  Expression *e = stmt->exp;
+  if (!e || e->op != TOKconstruct)
+    return false;
+  auto ae = static_cast<AssignExp *>(e);
+  if (ae->e1->op != TOKvar)
+    return false;
+
+  // Only immutable variables of this module without initializer are folded,
+  // which are referenced by this construction only (i.e., not assigned again
+  // or escaping). As they are then emitted as read-only data, any other
+  // constructor writing to them would crash.
+  auto vd = static_cast<VarExp *>(ae->e1)->var->isVarDeclaration();
+  if (!vd || !vd->isDataseg() || vd->toParent() != m || vd->_init ||
+      !vd->type->isImmutable() ||
+      (vd->storage_class & (STCextern | STCref | STCinit)) ||
+      refs.lookup(vd) != 1) {
+    return false;
+  }
+  if (!ae->e2->type->immutableOf()->equals(vd->type->immutableOf()))
+    return false;
+
+  unsigned errors = global.startGagging();
+  Expression *value = ctfeInterpret(ae->e2);
+  if (global.endGagging(errors) || value->op == TOKerror ||
+      !isStaticInitializer(value)) {
+    return false;
+  }
+
+  IF_LOG Logger::println("Folded construction of `%s` in static ctor: %s",
+                         vd->toPrettyChars(), value->toChars());
+  vd->_init = createExpInitializer(ae->loc, value);
+  stmt->exp = nullptr;
+  return true;
+}
+
+/// Folds the constructions at the start of a static ctor body; returns false
+/// at the first statement which isn't a foldable construction, leaving the
+/// order of the remaining side effects unchanged.
+bool foldLeadingConstructions(
+    Module *m, Statement *s,
+    const llvm::DenseMap<VarDeclaration *, unsigned> &refs) {
+  if (!s)
+    return true;
+  if (auto cs = s->isCompoundStatement()) {
+    for (auto child : *cs->statements) {
+      if (!foldLeadingConstructions(m, child, refs))
+        return false;
+    }
+    return true;
+  }
+  if (auto ss = s->isScopeStatement())
+    return foldLeadingConstructions(m, ss->statement, refs);
+  if (auto es = s->isExpStatement())
+    return foldConstruction(m, es, refs);
+  return false;
+}
+
+/// Moves the construction of immutable module-level variables at the start of
+/// the static ctors to their static initializers if the constructed values can
+/// be evaluated at compile time, like the initializers of variables declared
+/// with one. Runtime construction remains the fallback.
+void foldStaticCtorConstructions(Module *m) {
+  std::vector<FuncDeclaration *> ctors;
+  collectStaticCtors(m->members, ctors);
+  if (ctors.empty())
+    return;
+
+  VarReferenceCounter counter;
+  for (auto fd : ctors) {
+    RecursiveWalker walker(&counter);
+    fd->fbody->accept(&walker);
+  }
+
+  for (auto fd : ctors)
+    foldLeadingConstructions(m, fd->fbody, counter.counts);
+}
+}
+
 void codegenModule(IRState *irs, Module *m) {
   assert(!irs->dmodule &&
          "irs->module not null, codegen already in progress?!");
@@ -592,6 +783,12 @@ void codegenModule(IRState *irs, Module *m) {
     loadInstrProfileData(gIR);
   }
 
+  // Before emitting the variables, as their initializers may change.
+  if (foldStaticCtorInitializers && isOptimizationEnabled() &&
+      !isPseudoModule) {
+    foldStaticCtorConstructions(m);
+  }
+
   // process module members
   // NOTE: m->members may grow during codegen
   for (unsigned k = 0; k < m->members->dim; k++) {
@@ -604,6 +801,8 @@ void codegenModule(IRState *irs, Module *m) {
     fatal();
   }
 
+  declareHotIndirectCallTargets(irs);
+
   // Skip emission of all the additional module metadata if:
   // a) the -betterC switch is on,
   // b) requested explicitly by the user via pragma(LDC_no_moduleinfo), or if
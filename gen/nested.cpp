@@ -19,6 +19,8 @@
 #include "ir/irfunction.h"
 #include "ir/irtypeaggr.h"
 #include "llvm/Analysis/ValueTracking.h"
+#include <algorithm>
+#include <vector>
 
 static unsigned getVthisIdx(AggregateDeclaration *ad) {
   return getFieldGEPIndex(ad, ad->vthis);
@@ -370,10 +372,23 @@ static void DtoCreateNestedContextType(FuncDeclaration *fd) {
   }
 
   // Add the direct nested variables of this function, and update their
-  // indices to match.
-  // TODO: optimize ordering for minimal space usage?
+  // indices to match. They are sorted by decreasing alignment to minimize the
+  // padding; the sort is stable so that the layout is the same in all modules
+  // accessing the frame.
+  std::vector<std::pair<unsigned, VarDeclaration *>> closureVars;
+  closureVars.reserve(fd->closureVars.dim);
   for (auto vd : fd->closureVars) {
-    unsigned alignment = DtoAlignment(vd);
+    closureVars.emplace_back(DtoAlignment(vd), vd);
+  }
+  std::stable_sort(closureVars.begin(), closureVars.end(),
+                   [](const std::pair<unsigned, VarDeclaration *> &a,
+                      const std::pair<unsigned, VarDeclaration *> &b) {
+                     return a.first > b.first;
+                   });
+
+  for (const auto &pair : closureVars) {
+    const unsigned alignment = pair.first;
+    VarDeclaration *const vd = pair.second;
     if (alignment > 1) {
       builder.alignCurrentOffset(alignment);
     }
@@ -0,0 +1,152 @@
+//===-- nrvo.cpp ----------------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gen/nrvo.h"
+
+#include "dmd/aggregate.h"
+#include "dmd/declaration.h"
+#include "dmd/expression.h"
+#include "dmd/mtype.h"
+#include "dmd/statement.h"
+#include "gen/llvmhelpers.h"
+#include "gen/logger.h"
+#include "gen/recursivevisitor.h"
+#include "gen/tollvm.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include <algorithm>
+
+namespace {
+
+/// Collects the returned locals, the innermost scope statement each local is
+/// declared in (null for the function body) and the lexical order of the
+/// declarations and scope ends.
+class ReturnedLocalsCollector : public RecursiveVisitor {
+  ScopeStatement *currentScope = nullptr;
+  unsigned position = 0;
+
+public:
+  using RecursiveVisitor::visit;
+
+  struct ScopeInfo {
+    ScopeStatement *parent;
+    unsigned end;
+  };
+  struct LocalInfo {
+    ScopeStatement *scope;
+    unsigned position;
+  };
+
+  llvm::DenseMap<ScopeStatement *, ScopeInfo> scopes;
+  llvm::DenseMap<VarDeclaration *, LocalInfo> locals;
+  llvm::SmallVector<VarDeclaration *, 4> returnedLocals;
+  bool onlyLocalsReturned = true;
+
+  void visit(ScopeStatement *stmt) override {
+    ScopeStatement *const parent = currentScope;
+    currentScope = stmt;
+    recurse(stmt->statement);
+    currentScope = parent;
+    scopes[stmt] = {parent, position++};
+  }
+
+  void visit(DeclarationExp *e) override {
+    if (VarDeclaration *vd = e->declaration->isVarDeclaration())
+      locals[vd] = {currentScope, position++};
+    RecursiveVisitor::visit(e);
+  }
+
+  void visit(ReturnStatement *stmt) override {
+    VarDeclaration *vd = nullptr;
+    if (stmt->exp && stmt->exp->op == TOKvar)
+      vd = static_cast<VarExp *>(stmt->exp)->var->isVarDeclaration();
+
+    if (!vd) {
+      onlyLocalsReturned = false;
+    } else if (std::find(returnedLocals.begin(), returnedLocals.end(), vd) ==
+               returnedLocals.end()) {
+      returnedLocals.push_back(vd);
+    }
+  }
+
+  /// Returns whether `inner` is `outer` or nested in it.
+  bool isNestedIn(ScopeStatement *inner, ScopeStatement *outer) const {
+    for (ScopeStatement *s = inner; s; s = scopes.lookup(s).parent) {
+      if (s == outer)
+        return true;
+    }
+    return !outer;
+  }
+
+  /// Returns whether the lifetime of `inner`, declared in a scope nested in
+  /// the scope of `outer`, may overlap with the lifetime of `outer`. A local
+  /// lives until the end of its scope (in each loop iteration), so they
+  /// don't overlap if the scope of `inner` ends before `outer` is declared.
+  bool mayOverlap(const LocalInfo &inner, const LocalInfo &outer) const {
+    return inner.scope == outer.scope ||
+           scopes.lookup(inner.scope).end > outer.position;
+  }
+
+  bool haveDisjointLifetimes(VarDeclaration *a, VarDeclaration *b) const {
+    const LocalInfo &infoA = locals.find(a)->second;
+    const LocalInfo &infoB = locals.find(b)->second;
+    if (isNestedIn(infoA.scope, infoB.scope))
+      return !mayOverlap(infoA, infoB);
+    if (isNestedIn(infoB.scope, infoA.scope))
+      return !mayOverlap(infoB, infoA);
+    return true;
+  }
+};
+
+bool hasPostblit(Type *t) {
+  t = t->baseElemOf();
+  return t->ty == Tstruct && static_cast<TypeStruct *>(t)->sym->postblit;
+}
+
+/// Returns whether the local can be constructed in the sret slot without
+/// changing the semantics of copying it into the slot when returning it.
+bool canLiveInSretSlot(FuncDeclaration *fd, VarDeclaration *vd,
+                       llvm::Type *sretType) {
+  return vd->toParent2() == fd && !vd->isDataseg() && !vd->isParameter() &&
+         !(vd->storage_class & (STCref | STCout | STClazy)) &&
+         !isSpecialRefVar(vd) && vd->nestedrefs.dim == 0 && !vd->edtor &&
+         !hasPostblit(vd->type) && DtoType(vd->type) == sretType;
+}
+}
+
+void findSretLocals(FuncDeclaration *fd, llvm::Type *sretType,
+                    llvm::SmallPtrSetImpl<VarDeclaration *> &sretLocals) {
+  // the frontend's NRVO and functions with a __result variable are handled in
+  // DtoVarDeclaration(); inline asm (hasReturnExp & 8) may return anything
+  if ((fd->nrvo_can && fd->nrvo_var) || fd->vresult || fd->returnLabel ||
+      (fd->hasReturnExp & 8) || !fd->fbody) {
+    return;
+  }
+
+  ReturnedLocalsCollector collector;
+  fd->fbody->accept(&collector);
+  if (!collector.onlyLocalsReturned || collector.returnedLocals.empty())
+    return;
+
+  for (size_t i = 0; i < collector.returnedLocals.size(); ++i) {
+    VarDeclaration *vd = collector.returnedLocals[i];
+    if (!collector.locals.count(vd) || !canLiveInSretSlot(fd, vd, sretType))
+      return;
+
+    for (size_t j = 0; j < i; ++j) {
+      if (!collector.haveDisjointLifetimes(vd, collector.returnedLocals[j]))
+        return;
+    }
+  }
+
+  for (VarDeclaration *vd : collector.returnedLocals) {
+    IF_LOG Logger::println("Allocating %s in the sret slot", vd->toChars());
+    sretLocals.insert(vd);
+  }
+}
@@ -0,0 +1,39 @@
+//===-- gen/nrvo.h - Named return value optimization ------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Extends the frontend's NRVO (FuncDeclaration::nrvo_var) to functions
+// returning one of several locals with disjoint lifetimes, e.g.:
+//
+//   S f(bool c) {
+//     if (c) { S a; ...; return a; }
+//     S b; ...; return b;
+//   }
+//
+// All of these locals are then allocated in the sret slot.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_GEN_NRVO_H
+#define LDC_GEN_NRVO_H
+
+#include "llvm/ADT/SmallPtrSet.h"
+
+class FuncDeclaration;
+class VarDeclaration;
+namespace llvm {
+class Type;
+}
+
+/// Adds the locals of the function to be defined which can be allocated in its
+/// sret slot of type `sretType*` to `sretLocals`; either none or all returned
+/// locals.
+void findSretLocals(FuncDeclaration *fd, llvm::Type *sretType,
+                    llvm::SmallPtrSetImpl<VarDeclaration *> &sretLocals);
+
+#endif
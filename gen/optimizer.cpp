@@ -16,11 +16,14 @@
 #include "driver/cl_options.h"
 #include "driver/cl_options_instrumentation.h"
 #include "driver/cl_options_sanitizers.h"
+#include "driver/plugins.h"
 #include "driver/targetmachine.h"
+#include "driver/timereport.h"
 #include "llvm/LinkAllPasses.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/Triple.h"
 #if LDC_LLVM_VER >= 400
 #include "llvm/Analysis/InlineCost.h"
@@ -34,8 +37,19 @@
 #include "llvm/Transforms/Instrumentation.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#if LDC_LLVM_VER >= 600
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/GlobalDCE.h"
+#if LDC_LLVM_VER >= 700
+#include "llvm/Transforms/Scalar/InductiveRangeCheckElimination.h"
+#endif
+#endif
+#include <mutex>
 
-extern llvm::TargetMachine *gTargetMachine;
+extern thread_local llvm::TargetMachine *gTargetMachine;
 using namespace llvm;
 
 static cl::opt<signed char> optimizeLevel(
@@ -55,6 +69,24 @@ static cl::opt<signed char> optimizeLevel(
 static cl::opt<bool> noVerify("disable-verify", cl::ZeroOrMore, cl::Hidden,
                               cl::desc("Do not verify result module"));
 
+enum class VerifyPolicy { Always, Debug, Sampled };
+static cl::opt<VerifyPolicy> verifyPolicy(
+    "verify-policy", cl::ZeroOrMore, cl::Hidden,
+    cl::desc("Set which modules are verified before and after optimization"),
+    cl::init(VerifyPolicy::Always),
+    clEnumValues(
+        clEnumValN(VerifyPolicy::Always, "always", "Every module (default)"),
+        clEnumValN(VerifyPolicy::Debug, "debug",
+                   "Every module if the compiler was built with assertions, "
+                   "none otherwise"),
+        clEnumValN(VerifyPolicy::Sampled, "sampled",
+                   "1 in -verify-sample-period modules, selected by name")));
+
+static cl::opt<unsigned> verifySamplePeriod(
+    "verify-sample-period", cl::ZeroOrMore, cl::Hidden,
+    cl::desc("Verify 1 in <n> modules with -verify-policy=sampled"),
+    cl::value_desc("n"), cl::init(16));
+
 static cl::opt<bool>
     verifyEach("verify-each", cl::ZeroOrMore, cl::Hidden,
                cl::desc("Run verifier after D-specific and explicitly "
@@ -76,6 +108,15 @@ static cl::opt<bool> disableGCToStack(
     "disable-gc2stack", cl::ZeroOrMore,
     cl::desc("Disable promotion of GC allocations to stack memory"));
 
+static cl::opt<bool> disableFunctionSpecialization(
+    "disable-function-specialization", cl::ZeroOrMore,
+    cl::desc("Disable specializing functions for constant function pointer "
+             "and delegate arguments"));
+
+static cl::opt<bool> disableBoundsCheckElimination(
+    "disable-bounds-check-elimination", cl::ZeroOrMore,
+    cl::desc("Disable hoisting array bounds checks out of loops"));
+
 static cl::opt<cl::boolOrDefault, false, opts::FlagParser<cl::boolOrDefault>>
     enableInlining(
         "inlining", cl::ZeroOrMore,
@@ -83,9 +124,15 @@ static cl::opt<cl::boolOrDefault, false, opts::FlagParser<cl::boolOrDefault>>
 
 static cl::opt<cl::boolOrDefault, false, opts::FlagParser<cl::boolOrDefault>>
     enableCrossModuleInlining(
-        "cross-module-inlining", cl::ZeroOrMore, cl::Hidden,
+        "cross-module-inlining", cl::ZeroOrMore,
         cl::desc("(*) Enable cross-module function inlining (default disabled)"));
 
+static cl::opt<cl::boolOrDefault, false, opts::FlagParser<cl::boolOrDefault>>
+    splitColdCode("split-cold-code", cl::ZeroOrMore,
+                  cl::desc("(*) Outline cold code into separate functions "
+                           "(default with a PGO profile in -O2 and higher; "
+                           "LLVM 7+)"));
+
 static cl::opt<bool> unitAtATime("unit-at-a-time", cl::desc("Enable basic IPO"),
                                  cl::ZeroOrMore, cl::init(true));
 
@@ -104,6 +151,17 @@ static cl::opt<bool>
     disableSLPVectorization("disable-slp-vectorization", cl::ZeroOrMore,
                             cl::desc("Disable the slp vectorization pass"));
 
+enum class PassManagerKind { Legacy, New };
+static cl::opt<PassManagerKind> passManager(
+    "passmanager", cl::ZeroOrMore,
+    cl::desc("Set the LLVM pass manager for the optimizer (default: legacy)"),
+    cl::init(PassManagerKind::Legacy),
+    clEnumValues(
+        clEnumValN(PassManagerKind::Legacy, "legacy", "Legacy pass manager"),
+        clEnumValN(PassManagerKind::New, "new",
+                   "New pass manager (LLVM 6+; falls back to the legacy one "
+                   "for unsupported options)")));
+
 unsigned optLevel() {
   // Use -O2 as a base for the size-optimization levels.
   return optimizeLevel >= 0 ? optimizeLevel : 2;
@@ -117,6 +175,19 @@ bool willInline() {
          (enableInlining == cl::BOU_UNSET && optLevel() > 1);
 }
 
+// Determines whether cold code is split out of hot functions. Without a
+// profile, only the failure paths are known to be cold, so this is enabled by
+// default only when optimizing with a PGO profile.
+static bool willSplitColdCode() {
+#if LDC_LLVM_VER >= 700
+  return splitColdCode == cl::BOU_TRUE ||
+         (splitColdCode == cl::BOU_UNSET && opts::isUsingPGOProfile() &&
+          optLevel() > 1);
+#else
+  return false;
+#endif
+}
+
 bool willCrossModuleInline() {
   return enableCrossModuleInlining == llvm::cl::BOU_TRUE;
 }
@@ -129,6 +200,8 @@ bool willEliminateFramePointer() {
 
 bool isOptimizationEnabled() { return optimizeLevel != 0; }
 
+bool isOptimizingForSize() { return sizeLevel() > 0; }
+
 llvm::CodeGenOpt::Level codeGenOptLevel() {
   // Use same appoach as clang (see lib/CodeGen/BackendUtil.cpp)
   if (optLevel() == 0) {
@@ -170,6 +243,58 @@ static void addGarbageCollect2StackPass(const PassManagerBuilder &builder,
   }
 }
 
+// Specializing duplicates functions, so it isn't done when optimizing for size.
+static void addSpecializeFunctionsPass(const PassManagerBuilder &builder,
+                                       PassManagerBase &pm) {
+  if (builder.OptLevel >= 2 && builder.SizeLevel == 0) {
+    addPass(pm, createSpecializeFunctionsPass());
+  }
+}
+
+// The InductiveRangeCheckElimination pass splits loops indexing an array up to
+// its length into a main loop without bounds checks and pre/post loops with
+// them. It duplicates loops, so it isn't run when optimizing for size.
+static void addBoundsCheckEliminationPass(const PassManagerBuilder &builder,
+                                          PassManagerBase &pm) {
+  if (builder.OptLevel >= 2 && builder.SizeLevel == 0) {
+    addPass(pm, createInductiveRangeCheckEliminationPass());
+  }
+}
+
+#if LDC_LLVM_VER >= 500
+static void addWholeProgramDevirtPasses(const PassManagerBuilder &builder,
+                                        PassManagerBase &pm) {
+  addPass(pm, createWholeProgramDevirtPass(nullptr, nullptr));
+  addPass(pm, createLowerTypeTestsPass(nullptr, nullptr));
+}
+
+static void addLowerTypeTestsPass(const PassManagerBuilder &builder,
+                                  PassManagerBase &pm) {
+  addPass(pm, createLowerTypeTestsPass(nullptr, nullptr));
+}
+#endif
+
+#if LDC_LLVM_VER >= 700
+static void addMarkColdDRuntimeCallsPass(const PassManagerBuilder &builder,
+                                         PassManagerBase &pm) {
+  if (builder.OptLevel >= 1) {
+    addPass(pm, createMarkColdDRuntimeCallsPass());
+  }
+}
+
+// Outlines cold blocks (those ending in unreachable, landing pads, blocks
+// calling cold functions and, with a profile, never executed blocks) into
+// separate functions, so that the hot code becomes denser and inlines better.
+// As in LLVM's own pipeline, this is done in the link step with (Thin)LTO.
+static void addHotColdSplittingPass(const PassManagerBuilder &builder,
+                                    PassManagerBase &pm) {
+  if (builder.OptLevel >= 1 && !builder.PrepareForLTO &&
+      !builder.PrepareForThinLTO) {
+    addPass(pm, createHotColdSplittingPass());
+  }
+}
+#endif
+
 static void addAddressSanitizerPasses(const PassManagerBuilder &Builder,
                                       PassManagerBase &PM) {
   PM.add(createAddressSanitizerFunctionPass());
@@ -206,6 +331,11 @@ static void addSanitizerCoveragePass(const PassManagerBuilder &Builder,
 #endif
 }
 
+static void addAddDiscriminatorsPass(const PassManagerBuilder &Builder,
+                                     legacy::PassManagerBase &PM) {
+  PM.add(createAddDiscriminatorsPass());
+}
+
 // Adds PGO instrumentation generation and use passes.
 static void addPGOPasses(PassManagerBuilder &builder,
                          legacy::PassManagerBase &mpm, unsigned optLevel) {
@@ -231,6 +361,14 @@ static void addPGOPasses(PassManagerBuilder &builder,
     builder.PGOInstrGen = global.params.datafileInstrProf;
   } else if (opts::isUsingIRBasedPGOProfile()) {
     builder.PGOInstrUse = global.params.datafileInstrProf;
+  } else if (opts::isUsingSampleBasedPGOProfile()) {
+#if LDC_LLVM_VER >= 500
+    // The sample profile loader is added by the PassManagerBuilder, it needs
+    // discriminators to tell apart samples of code on the same line.
+    builder.addExtension(PassManagerBuilder::EP_EarlyAsPossible,
+                         addAddDiscriminatorsPass);
+    builder.PGOSampleUse = global.params.datafileInstrProf;
+#endif
   }
 }
 
@@ -243,8 +381,9 @@ static void addPGOPasses(PassManagerBuilder &builder,
  */
 static void addOptimizationPasses(legacy::PassManagerBase &mpm,
                                   legacy::FunctionPassManager &fpm,
-                                  unsigned optLevel, unsigned sizeLevel) {
-  if (!noVerify) {
+                                  unsigned optLevel, unsigned sizeLevel,
+                                  bool verify) {
+  if (verify) {
     fpm.add(createVerifierPass());
   }
 
@@ -325,7 +464,40 @@ static void addOptimizationPasses(legacy::PassManagerBase &mpm,
       builder.addExtension(PassManagerBuilder::EP_LoopOptimizerEnd,
                            addGarbageCollect2StackPass);
     }
+
+    if (!disableBoundsCheckElimination) {
+      builder.addExtension(PassManagerBuilder::EP_LoopOptimizerEnd,
+                           addBoundsCheckEliminationPass);
+    }
+
+    // before the inliner, so that it can inline the now direct calls
+    if (!disableFunctionSpecialization) {
+      builder.addExtension(PassManagerBuilder::EP_ModuleOptimizerEarly,
+                           addSpecializeFunctionsPass);
+    }
+  }
+
+#if LDC_LLVM_VER >= 700
+  if (willSplitColdCode()) {
+    // Failure paths of D code are always cold, independent of the profile.
+    if (!disableLangSpecificPasses) {
+      builder.addExtension(PassManagerBuilder::EP_EarlyAsPossible,
+                           addMarkColdDRuntimeCallsPass);
+    }
+    builder.addExtension(PassManagerBuilder::EP_OptimizerLast,
+                         addHotColdSplittingPass);
+  }
+#endif
+
+#if LDC_LLVM_VER >= 500
+  // With -flto, the passes are run at link time, on the whole program.
+  if (opts::wholeProgramVtables && !opts::isUsingLTO()) {
+    builder.addExtension(PassManagerBuilder::EP_ModuleOptimizerEarly,
+                         addWholeProgramDevirtPasses);
+    builder.addExtension(PassManagerBuilder::EP_EnabledOnOptLevel0,
+                         addLowerTypeTestsPass);
   }
+#endif
 
   // EP_OptimizerLast does not exist in LLVM 3.0, add it manually below.
   builder.addExtension(PassManagerBuilder::EP_OptimizerLast,
@@ -337,6 +509,227 @@ static void addOptimizationPasses(legacy::PassManagerBase &mpm,
   builder.populateModulePassManager(mpm);
 }
 
+#if LDC_LLVM_VER >= 600
+// Returns whether the optimization settings are supported by the new pass
+// manager pipeline below. The others are only implemented for the legacy one.
+static bool canUseNewPassManager() {
+  const char *unsupported = nullptr;
+  if (opts::isAnySanitizerEnabled())
+    unsupported = "sanitizers";
+  else if (opts::isInstrumentingForASTBasedPGO() ||
+           opts::isUsingASTBasedPGOProfile() ||
+           opts::isInstrumentingForIRBasedPGO() ||
+           opts::isUsingIRBasedPGOProfile())
+    unsupported = "PGO";
+  else if (enableInlining != cl::BOU_UNSET ||
+           splitColdCode != cl::BOU_UNSET ||
+           disableLoopUnrolling.getNumOccurrences() > 0 ||
+           disableLoopVectorization || disableSLPVectorization || !unitAtATime)
+    unsupported = "the specified pass tuning options";
+  else if (opts::wholeProgramVtables)
+    unsupported = "-fwhole-program-vtables";
+
+  if (unsupported) {
+    IF_LOG Logger::println("New pass manager doesn't support %s yet, using "
+                           "the legacy one",
+                           unsupported);
+    return false;
+  }
+  return true;
+}
+
+// Returns whether to optimize with the new pass manager. It is used by default
+// if pass plugins are loaded, whose passes are only run by it.
+static bool useNewPassManager() {
+  if (passManager == PassManagerKind::New)
+    return canUseNewPassManager();
+#if LDC_LLVM_VER >= 700
+  if (passManager.getNumOccurrences() == 0 && hasPassPlugins()) {
+    if (canUseNewPassManager())
+      return true;
+    static std::once_flag warned;
+    std::call_once(warned, [] {
+      warning(Loc(), "Pass plugins are only run by the new pass manager, "
+                     "which doesn't support the specified options");
+    });
+  }
+#endif
+  return false;
+}
+
+static PassBuilder::OptimizationLevel getNewPMOptimizationLevel() {
+  switch (optimizeLevel) {
+  case -2:
+    return PassBuilder::Oz;
+  case -1:
+    return PassBuilder::Os;
+  case 0:
+    return PassBuilder::O0;
+  case 1:
+    return PassBuilder::O1;
+  case 2:
+    return PassBuilder::O2;
+  default:
+    return PassBuilder::O3;
+  }
+}
+
+namespace {
+/// The new pass manager pipeline and analysis managers. Building the pipeline
+/// and registering all analyses is done once per thread (and target machine)
+/// and reused for all modules; only the cached analysis results are cleared
+/// after each module.
+struct NewPMPipeline {
+  const TargetMachine *target;
+  const std::string triple;
+  TargetLibraryInfoImpl tlii;
+  PassBuilder builder;
+  LoopAnalysisManager lam;
+  FunctionAnalysisManager fam;
+  CGSCCAnalysisManager cgam;
+  ModuleAnalysisManager mam;
+  ModulePassManager mpm;
+
+  NewPMPipeline(TargetMachine *target, const Triple &triple)
+      : target(target), triple(triple.str()), tlii(triple), builder(target) {
+    // The -disable-simplify-libcalls flag actually disables all builtin
+    // optzns.
+    if (disableSimplifyLibCalls)
+      tlii.disableAllFunctions();
+
+    // Register the AA manager and TLI first, so that the defaults don't
+    // override them.
+    fam.registerPass([this] { return builder.buildDefaultAAPipeline(); });
+    fam.registerPass([this] { return TargetLibraryAnalysis(tlii); });
+    builder.registerModuleAnalyses(mam);
+    builder.registerCGSCCAnalyses(cgam);
+    builder.registerFunctionAnalyses(fam);
+    builder.registerLoopAnalyses(lam);
+    builder.crossRegisterProxies(lam, fam, cgam, mam);
+
+    buildPipeline();
+  }
+
+  void buildPipeline() {
+    const bool runDPasses =
+        !disableLangSpecificPasses && optLevel() >= 2 && sizeLevel() == 0;
+    if (runDPasses) {
+      // The equivalent of EP_LoopOptimizerEnd for function passes.
+      builder.registerScalarOptimizerLateEPCallback(
+          [](FunctionPassManager &fpm, PassBuilder::OptimizationLevel) {
+            if (!disableSimplifyDruntimeCalls) {
+              fpm.addPass(SimplifyDRuntimeCallsPass());
+              if (verifyEach)
+                fpm.addPass(VerifierPass());
+            }
+            if (!disableGCToStack) {
+              fpm.addPass(GarbageCollect2StackPass());
+              if (verifyEach)
+                fpm.addPass(VerifierPass());
+            }
+          });
+
+#if LDC_LLVM_VER >= 700
+      // See addSpecializeFunctionsPass().
+      if (!disableFunctionSpecialization) {
+        builder.registerPipelineStartEPCallback([](ModulePassManager &mpm) {
+          mpm.addPass(SpecializeFunctionsPass());
+          if (verifyEach)
+            mpm.addPass(VerifierPass());
+        });
+      }
+
+      // See addBoundsCheckEliminationPass().
+      if (!disableBoundsCheckElimination) {
+        builder.registerLateLoopOptimizationsEPCallback(
+            [](LoopPassManager &lpm, PassBuilder::OptimizationLevel) {
+              lpm.addPass(IRCEPass());
+            });
+      }
+#endif
+    }
+
+#if LDC_LLVM_VER >= 700
+    // After the D passes, so that plugin passes at the same extension points
+    // run after them.
+    registerPassPluginCallbacks(builder);
+#endif
+
+    const auto level = getNewPMOptimizationLevel();
+    if (level == PassBuilder::O0) {
+      mpm.addPass(AlwaysInlinerPass());
+    } else if (opts::isUsingThinLTO()) {
+      mpm.addPass(builder.buildThinLTOPreLinkDefaultPipeline(level));
+    } else if (opts::isUsingLTO()) {
+      mpm.addPass(builder.buildLTOPreLinkDefaultPipeline(level));
+    } else {
+      mpm.addPass(builder.buildPerModuleDefaultPipeline(level));
+    }
+
+    if (optLevel() >= 1) {
+      mpm.addPass(StripExternalsPass());
+      mpm.addPass(GlobalDCEPass());
+    }
+  }
+
+  void run(Module &m) {
+    mpm.run(m, mam);
+    lam.clear();
+    fam.clear();
+    cgam.clear();
+    mam.clear();
+  }
+};
+}
+
+static void runNewPassManager(llvm::Module *M, bool verify) {
+  static thread_local std::unique_ptr<NewPMPipeline> pipeline;
+  const Triple triple(M->getTargetTriple());
+  if (!pipeline || pipeline->target != gTargetMachine ||
+      pipeline->triple != triple.str()) {
+    pipeline = llvm::make_unique<NewPMPipeline>(gTargetMachine, triple);
+  }
+
+  // If the -strip-debug command line option was specified, do it before
+  // anything else.
+  if (stripDebug) {
+    StripDebugInfo(*M);
+  }
+
+  // The pipeline is shared by all modules, so verify the input separately.
+  if (verify) {
+    verifyModule(M);
+  }
+
+  pipeline->run(*M);
+}
+#endif
+
+// Returns whether the module is to be verified before and after optimization,
+// see -disable-verify and -verify-policy.
+static bool shouldVerify(llvm::Module *M) {
+  if (noVerify)
+    return false;
+
+  switch (verifyPolicy) {
+  case VerifyPolicy::Always:
+    return true;
+  case VerifyPolicy::Debug:
+#ifdef NDEBUG
+    return false;
+#else
+    return true;
+#endif
+  case VerifyPolicy::Sampled:
+    // Select by module name, not by order, so that the same modules are
+    // verified with parallel, incremental and cached builds.
+    return verifySamplePeriod <= 1 ||
+           llvm::hash_value(M->getModuleIdentifier()) % verifySamplePeriod ==
+               0;
+  }
+  llvm_unreachable("Unknown verify policy");
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // This function runs optimization passes based on command line arguments.
 // Returns true if any optimization passes were invoked.
@@ -355,6 +748,23 @@ bool ldc_optimize_module(llvm::Module *M) {
   if (getComputeTargetType(M) == ComputeBackend::SPIRV)
     return false;
 
+  timereport::Scope timeScope("Optimization", nullptr,
+                              M->getModuleIdentifier().c_str());
+
+  const bool verify = shouldVerify(M);
+
+#if LDC_LLVM_VER >= 600
+  if (useNewPassManager()) {
+    runNewPassManager(M, verify);
+
+    // Verify the resulting module.
+    if (verify) {
+      verifyModule(M);
+    }
+    return true;
+  }
+#endif
+
   // Add an appropriate TargetLibraryInfo pass for the module's triple.
   TargetLibraryInfoImpl *tlii =
       new TargetLibraryInfoImpl(Triple(M->getTargetTriple()));
@@ -387,7 +797,7 @@ bool ldc_optimize_module(llvm::Module *M) {
     mpm.add(createStripSymbolsPass(true));
   }
 
-  addOptimizationPasses(mpm, fpm, optLevel(), sizeLevel());
+  addOptimizationPasses(mpm, fpm, optLevel(), sizeLevel(), verify);
 
   // Run per-function passes.
   fpm.doInitialization();
@@ -400,7 +810,7 @@ bool ldc_optimize_module(llvm::Module *M) {
   mpm.run(*M);
 
   // Verify the resulting module.
-  if (!noVerify) {
+  if (verify) {
     verifyModule(M);
   }
 
@@ -436,4 +846,5 @@ void outputOptimizationSettings(llvm::raw_ostream &hash_os) {
   hash_os << disableLoopUnrolling;
   hash_os << disableLoopVectorization;
   hash_os << disableSLPVectorization;
+  hash_os << static_cast<int>(passManager.getValue());
 }
@@ -41,6 +41,9 @@ unsigned optLevel();
 
 bool isOptimizationEnabled();
 
+// Returns whether -Os or -Oz is used.
+bool isOptimizingForSize();
+
 llvm::CodeGenOpt::Level codeGenOptLevel();
 
 void verifyModule(llvm::Module *m);
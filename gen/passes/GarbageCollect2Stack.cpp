@@ -12,6 +12,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "driver/timereport.h"
 #include "gen/runtime.h"
 #include "gen/metadata.h"
 #include "gen/attributes.h"
@@ -30,6 +31,7 @@
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/CallSite.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/IR/Dominators.h"
@@ -42,6 +44,7 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #if LDC_LLVM_VER >= 500
 #include "llvm/Support/KnownBits.h"
 #endif
@@ -53,6 +56,8 @@ using namespace llvm;
 STATISTIC(NumGcToStack, "Number of calls promoted to constant-size allocas");
 STATISTIC(NumToDynSize,
           "Number of calls promoted to dynamically-sized allocas");
+STATISTIC(NumGuarded, "Number of calls promoted to stack buffers of fixed size, "
+                      "guarded by a runtime check of the array length");
 STATISTIC(NumDeleted,
           "Number of GC calls deleted because the return value was unused");
 
@@ -62,6 +67,18 @@ static cl::opt<unsigned>
               cl::desc("Require allocs to be smaller than n bytes to be "
                        "promoted, 0 to ignore."));
 
+static cl::opt<unsigned> GuardedSize(
+    "dgc2stack-guarded-size", cl::ZeroOrMore, cl::Hidden, cl::init(0),
+    cl::desc("Promote dynamic arrays whose length isn't known to be small "
+             "enough to stack buffers of n bytes, used if the array fits at "
+             "runtime (and otherwise falling back to the GC), 0 to disable."));
+
+static cl::opt<unsigned>
+    IPADepth("dgc2stack-ipa-depth", cl::ZeroOrMore, cl::Hidden, cl::init(3),
+             cl::desc("Look into up to n levels of calls to functions defined "
+                      "in the module to see if they capture a GC allocation, "
+                      "0 to only rely on 'nocapture' attributes."));
+
 namespace {
 struct Analysis {
   const DataLayout &DL;
@@ -113,6 +130,10 @@ protected:
 public:
   ReturnType::Type ReturnType;
 
+  // Set by analyze() if the allocation can only be promoted to a stack buffer
+  // for up to this number of elements, which needs to be checked at runtime.
+  uint64_t GuardedLength = 0;
+
   // Analyze the current call, filling in some fields. Returns true if
   // this is an allocation we can stack-allocate.
   virtual bool analyze(CallSite CS, const Analysis &A) = 0;
@@ -187,6 +208,62 @@ public:
   }
 };
 
+/// A dynamic array allocation to be replaced by a stack buffer of MaxLength
+/// elements if the requested length fits, keeping the GC call for the other
+/// case:
+///
+///   %fits = icmp ule %len, MaxLength
+///   br %fits, %stack, %gc
+/// stack:                    ; the .nongc_mem buffer, zeroed if needed
+/// gc:                       ; the original call
+/// join:
+///   %arr = phi [ %stackarr, %stack ], [ %call, %gc ]
+///
+/// The buffer is allocated in the entry block, so this is only safe under
+/// the same conditions as promoting a constant-size allocation.
+struct GuardedPromotion {
+  CallInst *Call;
+  llvm::Type *ElemTy;
+  Value *Length;
+  uint64_t MaxLength;
+  bool Initialized;
+
+  void promote(const Analysis &A) const {
+    NumGuarded++;
+
+    BasicBlock &Entry = Call->getParent()->getParent()->getEntryBlock();
+    IRBuilder<> AllocaBuilder(&Entry, Entry.begin());
+    AllocaInst *Buffer = AllocaBuilder.CreateAlloca(
+        ElemTy, AllocaBuilder.getInt32(MaxLength), ".nongc_mem");
+
+    IRBuilder<> Builder(Call);
+    Value *Fits = Builder.CreateICmpULE(
+        Length, ConstantInt::get(Length->getType(), MaxLength), ".nongc_fits");
+    TerminatorInst *ThenTerm, *ElseTerm;
+    SplitBlockAndInsertIfThenElse(Fits, Call, &ThenTerm, &ElseTerm);
+    BasicBlock *Join = Call->getParent();
+    Call->moveBefore(ElseTerm);
+
+    Builder.SetInsertPoint(ThenTerm);
+    if (Initialized) {
+      uint64_t size = A.DL.getTypeStoreSize(ElemTy);
+      Value *TypeSize = ConstantInt::get(Length->getType(), size);
+      EmitMemZero(Builder, Buffer, Builder.CreateMul(TypeSize, Length), A);
+    }
+    Value *arrStruct = llvm::UndefValue::get(Call->getType());
+    arrStruct = Builder.CreateInsertValue(arrStruct, Length, 0);
+    Value *memPtr = Builder.CreateBitCast(
+        Buffer, PointerType::getUnqual(Builder.getInt8Ty()));
+    arrStruct = Builder.CreateInsertValue(arrStruct, memPtr, 1);
+
+    PHINode *Phi =
+        PHINode::Create(Call->getType(), 2, ".nongc_arr", &Join->front());
+    Call->replaceAllUsesWith(Phi);
+    Phi->addIncoming(arrStruct, ThenTerm->getParent());
+    Phi->addIncoming(Call, ElseTerm->getParent());
+  }
+};
+
 class ArrayFI : public TypeInfoFI {
   int ArrSizeArgNr;
   bool Initialized;
@@ -199,6 +276,7 @@ public:
         Initialized(initialized) {}
 
   bool analyze(CallSite CS, const Analysis &A) override {
+    GuardedLength = 0;
     if (!TypeInfoFI::analyze(CS, A)) {
       return false;
     }
@@ -220,13 +298,21 @@ public:
     if (SizeLimit > 0) {
       uint64_t ElemSize = A.DL.getTypeAllocSize(Ty);
       if (!isKnownLessThan(arrSize, SizeLimit / ElemSize, A)) {
-        return false;
+        // Fall back to a guarded stack buffer if enabled (pointless for too
+        // large constant lengths). Invokes would require splitting the
+        // landing pad, so only calls are handled.
+        GuardedLength = GuardedSize / ElemSize;
+        return GuardedLength > 0 && !isa<Constant>(arrSize) && CS.isCall();
       }
     }
 
     return true;
   }
 
+  GuardedPromotion getGuardedPromotion(CallInst *Call) const {
+    return {Call, Ty, arrSize, GuardedLength, Initialized};
+  }
+
   Value *promote(CallSite CS, IRBuilder<> &B, const Analysis &A) override {
     IRBuilder<> Builder = B;
     // If the allocation is of constant size it's best to put it in the
@@ -391,11 +477,10 @@ public:
 //===----------------------------------------------------------------------===//
 
 namespace {
-/// This pass replaces GC calls with alloca's
-///
-class LLVM_LIBRARY_VISIBILITY GarbageCollect2Stack : public FunctionPass {
+/// The transformation, shared by the legacy and new pass manager
+/// implementations.
+class LLVM_LIBRARY_VISIBILITY GarbageCollect2StackImpl {
   StringMap<FunctionInfo *> KnownFunctions;
-  Module *M;
 
   TypeInfoFI AllocMemoryT;
   ArrayFI NewArrayU;
@@ -403,17 +488,29 @@ class LLVM_LIBRARY_VISIBILITY GarbageCollect2Stack : public FunctionPass {
   AllocClassFI AllocClass;
   UntypedMemoryFI AllocMemory;
 
+public:
+  GarbageCollect2StackImpl();
+
+  // CG may be null.
+  bool run(Function &F, DominatorTree &DT, CallGraph *CG);
+};
+
+/// This pass replaces GC calls with alloca's
+///
+class LLVM_LIBRARY_VISIBILITY GarbageCollect2Stack : public FunctionPass {
+  GarbageCollect2StackImpl Impl;
+
 public:
   static char ID; // Pass identification
-  GarbageCollect2Stack();
+  GarbageCollect2Stack() : FunctionPass(ID) {}
 
-  bool doInitialization(Module &M) override {
-    this->M = &M;
-    return false;
+  bool runOnFunction(Function &F) override {
+    DominatorTree &DT = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+    CallGraphWrapperPass *CGPass =
+        getAnalysisIfAvailable<CallGraphWrapperPass>();
+    return Impl.run(F, DT, CGPass ? &CGPass->getCallGraph() : nullptr);
   }
 
-  bool runOnFunction(Function &F) override;
-
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.addRequired<DominatorTreeWrapperPass>();
     AU.addPreserved<CallGraphWrapperPass>();
@@ -430,8 +527,19 @@ FunctionPass *createGarbageCollect2Stack() {
   return new GarbageCollect2Stack();
 }
 
-GarbageCollect2Stack::GarbageCollect2Stack()
-    : FunctionPass(ID), AllocMemoryT(ReturnType::Pointer, 0),
+#if LDC_LLVM_VER >= 600
+PreservedAnalyses GarbageCollect2StackPass::run(Function &F,
+                                                FunctionAnalysisManager &AM) {
+  GarbageCollect2StackImpl Impl;
+  if (!Impl.run(F, AM.getResult<DominatorTreeAnalysis>(F), nullptr))
+    return PreservedAnalyses::all();
+  // Removing invokes changes the CFG.
+  return PreservedAnalyses::none();
+}
+#endif
+
+GarbageCollect2StackImpl::GarbageCollect2StackImpl()
+    : AllocMemoryT(ReturnType::Pointer, 0),
       NewArrayU(ReturnType::Array, 0, 1, false),
       NewArrayT(ReturnType::Array, 0, 1, true), AllocMemory(0) {
   KnownFunctions["_d_allocmemoryT"] = &AllocMemoryT;
@@ -459,6 +567,13 @@ static void RemoveCall(CallSite CS, const Analysis &A) {
   CS->eraseFromParent();
 }
 
+/// Records the fate of a tagged allocation site for -gc-alloc-report.
+static void noteGCAllocSite(Instruction *Inst, const char *ListName) {
+  if (MDNode *Site = Inst->getMetadata(GC_ALLOC_SITE)) {
+    Inst->getModule()->getOrInsertNamedMetadata(ListName)->addOperand(Site);
+  }
+}
+
 static bool
 isSafeToStackAllocateArray(BasicBlock::iterator Alloc, DominatorTree &DT,
                            SmallVector<CallInst *, 4> &RemoveTailCallInsts);
@@ -466,23 +581,26 @@ static bool
 isSafeToStackAllocate(BasicBlock::iterator Alloc, Value *V, DominatorTree &DT,
                       SmallVector<CallInst *, 4> &RemoveTailCallInsts);
 
-/// runOnFunction - Top level algorithm.
+/// run - Top level algorithm.
 ///
-bool GarbageCollect2Stack::runOnFunction(Function &F) {
+bool GarbageCollect2StackImpl::run(Function &F, DominatorTree &DT,
+                                   CallGraph *CG) {
+  timereport::Scope timeScope("GarbageCollect2Stack", "Optimization");
   LLVM_DEBUG(errs() << "\nRunning -dgc2stack on function " << F.getName() << '\n');
 
   const DataLayout &DL = F.getParent()->getDataLayout();
-  DominatorTree &DT = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
-  CallGraphWrapperPass *CGPass = getAnalysisIfAvailable<CallGraphWrapperPass>();
-  CallGraph *CG = CGPass ? &CGPass->getCallGraph() : nullptr;
   CallGraphNode *CGNode = CG ? (*CG)[&F] : nullptr;
 
-  Analysis A = {DL, *M, CG, CGNode};
+  Analysis A = {DL, *F.getParent(), CG, CGNode};
 
   BasicBlock &Entry = F.getEntryBlock();
 
   IRBuilder<> AllocaBuilder(&Entry, Entry.begin());
 
+  // Guarded promotions split the block, so they are done after the analysis
+  // of all the calls.
+  SmallVector<GuardedPromotion, 4> GuardedPromotions;
+
   bool Changed = false;
   for (auto &BB : F) {
     for (auto I = BB.begin(), E = BB.end(); I != E;) {
@@ -513,6 +631,7 @@ bool GarbageCollect2Stack::runOnFunction(Function &F) {
       if (Inst->use_empty()) {
         Changed = true;
         NumDeleted++;
+        noteGCAllocSite(Inst, GC_ALLOC_REMOVED);
         RemoveCall(CS, A);
         continue;
       }
@@ -536,6 +655,7 @@ bool GarbageCollect2Stack::runOnFunction(Function &F) {
 
       // Let's alloca this!
       Changed = true;
+      noteGCAllocSite(Inst, GC_ALLOC_PROMOTED);
 
       // First demote tail calls which use the value so there IR is never
       // in an invalid state.
@@ -543,6 +663,14 @@ bool GarbageCollect2Stack::runOnFunction(Function &F) {
         i->setTailCall(false);
       }
 
+      if (info->GuardedLength) {
+        assert(info->ReturnType == ReturnType::Array);
+        auto AFI = static_cast<ArrayFI *>(info);
+        GuardedPromotions.push_back(
+            AFI->getGuardedPromotion(cast<CallInst>(Inst)));
+        continue;
+      }
+
       IRBuilder<> Builder(&BB, originalI);
       Value *newVal = info->promote(CS, Builder, A);
 
@@ -559,6 +687,10 @@ bool GarbageCollect2Stack::runOnFunction(Function &F) {
     }
   }
 
+  for (const auto &GP : GuardedPromotions) {
+    GP.promote(A);
+  }
+
   return Changed;
 }
 
@@ -782,6 +914,156 @@ bool isSafeToStackAllocateArray(
   return true;
 }
 
+#if LDC_LLVM_VER < 500
+static const unsigned paramHasAttr_firstArg = 1;
+#else
+static const unsigned paramHasAttr_firstArg = 0;
+#endif
+
+/// Returns whether the stack slot Slot doesn't escape, i.e., whether its
+/// address is only used to load from and store to it. Collects the loads.
+static bool isLocalSlot(AllocaInst *Slot,
+                        SmallVectorImpl<Instruction *> &Loads) {
+  SmallVector<Instruction *, 8> Worklist;
+  SmallSet<Instruction *, 8> Visited;
+  Worklist.push_back(Slot);
+
+  while (!Worklist.empty()) {
+    Instruction *P = Worklist.pop_back_val();
+    for (User *U : P->users()) {
+      Instruction *I = cast<Instruction>(U);
+      switch (I->getOpcode()) {
+      case Instruction::Load:
+        Loads.push_back(I);
+        break;
+      case Instruction::Store:
+        if (I->getOperand(0) == P) {
+          return false;
+        }
+        break;
+      case Instruction::BitCast:
+      case Instruction::GetElementPtr:
+        if (Visited.insert(I).second) {
+          Worklist.push_back(I);
+        }
+        break;
+      case Instruction::Call: {
+        IntrinsicInst *II = dyn_cast<IntrinsicInst>(I);
+        if (II && (II->getIntrinsicID() == Intrinsic::lifetime_start ||
+                   II->getIntrinsicID() == Intrinsic::lifetime_end)) {
+          break;
+        }
+        return false;
+      }
+      default:
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// Returns whether argument ArgNo may be captured by the function F, looking
+/// into calls to other functions defined in the module up to Depth levels
+/// deep. Sets Returned if the argument (or a pointer derived from it) may be
+/// returned; it's then up to the caller to analyze the result of the call.
+///
+/// Unlike LLVM's PointerMayBeCaptured(), storing the argument to a stack slot
+/// of F isn't considered a capture as long as the slot doesn't escape. That's
+/// the case for the context pointer of nested functions with a (promoted)
+/// closure of their own, which stores the parent context in its frame.
+static bool mayCaptureArgument(Function *F, unsigned ArgNo, unsigned Depth,
+                               bool &Returned) {
+  // Only look into functions whose definition can't be replaced at link time.
+  if (F == nullptr || F->isDeclaration() || F->isInterposable() ||
+      ArgNo >= F->arg_size()) {
+    return true;
+  }
+  Argument *Arg = &*std::next(F->arg_begin(), ArgNo);
+  if (Arg->hasNoCaptureAttr()) {
+    return false;
+  }
+  if (Depth == 0) {
+    return true;
+  }
+
+  const DataLayout &DL = F->getParent()->getDataLayout();
+  SmallVector<Use *, 16> Worklist;
+  SmallSet<Use *, 16> Visited;
+  auto pushUses = [&](Value *V) {
+    for (Use &U : V->uses()) {
+      if (Visited.insert(&U).second) {
+        Worklist.push_back(&U);
+      }
+    }
+  };
+  pushUses(Arg);
+
+  while (!Worklist.empty()) {
+    Use *U = Worklist.pop_back_val();
+    Instruction *I = cast<Instruction>(U->getUser());
+    Value *V = U->get();
+
+    switch (I->getOpcode()) {
+    case Instruction::Call:
+    case Instruction::Invoke: {
+      CallSite CS(I);
+      if (CS.isCallee(U)) {
+        break;
+      }
+      if (!CS.isArgOperand(U)) {
+        return true; // e.g., an operand bundle
+      }
+      const unsigned CalleeArgNo = CS.getArgumentNo(U);
+      if (CS.paramHasAttr(CalleeArgNo + paramHasAttr_firstArg,
+                          LLAttribute::NoCapture)) {
+        break;
+      }
+      bool CalleeReturns = false;
+      if (mayCaptureArgument(CS.getCalledFunction(), CalleeArgNo, Depth - 1,
+                             CalleeReturns)) {
+        return true;
+      }
+      if (CalleeReturns) {
+        pushUses(I);
+      }
+      break;
+    }
+    case Instruction::Load:
+    case Instruction::ICmp:
+      break;
+    case Instruction::Store:
+      if (V == I->getOperand(0)) {
+        // Stored the pointer - captured unless stored to a local stack slot,
+        // in which case the loads from the slot are analyzed as well.
+        AllocaInst *Slot =
+            dyn_cast<AllocaInst>(GetUnderlyingObject(I->getOperand(1), DL));
+        SmallVector<Instruction *, 4> Loads;
+        if (Slot == nullptr || !isLocalSlot(Slot, Loads)) {
+          return true;
+        }
+        for (auto L : Loads) {
+          pushUses(L);
+        }
+      }
+      break;
+    case Instruction::BitCast:
+    case Instruction::GetElementPtr:
+    case Instruction::PHI:
+    case Instruction::Select:
+      pushUses(I);
+      break;
+    case Instruction::Ret:
+      Returned = true;
+      break;
+    default:
+      return true;
+    }
+  }
+
+  return false;
+}
+
 /// Returns true if the GC call passed in is safe to turn
 /// into a stack allocation. This requires that the return value does not
 /// escape from the function and no derived pointers are live at the call site
@@ -793,7 +1075,10 @@ bool isSafeToStackAllocateArray(
 /// subsequent iteration.
 ///
 /// Based on LLVM's PointerMayBeCaptured(), which only does escape analysis but
-/// doesn't care about loops.
+/// doesn't care about loops. In addition, pointers passed to functions defined
+/// in the module are followed into the callee (see mayCaptureArgument()), and
+/// pointers inserted into first-class aggregates such as delegates are tracked
+/// until they are extracted again.
 ///
 /// Alloc is the actual call to the runtime function, and V is the pointer to
 /// the memory it returns (which might not be equal to Alloc in case of
@@ -818,6 +1103,26 @@ bool isSafeToStackAllocate(BasicBlock::iterator Alloc, Value *V,
     Worklist.push_back(U);
   }
 
+  // Adds the uses of a value derived from the allocated pointer to the
+  // worklist. Returns false if it may be live across the original allocation.
+  auto followDerived = [&](Instruction *I) {
+    // It's not safe to stack-allocate if this derived pointer is live across
+    // the original allocation.
+    if (mayBeUsedAfterRealloc(I, Alloc, DT)) {
+      return false;
+    }
+
+    // The original value is not captured via this if the new value isn't.
+    for (Instruction::use_iterator UI = I->use_begin(), UE = I->use_end();
+         UI != UE; ++UI) {
+      Use *U = &(*UI);
+      if (Visited.insert(U).second) {
+        Worklist.push_back(U);
+      }
+    }
+    return true;
+  };
+
   while (!Worklist.empty()) {
     Use *U = Worklist.pop_back_val();
     Instruction *I = cast<Instruction>(U->getUser());
@@ -842,17 +1147,16 @@ bool isSafeToStackAllocate(BasicBlock::iterator Alloc, Value *V,
       // that loading a value from a pointer does not cause the pointer to be
       // captured, even though the loaded value might be the pointer itself
       // (think of self-referential objects).
+      bool MayBeReturned = false;
       CallSite::arg_iterator B = CS.arg_begin(), E = CS.arg_end();
       for (CallSite::arg_iterator A = B; A != E; ++A) {
         if (A->get() == V) {
-#if LDC_LLVM_VER < 500
-          const unsigned paramHasAttr_firstArg = 1;
-#else
-          const unsigned paramHasAttr_firstArg = 0;
-#endif
           if (!CS.paramHasAttr(A - B + paramHasAttr_firstArg,
-                               LLAttribute::NoCapture)) {
-            // The parameter is not marked 'nocapture' - captured.
+                               LLAttribute::NoCapture) &&
+              mayCaptureArgument(CS.getCalledFunction(), A - B, IPADepth,
+                                 MayBeReturned)) {
+            // The parameter is not marked 'nocapture' and may be captured by
+            // the callee.
             return false;
           }
 
@@ -864,13 +1168,21 @@ bool isSafeToStackAllocate(BasicBlock::iterator Alloc, Value *V,
           }
         }
       }
-      // Only passed via 'nocapture' arguments, or is the called function - not
-      // captured.
+      // If the callee may return the pointer, the result of the call needs to
+      // be analyzed too.
+      if (MayBeReturned && !followDerived(I)) {
+        return false;
+      }
+      // Only passed via non-capturing arguments, or is the called function -
+      // not captured.
       break;
     }
     case Instruction::Load:
       // Loading from a pointer does not cause it to be captured.
       break;
+    case Instruction::ICmp:
+      // Comparing the pointer doesn't extend the lifetime of the memory.
+      break;
     case Instruction::Store:
       if (V == I->getOperand(0)) {
         // Stored the pointer - it may be captured.
@@ -882,21 +1194,52 @@ bool isSafeToStackAllocate(BasicBlock::iterator Alloc, Value *V,
     case Instruction::GetElementPtr:
     case Instruction::PHI:
     case Instruction::Select:
-      // It's not safe to stack-allocate if this derived pointer is live across
-      // the original allocation.
-      if (mayBeUsedAfterRealloc(I, Alloc, DT)) {
+      if (!followDerived(I)) {
         return false;
       }
-
-      // The original value is not captured via this if the new value isn't.
-      for (Instruction::use_iterator UI = I->use_begin(), UE = I->use_end();
-           UI != UE; ++UI) {
-        Use *U = &(*UI);
-        if (Visited.insert(U).second) {
-          Worklist.push_back(U);
+      break;
+    case Instruction::InsertValue: {
+      // The pointer is inserted into a first-class aggregate, e.g. the context
+      // pointer of a delegate. Track the aggregates containing the pointer
+      // (at field Idx) until it's extracted again.
+      InsertValueInst *IVI = cast<InsertValueInst>(I);
+      if (V != IVI->getInsertedValueOperand() || IVI->getNumIndices() != 1) {
+        return false;
+      }
+      SmallVector<std::pair<Instruction *, unsigned>, 4> Aggregates;
+      Aggregates.push_back(std::make_pair(IVI, IVI->getIndices()[0]));
+      while (!Aggregates.empty()) {
+        Instruction *Agg = Aggregates.back().first;
+        const unsigned Idx = Aggregates.back().second;
+        Aggregates.pop_back();
+        if (mayBeUsedAfterRealloc(Agg, Alloc, DT)) {
+          return false;
+        }
+        for (User *AggUser : Agg->users()) {
+          if (auto EVI = dyn_cast<ExtractValueInst>(AggUser)) {
+            if (EVI->getNumIndices() != 1) {
+              return false;
+            }
+            if (EVI->getIndices()[0] == Idx && !followDerived(EVI)) {
+              return false;
+            }
+          } else if (auto NextIVI = dyn_cast<InsertValueInst>(AggUser)) {
+            if (NextIVI->getAggregateOperand() != Agg ||
+                NextIVI->getNumIndices() != 1) {
+              return false;
+            }
+            // Unless the pointer is overwritten, the new aggregate still
+            // contains it.
+            if (NextIVI->getIndices()[0] != Idx) {
+              Aggregates.push_back(std::make_pair(NextIVI, Idx));
+            }
+          } else {
+            return false;
+          }
         }
       }
       break;
+    }
     default:
       // Something else - be conservative and say it is captured.
       return false;
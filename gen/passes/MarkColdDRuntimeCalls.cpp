@@ -0,0 +1,94 @@
+//===-- MarkColdDRuntimeCalls.cpp - Mark D failure paths as cold ----------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This transform marks calls to the druntime functions throwing exceptions or
+// reporting failed assertions and bounds checks as cold, independent of the
+// attributes of their declarations (which may come from user code). Branch
+// probability analysis, the inliner and hot/cold splitting then treat the
+// blocks containing them as unlikely to be executed.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "mark-cold-druntime-calls"
+#if LDC_LLVM_VER < 700
+#define LLVM_DEBUG DEBUG
+#endif
+
+#include "Passes.h"
+
+#include "gen/attributes.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+STATISTIC(NumColdCalls, "Number of druntime calls marked as cold");
+
+// Prefixes of the druntime functions only called on failure paths, including
+// variants like _d_assert_msg and _d_arraybounds_index.
+static const char *const coldFunctionPrefixes[] = {
+    "_d_throw_exception", "_d_arraybounds", "_d_assert"};
+
+static bool isColdDRuntimeFunction(const Function *F) {
+  if (!F)
+    return false;
+  const StringRef name = F->getName();
+  for (const char *prefix : coldFunctionPrefixes) {
+    if (name.startswith(prefix))
+      return true;
+  }
+  return false;
+}
+
+static bool markColdDRuntimeCalls(Function &F) {
+  bool Changed = false;
+  for (auto &BB : F) {
+    for (auto &I : BB) {
+      CallSite CS(&I);
+      if (!CS || !isColdDRuntimeFunction(CS.getCalledFunction()) ||
+          CS.hasFnAttr(Attribute::Cold))
+        continue;
+
+      CS.addAttribute(LLAttributeSet::FunctionIndex, Attribute::Cold);
+      LLVM_DEBUG(errs() << "Marked as cold: " << I << '\n');
+      ++NumColdCalls;
+      Changed = true;
+    }
+  }
+  return Changed;
+}
+
+namespace {
+struct LLVM_LIBRARY_VISIBILITY MarkColdDRuntimeCalls : public FunctionPass {
+  static char ID; // Pass identification
+  MarkColdDRuntimeCalls() : FunctionPass(ID) {}
+
+  bool runOnFunction(Function &F) override { return markColdDRuntimeCalls(F); }
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesCFG();
+  }
+};
+}
+
+char MarkColdDRuntimeCalls::ID = 0;
+static RegisterPass<MarkColdDRuntimeCalls>
+    X("mark-cold-druntime-calls",
+      "Mark druntime calls on failure paths as cold");
+
+FunctionPass *createMarkColdDRuntimeCallsPass() {
+  return new MarkColdDRuntimeCalls();
+}
@@ -15,6 +15,9 @@
 #define LDC_PASSES_H
 
 #include "gen/metadata.h"
+#if LDC_LLVM_VER >= 600
+#include "llvm/IR/PassManager.h"
+#endif
 namespace llvm {
 class FunctionPass;
 class ModulePass;
@@ -27,4 +30,36 @@ llvm::FunctionPass *createGarbageCollect2Stack();
 
 llvm::ModulePass *createStripExternalsPass();
 
+// Clones functions for constant function pointer and delegate arguments.
+llvm::ModulePass *createSpecializeFunctionsPass();
+
+// Marks calls to druntime's throw, assert and bounds check failure functions
+// as cold.
+llvm::FunctionPass *createMarkColdDRuntimeCallsPass();
+
+#if LDC_LLVM_VER >= 600
+// The same passes for the new pass manager (-passmanager=new).
+
+struct SimplifyDRuntimeCallsPass
+    : public llvm::PassInfoMixin<SimplifyDRuntimeCallsPass> {
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &AM);
+};
+
+struct GarbageCollect2StackPass
+    : public llvm::PassInfoMixin<GarbageCollect2StackPass> {
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &AM);
+};
+
+struct StripExternalsPass : public llvm::PassInfoMixin<StripExternalsPass> {
+  llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+
+struct SpecializeFunctionsPass
+    : public llvm::PassInfoMixin<SpecializeFunctionsPass> {
+  llvm::PreservedAnalyses run(llvm::Module &M, llvm::ModuleAnalysisManager &AM);
+};
+#endif
+
 #endif
@@ -25,15 +25,19 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/CaptureTracking.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Support/Compiler.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
+#include "driver/timereport.h"
 #include "gen/runtime.h"
+#include <algorithm>
 
 using namespace llvm;
 
@@ -295,6 +299,415 @@ struct LLVM_LIBRARY_VISIBILITY ArraySliceCopyOpt : public LibCallOptimization {
   }
 };
 
+/// Returns the field Idx (0 for the length, 1 for the pointer) of the D slice
+/// value Arr if it can be determined, e.g. for constants and slices built via
+/// insertvalue.
+static Value *getSliceField(Value *Arr, unsigned Idx) {
+  while (InsertValueInst *IVI = dyn_cast<InsertValueInst>(Arr)) {
+    if (IVI->getNumIndices() == 1 && IVI->getIndices()[0] == Idx) {
+      return IVI->getInsertedValueOperand();
+    }
+    Arr = IVI->getAggregateOperand();
+  }
+  if (Constant *C = dyn_cast<Constant>(Arr)) {
+    if (!isa<UndefValue>(C)) {
+      return C->getAggregateElement(Idx);
+    }
+  }
+  return nullptr;
+}
+
+/// Returns true if the local array Array is only written to via stores and
+/// otherwise only passed (as part of a slice) to the call CI.
+static bool isOnlyInitializedForCall(AllocaInst *Array, CallInst *CI) {
+  SmallVector<Instruction *, 8> Worklist;
+  Worklist.push_back(Array);
+  while (!Worklist.empty()) {
+    Instruction *P = Worklist.pop_back_val();
+    for (User *U : P->users()) {
+      Instruction *I = cast<Instruction>(U);
+      if (isa<BitCastInst>(I) || isa<GetElementPtrInst>(I) ||
+          isa<InsertValueInst>(I)) {
+        Worklist.push_back(I);
+      } else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        if (SI->getValueOperand() == P) {
+          return false;
+        }
+      } else if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(I)) {
+        if (II->getIntrinsicID() != Intrinsic::lifetime_start &&
+            II->getIntrinsicID() != Intrinsic::lifetime_end) {
+          return false;
+        }
+      } else if (I != CI || !isa<InsertValueInst>(P)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// Returns true if the D slice value Arr is known to be empty.
+static bool isKnownEmptySlice(Value *Arr) {
+  Value *Len = getSliceField(Arr, 0);
+  return Len && isa<Constant>(Len) && cast<Constant>(Len)->isNullValue();
+}
+
+//===---------------------------------------===//
+// '_d_arraycatT' Optimizations
+
+/// ArrayCatOpt - Concatenating two empty arrays results in null.
+/// (Concatenation always creates a new array, so a single empty operand can't
+/// be dropped.)
+struct LLVM_LIBRARY_VISIBILITY ArrayCatOpt : public LibCallOptimization {
+  Value *CallOptimizer(Function *Callee, CallInst *CI,
+                       IRBuilder<> &B) override {
+    // Verify we have a reasonable prototype for _d_arraycatT
+    const FunctionType *FT = Callee->getFunctionType();
+    if (Callee->arg_size() != 3 || !isa<StructType>(FT->getReturnType()) ||
+        FT->getParamType(1) != FT->getReturnType() ||
+        FT->getParamType(2) != FT->getReturnType()) {
+      return nullptr;
+    }
+
+    if (isKnownEmptySlice(CI->getArgOperand(1)) &&
+        isKnownEmptySlice(CI->getArgOperand(2))) {
+      return Constant::getNullValue(CI->getType());
+    }
+    return nullptr;
+  }
+};
+
+//===---------------------------------------===//
+// '_d_arraycatnTX' Optimizations
+
+/// ArrayCatNOpt - Drop known-empty arrays from an n-ary concatenation, and
+/// use the simpler _d_arraycatT if at most two arrays remain.
+struct LLVM_LIBRARY_VISIBILITY ArrayCatNOpt : public LibCallOptimization {
+  /// A slice stored as a whole or per field.
+  struct StoredSlice {
+    Value *Whole = nullptr;
+    Value *Length = nullptr;
+    Value *Ptr = nullptr;
+
+    bool isKnownEmpty() const {
+      Value *Len = Whole ? getSliceField(Whole, 0) : Length;
+      return Len && isa<Constant>(Len) && cast<Constant>(Len)->isNullValue();
+    }
+  };
+
+  /// Finds the slices stored to the temporary array of slices, which is
+  /// initialized right before the call. Returns false if they can't all be
+  /// determined.
+  bool getSlices(CallInst *CI, AllocaInst *Array, StructType *SliceTy,
+                 SmallVectorImpl<StoredSlice> &Slices) {
+    const uint64_t N = Slices.size();
+    const uint64_t SliceSize = DL->getTypeAllocSize(SliceTy);
+    const uint64_t PtrOffset = DL->getStructLayout(SliceTy)->getElementOffset(1);
+
+    // Walk backwards from the call, stopping at anything that might write to
+    // the temporary array other than a store. Later stores win.
+    for (auto It = CI->getIterator(), Begin = CI->getParent()->begin();
+         It != Begin;) {
+      Instruction *I = &*--It;
+      if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        int64_t Offset;
+        if (GetPointerBaseWithConstantOffset(SI->getPointerOperand(), Offset,
+                                             *DL) != Array) {
+          continue;
+        }
+        Value *V = SI->getValueOperand();
+        if (Offset < 0 || uint64_t(Offset) / SliceSize >= N ||
+            SI->isVolatile()) {
+          return false;
+        }
+        StoredSlice &Slice = Slices[Offset / SliceSize];
+        const uint64_t FieldOffset = Offset % SliceSize;
+        if (isa<StructType>(V->getType()) && FieldOffset == 0) {
+          if (!Slice.Whole && !Slice.Length && !Slice.Ptr) {
+            Slice.Whole = V;
+          }
+        } else if (FieldOffset == 0 &&
+                   V->getType() == SliceTy->getElementType(0)) {
+          if (!Slice.Whole && !Slice.Length) {
+            Slice.Length = V;
+          }
+        } else if (FieldOffset == PtrOffset && V->getType()->isPointerTy()) {
+          if (!Slice.Whole && !Slice.Ptr) {
+            Slice.Ptr = V;
+          }
+        } else {
+          return false;
+        }
+      } else if (I->mayWriteToMemory()) {
+        IntrinsicInst *II = dyn_cast<IntrinsicInst>(I);
+        if (!II || (II->getIntrinsicID() != Intrinsic::lifetime_start &&
+                    II->getIntrinsicID() != Intrinsic::lifetime_end)) {
+          break;
+        }
+      }
+    }
+
+    for (const auto &Slice : Slices) {
+      if (!Slice.Whole && !Slice.isKnownEmpty() &&
+          (!Slice.Length || !Slice.Ptr)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Builds a slice of type SliceTy from a stored one.
+  Value *buildSlice(const StoredSlice &Stored, StructType *SliceTy,
+                    IRBuilder<> &B) {
+    Value *Length = Stored.Length, *Ptr = Stored.Ptr;
+    if (Stored.Whole) {
+      if (Stored.Whole->getType() == SliceTy) {
+        return Stored.Whole;
+      }
+      Length = B.CreateExtractValue(Stored.Whole, 0);
+      Ptr = B.CreateExtractValue(Stored.Whole, 1);
+    }
+    Value *Slice = UndefValue::get(SliceTy);
+    Slice = B.CreateInsertValue(Slice, Length, 0);
+    return B.CreateInsertValue(
+        Slice, B.CreateBitCast(Ptr, SliceTy->getElementType(1)), 1);
+  }
+
+  Value *CallOptimizer(Function *Callee, CallInst *CI,
+                       IRBuilder<> &B) override {
+    // Verify we have a reasonable prototype for _d_arraycatnTX
+    const FunctionType *FT = Callee->getFunctionType();
+    StructType *SliceTy = dyn_cast<StructType>(FT->getReturnType());
+    if (Callee->arg_size() != 2 || !SliceTy ||
+        SliceTy->getNumElements() != 2 ||
+        !isa<StructType>(FT->getParamType(1))) {
+      return nullptr;
+    }
+
+    // The array of slices is a constant-length slice of a local array.
+    Value *Arrs = CI->getArgOperand(1);
+    ConstantInt *N = dyn_cast_or_null<ConstantInt>(getSliceField(Arrs, 0));
+    Value *Ptr = getSliceField(Arrs, 1);
+    AllocaInst *Array =
+        Ptr ? dyn_cast<AllocaInst>(Ptr->stripPointerCasts()) : nullptr;
+    if (!N || !Array || N->getValue().ugt(16) ||
+        !isOnlyInitializedForCall(Array, CI)) {
+      return nullptr;
+    }
+
+    SmallVector<StoredSlice, 8> Stored(N->getZExtValue());
+    if (!getSlices(CI, Array, SliceTy, Stored)) {
+      return nullptr;
+    }
+    Stored.erase(std::remove_if(Stored.begin(), Stored.end(),
+                                [](const StoredSlice &Slice) {
+                                  return Slice.isKnownEmpty();
+                                }),
+                 Stored.end());
+
+    if (Stored.empty()) {
+      return Constant::getNullValue(CI->getType());
+    }
+    if (Stored.size() > 2) {
+      return nullptr;
+    }
+
+    Type *CatParams[] = {FT->getParamType(0), SliceTy, SliceTy};
+    Function *CatT = dyn_cast<Function>(
+        Caller->getParent()->getOrInsertFunction(
+            "_d_arraycatT", FunctionType::get(SliceTy, CatParams, false)));
+    if (!CatT) {
+      return nullptr;
+    }
+
+    Value *X = buildSlice(Stored[0], SliceTy, B);
+    // A single remaining array still needs to be copied.
+    Value *Y = Stored.size() == 2 ? buildSlice(Stored[1], SliceTy, B)
+                                  : Constant::getNullValue(SliceTy);
+    return B.CreateCall(CatT, {CI->getArgOperand(0), X, Y});
+  }
+};
+
+//===---------------------------------------===//
+// '_d_arrayappendcTX' Optimizations
+
+/// ArrayAppendCOpt - _d_arrayappendcTX returns the extended array, so forward
+/// it to the subsequent loads of the array, which is how the new elements are
+/// stored to. This lets the element stores go to the returned memory
+/// directly.
+struct LLVM_LIBRARY_VISIBILITY ArrayAppendCOpt : public LibCallOptimization {
+  Value *CallOptimizer(Function *Callee, CallInst *CI,
+                       IRBuilder<> &B) override {
+    // Verify we have a reasonable prototype for _d_arrayappendcTX
+    const FunctionType *FT = Callee->getFunctionType();
+    StructType *SliceTy = dyn_cast<StructType>(FT->getReturnType());
+    if (Callee->arg_size() != 3 || !SliceTy ||
+        SliceTy->getNumElements() != 2 ||
+        !isa<PointerType>(FT->getParamType(1))) {
+      return nullptr;
+    }
+
+    int64_t ArrOffset;
+    Value *Base = GetPointerBaseWithConstantOffset(CI->getArgOperand(1),
+                                                   ArrOffset, *DL);
+    const int64_t PtrOffset =
+        DL->getStructLayout(SliceTy)->getElementOffset(1);
+
+    Value *Length = nullptr, *Ptr = nullptr;
+    for (auto It = ++CI->getIterator(), E = CI->getParent()->end(); It != E;
+         ++It) {
+      LoadInst *LI = dyn_cast<LoadInst>(&*It);
+      if (!LI) {
+        if (It->mayWriteToMemory()) {
+          break;
+        }
+        continue;
+      }
+
+      int64_t Offset;
+      if (LI->isVolatile() || LI->use_empty() ||
+          GetPointerBaseWithConstantOffset(LI->getPointerOperand(), Offset,
+                                           *DL) != Base) {
+        continue;
+      }
+      Offset -= ArrOffset;
+
+      Value *V = nullptr;
+      if (Offset == 0 && LI->getType() == SliceTy->getElementType(0)) {
+        if (!Length) {
+          Length = B.CreateExtractValue(CI, 0);
+        }
+        V = Length;
+      } else if (Offset == PtrOffset && LI->getType()->isPointerTy()) {
+        if (!Ptr) {
+          Ptr = B.CreateExtractValue(CI, 1);
+        }
+        V = B.CreateBitCast(Ptr, LI->getType());
+      } else if (Offset == 0 && LI->getType() == SliceTy) {
+        V = CI;
+      }
+
+      if (V) {
+        LI->replaceAllUsesWith(V);
+        // Leave the dead load to DCE, the caller may have an iterator to it.
+        *Changed = true;
+      }
+    }
+    return nullptr;
+  }
+};
+
+//===---------------------------------------===//
+// '_aaInX'/'_aaGetY' Optimizations
+
+/// AALookupOpt - Reuse the result of an earlier lookup of the same key in the
+/// same AA in the block.
+struct LLVM_LIBRARY_VISIBILITY AALookupOpt : public LibCallOptimization {
+  unsigned KeyArgNr;
+
+  /// Returns the key passed to the AA call, i.e., the value stored to the
+  /// local temporary pointed to by the key argument, if it can be determined.
+  Value *getKey(CallInst *CI) {
+    AllocaInst *Slot =
+        dyn_cast<AllocaInst>(CI->getArgOperand(KeyArgNr)->stripPointerCasts());
+    if (!Slot || PointerMayBeCaptured(Slot, /*ReturnCaptures=*/true,
+                                      /*StoreCaptures=*/true)) {
+      return nullptr;
+    }
+    for (auto It = CI->getIterator(), Begin = CI->getParent()->begin();
+         It != Begin;) {
+      Instruction *I = &*--It;
+      if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        if (SI->getPointerOperand()->stripPointerCasts() == Slot) {
+          return !SI->isVolatile() && SI->getValueOperand()->getType() ==
+                                          Slot->getAllocatedType()
+                     ? SI->getValueOperand()
+                     : nullptr;
+        }
+        if (!isa<AllocaInst>(SI->getPointerOperand()->stripPointerCasts())) {
+          return nullptr;
+        }
+      } else if (I->mayWriteToMemory()) {
+        return nullptr;
+      }
+    }
+    return nullptr;
+  }
+
+  bool isKeySlotOf(Value *Ptr, CallInst *CI) {
+    return Ptr->stripPointerCasts() ==
+           CI->getArgOperand(KeyArgNr)->stripPointerCasts();
+  }
+
+  Value *CallOptimizer(Function *Callee, CallInst *CI,
+                       IRBuilder<> &B) override {
+    // Verify we have a reasonable prototype for _aaInX/_aaGetY
+    if (Callee->arg_size() != KeyArgNr + 1 ||
+        !isa<PointerType>(Callee->getReturnType())) {
+      return nullptr;
+    }
+
+    Value *Key = getKey(CI);
+    if (!Key) {
+      return nullptr;
+    }
+
+    // Walk backwards looking for an earlier lookup. The AA mustn't be
+    // modified inbetween, so only allow the initialization of the keys and
+    // writes to the looked-up values.
+    for (auto It = CI->getIterator(), Begin = CI->getParent()->begin();
+         It != Begin;) {
+      Instruction *I = &*--It;
+      CallInst *Earlier = dyn_cast<CallInst>(I);
+      if (Earlier && Earlier->getCalledFunction() == Callee) {
+        bool SameArgs = true;
+        for (unsigned i = 0; i < KeyArgNr; ++i) {
+          SameArgs &= Earlier->getArgOperand(i) == CI->getArgOperand(i);
+        }
+        if (SameArgs && getKey(Earlier) == Key) {
+          return Earlier;
+        }
+      }
+
+      if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        if (isKeySlotOf(SI->getPointerOperand(), CI)) {
+          continue;
+        }
+        // The key slot of an earlier call.
+        CallInst *Next = nullptr;
+        for (auto NextIt = ++I->getIterator(); NextIt != CI->getIterator();
+             ++NextIt) {
+          Next = dyn_cast<CallInst>(&*NextIt);
+          if (Next && Next->getCalledFunction() == Callee) {
+            break;
+          }
+          Next = nullptr;
+        }
+        if (Next && isKeySlotOf(SI->getPointerOperand(), Next)) {
+          continue;
+        }
+        // Writing to a value in the AA doesn't modify the AA itself.
+        CallInst *Lookup = dyn_cast<CallInst>(
+            GetUnderlyingObject(SI->getPointerOperand(), *DL));
+        if (Lookup && Lookup->getCalledFunction() == Callee) {
+          continue;
+        }
+        return nullptr;
+      }
+      if (I->mayWriteToMemory() && I != Earlier) {
+        IntrinsicInst *II = dyn_cast<IntrinsicInst>(I);
+        if (!II || (II->getIntrinsicID() != Intrinsic::lifetime_start &&
+                    II->getIntrinsicID() != Intrinsic::lifetime_end)) {
+          return nullptr;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  explicit AALookupOpt(unsigned keyArgNr) : KeyArgNr(keyArgNr) {}
+};
+
 // TODO: More optimizations! :)
 
 } // end anonymous namespace.
@@ -304,27 +717,47 @@ struct LLVM_LIBRARY_VISIBILITY ArraySliceCopyOpt : public LibCallOptimization {
 //===----------------------------------------------------------------------===//
 
 namespace {
-/// This pass optimizes library functions from the D runtime as used by LDC.
-///
-class LLVM_LIBRARY_VISIBILITY SimplifyDRuntimeCalls : public FunctionPass {
+/// The optimizations of the pass, shared by the legacy and new pass manager
+/// implementations.
+class LLVM_LIBRARY_VISIBILITY SimplifyDRuntimeCallsImpl {
   StringMap<LibCallOptimization *> Optimizations;
 
   // Array operations
   ArraySetLengthOpt ArraySetLength;
   ArrayCastLenOpt ArrayCastLen;
   ArraySliceCopyOpt ArraySliceCopy;
+  ArrayCatOpt ArrayCat;
+  ArrayCatNOpt ArrayCatN;
+  ArrayAppendCOpt ArrayAppendC;
+
+  // Associative arrays
+  AALookupOpt AAIn;
+  AALookupOpt AAGet;
 
   // GC allocations
   AllocationOpt Allocation;
 
+  void InitOptimizations();
+  bool runOnce(Function &F, const DataLayout *DL, AliasAnalysis &AA);
+
+public:
+  SimplifyDRuntimeCallsImpl() : AAIn(2), AAGet(3) {}
+
+  bool run(Function &F, AliasAnalysis &AA);
+};
+
+/// This pass optimizes library functions from the D runtime as used by LDC.
+///
+class LLVM_LIBRARY_VISIBILITY SimplifyDRuntimeCalls : public FunctionPass {
+  SimplifyDRuntimeCallsImpl Impl;
+
 public:
   static char ID; // Pass identification
   SimplifyDRuntimeCalls() : FunctionPass(ID) {}
 
-  void InitOptimizations();
-  bool runOnFunction(Function &F) override;
-
-  bool runOnce(Function &F, const DataLayout *DL, AAResultsWrapperPass &AA);
+  bool runOnFunction(Function &F) override {
+    return Impl.run(F, getAnalysis<AAResultsWrapperPass>().getAAResults());
+  }
 
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.addRequired<AAResultsWrapperPass>();
@@ -341,14 +774,33 @@ FunctionPass *createSimplifyDRuntimeCalls() {
   return new SimplifyDRuntimeCalls();
 }
 
+#if LDC_LLVM_VER >= 600
+PreservedAnalyses SimplifyDRuntimeCallsPass::run(Function &F,
+                                                 FunctionAnalysisManager &AM) {
+  SimplifyDRuntimeCallsImpl Impl;
+  if (!Impl.run(F, AM.getResult<AAManager>(F)))
+    return PreservedAnalyses::all();
+  PreservedAnalyses PA;
+  PA.preserveSet<CFGAnalyses>();
+  return PA;
+}
+#endif
+
 /// Optimizations - Populate the Optimizations map with all the optimizations
 /// we know.
-void SimplifyDRuntimeCalls::InitOptimizations() {
+void SimplifyDRuntimeCallsImpl::InitOptimizations() {
   // Some array-related optimizations
   Optimizations["_d_arraysetlengthT"] = &ArraySetLength;
   Optimizations["_d_arraysetlengthiT"] = &ArraySetLength;
   Optimizations["_d_array_cast_len"] = &ArrayCastLen;
   Optimizations["_d_array_slice_copy"] = &ArraySliceCopy;
+  Optimizations["_d_arraycatT"] = &ArrayCat;
+  Optimizations["_d_arraycatnTX"] = &ArrayCatN;
+  Optimizations["_d_arrayappendcTX"] = &ArrayAppendC;
+
+  // Repeated lookups of the same key
+  Optimizations["_aaInX"] = &AAIn;
+  Optimizations["_aaGetY"] = &AAGet;
 
   /* Delete calls to runtime functions which aren't needed if their result is
    * unused. That comes down to functions that don't do anything but
@@ -370,15 +822,16 @@ void SimplifyDRuntimeCalls::InitOptimizations() {
   Optimizations["_d_allocclass"] = &Allocation;
 }
 
-/// runOnFunction - Top level algorithm.
+/// run - Top level algorithm.
 ///
-bool SimplifyDRuntimeCalls::runOnFunction(Function &F) {
+bool SimplifyDRuntimeCallsImpl::run(Function &F, AliasAnalysis &AA) {
+  timereport::Scope timeScope("SimplifyDRuntimeCalls", "Optimization");
+
   if (Optimizations.empty()) {
     InitOptimizations();
   }
 
   const DataLayout *DL = &F.getParent()->getDataLayout();
-  AAResultsWrapperPass &AA = getAnalysis<AAResultsWrapperPass>();
 
   // Iterate to catch opportunities opened up by other optimizations,
   // such as calls that are only used as arguments to unused calls:
@@ -395,8 +848,8 @@ bool SimplifyDRuntimeCalls::runOnFunction(Function &F) {
   return EverChanged;
 }
 
-bool SimplifyDRuntimeCalls::runOnce(Function &F, const DataLayout *DL,
-                                    AAResultsWrapperPass &AAP) {
+bool SimplifyDRuntimeCallsImpl::runOnce(Function &F, const DataLayout *DL,
+                                        AliasAnalysis &AA) {
   IRBuilder<> Builder(F.getContext());
 
   bool Changed = false;
@@ -429,7 +882,6 @@ bool SimplifyDRuntimeCalls::runOnce(Function &F, const DataLayout *DL,
       --ciIt;
       Builder.SetInsertPoint(&BB, I);
 
-      AliasAnalysis &AA = AAP.getAAResults();
       // Try to optimize this call.
       Value *Result = OMI->second->OptimizeCall(CI, Changed, DL, AA, Builder);
       if (Result == nullptr) {
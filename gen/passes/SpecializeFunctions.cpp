@@ -0,0 +1,336 @@
+//===-- SpecializeFunctions.cpp - Specialize for constant callees ---------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This transform clones small functions for call sites passing constant
+// function pointers or delegates with a constant function pointer (e.g.,
+// delegate literals), for parameters the function calls through. The indirect
+// calls in the clones become direct calls, which can then be inlined, like
+// for template alias parameters.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "dspecialize"
+#if LDC_LLVM_VER < 700
+#define LLVM_DEBUG DEBUG
+#endif
+
+#include "Passes.h"
+
+#include "driver/timereport.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC(NumSpecializations, "Number of specialized functions created");
+STATISTIC(NumCallsRedirected,
+          "Number of calls redirected to specialized functions");
+
+static cl::opt<unsigned>
+    SizeLimit("dspecialize-size-limit", cl::ZeroOrMore, cl::Hidden,
+              cl::init(200),
+              cl::desc("Only specialize functions with at most n "
+                       "instructions"));
+
+static cl::opt<unsigned>
+    MaxSpecializations("dspecialize-max-clones", cl::ZeroOrMore, cl::Hidden,
+                       cl::init(4),
+                       cl::desc("Create at most n specializations of a "
+                                "function"));
+
+static bool specializeFunctions(Module &M);
+
+namespace {
+struct LLVM_LIBRARY_VISIBILITY SpecializeFunctions : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+  SpecializeFunctions() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override { return specializeFunctions(M); }
+};
+
+/// A constant function pointer passed for a parameter, directly or as the
+/// function pointer of a delegate (field 1 of the LL struct).
+struct ConstantArg {
+  unsigned argNo;
+  bool isDelegate;
+  Constant *funcPtr;
+
+  bool operator<(const ConstantArg &other) const {
+    return std::tie(argNo, isDelegate, funcPtr) <
+           std::tie(other.argNo, other.isDelegate, other.funcPtr);
+  }
+};
+
+using Specialization = std::vector<ConstantArg>;
+}
+
+char SpecializeFunctions::ID = 0;
+static RegisterPass<SpecializeFunctions>
+    X("dspecialize", "Specialize functions for constant function pointer and "
+                     "delegate arguments");
+
+ModulePass *createSpecializeFunctionsPass() {
+  return new SpecializeFunctions();
+}
+
+#if LDC_LLVM_VER >= 600
+PreservedAnalyses SpecializeFunctionsPass::run(Module &M,
+                                               ModuleAnalysisManager &) {
+  return specializeFunctions(M) ? PreservedAnalyses::none()
+                                : PreservedAnalyses::all();
+}
+#endif
+
+/// Returns whether the type is the LL type of a D delegate.
+static bool isDelegateType(Type *T) {
+  auto ST = dyn_cast<StructType>(T);
+  return ST && ST->getNumElements() == 2 &&
+         ST->getElementType(0)->isPointerTy() &&
+         ST->getElementType(1)->isPointerTy() &&
+         ST->getElementType(1)->getPointerElementType()->isFunctionTy();
+}
+
+/// Returns the value if it is a (bitcast) constant function.
+static Constant *getFunctionConstant(Value *V) {
+  auto C = dyn_cast_or_null<Constant>(V);
+  return C && isa<Function>(C->stripPointerCasts()) ? C : nullptr;
+}
+
+/// Returns the function pointer of a delegate value built by insertvalue.
+static Value *getDelegateFuncPtr(Value *V) {
+  while (auto IV = dyn_cast<InsertValueInst>(V)) {
+    if (IV->getNumIndices() == 1 && *IV->idx_begin() == 1)
+      return IV->getInsertedValueOperand();
+    V = IV->getAggregateOperand();
+  }
+  if (auto C = dyn_cast<Constant>(V))
+    return C->getAggregateElement(1u);
+  return nullptr;
+}
+
+/// Returns whether the function pointer V, or field 1 of the delegate V if
+/// `isDelegate`, is called, possibly after a round trip through a local
+/// variable (before SROA).
+static bool isCalledThrough(Value *V, bool isDelegate, unsigned depth = 0) {
+  if (depth > 4)
+    return false;
+
+  for (User *U : V->users()) {
+    if (isDelegate) {
+      if (auto EV = dyn_cast<ExtractValueInst>(U)) {
+        if (EV->getNumIndices() == 1 && *EV->idx_begin() == 1 &&
+            isCalledThrough(EV, false, depth + 1))
+          return true;
+        continue;
+      }
+    } else {
+      CallSite CS(U);
+      if (CS && CS.getCalledValue()->stripPointerCasts() == V)
+        return true;
+      if (isa<BitCastInst>(U) && isCalledThrough(U, false, depth + 1))
+        return true;
+    }
+
+    // stored to a local variable
+    auto SI = dyn_cast<StoreInst>(U);
+    if (!SI || SI->getValueOperand() != V)
+      continue;
+    auto AI = dyn_cast<AllocaInst>(SI->getPointerOperand());
+    if (!AI)
+      continue;
+    for (User *AU : AI->users()) {
+      if (auto LI = dyn_cast<LoadInst>(AU)) {
+        if (isCalledThrough(LI, isDelegate, depth + 1))
+          return true;
+      } else if (auto GEP = dyn_cast<GetElementPtrInst>(AU)) {
+        // the function pointer field of a delegate variable
+        if (isDelegate && GEP->getNumIndices() == 2 &&
+            GEP->hasAllConstantIndices() &&
+            cast<ConstantInt>(GEP->getOperand(2))->getZExtValue() == 1) {
+          for (User *GU : GEP->users()) {
+            if (isa<LoadInst>(GU) && isCalledThrough(GU, false, depth + 1))
+              return true;
+          }
+        }
+      }
+    }
+  }
+  return false;
+}
+
+static bool canSpecialize(Function &F) {
+  if (F.isDeclaration() || F.isInterposable() || F.isVarArg() ||
+      F.hasFnAttribute(Attribute::OptimizeNone) ||
+      F.hasFnAttribute(Attribute::Naked) ||
+      F.hasFnAttribute(Attribute::NoDuplicate)) {
+    return false;
+  }
+
+  unsigned size = 0;
+  for (BasicBlock &BB : F) {
+    size += BB.size();
+    if (size > SizeLimit)
+      return false;
+  }
+  return true;
+}
+
+/// Collects the constant function pointer arguments the callee calls through.
+static Specialization getSpecialization(CallSite CS, Function &F) {
+  Specialization result;
+  unsigned argNo = 0;
+  for (Argument &formal : F.args()) {
+    if (argNo >= CS.arg_size())
+      break;
+    Value *actual = CS.getArgument(argNo);
+    Type *T = formal.getType();
+
+    if (T->isPointerTy() && T->getPointerElementType()->isFunctionTy()) {
+      if (Constant *C = getFunctionConstant(actual)) {
+        if (isCalledThrough(&formal, false))
+          result.push_back({argNo, false, C});
+      }
+    } else if (isDelegateType(T)) {
+      if (Constant *C = getFunctionConstant(getDelegateFuncPtr(actual))) {
+        if (isCalledThrough(&formal, true))
+          result.push_back({argNo, true, C});
+      }
+    }
+    ++argNo;
+  }
+  return result;
+}
+
+static Function *createSpecialization(Function &F,
+                                      const Specialization &constantArgs) {
+  ValueToValueMapTy VMap;
+  Function *clone = CloneFunction(&F, VMap);
+  clone->setName(F.getName() + ".specialized");
+  clone->setLinkage(GlobalValue::InternalLinkage);
+  clone->setVisibility(GlobalValue::DefaultVisibility);
+  clone->setDLLStorageClass(GlobalValue::DefaultStorageClass);
+  clone->setComdat(nullptr);
+
+  IRBuilder<> builder(&*clone->getEntryBlock().getFirstInsertionPt());
+  SmallVector<Value *, 2> replacements;
+  for (const ConstantArg &arg : constantArgs) {
+    auto formal = cast<Argument>(VMap[&*std::next(F.arg_begin(), arg.argNo)]);
+    if (!arg.isDelegate) {
+      formal->replaceAllUsesWith(arg.funcPtr);
+      replacements.push_back(arg.funcPtr);
+      continue;
+    }
+    // Keep the context pointer; later passes fold the extractvalues.
+    auto specialized =
+        cast<InsertValueInst>(builder.CreateInsertValue(formal, arg.funcPtr, 1));
+    formal->replaceAllUsesWith(specialized);
+    specialized->setOperand(0, formal);
+    replacements.push_back(specialized);
+  }
+
+  // Keep recursive calls forwarding the same arguments (e.g., an opApply
+  // recursing into the children of a tree with its loop body delegate) in the
+  // specialization.
+  for (BasicBlock &BB : *clone) {
+    for (Instruction &I : BB) {
+      CallSite CS(&I);
+      if (!CS || CS.getCalledFunction() != &F)
+        continue;
+      bool forwardsArgs = true;
+      for (size_t i = 0; i < constantArgs.size(); ++i) {
+        const unsigned argNo = constantArgs[i].argNo;
+        if (argNo >= CS.arg_size() ||
+            CS.getArgument(argNo) != replacements[i]) {
+          forwardsArgs = false;
+          break;
+        }
+      }
+      if (forwardsArgs) {
+        CS.setCalledFunction(clone);
+        ++NumCallsRedirected;
+      }
+    }
+  }
+
+  LLVM_DEBUG(errs() << "Specialized " << F.getName() << " for "
+                    << constantArgs.size() << " constant argument(s)\n");
+  ++NumSpecializations;
+  return clone;
+}
+
+static bool specializeFunctions(Module &M) {
+  timereport::Scope timeScope("SpecializeFunctions", "Optimization");
+
+  // Collect the candidate call sites first, as new functions are added.
+  std::vector<std::pair<Instruction *, Specialization>> candidates;
+  DenseMap<Function *, bool> canSpecializeCache;
+  for (Function &caller : M) {
+    for (BasicBlock &BB : caller) {
+      for (Instruction &I : BB) {
+        CallSite CS(&I);
+        if (!CS)
+          continue;
+        Function *F = CS.getCalledFunction();
+        if (!F || F == &caller)
+          continue;
+
+        auto it = canSpecializeCache.find(F);
+        if (it == canSpecializeCache.end())
+          it = canSpecializeCache.insert({F, canSpecialize(*F)}).first;
+        if (!it->second)
+          continue;
+
+        Specialization spec = getSpecialization(CS, *F);
+        if (!spec.empty())
+          candidates.emplace_back(&I, std::move(spec));
+      }
+    }
+  }
+
+  std::map<std::pair<Function *, Specialization>, Function *> specializations;
+  DenseMap<Function *, unsigned> numSpecializations;
+  bool changed = false;
+
+  for (auto &candidate : candidates) {
+    CallSite CS(candidate.first);
+    Function *F = CS.getCalledFunction();
+
+    Function *&clone = specializations[{F, candidate.second}];
+    if (!clone) {
+      unsigned &count = numSpecializations[F];
+      if (count >= MaxSpecializations)
+        continue;
+      ++count;
+      clone = createSpecialization(*F, candidate.second);
+    }
+
+    CS.setCalledFunction(clone);
+    ++NumCallsRedirected;
+    changed = true;
+  }
+
+  return changed;
+}
@@ -22,6 +22,8 @@
 
 #include "Passes.h"
 
+#include "driver/timereport.h"
+
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/ADT/Statistic.h"
@@ -33,6 +35,8 @@ using namespace llvm;
 STATISTIC(NumFunctions, "Number of function bodies removed");
 STATISTIC(NumVariables, "Number of global initializers removed");
 
+static bool stripExternals(Module &M);
+
 namespace {
 struct LLVM_LIBRARY_VISIBILITY StripExternals : public ModulePass {
   static char ID; // Pass identification, replacement for typeid
@@ -40,7 +44,7 @@ struct LLVM_LIBRARY_VISIBILITY StripExternals : public ModulePass {
 
   // run - Do the StripExternals pass on the specified module.
   //
-  bool runOnModule(Module &M) override;
+  bool runOnModule(Module &M) override { return stripExternals(M); }
 };
 }
 
@@ -50,7 +54,16 @@ static RegisterPass<StripExternals>
 
 ModulePass *createStripExternalsPass() { return new StripExternals(); }
 
-bool StripExternals::runOnModule(Module &M) {
+#if LDC_LLVM_VER >= 600
+PreservedAnalyses StripExternalsPass::run(Module &M, ModuleAnalysisManager &) {
+  return stripExternals(M) ? PreservedAnalyses::none()
+                           : PreservedAnalyses::all();
+}
+#endif
+
+static bool stripExternals(Module &M) {
+  timereport::Scope timeScope("StripExternals", "Optimization");
+
   bool Changed = false;
 
   for (auto I = M.begin(); I != M.end();) {
@@ -26,6 +26,8 @@
 #include "gen/recursivevisitor.h"
 #include "gen/tollvm.h"
 
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/MDBuilder.h"
 #include "llvm/ProfileData/InstrProfReader.h"
@@ -38,8 +40,22 @@ llvm::cl::opt<bool, false, opts::FlagParser<bool>> enablePGOIndirectCalls(
     "pgo-indirect-calls", llvm::cl::ZeroOrMore, llvm::cl::Hidden,
     llvm::cl::desc("(*) Enable PGO of indirect calls (LLVM >= 3.9)"),
     llvm::cl::init(true));
+
+llvm::cl::opt<unsigned> indirectCallTargetPercent(
+    "pgo-indirect-call-target-percent", llvm::cl::ZeroOrMore,
+    llvm::cl::Hidden,
+    llvm::cl::desc("Make external indirect call targets taking at least this "
+                   "percentage of a call site's count visible for promotion"),
+    llvm::cl::init(30));
 }
 
+#define DEBUG_TYPE "ldc-pgo"
+
+STATISTIC(NumHotIndirectCallSites,
+          "Number of indirect call sites with a hot target");
+STATISTIC(NumDeclaredCallTargets,
+          "Number of external indirect call targets declared for promotion");
+
 /// \brief Stable hasher for PGO region counters.
 ///
 /// PGOHash produces a stable hash of a given function's control flow.
@@ -1064,3 +1080,73 @@ void CodeGenPGO::valueProfile(uint32_t valueKind, llvm::Instruction *valueSite,
     NumValueSites[valueKind]++;
   }
 }
+
+void declareHotIndirectCallTargets(IRState *irs) {
+#if LDC_LLVM_VER >= 500
+  auto *PGOReader = irs->getPGOReader();
+  if (!PGOReader || !enablePGOIndirectCalls)
+    return;
+
+  // Virtual and delegate calls mostly target functions defined in other
+  // modules, which LLVM's indirect call promotion can't see as they are not
+  // declared in this one. Declare the hot ones as extern_weak: if a target
+  // doesn't exist anymore, its address is null and the guard of the promoted
+  // call is never taken. Only ELF resolves undefined weak references this way.
+  if (!global.params.targetTriple->isOSBinFormatELF())
+    return;
+
+  const auto &Symtab = PGOReader->getSymtab();
+  llvm::Module &M = irs->module;
+
+  // LLVM's default maximum number of promotions per call site.
+  const uint32_t MaxTargets = 3;
+  llvm::InstrProfValueData ValueData[MaxTargets];
+
+  std::vector<std::pair<llvm::StringRef, llvm::FunctionType *>> Targets;
+  for (auto &F : M) {
+    for (auto &BB : F) {
+      for (auto &I : BB) {
+        llvm::CallSite CS(&I);
+        if (!CS || CS.getCalledFunction() || CS.isInlineAsm())
+          continue;
+
+        uint32_t NumValueData;
+        uint64_t TotalCount;
+        if (!llvm::getValueProfDataFromInst(I, llvm::IPVK_IndirectCallTarget,
+                                            MaxTargets, ValueData,
+                                            NumValueData, TotalCount)) {
+          continue;
+        }
+
+        bool IsHot = false;
+        // The value data is sorted by decreasing count.
+        for (uint32_t i = 0; i < NumValueData; ++i) {
+          if (ValueData[i].Count * 100 < TotalCount * indirectCallTargetPercent)
+            break;
+          IsHot = true;
+          // Names of local functions are prefixed with their file name; those
+          // are defined in this module anyway.
+          auto Name = Symtab.getFuncName(ValueData[i].Value);
+          if (Name.empty() || Name.contains(':') || M.getNamedValue(Name))
+            continue;
+          auto *FTy = llvm::cast<llvm::FunctionType>(
+              CS.getCalledValue()->getType()->getPointerElementType());
+          Targets.emplace_back(Name, FTy);
+        }
+        if (IsHot)
+          ++NumHotIndirectCallSites;
+      }
+    }
+  }
+
+  for (const auto &T : Targets) {
+    if (M.getNamedValue(T.first))
+      continue;
+    IF_LOG Logger::println("Declaring hot indirect call target: %s",
+                           T.first.str().c_str());
+    llvm::Function::Create(T.second, llvm::GlobalValue::ExternalWeakLinkage,
+                           T.first, &M);
+    ++NumDeclaredCallTargets;
+  }
+#endif
+}
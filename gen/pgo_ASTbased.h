@@ -173,4 +173,9 @@ private:
                         const FuncDeclaration *D);
 };
 
+/// Declares the external hot targets of profiled indirect calls in the
+/// module, enabling LLVM's indirect call promotion for them.
+/// Does nothing for LLVM < 5.0.
+void declareHotIndirectCallTargets(IRState *irs);
+
 #endif //  LDC_GEN_PGO_ASTBASED_H
@@ -0,0 +1,159 @@
+//===-- pointerbitmap.cpp -------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gen/pointerbitmap.h"
+
+#include "aggregate.h"
+#include "declaration.h"
+#include "mtype.h"
+#include "target.h"
+#include "gen/irstate.h"
+#include "gen/llvm.h"
+#include "gen/logger.h"
+#include "gen/tollvm.h"
+#include "llvm/Support/CommandLine.h"
+#include <vector>
+
+static llvm::cl::opt<bool> gcPointerBitmaps(
+    "fgc-pointer-bitmaps", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("(experimental) Pass a compile-time pointer bitmap of the "
+                   "allocated type to the GC allocation hooks, enabling "
+                   "precise scanning; requires a druntime providing the "
+                   "_d_*Bitmap hooks"));
+
+bool isPointerBitmapEnabled() { return gcPointerBitmaps; }
+
+namespace {
+
+class PointerBitmapBuilder {
+  const uint64_t ptrSize;
+  std::vector<bool> words;
+
+  bool mark(uint64_t offset) {
+    if (offset % ptrSize != 0)
+      return false;
+    words[offset / ptrSize] = true;
+    return true;
+  }
+
+  bool addFields(AggregateDeclaration *ad, uint64_t offset) {
+    for (VarDeclaration *vd : ad->fields) {
+      if (!add(vd->type, offset + vd->offset))
+        return false;
+    }
+    return true;
+  }
+
+public:
+  PointerBitmapBuilder(uint64_t size)
+      : ptrSize(Target::ptrsize), words((size + ptrSize - 1) / ptrSize) {}
+
+  /// Adds the GC pointers of a `t` at `offset`. Returns false if they cannot
+  /// be described precisely.
+  bool add(Type *t, uint64_t offset) {
+    t = t->toBasetype();
+    if (!t->hasPointers())
+      return true;
+
+    switch (t->ty) {
+    case Tpointer:
+    case Tclass:
+    case Taarray:
+    case Tnull:
+      return mark(offset);
+    case Tarray:
+      return mark(offset + ptrSize); // .ptr
+    case Tdelegate:
+      return mark(offset); // context pointer
+    case Tsarray: {
+      auto ts = static_cast<TypeSArray *>(t);
+      Type *elem = ts->nextOf();
+      const uint64_t elemSize = elem->size();
+      const uint64_t dim = ts->dim->toUInteger();
+      for (uint64_t i = 0; i < dim; ++i) {
+        if (!add(elem, offset + i * elemSize))
+          return false;
+      }
+      return true;
+    }
+    case Tstruct:
+      return addFields(static_cast<TypeStruct *>(t)->sym, offset);
+    default:
+      return false;
+    }
+  }
+
+  /// Adds the GC pointers of a class instance; the vtable and monitor
+  /// pointers (and those of implemented interfaces) never point into the GC
+  /// heap.
+  bool addInstance(ClassDeclaration *cd) {
+    for (; cd; cd = cd->baseClass) {
+      if (!addFields(cd, 0))
+        return false;
+    }
+    return true;
+  }
+
+  llvm::Constant *build(uint64_t size) const {
+    const uint64_t bitsPerWord = 8 * ptrSize;
+    std::vector<uint64_t> bitmap(1 + (words.size() + bitsPerWord - 1) /
+                                         bitsPerWord);
+    bitmap[0] = size;
+    for (size_t i = 0; i < words.size(); ++i) {
+      if (words[i])
+        bitmap[1 + i / bitsPerWord] |= uint64_t(1) << (i % bitsPerWord);
+    }
+
+    std::vector<llvm::Constant *> elements;
+    elements.reserve(bitmap.size());
+    for (uint64_t word : bitmap)
+      elements.push_back(DtoConstSize_t(word));
+    return llvm::ConstantArray::get(
+        llvm::ArrayType::get(DtoSize_t(), elements.size()), elements);
+  }
+};
+
+} // anonymous namespace
+
+llvm::Constant *DtoPointerBitmapOf(Type *type) {
+  Type *tb = type->toBasetype();
+  if (!tb->deco)
+    return nullptr;
+
+  const std::string name = std::string("_ldc_ptrbitmap_") + tb->deco;
+  llvm::GlobalVariable *gvar = gIR->module.getGlobalVariable(name);
+  if (!gvar) {
+    uint64_t size;
+    llvm::Constant *init;
+    if (tb->ty == Tclass) {
+      auto cd = static_cast<TypeClass *>(tb)->sym;
+      size = cd->structsize;
+      PointerBitmapBuilder builder(size);
+      if (!builder.addInstance(cd))
+        return nullptr;
+      init = builder.build(size);
+    } else {
+      size = tb->size();
+      PointerBitmapBuilder builder(size);
+      if (!builder.add(tb, 0))
+        return nullptr;
+      init = builder.build(size);
+    }
+
+    IF_LOG Logger::println("Emitting pointer bitmap for %s", tb->toChars());
+
+    gvar = new llvm::GlobalVariable(gIR->module, init->getType(), true,
+                                    llvm::GlobalValue::LinkOnceODRLinkage,
+                                    init, name);
+    setLinkage({llvm::GlobalValue::LinkOnceODRLinkage, supportsCOMDAT()},
+               gvar);
+  }
+
+  return DtoBitCast(gvar, getPtrToType(DtoSize_t()));
+}
@@ -0,0 +1,36 @@
+//===-- gen/pointerbitmap.h - GC pointer bitmaps ----------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Compile-time pointer bitmaps of GC-allocated types, passed to the typed
+// allocation hooks with -fgc-pointer-bitmaps to enable precise scanning.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_GEN_POINTERBITMAP_H
+#define LDC_GEN_POINTERBITMAP_H
+
+class Type;
+namespace llvm {
+class Constant;
+}
+
+/// Whether -fgc-pointer-bitmaps is enabled.
+bool isPointerBitmapEnabled();
+
+/// Returns a `const(size_t)*` to the constant pointer bitmap of a GC-allocated
+/// `type` (of the instance for classes), or null if its layout cannot be
+/// described precisely, e.g., due to misaligned pointers.
+///
+/// The layout matches druntime's precise GC RTInfo: the first word is the
+/// size of the type in bytes, followed by one bit per pointer-sized word,
+/// starting with the least significant bit, which is set if the word may
+/// point into the GC heap.
+llvm::Constant *DtoPointerBitmapOf(Type *type);
+
+#endif
@@ -73,6 +73,12 @@ LDCPragma DtoGetPragma(Scope *sc, PragmaDeclaration *decl,
         {"bitop.bt", LLVMbitop_bt},   {"bitop.btc", LLVMbitop_btc},
         {"bitop.btr", LLVMbitop_btr}, {"bitop.bts", LLVMbitop_bts},
         {"bitop.vld", LLVMbitop_vld}, {"bitop.vst", LLVMbitop_vst},
+        {"simd.gather", LLVMsimd_gather},
+        {"simd.masked_load", LLVMsimd_masked_load},
+        {"simd.masked_store", LLVMsimd_masked_store},
+        {"simd.reduce_add", LLVMsimd_reduce_add},
+        {"simd.select", LLVMsimd_select},
+        {"simd.shuffle", LLVMsimd_shuffle},
     };
 
     static std::string prefix = "ldc.";
@@ -396,6 +402,24 @@ void DtoCheckPragma(PragmaDeclaration *decl, Dsymbol *s,
     }
     break;
 
+  case LLVMsimd_gather:
+  case LLVMsimd_masked_load:
+  case LLVMsimd_masked_store:
+  case LLVMsimd_reduce_add:
+  case LLVMsimd_select:
+  case LLVMsimd_shuffle:
+    if (FuncDeclaration *fd = s->isFuncDeclaration()) {
+      fd->llvmInternal = llvm_internal;
+    } else if (TemplateDeclaration *td = s->isTemplateDeclaration()) {
+      td->llvmInternal = llvm_internal;
+    } else {
+      error(s->loc, "the `%s` pragma is only allowed on function or template "
+                    "declarations",
+            ident->toChars());
+      fatal();
+    }
+    break;
+
   case LLVMno_typeinfo:
     s->llvmInternal = llvm_internal;
     break;
@@ -492,6 +516,12 @@ bool DtoIsIntrinsic(FuncDeclaration *fd) {
   case LLVMbitop_bts:
   case LLVMbitop_vld:
   case LLVMbitop_vst:
+  case LLVMsimd_gather:
+  case LLVMsimd_masked_load:
+  case LLVMsimd_masked_store:
+  case LLVMsimd_reduce_add:
+  case LLVMsimd_select:
+  case LLVMsimd_shuffle:
     return true;
 
   default:
@@ -509,3 +539,110 @@ bool DtoIsVaIntrinsic(FuncDeclaration *fd) {
 bool DtoCheckProfileInstrPragma(Expression *arg, bool &value) {
   return parseBoolExp(arg, value);
 }
+
+enum class LoopHintKind { Flag, Bool, Count };
+
+struct LoopHint {
+  const char *name;
+  LoopHintKind kind;
+};
+
+static const LoopHint loopHints[] = {
+    {"vectorize.enable", LoopHintKind::Bool},
+    {"vectorize.width", LoopHintKind::Count},
+    {"interleave.count", LoopHintKind::Count},
+    {"unroll.enable", LoopHintKind::Flag},
+    {"unroll.disable", LoopHintKind::Flag},
+    {"unroll.full", LoopHintKind::Flag},
+    {"unroll.count", LoopHintKind::Count},
+    {"distribute.enable", LoopHintKind::Bool},
+};
+
+static const LoopHint *findLoopHint(Expression *e) {
+  const char *name = nullptr;
+  if (!e || !parseStringExp(e, name)) {
+    return nullptr;
+  }
+  for (const auto &hint : loopHints) {
+    if (llvm::StringRef(name) == hint.name) {
+      return &hint;
+    }
+  }
+  return nullptr;
+}
+
+// pragma(LDC_loop, "hint"[, value])
+// Return false if an error occurred.
+bool DtoCheckLoopPragma(const Loc &loc, Expressions *args) {
+  if (!args || args->dim < 1 || args->dim > 2) {
+    error(loc, "`pragma(LDC_loop, \"hint\"[, value])` expected");
+    return false;
+  }
+
+  const LoopHint *hint = findLoopHint((*args)[0]);
+  if (!hint) {
+    error(loc, "unknown loop hint `%s` for `pragma(LDC_loop)`",
+          (*args)[0]->toChars());
+    return false;
+  }
+
+  Expression *value = args->dim > 1 ? (*args)[1] : nullptr;
+  bool b;
+  dinteger_t count;
+  switch (hint->kind) {
+  case LoopHintKind::Flag:
+    if (value) {
+      error(loc, "loop hint `%s` does not take a value", hint->name);
+      return false;
+    }
+    break;
+  case LoopHintKind::Bool:
+    if (value && !parseBoolExp(value, b)) {
+      error(loc, "loop hint `%s` expects `true` or `false`, not `%s`",
+            hint->name, value->toChars());
+      return false;
+    }
+    break;
+  case LoopHintKind::Count:
+    if (!value || !parseIntExp(value, count) || count == 0 ||
+        count > 0xFFFFFFFF) {
+      error(loc, "loop hint `%s` expects a positive integer", hint->name);
+      return false;
+    }
+    break;
+  }
+  return true;
+}
+
+llvm::MDNode *DtoLoopPragmaMetadata(llvm::LLVMContext &ctx,
+                                    Expressions *hints) {
+  llvm::SmallVector<llvm::Metadata *, 4> ops;
+  ops.push_back(nullptr); // self reference
+  for (size_t i = 0; i + 1 < hints->dim; i += 2) {
+    const LoopHint *hint = findLoopHint((*hints)[i]);
+    Expression *value = (*hints)[i + 1];
+    assert(hint && "loop hints should have been checked already");
+
+    llvm::SmallVector<llvm::Metadata *, 2> hintOps;
+    hintOps.push_back(
+        llvm::MDString::get(ctx, std::string("llvm.loop.") + hint->name));
+    if (hint->kind == LoopHintKind::Bool) {
+      bool b = true;
+      if (value) {
+        parseBoolExp(value, b);
+      }
+      hintOps.push_back(llvm::ConstantAsMetadata::get(
+          llvm::ConstantInt::get(llvm::Type::getInt1Ty(ctx), b)));
+    } else if (hint->kind == LoopHintKind::Count) {
+      dinteger_t count = 0;
+      parseIntExp(value, count);
+      hintOps.push_back(llvm::ConstantAsMetadata::get(
+          llvm::ConstantInt::get(llvm::Type::getInt32Ty(ctx), count)));
+    }
+    ops.push_back(llvm::MDNode::get(ctx, hintOps));
+  }
+
+  llvm::MDNode *loopID = llvm::MDNode::getDistinct(ctx, ops);
+  loopID->replaceOperandWith(0, loopID);
+  return loopID;
+}
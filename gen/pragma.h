@@ -14,13 +14,19 @@
 #ifndef LDC_GEN_PRAGMA_H
 #define LDC_GEN_PRAGMA_H
 
+#include "arraytypes.h"
 #include <string>
 
 class PragmaDeclaration;
 class FuncDeclaration;
 class Dsymbol;
+struct Loc;
 struct Scope;
 class Expression;
+namespace llvm {
+class LLVMContext;
+class MDNode;
+}
 
 // Remember to keep this enum in-sync with dpragma.d
 enum LDCPragma {
@@ -48,6 +54,12 @@ enum LDCPragma {
   LLVMbitop_bts,
   LLVMbitop_vld,
   LLVMbitop_vst,
+  LLVMsimd_gather,
+  LLVMsimd_masked_load,
+  LLVMsimd_masked_store,
+  LLVMsimd_reduce_add,
+  LLVMsimd_select,
+  LLVMsimd_shuffle,
   LLVMextern_weak,
   LLVMprofile_instr
 };
@@ -56,6 +68,11 @@ LDCPragma DtoGetPragma(Scope *sc, PragmaDeclaration *decl, const char *&arg1str)
 void DtoCheckPragma(PragmaDeclaration *decl, Dsymbol *sym, LDCPragma llvm_internal,
                     const char * const arg1str);
 bool DtoCheckProfileInstrPragma(Expression *arg, bool &value);
+bool DtoCheckLoopPragma(const Loc &loc, Expressions *args);
+/// Returns the llvm.loop metadata for the name/value pairs of the
+/// pragma(LDC_loop) hints applied to a loop.
+llvm::MDNode *DtoLoopPragmaMetadata(llvm::LLVMContext &ctx,
+                                    Expressions *hints);
 bool DtoIsIntrinsic(FuncDeclaration *fd);
 bool DtoIsVaIntrinsic(FuncDeclaration *fd);
 
@@ -23,6 +23,7 @@
 #include "ir/irtype.h"
 #include "ir/irtypefunction.h"
 #include "driver/cl_options_instrumentation.h"
+#include "driver/gcallocreport.h"
 #include "ldcbindings.h"
 #include "mars.h"
 #include "module.h"
@@ -48,25 +49,20 @@ static llvm::cl::opt<bool> nogc(
     llvm::cl::desc(
         "Do not allow code that generates implicit garbage collector calls"));
 
-////////////////////////////////////////////////////////////////////////////////
-
-// Internal LLVM module containing already declared runtime functions and
-// globals.
-static llvm::Module *M = nullptr;
-
-static void buildRuntimeModule();
-
-////////////////////////////////////////////////////////////////////////////////
 
 static void checkForImplicitGCCall(const Loc &loc, const char *name) {
   if (nogc) {
+    // Sorted (by strcmp) for the binary search below.
     static const std::string GCNAMES[] = {
         "_aaDelX",
         "_aaGetY",
         "_aaKeys",
         "_aaRehash",
         "_aaValues",
+        "_d_allocclass",
+        "_d_allocclassBitmap",
         "_d_allocmemory",
+        "_d_allocmemoryBitmap",
         "_d_allocmemoryT",
         "_d_array_cast_len",
         "_d_array_slice_copy",
@@ -76,24 +72,26 @@ static void checkForImplicitGCCall(const Loc &loc, const char *name) {
         "_d_arrayappendwd",
         "_d_arraycatT",
         "_d_arraycatnTX",
+        "_d_arraysetcapacity",
         "_d_arraysetlengthT",
         "_d_arraysetlengthiT",
         "_d_assocarrayliteralTX",
         "_d_callfinalizer",
         "_d_delarray_t",
         "_d_delclass",
-        "_d_delstruct",
         "_d_delinterface",
         "_d_delmemory",
+        "_d_delstruct",
         "_d_newarrayT",
+        "_d_newarrayU",
         "_d_newarrayiT",
         "_d_newarraymTX",
         "_d_newarraymiTX",
-        "_d_newarrayU",
         "_d_newclass",
-        "_d_allocclass",
+        "_d_newitemBitmap",
         "_d_newitemT",
         "_d_newitemiT",
+        "_d_tlab_refill",
     };
 
     if (binary_search(&GCNAMES[0],
@@ -109,22 +107,26 @@ static void checkForImplicitGCCall(const Loc &loc, const char *name) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// The signatures of the runtime functions are only materialized when a function
+// is first requested; they are cached here until freeRuntime().
+namespace {
+struct RuntimeSignature {
+  llvm::FunctionType *type;
+  LLAttributeSet attributes;
+  llvm::CallingConv::ID callingConv;
+};
+llvm::StringMap<RuntimeSignature> runtimeSignatures;
+} // anonymous namespace
+
 bool initRuntime() {
   Logger::println("*** Initializing D runtime declarations ***");
-  LOG_SCOPE;
-
-  if (!M) {
-    buildRuntimeModule();
-  }
-
   return true;
 }
 
 void freeRuntime() {
-  if (M) {
+  if (!runtimeSignatures.empty()) {
     Logger::println("*** Freeing D runtime declarations ***");
-    delete M;
-    M = nullptr;
+    runtimeSignatures.clear();
   }
 }
 
@@ -192,150 +194,661 @@ LazyAggregateType moduleInfoTy(Module::moduleinfo, "ModuleInfo");
 
 ////////////////////////////////////////////////////////////////////////////////
 
-struct PotentiallyLazyType {
-private:
-  enum class Kind {
-    normal,
-    lazyClass,
-    lazyAggregate,
-  };
-  Kind kind;
-  int numIndirections = 0;
-  void *ptr;
+// Return and parameter types of the runtime function signatures.
+enum RTType : uint8_t {
+  rtNone, // terminates the parameter list
+  rtVoid,
+  rtBool,
+  rtUbyte,
+  rtInt,
+  rtUint,
+  rtUlong,
+  rtSize,
+  rtDchar,
+  rtReal,
+  rtCreal,
+  rtVoidPtr,
+  rtVoidPtrPtr,
+  rtVoidArray,
+  rtVoidArrayPtr,
+  rtVoidArrayArray,
+  rtSizePtr,
+  rtSizeArray,
+  rtUintArray,
+  rtString,
+  rtWstring,
+  rtDstring,
+  rtAA,    // the AA type is a struct that only contains a ptr
+  rtAAPtr,
+  rtDg1,   // int delegate(void*)
+  rtDg2,   // int delegate(void*, void*)
+  rtObject,
+  rtObjectPtr,
+  rtTypeInfo,
+  rtClassInfo,
+  rtStructTypeInfo,
+  rtAATypeInfo,
+  rtThrowable,
+  rtModuleInfoPtr,
+};
 
-public:
-  PotentiallyLazyType(Type *type) : kind(Kind::normal), ptr(type) {}
-  PotentiallyLazyType(LazyClassType &type)
-      : kind(Kind::lazyClass), ptr(&type) {}
-  PotentiallyLazyType(LazyAggregateType &type)
-      : kind(Kind::lazyAggregate), ptr(&type) {}
-
-  PotentiallyLazyType pointerTo() const {
-    auto copy = *this;
-    copy.numIndirections++;
-    return copy;
-  }
+// Additional attributes of the runtime functions.
+enum RTAttrs : uint8_t {
+  attrNone,
+  attrNoAlias,
+  attrNoUnwind,
+  attrReadOnly,
+  attrReadOnly_NoUnwind,
+  attrReadNone,
+  attrCold_NoReturn,
+  attrCold_NoReturn_NoUnwind,
+  attrReadOnly_1_3_NoCapture,
+  attrReadOnly_NoUnwind_1_2_NoCapture,
+  attr1_2_NoCapture,
+  attr1_3_NoCapture,
+  attr1_4_NoCapture,
+  attrNonLazyBind,
+};
 
-  Type *get(const Loc &loc) const {
-    Type *ty;
-    if (kind == Kind::lazyClass) {
-      ty = static_cast<LazyClassType *>(ptr)->get(loc);
-    } else if (kind == Kind::lazyAggregate) {
-      ty = static_cast<LazyAggregateType *>(ptr)->get(loc);
-    } else {
-      ty = static_cast<Type *>(ptr);
-    }
+// Targets for which a signature is valid; the first matching entry for a
+// name wins.
+enum RTTarget : uint8_t {
+  targetAny,
+  targetAndroid,
+  targetMSVCEnvironment,
+  targetARM,
+  targetMSVCEH,
+};
 
-    for (int i = 0; i < numIndirections; ++i)
-      ty = ty->pointerTo();
+const unsigned maxRuntimeFunctionParams = 5;
 
-    return ty;
-  }
+struct RuntimeFunction {
+  const char *name;
+  LINK linkage;
+  RTType returnType;
+  RTType paramTypes[maxRuntimeFunctionParams];
+  StorageClass paramsSTC[maxRuntimeFunctionParams];
+  RTAttrs attributes;
+  RTTarget target;
 };
 
-const auto moduleInfoPtrTy = PotentiallyLazyType(moduleInfoTy).pointerTo();
-const auto objectPtrTy = PotentiallyLazyType(objectTy).pointerTo();
+// The druntime hooks and other functions the compiler emits calls to.
+// Nothing in here is turned into frontend or LLVM types until
+// getRuntimeFunction() is called for the name.
+constexpr RuntimeFunction runtimeFunctions[] = {
+    // void __cyg_profile_func_enter(void *callee, void *caller)
+    // void __cyg_profile_func_exit(void *callee, void *caller)
+    {"__cyg_profile_func_enter", LINKc, rtVoid, {rtVoidPtr, rtVoidPtr}, {},
+     attrNoUnwind},
+    {"__cyg_profile_func_exit", LINKc, rtVoid, {rtVoidPtr, rtVoidPtr}, {},
+     attrNoUnwind},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // C assert functions, see getCAssertFunction()
+    {"__assert_rtn", LINKc, rtVoid, {rtVoidPtr, rtVoidPtr, rtUint, rtVoidPtr},
+     {}, attrCold_NoReturn_NoUnwind},
+    {"__assert_c99", LINKc, rtVoid, {rtVoidPtr, rtVoidPtr, rtUint, rtVoidPtr},
+     {}, attrCold_NoReturn_NoUnwind},
+    {"__assert_fail", LINKc, rtVoid, {rtVoidPtr, rtVoidPtr, rtUint, rtVoidPtr},
+     {}, attrCold_NoReturn_NoUnwind},
+    {"_assert", LINKc, rtVoid, {rtVoidPtr, rtVoidPtr, rtUint}, {},
+     attrCold_NoReturn_NoUnwind},
+    {"__assert", LINKc, rtVoid, {rtVoidPtr, rtUint, rtVoidPtr}, {},
+     attrCold_NoReturn_NoUnwind, targetAndroid},
+    {"__assert", LINKc, rtVoid, {rtVoidPtr, rtVoidPtr, rtUint}, {},
+     attrCold_NoReturn_NoUnwind},
+
+    // void _d_assert(string file, uint line)
+    // void _d_arraybounds(string file, uint line)
+    {"_d_assert", LINKc, rtVoid, {rtString, rtUint}, {}, attrCold_NoReturn},
+    {"_d_arraybounds", LINKc, rtVoid, {rtString, rtUint}, {},
+     attrCold_NoReturn},
+
+    // void _d_assert_msg(string msg, string file, uint line)
+    {"_d_assert_msg", LINKc, rtVoid, {rtString, rtString, rtUint}, {},
+     attrCold_NoReturn},
+
+    // void _d_switch_error(immutable(ModuleInfo)* m, uint line)
+    {"_d_switch_error", LINKc, rtVoid, {rtModuleInfoPtr, rtUint},
+     {STCimmutable, 0}, attrCold_NoReturn},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // void* _d_allocmemory(size_t sz)
+    {"_d_allocmemory", LINKc, rtVoidPtr, {rtSize}, {}, attrNoAlias},
+
+    // void* _d_allocmemoryT(TypeInfo ti)
+    {"_d_allocmemoryT", LINKc, rtVoidPtr, {rtTypeInfo}, {}, attrNoAlias},
+
+    // void[] _d_newarrayT (const TypeInfo ti, size_t length)
+    // void[] _d_newarrayiT(const TypeInfo ti, size_t length)
+    // void[] _d_newarrayU (const TypeInfo ti, size_t length)
+    {"_d_newarrayT", LINKc, rtVoidArray, {rtTypeInfo, rtSize}, {STCconst, 0}},
+    {"_d_newarrayiT", LINKc, rtVoidArray, {rtTypeInfo, rtSize}, {STCconst, 0}},
+    {"_d_newarrayU", LINKc, rtVoidArray, {rtTypeInfo, rtSize}, {STCconst, 0}},
+
+    // void[] _d_newarraymTX (const TypeInfo ti, size_t[] dims)
+    // void[] _d_newarraymiTX(const TypeInfo ti, size_t[] dims)
+    {"_d_newarraymTX", LINKc, rtVoidArray, {rtTypeInfo, rtSizeArray},
+     {STCconst, 0}},
+    {"_d_newarraymiTX", LINKc, rtVoidArray, {rtTypeInfo, rtSizeArray},
+     {STCconst, 0}},
+
+    // void[] _d_arraysetlengthT (const TypeInfo ti, size_t newlength, void[]* p)
+    // void[] _d_arraysetlengthiT(const TypeInfo ti, size_t newlength, void[]* p)
+    {"_d_arraysetlengthT", LINKc, rtVoidArray,
+     {rtTypeInfo, rtSize, rtVoidArrayPtr}, {STCconst, 0, 0}},
+    {"_d_arraysetlengthiT", LINKc, rtVoidArray,
+     {rtTypeInfo, rtSize, rtVoidArrayPtr}, {STCconst, 0, 0}},
+
+    // size_t _d_arraysetcapacity(const TypeInfo ti, size_t newcapacity,
+    //                             void[]* p)
+    {"_d_arraysetcapacity", LINKc, rtSize, {rtTypeInfo, rtSize, rtVoidArrayPtr},
+     {STCconst, 0, 0}},
+
+    // byte[] _d_arrayappendcTX(const TypeInfo ti, ref byte[] px, size_t n)
+    {"_d_arrayappendcTX", LINKc, rtVoidArray, {rtTypeInfo, rtVoidArray, rtSize},
+     {STCconst, STCref, 0}},
+
+    // void[] _d_arrayappendT(const TypeInfo ti, ref byte[] x, byte[] y)
+    {"_d_arrayappendT", LINKc, rtVoidArray,
+     {rtTypeInfo, rtVoidArray, rtVoidArray}, {STCconst, STCref, 0}},
+
+    // void[] _d_arrayappendcd(ref byte[] x, dchar c)
+    // void[] _d_arrayappendwd(ref byte[] x, dchar c)
+    {"_d_arrayappendcd", LINKc, rtVoidArray, {rtVoidArray, rtDchar},
+     {STCref, 0}},
+    {"_d_arrayappendwd", LINKc, rtVoidArray, {rtVoidArray, rtDchar},
+     {STCref, 0}},
+
+    // byte[] _d_arraycatT(const TypeInfo ti, byte[] x, byte[] y)
+    {"_d_arraycatT", LINKc, rtVoidArray, {rtTypeInfo, rtVoidArray, rtVoidArray},
+     {STCconst, 0, 0}},
+
+    // void[] _d_arraycatnTX(const TypeInfo ti, byte[][] arrs)
+    {"_d_arraycatnTX", LINKc, rtVoidArray, {rtTypeInfo, rtVoidArrayArray},
+     {STCconst, 0}},
+
+    // Object _d_newclass(const ClassInfo ci)
+    // Object _d_allocclass(const ClassInfo ci)
+    {"_d_newclass", LINKc, rtObject, {rtClassInfo}, {STCconst}, attrNoAlias},
+    {"_d_allocclass", LINKc, rtObject, {rtClassInfo}, {STCconst}, attrNoAlias},
+
+    // void* _d_newitemT (TypeInfo ti)
+    // void* _d_newitemiT(TypeInfo ti)
+    {"_d_newitemT", LINKc, rtVoidPtr, {rtTypeInfo}, {}, attrNoAlias},
+    {"_d_newitemiT", LINKc, rtVoidPtr, {rtTypeInfo}, {}, attrNoAlias},
+
+    // void* _d_tlab_refill(size_t index, const TypeInfo ti)
+    {"_d_tlab_refill", LINKc, rtVoidPtr, {rtSize, rtTypeInfo}, {0, STCconst},
+     attrNoAlias},
+
+    // Typed allocations with a pointer bitmap (-fgc-pointer-bitmaps), see
+    // gen/pointerbitmap.h:
+    // void* _d_allocmemoryBitmap(const TypeInfo ti, const size_t* bitmap)
+    // void* _d_newitemBitmap(const TypeInfo ti, const size_t* bitmap)
+    // Object _d_allocclassBitmap(const ClassInfo ci, const size_t* bitmap)
+    {"_d_allocmemoryBitmap", LINKc, rtVoidPtr, {rtTypeInfo, rtSizePtr},
+     {STCconst, STCconst}, attrNoAlias},
+    {"_d_newitemBitmap", LINKc, rtVoidPtr, {rtTypeInfo, rtSizePtr},
+     {STCconst, STCconst}, attrNoAlias},
+    {"_d_allocclassBitmap", LINKc, rtObject, {rtClassInfo, rtSizePtr},
+     {STCconst, STCconst}, attrNoAlias},
+
+    // void _d_delarray_t(void[]* p, const TypeInfo_Struct ti)
+    {"_d_delarray_t", LINKc, rtVoid, {rtVoidArrayPtr, rtStructTypeInfo},
+     {0, STCconst}},
+
+    // void _d_delmemory(void** p)
+    // void _d_delinterface(void** p)
+    {"_d_delmemory", LINKc, rtVoid, {rtVoidPtrPtr}},
+    {"_d_delinterface", LINKc, rtVoid, {rtVoidPtrPtr}},
+
+    // void _d_callfinalizer(void* p)
+    {"_d_callfinalizer", LINKc, rtVoid, {rtVoidPtr}},
+
+    // D2: void _d_delclass(Object* p)
+    {"_d_delclass", LINKc, rtVoid, {rtObjectPtr}},
+
+    // void _d_delstruct(void** p, TypeInfo_Struct inf)
+    {"_d_delstruct", LINKc, rtVoid, {rtVoidPtrPtr, rtStructTypeInfo}},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // array slice copy when assertions are on!
+    // void _d_array_slice_copy(void* dst, size_t dstlen, void* src,
+    //                          size_t srclen)
+    {"_d_array_slice_copy", LINKc, rtVoid,
+     {rtVoidPtr, rtSize, rtVoidPtr, rtSize}, {}, attr1_3_NoCapture},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // int _aApplycd1(in char[] aa, dg_t dg)
+    // int _aApplyRcd1(in char[] aa, dg_t dg)
+    // int _aApplycd2(in char[] aa, dg2_t dg)
+    // int _aApplyRcd2(in char[] aa, dg2_t dg)
+#define STR_APPLY(TY, DG, n, a, b)                                             \
+  {"_aApply" #a #n, LINKc, rtSize, {TY, DG}},                                  \
+      {"_aApply" #b #n, LINKc, rtSize, {TY, DG}},                              \
+      {"_aApplyR" #a #n, LINKc, rtSize, {TY, DG}},                             \
+      {"_aApplyR" #b #n, LINKc, rtSize, {TY, DG}}
+    STR_APPLY(rtString, rtDg1, 1, cw, cd),
+    STR_APPLY(rtWstring, rtDg1, 1, wc, wd),
+    STR_APPLY(rtDstring, rtDg1, 1, dc, dw),
+    STR_APPLY(rtString, rtDg2, 2, cw, cd),
+    STR_APPLY(rtWstring, rtDg2, 2, wc, wd),
+    STR_APPLY(rtDstring, rtDg2, 2, dc, dw),
+#undef STR_APPLY
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // fixes the length for dynamic array casts
+    // size_t _d_array_cast_len(size_t len, size_t elemsz, size_t newelemsz)
+    {"_d_array_cast_len", LINKc, rtSize, {rtSize, rtSize, rtSize}, {},
+     attrReadNone},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // void[] _d_arrayassign_l(TypeInfo ti, void[] src, void[] dst, void* ptmp)
+    // void[] _d_arrayassign_r(TypeInfo ti, void[] src, void[] dst, void* ptmp)
+    {"_d_arrayassign_l", LINKc, rtVoidArray,
+     {rtTypeInfo, rtVoidArray, rtVoidArray, rtVoidPtr}},
+    {"_d_arrayassign_r", LINKc, rtVoidArray,
+     {rtTypeInfo, rtVoidArray, rtVoidArray, rtVoidPtr}},
+
+    // void[] _d_arrayctor(TypeInfo ti, void[] from, void[] to)
+    {"_d_arrayctor", LINKc, rtVoidArray,
+     {rtTypeInfo, rtVoidArray, rtVoidArray}},
+
+    // void* _d_arraysetassign(void* p, void* value, int count, TypeInfo ti)
+    // void* _d_arraysetctor(void* p, void* value, int count, TypeInfo ti)
+    {"_d_arraysetassign", LINKc, rtVoidPtr,
+     {rtVoidPtr, rtVoidPtr, rtInt, rtTypeInfo}, {}, attrNoAlias},
+    {"_d_arraysetctor", LINKc, rtVoidPtr,
+     {rtVoidPtr, rtVoidPtr, rtInt, rtTypeInfo}, {}, attrNoAlias},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // cast interface
+    // void* _d_interface_cast(void* p, ClassInfo c)
+    {"_d_interface_cast", LINKc, rtVoidPtr, {rtVoidPtr, rtClassInfo}, {},
+     attrReadOnly_NoUnwind},
+
+    // dynamic cast
+    // void* _d_dynamic_cast(Object o, ClassInfo c)
+    {"_d_dynamic_cast", LINKc, rtVoidPtr, {rtObject, rtClassInfo}, {},
+     attrReadOnly_NoUnwind},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // int _adEq2(void[] a1, void[] a2, TypeInfo ti)
+    {"_adEq2", LINKc, rtInt, {rtVoidArray, rtVoidArray, rtTypeInfo}, {},
+     attrReadOnly},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // void* _aaGetY(AA* aa, const TypeInfo aati, in size_t valuesize,
+    //               in void* pkey)
+    {"_aaGetY", LINKc, rtVoidPtr, {rtAAPtr, rtAATypeInfo, rtSize, rtVoidPtr},
+     {0, STCconst, STCin, STCin}, attr1_4_NoCapture},
+
+    // inout(void)* _aaInX(inout AA aa, in TypeInfo keyti, in void* pkey)
+    // FIXME: "inout" storageclass is not applied to return type
+    {"_aaInX", LINKc, rtVoidPtr, {rtAA, rtTypeInfo, rtVoidPtr},
+     {STCin | STCout, STCin, STCin}, attrReadOnly_1_3_NoCapture},
+
+    // bool _aaDelX(AA aa, in TypeInfo keyti, in void* pkey)
+    {"_aaDelX", LINKc, rtBool, {rtAA, rtTypeInfo, rtVoidPtr}, {0, STCin, STCin},
+     attr1_3_NoCapture},
+
+    // int _aaEqual(in TypeInfo tiRaw, in AA e1, in AA e2)
+    {"_aaEqual", LINKc, rtInt, {rtTypeInfo, rtAA, rtAA}, {STCin, STCin, STCin},
+     attr1_2_NoCapture},
+
+    // AA _d_assocarrayliteralTX(const TypeInfo_AssociativeArray ti,
+    //                           void[] keys, void[] values)
+    {"_d_assocarrayliteralTX", LINKc, rtAA,
+     {rtAATypeInfo, rtVoidArray, rtVoidArray}, {STCconst, 0, 0}},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // void _d_throw_exception(Throwable o)
+    {"_d_throw_exception", LINKc, rtVoid, {rtThrowable}, {}, attrCold_NoReturn},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // int __CxxFrameHandler3(ptr ExceptionRecord, ptr EstablisherFrame,
+    //                        ptr ContextRecord, ptr DispatcherContext)
+    {"__CxxFrameHandler3", LINKc, rtInt,
+     {rtVoidPtr, rtVoidPtr, rtVoidPtr, rtVoidPtr}},
+
+    // int _d_eh_personality(...)
+    // MSVC: (ptr ExceptionRecord, ptr EstablisherFrame, ptr ContextRecord,
+    //        ptr DispatcherContext)
+    // ARM:  (int state, ptr ucb, ptr context)
+    // else: (int ver, int actions, ulong eh_class, ptr eh_info, ptr context)
+    {"_d_eh_personality", LINKc, rtInt,
+     {rtVoidPtr, rtVoidPtr, rtVoidPtr, rtVoidPtr}, {}, attrNone,
+     targetMSVCEnvironment},
+    {"_d_eh_personality", LINKc, rtInt, {rtInt, rtVoidPtr, rtVoidPtr}, {},
+     attrNone, targetARM},
+    {"_d_eh_personality", LINKc, rtInt,
+     {rtInt, rtInt, rtUlong, rtVoidPtr, rtVoidPtr}},
+
+    // MSVC EH only:
+    // bool _d_enter_cleanup(ptr frame)
+    // void _d_leave_cleanup(ptr frame)
+    // Throwable _d_eh_enter_catch(ptr exception, ClassInfo catchType)
+    {"_d_enter_cleanup", LINKc, rtBool, {rtVoidPtr}, {}, attrNone,
+     targetMSVCEH},
+    {"_d_leave_cleanup", LINKc, rtVoid, {rtVoidPtr}, {}, attrNone,
+     targetMSVCEH},
+    {"_d_eh_enter_catch", LINKc, rtThrowable, {rtVoidPtr, rtClassInfo}, {},
+     attrNone, targetMSVCEH},
+
+    // Continue-unwinding functions, see getUnwindResumeFunction()
+    {"_Unwind_Resume", LINKc, rtVoid, {rtVoidPtr}, {}, attrCold_NoReturn},
+    {"_Unwind_SjLj_Resume", LINKc, rtVoid, {rtVoidPtr}, {}, attrCold_NoReturn},
+    {"_d_eh_resume_unwind", LINKc, rtVoid, {rtVoidPtr}, {}, attrCold_NoReturn},
 
-////////////////////////////////////////////////////////////////////////////////
+    // Throwable _d_eh_enter_catch(ptr)
+    {"_d_eh_enter_catch", LINKc, rtThrowable, {rtVoidPtr}, {}, attrNoUnwind},
 
-struct LazyFunctionDeclarer {
-  LINK linkage;
-  PotentiallyLazyType returnType;
-  std::vector<llvm::StringRef> mangledFunctionNames;
-  std::vector<PotentiallyLazyType> paramTypes;
-  std::vector<StorageClass> paramsSTC;
-  AttrSet attributes;
-
-  void declare(const Loc &loc) {
-    Parameters *params = nullptr;
-    if (!paramTypes.empty()) {
-      params = new Parameters();
-      for (size_t i = 0, e = paramTypes.size(); i < e; ++i) {
-        StorageClass stc = paramsSTC.empty() ? 0 : paramsSTC[i];
-        Type *paramTy = paramTypes[i].get(loc);
-        params->push(
-            Parameter::create(stc, paramTy, nullptr, nullptr, nullptr));
-      }
-    }
-    Type *returnTy = returnType.get(loc);
-    auto dty = TypeFunction::create(params, returnTy, 0, linkage);
-
-    // the call to DtoType performs many actions such as rewriting the function
-    // type and storing it in dty
-    auto llfunctype = llvm::cast<llvm::FunctionType>(DtoType(dty));
-    assert(dty->ctype);
-    auto attrs =
-        dty->ctype->getIrFuncTy().getParamAttrs(gABI->passThisBeforeSret(dty));
-    attrs.merge(attributes);
-
-    for (auto fname : mangledFunctionNames) {
-      llvm::Function *fn = llvm::Function::Create(
-          llfunctype, llvm::GlobalValue::ExternalLinkage, fname, M);
-
-      fn->setAttributes(attrs);
-
-      // On x86_64, always set 'uwtable' for System V ABI compatibility.
-      // FIXME: Move to better place (abi-x86-64.cpp?)
-      // NOTE: There are several occurances if this line.
-      if (global.params.targetTriple->getArch() == llvm::Triple::x86_64) {
-        fn->addFnAttr(LLAttribute::UWTable);
-      }
+    // void* __cxa_begin_catch(ptr)
+    {"__cxa_begin_catch", LINKc, rtVoidPtr, {rtVoidPtr}, {}, attrNoUnwind},
 
-      fn->setCallingConv(gABI->callingConv(linkage, dty));
-    }
-  }
+    ////////////////////////////////////////////////////////////////////////////
+
+    // void invariant._d_invariant(Object o)
+    {"_D9invariant12_d_invariantFC6ObjectZv", LINKd, rtVoid, {rtObject}},
+
+    // void _d_dso_registry(void* data)
+    // (the argument is really a pointer to
+    // rt.sections_elf_shared.CompilerDSOData)
+    {"_d_dso_registry", LINKc, rtVoid, {rtVoidPtr}},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // extern (C) void _d_cover_register2(string filename, size_t[] valid,
+    //                                    uint[] data, ubyte minPercent)
+    {"_d_cover_register2", LINKc, rtVoid,
+     {rtString, rtSizeArray, rtUintArray, rtUbyte}},
+
+    ////////////////////////////////////////////////////////////////////////////
+
+    // Objective-C: the types of these functions don't really matter because
+    // they are always bitcast to correct signature before calling.
+
+    // id objc_msgSend(id self, SEL op, ...)
+    // Function called early and/or often, so lazy binding isn't worthwhile.
+    {"objc_msgSend", LINKc, rtVoidPtr, {rtVoidPtr, rtVoidPtr}, {},
+     attrNonLazyBind},
+
+    // x86_64 only:
+    // creal objc_msgSend_fp2ret(id self, SEL op, ...)
+    {"objc_msgSend_fp2ret", LINKc, rtCreal, {rtVoidPtr, rtVoidPtr}},
+
+    // x86_64 real return only,  x86 float, double, real return
+    // real objc_msgSend_fpret(id self, SEL op, ...)
+    {"objc_msgSend_fpret", LINKc, rtReal, {rtVoidPtr, rtVoidPtr}},
+
+    // used when return value is aggregate via a hidden sret arg
+    // void objc_msgSend_stret(T *sret_arg, id self, SEL op, ...)
+    {"objc_msgSend_stret", LINKc, rtVoid, {rtVoidPtr, rtVoidPtr}},
+
+    ////////////////////////////////////////////////////////////////////////////
+    ////// DMD-style tracing calls
+
+    // extern(C) void trace_pro(char[] id)
+    {"trace_pro", LINKc, rtVoid, {rtString}},
+
+    // extern(C) void _c_trace_epi()
+    {"_c_trace_epi", LINKc, rtVoid, {}},
+
+    ////////////////////////////////////////////////////////////////////////////
+    ////// C standard library functions (a druntime link dependency)
+
+    // int memcmp(const void *s1, const void *s2, size_t n);
+    {"memcmp", LINKc, rtInt, {rtVoidPtr, rtVoidPtr, rtSize}, {},
+     attrReadOnly_NoUnwind_1_2_NoCapture},
 };
 
-// Use a pointer in order to share one declarer (declaring multiple functions
-// of the same type under different names) for multiple function names.
-llvm::StringMap<LazyFunctionDeclarer *> lazyFunctionDeclarers;
-
-// Registers a runtime function forward declaration. The actual declaration of
-// the function (and involved types) is deferred to the first
-// getRuntimeFunction() call.
-void createFwdDecl(LINK linkage, PotentiallyLazyType returnType,
-                   std::vector<llvm::StringRef> mangledFunctionNames,
-                   std::vector<PotentiallyLazyType> paramTypes,
-                   std::vector<StorageClass> paramsSTC = {},
-                   AttrSet attributes = {}) {
-  const auto ptr = new LazyFunctionDeclarer{linkage,
-                                            returnType,
-                                            mangledFunctionNames,
-                                            std::move(paramTypes),
-                                            std::move(paramsSTC),
-                                            attributes};
-
-  for (auto name : mangledFunctionNames)
-    lazyFunctionDeclarers[name] = ptr;
+bool isForCurrentTarget(RTTarget target) {
+  const auto &triple = *global.params.targetTriple;
+  switch (target) {
+  case targetAny:
+    return true;
+  case targetAndroid:
+    return triple.getEnvironment() == llvm::Triple::Android;
+  case targetMSVCEnvironment:
+    return triple.isWindowsMSVCEnvironment();
+  case targetARM:
+    return triple.getArch() == llvm::Triple::arm;
+  case targetMSVCEH:
+    return useMSVCEH();
+  }
+  llvm_unreachable("Unknown runtime function target");
+}
+
+const RuntimeFunction *findRuntimeFunction(llvm::StringRef name) {
+  for (const auto &rf : runtimeFunctions) {
+    if (!isForCurrentTarget(rf.target))
+      continue;
+    if (rf.linkage == LINKd ? getIRMangledFuncName(rf.name, LINKd) == name
+                            : name == rf.name) {
+      return &rf;
+    }
+  }
+  return nullptr;
 }
 
 } // anonymous namespace
 
 ////////////////////////////////////////////////////////////////////////////////
 
-llvm::Function *getRuntimeFunction(const Loc &loc, llvm::Module &target,
-                                   const char *name) {
-  checkForImplicitGCCall(loc, name);
+// extern (D) alias dg_t = int delegate(void*);
+static Type *rt_dg1() {
+  static Type *dg_t = nullptr;
+  if (dg_t)
+    return dg_t;
 
-  if (!M)
-    initRuntime();
+  auto params = new Parameters();
+  params->push(Parameter::create(0, Type::tvoidptr, nullptr, nullptr, nullptr));
+  auto fty = TypeFunction::create(params, Type::tint32, 0, LINKd);
+  dg_t = createTypeDelegate(fty);
+  return dg_t;
+}
 
-  LLFunction *fn = M->getFunction(name);
-  if (!fn) {
-    const auto it = lazyFunctionDeclarers.find(name);
-    if (it == lazyFunctionDeclarers.end()) {
-      error(loc, "Runtime function `%s` was not found", name);
-      fatal();
+// extern (D) alias dg2_t = int delegate(void*, void*);
+static Type *rt_dg2() {
+  static Type *dg2_t = nullptr;
+  if (dg2_t)
+    return dg2_t;
+
+  auto params = new Parameters();
+  params->push(Parameter::create(0, Type::tvoidptr, nullptr, nullptr, nullptr));
+  params->push(Parameter::create(0, Type::tvoidptr, nullptr, nullptr, nullptr));
+  auto fty = TypeFunction::create(params, Type::tint32, 0, LINKd);
+  dg2_t = createTypeDelegate(fty);
+  return dg2_t;
+}
+
+
+static Type *getRuntimeType(const Loc &loc, RTType type) {
+  switch (type) {
+  case rtNone:
+    break;
+  case rtVoid:
+    return Type::tvoid;
+  case rtBool:
+    return Type::tbool;
+  case rtUbyte:
+    return Type::tuns8;
+  case rtInt:
+    return Type::tint32;
+  case rtUint:
+    return Type::tuns32;
+  case rtUlong:
+    return Type::tuns64;
+  case rtSize:
+    return Type::tsize_t;
+  case rtDchar:
+    return Type::tdchar;
+  case rtReal:
+    return Type::tfloat80;
+  case rtCreal:
+    return Type::tcomplex80;
+  case rtVoidPtr:
+  case rtAA:
+    return Type::tvoidptr;
+  case rtVoidPtrPtr:
+  case rtAAPtr:
+    return Type::tvoidptr->pointerTo();
+  case rtVoidArray:
+    return Type::tvoid->arrayOf();
+  case rtVoidArrayPtr:
+    return Type::tvoid->arrayOf()->pointerTo();
+  case rtVoidArrayArray:
+    return Type::tvoid->arrayOf()->arrayOf();
+  case rtSizePtr:
+    return Type::tsize_t->pointerTo();
+  case rtSizeArray:
+    return Type::tsize_t->arrayOf();
+  case rtUintArray:
+    return Type::tuns32->arrayOf();
+  case rtString:
+    return Type::tchar->arrayOf();
+  case rtWstring:
+    return Type::twchar->arrayOf();
+  case rtDstring:
+    return Type::tdchar->arrayOf();
+  case rtDg1:
+    return rt_dg1();
+  case rtDg2:
+    return rt_dg2();
+  case rtObject:
+    return objectTy.get(loc);
+  case rtObjectPtr:
+    return objectTy.get(loc)->pointerTo();
+  case rtTypeInfo:
+    return typeInfoTy.get(loc);
+  case rtClassInfo:
+    return classInfoTy.get(loc);
+  case rtStructTypeInfo:
+    return structTypeInfoTy.get(loc);
+  case rtAATypeInfo:
+    return aaTypeInfoTy.get(loc);
+  case rtThrowable:
+    return throwableTy.get(loc);
+  case rtModuleInfoPtr:
+    return moduleInfoTy.get(loc)->pointerTo();
+  }
+  llvm_unreachable("Invalid runtime function type");
+}
+
+static AttrSet getRuntimeAttributes(RTAttrs attrs) {
+  const unsigned fnIndex = LLAttributeSet::FunctionIndex;
+  const unsigned retIndex = LLAttributeSet::ReturnIndex;
+  const unsigned arg1 = AttrSet::FirstArgIndex;
+  const AttrSet none;
+
+  switch (attrs) {
+  case attrNone:
+    return none;
+  case attrNoAlias:
+    return {none, retIndex, LLAttribute::NoAlias};
+  case attrNoUnwind:
+    return {none, fnIndex, LLAttribute::NoUnwind};
+  case attrReadOnly:
+    return {none, fnIndex, LLAttribute::ReadOnly};
+  case attrReadOnly_NoUnwind:
+    return {getRuntimeAttributes(attrReadOnly), fnIndex, LLAttribute::NoUnwind};
+  case attrReadNone:
+    return {none, fnIndex, LLAttribute::ReadNone};
+  case attrCold_NoReturn:
+    return {AttrSet(none, fnIndex, LLAttribute::Cold), fnIndex,
+            LLAttribute::NoReturn};
+  case attrCold_NoReturn_NoUnwind:
+    return {getRuntimeAttributes(attrCold_NoReturn), fnIndex,
+            LLAttribute::NoUnwind};
+  case attrReadOnly_1_3_NoCapture:
+    return {AttrSet(getRuntimeAttributes(attrReadOnly), arg1,
+                    LLAttribute::NoCapture),
+            arg1 + 2, LLAttribute::NoCapture};
+  case attrReadOnly_NoUnwind_1_2_NoCapture:
+    return {AttrSet(getRuntimeAttributes(attrReadOnly_NoUnwind), arg1,
+                    LLAttribute::NoCapture),
+            arg1 + 1, LLAttribute::NoCapture};
+  case attr1_2_NoCapture:
+    return {AttrSet(none, arg1, LLAttribute::NoCapture), arg1 + 1,
+            LLAttribute::NoCapture};
+  case attr1_3_NoCapture:
+    return {AttrSet(none, arg1, LLAttribute::NoCapture), arg1 + 2,
+            LLAttribute::NoCapture};
+  case attr1_4_NoCapture:
+    return {AttrSet(none, arg1, LLAttribute::NoCapture), arg1 + 3,
+            LLAttribute::NoCapture};
+  case attrNonLazyBind:
+    return {none, fnIndex, LLAttribute::NonLazyBind};
+  }
+  llvm_unreachable("Invalid runtime function attributes");
+}
+
+// Returns the signature of the named runtime function, building it from the
+// table on first use.
+static const RuntimeSignature &getRuntimeSignature(const Loc &loc,
+                                                   llvm::StringRef name) {
+  auto it = runtimeSignatures.find(name);
+  if (it != runtimeSignatures.end())
+    return it->second;
+
+  const RuntimeFunction *rf = findRuntimeFunction(name);
+  if (!rf) {
+    error(loc, "Runtime function `%s` was not found", name.str().c_str());
+    fatal();
+  }
+
+  IF_LOG Logger::println("Declaring runtime function: %s", rf->name);
+  LOG_SCOPE;
+
+  Parameters *params = nullptr;
+  if (rf->paramTypes[0] != rtNone) {
+    params = new Parameters();
+    for (unsigned i = 0;
+         i < maxRuntimeFunctionParams && rf->paramTypes[i] != rtNone; ++i) {
+      Type *paramTy = getRuntimeType(loc, rf->paramTypes[i]);
+      params->push(Parameter::create(rf->paramsSTC[i], paramTy, nullptr,
+                                     nullptr, nullptr));
     }
-    // declare it in the M runtime module
-    it->second->declare(loc);
-    fn = M->getFunction(name);
-    assert(fn);
   }
-  LLFunctionType *fnty = fn->getFunctionType();
+  Type *returnTy = getRuntimeType(loc, rf->returnType);
+  auto dty = TypeFunction::create(params, returnTy, 0, rf->linkage);
+
+  // the call to DtoType performs many actions such as rewriting the function
+  // type and storing it in dty
+  auto llfunctype = llvm::cast<llvm::FunctionType>(DtoType(dty));
+  assert(dty->ctype);
+  auto attrs =
+      dty->ctype->getIrFuncTy().getParamAttrs(gABI->passThisBeforeSret(dty));
+  attrs.merge(getRuntimeAttributes(rf->attributes));
+
+  RuntimeSignature sig = {llfunctype, attrs,
+                          gABI->callingConv(rf->linkage, dty)};
+  return runtimeSignatures.insert({name, sig}).first->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+llvm::Function *getRuntimeFunction(const Loc &loc, llvm::Module &target,
+                                   const char *name) {
+  checkForImplicitGCCall(loc, name);
+  gcallocreport::noteRuntimeFunction(loc, name);
+
+  const RuntimeSignature &sig = getRuntimeSignature(loc, name);
 
   if (LLFunction *existing = target.getFunction(name)) {
-    if (existing->getFunctionType() != fnty) {
+    if (existing->getFunctionType() != sig.type) {
       error(Loc(), "Incompatible declaration of runtime function `%s`", name);
       fatal();
     }
@@ -343,9 +856,17 @@ llvm::Function *getRuntimeFunction(const Loc &loc, llvm::Module &target,
   }
 
   LLFunction *resfn =
-      llvm::cast<llvm::Function>(target.getOrInsertFunction(name, fnty));
-  resfn->setAttributes(fn->getAttributes());
-  resfn->setCallingConv(fn->getCallingConv());
+      llvm::cast<llvm::Function>(target.getOrInsertFunction(name, sig.type));
+  resfn->setAttributes(sig.attributes);
+
+  // On x86_64, always set 'uwtable' for System V ABI compatibility.
+  // FIXME: Move to better place (abi-x86-64.cpp?)
+  // NOTE: There are several occurances if this line.
+  if (global.params.targetTriple->getArch() == llvm::Triple::x86_64) {
+    resfn->addFnAttr(LLAttribute::UWTable);
+  }
+
+  resfn->setCallingConv(sig.callingConv);
   return resfn;
 }
 
@@ -375,20 +896,6 @@ static const char *getCAssertFunctionName() {
   return "__assert";
 }
 
-static std::vector<PotentiallyLazyType> getCAssertFunctionParamTypes() {
-  const auto voidPtr = Type::tvoidptr;
-  const auto uint = Type::tuns32;
-
-  if (global.params.targetTriple->isOSDarwin() ||
-      global.params.targetTriple->isOSSolaris() || isMusl()) {
-    return {voidPtr, voidPtr, uint, voidPtr};
-  }
-  if (global.params.targetTriple->getEnvironment() == llvm::Triple::Android) {
-    return {voidPtr, uint, voidPtr};
-  }
-  return {voidPtr, voidPtr, uint};
-}
-
 llvm::Function *getCAssertFunction(const Loc &loc, llvm::Module &target) {
   return getRuntimeFunction(loc, target, getCAssertFunctionName());
 }
@@ -437,472 +944,6 @@ Type *getModuleInfoType() { return moduleInfoTy.get(); }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-// extern (D) alias dg_t = int delegate(void*);
-static Type *rt_dg1() {
-  static Type *dg_t = nullptr;
-  if (dg_t)
-    return dg_t;
-
-  auto params = new Parameters();
-  params->push(Parameter::create(0, Type::tvoidptr, nullptr, nullptr, nullptr));
-  auto fty = TypeFunction::create(params, Type::tint32, 0, LINKd);
-  dg_t = createTypeDelegate(fty);
-  return dg_t;
-}
-
-// extern (D) alias dg2_t = int delegate(void*, void*);
-static Type *rt_dg2() {
-  static Type *dg2_t = nullptr;
-  if (dg2_t)
-    return dg2_t;
-
-  auto params = new Parameters();
-  params->push(Parameter::create(0, Type::tvoidptr, nullptr, nullptr, nullptr));
-  params->push(Parameter::create(0, Type::tvoidptr, nullptr, nullptr, nullptr));
-  auto fty = TypeFunction::create(params, Type::tint32, 0, LINKd);
-  dg2_t = createTypeDelegate(fty);
-  return dg2_t;
-}
-
-static void buildRuntimeModule() {
-  Logger::println("building runtime module");
-  M = new llvm::Module("ldc internal runtime", gIR->context());
-
-  Type *voidTy = Type::tvoid;
-  Type *boolTy = Type::tbool;
-  Type *ubyteTy = Type::tuns8;
-  Type *intTy = Type::tint32;
-  Type *uintTy = Type::tuns32;
-  Type *ulongTy = Type::tuns64;
-  Type *sizeTy = Type::tsize_t;
-  Type *dcharTy = Type::tdchar;
-
-  Type *voidPtrTy = Type::tvoidptr;
-  Type *voidArrayTy = Type::tvoid->arrayOf();
-  Type *voidArrayPtrTy = voidArrayTy->pointerTo();
-  Type *stringTy = Type::tchar->arrayOf();
-  Type *wstringTy = Type::twchar->arrayOf();
-  Type *dstringTy = Type::tdchar->arrayOf();
-
-  // The AA type is a struct that only contains a ptr
-  Type *aaTy = voidPtrTy;
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // Construct some attribute lists used below (possibly multiple times)
-  AttrSet NoAttrs,
-      Attr_NoAlias(NoAttrs, LLAttributeSet::ReturnIndex,
-                   llvm::Attribute::NoAlias),
-      Attr_NoUnwind(NoAttrs, LLAttributeSet::FunctionIndex,
-                    llvm::Attribute::NoUnwind),
-      Attr_ReadOnly(NoAttrs, LLAttributeSet::FunctionIndex,
-                    llvm::Attribute::ReadOnly),
-      Attr_Cold(NoAttrs, LLAttributeSet::FunctionIndex, llvm::Attribute::Cold),
-      Attr_Cold_NoReturn(Attr_Cold, LLAttributeSet::FunctionIndex,
-                         llvm::Attribute::NoReturn),
-      Attr_Cold_NoReturn_NoUnwind(Attr_Cold_NoReturn,
-                                  LLAttributeSet::FunctionIndex,
-                                  llvm::Attribute::NoUnwind),
-      Attr_ReadOnly_NoUnwind(Attr_ReadOnly, LLAttributeSet::FunctionIndex,
-                             llvm::Attribute::NoUnwind),
-      Attr_ReadOnly_1_NoCapture(Attr_ReadOnly, AttrSet::FirstArgIndex,
-                                llvm::Attribute::NoCapture),
-      Attr_ReadOnly_1_3_NoCapture(Attr_ReadOnly_1_NoCapture,
-                                  AttrSet::FirstArgIndex + 2,
-                                  llvm::Attribute::NoCapture),
-      Attr_ReadOnly_NoUnwind_1_NoCapture(Attr_ReadOnly_1_NoCapture,
-                                         LLAttributeSet::FunctionIndex,
-                                         llvm::Attribute::NoUnwind),
-      Attr_ReadOnly_NoUnwind_1_2_NoCapture(Attr_ReadOnly_NoUnwind_1_NoCapture,
-                                           AttrSet::FirstArgIndex + 1,
-                                           llvm::Attribute::NoCapture),
-      Attr_ReadNone(NoAttrs, LLAttributeSet::FunctionIndex,
-                    llvm::Attribute::ReadNone),
-      Attr_1_NoCapture(NoAttrs, AttrSet::FirstArgIndex,
-                       llvm::Attribute::NoCapture),
-      Attr_1_2_NoCapture(Attr_1_NoCapture, AttrSet::FirstArgIndex + 1,
-                         llvm::Attribute::NoCapture),
-      Attr_1_3_NoCapture(Attr_1_NoCapture, AttrSet::FirstArgIndex + 2,
-                         llvm::Attribute::NoCapture),
-      Attr_1_4_NoCapture(Attr_1_NoCapture, AttrSet::FirstArgIndex + 3,
-                         llvm::Attribute::NoCapture),
-      Attr_NoAlias_1_NoCapture(Attr_1_NoCapture, LLAttributeSet::ReturnIndex,
-                               llvm::Attribute::NoAlias);
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // void __cyg_profile_func_enter(void *callee, void *caller)
-  // void __cyg_profile_func_exit(void *callee, void *caller)
-  createFwdDecl(LINKc, voidTy,
-                {"__cyg_profile_func_exit", "__cyg_profile_func_enter"},
-                {voidPtrTy, voidPtrTy}, {}, Attr_NoUnwind);
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // C assert function
-  createFwdDecl(LINKc, Type::tvoid, {getCAssertFunctionName()},
-                getCAssertFunctionParamTypes(), {},
-                Attr_Cold_NoReturn_NoUnwind);
-
-  // void _d_assert(string file, uint line)
-  // void _d_arraybounds(string file, uint line)
-  createFwdDecl(LINKc, Type::tvoid, {"_d_assert", "_d_arraybounds"},
-                {stringTy, uintTy}, {}, Attr_Cold_NoReturn);
-
-  // void _d_assert_msg(string msg, string file, uint line)
-  createFwdDecl(LINKc, voidTy, {"_d_assert_msg"}, {stringTy, stringTy, uintTy},
-                {}, Attr_Cold_NoReturn);
-
-  // void _d_switch_error(immutable(ModuleInfo)* m, uint line)
-  createFwdDecl(LINKc, voidTy, {"_d_switch_error"}, {moduleInfoPtrTy, uintTy},
-                {STCimmutable, 0}, Attr_Cold_NoReturn);
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // void* _d_allocmemory(size_t sz)
-  createFwdDecl(LINKc, voidPtrTy, {"_d_allocmemory"}, {sizeTy}, {},
-                Attr_NoAlias);
-
-  // void* _d_allocmemoryT(TypeInfo ti)
-  createFwdDecl(LINKc, voidPtrTy, {"_d_allocmemoryT"}, {typeInfoTy}, {},
-                Attr_NoAlias);
-
-  // void[] _d_newarrayT (const TypeInfo ti, size_t length)
-  // void[] _d_newarrayiT(const TypeInfo ti, size_t length)
-  // void[] _d_newarrayU (const TypeInfo ti, size_t length)
-  createFwdDecl(LINKc, voidArrayTy,
-                {"_d_newarrayT", "_d_newarrayiT", "_d_newarrayU"},
-                {typeInfoTy, sizeTy}, {STCconst, 0});
-
-  // void[] _d_newarraymTX (const TypeInfo ti, size_t[] dims)
-  // void[] _d_newarraymiTX(const TypeInfo ti, size_t[] dims)
-  createFwdDecl(LINKc, voidArrayTy, {"_d_newarraymTX", "_d_newarraymiTX"},
-                {typeInfoTy, sizeTy->arrayOf()}, {STCconst, 0});
-
-  // void[] _d_arraysetlengthT (const TypeInfo ti, size_t newlength, void[]* p)
-  // void[] _d_arraysetlengthiT(const TypeInfo ti, size_t newlength, void[]* p)
-  createFwdDecl(LINKc, voidArrayTy,
-                {"_d_arraysetlengthT", "_d_arraysetlengthiT"},
-                {typeInfoTy, sizeTy, voidArrayPtrTy}, {STCconst, 0, 0});
-
-  // byte[] _d_arrayappendcTX(const TypeInfo ti, ref byte[] px, size_t n)
-  createFwdDecl(LINKc, voidArrayTy, {"_d_arrayappendcTX"},
-                {typeInfoTy, voidArrayTy, sizeTy}, {STCconst, STCref, 0});
-
-  // void[] _d_arrayappendT(const TypeInfo ti, ref byte[] x, byte[] y)
-  createFwdDecl(LINKc, voidArrayTy, {"_d_arrayappendT"},
-                {typeInfoTy, voidArrayTy, voidArrayTy}, {STCconst, STCref, 0});
-
-  // void[] _d_arrayappendcd(ref byte[] x, dchar c)
-  // void[] _d_arrayappendwd(ref byte[] x, dchar c)
-  createFwdDecl(LINKc, voidArrayTy, {"_d_arrayappendcd", "_d_arrayappendwd"},
-                {voidArrayTy, dcharTy}, {STCref, 0});
-
-  // byte[] _d_arraycatT(const TypeInfo ti, byte[] x, byte[] y)
-  createFwdDecl(LINKc, voidArrayTy, {"_d_arraycatT"},
-                {typeInfoTy, voidArrayTy, voidArrayTy}, {STCconst, 0, 0});
-
-  // void[] _d_arraycatnTX(const TypeInfo ti, byte[][] arrs)
-  createFwdDecl(LINKc, voidArrayTy, {"_d_arraycatnTX"},
-                {typeInfoTy, voidArrayTy->arrayOf()}, {STCconst, 0});
-
-  // Object _d_newclass(const ClassInfo ci)
-  // Object _d_allocclass(const ClassInfo ci)
-  createFwdDecl(LINKc, objectTy, {"_d_newclass", "_d_allocclass"},
-                {classInfoTy}, {STCconst}, Attr_NoAlias);
-
-  // void* _d_newitemT (TypeInfo ti)
-  // void* _d_newitemiT(TypeInfo ti)
-  createFwdDecl(LINKc, voidPtrTy, {"_d_newitemT", "_d_newitemiT"}, {typeInfoTy},
-                {0}, Attr_NoAlias);
-
-  // void _d_delarray_t(void[]* p, const TypeInfo_Struct ti)
-  createFwdDecl(LINKc, voidTy, {"_d_delarray_t"},
-                {voidArrayPtrTy, structTypeInfoTy}, {0, STCconst});
-
-  // void _d_delmemory(void** p)
-  // void _d_delinterface(void** p)
-  createFwdDecl(LINKc, voidTy, {"_d_delmemory", "_d_delinterface"},
-                {voidPtrTy->pointerTo()});
-
-  // void _d_callfinalizer(void* p)
-  createFwdDecl(LINKc, voidTy, {"_d_callfinalizer"}, {voidPtrTy});
-
-  // D2: void _d_delclass(Object* p)
-  createFwdDecl(LINKc, voidTy, {"_d_delclass"}, {objectPtrTy});
-
-  // void _d_delstruct(void** p, TypeInfo_Struct inf)
-  createFwdDecl(LINKc, voidTy, {"_d_delstruct"},
-                {voidPtrTy->pointerTo(), structTypeInfoTy});
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // array slice copy when assertions are on!
-  // void _d_array_slice_copy(void* dst, size_t dstlen, void* src, size_t
-  // srclen)
-  createFwdDecl(LINKc, voidTy, {"_d_array_slice_copy"},
-                {voidPtrTy, sizeTy, voidPtrTy, sizeTy}, {}, Attr_1_3_NoCapture);
-
-////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////
-
-// int _aApplycd1(in char[] aa, dg_t dg)
-// int _aApplyRcd1(in char[] aa, dg_t dg)
-#define STR_APPLY1(TY, a, b)                                                   \
-  {                                                                            \
-    const char *fname1 = "_aApply" #a "1", *fname2 = "_aApply" #b "1",         \
-               *fname3 = "_aApplyR" #a "1", *fname4 = "_aApplyR" #b "1";       \
-    createFwdDecl(LINKc, sizeTy, {fname1, fname2, fname3, fname4},             \
-                  {TY, rt_dg1()});                                             \
-  }
-  STR_APPLY1(stringTy, cw, cd)
-  STR_APPLY1(wstringTy, wc, wd)
-  STR_APPLY1(dstringTy, dc, dw)
-#undef STR_APPLY1
-
-// int _aApplycd2(in char[] aa, dg2_t dg)
-// int _aApplyRcd2(in char[] aa, dg2_t dg)
-#define STR_APPLY2(TY, a, b)                                                   \
-  {                                                                            \
-    const char *fname1 = "_aApply" #a "2", *fname2 = "_aApply" #b "2",         \
-               *fname3 = "_aApplyR" #a "2", *fname4 = "_aApplyR" #b "2";       \
-    createFwdDecl(LINKc, sizeTy, {fname1, fname2, fname3, fname4},             \
-                  {TY, rt_dg2()});                                             \
-  }
-  STR_APPLY2(stringTy, cw, cd)
-  STR_APPLY2(wstringTy, wc, wd)
-  STR_APPLY2(dstringTy, dc, dw)
-#undef STR_APPLY2
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // fixes the length for dynamic array casts
-  // size_t _d_array_cast_len(size_t len, size_t elemsz, size_t newelemsz)
-  createFwdDecl(LINKc, sizeTy, {"_d_array_cast_len"}, {sizeTy, sizeTy, sizeTy},
-                {}, Attr_ReadNone);
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // void[] _d_arrayassign_l(TypeInfo ti, void[] src, void[] dst, void* ptmp)
-  // void[] _d_arrayassign_r(TypeInfo ti, void[] src, void[] dst, void* ptmp)
-  createFwdDecl(LINKc, voidArrayTy, {"_d_arrayassign_l", "_d_arrayassign_r"},
-                {typeInfoTy, voidArrayTy, voidArrayTy, voidPtrTy});
-
-  // void[] _d_arrayctor(TypeInfo ti, void[] from, void[] to)
-  createFwdDecl(LINKc, voidArrayTy, {"_d_arrayctor"},
-                {typeInfoTy, voidArrayTy, voidArrayTy});
-
-  // void* _d_arraysetassign(void* p, void* value, int count, TypeInfo ti)
-  // void* _d_arraysetctor(void* p, void* value, int count, TypeInfo ti)
-  createFwdDecl(LINKc, voidPtrTy, {"_d_arraysetassign", "_d_arraysetctor"},
-                {voidPtrTy, voidPtrTy, intTy, typeInfoTy}, {}, Attr_NoAlias);
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // cast interface
-  // void* _d_interface_cast(void* p, ClassInfo c)
-  createFwdDecl(LINKc, voidPtrTy, {"_d_interface_cast"},
-                {voidPtrTy, classInfoTy}, {}, Attr_ReadOnly_NoUnwind);
-
-  // dynamic cast
-  // void* _d_dynamic_cast(Object o, ClassInfo c)
-  createFwdDecl(LINKc, voidPtrTy, {"_d_dynamic_cast"}, {objectTy, classInfoTy},
-                {}, Attr_ReadOnly_NoUnwind);
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // int _adEq2(void[] a1, void[] a2, TypeInfo ti)
-  createFwdDecl(LINKc, intTy, {"_adEq2"},
-                {voidArrayTy, voidArrayTy, typeInfoTy}, {}, Attr_ReadOnly);
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // void* _aaGetY(AA* aa, const TypeInfo aati, in size_t valuesize,
-  //               in void* pkey)
-  createFwdDecl(LINKc, voidPtrTy, {"_aaGetY"},
-                {aaTy->pointerTo(), aaTypeInfoTy, sizeTy, voidPtrTy},
-                {0, STCconst, STCin, STCin}, Attr_1_4_NoCapture);
-
-  // inout(void)* _aaInX(inout AA aa, in TypeInfo keyti, in void* pkey)
-  // FIXME: "inout" storageclass is not applied to return type
-  createFwdDecl(LINKc, voidPtrTy, {"_aaInX"}, {aaTy, typeInfoTy, voidPtrTy},
-                {STCin | STCout, STCin, STCin}, Attr_ReadOnly_1_3_NoCapture);
-
-  // bool _aaDelX(AA aa, in TypeInfo keyti, in void* pkey)
-  createFwdDecl(LINKc, boolTy, {"_aaDelX"}, {aaTy, typeInfoTy, voidPtrTy},
-                {0, STCin, STCin}, Attr_1_3_NoCapture);
-
-  // int _aaEqual(in TypeInfo tiRaw, in AA e1, in AA e2)
-  createFwdDecl(LINKc, intTy, {"_aaEqual"}, {typeInfoTy, aaTy, aaTy},
-                {STCin, STCin, STCin}, Attr_1_2_NoCapture);
-
-  // AA _d_assocarrayliteralTX(const TypeInfo_AssociativeArray ti,
-  //                           void[] keys, void[] values)
-  createFwdDecl(LINKc, aaTy, {"_d_assocarrayliteralTX"},
-                {aaTypeInfoTy, voidArrayTy, voidArrayTy}, {STCconst, 0, 0});
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // void _d_throw_exception(Throwable o)
-  createFwdDecl(LINKc, voidTy, {"_d_throw_exception"}, {throwableTy}, {},
-                Attr_Cold_NoReturn);
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // int _d_eh_personality(...)
-  {
-    if (global.params.targetTriple->isWindowsMSVCEnvironment()) {
-      const char *fname =
-          useMSVCEH() ? "__CxxFrameHandler3" : "_d_eh_personality";
-      // (ptr ExceptionRecord, ptr EstablisherFrame, ptr ContextRecord,
-      //  ptr DispatcherContext)
-      createFwdDecl(LINKc, intTy, {fname},
-                    {voidPtrTy, voidPtrTy, voidPtrTy, voidPtrTy});
-    } else if (global.params.targetTriple->getArch() == llvm::Triple::arm) {
-      // (int state, ptr ucb, ptr context)
-      createFwdDecl(LINKc, intTy, {"_d_eh_personality"},
-                    {intTy, voidPtrTy, voidPtrTy});
-    } else {
-      // (int ver, int actions, ulong eh_class, ptr eh_info, ptr context)
-      createFwdDecl(LINKc, intTy, {"_d_eh_personality"},
-                    {intTy, intTy, ulongTy, voidPtrTy, voidPtrTy});
-    }
-  }
-
-  if (useMSVCEH()) {
-    // _d_enter_cleanup(ptr frame)
-    createFwdDecl(LINKc, boolTy, {"_d_enter_cleanup"}, {voidPtrTy});
-
-    // _d_leave_cleanup(ptr frame)
-    createFwdDecl(LINKc, voidTy, {"_d_leave_cleanup"}, {voidPtrTy});
-
-    // Throwable _d_eh_enter_catch(ptr exception, ClassInfo catchType)
-    createFwdDecl(LINKc, throwableTy, {"_d_eh_enter_catch"},
-                  {voidPtrTy, classInfoTy}, {});
-  } else {
-    // void _Unwind_Resume(ptr)
-    createFwdDecl(LINKc, voidTy, {getUnwindResumeFunctionName()}, {voidPtrTy},
-                  {}, Attr_Cold_NoReturn);
-
-    // Throwable _d_eh_enter_catch(ptr)
-    createFwdDecl(LINKc, throwableTy, {"_d_eh_enter_catch"}, {voidPtrTy}, {},
-                  Attr_NoUnwind);
-
-    // void* __cxa_begin_catch(ptr)
-    createFwdDecl(LINKc, voidPtrTy, {"__cxa_begin_catch"}, {voidPtrTy}, {},
-                  Attr_NoUnwind);
-  }
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // void invariant._d_invariant(Object o)
-  {
-    static const std::string mangle =
-        getIRMangledFuncName("_D9invariant12_d_invariantFC6ObjectZv", LINKd);
-    createFwdDecl(LINKd, voidTy, {mangle}, {objectTy});
-  }
-
-  // void _d_dso_registry(void* data)
-  // (the argument is really a pointer to
-  // rt.sections_elf_shared.CompilerDSOData)
-  createFwdDecl(LINKc, voidTy, {"_d_dso_registry"}, {voidPtrTy});
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-
-  // extern (C) void _d_cover_register2(string filename, size_t[] valid,
-  //                                    uint[] data, ubyte minPercent)
-  if (global.params.cov) {
-    createFwdDecl(LINKc, voidTy, {"_d_cover_register2"},
-                  {stringTy, sizeTy->arrayOf(), uintTy->arrayOf(), ubyteTy});
-  }
-
-  if (global.params.hasObjectiveC) {
-    assert(global.params.targetTriple->isOSDarwin());
-
-    // The types of these functions don't really matter because they are always
-    // bitcast to correct signature before calling.
-    Type *objectPtrTy = voidPtrTy;
-    Type *selectorPtrTy = voidPtrTy;
-    Type *realTy = Type::tfloat80;
-
-    // id objc_msgSend(id self, SEL op, ...)
-    // Function called early and/or often, so lazy binding isn't worthwhile.
-    createFwdDecl(LINKc, objectPtrTy, {"objc_msgSend"},
-                  {objectPtrTy, selectorPtrTy}, {},
-                  AttrSet(NoAttrs, ~0U, llvm::Attribute::NonLazyBind));
-
-    switch (global.params.targetTriple->getArch()) {
-    case llvm::Triple::x86_64:
-      // creal objc_msgSend_fp2ret(id self, SEL op, ...)
-      createFwdDecl(LINKc, Type::tcomplex80, {"objc_msgSend_fp2ret"},
-                    {objectPtrTy, selectorPtrTy});
-    // fall-thru
-    case llvm::Triple::x86:
-      // x86_64 real return only,  x86 float, double, real return
-      // real objc_msgSend_fpret(id self, SEL op, ...)
-      createFwdDecl(LINKc, realTy, {"objc_msgSend_fpret"},
-                    {objectPtrTy, selectorPtrTy});
-    // fall-thru
-    case llvm::Triple::arm:
-    case llvm::Triple::thumb:
-      // used when return value is aggregate via a hidden sret arg
-      // void objc_msgSend_stret(T *sret_arg, id self, SEL op, ...)
-      createFwdDecl(LINKc, voidTy, {"objc_msgSend_stret"},
-                    {objectPtrTy, selectorPtrTy});
-      break;
-    default:
-      break;
-    }
-  }
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  ////// DMD-style tracing calls
-
-  // extern(C) void trace_pro(char[] id)
-  createFwdDecl(LINKc, voidTy, {"trace_pro"}, {stringTy});
-
-  // extern(C) void _c_trace_epi()
-  createFwdDecl(LINKc, voidTy, {"_c_trace_epi"}, {});
-
-  //////////////////////////////////////////////////////////////////////////////
-  //////////////////////////////////////////////////////////////////////////////
-  ////// C standard library functions (a druntime link dependency)
-
-  // int memcmp(const void *s1, const void *s2, size_t n);
-  createFwdDecl(LINKc, intTy, {"memcmp"}, {voidPtrTy, voidPtrTy, sizeTy}, {},
-                Attr_ReadOnly_NoUnwind_1_2_NoCapture);
-}
-
 static void emitInstrumentationFn(const char *name) {
   LLFunction *fn = getRuntimeFunction(Loc(), gIR->module, name);
 
@@ -923,3 +964,38 @@ void emitInstrumentationFnLeave(FuncDeclaration *decl) {
   if (opts::instrumentFunctions && decl->emitInstrumentation)
     emitInstrumentationFn("__cyg_profile_func_exit");
 }
+
+void pruneInstrumentationFnCalls(FuncDeclaration *decl, llvm::Function *func) {
+  if (!opts::instrumentFunctions || !decl->emitInstrumentation ||
+      opts::instrumentFunctionsThreshold == 0)
+    return;
+
+  llvm::SmallVector<llvm::CallInst *, 8> hooks;
+  size_t size = 0;
+  for (auto &bb : *func) {
+    for (auto &inst : bb) {
+      auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+      auto callee = call ? call->getCalledFunction() : nullptr;
+      if (callee && (callee->getName() == "__cyg_profile_func_enter" ||
+                     callee->getName() == "__cyg_profile_func_exit")) {
+        hooks.push_back(call);
+      } else {
+        ++size;
+      }
+    }
+  }
+
+  // Don't count the return address lookups for the hooks.
+  size -= hooks.size();
+  if (size >= opts::instrumentFunctionsThreshold)
+    return;
+
+  IF_LOG Logger::println("Removing instrumentation of small function: %s",
+                         decl->toPrettyChars());
+  for (auto call : hooks) {
+    auto caller = llvm::cast<llvm::Instruction>(call->getArgOperand(1));
+    call->eraseFromParent();
+    if (caller->use_empty())
+      caller->eraseFromParent();
+  }
+}
@@ -37,6 +37,9 @@ llvm::Function *getUnwindResumeFunction(const Loc &loc, llvm::Module &target);
 
 void emitInstrumentationFnEnter(FuncDeclaration *decl);
 void emitInstrumentationFnLeave(FuncDeclaration *decl);
+/// Removes the instrumentation calls again if the function's body is smaller
+/// than -finstrument-functions-threshold.
+void pruneInstrumentationFnCalls(FuncDeclaration *decl, llvm::Function *func);
 
 Type *getObjectType();
 Type *getTypeInfoType();
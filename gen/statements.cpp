@@ -13,8 +13,11 @@
 #include "module.h"
 #include "mtype.h"
 #include "port.h"
+#include "template.h"
+#include "driver/cl_options_sanitizers.h"
 #include "gen/abi.h"
 #include "gen/arrays.h"
+#include "gen/cl_helpers.h"
 #include "gen/classes.h"
 #include "gen/coverage.h"
 #include "gen/dcompute/target.h"
@@ -24,6 +27,7 @@
 #include "gen/llvm.h"
 #include "gen/llvmhelpers.h"
 #include "gen/logger.h"
+#include "gen/pragma.h"
 #include "gen/runtime.h"
 #include "gen/tollvm.h"
 #include "id.h"
@@ -31,9 +35,13 @@
 #include "ir/irmodule.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/InlineAsm.h"
+#include "llvm/Support/CommandLine.h"
+#include <algorithm>
 #include <fstream>
 #include <math.h>
+#include <numeric>
 #include <stdio.h>
+#include <vector>
 
 // Need to include this after the other DMD includes because of missing
 // dependencies.
@@ -46,6 +54,329 @@ void CompoundAsmStatement_toIR(CompoundAsmStatement *stmt, IRState *p);
 
 //////////////////////////////////////////////////////////////////////////////
 
+static llvm::cl::opt<unsigned> stringSwitchHashThreshold(
+    "string-switch-hash", llvm::cl::ZeroOrMore, llvm::cl::init(16),
+    llvm::cl::value_desc("cases"),
+    llvm::cl::desc("Dispatch switch statements on strings with at least this "
+                   "many cases via a perfect hash instead of a binary search "
+                   "(0 = never)"));
+
+static llvm::cl::opt<unsigned> switchPeelPercentage(
+    "switch-peel-percentage", llvm::cl::ZeroOrMore, llvm::cl::Hidden,
+    llvm::cl::init(66),
+    llvm::cl::desc("With profile data, test the hottest case of a switch "
+                   "before the switch if it is taken at least this percentage "
+                   "of the time (0 = never)"));
+
+enum class SwitchErrors { Check, Unreachable };
+
+static llvm::cl::opt<SwitchErrors> switchErrors(
+    "fswitch-errors", llvm::cl::ZeroOrMore,
+    llvm::cl::desc("Code for switch defaults which mustn't be reached, i.e., "
+                   "of `final switch` statements and `default: assert(0);`"),
+    llvm::cl::init(SwitchErrors::Check),
+    clEnumValues(
+        clEnumValN(SwitchErrors::Check, "check",
+                   "Fail at runtime, as for -release/-checkaction (default)"),
+        clEnumValN(SwitchErrors::Unreachable, "unreachable",
+                   "Assume them to be unreachable (undefined behavior if "
+                   "reached)")));
+
+namespace {
+/// Determines whether a statement only consists of a switch error or an
+/// `assert(0)`.
+class SwitchErrorDetector : public Visitor {
+public:
+  bool result = false;
+
+  using Visitor::visit;
+
+  void visit(Statement *) override {}
+  void visit(SwitchErrorStatement *) override { result = true; }
+
+  void visit(ScopeStatement *stmt) override {
+    if (stmt->statement)
+      stmt->statement->accept(this);
+  }
+
+  void visit(CompoundStatement *stmt) override {
+    if (stmt->statements && stmt->statements->dim == 1 &&
+        (*stmt->statements)[0]) {
+      (*stmt->statements)[0]->accept(this);
+    }
+  }
+
+  void visit(ExpStatement *stmt) override {
+    Expression *e = stmt->exp;
+    result = e && (e->op == TOKhalt ||
+                   (e->op == TOKassert &&
+                    static_cast<AssertExp *>(e)->e1->isBool(false)));
+  }
+};
+
+bool isSwitchError(Statement *stmt) {
+  SwitchErrorDetector v;
+  if (stmt)
+    stmt->accept(&v);
+  return v.result;
+}
+
+/// A perfect hash of the labels of a string switch, combining the length and
+/// the characters at a few positions. Only defined for non-empty strings.
+class StringSwitchHash {
+  // Positions of the hashed characters, >= 0 counting from the start and < 0
+  // from the end (-1 being the last character), clamped to the string.
+  llvm::SmallVector<int, 4> positions;
+
+  static const uint64_t prime = 1099511628211ULL; // FNV-1a
+
+  static size_t charIndex(int pos, size_t length) {
+    if (pos >= 0) {
+      return static_cast<size_t>(pos) < length ? pos : length - 1;
+    }
+    const size_t fromEnd = -(pos + 1);
+    return fromEnd < length ? length - 1 - fromEnd : 0;
+  }
+
+  static size_t countDistinct(const std::vector<uint64_t> &hashes) {
+    std::vector<uint64_t> sorted = hashes;
+    std::sort(sorted.begin(), sorted.end());
+    return std::unique(sorted.begin(), sorted.end()) - sorted.begin();
+  }
+
+  std::vector<uint64_t> hashAll(const std::vector<StringExp *> &labels) const {
+    std::vector<uint64_t> hashes;
+    hashes.reserve(labels.size());
+    for (auto se : labels) {
+      hashes.push_back(hash(se));
+    }
+    return hashes;
+  }
+
+public:
+  uint64_t hash(StringExp *se) const {
+    const size_t length = se->numberOfCodeUnits();
+    uint64_t h = length;
+    for (int pos : positions) {
+      h = (h ^ se->charAt(charIndex(pos, length))) * prime;
+    }
+    return h;
+  }
+
+  /// Greedily picks up to 4 positions for a perfect hash of the (non-empty,
+  /// distinct) labels. Returns false if there is none.
+  bool build(const std::vector<StringExp *> &labels) {
+    size_t maxLength = 0;
+    for (auto se : labels) {
+      maxLength = std::max(maxLength, se->numberOfCodeUnits());
+    }
+    const int numCandidates = static_cast<int>(std::min<size_t>(maxLength, 8));
+
+    size_t distinct = countDistinct(hashAll(labels));
+    while (distinct < labels.size()) {
+      if (positions.size() == 4) {
+        return false;
+      }
+      int bestPos = 0;
+      size_t bestDistinct = distinct;
+      positions.push_back(0);
+      for (int i = 0; i < numCandidates; ++i) {
+        for (int pos : {i, -(i + 1)}) {
+          positions.back() = pos;
+          const size_t d = countDistinct(hashAll(labels));
+          if (d > bestDistinct) {
+            bestPos = pos;
+            bestDistinct = d;
+          }
+        }
+      }
+      if (bestDistinct == distinct) {
+        return false;
+      }
+      positions.back() = bestPos;
+      distinct = bestDistinct;
+    }
+    return true;
+  }
+
+  /// Emits the hash of a non-empty string.
+  LLValue *emit(IRState *irs, LLValue *ptr, LLValue *length) const {
+    LLType *i64 = LLType::getInt64Ty(irs->context());
+    LLValue *h = irs->ir->CreateZExtOrTrunc(length, i64);
+    LLValue *last = irs->ir->CreateSub(length, DtoConstSize_t(1));
+    for (int pos : positions) {
+      LLValue *index;
+      if (pos >= 0) {
+        LLValue *p = DtoConstSize_t(pos);
+        index = irs->ir->CreateSelect(irs->ir->CreateICmpULT(p, length), p,
+                                      last);
+      } else {
+        LLValue *fromEnd = DtoConstSize_t(-(pos + 1));
+        index = irs->ir->CreateSelect(irs->ir->CreateICmpULT(fromEnd, length),
+                                      irs->ir->CreateSub(last, fromEnd),
+                                      DtoConstSize_t(0));
+      }
+      LLValue *c = irs->ir->CreateZExt(DtoLoad(DtoGEP1(ptr, index)), i64);
+      h = irs->ir->CreateMul(irs->ir->CreateXor(h, c),
+                             llvm::ConstantInt::get(i64, prime));
+    }
+    return h;
+  }
+};
+}
+
+/// The frontend lowers switch statements on strings to integer switches on
+/// `object.__switch!(T, sortedLabels...)(condition)`, which returns the index
+/// of the matching label via binary search. For switches with enough cases,
+/// this emits the index computation inline instead: an integer switch over a
+/// perfect hash of the condition, selecting the only label which can match,
+/// followed by a length check and memcmp.
+/// With -fsanitize-coverage=trace-cmp, all string switches are emitted inline
+/// as a chain of length checks and memcmps instead, so that the fuzzer sees
+/// the labels compared against (the hash and druntime's binary search would
+/// hide them).
+/// Returns null if not applicable.
+static LLValue *emitStringSwitchIndex(Expression *condition, IRState *irs) {
+  const bool linear = opts::isSanitizerCoverageTraceCmpEnabled();
+  if ((stringSwitchHashThreshold == 0 && !linear) ||
+      condition->op != TOKcall) {
+    return nullptr;
+  }
+  auto ce = static_cast<CallExp *>(condition);
+  if (!ce->f || ce->f->ident != Id::__switch || !ce->arguments ||
+      ce->arguments->dim != 1 || !ce->f->parent) {
+    return nullptr;
+  }
+  TemplateInstance *ti = ce->f->parent->isTemplateInstance();
+  if (!ti || !ti->tiargs ||
+      (ti->tiargs->dim <= stringSwitchHashThreshold && !linear)) {
+    return nullptr;
+  }
+
+  Expression *arg = (*ce->arguments)[0];
+  Type *elemType = arg->type->toBasetype()->nextOf();
+  if (!elemType) {
+    return nullptr;
+  }
+  const unsigned char elemSize = elemType->size();
+
+  // The labels, in sorted order, i.e., by the index to return.
+  std::vector<StringExp *> labels;
+  std::vector<StringExp *> nonEmptyLabels;
+  int emptyIndex = -1;
+  for (size_t i = 1; i < ti->tiargs->dim; ++i) {
+    Expression *e = isExpression((*ti->tiargs)[i]);
+    if (!e || e->op != TOKstring) {
+      return nullptr;
+    }
+    auto se = static_cast<StringExp *>(e);
+    if (se->sz != elemSize) {
+      return nullptr;
+    }
+    labels.push_back(se);
+    if (se->numberOfCodeUnits() == 0) {
+      emptyIndex = static_cast<int>(i - 1);
+    } else {
+      nonEmptyLabels.push_back(se);
+    }
+  }
+
+  StringSwitchHash hash;
+  if (!linear && !hash.build(nonEmptyLabels)) {
+    IF_LOG Logger::println("No perfect hash found for string switch");
+    return nullptr;
+  }
+
+  IF_LOG Logger::println("Emitting %s for string switch",
+                         linear ? "compare chain" : "perfect hash");
+  LOG_SCOPE;
+
+  DValue *cond = toElemDtor(arg);
+  LLValue *length = DtoArrayLen(cond);
+  LLValue *ptr = DtoArrayPtr(cond);
+  LLType *indexType = DtoType(condition->type);
+
+  llvm::BasicBlock *hashbb = irs->insertBB("stringswitch.hash");
+  llvm::BasicBlock *nomatchbb =
+      irs->insertBBAfter(hashbb, "stringswitch.nomatch");
+  llvm::BasicBlock *endbb = irs->insertBBAfter(nomatchbb, "stringswitch.end");
+
+  llvm::PHINode *index = llvm::PHINode::Create(
+      indexType, labels.size() + 2, "stringswitch.index", endbb);
+  index->addIncoming(llvm::ConstantInt::get(indexType, -1, true), nomatchbb);
+
+  // The empty string can't be hashed.
+  llvm::BasicBlock *emptybb =
+      emptyIndex >= 0 ? irs->insertBBBefore(endbb, "stringswitch.empty")
+                      : nomatchbb;
+  irs->ir->CreateCondBr(irs->ir->CreateICmpEQ(length, DtoConstSize_t(0)),
+                        emptybb, hashbb);
+  if (emptyIndex >= 0) {
+    llvm::BranchInst::Create(endbb, emptybb);
+    index->addIncoming(llvm::ConstantInt::get(indexType, emptyIndex), emptybb);
+  }
+
+  irs->scope() = IRScope(hashbb);
+  llvm::SwitchInst *si = nullptr;
+  if (!linear) {
+    LLValue *h = hash.emit(irs, ptr, length);
+    si = llvm::SwitchInst::Create(h, nomatchbb, nonEmptyLabels.size(),
+                                  irs->scopebb());
+  }
+
+  for (size_t i = 0; i < labels.size(); ++i) {
+    StringExp *se = labels[i];
+    const size_t labelLength = se->numberOfCodeUnits();
+    if (labelLength == 0) {
+      continue;
+    }
+
+    llvm::BasicBlock *lengthbb =
+        irs->insertBBBefore(nomatchbb, "stringswitch.length");
+    llvm::BasicBlock *cmpbb = irs->insertBBBefore(nomatchbb, "stringswitch.cmp");
+    // In the compare chain, a mismatch continues with the next label.
+    llvm::BasicBlock *mismatchbb =
+        linear ? irs->insertBBBefore(nomatchbb, "stringswitch.next")
+               : nomatchbb;
+    if (linear) {
+      llvm::BranchInst::Create(lengthbb, irs->scopebb());
+    } else {
+      si->addCase(llvm::ConstantInt::get(LLType::getInt64Ty(irs->context()),
+                                         hash.hash(se)),
+                  lengthbb);
+    }
+
+    irs->scope() = IRScope(lengthbb);
+    irs->ir->CreateCondBr(
+        irs->ir->CreateICmpEQ(length, DtoConstSize_t(labelLength)), cmpbb,
+        mismatchbb);
+
+    irs->scope() = IRScope(cmpbb);
+    LLConstant *label = toConstElem(se, irs);
+    LLValue *labelPtr = DtoBitCast(label->getAggregateElement(1u),
+                                   ptr->getType());
+    LLValue *cmp = callMemcmp(se->loc, *irs, ptr, labelPtr,
+                              DtoConstSize_t(labelLength));
+    irs->ir->CreateCondBr(
+        irs->ir->CreateICmpEQ(cmp, LLConstant::getNullValue(cmp->getType())),
+        endbb, mismatchbb);
+    index->addIncoming(llvm::ConstantInt::get(indexType, i), irs->scopebb());
+
+    irs->scope() = IRScope(mismatchbb);
+  }
+  if (linear) {
+    llvm::BranchInst::Create(nomatchbb, irs->scopebb());
+  }
+
+  irs->scope() = IRScope(nomatchbb);
+  llvm::BranchInst::Create(endbb, nomatchbb);
+
+  irs->scope() = IRScope(endbb);
+  return index;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 class ToIRVisitor : public Visitor {
   IRState *irs;
 
@@ -369,8 +700,10 @@ public:
     PGO.setCurrentStmt(stmt);
 
     if (stmt->statement) {
+      const size_t numOuterLocals = irs->funcGen().scopedLocals.size();
       irs->DBuilder.EmitBlockStart(stmt->statement->loc);
       stmt->statement->accept(this);
+      DtoEndScopedLifetimes(numOuterLocals);
       irs->DBuilder.EmitBlockEnd();
     }
   }
@@ -492,6 +825,11 @@ public:
           PGO.createProfileWeightsWhileLoop(stmt->condition, loopcount);
       PGO.addBranchWeights(branchinst, brweights);
     }
+    if (stmt->ldcLoopHints) {
+      branchinst->setMetadata(
+          "llvm.loop",
+          DtoLoopPragmaMetadata(irs->context(), stmt->ldcLoopHints));
+    }
 
     // rewrite the scope
     irs->scope() = IRScope(endbb);
@@ -583,7 +921,12 @@ public:
 
     // loop
     if (!irs->scopereturned()) {
-      llvm::BranchInst::Create(forbb, irs->scopebb());
+      auto latch = llvm::BranchInst::Create(forbb, irs->scopebb());
+      if (stmt->ldcLoopHints) {
+        latch->setMetadata(
+            "llvm.loop",
+            DtoLoopPragmaMetadata(irs->context(), stmt->ldcLoopHints));
+      }
     }
 
     irs->funcGen().jumpTargets.popLoopTarget();
@@ -871,6 +1214,19 @@ public:
     }
     assert(indices.size() == caseCount);
 
+    // The order in which to test the cases: with profile data, the hottest
+    // cases first, else in source order. As the case values must be distinct,
+    // the order doesn't affect semantics.
+    llvm::SmallVector<size_t, 16> caseOrder(caseCount);
+    std::iota(caseOrder.begin(), caseOrder.end(), 0);
+    if (PGO.haveRegionCounts()) {
+      std::stable_sort(caseOrder.begin(), caseOrder.end(),
+                       [&](size_t a, size_t b) {
+                         return PGO.getRegionCount((*cases)[a]) >
+                                PGO.getRegionCount((*cases)[b]);
+                       });
+    }
+
     // body block.
     // FIXME: that block is never used
     llvm::BasicBlock *bodybb = irs->insertBB("switchbody");
@@ -886,6 +1242,18 @@ public:
           funcGen.switchTargets.getOrCreate(stmt->sdefault, "default", *irs);
     }
 
+    // Let LLVM drop the range check of the case dispatch, e.g., for a bare
+    // jump table. A default body is still emitted for `goto default`. Without
+    // checks (-release), the frontend doesn't add a default to final switches
+    // covering all enum members.
+    if (switchErrors == SwitchErrors::Unreachable &&
+        (stmt->sdefault ? isSwitchError(stmt->sdefault->statement)
+                        : stmt->isFinal)) {
+      Logger::println("default is unreachable");
+      defaultTargetBB = irs->insertBBAfter(endbb, "switch.unreachable");
+      new llvm::UnreachableInst(irs->context(), defaultTargetBB);
+    }
+
     // do switch body
     assert(stmt->_body);
     irs->scope() = IRScope(bodybb);
@@ -899,19 +1267,51 @@ public:
     irs->scope() = IRScope(oldbb);
     if (useSwitchInst) {
       // The case index value.
-      LLValue *condVal = DtoRVal(toElemDtor(stmt->condition));
+      LLValue *condVal = emitStringSwitchIndex(stmt->condition, irs);
+      if (!condVal) {
+        condVal = DtoRVal(toElemDtor(stmt->condition));
+      }
 
       // Create switch and add the cases.
       // For PGO instrumentation, we need to add counters /before/ the case
       // statement bodies, because the counters should only count the jumps
       // directly from the switch statement and not "goto default", etc.
       llvm::SwitchInst *si;
+      size_t firstSwitchCase = 0;
       if (!PGO.emitsInstrumentation()) {
-        si = llvm::SwitchInst::Create(condVal, defaultTargetBB, caseCount,
+        // If the profile is dominated by a single case, test for it before
+        // dispatching via jump table or binary search.
+        if (PGO.haveRegionCounts() && switchPeelPercentage > 0 &&
+            caseCount > 1 && incomingPGORegionCount > 0) {
+          const auto hotCase = (*cases)[caseOrder[0]];
+          const uint64_t hotCount = PGO.getRegionCount(hotCase);
+          if (hotCount >=
+              incomingPGORegionCount * switchPeelPercentage / 100) {
+            IF_LOG Logger::println("Testing hot case before switch");
+            const uint64_t coldCount = incomingPGORegionCount > hotCount
+                                           ? incomingPGORegionCount - hotCount
+                                           : 0;
+            llvm::BasicBlock *coldbb =
+                irs->insertBBBefore(bodybb, "switch.cold");
+            LLValue *cmp = irs->ir->CreateICmpEQ(
+                condVal, indices[caseOrder[0]], "switch.ishot");
+            auto br = llvm::BranchInst::Create(
+                funcGen.switchTargets.get(hotCase), coldbb, cmp,
+                irs->scopebb());
+            PGO.addBranchWeights(br,
+                                 PGO.createProfileWeights(hotCount, coldCount));
+            irs->scope() = IRScope(coldbb);
+            firstSwitchCase = 1;
+          }
+        }
+
+        si = llvm::SwitchInst::Create(condVal, defaultTargetBB,
+                                      caseCount - firstSwitchCase,
                                       irs->scopebb());
-        for (size_t i = 0; i < caseCount; ++i) {
-          si->addCase(isaConstantInt(indices[i]),
-                      funcGen.switchTargets.get((*cases)[i]));
+        for (size_t i = firstSwitchCase; i < caseCount; ++i) {
+          const auto c = caseOrder[i];
+          si->addCase(isaConstantInt(indices[c]),
+                      funcGen.switchTargets.get((*cases)[c]));
         }
       } else {
         auto switchbb = irs->scopebb();
@@ -930,14 +1330,15 @@ public:
 
         // Create and add case counter bbs.
         for (size_t i = 0; i < caseCount; ++i) {
-          const auto cs = (*cases)[i];
+          const auto c = caseOrder[i];
+          const auto cs = (*cases)[c];
           const auto body = funcGen.switchTargets.get(cs);
 
           auto casecntr = irs->insertBBBefore(body, "casecntr");
           irs->scope() = IRScope(casecntr);
           PGO.emitCounterIncrement(cs);
           llvm::BranchInst::Create(body, casecntr);
-          si->addCase(isaConstantInt(indices[i]), casecntr);
+          si->addCase(isaConstantInt(indices[c]), casecntr);
         }
       }
 
@@ -947,8 +1348,8 @@ public:
         std::vector<uint64_t> case_prof_counts;
         case_prof_counts.push_back(
             stmt->sdefault ? PGO.getRegionCount(stmt->sdefault) : 0);
-        for (auto cs : *cases) {
-          auto w = PGO.getRegionCount(cs);
+        for (size_t i = firstSwitchCase; i < caseCount; ++i) {
+          auto w = PGO.getRegionCount((*cases)[caseOrder[i]]);
           case_prof_counts.push_back(w);
         }
 
@@ -978,12 +1379,13 @@ public:
       irs->scope() = IRScope(nextbb);
       auto failedCompareCount = incomingPGORegionCount;
       for (size_t i = 0; i < caseCount; ++i) {
-        LLValue *cmp = irs->ir->CreateICmp(llvm::ICmpInst::ICMP_EQ, indices[i],
+        const auto c = caseOrder[i];
+        LLValue *cmp = irs->ir->CreateICmp(llvm::ICmpInst::ICMP_EQ, indices[c],
                                            condVal, "checkcase");
         nextbb = irs->insertBBBefore(endbb, "checkcase");
 
         // Add case counters for PGO in front of case body
-        const auto cs = (*cases)[i];
+        const auto cs = (*cases)[c];
         auto casejumptargetbb = funcGen.switchTargets.get(cs);
         if (PGO.emitsInstrumentation()) {
           llvm::BasicBlock *casecntr =
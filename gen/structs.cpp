@@ -22,6 +22,7 @@
 #include "gen/structs.h"
 #include "gen/tollvm.h"
 #include "ir/iraggr.h"
+#include "ir/irtype.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/ManagedStatic.h"
 #include <algorithm>
@@ -104,6 +105,12 @@ LLType *DtoUnpaddedStructType(Type *dty) {
 
   typedef llvm::DenseMap<Type *, llvm::StructType *> CacheT;
   static llvm::ManagedStatic<CacheT> cache;
+  // The cached types are invalidated together with the IrTypes.
+  static unsigned cacheEpoch = 0;
+  if (cacheEpoch != IrType::getEpoch()) {
+    cache->clear();
+    cacheEpoch = IrType::getEpoch();
+  }
   auto it = cache->find(dty);
   if (it != cache->end()) {
     return it->second;
@@ -0,0 +1,429 @@
+//===-- targetclones.cpp --------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// The body of a function with @targetClones is moved to an internal default
+// version and cloned for each feature set. The original function becomes a
+// stub tail-calling the version selected by a resolver, which tests the CPUID
+// feature bits (and whether the OS saves the AVX/AVX-512 register state).
+//
+// On ELF, the stub calls through an ifunc, so the resolver runs once when the
+// dynamic linker relocates the binary. Elsewhere, it calls through a pointer
+// set by a module constructor, which points to the default version before.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gen/targetclones.h"
+
+#include "declaration.h"
+#include "errors.h"
+#include "globals.h"
+#include "gen/irstate.h"
+#include "gen/llvm.h"
+#include "gen/logger.h"
+#include "ir/irfunction.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/GlobalIFunc.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+llvm::cl::list<std::string> multiversionHot(
+    "fmultiversion-hot", llvm::cl::CommaSeparated,
+    llvm::cl::value_desc("feature,..."),
+    llvm::cl::desc("Clone hot functions containing loops for each of the "
+                   "given x86 target features and select the best version at "
+                   "load time (requires -fprofile-instr-use or "
+                   "@optStrategy(\"hot\"))"));
+
+llvm::cl::opt<unsigned> multiversionHotThreshold(
+    "fmultiversion-hot-threshold", llvm::cl::ZeroOrMore, llvm::cl::Hidden,
+    llvm::cl::init(10000),
+    llvm::cl::desc("Minimum profiled loop iteration count for a function to "
+                   "be cloned by -fmultiversion-hot"));
+
+// The CPUID result words the feature bits are read from.
+enum CpuidWord { Leaf1EDX, Leaf1ECX, Leaf7EBX, NumCpuidWords };
+
+// The register state the OS needs to save for a feature to be usable.
+enum class OSState { None, AVX, AVX512 };
+
+struct CpuFeature {
+  const char *name;
+  CpuidWord word;
+  unsigned bit;
+  OSState state;
+};
+
+// Ordered by priority: clones requiring later features are preferred.
+const CpuFeature cpuFeatures[] = {
+    {"sse", Leaf1EDX, 25, OSState::None},
+    {"sse2", Leaf1EDX, 26, OSState::None},
+    {"sse3", Leaf1ECX, 0, OSState::None},
+    {"pclmul", Leaf1ECX, 1, OSState::None},
+    {"ssse3", Leaf1ECX, 9, OSState::None},
+    {"sse4.1", Leaf1ECX, 19, OSState::None},
+    {"sse4.2", Leaf1ECX, 20, OSState::None},
+    {"popcnt", Leaf1ECX, 23, OSState::None},
+    {"aes", Leaf1ECX, 25, OSState::None},
+    {"avx", Leaf1ECX, 28, OSState::AVX},
+    {"fma", Leaf1ECX, 12, OSState::AVX},
+    {"bmi", Leaf7EBX, 3, OSState::None},
+    {"bmi2", Leaf7EBX, 8, OSState::None},
+    {"avx2", Leaf7EBX, 5, OSState::AVX},
+    {"avx512f", Leaf7EBX, 16, OSState::AVX512},
+    {"avx512cd", Leaf7EBX, 28, OSState::AVX512},
+    {"avx512dq", Leaf7EBX, 17, OSState::AVX512},
+    {"avx512bw", Leaf7EBX, 30, OSState::AVX512},
+    {"avx512vl", Leaf7EBX, 31, OSState::AVX512},
+};
+
+const CpuFeature *findFeature(llvm::StringRef name, unsigned &priority) {
+  for (unsigned i = 0; i < llvm::array_lengthof(cpuFeatures); ++i) {
+    if (name == cpuFeatures[i].name) {
+      priority = i + 1;
+      return &cpuFeatures[i];
+    }
+  }
+  return nullptr;
+}
+
+void splitSpec(llvm::StringRef spec,
+               llvm::SmallVectorImpl<llvm::StringRef> &features) {
+  llvm::SmallVector<llvm::StringRef, 4> fragments;
+  spec.split(fragments, ',', -1, /*KeepEmpty=*/false);
+  for (auto f : fragments) {
+    f = f.trim();
+    if (!f.empty())
+      features.push_back(f);
+  }
+}
+
+struct Clone {
+  llvm::Function *func;
+  llvm::SmallVector<const CpuFeature *, 4> features;
+  unsigned priority;
+};
+
+llvm::Value *emitCpuid(llvm::IRBuilder<> &b, unsigned leaf) {
+  llvm::Type *i32 = b.getInt32Ty();
+  llvm::Type *resultType =
+      llvm::StructType::get(b.getContext(), {i32, i32, i32, i32});
+  auto fnType = llvm::FunctionType::get(resultType, {i32, i32}, false);
+  auto cpuid = llvm::InlineAsm::get(
+      fnType, "cpuid",
+      "={ax},={bx},={cx},={dx},{ax},{cx},~{dirflag},~{fpsr},~{flags}",
+      /*hasSideEffects=*/false);
+  return b.CreateCall(cpuid, {b.getInt32(leaf), b.getInt32(0)});
+}
+
+/// Emits the resolver returning the best version; clones are sorted by
+/// ascending priority.
+llvm::Function *emitResolver(llvm::Module &module, llvm::Function *defaultImpl,
+                             const std::vector<Clone> &clones,
+                             llvm::StringRef name) {
+  llvm::LLVMContext &ctx = module.getContext();
+  auto resolver = llvm::Function::Create(
+      llvm::FunctionType::get(defaultImpl->getType(), false),
+      llvm::GlobalValue::InternalLinkage, name + ".resolver", &module);
+  resolver->addFnAttr(llvm::Attribute::NoUnwind);
+
+  auto entryBB = llvm::BasicBlock::Create(ctx, "", resolver);
+  auto xgetbvBB = llvm::BasicBlock::Create(ctx, "xgetbv", resolver);
+  auto selectBB = llvm::BasicBlock::Create(ctx, "select", resolver);
+  llvm::IRBuilder<> b(entryBB);
+  llvm::Type *i32 = b.getInt32Ty();
+
+  llvm::Value *maxLeaf = b.CreateExtractValue(emitCpuid(b, 0), 0);
+  llvm::Value *leaf1 = emitCpuid(b, 1);
+  llvm::Value *leaf7 = emitCpuid(b, 7);
+  llvm::Value *words[NumCpuidWords];
+  words[Leaf1EDX] = b.CreateExtractValue(leaf1, 3);
+  words[Leaf1ECX] = b.CreateExtractValue(leaf1, 2);
+  words[Leaf7EBX] =
+      b.CreateSelect(b.CreateICmpUGE(maxLeaf, b.getInt32(7)),
+                     b.CreateExtractValue(leaf7, 1), b.getInt32(0));
+
+  // XGETBV may only be executed if the OS has enabled it (OSXSAVE).
+  llvm::Value *osxsave = b.CreateICmpNE(
+      b.CreateAnd(words[Leaf1ECX], 1u << 27), b.getInt32(0));
+  b.CreateCondBr(osxsave, xgetbvBB, selectBB);
+
+  b.SetInsertPoint(xgetbvBB);
+  // Encoded as bytes, as the assembler may require the XSAVE feature.
+  auto xgetbvType = llvm::FunctionType::get(
+      llvm::StructType::get(ctx, {i32, i32}), {i32}, false);
+  auto xgetbv = llvm::InlineAsm::get(
+      xgetbvType, ".byte 0x0f, 0x01, 0xd0",
+      "={ax},={dx},{cx},~{dirflag},~{fpsr},~{flags}",
+      /*hasSideEffects=*/false);
+  llvm::Value *xcr0 =
+      b.CreateExtractValue(b.CreateCall(xgetbv, {b.getInt32(0)}), 0);
+  b.CreateBr(selectBB);
+
+  b.SetInsertPoint(selectBB);
+  llvm::PHINode *xcr0Phi = b.CreatePHI(i32, 2, "xcr0");
+  xcr0Phi->addIncoming(b.getInt32(0), entryBB);
+  xcr0Phi->addIncoming(xcr0, xgetbvBB);
+  // XMM and YMM state; additionally opmask and ZMM state for AVX-512
+  llvm::Value *avxState =
+      b.CreateICmpEQ(b.CreateAnd(xcr0Phi, 0x6), b.getInt32(0x6));
+  llvm::Value *avx512State =
+      b.CreateICmpEQ(b.CreateAnd(xcr0Phi, 0xe6), b.getInt32(0xe6));
+
+  llvm::Value *result = defaultImpl;
+  for (const auto &clone : clones) {
+    llvm::Value *supported = b.getTrue();
+    for (const CpuFeature *f : clone.features) {
+      llvm::Value *bit = b.CreateAnd(words[f->word], 1u << f->bit);
+      supported = b.CreateAnd(supported, b.CreateICmpNE(bit, b.getInt32(0)));
+      if (f->state == OSState::AVX) {
+        supported = b.CreateAnd(supported, avxState);
+      } else if (f->state == OSState::AVX512) {
+        supported = b.CreateAnd(supported, avx512State);
+      }
+    }
+    result = b.CreateSelect(supported, clone.func, result);
+  }
+  b.CreateRet(result);
+
+  return resolver;
+}
+
+bool isX86(const llvm::Triple &triple) {
+  return triple.getArch() == llvm::Triple::x86 ||
+         triple.getArch() == llvm::Triple::x86_64;
+}
+
+/// Returns the highest profiled execution count of a branch in an innermost
+/// loop of the function, or 0 if there's no profile data.
+uint64_t getMaxInnermostLoopCount(llvm::Function *func, bool &hasLoops) {
+  llvm::DominatorTree domTree(*func);
+  llvm::LoopInfo loopInfo(domTree);
+
+  uint64_t maxCount = 0;
+  hasLoops = !loopInfo.empty();
+  llvm::SmallVector<llvm::Loop *, 4> worklist(loopInfo.begin(),
+                                              loopInfo.end());
+  while (!worklist.empty()) {
+    llvm::Loop *loop = worklist.pop_back_val();
+    if (!loop->empty()) {
+      worklist.append(loop->begin(), loop->end());
+      continue;
+    }
+    for (llvm::BasicBlock *bb : loop->blocks()) {
+      uint64_t count = 0;
+      if (bb->getTerminator()->extractProfTotalWeight(count))
+        maxCount = std::max(maxCount, count);
+    }
+  }
+  return maxCount;
+}
+
+} // anonymous namespace
+
+void addHotTargetClones(IrFunction *irFunc) {
+  if (multiversionHot.empty() || !irFunc->targetClones.empty() ||
+      irFunc->targetFeaturesOverridden || irFunc->isDynamicCompiled()) {
+    return;
+  }
+
+  // Diagnose the command line once, on the first function definition.
+  static bool checked = false;
+  static bool valid = true;
+  if (!checked) {
+    checked = true;
+    if (!isX86(*global.params.targetTriple)) {
+      error(Loc(), "`-fmultiversion-hot` is only supported for x86 targets");
+      valid = false;
+    }
+    for (const auto &spec : multiversionHot) {
+      llvm::StringRef unsupported = findUnsupportedCloneFeature(spec);
+      if (!unsupported.empty() || llvm::StringRef(spec).trim().empty()) {
+        error(Loc(), "unsupported target feature `%s` for "
+                     "`-fmultiversion-hot`",
+              spec.c_str());
+        valid = false;
+      }
+    }
+  }
+  if (!valid) {
+    return;
+  }
+
+  llvm::Function *func = irFunc->getLLVMFunc();
+  if (func->isDeclaration() ||
+      func->hasFnAttribute(llvm::Attribute::OptimizeNone) ||
+      func->hasFnAttribute(llvm::Attribute::OptimizeForSize) ||
+      func->hasFnAttribute(llvm::Attribute::MinSize) ||
+      func->hasFnAttribute(llvm::Attribute::Naked)) {
+    return;
+  }
+
+  // Functions marked @optStrategy("hot") qualify without profile data.
+  bool hasLoops = false;
+  const uint64_t loopCount = getMaxInnermostLoopCount(func, hasLoops);
+  if (!hasLoops || (!irFunc->hot && loopCount < multiversionHotThreshold)) {
+    return;
+  }
+
+  IF_LOG Logger::println("Hot loops (%llu iterations), cloning %s",
+                         static_cast<unsigned long long>(loopCount),
+                         irFunc->decl->toPrettyChars());
+  for (const auto &spec : multiversionHot) {
+    irFunc->targetClones.push_back(llvm::StringRef(spec).trim().str());
+  }
+}
+
+llvm::StringRef findUnsupportedCloneFeature(llvm::StringRef spec) {
+  llvm::SmallVector<llvm::StringRef, 4> features;
+  splitSpec(spec, features);
+  for (auto f : features) {
+    unsigned priority;
+    if (!findFeature(f, priority))
+      return f;
+  }
+  return llvm::StringRef();
+}
+
+void emitTargetClones(IrFunction *irFunc) {
+  FuncDeclaration *fd = irFunc->decl;
+  llvm::Function *func = irFunc->getLLVMFunc();
+  if (func->isDeclaration()) {
+    return;
+  }
+
+  const llvm::Triple &triple = *global.params.targetTriple;
+  if (!isX86(triple)) {
+    error(fd->loc, "`@ldc.attributes.targetClones` is only supported for x86 "
+                   "targets");
+    return;
+  }
+  if (irFunc->isDynamicCompiled()) {
+    error(fd->loc, "cannot combine `@ldc.attributes.targetClones` with "
+                   "dynamic compilation");
+    return;
+  }
+
+  IF_LOG Logger::println("Emitting %u target clones of %s",
+                         static_cast<unsigned>(irFunc->targetClones.size()),
+                         fd->toPrettyChars());
+  LOG_SCOPE;
+
+  llvm::Module &module = *func->getParent();
+  llvm::LLVMContext &ctx = module.getContext();
+  const std::string name = func->getName();
+
+  // Move the body to the internal default version.
+  auto defaultImpl =
+      llvm::Function::Create(func->getFunctionType(),
+                             llvm::GlobalValue::InternalLinkage,
+                             name + ".default", &module);
+  defaultImpl->copyAttributesFrom(func);
+  defaultImpl->setLinkage(llvm::GlobalValue::InternalLinkage);
+  defaultImpl->setVisibility(llvm::GlobalValue::DefaultVisibility);
+  defaultImpl->setDLLStorageClass(llvm::GlobalValue::DefaultStorageClass);
+  defaultImpl->setComdat(nullptr);
+  defaultImpl->getBasicBlockList().splice(defaultImpl->begin(),
+                                          func->getBasicBlockList());
+  for (auto arg = func->arg_begin(), newArg = defaultImpl->arg_begin();
+       arg != func->arg_end(); ++arg, ++newArg) {
+    newArg->takeName(&*arg);
+    arg->replaceAllUsesWith(&*newArg);
+  }
+  if (llvm::DISubprogram *sp = func->getSubprogram()) {
+    defaultImpl->setSubprogram(sp);
+    func->setSubprogram(nullptr);
+  }
+
+  const std::string defaultFeatures =
+      defaultImpl->getFnAttribute("target-features").getValueAsString();
+
+  std::vector<Clone> clones;
+  for (const auto &spec : irFunc->targetClones) {
+    llvm::SmallVector<llvm::StringRef, 4> features;
+    splitSpec(spec, features);
+
+    Clone clone;
+    clone.priority = 0;
+    std::string suffix;
+    std::string targetFeatures = defaultFeatures;
+    for (auto f : features) {
+      unsigned priority = 0;
+      const CpuFeature *feature = findFeature(f, priority);
+      assert(feature && "unsupported feature should have been diagnosed");
+      clone.features.push_back(feature);
+      clone.priority = std::max(clone.priority, priority);
+      suffix += '.';
+      suffix += f;
+      if (!targetFeatures.empty())
+        targetFeatures += ',';
+      targetFeatures += '+';
+      targetFeatures += f;
+    }
+
+    llvm::ValueToValueMapTy vmap;
+    clone.func = llvm::CloneFunction(defaultImpl, vmap);
+    clone.func->setName(name + suffix);
+    clone.func->addFnAttr("target-features", targetFeatures);
+    clones.push_back(clone);
+  }
+  std::stable_sort(clones.begin(), clones.end(),
+                   [](const Clone &a, const Clone &b) {
+                     return a.priority < b.priority;
+                   });
+
+  llvm::Function *resolver = emitResolver(module, defaultImpl, clones, name);
+
+  // The original function forwards all calls to the selected version.
+  llvm::IRBuilder<> b(llvm::BasicBlock::Create(ctx, "", func));
+  llvm::Value *callee;
+  if (triple.isOSBinFormatELF()) {
+    callee = llvm::GlobalIFunc::create(func->getFunctionType(), 0,
+                                       llvm::GlobalValue::InternalLinkage,
+                                       name + ".ifunc", resolver, &module);
+  } else {
+    auto dispatch = new llvm::GlobalVariable(
+        module, func->getType(), false, llvm::GlobalValue::InternalLinkage,
+        defaultImpl, name + ".dispatch");
+
+    auto init = llvm::Function::Create(
+        llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), false),
+        llvm::GlobalValue::InternalLinkage, name + ".dispatch_init", &module);
+    llvm::IRBuilder<> initBuilder(llvm::BasicBlock::Create(ctx, "", init));
+    initBuilder.CreateStore(initBuilder.CreateCall(resolver), dispatch);
+    initBuilder.CreateRetVoid();
+    llvm::appendToGlobalCtors(module, init, 0);
+
+    callee = b.CreateLoad(dispatch);
+  }
+
+  llvm::SmallVector<llvm::Value *, 8> args;
+  for (auto &arg : func->args()) {
+    args.push_back(&arg);
+  }
+  llvm::CallInst *call = b.CreateCall(callee, args);
+  call->setCallingConv(func->getCallingConv());
+  call->setAttributes(func->getAttributes());
+  call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+  if (func->getReturnType()->isVoidTy()) {
+    b.CreateRetVoid();
+  } else {
+    b.CreateRet(call);
+  }
+}
@@ -0,0 +1,38 @@
+//===-- gen/targetclones.h - Function multiversioning -----------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Functions with @ldc.attributes.targetClones are compiled once per given set
+// of target features in addition to the default version; calls are dispatched
+// to the best version for the executing CPU, selected once at load time.
+// With -fmultiversion-hot, the same is done for functions with hot loops.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_GEN_TARGETCLONES_H
+#define LDC_GEN_TARGETCLONES_H
+
+#include "llvm/ADT/StringRef.h"
+
+struct IrFunction;
+
+/// Returns the first feature of the comma-separated clone specification
+/// whose availability can't be tested at runtime, or an empty string if
+/// there is none.
+llvm::StringRef findUnsupportedCloneFeature(llvm::StringRef spec);
+
+/// Adds the -fmultiversion-hot feature sets to irFunc->targetClones if the
+/// defined function contains innermost loops executed often enough according
+/// to the profile data, or contains loops and is marked @optStrategy("hot").
+void addHotTargetClones(IrFunction *irFunc);
+
+/// Turns the defined function into a dispatcher for its default version and
+/// the clones in irFunc->targetClones.
+void emitTargetClones(IrFunction *irFunc);
+
+#endif
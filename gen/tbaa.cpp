@@ -0,0 +1,95 @@
+//===-- tbaa.cpp ----------------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gen/tbaa.h"
+
+#include "dmd/mtype.h"
+#include "driver/cl_options.h"
+#include "gen/funcgenstate.h"
+#include "gen/irstate.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+
+namespace {
+// The name of the scalar type node for accesses of values of type `t`, or
+// null for types whose accesses may alias anything.
+const char *getScalarTypeName(Type *t) {
+  switch (t->ty) {
+  case Tint16:
+  case Tuns16:
+  case Twchar:
+    return "short";
+  case Tint32:
+  case Tuns32:
+  case Tdchar:
+    return "int";
+  case Tint64:
+  case Tuns64:
+    return "long";
+  case Tint128:
+  case Tuns128:
+    return "cent";
+  case Tfloat32:
+  case Timaginary32:
+    return "float";
+  case Tfloat64:
+  case Timaginary64:
+    return "double";
+  case Tfloat80:
+  case Timaginary80:
+    return "real";
+  case Tpointer:
+  case Tnull:
+  case Tclass:
+  case Taarray:
+    return "any pointer";
+  default:
+    // Byte-sized types (void, bool, byte, ubyte, char) alias everything like
+    // C's char. Aggregates, vectors and complex numbers aren't tagged.
+    return nullptr;
+  }
+}
+}
+
+llvm::MDNode *getTBAAAccessTag(Type *type) {
+  const char *name = getScalarTypeName(type->toBasetype());
+  if (!name)
+    return nullptr;
+
+  // The nodes are uniqued by the LLVMContext.
+  llvm::MDBuilder mdb(gIR->context());
+  llvm::MDNode *root = mdb.createTBAARoot("LDC D types");
+  llvm::MDNode *omnipotentChar =
+      mdb.createTBAAScalarTypeNode("omnipotent char", root);
+  llvm::MDNode *scalar = mdb.createTBAAScalarTypeNode(name, omnipotentChar);
+  return mdb.createTBAAStructTagNode(scalar, scalar, 0);
+}
+
+void addTBAAMetadata(llvm::Value *access, Type *type, llvm::Value *ptr) {
+  if (!opts::strictAliasing || isTBAAUnionPointer(ptr))
+    return;
+
+  auto inst = llvm::dyn_cast<llvm::Instruction>(access);
+  if (!inst || !(llvm::isa<llvm::LoadInst>(inst) ||
+                 llvm::isa<llvm::StoreInst>(inst)))
+    return;
+
+  if (llvm::MDNode *tag = getTBAAAccessTag(type))
+    inst->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
+}
+
+void addTBAAUnionPointer(llvm::Value *ptr) {
+  if (opts::strictAliasing && !gIR->funcGenStates.empty())
+    gIR->funcGen().tbaaUnionPointers.insert(ptr);
+}
+
+bool isTBAAUnionPointer(llvm::Value *ptr) {
+  return !gIR->funcGenStates.empty() &&
+         gIR->funcGen().tbaaUnionPointers.count(ptr);
+}
@@ -0,0 +1,40 @@
+//===-- gen/tbaa.h - Type-based alias analysis metadata ---------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the BSD-style LDC license. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Attaches type-based alias analysis (TBAA) metadata to loads and stores of
+// scalar D values, if enabled by -fstrict-aliasing.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LDC_GEN_TBAA_H
+#define LDC_GEN_TBAA_H
+
+class Type;
+namespace llvm {
+class MDNode;
+class Value;
+}
+
+/// Returns the TBAA access tag for loads and stores of values of the given D
+/// type, or null if they may alias anything.
+llvm::MDNode *getTBAAAccessTag(Type *type);
+
+/// Attaches the TBAA access tag of `type` to the load or store `access`
+/// through `ptr`, unless -fstrict-aliasing is disabled or `ptr` points to
+/// (a part of) an overlapping field, which D allows to be type-punned.
+void addTBAAMetadata(llvm::Value *access, Type *type, llvm::Value *ptr);
+
+/// Remembers that `ptr` points to (a part of) an overlapping field, e.g., a
+/// union member, so that accesses through it aren't tagged.
+void addTBAAUnionPointer(llvm::Value *ptr);
+
+/// Returns whether `ptr` has been passed to addTBAAUnionPointer().
+bool isTBAAUnionPointer(llvm::Value *ptr);
+
+#endif
@@ -238,37 +238,205 @@ static LLValue *getTypeinfoArrayArgumentForDVarArg(Expressions *argexps,
   LLArrayType *typeinfoarraytype =
       LLArrayType::get(typeinfotype, numVariadicArgs);
 
-  auto typeinfomem = new llvm::GlobalVariable(
-      gIR->module, typeinfoarraytype, true, llvm::GlobalValue::InternalLinkage,
-      nullptr, "._arguments.storage");
-  IF_LOG Logger::cout() << "_arguments storage: " << *typeinfomem << '\n';
-
   std::vector<LLConstant *> vtypeinfos;
   vtypeinfos.reserve(numVariadicArgs);
   for (size_t i = begin; i < numArgExps; i++) {
     vtypeinfos.push_back(DtoTypeInfoOf((*argexps)[i]->type));
   }
 
-  // apply initializer
+  // Call sites with the same argument types share the storage.
   LLConstant *tiinits = LLConstantArray::get(typeinfoarraytype, vtypeinfos);
-  typeinfomem->setInitializer(tiinits);
+  auto typeinfomem = gIR->getPooledConstant(tiinits, "._arguments.storage");
+  IF_LOG Logger::cout() << "_arguments storage: " << *typeinfomem << '\n';
 
-  // put data in d-array
+  // The d-array is a constant too, so it is passed directly.
   LLConstant *pinits[] = {
       DtoConstSize_t(numVariadicArgs),
       llvm::ConstantExpr::getBitCast(typeinfomem, getPtrToType(typeinfotype))};
   LLType *tiarrty = DtoType(getTypeInfoType()->arrayOf());
-  tiinits = LLConstantStruct::get(isaStruct(tiarrty),
-                                  llvm::ArrayRef<LLConstant *>(pinits));
-  LLValue *typeinfoarrayparam = new llvm::GlobalVariable(
-      gIR->module, tiarrty, true, llvm::GlobalValue::InternalLinkage, tiinits,
-      "._arguments.array");
-
-  return DtoLoad(typeinfoarrayparam);
+  return LLConstantStruct::get(isaStruct(tiarrty),
+                               llvm::ArrayRef<LLConstant *>(pinits));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+llvm::VectorType *getSimdVectorType(CallExp *e, LLValue *v, const char *name) {
+  auto vecTy = llvm::dyn_cast<llvm::VectorType>(v->getType());
+  if (!vecTy) {
+    e->error("`simd.%s` intrinsic expects a vector argument", name);
+    fatal();
+  }
+  return vecTy;
+}
+
+// Converts an integer vector to a vector of i1, true for non-zero lanes.
+LLValue *getSimdMask(CallExp *e, LLValue *mask, unsigned numElements,
+                     const char *name) {
+  auto maskTy = getSimdVectorType(e, mask, name);
+  if (!maskTy->getElementType()->isIntegerTy() ||
+      maskTy->getNumElements() != numElements) {
+    e->error("`simd.%s` intrinsic expects an integer mask vector with %u "
+             "elements",
+             name, numElements);
+    fatal();
+  }
+  return gIR->ir->CreateICmpNE(mask, LLConstant::getNullValue(maskTy),
+                               "simd.mask");
+}
+
+void checkSimdArgCount(CallExp *e, unsigned count, const char *name) {
+  if (e->arguments->dim != count) {
+    e->error("`simd.%s` intrinsic expects %u arguments", name, count);
+    fatal();
+  }
+}
+
+// Lowers the portable ldc.simd.* intrinsics directly to vector instructions
+// and masked memory intrinsics, so that they don't go through memory.
+DValue *DtoLowerSimdIntrinsic(IRState *p, FuncDeclaration *fndecl,
+                              CallExp *e) {
+  Expressions &args = *e->arguments;
+  LLType *const i32Ty = LLType::getInt32Ty(p->context());
+
+  switch (fndecl->llvmInternal) {
+  // shuffle(a, b, mask): mask needs to be a constant integer vector or static
+  // array, each element selecting a lane of `a ~ b` (or -1 for undef)
+  case LLVMsimd_shuffle: {
+    checkSimdArgCount(e, 3, "shuffle");
+    LLValue *a = DtoRVal(args[0]);
+    LLValue *b = DtoRVal(args[1]);
+    getSimdVectorType(e, a, "shuffle");
+    if (a->getType() != b->getType()) {
+      e->error("`simd.shuffle` intrinsic expects two vectors of the same type");
+      fatal();
+    }
+    LLConstant *maskConst = toConstElem(args[2], p);
+    const unsigned n =
+        args[2]->type->toBasetype()->ty == Tvector
+            ? maskConst->getType()->getVectorNumElements()
+            : maskConst->getType()->getArrayNumElements();
+    llvm::SmallVector<LLConstant *, 16> indices;
+    for (unsigned i = 0; i < n; ++i) {
+      auto index =
+          llvm::dyn_cast_or_null<llvm::ConstantInt>(
+              maskConst->getAggregateElement(i));
+      if (!index) {
+        e->error("`simd.shuffle` intrinsic expects constant integer indices");
+        fatal();
+      }
+      const int64_t value = index->getSExtValue();
+      indices.push_back(value < 0 ? llvm::UndefValue::get(i32Ty)
+                                  : LLConstantInt::get(i32Ty, value));
+    }
+    LLValue *ret = p->ir->CreateShuffleVector(
+        a, b, llvm::ConstantVector::get(indices), "simd.shuffle");
+    return new DImValue(e->type, ret);
+  }
+
+  // select(mask, a, b): lanes of `a` where the mask is non-zero, else `b`
+  case LLVMsimd_select: {
+    checkSimdArgCount(e, 3, "select");
+    LLValue *mask = DtoRVal(args[0]);
+    LLValue *a = DtoRVal(args[1]);
+    LLValue *b = DtoRVal(args[2]);
+    auto vecTy = getSimdVectorType(e, a, "select");
+    mask = getSimdMask(e, mask, vecTy->getNumElements(), "select");
+    return new DImValue(e->type,
+                        p->ir->CreateSelect(mask, a, b, "simd.select"));
+  }
+
+  // reduce_add(v): horizontal sum of all lanes, as log2(N) halving shuffles
+  // which the backends match to native horizontal adds
+  case LLVMsimd_reduce_add: {
+    checkSimdArgCount(e, 1, "reduce_add");
+    LLValue *v = DtoRVal(args[0]);
+    auto vecTy = getSimdVectorType(e, v, "reduce_add");
+    const unsigned n = vecTy->getNumElements();
+    if (n & (n - 1)) {
+      e->error("`simd.reduce_add` intrinsic expects a power-of-2 number of "
+               "vector elements");
+      fatal();
+    }
+    const bool isFP = vecTy->getElementType()->isFloatingPointTy();
+    for (unsigned width = n / 2; width > 0; width /= 2) {
+      llvm::SmallVector<LLConstant *, 16> indices;
+      for (unsigned i = 0; i < n; ++i) {
+        indices.push_back(i < width ? LLConstantInt::get(i32Ty, i + width)
+                                    : llvm::UndefValue::get(i32Ty));
+      }
+      LLValue *upper = p->ir->CreateShuffleVector(
+          v, llvm::UndefValue::get(vecTy), llvm::ConstantVector::get(indices),
+          "simd.rdx.shuf");
+      v = isFP ? p->ir->CreateFAdd(v, upper, "simd.rdx")
+               : p->ir->CreateAdd(v, upper, "simd.rdx");
+    }
+    return new DImValue(e->type, p->ir->CreateExtractElement(
+                                     v, DtoConstUint(0), "simd.reduce_add"));
+  }
+
+  // masked_load(ptr, mask, passThru): loads the lanes where the mask is
+  // non-zero from the (element-aligned) memory at ptr
+  case LLVMsimd_masked_load: {
+    checkSimdArgCount(e, 3, "masked_load");
+    LLValue *ptr = DtoRVal(args[0]);
+    LLValue *mask = DtoRVal(args[1]);
+    LLValue *passThru = DtoRVal(args[2]);
+    auto vecTy = getSimdVectorType(e, passThru, "masked_load");
+    ptr = DtoBitCast(ptr, getPtrToType(vecTy));
+    mask = getSimdMask(e, mask, vecTy->getNumElements(), "masked_load");
+    LLValue *ret = p->ir->CreateMaskedLoad(
+        ptr, getABITypeAlign(vecTy->getElementType()), mask, passThru,
+        "simd.masked_load");
+    return new DImValue(e->type, ret);
+  }
+
+  // masked_store(ptr, value, mask)
+  case LLVMsimd_masked_store: {
+    checkSimdArgCount(e, 3, "masked_store");
+    LLValue *ptr = DtoRVal(args[0]);
+    LLValue *value = DtoRVal(args[1]);
+    LLValue *mask = DtoRVal(args[2]);
+    auto vecTy = getSimdVectorType(e, value, "masked_store");
+    ptr = DtoBitCast(ptr, getPtrToType(vecTy));
+    mask = getSimdMask(e, mask, vecTy->getNumElements(), "masked_store");
+    p->ir->CreateMaskedStore(value, ptr,
+                             getABITypeAlign(vecTy->getElementType()), mask);
+    return nullptr;
+  }
+
+  // gather(ptr, indices, mask, passThru): loads ptr[indices[i]] for the lanes
+  // where the mask is non-zero
+  case LLVMsimd_gather: {
+    checkSimdArgCount(e, 4, "gather");
+    LLValue *base = DtoRVal(args[0]);
+    LLValue *indices = DtoRVal(args[1]);
+    LLValue *mask = DtoRVal(args[2]);
+    LLValue *passThru = DtoRVal(args[3]);
+    auto vecTy = getSimdVectorType(e, passThru, "gather");
+    LLType *elemTy = vecTy->getElementType();
+    base = DtoBitCast(base, getPtrToType(elemTy));
+    auto indicesTy = getSimdVectorType(e, indices, "gather");
+    if (!indicesTy->getElementType()->isIntegerTy() ||
+        indicesTy->getNumElements() != vecTy->getNumElements()) {
+      e->error("`simd.gather` intrinsic expects an integer index vector with "
+               "%u elements",
+               vecTy->getNumElements());
+      fatal();
+    }
+    LLValue *ptrs = p->ir->CreateGEP(base, indices, "simd.gather.ptrs");
+    mask = getSimdMask(e, mask, vecTy->getNumElements(), "gather");
+    LLValue *ret = p->ir->CreateMaskedGather(ptrs, getABITypeAlign(elemTy),
+                                             mask, passThru, "simd.gather");
+    return new DImValue(e->type, ret);
+  }
+
+  default:
+    llvm_unreachable("Unrecognized simd intrinsic.");
+  }
+}
+} // anonymous namespace
+
 bool DtoLowerMagicIntrinsic(IRState *p, FuncDeclaration *fndecl, CallExp *e,
                             DValue *&result) {
   // va_start instruction
@@ -642,6 +810,12 @@ bool DtoLowerMagicIntrinsic(IRState *p, FuncDeclaration *fndecl, CallExp *e,
     return true;
   }
 
+  if (fndecl->llvmInternal >= LLVMsimd_gather &&
+      fndecl->llvmInternal <= LLVMsimd_shuffle) {
+    result = DtoLowerSimdIntrinsic(p, fndecl, e);
+    return true;
+  }
+
   return false;
 }
 
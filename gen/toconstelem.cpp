@@ -169,7 +169,6 @@ public:
     LOG_SCOPE;
 
     Type *const t = e->type->toBasetype();
-    Type *const cty = t->nextOf()->toBasetype();
 
     auto _init = buildStringLiteralConstant(e, t->ty != Tsarray);
 
@@ -178,20 +177,7 @@ public:
       return;
     }
 
-    auto stringLiteralCache = stringLiteralCacheForType(cty);
-    llvm::StringRef key(e->toChars());
-    llvm::GlobalVariable *gvar =
-        (stringLiteralCache->find(key) == stringLiteralCache->end())
-            ? nullptr
-            : (*stringLiteralCache)[key];
-    if (gvar == nullptr) {
-      llvm::GlobalValue::LinkageTypes _linkage =
-          llvm::GlobalValue::PrivateLinkage;
-      gvar = new llvm::GlobalVariable(gIR->module, _init->getType(), true,
-                                      _linkage, _init, ".str");
-      gvar->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
-      (*stringLiteralCache)[key] = gvar;
-    }
+    llvm::GlobalVariable *gvar = p->getPooledConstant(_init, ".str");
 
     llvm::ConstantInt *zero =
         LLConstantInt::get(LLType::getInt32Ty(gIR->context()), 0, false);
@@ -421,8 +407,12 @@ public:
         return;
       }
 
+      // the literal can't be modified through an immutable/const pointer
+      Type *pointeeType = e->type->toBasetype()->nextOf();
+      const bool isConstant =
+          pointeeType->isImmutable() || pointeeType->isConst();
       auto globalVar = new llvm::GlobalVariable(
-          p->module, DtoType(se->type), false,
+          p->module, DtoType(se->type), isConstant,
           llvm::GlobalValue::InternalLinkage, nullptr, ".structliteral");
       globalVar->setAlignment(DtoAlignment(se->type));
 
@@ -516,11 +506,14 @@ public:
     }
 
     bool canBeConst = e->type->isConst() || e->type->isImmutable();
-    auto gvar = new llvm::GlobalVariable(
-        gIR->module, initval->getType(), canBeConst,
-        llvm::GlobalValue::InternalLinkage, initval, ".dynarrayStorage");
-    gvar->setUnnamedAddr(canBeConst ? llvm::GlobalValue::UnnamedAddr::Global
-                                    : llvm::GlobalValue::UnnamedAddr::None);
+    llvm::GlobalVariable *gvar;
+    if (canBeConst) {
+      gvar = p->getPooledConstant(initval, ".dynarrayStorage");
+    } else {
+      gvar = new llvm::GlobalVariable(gIR->module, initval->getType(), false,
+                                      llvm::GlobalValue::InternalLinkage,
+                                      initval, ".dynarrayStorage");
+    }
     llvm::Constant *store = DtoBitCast(gvar, getPtrToType(arrtype));
 
     if (bt->ty == Tpointer) {
@@ -9,6 +9,7 @@
 
 #include "attrib.h"
 #include "enum.h"
+#include "driver/cl_options_sanitizers.h"
 #include "gen/aa.h"
 #include "gen/abi.h"
 #include "gen/arrays.h"
@@ -31,6 +32,7 @@
 #include "gen/runtime.h"
 #include "gen/scope_exit.h"
 #include "gen/structs.h"
+#include "gen/tbaa.h"
 #include "gen/tollvm.h"
 #include "gen/typinf.h"
 #include "gen/warnings.h"
@@ -64,6 +66,60 @@ bool walkPostorder(Expression *e, StoppableVisitor *v);
 
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+/// Stops at subexpressions which must not be evaluated just for an
+/// llvm.assume, as they may call functions (possibly via druntime hooks) or
+/// allocate.
+struct AssumableConditionChecker : public StoppableVisitor {
+  using StoppableVisitor::visit;
+
+  void visit(Expression *) override {}
+  void visit(CallExp *) override { stop = true; }
+  void visit(NewExp *) override { stop = true; }
+  void visit(NewAnonClassExp *) override { stop = true; }
+  void visit(DeleteExp *) override { stop = true; }
+  void visit(ArrayLiteralExp *) override { stop = true; }
+  void visit(AssocArrayLiteralExp *) override { stop = true; }
+  void visit(CatExp *) override { stop = true; }
+  void visit(FuncExp *) override { stop = true; }
+  void visit(DelegateExp *) override { stop = true; }
+  void visit(InExp *) override { stop = true; }
+  void visit(AssertExp *) override { stop = true; }
+  void visit(HaltExp *) override { stop = true; }
+  void visit(IndexExp *e) override {
+    // associative array lookups are runtime calls
+    stop = e->e1->type->toBasetype()->ty == Taarray;
+  }
+  void visit(EqualExp *e) override { stop = isAggregateComparison(e); }
+  void visit(CmpExp *e) override { stop = isAggregateComparison(e); }
+
+  // Comparisons of arrays and aggregates may call druntime or opEquals/opCmp.
+  static bool isAggregateComparison(BinExp *e) {
+    switch (e->e1->type->toBasetype()->ty) {
+    case Tarray:
+    case Tsarray:
+    case Taarray:
+    case Tstruct:
+    case Tclass:
+      return true;
+    default:
+      return false;
+    }
+  }
+};
+}
+
+/// Returns whether the condition of an unchecked assert can be turned into an
+/// llvm.assume, i.e., whether it has no side effects and is cheap to evaluate.
+static bool isAssumableCondition(Expression *cond) {
+  if (cond->isConst() || hasSideEffect(cond))
+    return false;
+  AssumableConditionChecker checker;
+  return !walkPostorder(cond, &checker);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 static LLValue *write_zeroes(LLValue *mem, unsigned start, unsigned end) {
   mem = DtoBitCast(mem, getVoidPtrType());
   LLValue *gep = DtoGEPi1(mem, start, ".padding");
@@ -379,28 +435,12 @@ public:
 
     LLType *ct = DtoMemType(cty);
 
-    llvm::StringMap<llvm::GlobalVariable *> *stringLiteralCache =
-        stringLiteralCacheForType(cty);
     LLConstant *_init = buildStringLiteralConstant(e, true);
-    const auto at = _init->getType();
-
-    llvm::StringRef key(e->toChars());
-    llvm::GlobalVariable *gvar =
-        (stringLiteralCache->find(key) == stringLiteralCache->end())
-            ? nullptr
-            : (*stringLiteralCache)[key];
-    if (gvar == nullptr) {
-      llvm::GlobalValue::LinkageTypes _linkage =
-          llvm::GlobalValue::PrivateLinkage;
-      IF_LOG {
-        Logger::cout() << "type: " << *at << '\n';
-        Logger::cout() << "init: " << *_init << '\n';
-      }
-      gvar = new llvm::GlobalVariable(gIR->module, at, true, _linkage, _init,
-                                      ".str");
-      gvar->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
-      (*stringLiteralCache)[key] = gvar;
+    IF_LOG {
+      Logger::cout() << "type: " << *_init->getType() << '\n';
+      Logger::cout() << "init: " << *_init << '\n';
     }
+    llvm::GlobalVariable *gvar = p->getPooledConstant(_init, ".str");
 
     llvm::ConstantInt *zero =
         LLConstantInt::get(LLType::getInt32Ty(gIR->context()), 0, false);
@@ -509,6 +549,22 @@ public:
       return;
     }
 
+    // default initialization from the static initializer (`S s;`)
+    if (e->e1->type->toBasetype()->ty == Tstruct && e->e2->op == TOKvar &&
+        (e->op == TOKconstruct || e->op == TOKblit)) {
+      auto sdecl = static_cast<VarExp *>(e->e2)->var->isSymbolDeclaration();
+      TypeStruct *ts = static_cast<TypeStruct *>(e->e1->type->toBasetype());
+      if (sdecl && sdecl->dsym == ts->sym) {
+        DtoResolveStruct(ts->sym);
+        LLConstant *init = getIrAggr(ts->sym)->getDefaultInit();
+        if (DtoSparseInitialize(DtoLVal(lhs), init, 0,
+                                getTypeStoreSize(DtoType(ts)))) {
+          Logger::println("performing sparse aggregate initialization");
+          return;
+        }
+      }
+    }
+
     DValue *r = toElem(e->e2);
 
     if (e->e1->type->toBasetype()->ty == Tstruct && e->e2->op == TOKint64) {
@@ -1059,14 +1115,16 @@ public:
     p->arrays.pop_back();
 
     LLValue *arrptr = nullptr;
+    bool isUnionElement = false;
     if (e1type->ty == Tpointer) {
       arrptr = DtoGEP1(DtoRVal(l), DtoRVal(r), false);
     } else if (e1type->ty == Tsarray) {
       if (p->emitArrayBoundsChecks() && !e->indexIsInBounds) {
         DtoIndexBoundsCheck(e->loc, l, r);
       }
-      arrptr =
-          DtoGEP(DtoLVal(l), DtoConstUint(0), DtoRVal(r), e->indexIsInBounds);
+      LLValue *lval = DtoLVal(l);
+      isUnionElement = isTBAAUnionPointer(lval);
+      arrptr = DtoGEP(lval, DtoConstUint(0), DtoRVal(r), e->indexIsInBounds);
     } else if (e1type->ty == Tarray) {
       if (p->emitArrayBoundsChecks() && !e->indexIsInBounds) {
         DtoIndexBoundsCheck(e->loc, l, r);
@@ -1079,7 +1137,23 @@ public:
       IF_LOG Logger::println("e1type: %s", e1type->toChars());
       llvm_unreachable("Unknown IndexExp target.");
     }
-    result = new DLValue(e->type, DtoBitCast(arrptr, DtoPtrToType(e->type)));
+    arrptr = DtoBitCast(arrptr, DtoPtrToType(e->type));
+
+    // Elements of static arrays in unions may be type-punned.
+    if (isUnionElement) {
+      addTBAAUnionPointer(arrptr);
+    }
+
+    // The element of a bounds-checked array in @safe code is valid memory, so
+    // AddressSanitizer doesn't need to check its accesses.
+    if (e1type->ty != Tpointer &&
+        (p->emitArrayBoundsChecks() || e->indexIsInBounds) &&
+        opts::isSanitizerAddressSkipBoundsCheckedEnabled() &&
+        p->func()->decl->isSafe()) {
+      p->funcGen().validElementPointers.insert(arrptr);
+    }
+
+    result = new DLValue(e->type, arrptr);
   }
 
   //////////////////////////////////////////////////////////////////////////////
@@ -1130,9 +1204,6 @@ public:
           (etype->ty != Tpointer) && !e->upperIsInBounds;
       const bool needCheckLower = !e->lowerIsLessThanUpper;
       if (p->emitArrayBoundsChecks() && (needCheckUpper || needCheckLower)) {
-        llvm::BasicBlock *okbb = p->insertBB("bounds.ok");
-        llvm::BasicBlock *failbb = p->insertBBAfter(okbb, "bounds.fail");
-
         llvm::Value *okCond = nullptr;
         if (needCheckUpper) {
           okCond = p->ir->CreateICmp(llvm::ICmpInst::ICMP_ULE, vup,
@@ -1149,12 +1220,7 @@ public:
           }
         }
 
-        p->ir->CreateCondBr(okCond, okbb, failbb);
-
-        p->scope() = IRScope(failbb);
-        DtoBoundsCheckFailCall(p, e->loc);
-
-        p->scope() = IRScope(okbb);
+        DtoBoundsCheckBranch(e->loc, okCond);
       }
 
       // offset by lower
@@ -1641,8 +1707,17 @@ public:
     auto &PGO = gIR->funcGen().pgo;
     PGO.setCurrentStmt(e);
 
-    if (global.params.useAssert != CHECKENABLEon)
+    if (global.params.useAssert != CHECKENABLEon) {
+      // -fassume-asserts: let the optimizer rely on the condition instead
+      if (global.params.assumeAsserts && isOptimizationEnabled() &&
+          isAssumableCondition(e->e1)) {
+        Logger::println("emitting assumption");
+        DValue *cond = toElemDtor(e->e1);
+        LLValue *condval = DtoRVal(DtoCast(e->loc, cond, Type::tbool));
+        p->ir->CreateCall(GET_INTRINSIC_DECL(assume), condval);
+      }
       return;
+    }
 
     // condition
     DValue *cond;
@@ -1693,6 +1768,23 @@ public:
       if (sym->isInterfaceDeclaration() || sym->isCPPclass())
         return;
 
+      // The dynamic type of an instance of a final class is known, so call the
+      // invariants of the class and its bases directly, in the same order as
+      // druntime's _d_invariant() walking the ClassInfos.
+      if (sym->storage_class & STCfinal) {
+        Logger::println("calling final class invariants directly");
+        LLValue *obj = DtoRVal(cond);
+        for (auto cd = sym; cd; cd = cd->baseClass) {
+          if (!cd->inv)
+            continue;
+          DtoResolveFunction(cd->inv);
+          DFuncValue invFunc(cd->inv, DtoCallee(cd->inv),
+                             DtoBitCast(obj, DtoType(cd->type)));
+          DtoCallFunction(e->loc, nullptr, &invFunc, nullptr);
+        }
+        return;
+      }
+
       Logger::println("calling class invariant");
 
       const auto fnMangle =
@@ -2117,7 +2209,11 @@ public:
       DtoStore(DtoRVal(slice), DtoLVal(result));
     } else {
       // append element
-      DtoCatAssignElement(e->loc, result, e->e2);
+      VarDeclaration *arrayVar =
+          e->e1->op == TOKvar
+              ? static_cast<VarExp *>(e->e1)->var->isVarDeclaration()
+              : nullptr;
+      DtoCatAssignElement(e->loc, result, e->e2, arrayVar);
     }
   }
 
@@ -2133,10 +2229,12 @@ public:
       fd->vthis = nullptr;
     }
 
-    if (fd->isNested()) {
-      Logger::println("nested");
+    IF_LOG {
+      if (fd->isNested()) {
+        Logger::println("nested");
+      }
+      Logger::println("kind = %s", fd->kind());
     }
-    Logger::println("kind = %s", fd->kind());
 
     // We need to actually codegen the function here, as literals are not added
     // to the module member list.
@@ -2235,9 +2333,7 @@ public:
     } else if (dyn) {
       if (arrayType->isImmutable() && isConstLiteral(e, true)) {
         llvm::Constant *init = arrayLiteralToConst(p, e);
-        auto global = new llvm::GlobalVariable(
-            gIR->module, init->getType(), true,
-            llvm::GlobalValue::InternalLinkage, init, ".immutablearray");
+        auto global = p->getPooledConstant(init, ".immutablearray");
         result = new DSliceValue(arrayType, DtoConstSize_t(len),
                                  DtoBitCast(global, getPtrToType(llElemType)));
       } else {
@@ -2280,7 +2376,10 @@ public:
         dstMem = DtoAlloca(e->type, ".structliteral");
 
       assert(dstMem->getType() == initsym->getType());
-      DtoMemCpy(dstMem, initsym);
+      if (!DtoSparseInitialize(dstMem, getIrAggr(e->sd)->getDefaultInit(), 0,
+                               getTypeStoreSize(DtoType(e->type)))) {
+        DtoMemCpy(dstMem, initsym);
+      }
       return new DLValue(e->type, dstMem);
     }
 
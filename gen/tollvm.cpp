@@ -14,12 +14,14 @@
 #include "id.h"
 #include "init.h"
 #include "module.h"
+#include "driver/cl_options_sanitizers.h"
 #include "gen/abi.h"
 #include "gen/arrays.h"
 #include "gen/classes.h"
 #include "gen/complex.h"
 #include "gen/dvalue.h"
 #include "gen/functions.h"
+#include "gen/funcgenstate.h"
 #include "gen/irstate.h"
 #include "gen/linkage.h"
 #include "gen/llvm.h"
@@ -34,6 +36,9 @@
 #include "ir/irtypeclass.h"
 #include "ir/irtypefunction.h"
 #include "ir/irtypestruct.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/MathExtras.h"
+#include <algorithm>
 
 bool DtoIsInMemoryOnly(Type *type) {
   Type *typ = type->toBasetype();
@@ -58,7 +63,64 @@ LLAttribute DtoShouldExtend(Type *type) {
   return LLAttribute::None;
 }
 
+namespace {
+// The results of DtoType(), DtoMemType() and DtoPtrToType(), indexed by the
+// (unstripped) D type. Saves stripping the modifiers, the virtual IrType
+// lookup and the LLVMContext type uniquing on every call.
+struct CachedLLTypes {
+  LLType *type = nullptr;
+  LLType *memType = nullptr;
+  LLPointerType *ptrType = nullptr;
+};
+
+llvm::DenseMap<Type *, CachedLLTypes> llTypeCache;
+unsigned llTypeCacheEpoch = 0;
+
+// The cached LLVM types refer to the current IrTypes, i.e., LLVMContext.
+CachedLLTypes &getCachedLLTypes(Type *t) {
+  if (llTypeCacheEpoch != IrType::getEpoch()) {
+    llTypeCache.clear();
+    llTypeCacheEpoch = IrType::getEpoch();
+  }
+  return llTypeCache[t];
+}
+
+LLType *buildType(Type *t);
+}
+
 LLType *DtoType(Type *t) {
+  CachedLLTypes &cached = getCachedLLTypes(t);
+  if (!cached.type) {
+    // buildType() may recurse and invalidate the reference.
+    LLType *type = buildType(t);
+    getCachedLLTypes(t).type = type;
+    return type;
+  }
+  return cached.type;
+}
+
+LLType *DtoMemType(Type *t) {
+  CachedLLTypes &cached = getCachedLLTypes(t);
+  if (!cached.memType) {
+    LLType *memType = i1ToI8(voidToI8(DtoType(t)));
+    getCachedLLTypes(t).memType = memType;
+    return memType;
+  }
+  return cached.memType;
+}
+
+LLPointerType *DtoPtrToType(Type *t) {
+  CachedLLTypes &cached = getCachedLLTypes(t);
+  if (!cached.ptrType) {
+    LLPointerType *ptrType = DtoMemType(t)->getPointerTo();
+    getCachedLLTypes(t).ptrType = ptrType;
+    return ptrType;
+  }
+  return cached.ptrType;
+}
+
+namespace {
+LLType *buildType(Type *t) {
   t = stripModifiers(t);
 
   if (t->ctype) {
@@ -179,10 +241,7 @@ LLType *DtoType(Type *t) {
   }
   return nullptr;
 }
-
-LLType *DtoMemType(Type *t) { return i1ToI8(voidToI8(DtoType(t))); }
-
-LLPointerType *DtoPtrToType(Type *t) { return DtoMemType(t)->getPointerTo(); }
+}
 
 LLType *voidToI8(LLType *t) {
   if (t == LLType::getVoidTy(gIR->context())) {
@@ -254,22 +313,17 @@ void setLinkage(Dsymbol *sym, llvm::GlobalObject *obj) {
 ////////////////////////////////////////////////////////////////////////////////
 
 LLIntegerType *DtoSize_t() {
-  // the type of size_t does not change once set
-  static LLIntegerType *t = nullptr;
-  if (t == nullptr) {
-    auto triple = global.params.targetTriple;
-
-    if (triple->isArch64Bit()) {
-      t = LLType::getInt64Ty(gIR->context());
-    } else if (triple->isArch32Bit()) {
-      t = LLType::getInt32Ty(gIR->context());
-    } else if (triple->isArch16Bit()) {
-      t = LLType::getInt16Ty(gIR->context());
-    } else {
-      llvm_unreachable("Unsupported size_t width");
-    }
+  // Not cached, as the context may change between modules.
+  auto triple = global.params.targetTriple;
+
+  if (triple->isArch64Bit()) {
+    return LLType::getInt64Ty(gIR->context());
+  } else if (triple->isArch32Bit()) {
+    return LLType::getInt32Ty(gIR->context());
+  } else if (triple->isArch16Bit()) {
+    return LLType::getInt16Ty(gIR->context());
   }
-  return t;
+  llvm_unreachable("Unsupported size_t width");
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -363,6 +417,107 @@ void DtoMemCpy(LLValue *dst, LLValue *src, bool withPadding, unsigned align) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+using ScalarInits = llvm::SmallVector<std::pair<uint64_t, LLConstant *>, 16>;
+
+// Collects the non-zero scalars of c (at the given offset) overlapping
+// [begin, end). Returns false if there are more than maxScalars or some
+// scalar straddles a bound.
+bool collectNonZeroScalars(LLConstant *c, uint64_t offset, uint64_t begin,
+                           uint64_t end, size_t maxScalars,
+                           ScalarInits &scalars) {
+  if (c->isNullValue() || llvm::isa<llvm::UndefValue>(c)) {
+    return true;
+  }
+  LLType *type = c->getType();
+  const uint64_t size = getTypeStoreSize(type);
+  if (offset + size <= begin || offset >= end) {
+    return true;
+  }
+
+  if (auto st = llvm::dyn_cast<LLStructType>(type)) {
+    const llvm::StructLayout *layout = gDataLayout->getStructLayout(st);
+    for (unsigned i = 0, n = st->getNumElements(); i < n; ++i) {
+      LLConstant *elem = c->getAggregateElement(i);
+      if (!elem ||
+          !collectNonZeroScalars(elem, offset + layout->getElementOffset(i),
+                                 begin, end, maxScalars, scalars)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (auto at = llvm::dyn_cast<LLArrayType>(type)) {
+    const uint64_t elemSize = getTypeAllocSize(at->getElementType());
+    for (uint64_t i = 0, n = at->getNumElements(); i < n; ++i) {
+      LLConstant *elem = c->getAggregateElement(static_cast<unsigned>(i));
+      if (!elem || !collectNonZeroScalars(elem, offset + i * elemSize, begin,
+                                          end, maxScalars, scalars)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (offset < begin || offset + size > end || scalars.size() == maxScalars) {
+    return false;
+  }
+  scalars.push_back(std::make_pair(offset, c));
+  return true;
+}
+
+// Each store needs to save at least 64 bytes of copying.
+size_t getMaxSparseStores(uint64_t begin, uint64_t end) {
+  return static_cast<size_t>(std::min<uint64_t>((end - begin) / 64, 16));
+}
+}
+
+bool canSparseInitialize(LLConstant *init, uint64_t begin, uint64_t end) {
+  ScalarInits scalars;
+  return begin >= end ||
+         collectNonZeroScalars(init, 0, begin, end,
+                               getMaxSparseStores(begin, end), scalars);
+}
+
+bool DtoSparseInitialize(LLValue *dst, LLConstant *init, uint64_t begin,
+                         uint64_t end, bool isZeroed) {
+  if (begin >= end) {
+    return true;
+  }
+
+  ScalarInits scalars;
+  if (!collectNonZeroScalars(init, 0, begin, end,
+                             getMaxSparseStores(begin, end), scalars)) {
+    return false;
+  }
+
+  IF_LOG Logger::println("Sparse initialization: %llu bytes, %u stores",
+                         static_cast<unsigned long long>(end - begin),
+                         static_cast<unsigned>(scalars.size()));
+
+  const unsigned baseAlign = gDataLayout->getABITypeAlignment(init->getType());
+  LLValue *base = DtoBitCast(dst, getVoidPtrType());
+  if (!isZeroed) {
+    DtoMemSetZero(DtoGEP1(base, DtoConstSize_t(begin), true),
+                  DtoConstSize_t(end - begin),
+                  static_cast<unsigned>(llvm::MinAlign(baseAlign, begin)));
+  }
+  for (const auto &scalar : scalars) {
+    LLType *type = scalar.second->getType();
+    LLValue *ptr =
+        DtoBitCast(DtoGEP1(base, DtoConstSize_t(scalar.first), true),
+                   type->getPointerTo());
+    const unsigned align = static_cast<unsigned>(llvm::MinAlign(
+        std::min(gDataLayout->getABITypeAlignment(type), baseAlign),
+        scalar.first));
+    gIR->ir->CreateAlignedStore(scalar.second, ptr, align);
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 LLValue *DtoMemCmp(LLValue *lhs, LLValue *rhs, LLValue *nbytes) {
   // int memcmp ( const void * ptr1, const void * ptr2, size_t num );
 
@@ -423,19 +578,9 @@ LLConstant *DtoConstFP(Type *t, const real_t value) {
 LLConstant *DtoConstCString(const char *str) {
   llvm::StringRef s(str ? str : "");
 
-  const auto it = gIR->stringLiteral1ByteCache.find(s);
-  llvm::GlobalVariable *gvar =
-      it == gIR->stringLiteral1ByteCache.end() ? nullptr : it->getValue();
-
-  if (gvar == nullptr) {
-    llvm::Constant *init =
-        llvm::ConstantDataArray::getString(gIR->context(), s, true);
-    gvar = new llvm::GlobalVariable(gIR->module, init->getType(), true,
-                                    llvm::GlobalValue::PrivateLinkage, init,
-                                    ".str");
-    gvar->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
-    gIR->stringLiteral1ByteCache[s] = gvar;
-  }
+  llvm::Constant *init =
+      llvm::ConstantDataArray::getString(gIR->context(), s, true);
+  llvm::GlobalVariable *gvar = gIR->getPooledConstant(init, ".str");
 
   LLConstant *idxs[] = {DtoConstUint(0), DtoConstUint(0)};
   return llvm::ConstantExpr::getGetElementPtr(gvar->getInitializer()->getType(),
@@ -450,8 +595,21 @@ LLConstant *DtoConstString(const char *str) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+// Excludes accesses of array elements known to be valid from the
+// AddressSanitizer instrumentation, see IndexExp.
+template <typename T> T *skipSanitizerIfValid(T *access, LLValue *ptr) {
+  if (opts::isSanitizerAddressSkipBoundsCheckedEnabled() &&
+      !gIR->funcGenStates.empty() &&
+      gIR->funcGen().validElementPointers.count(ptr)) {
+    access->setMetadata("nosanitize", llvm::MDNode::get(gIR->context(), {}));
+  }
+  return access;
+}
+}
+
 LLValue *DtoLoad(LLValue *src, const char *name) {
-  return gIR->ir->CreateLoad(src, name);
+  return skipSanitizerIfValid(gIR->ir->CreateLoad(src, name), src);
 }
 
 // Like DtoLoad, but the pointer is guaranteed to be aligned appropriately for
@@ -459,7 +617,7 @@ LLValue *DtoLoad(LLValue *src, const char *name) {
 LLValue *DtoAlignedLoad(LLValue *src, const char *name) {
   llvm::LoadInst *ld = gIR->ir->CreateLoad(src, name);
   ld->setAlignment(getABITypeAlign(ld->getType()));
-  return ld;
+  return skipSanitizerIfValid(ld, src);
 }
 
 LLValue *DtoVolatileLoad(LLValue *src, const char *name) {
@@ -468,10 +626,10 @@ LLValue *DtoVolatileLoad(LLValue *src, const char *name) {
   return ld;
 }
 
-void DtoStore(LLValue *src, LLValue *dst) {
+llvm::StoreInst *DtoStore(LLValue *src, LLValue *dst) {
   assert(src->getType() != llvm::Type::getInt1Ty(gIR->context()) &&
          "Should store bools as i8 instead of i1.");
-  gIR->ir->CreateStore(src, dst);
+  return skipSanitizerIfValid(gIR->ir->CreateStore(src, dst), dst);
 }
 
 void DtoVolatileStore(LLValue *src, LLValue *dst) {
@@ -480,13 +638,13 @@ void DtoVolatileStore(LLValue *src, LLValue *dst) {
   gIR->ir->CreateStore(src, dst)->setVolatile(true);
 }
 
-void DtoStoreZextI8(LLValue *src, LLValue *dst) {
+llvm::StoreInst *DtoStoreZextI8(LLValue *src, LLValue *dst) {
   if (src->getType() == llvm::Type::getInt1Ty(gIR->context())) {
     llvm::Type *i8 = llvm::Type::getInt8Ty(gIR->context());
     assert(dst->getType()->getContainedType(0) == i8);
     src = gIR->ir->CreateZExt(src, i8);
   }
-  gIR->ir->CreateStore(src, dst);
+  return skipSanitizerIfValid(gIR->ir->CreateStore(src, dst), dst);
 }
 
 // Like DtoStore, but the pointer is guaranteed to be aligned appropriately for
@@ -496,6 +654,7 @@ void DtoAlignedStore(LLValue *src, LLValue *dst) {
          "Should store bools as i8 instead of i1.");
   llvm::StoreInst *st = gIR->ir->CreateStore(src, dst);
   st->setAlignment(getABITypeAlign(src->getType()));
+  skipSanitizerIfValid(st, dst);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
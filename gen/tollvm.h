@@ -105,9 +105,9 @@ LLConstant *DtoConstBool(bool);
 LLValue *DtoLoad(LLValue *src, const char *name = "");
 LLValue *DtoVolatileLoad(LLValue *src, const char *name = "");
 LLValue *DtoAlignedLoad(LLValue *src, const char *name = "");
-void DtoStore(LLValue *src, LLValue *dst);
+llvm::StoreInst *DtoStore(LLValue *src, LLValue *dst);
 void DtoVolatileStore(LLValue *src, LLValue *dst);
-void DtoStoreZextI8(LLValue *src, LLValue *dst);
+llvm::StoreInst *DtoStoreZextI8(LLValue *src, LLValue *dst);
 void DtoAlignedStore(LLValue *src, LLValue *dst);
 LLValue *DtoBitCast(LLValue *v, LLType *t, const llvm::Twine &name = "");
 LLConstant *DtoBitCast(LLConstant *v, LLType *t);
@@ -200,6 +200,28 @@ void DtoMemCpy(LLValue *dst, LLValue *src, LLValue *nbytes, unsigned align = 1);
 void DtoMemCpy(LLValue *dst, LLValue *src, bool withPadding = false,
                unsigned align = 1);
 
+/**
+ * Initializes the bytes [begin, end) of the memory at dst, laid out like the
+ * constant init, by zeroing them and storing the few non-zero scalars of init.
+ * This is cheaper than copying large, mostly zero initializers from their
+ * global.
+ * @param dst Destination memory.
+ * @param init The initializer constant.
+ * @param begin Offset of the first byte to initialize.
+ * @param end Offset past the last byte to initialize.
+ * @param isZeroed Whether the memory is known to be zeroed already.
+ * @return false, without emitting anything, if init has too many non-zero
+ * scalars for this to pay off.
+ */
+bool DtoSparseInitialize(LLValue *dst, LLConstant *init, uint64_t begin,
+                         uint64_t end, bool isZeroed = false);
+
+/**
+ * Whether DtoSparseInitialize() would initialize the bytes [begin, end) with
+ * the constant init.
+ */
+bool canSparseInitialize(LLConstant *init, uint64_t begin, uint64_t end);
+
 /**
  * Generates a call to C memcmp.
  */
@@ -21,6 +21,7 @@
 #include "gen/tollvm.h"
 #include "ir/irfunction.h"
 #include "ir/irtypeclass.h"
+#include "llvm/Support/CommandLine.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -329,10 +330,42 @@ void TryCatchScope::emitCatchBodiesMSVC(IRState &irs, llvm::Value *) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+namespace {
+llvm::cl::opt<unsigned> cleanupCopyLimit(
+    "cleanup-copy-limit", llvm::cl::ZeroOrMore, llvm::cl::Hidden,
+    llvm::cl::desc("MSVC: Copy cleanups of at most <n> instructions for each "
+                   "normal exit target instead of sharing them via a branch "
+                   "selector"),
+    llvm::cl::value_desc("n"), llvm::cl::init(8));
+
+size_t countInstructions(const std::vector<llvm::BasicBlock *> &blocks) {
+  size_t count = 0;
+  for (llvm::BasicBlock *bb : blocks) {
+    for (llvm::Instruction &inst : *bb) {
+      if (!llvm::isa<llvm::DbgInfoIntrinsic>(inst))
+        ++count;
+    }
+  }
+  return count;
+}
+
+/// Stores the branch selector value at the end of the source block, i.e.,
+/// before its terminator if it already has one.
+void storeBranchSelector(unsigned value, llvm::AllocaInst *branchSelector,
+                         llvm::BasicBlock *sourceBlock) {
+  if (auto terminator = sourceBlock->getTerminator()) {
+    new llvm::StoreInst(DtoConstUint(value), branchSelector, terminator);
+  } else {
+    new llvm::StoreInst(DtoConstUint(value), branchSelector, sourceBlock);
+  }
+}
+}
+
 CleanupScope::CleanupScope(llvm::BasicBlock *beginBlock,
                            llvm::BasicBlock *endBlock) {
   if (useMSVCEH()) {
     findSuccessors(blocks, beginBlock, endBlock);
+    copyForNormalExits = countInstructions(blocks) <= cleanupCopyLimit;
     return;
   }
   blocks.push_back(beginBlock);
@@ -344,19 +377,32 @@ llvm::BasicBlock *CleanupScope::run(IRState &irs, llvm::BasicBlock *sourceBlock,
                                     llvm::BasicBlock *continueWith) {
   if (useMSVCEH())
     return runCopying(irs, sourceBlock, continueWith);
+  return runShared(irs, sourceBlock, continueWith, exitTargets);
+}
 
-  if (exitTargets.empty() || (exitTargets.size() == 1 &&
-                              exitTargets[0].branchTarget == continueWith)) {
+llvm::BasicBlock *
+CleanupScope::runShared(IRState &irs, llvm::BasicBlock *sourceBlock,
+                        llvm::BasicBlock *continueWith,
+                        std::vector<CleanupExitTarget> &targets) {
+  if (targets.empty() ||
+      (targets.size() == 1 && targets[0].branchTarget == continueWith)) {
     // We didn't need a branch selector before and still don't need one.
     assert(!branchSelector);
 
     // Set up the unconditional branch at the end of the cleanup if we have
-    // not done so already.
-    if (exitTargets.empty()) {
-      exitTargets.emplace_back(continueWith);
-      llvm::BranchInst::Create(continueWith, endBlock());
+    // not done so already. With MSVC, a branch may have been set up by a
+    // copy for unwinding (see runCopying()).
+    if (targets.empty()) {
+      targets.emplace_back(continueWith);
+      if (auto term = endBlock()->getTerminator()) {
+        llvm::BasicBlock *succ = term->getSuccessor(0);
+        if (succ != continueWith)
+          remapBlocksValue(blocks, succ, continueWith);
+      } else {
+        llvm::BranchInst::Create(continueWith, endBlock());
+      }
     }
-    exitTargets.front().sourceBlocks.push_back(sourceBlock);
+    targets.front().sourceBlocks.push_back(sourceBlock);
     return beginBlock();
   }
 
@@ -373,8 +419,8 @@ llvm::BasicBlock *CleanupScope::run(IRState &irs, llvm::BasicBlock *sourceBlock,
 
     // Now we also need to store 0 to it to keep the paths that go to the
     // only existing branch target the same.
-    for (auto bb : exitTargets.front().sourceBlocks) {
-      new llvm::StoreInst(DtoConstUint(0), branchSelector, bb->getTerminator());
+    for (auto bb : targets.front().sourceBlocks) {
+      storeBranchSelector(0, branchSelector, bb);
     }
 
     // And convert the BranchInst to the existing branch target to a
@@ -382,7 +428,7 @@ llvm::BasicBlock *CleanupScope::run(IRState &irs, llvm::BasicBlock *sourceBlock,
     endBlock()->getTerminator()->eraseFromParent();
     llvm::Value *sel = new llvm::LoadInst(branchSelector, "", endBlock());
     llvm::SwitchInst::Create(
-        sel, exitTargets[0].branchTarget,
+        sel, targets[0].branchTarget,
         1, // Expected number of branches, only for pre-allocating.
         endBlock());
   }
@@ -390,11 +436,10 @@ llvm::BasicBlock *CleanupScope::run(IRState &irs, llvm::BasicBlock *sourceBlock,
   // If we already know this branch target, figure out the branch selector
   // value and simply insert the store into the source block (prior to the
   // last instruction, which is the branch to the first cleanup).
-  for (unsigned i = 0; i < exitTargets.size(); ++i) {
-    CleanupExitTarget &t = exitTargets[i];
+  for (unsigned i = 0; i < targets.size(); ++i) {
+    CleanupExitTarget &t = targets[i];
     if (t.branchTarget == continueWith) {
-      new llvm::StoreInst(DtoConstUint(i), branchSelector,
-                          sourceBlock->getTerminator());
+      storeBranchSelector(i, branchSelector, sourceBlock);
 
       // Note: Strictly speaking, keeping this up to date would not be
       // needed right now, because we never to any optimizations that
@@ -408,18 +453,17 @@ llvm::BasicBlock *CleanupScope::run(IRState &irs, llvm::BasicBlock *sourceBlock,
   }
 
   // We don't know this branch target yet, so add it to the SwitchInst...
-  llvm::ConstantInt *const selectorVal = DtoConstUint(exitTargets.size());
+  const unsigned selectorVal = targets.size();
   llvm::cast<llvm::SwitchInst>(endBlock()->getTerminator())
-      ->addCase(selectorVal, continueWith);
+      ->addCase(DtoConstUint(selectorVal), continueWith);
 
   // ... insert the store into the source block...
-  new llvm::StoreInst(selectorVal, branchSelector,
-                      sourceBlock->getTerminator());
+  storeBranchSelector(selectorVal, branchSelector, sourceBlock);
 
   // ... and keep track of it (again, this is unnecessary right now as
   // discussed in the above note).
-  exitTargets.emplace_back(continueWith);
-  exitTargets.back().sourceBlocks.push_back(sourceBlock);
+  targets.emplace_back(continueWith);
+  targets.back().sourceBlocks.push_back(sourceBlock);
 
   return beginBlock();
 }
@@ -431,7 +475,9 @@ llvm::BasicBlock *CleanupScope::runCopying(IRState &irs,
                                            llvm::Value *funclet) {
   if (isCatchSwitchBlock(beginBlock()))
     return continueWith;
-  if (exitTargets.empty()) {
+  if (!unwindTo && !funclet && !copyForNormalExits)
+    return runShared(irs, sourceBlock, continueWith, sharedExitTargets);
+  if (exitTargets.empty() && sharedExitTargets.empty()) {
     if (!endBlock()->getTerminator())
       // Set up the unconditional branch at the end of the cleanup
       llvm::BranchInst::Create(continueWith, endBlock());
@@ -471,6 +517,17 @@ llvm::BasicBlock *CleanupScope::runCopying(IRState &irs,
     // clone the code
     cloneBlocks(blocks, exitTarget.cleanupBlocks, continueWith, unwindTo,
                 funclet);
+
+    // A copy of shared code leaves via the branch selector switch, continue
+    // with the given target instead.
+    llvm::BasicBlock *copyEnd = exitTarget.cleanupBlocks.back();
+    if (auto sw = llvm::dyn_cast<llvm::SwitchInst>(copyEnd->getTerminator())) {
+      auto sel = llvm::cast<llvm::Instruction>(sw->getCondition());
+      sw->eraseFromParent();
+      if (sel->use_empty())
+        sel->eraseFromParent();
+      llvm::BranchInst::Create(continueWith, copyEnd);
+    }
   }
   return exitTarget.cleanupBlocks.front();
 }
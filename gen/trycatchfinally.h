@@ -101,8 +101,11 @@ public:
 
   /// MSVC uses C++ exception handling that puts cleanup blocks into funclets.
   /// This means that we cannot use a branch selector and conditional branches
-  /// at cleanup exit to continue with different targets.
-  /// Instead we make a full copy of the cleanup code for every target.
+  /// at cleanup exit to continue with different targets when unwinding.
+  /// Instead we make a full copy of the cleanup code for every funclet. The
+  /// normal (non-unwinding) exits share the original cleanup code and a
+  /// branch selector, unless the cleanup is small enough to be copied for
+  /// every target as well.
   llvm::BasicBlock *runCopying(IRState &irs, llvm::BasicBlock *sourceBlock,
                                llvm::BasicBlock *continueWith,
                                llvm::BasicBlock *unwindTo = nullptr,
@@ -114,6 +117,10 @@ public:
 private:
   std::vector<llvm::BasicBlock *> blocks;
 
+  /// MSVC: Whether the normal exits copy the cleanup code instead of sharing
+  /// it, decided by the cleanup size.
+  bool copyForNormalExits = false;
+
   /// The branch selector variable, or null if not created yet.
   llvm::AllocaInst *branchSelector = nullptr;
 
@@ -145,6 +152,17 @@ private:
   // complexity-wise. However, situations where this matters should be
   // exceedingly rare in both hand-written as well as generated code.
   std::vector<CleanupExitTarget> exitTargets;
+
+  /// MSVC: The targets of the normal exits sharing the original cleanup code,
+  /// indexed by branch selector value (the copies are in exitTargets).
+  std::vector<CleanupExitTarget> sharedExitTargets;
+
+  /// Makes the original cleanup code continue with the given target when
+  /// entered from the source block, switching on the branch selector if
+  /// there are multiple targets. Returns the block to branch to.
+  llvm::BasicBlock *runShared(IRState &irs, llvm::BasicBlock *sourceBlock,
+                              llvm::BasicBlock *continueWith,
+                              std::vector<CleanupExitTarget> &targets);
 };
 
 ////////////////////////////////////////////////////////////////////////////////
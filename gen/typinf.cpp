@@ -655,6 +655,36 @@ void TypeInfoDeclaration_codegen(TypeInfoDeclaration *decl, IRState *p) {
   decl->accept(&v);
 
   setLinkage({TYPEINFO_LINKAGE_TYPE, supportsCOMDAT()}, gvar);
+  p->typeInfoDefinitions.emplace_back(gvar);
+}
+
+void eraseUnreferencedTypeInfos(IRState &irs) {
+  // TypeInfos refer to each other, so repeat until nothing changes.
+  unsigned numErased = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto &vh : irs.typeInfoDefinitions) {
+      auto gvar = llvm::dyn_cast_or_null<llvm::GlobalVariable>(vh);
+      if (!gvar || !gvar->isDiscardableIfUnused())
+        continue;
+      gvar->removeDeadConstantUsers();
+      if (!gvar->use_empty())
+        continue;
+      // Drop the metadata for the optimizer passes too, see emitTypeMetadata().
+      std::string metaname = TD_PREFIX;
+      metaname += gvar->getName();
+      if (auto meta = irs.module.getNamedMetadata(metaname))
+        meta->eraseFromParent();
+      gvar->eraseFromParent();
+      ++numErased;
+      changed = true;
+    }
+  }
+  irs.typeInfoDefinitions.clear();
+
+  IF_LOG Logger::println("Erased %u unreferenced TypeInfo definitions",
+                         numErased);
 }
 
 /* ========================================================================= */
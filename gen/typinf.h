@@ -27,6 +27,12 @@ TypeInfoDeclaration *getOrCreateTypeInfoDeclaration(const Loc &loc, Type *t,
 void TypeInfoDeclaration_codegen(TypeInfoDeclaration *decl, IRState *p);
 void TypeInfoClassDeclaration_codegen(TypeInfoDeclaration *decl, IRState *p);
 
+/// Erases the TypeInfo definitions which nothing in the finished module refers
+/// to. Every module referencing a TypeInfo emits its own linkonce_odr copy, so
+/// unreferenced ones would only be discarded by the optimizer (or not at all
+/// with -O0).
+void eraseUnreferencedTypeInfos(IRState &irs);
+
 // defined in dmd/typinf.d:
 bool isSpeculativeType(Type *t);
 
@@ -3,6 +3,7 @@
 #include "gen/irstate.h"
 #include "gen/llvm.h"
 #include "gen/llvmhelpers.h"
+#include "gen/targetclones.h"
 #include "aggregate.h"
 #include "attrib.h"
 #include "declaration.h"
@@ -280,6 +281,16 @@ void applyAttrOptStrategy(StructLiteralExp *sle, IrFunction *irFunc) {
     func->addFnAttr(llvm::Attribute::OptimizeForSize);
   } else if (value == "minsize") {
     func->addFnAttr(llvm::Attribute::MinSize);
+  } else if (value == "hot") {
+    // loops and callees are annotated after the body has been generated
+    irFunc->hot = true;
+  } else if (value == "cold") {
+    func->addFnAttr(llvm::Attribute::Cold);
+    func->addFnAttr(llvm::Attribute::OptimizeForSize);
+#if LDC_LLVM_VER >= 400
+    // .text.unlikely on ELF
+    func->setSectionPrefix(".unlikely");
+#endif
   } else {
     sle->warning(
         "ignoring unrecognized parameter `%s` for `@ldc.attributes.%s`",
@@ -361,6 +372,48 @@ void applyAttrTarget(StructLiteralExp *sle, llvm::Function *func, IrFunction *ir
   }
 }
 
+// @targetClones("avx512f", "avx2", "default")
+void applyAttrTargetClones(StructLiteralExp *sle, IrFunction *irFunc) {
+  checkStructElems(sle, {Type::tstring->arrayOf()});
+
+  bool hasDefault = false;
+  auto specs = (*sle->elements)[0];
+  if (specs->op == TOKarrayliteral) {
+    auto ale = static_cast<ArrayLiteralExp *>(specs);
+    for (size_t i = 0; i < ale->elements->dim; ++i) {
+      auto e = ale->getElement(i);
+      if (e->op != TOKstring)
+        continue;
+      llvm::StringRef spec =
+          llvm::StringRef(static_cast<StringExp *>(e)->toStringz()).trim();
+      if (spec == "default") {
+        hasDefault = true;
+        continue;
+      }
+      if (spec.empty()) {
+        sle->error("empty target specification for `@ldc.attributes.%s`",
+                   sle->sd->ident->toChars());
+        continue;
+      }
+      llvm::StringRef unsupported = findUnsupportedCloneFeature(spec);
+      if (!unsupported.empty()) {
+        sle->error("unsupported target feature `%.*s` for "
+                   "`@ldc.attributes.%s`",
+                   static_cast<int>(unsupported.size()), unsupported.data(),
+                   sle->sd->ident->toChars());
+        continue;
+      }
+      irFunc->targetClones.push_back(spec.str());
+    }
+  }
+
+  if (!hasDefault) {
+    sle->error("`@ldc.attributes.%s` requires a `\"default\"` version",
+               sle->sd->ident->toChars());
+    irFunc->targetClones.clear();
+  }
+}
+
 void applyAttrAssumeUsed(IRState &irs, StructLiteralExp *sle, llvm::Constant *symbol) {
   checkStructElems(sle, {});
   irs.usedArray.push_back(symbol);
@@ -382,7 +435,8 @@ void applyVarDeclUDAs(VarDeclaration *decl, llvm::GlobalVariable *gvar) {
     auto ident = sle->sd->ident;
     if (ident == Id::udaSection) {
       applyAttrSection(sle, gvar);
-    } else if (ident == Id::udaOptStrategy || ident == Id::udaTarget) {
+    } else if (ident == Id::udaOptStrategy || ident == Id::udaTarget ||
+               ident == Id::udaTargetClones) {
       sle->error(
           "Special attribute `ldc.attributes.%s` is only valid for functions",
           ident->toChars());
@@ -397,6 +451,10 @@ void applyVarDeclUDAs(VarDeclaration *decl, llvm::GlobalVariable *gvar) {
           ident->toChars());
     } else if (ident == Id::udaDynamicCompileConst) {
       getIrGlobal(decl)->dynamicCompileConst = true;
+    } else if (ident == Id::udaAssumeAligned) {
+      sle->error("Special attribute `ldc.attributes.%s` is only valid for "
+                 "parameters and local variables",
+                 ident->toChars());
     } else {
       sle->warning(
           "Ignoring unrecognized special attribute `ldc.attributes.%s`",
@@ -432,6 +490,8 @@ void applyFuncDeclUDAs(FuncDeclaration *decl, IrFunction *irFunc) {
       applyAttrSection(sle, func);
     } else if (ident == Id::udaTarget) {
       applyAttrTarget(sle, func, irFunc);
+    } else if (ident == Id::udaTargetClones) {
+      applyAttrTargetClones(sle, irFunc);
     } else if (ident == Id::udaAssumeUsed) {
       applyAttrAssumeUsed(*gIR, sle, func);
     } else if (ident == Id::udaWeak || ident == Id::udaKernel) {
@@ -452,6 +512,76 @@ void applyFuncDeclUDAs(FuncDeclaration *decl, IrFunction *irFunc) {
   }
 }
 
+bool hasRestrictUDA(Parameter *param) {
+  if (!param->userAttribDecl)
+    return false;
+
+  Expressions *attrs = param->userAttribDecl->getAttributes();
+  expandTuples(attrs);
+  for (auto &attr : *attrs) {
+    auto sle = getLdcAttributesStruct(attr);
+    if (!sle || sle->sd->ident != Id::udaRestrict)
+      continue;
+
+    checkStructElems(sle, {});
+    const auto ty = param->type->toBasetype()->ty;
+    if ((ty != Tpointer && ty != Tarray) ||
+        (param->storageClass & (STCref | STCout | STClazy))) {
+      sle->error("`@ldc.attributes.restrict` can only be applied to pointer "
+                 "and slice parameters passed by value");
+      return false;
+    }
+    return true;
+  }
+  return false;
+}
+
+unsigned getAssumeAlignedUDA(VarDeclaration *decl) {
+  auto sle = getMagicAttribute(decl, Id::udaAssumeAligned, Id::attributes);
+  if (!sle)
+    return 0;
+
+  checkStructElems(sle, {Type::tuns32});
+  const auto alignment = getIntElem(sle, 0);
+  const auto ty = decl->type->toBasetype()->ty;
+  if ((ty != Tpointer && ty != Tarray) ||
+      (decl->storage_class & (STCref | STCout | STClazy))) {
+    sle->error("`@ldc.attributes.%s` can only be applied to pointer and "
+               "slice variables",
+               sle->sd->ident->toChars());
+    return 0;
+  }
+  if (alignment <= 0 || (alignment & (alignment - 1)) != 0) {
+    sle->error("alignment `%lld` of `@ldc.attributes.%s` is not a power of 2",
+               static_cast<long long>(alignment), sle->sd->ident->toChars());
+    return 0;
+  }
+  return static_cast<unsigned>(alignment);
+}
+
+bool hasOptimizeLayoutUDA(StructDeclaration *sd) {
+  auto sle = getMagicAttribute(sd, Id::udaOptimizeLayout, Id::attributes);
+  if (!sle)
+    return false;
+
+  checkStructElems(sle, {});
+  if (sd->isUnionDeclaration() || sd->classKind != ClassKind::d) {
+    sle->error("`@ldc.attributes.optimizeLayout` can only be applied to "
+               "`extern(D)` structs");
+    return false;
+  }
+  return true;
+}
+
+bool hasColdFieldUDA(VarDeclaration *field) {
+  auto sle = getMagicAttribute(field, Id::udaColdField, Id::attributes);
+  if (!sle)
+    return false;
+
+  checkStructElems(sle, {});
+  return true;
+}
+
 /// Checks whether 'sym' has the @ldc.attributes._weak() UDA applied.
 bool hasWeakUDA(Dsymbol *sym) {
   auto sle = getMagicAttribute(sym, Id::udaWeak, Id::attributes);
@@ -496,3 +626,59 @@ bool hasKernelAttr(Dsymbol *sym) {
   return true;
 }
 
+namespace {
+void checkKernelOnlyAttr(Dsymbol *sym, StructLiteralExp *sle,
+                         const char *name) {
+  if (!sym->isFuncDeclaration() || !hasKernelAttr(sym)) {
+    sle->error("`@ldc.dcompute.%s` can only be applied to `@kernel` functions",
+               name);
+  }
+}
+}
+
+/// Checks whether 'sym' has the @ldc.dcompute.launchBounds(maxThreads,
+/// minBlocks) UDA applied.
+bool getLaunchBoundsAttr(Dsymbol *sym, unsigned &maxThreads,
+                         unsigned &minBlocks) {
+  auto sle = getMagicAttribute(sym, Id::udaLaunchBounds, Id::dcompute);
+  if (!sle)
+    return false;
+
+  checkStructElems(sle, {Type::tint32, Type::tint32});
+  checkKernelOnlyAttr(sym, sle, "launchBounds");
+
+  auto threads = getIntElem(sle, 0);
+  auto blocks = getIntElem(sle, 1);
+  if (threads <= 0 || blocks < 0) {
+    sle->error("`@ldc.dcompute.launchBounds(%d, %d)` requires a positive "
+               "maxThreads and a non-negative minBlocks",
+               (int)threads, (int)blocks);
+    return false;
+  }
+
+  maxThreads = static_cast<unsigned>(threads);
+  minBlocks = static_cast<unsigned>(blocks);
+  return true;
+}
+
+/// Checks whether 'sym' has the @ldc.dcompute.maxRegisters(n) UDA applied.
+bool getMaxRegistersAttr(Dsymbol *sym, unsigned &maxRegisters) {
+  auto sle = getMagicAttribute(sym, Id::udaMaxRegisters, Id::dcompute);
+  if (!sle)
+    return false;
+
+  checkStructElems(sle, {Type::tint32});
+  checkKernelOnlyAttr(sym, sle, "maxRegisters");
+
+  auto n = getIntElem(sle, 0);
+  if (n <= 0) {
+    sle->error("`@ldc.dcompute.maxRegisters(%d)` requires a positive register "
+               "count",
+               (int)n);
+    return false;
+  }
+
+  maxRegisters = static_cast<unsigned>(n);
+  return true;
+}
+
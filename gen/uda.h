@@ -17,6 +17,8 @@
 
 class Dsymbol;
 class FuncDeclaration;
+class Parameter;
+class StructDeclaration;
 class VarDeclaration;
 struct IrFunction;
 namespace llvm {
@@ -27,7 +29,25 @@ void applyFuncDeclUDAs(FuncDeclaration *decl, IrFunction *irFunc);
 void applyVarDeclUDAs(VarDeclaration *decl, llvm::GlobalVariable *gvar);
 
 bool hasWeakUDA(Dsymbol *sym);
+/// Checks whether the parameter has @ldc.attributes.restrict applied.
+bool hasRestrictUDA(Parameter *param);
+/// Returns the alignment of @ldc.attributes.assumeAligned(n) applied to the
+/// pointer or slice variable/parameter 'decl', or 0.
+unsigned getAssumeAlignedUDA(VarDeclaration *decl);
+/// For the frontend: checks whether the struct has
+/// @ldc.attributes.optimizeLayout applied, i.e., whether its fields may be
+/// reordered (dmd/dstruct.d).
+bool hasOptimizeLayoutUDA(StructDeclaration *sd);
+/// For the frontend: checks whether the field has @ldc.attributes.coldField
+/// applied.
+bool hasColdFieldUDA(VarDeclaration *field);
 bool hasKernelAttr(Dsymbol *sym);
+/// Returns true if 'sym' has @ldc.dcompute.launchBounds(maxThreads, minBlocks)
+/// applied, a minBlocks of 0 means unspecified.
+bool getLaunchBoundsAttr(Dsymbol *sym, unsigned &maxThreads,
+                         unsigned &minBlocks);
+/// Returns true if 'sym' has @ldc.dcompute.maxRegisters(n) applied.
+bool getMaxRegistersAttr(Dsymbol *sym, unsigned &maxRegisters);
 /// Must match ldc.dcompute.Compilefor + 1 == DComputeCompileFor
 enum class DComputeCompileFor : int
 {
@@ -16,65 +16,40 @@
 void* newIrDsymbol() { return static_cast<void*>(new IrDsymbol()); }
 void deleteIrDsymbol(void* sym) { delete static_cast<IrDsymbol*>(sym); }
 
-std::vector<IrDsymbol *> IrDsymbol::list;
+unsigned IrDsymbol::currentEpoch = 0;
 
 void IrDsymbol::resetAll() {
-  Logger::println("resetting %llu Dsymbols",
-                  static_cast<unsigned long long>(list.size()));
-
-  for (auto s : list) {
-    s->reset();
-  }
-}
-
-IrDsymbol::IrDsymbol() : irData(nullptr) {
-  list.push_back(this);
-}
-
-IrDsymbol::IrDsymbol(const IrDsymbol &s) {
-  list.push_back(this);
-  irData = s.irData;
-  m_type = s.m_type;
-  m_state = s.m_state;
-}
-
-IrDsymbol::~IrDsymbol() {
-  if (this == list.back()) {
-    list.pop_back();
-    return;
-  }
-
-  auto it = std::find(list.rbegin(), list.rend(), this).base();
-  // base() returns the iterator _after_ the found position
-  list.erase(--it);
+  Logger::println("resetting all Dsymbols");
+  ++currentEpoch;
 }
 
 void IrDsymbol::reset() {
   irData = nullptr;
   m_type = Type::NotSet;
   m_state = State::Initial;
+  m_epoch = currentEpoch;
 }
 
 void IrDsymbol::setResolved() {
-  if (m_state < Resolved) {
+  if (state() < Resolved) {
     m_state = Resolved;
   }
 }
 
 void IrDsymbol::setDeclared() {
-  if (m_state < Declared) {
+  if (state() < Declared) {
     m_state = Declared;
   }
 }
 
 void IrDsymbol::setInitialized() {
-  if (m_state < Initialized) {
+  if (state() < Initialized) {
     m_state = Initialized;
   }
 }
 
 void IrDsymbol::setDefined() {
-  if (m_state < Defined) {
+  if (state() < Defined) {
     m_state = Defined;
   }
 }
@@ -14,7 +14,7 @@
 #ifndef LDC_IR_IRDSYMBOL_H
 #define LDC_IR_IRDSYMBOL_H
 
-#include <vector>
+#include <string>
 
 struct IrModule;
 struct IrFunction;
@@ -48,30 +48,36 @@ struct IrDsymbol {
 
   enum State { Initial, Resolved, Declared, Initialized, Defined };
 
-  static std::vector<IrDsymbol *> list;
+  /// Resets all IrDsymbols, e.g., before generating the next module. This is
+  /// O(1); each symbol is reset lazily when it is accessed the next time.
   static void resetAll();
 
-  // overload all of these to make sure
-  // the static list is up to date
-  IrDsymbol();
-  IrDsymbol(const IrDsymbol &s);
-  ~IrDsymbol();
-
   void reset();
 
-  Type type() const { return m_type; }
-  State state() const { return m_state; }
+  Type type() {
+    refresh();
+    return m_type;
+  }
+  State state() {
+    refresh();
+    return m_state;
+  }
 
-  bool isResolved() const { return m_state >= Resolved; }
-  bool isDeclared() const { return m_state >= Declared; }
-  bool isInitialized() const { return m_state >= Initialized; }
-  bool isDefined() const { return m_state >= Defined; }
+  bool isResolved() { return state() >= Resolved; }
+  bool isDeclared() { return state() >= Declared; }
+  bool isInitialized() { return state() >= Initialized; }
+  bool isDefined() { return state() >= Defined; }
 
   void setResolved();
   void setDeclared();
   void setInitialized();
   void setDefined();
 
+  /// The symbol's IR mangle as computed by getIRMangledName(), or empty if it
+  /// hasn't been computed yet. It doesn't depend on the LLVM module, so it
+  /// isn't reset.
+  std::string irMangle;
+
 private:
   friend IrModule *getIrModule(Module *m);
   friend IrAggr *getIrAggr(AggregateDeclaration *decl, bool create);
@@ -83,7 +89,7 @@ private:
   friend IrField *getIrField(VarDeclaration *decl, bool create);
 
   union {
-    void *irData;
+    void *irData = nullptr;
     IrModule *irModule;
     IrAggr *irAggr;
     IrFunction *irFunc;
@@ -95,6 +101,15 @@ private:
   };
   Type m_type = Type::NotSet;
   State m_state = State::Initial;
+
+  // Incremented by resetAll(); a symbol with an older epoch is reset on access.
+  static unsigned currentEpoch;
+  unsigned m_epoch = currentEpoch;
+
+  void refresh() {
+    if (m_epoch != currentEpoch)
+      reset();
+  }
 };
 
 #endif
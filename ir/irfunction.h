@@ -20,6 +20,8 @@
 #include "gen/llvm.h"
 #include "ir/irfuncty.h"
 #include <stack>
+#include <string>
+#include <vector>
 
 class FuncDeclaration;
 class TypeFunction;
@@ -89,6 +91,13 @@ struct IrFunction {
   /// target features was overriden by attributes
   bool targetFeaturesOverridden = false;
 
+  /// Target feature strings of the clones requested by @targetClones, in
+  /// addition to the default version.
+  std::vector<std::string> targetClones;
+
+  /// This function was marked @optStrategy("hot")
+  bool hot = false;
+
   /// This functions was marked for dynamic compilation
   bool dynamicCompile = false;
 
@@ -68,6 +68,10 @@ struct IrFuncTyArg {
    *  return values */
   ABIRewrite *rewrite = nullptr;
 
+  /// The pointer of this slice argument is marked @restrict, which can't be
+  /// expressed as LLVM parameter attribute for the slice aggregate.
+  bool restrictSlice = false;
+
   /// Helper to check if the 'inreg' attribute is set
   bool isInReg() const;
   /// Helper to check if the 'sret' attribute is set
@@ -38,11 +38,11 @@ IrModule *getIrModule(Module *m) {
   }
 
   assert(m && "null module");
-  if (m->ir->m_type == IrDsymbol::NotSet) {
+  if (m->ir->type() == IrDsymbol::NotSet) {
     m->ir->irModule = new IrModule(m);
     m->ir->m_type = IrDsymbol::ModuleType;
   }
 
-  assert(m->ir->m_type == IrDsymbol::ModuleType);
+  assert(m->ir->type() == IrDsymbol::ModuleType);
   return m->ir->irModule;
 }
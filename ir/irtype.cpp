@@ -16,6 +16,14 @@
 #include "gen/llvmhelpers.h"
 #include "gen/tollvm.h"
 #include "ir/irtype.h"
+#include <vector>
+
+namespace {
+// All IrTypes created since the last resetAll().
+std::vector<IrType *> allIrTypes;
+}
+
+unsigned IrType::epoch = 0;
 
 // These functions use getGlobalContext() as they are invoked before gIR
 // is set.
@@ -24,6 +32,18 @@ IrType::IrType(Type *dt, LLType *lt) : dtype(dt), type(lt) {
   assert(dt && "null D Type");
   assert(lt && "null LLVM Type");
   assert(!dt->ctype && "already has IrType");
+  allIrTypes.push_back(this);
+}
+
+void IrType::resetAll() {
+  Logger::println("resetting all IrTypes");
+  for (IrType *t : allIrTypes) {
+    if (t->dtype->ctype == t)
+      t->dtype->ctype = nullptr;
+    delete t;
+  }
+  allIrTypes.clear();
+  ++epoch;
 }
 
 IrFuncTy &IrType::getIrFuncTy() {
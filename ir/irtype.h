@@ -90,6 +90,13 @@ public:
   ///
   virtual IrFuncTy &getIrFuncTy();
 
+  /// Deletes the IrTypes of all D types, so that they are rebuilt on next use,
+  /// e.g., in another LLVMContext (see -context-per-module).
+  static void resetAll();
+
+  /// Incremented by resetAll(), for invalidating other caches of LLVM types.
+  static unsigned getEpoch() { return epoch; }
+
 protected:
   ///
   IrType(Type *dt, llvm::Type *lt);
@@ -99,6 +106,9 @@ protected:
 
   /// LLVM type.
   llvm::Type *type = nullptr;
+
+private:
+  static unsigned epoch;
 };
 
 //////////////////////////////////////////////////////////////////////////////
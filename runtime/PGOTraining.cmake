@@ -0,0 +1,34 @@
+# - Training run for the profile-optimized runtime libraries (BUILD_PGO_LIBS)
+#
+# Runs the instrumented hook benchmarks and Phobos unittests, then merges the
+# raw profiles they wrote to RAW_DIR into OUTPUT. Invoked in script mode with
+# the variables PROFDATA (ldc-profdata), RAW_DIR, OUTPUT, HOOK_BENCH and
+# TEST_RUNNER.
+#
+# Failing unittests don't invalidate the profile, so the exit codes of the
+# training executables are only reported.
+
+file(REMOVE_RECURSE ${RAW_DIR})
+file(MAKE_DIRECTORY ${RAW_DIR})
+
+macro(run_training)
+    string(REPLACE ";" " " command_line "${ARGN}")
+    message(STATUS "PGO training: ${command_line}")
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE result OUTPUT_QUIET)
+    if(NOT "${result}" STREQUAL "0")
+        message(WARNING "PGO training command exited with '${result}': ${command_line}")
+    endif()
+endmacro()
+
+# Short benchmark runs suffice; the relative hook frequencies are what matters.
+run_training(${HOOK_BENCH} --scale=10 --threads=1,4)
+run_training(${TEST_RUNNER})
+
+file(GLOB raw_profiles ${RAW_DIR}/*.profraw)
+if(NOT raw_profiles)
+    message(FATAL_ERROR "PGO training wrote no profiles to ${RAW_DIR}")
+endif()
+execute_process(COMMAND ${PROFDATA} merge -output=${OUTPUT} ${raw_profiles} RESULT_VARIABLE result)
+if(NOT "${result}" STREQUAL "0")
+    message(FATAL_ERROR "Merging the PGO training profiles failed")
+endif()
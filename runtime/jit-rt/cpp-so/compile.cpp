@@ -12,29 +12,44 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
+#include <string>
+#include <thread>
 #include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "bind.h"
 #include "callback_ostream.h"
 #include "context.h"
 #include "jit_context.h"
 #include "optimizer.h"
+#include "statistics.h"
 #include "utils.h"
 
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
 
 namespace {
 
@@ -170,8 +185,9 @@ void *resolveSymbol(llvm::JITSymbol &symbol) {
   }
 }
 
-void generateBind(const Context &context, JITContext &jitContext,
-                  JitModuleInfo &moduleInfo, llvm::Module &module) {
+// Returns the number of generated specializations.
+std::size_t generateBind(const Context &context, JITContext &jitContext,
+                         JitModuleInfo &moduleInfo, llvm::Module &module) {
   auto getIrFunc = [&](const void *ptr) -> llvm::Function * {
     assert(ptr != nullptr);
     auto funcDesc = moduleInfo.getFunc(ptr);
@@ -184,10 +200,35 @@ void generateBind(const Context &context, JITContext &jitContext,
   std::unordered_map<const void *, llvm::Function *> bindFuncs;
   bindFuncs.reserve(jitContext.getBindInstances().size() * 2);
 
+  // Bind instances of the same function with the same parameter bytes share
+  // one specialization.
+  std::unordered_map<std::string, llvm::Function *> specializations;
+  auto getSpecializationKey = [](void *originalFunc, void *exampleFunc,
+                                 const llvm::ArrayRef<ParamSlice> &params) {
+    std::string key;
+    llvm::raw_string_ostream os(key);
+    os << originalFunc << ' ' << exampleFunc;
+    for (auto &&param : params) {
+      os << ' ' << static_cast<uint32_t>(param.type) << ':' << param.size
+         << ':';
+      if (param.data != nullptr) {
+        os.write(static_cast<const char *>(param.data), param.size);
+      }
+    }
+    return os.str();
+  };
+
   auto genBind = [&](void *bindPtr, void *originalFunc, void *exampleFunc,
                      const llvm::ArrayRef<ParamSlice> &params) {
     assert(bindPtr != nullptr);
     assert(bindFuncs.end() == bindFuncs.find(bindPtr));
+    auto specKey = getSpecializationKey(originalFunc, exampleFunc, params);
+    auto specIt = specializations.find(specKey);
+    if (specializations.end() != specIt) {
+      moduleInfo.addBindHandle(specIt->second->getName(), bindPtr);
+      bindFuncs.insert({bindPtr, specIt->second});
+      return;
+    }
     auto funcToInline = getIrFunc(originalFunc);
     if (funcToInline != nullptr) {
       auto exampleIrFunc = getIrFunc(exampleFunc);
@@ -234,6 +275,7 @@ void generateBind(const Context &context, JITContext &jitContext,
                            errhandler, BindOverride(overrideHandler));
       moduleInfo.addBindHandle(func->getName(), bindPtr);
       bindFuncs.insert({bindPtr, func});
+      specializations.insert({std::move(specKey), func});
     } else {
       fatal(context, "Bind: function body not available");
     }
@@ -245,35 +287,37 @@ void generateBind(const Context &context, JITContext &jitContext,
     genBind(bindPtr, bindDesc.originalFunc, bindDesc.exampleFunc,
             bindDesc.params);
   }
+  return specializations.size();
 }
 
-void applyBind(const Context &context, JITContext &jitContext,
-               const JitModuleInfo &moduleInfo) {
-  auto &layout = jitContext.getDataLayout();
-  for (auto &elem : moduleInfo.getBindHandles()) {
-    auto decorated = decorate(elem.name, layout);
-    auto symbol = jitContext.findSymbol(decorated);
-    auto addr = resolveSymbol(symbol);
-    if (nullptr == addr) {
-      std::string desc = std::string("Symbol not found in jitted code: \"") +
-                         elem.name + "\" (\"" + decorated + "\")";
-      fatal(context, desc);
-    } else {
-      auto handle = static_cast<void **>(elem.handle);
-      *handle = addr;
-    }
-  }
-}
-
+// The default context, which updates the thunks and bind handles.
 JITContext &getJit() {
   static JITContext jit;
   return jit;
 }
 
-void setRtCompileVars(const Context &context, llvm::Module &module,
+JITContext &getJit(const Context &context) {
+  if (nullptr != context.jitContext) {
+    return *static_cast<JITContext *>(context.jitContext);
+  }
+  return getJit();
+}
+
+// Thunks and bind handles may be read concurrently by other threads while a
+// background compilation publishes new code.
+void publishAddress(void **target, void *address) {
+  static_assert(sizeof(std::atomic<void *>) == sizeof(void *),
+                "std::atomic<void *> must be layout compatible with void *");
+  reinterpret_cast<std::atomic<void *> *>(target)->store(
+      address, std::memory_order_release);
+}
+
+void setRtCompileVars(const Context &context, const JITContext &jitContext,
+                      llvm::Module &module,
                       llvm::ArrayRef<RtCompileVarList> vals) {
   for (auto &&val : vals) {
-    setRtCompileVar(context, module, val.name, val.init);
+    setRtCompileVar(context, module, val.name,
+                    jitContext.getConstValue(val.init));
   }
 }
 
@@ -289,19 +333,280 @@ void dumpModule(const Context &context, const llvm::Module &module,
   }
 }
 
-void setFunctionsTarget(llvm::Module &module, const llvm::TargetMachine &TM) {
+void setFunctionsTarget(const Context &context, llvm::Module &module,
+                        const llvm::TargetMachine &TM) {
+  // Per-compile overrides take precedence over the host, features appended
+  // later win over earlier ones.
+  std::string cpu = TM.getTargetCPU();
+  if (nullptr != context.cpu && '\0' != *context.cpu) {
+    cpu = context.cpu;
+  }
+  std::string featStr = TM.getTargetFeatureString();
+  if (nullptr != context.features && '\0' != *context.features) {
+    if (!featStr.empty()) {
+      featStr += ',';
+    }
+    featStr += context.features;
+  }
+
   // Set function target cpu to host if it wasn't set explicitly
   for (auto &&func : module.functions()) {
     if (!func.hasFnAttribute("target-cpu")) {
-      func.addFnAttr("target-cpu", TM.getTargetCPU());
+      func.addFnAttr("target-cpu", cpu);
     }
 
     if (!func.hasFnAttribute("target-features")) {
-      auto featStr = TM.getTargetFeatureString();
       if (!featStr.empty()) {
         func.addFnAttr("target-features", featStr);
       }
     }
+
+    if (0 != context.preferVectorWidth &&
+        !func.hasFnAttribute("prefer-vector-width")) {
+      func.addFnAttr("prefer-vector-width",
+                     std::to_string(context.preferVectorWidth));
+    }
+  }
+}
+
+// Entry point of jitted code: a thunked function or a bind handle.
+struct JitEntry final {
+  std::string key;
+  std::string funcName;
+  void **target;
+  void *bindHandle;
+  std::string hash;
+  void *address;
+  const void *originalFunc;
+};
+
+std::vector<JitEntry> collectEntries(const JitModuleInfo &moduleInfo) {
+  std::vector<JitEntry> ret;
+  for (auto &&fun : moduleInfo.functions()) {
+    if (fun.thunkVar != nullptr) {
+      ret.push_back({fun.name.str(), fun.name.str(), fun.thunkVar, nullptr, {},
+                     nullptr, fun.originalFunc});
+    }
+  }
+  for (auto &&elem : moduleInfo.getBindHandles()) {
+    std::stringstream ss;
+    ss << "bind " << elem.handle;
+    ret.push_back({ss.str(), elem.name, static_cast<void **>(elem.handle),
+                   elem.handle, {}, nullptr, nullptr});
+  }
+  return ret;
+}
+
+using GlobalsSet = std::unordered_set<const llvm::GlobalValue *>;
+
+// Collects `root` and all definitions it transitively references.
+void collectDefinitions(const llvm::GlobalValue &root, GlobalsSet &defs) {
+  llvm::SmallVector<const llvm::User *, 32> worklist;
+  std::unordered_set<const llvm::Constant *> visited;
+  auto push = [&](const llvm::Value *val) {
+    if (auto gv = llvm::dyn_cast<llvm::GlobalValue>(val)) {
+      if (!gv->isDeclaration() && defs.insert(gv).second) {
+        worklist.push_back(gv);
+      }
+    } else if (auto c = llvm::dyn_cast<llvm::Constant>(val)) {
+      if (visited.insert(c).second) {
+        worklist.push_back(c);
+      }
+    }
+  };
+  push(&root);
+  while (!worklist.empty()) {
+    auto user = worklist.pop_back_val();
+    for (auto &&op : user->operands()) {
+      push(op.get());
+    }
+    if (auto func = llvm::dyn_cast<llvm::Function>(user)) {
+      for (auto &&bb : *func) {
+        for (auto &&instr : bb) {
+          for (auto &&op : instr.operands()) {
+            push(op.get());
+          }
+        }
+      }
+    }
+  }
+}
+
+// Hashes the definitions each entry point depends on. As the module already
+// has all @dynamicCompileConst values and bound parameters folded in, an
+// unchanged hash means the previously generated code can be reused.
+void hashEntries(const llvm::Module &module, const OptimizerSettings &settings,
+                 ProfileMode profileMode, std::vector<JitEntry> &entries,
+                 std::vector<GlobalsSet> &entryDefs) {
+  std::unordered_map<const llvm::GlobalValue *, std::string> defHashes;
+  auto getDefHash = [&](const llvm::GlobalValue *gv) -> const std::string & {
+    auto it = defHashes.find(gv);
+    if (defHashes.end() != it) {
+      return it->second;
+    }
+    std::string str;
+    llvm::raw_string_ostream os(str);
+    gv->print(os);
+    if (auto func = llvm::dyn_cast<llvm::Function>(gv)) {
+      os << func->getAttributes().getAsString(
+          llvm::AttributeList::FunctionIndex);
+    }
+    llvm::MD5 hash;
+    hash.update(os.str());
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> res;
+    llvm::MD5::stringifyResult(result, res);
+    return defHashes.insert({gv, res.str().str()}).first->second;
+  };
+
+  entryDefs.clear();
+  for (auto &&entry : entries) {
+    entryDefs.emplace_back();
+    auto &defs = entryDefs.back();
+    if (auto func = module.getFunction(entry.funcName)) {
+      collectDefinitions(*func, defs);
+    }
+
+    std::vector<llvm::StringRef> hashes;
+    for (auto &&def : defs) {
+      hashes.push_back(getDefHash(def));
+    }
+    std::sort(hashes.begin(), hashes.end());
+
+    llvm::MD5 hash;
+    const uint8_t levels[] = {static_cast<uint8_t>(settings.optLevel),
+                              static_cast<uint8_t>(settings.sizeLevel),
+                              static_cast<uint8_t>(profileMode)};
+    hash.update(levels);
+    for (auto &&h : hashes) {
+      hash.update(h);
+    }
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> res;
+    llvm::MD5::stringifyResult(result, res);
+    entry.hash = res.str().str();
+  }
+}
+
+// Removes all definitions not in `used` and internalizes the used functions
+// which are not entry points, those are copies of already jitted code.
+void stripModuleTo(llvm::Module &module, const GlobalsSet &used,
+                   const std::unordered_set<std::string> &entryNames) {
+  std::vector<llvm::GlobalValue *> unused;
+  for (auto &&func : module.functions()) {
+    if (func.isDeclaration()) {
+      continue;
+    }
+    if (used.count(&func) == 0) {
+      func.deleteBody();
+      unused.push_back(&func);
+    } else if (!func.hasLocalLinkage() &&
+               entryNames.count(func.getName().str()) == 0) {
+      func.setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+  }
+  for (auto &&var : module.globals()) {
+    if (!var.isDeclaration() && used.count(&var) == 0) {
+      var.setInitializer(nullptr);
+      var.setLinkage(llvm::GlobalValue::ExternalLinkage);
+      unused.push_back(&var);
+    }
+  }
+  for (auto &&gv : unused) {
+    gv->removeDeadConstantUsers();
+    if (gv->use_empty()) {
+      gv->eraseFromParent();
+    }
+  }
+}
+
+// Part of the final module, optimized and compiled on its own thread.
+struct ModulePartition final {
+  llvm::LLVMContext llvmContext;
+  llvm::SmallString<0> bitcode;
+  std::unique_ptr<llvm::Module> module;
+  JITContext::CompiledObject object;
+  StatisticsCollector::Clock::duration optimizeTime{};
+  StatisticsCollector::Clock::duration codegenTime{};
+};
+
+std::vector<std::unique_ptr<ModulePartition>>
+splitModule(std::unique_ptr<llvm::Module> module, unsigned count) {
+  // Partitions are moved into their own LLVMContext through bitcode, which is
+  // what llvm::splitCodeGen does too.
+  std::vector<std::unique_ptr<ModulePartition>> ret;
+  llvm::SplitModule(std::move(module), count,
+                    [&](std::unique_ptr<llvm::Module> part) {
+                      bool empty = true;
+                      for (auto &&func : part->functions()) {
+                        if (!func.isDeclaration()) {
+                          empty = false;
+                          break;
+                        }
+                      }
+                      if (empty) {
+                        return;
+                      }
+                      ret.emplace_back(new ModulePartition);
+                      llvm::raw_svector_ostream os(ret.back()->bitcode);
+#if LDC_LLVM_VER >= 700
+                      llvm::WriteBitcodeToFile(*part, os);
+#else
+                      llvm::WriteBitcodeToFile(part.get(), os);
+#endif
+                    });
+  return ret;
+}
+
+void compilePartitions(
+    const Context &context, JITContext &jitContext,
+    const OptimizerSettings &settings,
+    std::vector<std::unique_ptr<ModulePartition>> &partitions) {
+  // Worker threads must not call back into the D handlers, they aren't
+  // registered with the D runtime.
+  Context workerContext = context;
+  workerContext.interruptPointHandler = nullptr;
+  workerContext.dumpHandler = nullptr;
+
+  const auto threadsCount = std::min<std::size_t>(
+      static_cast<std::size_t>(context.threads), partitions.size());
+  std::vector<std::unique_ptr<llvm::TargetMachine>> targetMachines;
+  for (std::size_t i = 0; i < threadsCount; ++i) {
+    targetMachines.push_back(jitContext.createTargetMachine());
+  }
+
+  std::atomic<std::size_t> next(0);
+  auto worker = [&](llvm::TargetMachine &targetMachine) {
+    for (auto i = next++; i < partitions.size(); i = next++) {
+      auto &part = *partitions[i];
+      auto mod = llvm::parseBitcodeFile(
+          llvm::MemoryBufferRef(part.bitcode, ""), part.llvmContext);
+      if (!mod) {
+        llvm::consumeError(mod.takeError());
+        fatal(workerContext, "Unable to parse IR");
+      }
+      part.module = std::move(*mod);
+      const auto optimizeStart = StatisticsCollector::Clock::now();
+      optimizeModule(workerContext, targetMachine, settings, *part.module);
+      verifyModule(workerContext, *part.module);
+      const auto codegenStart = StatisticsCollector::Clock::now();
+      part.object = llvm::orc::SimpleCompiler(targetMachine)(*part.module);
+      part.optimizeTime = codegenStart - optimizeStart;
+      part.codegenTime = StatisticsCollector::Clock::now() - codegenStart;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < threadsCount; ++i) {
+    threads.emplace_back(worker, std::ref(*targetMachines[i]));
+  }
+  if (threadsCount != 0) {
+    worker(*targetMachines[0]);
+  }
+  for (auto &&thread : threads) {
+    thread.join();
   }
 }
 
@@ -318,14 +623,292 @@ struct JitFinaliser final {
   void finalze() { finalized = true; }
 };
 
+// Merged module and entry points of a lazy compilation. Entry points
+// initially point to stubs which compile the entry point with its callees
+// from a copy of the module on the first call.
+struct LazyCompileState final {
+  // Incremented whenever the state is replaced, stubs of older compilations
+  // forward to the currently published code.
+  std::size_t generation = 0;
+  std::unique_ptr<llvm::Module> module;
+  // Handlers and strings of the original context aren't valid anymore when
+  // the stubs are called.
+  Context context;
+  OptimizerSettings settings;
+  std::vector<JitEntry> entries;
+
+  void reset() {
+    ++generation;
+    module.reset();
+    entries.clear();
+  }
+};
+
+LazyCompileState &getLazyState() {
+  static LazyCompileState state;
+  return state;
+}
+
+void *compileLazyEntry(JITContext &jitContext, LazyCompileState &state,
+                       std::size_t index) {
+  auto &entry = state.entries[index];
+  if (entry.address != nullptr) {
+    return entry.address;
+  }
+  const auto &context = state.context;
+  auto root = state.module->getFunction(entry.funcName);
+  assert(root != nullptr);
+  GlobalsSet defs;
+  collectDefinitions(*root, defs);
+  llvm::ValueToValueMapTy vmap;
+  auto module = llvm::CloneModule(
+#if LDC_LLVM_VER >= 700
+      *state.module,
+#else
+      state.module.get(),
+#endif
+      vmap, [&](const llvm::GlobalValue *gv) { return defs.count(gv) != 0; });
+
+  GlobalsSet used;
+  collectDefinitions(*module->getFunction(entry.funcName), used);
+  stripModuleTo(*module, used, {entry.funcName});
+  if (ProfileMode::Instrument == context.profileMode) {
+    jitContext.getProfile().instrument(*module);
+  } else if (ProfileMode::Use == context.profileMode) {
+    jitContext.getProfile().apply(*module);
+  }
+  optimizeModule(context, jitContext.getTargetMachine(), state.settings,
+                 *module);
+  verifyModule(context, *module);
+
+  jitContext.getObjectCache().reset();
+  jitContext.beginModuleGroup();
+  if (jitContext.addModule(std::move(module), nullptr)) {
+    fatal(context, "Can't codegen module");
+  }
+  if (jitContext.finalizeModuleGroup()) {
+    fatal(context, "Can't link jitted code");
+  }
+  auto decorated = decorate(entry.funcName, jitContext.getDataLayout());
+  auto symbol = jitContext.findSymbol(decorated);
+  auto addr = resolveSymbol(symbol);
+  if (nullptr == addr) {
+    fatal(context, std::string("Symbol not found in jitted code: \"") +
+                       entry.funcName + "\" (\"" + decorated + "\")");
+  }
+  entry.address = addr;
+  jitContext.addCompiledEntry(entry.key, {}, addr, entry.bindHandle);
+  publishAddress(entry.target, addr);
+  return addr;
+}
+
+// Called by the stubs with the arguments of the entry point still in place,
+// which then tail calls the returned address.
+void *lazyCompileCallback(std::size_t generation, std::size_t index,
+                          void **target) {
+  std::lock_guard<std::mutex> lock(getJit().getMutex());
+  auto &state = getLazyState();
+  if (generation != state.generation) {
+    // The entry point was recompiled since, the stub was loaded before that.
+    return reinterpret_cast<std::atomic<void *> *>(target)->load(
+        std::memory_order_acquire);
+  }
+  assert(index < state.entries.size());
+  return compileLazyEntry(getJit(), state, index);
+}
+
+// Generates a stub for each entry point which calls lazyCompileCallback and
+// tail calls the result with its own arguments. Variadic entry points can't
+// be forwarded like that and get null.
+std::unique_ptr<llvm::Module>
+generateLazyStubs(JITContext &jitContext, const LazyCompileState &state,
+                  std::vector<std::string> &stubNames) {
+  auto &llvmContext = jitContext.getContext();
+  std::unique_ptr<llvm::Module> module(
+      new llvm::Module("lazy_stubs", llvmContext));
+  module->setDataLayout(jitContext.getDataLayout());
+  module->setTargetTriple(jitContext.getTargetMachine().getTargetTriple().str());
+
+  auto &layout = jitContext.getDataLayout();
+  auto intPtrType = layout.getIntPtrType(llvmContext);
+  auto voidPtrType = llvm::Type::getInt8PtrTy(llvmContext);
+  auto callbackType = llvm::FunctionType::get(
+      voidPtrType, {intPtrType, intPtrType, voidPtrType}, false);
+  auto callback = llvm::ConstantExpr::getIntToPtr(
+      llvm::ConstantInt::get(
+          intPtrType, reinterpret_cast<uintptr_t>(&lazyCompileCallback)),
+      callbackType->getPointerTo());
+
+  stubNames.clear();
+  for (std::size_t i = 0; i < state.entries.size(); ++i) {
+    auto &entry = state.entries[i];
+    auto func = state.module->getFunction(entry.funcName);
+    assert(func != nullptr);
+    auto funcType = func->getFunctionType();
+    if (funcType->isVarArg()) {
+      stubNames.emplace_back();
+      continue;
+    }
+
+    auto stub =
+        llvm::Function::Create(funcType, llvm::GlobalValue::ExternalLinkage,
+                               entry.funcName + ".lazy_stub", module.get());
+    stub->copyAttributesFrom(func);
+    stubNames.push_back(stub->getName().str());
+
+    llvm::IRBuilder<> builder(
+        llvm::BasicBlock::Create(llvmContext, "", stub));
+    auto toPtr = [&](uintptr_t val) {
+      return llvm::ConstantExpr::getIntToPtr(
+          llvm::ConstantInt::get(intPtrType, val), voidPtrType);
+    };
+    auto addr = builder.CreateCall(
+        callback, {llvm::ConstantInt::get(intPtrType, state.generation),
+                   llvm::ConstantInt::get(intPtrType, i),
+                   toPtr(reinterpret_cast<uintptr_t>(entry.target))});
+    std::vector<llvm::Value *> args;
+    for (auto &&arg : stub->args()) {
+      args.push_back(&arg);
+    }
+    auto call = builder.CreateCall(
+        builder.CreateBitCast(addr, funcType->getPointerTo()), args);
+    call->setCallingConv(func->getCallingConv());
+    call->setAttributes(func->getAttributes());
+    call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+    if (funcType->getReturnType()->isVoidTy()) {
+      builder.CreateRetVoid();
+    } else {
+      builder.CreateRet(call);
+    }
+  }
+  return module;
+}
+
+// Publishes stubs for all entry points instead of compiling them.
+void installLazyStubs(const Context &context, JITContext &jitContext,
+                      const OptimizerSettings &settings,
+                      std::unique_ptr<llvm::Module> module,
+                      std::vector<JitEntry> &entries,
+                      StatisticsCollector *statistics) {
+  auto &state = getLazyState();
+  state.reset();
+  state.module = std::move(module);
+  state.context = Context();
+  state.context.optLevel = context.optLevel;
+  state.context.sizeLevel = context.sizeLevel;
+  state.context.profileMode = context.profileMode;
+  state.settings = settings;
+  state.entries = entries;
+
+  std::vector<std::string> stubNames;
+  auto stubs = generateLazyStubs(jitContext, state, stubNames);
+  verifyModule(context, *stubs);
+
+  jitContext.getObjectCache().reset();
+  jitContext.beginModuleGroup();
+  if (jitContext.addModule(std::move(stubs), nullptr, statistics)) {
+    fatal(context, "Can't codegen module");
+  }
+  if (jitContext.finalizeModuleGroup()) {
+    fatal(context, "Can't link jitted code");
+  }
+
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    auto &entry = entries[i];
+    if (stubNames[i].empty()) {
+      continue;
+    }
+    auto symbol = jitContext.findSymbol(
+        decorate(stubNames[i], jitContext.getDataLayout()));
+    entry.address = resolveSymbol(symbol);
+    if (nullptr == entry.address) {
+      fatal(context, "Symbol not found in jitted code: \"" + stubNames[i] +
+                         "\"");
+    }
+    jitContext.addCompiledEntry(entry.key, {}, entry.address,
+                                entry.bindHandle);
+  }
+
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    if (stubNames[i].empty()) {
+      interruptPoint(context, "Compile variadic function",
+                     entries[i].funcName.c_str());
+      entries[i].address = compileLazyEntry(jitContext, state, i);
+    }
+  }
+}
+
+// Bitcode compressed with -dynamic-compile-compress-ir starts with this magic,
+// followed by the uncompressed size as 32-bit little-endian integer and the
+// zlib stream. Must be in sync with gen/dynamiccompile.cpp.
+const char compressedIRMagic[] = {'L', 'D', 'C', 'Z'};
+const std::size_t compressedIRHeaderSize = sizeof(compressedIRMagic) + 4;
+
+bool isCompressedIR(llvm::StringRef data) {
+  return data.size() >= compressedIRHeaderSize &&
+         data.startswith(
+             llvm::StringRef(compressedIRMagic, sizeof(compressedIRMagic)));
+}
+
+llvm::StringRef decompressIR(const Context &context, llvm::StringRef data,
+                             llvm::SmallVectorImpl<char> &buffer) {
+  std::size_t size = 0;
+  for (unsigned i = 0; i < 4; ++i) {
+    size |= static_cast<std::size_t>(static_cast<unsigned char>(
+                data[sizeof(compressedIRMagic) + i]))
+            << (8 * i);
+  }
+  const auto payload = data.drop_front(compressedIRHeaderSize);
+  if (!llvm::zlib::isAvailable()) {
+    fatal(context, "Compressed IR requires LLVM to be built with zlib");
+  }
+#if LDC_LLVM_VER >= 500
+  if (auto err = llvm::zlib::uncompress(payload, buffer, size)) {
+    fatal(context, "Unable to decompress IR: " +
+                       llvm::toString(std::move(err)));
+  }
+#else
+  if (llvm::zlib::uncompress(payload, buffer, size) != llvm::zlib::StatusOK) {
+    fatal(context, "Unable to decompress IR");
+  }
+#endif
+  return llvm::StringRef(buffer.data(), buffer.size());
+}
+
+// Makes the entry points call the compiled code. Isolated contexts leave the
+// thunks alone and only record the addresses for getFunctionAddress().
+void publishEntries(JITContext &jitContext, bool isolated,
+                    const std::vector<JitEntry> &entries) {
+  if (!isolated) {
+    for (auto &&entry : entries) {
+      publishAddress(entry.target, entry.address);
+    }
+    return;
+  }
+  std::unordered_map<const void *, void *> addrs;
+  for (auto &&entry : entries) {
+    if (entry.originalFunc != nullptr) {
+      addrs.insert({entry.originalFunc, entry.address});
+    }
+  }
+  jitContext.setFunctionAddresses(std::move(addrs));
+}
+
 void rtCompileProcessImplSoInternal(const RtCompileModuleList *modlist_head,
-                                    const Context &context) {
+                                    const Context &context, JITContext &myJit) {
   if (nullptr == modlist_head) {
     // No jit modules to compile
     return;
   }
   interruptPoint(context, "Init");
-  JITContext &myJit = getJit();
+  // Bind instances are registered with the default context, so there are no
+  // bind handles to update in isolated ones.
+  const bool isolated = nullptr != context.jitContext;
+  myJit.getEventNotifier().setEvents(context.profilerEvents,
+                                     context.demangleHandler);
+  myJit.setHugePages(context.hugePages);
+  StatisticsCollector statistics(context, myJit.getDataLayout());
+  auto statsListener = statistics.enabled() ? &statistics : nullptr;
 
   JitModuleInfo moduleInfo(context, modlist_head);
   std::unique_ptr<llvm::Module> finalModule;
@@ -336,27 +919,59 @@ void rtCompileProcessImplSoInternal(const RtCompileModuleList *modlist_head,
   settings.sizeLevel = context.sizeLevel;
   enumModules(modlist_head, context, [&](const RtCompileModuleList &current) {
     interruptPoint(context, "load IR");
-    auto buff = llvm::MemoryBuffer::getMemBuffer(
-        llvm::StringRef(current.irData,
-                        static_cast<std::size_t>(current.irDataSize)),
-        "", false);
-    interruptPoint(context, "parse IR");
-    auto mod = llvm::parseBitcodeFile(*buff, myJit.getContext());
+    llvm::StringRef irData(current.irData,
+                           static_cast<std::size_t>(current.irDataSize));
+    statistics.addIrSize(static_cast<uint64_t>(current.irDataSize));
+    auto mod = [&]() -> llvm::Expected<std::unique_ptr<llvm::Module>> {
+      StageTimer timer(statistics, CompileStage::Parse);
+      if (auto parsed = myJit.getParsedModule(irData)) {
+        interruptPoint(context, "clone parsed IR", parsed->getName().data());
+#if LDC_LLVM_VER >= 700
+        return llvm::CloneModule(*parsed);
+#else
+        return llvm::CloneModule(parsed);
+#endif
+      }
+
+      llvm::SmallVector<char, 0> uncompressed;
+      llvm::StringRef bitcode = irData;
+      if (isCompressedIR(bitcode)) {
+        interruptPoint(context, "decompress IR");
+        bitcode = decompressIR(context, bitcode, uncompressed);
+      }
+      auto buff = llvm::MemoryBuffer::getMemBuffer(bitcode, "", false);
+      interruptPoint(context, "parse IR");
+      auto parsed = llvm::parseBitcodeFile(*buff, myJit.getContext());
+      if (!parsed) {
+        return parsed.takeError();
+      }
+      interruptPoint(context, "Verify module", (*parsed)->getName().data());
+      verifyModule(context, **parsed, /*input=*/true);
+      // Keep the pristine module for the next compilations, which mutate
+      // their copy.
+#if LDC_LLVM_VER >= 700
+      auto copy = llvm::CloneModule(**parsed);
+#else
+      auto copy = llvm::CloneModule(parsed->get());
+#endif
+      myJit.addParsedModule(irData, std::move(*parsed));
+      return std::move(copy);
+    }();
     if (!mod) {
+      llvm::consumeError(mod.takeError());
       fatal(context, "Unable to parse IR");
     } else {
       llvm::Module &module = **mod;
       const auto name = module.getName();
-      interruptPoint(context, "Verify module", name.data());
-      verifyModule(context, module);
 
       dumpModule(context, module, DumpStage::OriginalModule);
-      setFunctionsTarget(module, myJit.getTargetMachine());
+      StageTimer timer(statistics, CompileStage::Link);
+      setFunctionsTarget(context, module, myJit.getTargetMachine());
 
       module.setDataLayout(myJit.getTargetMachine().createDataLayout());
 
       interruptPoint(context, "setRtCompileVars", name.data());
-      setRtCompileVars(context, module,
+      setRtCompileVars(context, myJit, module,
                        toArray(current.varList,
                                static_cast<std::size_t>(current.varListSize)));
 
@@ -378,60 +993,195 @@ void rtCompileProcessImplSoInternal(const RtCompileModuleList *modlist_head,
   assert(nullptr != finalModule);
 
   interruptPoint(context, "Generate bind functions");
-  generateBind(context, myJit, moduleInfo, *finalModule);
+  {
+    StageTimer timer(statistics, CompileStage::Bind);
+    statistics.setBindSpecializations(
+        generateBind(context, myJit, moduleInfo, *finalModule));
+  }
   dumpModule(context, *finalModule, DumpStage::MergedModule);
-  interruptPoint(context, "Optimize final module");
-  optimizeModule(context, myJit.getTargetMachine(), settings, *finalModule);
-
-  interruptPoint(context, "Verify final module");
-  verifyModule(context, *finalModule);
 
-  dumpModule(context, *finalModule, DumpStage::OptimizedModule);
+  auto entries = collectEntries(moduleInfo);
+  std::unordered_set<std::string> liveKeys;
+  for (auto &&entry : entries) {
+    liveKeys.insert(entry.key);
+  }
+  // The lazy compilation state is shared by the thunks, isolated contexts
+  // always compile eagerly.
+  if (context.lazyCompile && !isolated) {
+    interruptPoint(context, "Install lazy stubs");
+    JitFinaliser jitFinalizer(myJit);
+    installLazyStubs(context, myJit, settings, std::move(finalModule), entries,
+                     statsListener);
 
-  interruptPoint(context, "Codegen final module");
-  if (nullptr != context.dumpHandler) {
-    auto callback = [&](const char *str, size_t len) {
-      context.dumpHandler(context.dumpHandlerData, DumpStage::FinalAsm, str,
-                          len);
-    };
+    interruptPoint(context, "Update thunks and bind handles");
+    publishEntries(myJit, isolated, entries);
+    if (!context.async) {
+      myJit.removeStaleModules(liveKeys);
+    }
+    jitFinalizer.finalze();
+    statistics.setFunctions(entries.size(), 0);
+    statistics.report();
+    return;
+  }
+  if (!isolated) {
+    getLazyState().reset();
+  }
 
-    CallbackOstream os(callback);
-    if (myJit.addModule(std::move(finalModule), &os)) {
-      fatal(context, "Can't codegen module");
+  std::unordered_set<std::string> dirtyNames;
+  std::vector<GlobalsSet> entryDefs;
+  if (context.incremental) {
+    interruptPoint(context, "Hash entry points");
+    hashEntries(*finalModule, settings, context.profileMode, entries,
+                entryDefs);
+  }
+  GlobalsSet dirtyDefs;
+  bool reused = false;
+  std::size_t compiledCount = 0;
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    auto &entry = entries[i];
+    if (context.incremental) {
+      entry.address = myJit.getCompiledEntry(entry.key, entry.hash);
     }
-  } else {
-    if (myJit.addModule(std::move(finalModule), nullptr)) {
-      fatal(context, "Can't codegen module");
+    if (entry.address != nullptr) {
+      reused = true;
+      interruptPoint(context, "Reused", entry.funcName.c_str());
+    } else {
+      ++compiledCount;
+      dirtyNames.insert(entry.funcName);
+      if (context.incremental) {
+        dirtyDefs.insert(entryDefs[i].begin(), entryDefs[i].end());
+      }
     }
   }
 
   JitFinaliser jitFinalizer(myJit);
-  interruptPoint(context, "Resolve functions");
-  for (auto &&fun : moduleInfo.functions()) {
-    if (fun.thunkVar == nullptr) {
-      continue;
+  if (!dirtyNames.empty()) {
+    if (reused) {
+      interruptPoint(context, "Strip unchanged functions");
+      stripModuleTo(*finalModule, dirtyDefs, dirtyNames);
+    }
+
+    if (ProfileMode::Instrument == context.profileMode) {
+      interruptPoint(context, "Instrument final module");
+      myJit.getProfile().instrument(*finalModule);
+    } else if (ProfileMode::Use == context.profileMode) {
+      interruptPoint(context, "Apply profile");
+      myJit.getProfile().apply(*finalModule);
     }
-    auto decorated = decorate(fun.name, layout);
-    auto symbol = myJit.findSymbol(decorated);
-    auto addr = resolveSymbol(symbol);
-    if (nullptr == addr) {
-      std::string desc = std::string("Symbol not found in jitted code: \"") +
-                         fun.name.data() + "\" (\"" + decorated + "\")";
-      fatal(context, desc);
+    statistics.countModule(*finalModule);
+
+    auto &objectCache = myJit.getObjectCache();
+    objectCache.setCacheDir(context.cacheDir);
+    bool cached = false;
+    if (objectCache.enabled()) {
+      interruptPoint(context, "Lookup object cache");
+      cached = objectCache.lookup(*finalModule, myJit.getTargetMachine(),
+                                  settings.optLevel, settings.sizeLevel);
+    } else {
+      objectCache.reset();
+    }
+
+    auto asmCallback = [&](const char *str, size_t len) {
+      context.dumpHandler(context.dumpHandlerData, DumpStage::FinalAsm, str,
+                          len);
+    };
+    std::unique_ptr<CallbackOstream> asmListener;
+    if (nullptr != context.dumpHandler) {
+      asmListener.reset(new CallbackOstream(asmCallback));
+    }
+
+    myJit.beginModuleGroup();
+    if (cached) {
+      interruptPoint(context, "Object cache hit");
+      statistics.setObjectCacheHit();
+    } else if (context.threads > 1) {
+      interruptPoint(context, "Split final module");
+      auto partitions = splitModule(std::move(finalModule), context.threads);
+
+      interruptPoint(context, "Optimize and codegen partitions");
+      compilePartitions(context, myJit, settings, partitions);
+
+      interruptPoint(context, "Load partitions");
+      for (auto &&part : partitions) {
+        dumpModule(context, *part->module, DumpStage::OptimizedModule);
+        statistics.countOptimizedModule(*part->module);
+        // Sum of all threads, may exceed the total time.
+        statistics.addTime(CompileStage::Optimize, part->optimizeTime);
+        statistics.addTime(CompileStage::Codegen, part->codegenTime);
+        if (myJit.addObject(std::move(part->object), asmListener.get(),
+                            statsListener)) {
+          fatal(context, "Can't load jitted object");
+        }
+      }
     } else {
-      *fun.thunkVar = addr;
+      interruptPoint(context, "Optimize final module");
+      {
+        StageTimer timer(statistics, CompileStage::Optimize);
+        optimizeModule(context, myJit.getTargetMachine(), settings,
+                       *finalModule);
+
+        interruptPoint(context, "Verify final module");
+        verifyModule(context, *finalModule);
+      }
+
+      dumpModule(context, *finalModule, DumpStage::OptimizedModule);
+      statistics.countOptimizedModule(*finalModule);
     }
 
-    if (nullptr != context.interruptPointHandler) {
-      std::stringstream ss;
-      ss << fun.name.data() << " to " << addr;
-      auto str = ss.str();
-      interruptPoint(context, "Resolved", str.c_str());
+    if (nullptr != finalModule) {
+      interruptPoint(context, "Codegen final module");
+      StageTimer timer(statistics, CompileStage::Codegen);
+      if (myJit.addModule(std::move(finalModule), asmListener.get(),
+                          statsListener)) {
+        fatal(context, "Can't codegen module");
+      }
     }
+
+    interruptPoint(context, "Link jitted code");
+    StageTimer timer(statistics, CompileStage::Resolve);
+    if (myJit.finalizeModuleGroup()) {
+      fatal(context, "Can't link jitted code");
+    }
+
+    interruptPoint(context, "Resolve functions");
+    for (auto &&entry : entries) {
+      if (entry.address != nullptr) {
+        continue;
+      }
+      auto decorated = decorate(entry.funcName, layout);
+      auto symbol = myJit.findSymbol(decorated);
+      auto addr = resolveSymbol(symbol);
+      if (nullptr == addr) {
+        std::string desc = std::string("Symbol not found in jitted code: \"") +
+                           entry.funcName + "\" (\"" + decorated + "\")";
+        fatal(context, desc);
+      }
+      entry.address = addr;
+      myJit.addCompiledEntry(entry.key, entry.hash, addr, entry.bindHandle);
+
+      if (nullptr != context.interruptPointHandler) {
+        std::stringstream ss;
+        ss << entry.funcName << " to " << addr;
+        auto str = ss.str();
+        interruptPoint(context, "Resolved", str.c_str());
+      }
+    }
+  } else {
+    interruptPoint(context, "Nothing to recompile");
+  }
+
+  interruptPoint(context, "Update thunks and bind handles");
+  publishEntries(myJit, isolated, entries);
+  // Other threads may still be executing the previous code during an
+  // asynchronous compilation, stale modules are kept until the next
+  // synchronous one.
+  if (!context.async) {
+    myJit.removeStaleModules(liveKeys);
   }
-  interruptPoint(context, "Update bind handles");
-  applyBind(context, myJit, moduleInfo);
   jitFinalizer.finalze();
+
+  statistics.setFunctions(entries.size(), compiledCount);
+  statistics.report();
 }
 
 } // anon namespace
@@ -441,8 +1191,10 @@ EXTERNAL void JIT_API_ENTRYPOINT(const void *modlist_head,
                                  const Context *context, size_t contextSize) {
   assert(nullptr != context);
   assert(sizeof(*context) == contextSize);
+  JITContext &myJit = getJit(*context);
+  std::lock_guard<std::mutex> lock(myJit.getMutex());
   rtCompileProcessImplSoInternal(
-      static_cast<const RtCompileModuleList *>(modlist_head), *context);
+      static_cast<const RtCompileModuleList *>(modlist_head), *context, myJit);
 }
 
 EXTERNAL void JIT_REG_BIND_PAYLOAD(void *handle, void *originalFunc,
@@ -452,13 +1204,44 @@ EXTERNAL void JIT_REG_BIND_PAYLOAD(void *handle, void *originalFunc,
   assert(originalFunc != nullptr);
   assert(exampleFunc != nullptr);
   JITContext &myJit = getJit();
+  std::lock_guard<std::mutex> lock(myJit.getMutex());
   myJit.registerBind(handle, originalFunc, exampleFunc,
                      toArray(params, paramsSize));
 }
 
+EXTERNAL void JIT_RELEASE_UNUSED_CODE() {
+  JITContext &myJit = getJit();
+  std::lock_guard<std::mutex> lock(myJit.getMutex());
+  myJit.removeUnusedModules();
+}
+
 EXTERNAL void JIT_UNREG_BIND_PAYLOAD(void *handle) {
   assert(handle != nullptr);
   JITContext &myJit = getJit();
+  std::lock_guard<std::mutex> lock(myJit.getMutex());
   myJit.unregisterBind(handle);
 }
+
+EXTERNAL void *JIT_CREATE_CONTEXT() { return new JITContext(); }
+
+EXTERNAL void JIT_DESTROY_CONTEXT(void *jitContext) {
+  assert(jitContext != nullptr);
+  delete static_cast<JITContext *>(jitContext);
+}
+
+EXTERNAL void JIT_SET_CONTEXT_CONST(void *jitContext, const void *var,
+                                    const void *value, size_t size) {
+  assert(jitContext != nullptr);
+  auto &myJit = *static_cast<JITContext *>(jitContext);
+  std::lock_guard<std::mutex> lock(myJit.getMutex());
+  myJit.setConstOverride(var, value, size);
+}
+
+EXTERNAL void *JIT_GET_CONTEXT_FUNCTION(void *jitContext, const void *func) {
+  assert(jitContext != nullptr);
+  assert(func != nullptr);
+  auto &myJit = *static_cast<JITContext *>(jitContext);
+  std::lock_guard<std::mutex> lock(myJit.getMutex());
+  return myJit.getFunctionAddress(func);
+}
 }
@@ -26,6 +26,17 @@ enum class DumpStage : int {
   FinalAsm = 3
 };
 
+enum class ProfileMode : int { None = 0, Instrument = 1, Use = 2 };
+
+enum class VerifyMode : int { All = 0, Generated = 1, None = 2 };
+
+// Flags of Context::profilerEvents.
+enum ProfilerEvents : unsigned {
+  ProfilerEventsPerfMap = 1,
+  ProfilerEventsJitDump = 2,
+  ProfilerEventsIntelJit = 4
+};
+
 enum { ApiVersion = LDC_DYNAMIC_COMPILE_API_VERSION };
 
 #ifdef _WIN32
@@ -44,12 +55,49 @@ enum { ApiVersion = LDC_DYNAMIC_COMPILE_API_VERSION };
 #define JIT_UNREG_BIND_PAYLOAD                                                 \
   MAKE_JIT_API_CALL(unregisterBindPayloadImplSo,                               \
                     LDC_DYNAMIC_COMPILE_API_VERSION)
+#define JIT_RELEASE_UNUSED_CODE                                                \
+  MAKE_JIT_API_CALL(releaseUnusedCodeImplSo, LDC_DYNAMIC_COMPILE_API_VERSION)
+#define JIT_CREATE_CONTEXT                                                     \
+  MAKE_JIT_API_CALL(createJitContextImplSo, LDC_DYNAMIC_COMPILE_API_VERSION)
+#define JIT_DESTROY_CONTEXT                                                    \
+  MAKE_JIT_API_CALL(destroyJitContextImplSo, LDC_DYNAMIC_COMPILE_API_VERSION)
+#define JIT_SET_CONTEXT_CONST                                                  \
+  MAKE_JIT_API_CALL(setJitContextConstImplSo, LDC_DYNAMIC_COMPILE_API_VERSION)
+#define JIT_GET_CONTEXT_FUNCTION                                               \
+  MAKE_JIT_API_CALL(getJitContextFunctionImplSo,                               \
+                    LDC_DYNAMIC_COMPILE_API_VERSION)
 
 typedef void (*InterruptPointHandlerT)(void *, const char *action,
                                        const char *object);
 typedef void (*FatalHandlerT)(void *, const char *reason);
 typedef void (*DumpHandlerT)(void *, DumpStage stage, const char *str,
                              std::size_t len);
+typedef void (*FunctionStatsHandlerT)(void *, const char *name,
+                                      uint64_t instructions,
+                                      uint64_t codeSize);
+// Writes up to `len` bytes of the demangled `name` to `buf` and returns the
+// length of the demangled name, 0 if it can't be demangled.
+typedef std::size_t (*DemangleHandlerT)(const char *name, char *buf,
+                                        std::size_t len);
+
+// Durations are in nanoseconds.
+struct Statistics final {
+  uint64_t totalTime = 0;
+  uint64_t parseTime = 0;
+  uint64_t linkTime = 0;
+  uint64_t bindTime = 0;
+  uint64_t optimizeTime = 0;
+  uint64_t codegenTime = 0;
+  uint64_t resolveTime = 0;
+  uint64_t irSize = 0;
+  uint64_t instructions = 0;
+  uint64_t optimizedInstructions = 0;
+  uint64_t codeSize = 0;
+  uint32_t functions = 0;
+  uint32_t compiledFunctions = 0;
+  uint32_t bindSpecializations = 0;
+  bool objectCacheHit = false;
+};
 
 struct Context final {
   unsigned optLevel = 0;
@@ -60,6 +108,24 @@ struct Context final {
   void *fatalHandlerData = nullptr;
   DumpHandlerT dumpHandler = nullptr;
   void *dumpHandlerData = nullptr;
+  const char *cacheDir = nullptr;
+  bool incremental = false;
+  bool async = false;
+  unsigned threads = 0;
+  ProfileMode profileMode = ProfileMode::None;
+  const char *cpu = nullptr;
+  const char *features = nullptr;
+  unsigned preferVectorWidth = 0;
+  Statistics *statistics = nullptr;
+  FunctionStatsHandlerT functionStatsHandler = nullptr;
+  void *functionStatsHandlerData = nullptr;
+  bool lazyCompile = false;
+  VerifyMode verifyMode = VerifyMode::All;
+  // Isolated context created by JIT_CREATE_CONTEXT, null for the default one.
+  void *jitContext = nullptr;
+  unsigned profilerEvents = 0;
+  DemangleHandlerT demangleHandler = nullptr;
+  bool hugePages = false;
 };
 
 #endif // CONTEXT_H
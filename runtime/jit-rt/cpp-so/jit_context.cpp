@@ -15,13 +15,16 @@
 #include "jit_context.h"
 
 #include <cassert>
+#include <mutex>
 
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/ExecutionEngine/RuntimeDyld.h"
-#include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Target/TargetMachine.h"
@@ -39,10 +42,22 @@ llvm::SmallVector<std::string, 4> getHostAttrs() {
   return features;
 }
 
+// Initializes the native target once for all contexts, which may be created
+// concurrently. LLVM is shut down on unloading, after the default context was
+// destroyed.
+void initializeNativeTarget() {
+  static std::once_flag initialized;
+  static std::unique_ptr<llvm::llvm_shutdown_obj> shutdownObj;
+  std::call_once(initialized, []() {
+    shutdownObj.reset(new llvm::llvm_shutdown_obj());
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetDisassembler();
+    llvm::InitializeNativeTargetAsmPrinter();
+  });
+}
+
 std::unique_ptr<llvm::TargetMachine> createTargetMachine() {
-  llvm::InitializeNativeTarget();
-  llvm::InitializeNativeTargetDisassembler();
-  llvm::InitializeNativeTargetAsmPrinter();
+  initializeNativeTarget();
 
   std::string triple(llvm::sys::getProcessTriple());
   std::string error;
@@ -78,44 +93,70 @@ auto getSymbolInProcess(const std::string &name)
 } // anon namespace
 
 JITContext::ListenerCleaner::ListenerCleaner(JITContext &o,
-                                             llvm::raw_ostream *stream)
+                                             llvm::raw_ostream *stream,
+                                             StatisticsCollector *statistics)
     : owner(o) {
   owner.listenerlayer.getTransform().stream = stream;
+  owner.listenerlayer.getTransform().statistics = statistics;
 }
 
 JITContext::ListenerCleaner::~ListenerCleaner() {
   owner.listenerlayer.getTransform().stream = nullptr;
+  owner.listenerlayer.getTransform().statistics = nullptr;
 }
 
 JITContext::JITContext()
     : targetmachine(createTargetMachine()),
       dataLayout(targetmachine->createDataLayout()),
+      eventNotifier(dataLayout),
+      codePool(std::make_shared<MemoryPool>(/*executable=*/true)),
+      dataPool(std::make_shared<MemoryPool>(/*executable=*/false)),
 #if LDC_LLVM_VER >= 700
       stringPool(std::make_shared<llvm::orc::SymbolStringPool>()),
       execSession(stringPool), resolver(createResolver()),
       objectLayer(execSession,
                   [this](llvm::orc::VModuleKey) {
                     return llvm::orc::RTDyldObjectLinkingLayer::Resources{
-                        std::make_shared<llvm::SectionMemoryManager>(),
+                        std::make_shared<PooledMemoryManager>(codePool,
+                                                              dataPool),
                         resolver};
+                  },
+                  [this](llvm::orc::VModuleKey,
+                         const llvm::object::ObjectFile &obj,
+                         const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+                    eventNotifier.notifyLoaded(obj, info);
                   }),
 #else
       objectLayer(
-          []() { return std::make_shared<llvm::SectionMemoryManager>(); }),
+          [this]() {
+            return std::make_shared<PooledMemoryManager>(codePool, dataPool);
+          },
+          [this](ObjectLayerT::ObjHandleT, const ObjectLayerT::ObjectPtr &obj,
+                 const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+            eventNotifier.notifyLoaded(*obj->getBinary(), info);
+          }),
 #endif
       listenerlayer(objectLayer, ModuleListener(*targetmachine)),
-      compileLayer(listenerlayer, llvm::orc::SimpleCompiler(*targetmachine)) {
+      compileLayer(listenerlayer,
+                   llvm::orc::SimpleCompiler(*targetmachine, &objectCache)) {
   llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
 }
 
 JITContext::~JITContext() {}
 
+std::unique_ptr<llvm::TargetMachine> JITContext::createTargetMachine() const {
+  return ::createTargetMachine();
+}
+
+void JITContext::beginModuleGroup() { moduleGroups.emplace_back(); }
+
 bool JITContext::addModule(std::unique_ptr<llvm::Module> module,
-                           llvm::raw_ostream *asmListener) {
+                           llvm::raw_ostream *asmListener,
+                           StatisticsCollector *statistics) {
   assert(nullptr != module);
-  reset();
+  assert(!moduleGroups.empty());
 
-  ListenerCleaner cleaner(*this, asmListener);
+  ListenerCleaner cleaner(*this, asmListener, statistics);
   // Add the set to the JIT with the resolver we created above
 #if LDC_LLVM_VER >= 700
   auto handle = execSession.allocateVModule();
@@ -124,20 +165,157 @@ bool JITContext::addModule(std::unique_ptr<llvm::Module> module,
     execSession.releaseVModule(handle);
     return true;
   }
-  moduleHandle = handle;
+  moduleGroups.back().push_back(handle);
 #else
   auto result = compileLayer.addModule(std::move(module), createResolver());
   if (!result) {
     return true;
   }
-  moduleHandle = result.get();
+  moduleGroups.back().push_back(result.get());
 #endif
-  compiled = true;
+  return false;
+}
+
+bool JITContext::addObject(CompiledObject object,
+                           llvm::raw_ostream *asmListener,
+                           StatisticsCollector *statistics) {
+  assert(!moduleGroups.empty());
+
+  ListenerCleaner cleaner(*this, asmListener, statistics);
+#if LDC_LLVM_VER >= 700
+  auto handle = execSession.allocateVModule();
+  auto result = listenerlayer.addObject(handle, std::move(object));
+  if (result) {
+    llvm::consumeError(std::move(result));
+    execSession.releaseVModule(handle);
+    return true;
+  }
+  moduleGroups.back().push_back(handle);
+#else
+  auto result = listenerlayer.addObject(
+      std::make_shared<CompiledObject>(std::move(object)), createResolver());
+  if (!result) {
+    llvm::consumeError(result.takeError());
+    return true;
+  }
+  moduleGroups.back().push_back(result.get());
+#endif
+  return false;
+}
+
+bool JITContext::finalizeModuleGroup() {
+  assert(!moduleGroups.empty());
+  for (auto &&handle : moduleGroups.back()) {
+    if (auto err = compileLayer.emitAndFinalize(handle)) {
+      llvm::consumeError(std::move(err));
+      return true;
+    }
+  }
   return false;
 }
 
 llvm::JITSymbol JITContext::findSymbol(const std::string &name) {
-  return compileLayer.findSymbol(name, false);
+  assert(!moduleGroups.empty());
+  for (auto &&handle : moduleGroups.back()) {
+    auto sym = compileLayer.findSymbolIn(handle, name, false);
+    if (sym) {
+      return sym;
+    }
+    if (auto err = sym.takeError()) {
+      return std::move(err);
+    }
+  }
+  return nullptr;
+}
+
+void *JITContext::getCompiledEntry(const std::string &key,
+                                   llvm::StringRef hash) const {
+  auto it = compiledEntries.find(key);
+  if (compiledEntries.end() == it || it->second.hash != hash) {
+    return nullptr;
+  }
+  return it->second.address;
+}
+
+void JITContext::addCompiledEntry(const std::string &key, std::string hash,
+                                  void *address, void *bindHandle) {
+  assert(!moduleGroups.empty());
+  assert(nullptr != address);
+  auto &entry = compiledEntries[key];
+  entry.hash = std::move(hash);
+  entry.address = address;
+  entry.bindHandle = bindHandle;
+  entry.group = std::prev(moduleGroups.end());
+}
+
+void JITContext::removeStaleModules(
+    const std::unordered_set<std::string> &liveKeys) {
+  for (auto it = compiledEntries.begin(); it != compiledEntries.end();) {
+    if (liveKeys.count(it->first) == 0) {
+      it = compiledEntries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  removeUnusedModules();
+}
+
+void JITContext::removeUnusedModules() {
+  for (auto it = moduleGroups.begin(); it != moduleGroups.end();) {
+    bool used = false;
+    for (auto &&entry : compiledEntries) {
+      if (entry.second.group == it) {
+        used = true;
+        break;
+      }
+    }
+    if (used) {
+      ++it;
+    } else {
+      for (auto &&handle : *it) {
+        removeModule(handle);
+      }
+      it = moduleGroups.erase(it);
+    }
+  }
+}
+
+const llvm::Module *JITContext::getParsedModule(llvm::StringRef irData) const {
+  auto it = parsedModules.find(irData.data());
+  if (parsedModules.end() == it || it->second.first != irData.size()) {
+    return nullptr;
+  }
+  return it->second.second.get();
+}
+
+void JITContext::addParsedModule(llvm::StringRef irData,
+                                 std::unique_ptr<llvm::Module> module) {
+  assert(nullptr != module);
+  parsedModules[irData.data()] = std::make_pair(irData.size(),
+                                                std::move(module));
+}
+
+void *JITContext::getFunctionAddress(const void *func) const {
+  auto it = functionAddresses.find(func);
+  return functionAddresses.end() != it ? it->second : nullptr;
+}
+
+void JITContext::setFunctionAddresses(
+    std::unordered_map<const void *, void *> addrs) {
+  functionAddresses = std::move(addrs);
+}
+
+void JITContext::setConstOverride(const void *var, const void *value,
+                                  std::size_t size) {
+  assert(nullptr != var);
+  assert(nullptr != value);
+  auto data = static_cast<const char *>(value);
+  constOverrides[var].assign(data, data + size);
+}
+
+const void *JITContext::getConstValue(const void *var) const {
+  auto it = constOverrides.find(var);
+  return constOverrides.end() != it ? it->second.data() : var;
 }
 
 void JITContext::clearSymMap() { symMap.clear(); }
@@ -147,11 +325,14 @@ void JITContext::addSymbol(std::string &&name, void *value) {
 }
 
 void JITContext::reset() {
-  if (compiled) {
-    removeModule(moduleHandle);
-    moduleHandle = {};
-    compiled = false;
+  compiledEntries.clear();
+  functionAddresses.clear();
+  for (auto &&group : moduleGroups) {
+    for (auto &&handle : group) {
+      removeModule(handle);
+    }
   }
+  moduleGroups.clear();
 }
 
 void JITContext::registerBind(void *handle, void *originalFunc,
@@ -165,6 +346,13 @@ void JITContext::registerBind(void *handle, void *originalFunc,
 void JITContext::unregisterBind(void *handle) {
   assert(bindInstances.count(handle) == 1);
   bindInstances.erase(handle);
+  for (auto it = compiledEntries.begin(); it != compiledEntries.end();) {
+    if (it->second.bindHandle == handle) {
+      it = compiledEntries.erase(it);
+    } else {
+      ++it;
+    }
+  }
 }
 
 bool JITContext::hasBindFunction(const void *handle) const {
@@ -185,6 +373,15 @@ std::shared_ptr<llvm::orc::SymbolResolver> JITContext::createResolver() {
   return llvm::orc::createLegacyLookupResolver(
       execSession,
       [this](const std::string &name) -> llvm::JITSymbol {
+        // Prefer definitions from the group being linked, older groups may
+        // contain stale code with the same names.
+        if (!moduleGroups.empty()) {
+          if (auto Sym = findSymbol(name)) {
+            return Sym;
+          } else if (auto Err = Sym.takeError()) {
+            return std::move(Err);
+          }
+        }
         if (auto Sym = compileLayer.findSymbol(name, false)) {
           return Sym;
         } else if (auto Err = Sym.takeError()) {
@@ -213,6 +410,13 @@ std::shared_ptr<llvm::JITSymbolResolver> JITContext::createResolver() {
   // Lambda 2: Search for external symbols in the host process.
   return llvm::orc::createLambdaResolver(
       [this](const std::string &name) {
+        // Prefer definitions from the group being linked, older groups may
+        // contain stale code with the same names.
+        if (!moduleGroups.empty()) {
+          if (auto Sym = findSymbol(name)) {
+            return Sym;
+          }
+        }
         if (auto Sym = compileLayer.findSymbol(name, false)) {
           return Sym;
         }
@@ -15,9 +15,15 @@
 #ifndef JIT_CONTEXT_H
 #define JIT_CONTEXT_H
 
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "llvm/ADT/MapVector.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
@@ -27,7 +33,6 @@
 #include "llvm/ExecutionEngine/Orc/ObjectTransformLayer.h"
 #include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
 #include "llvm/IR/LLVMContext.h"
-#include "llvm/Support/ManagedStatic.h"
 
 #if LDC_LLVM_VER >= 700
 #include "llvm/ExecutionEngine/Orc/Legacy.h"
@@ -35,6 +40,11 @@
 
 #include "context.h"
 #include "disassembler.h"
+#include "jit_events.h"
+#include "jit_profile.h"
+#include "memory_manager.h"
+#include "object_cache.h"
+#include "statistics.h"
 
 namespace llvm {
 class raw_ostream;
@@ -48,26 +58,41 @@ private:
   struct ModuleListener {
     llvm::TargetMachine &targetmachine;
     llvm::raw_ostream *stream = nullptr;
+    StatisticsCollector *statistics = nullptr;
 
     ModuleListener(llvm::TargetMachine &tm) : targetmachine(tm) {}
 
     template <typename T> auto operator()(T &&object) -> T {
-      if (nullptr != stream) {
+      if (nullptr != stream || nullptr != statistics) {
 #if LDC_LLVM_VER >= 700
         auto objFile =
             llvm::cantFail(llvm::object::ObjectFile::createObjectFile(
                 object->getMemBufferRef()));
-        disassemble(targetmachine, *objFile, *stream);
+        auto &obj = *objFile;
 #else
-        disassemble(targetmachine, *object->getBinary(), *stream);
+        auto &obj = *object->getBinary();
 #endif
+        if (nullptr != stream) {
+          disassemble(targetmachine, obj, *stream);
+        }
+        if (nullptr != statistics) {
+          statistics->countObject(obj);
+        }
       }
       return std::move(object);
     }
   };
-  llvm::llvm_shutdown_obj shutdownObj;
+  // Serializes compilations in this context, which may run on a background
+  // thread, with bind payload registration.
+  std::mutex mutex;
   std::unique_ptr<llvm::TargetMachine> targetmachine;
   const llvm::DataLayout dataLayout;
+  DiskObjectCache objectCache;
+  JitProfile profile;
+  JitEventNotifier eventNotifier;
+  // Shared by the memory managers of all loaded objects.
+  std::shared_ptr<MemoryPool> codePool;
+  std::shared_ptr<MemoryPool> dataPool;
   using ObjectLayerT = llvm::orc::RTDyldObjectLinkingLayer;
   using ListenerLayerT =
       llvm::orc::ObjectTransformLayer<ObjectLayerT, ModuleListener>;
@@ -85,10 +110,31 @@ private:
   ListenerLayerT listenerlayer;
   CompileLayerT compileLayer;
   llvm::LLVMContext context;
-  bool compiled = false;
-  ModuleHandleT moduleHandle;
+  // Each compilation adds a group of modules which may reference each other
+  // and are removed together.
+  using ModuleGroup = std::vector<ModuleHandleT>;
+  std::list<ModuleGroup> moduleGroups;
   SymMap symMap;
 
+  // Jitted entry points (thunked functions and bind handles) which are still
+  // in use, keyed by name. The hash describes the IR the code was generated
+  // from, so unchanged entry points can be reused by the next compilation.
+  struct CompiledEntry final {
+    std::string hash;
+    void *address;
+    void *bindHandle;
+    std::list<ModuleGroup>::iterator group;
+  };
+  std::unordered_map<std::string, CompiledEntry> compiledEntries;
+
+  // Thunked functions of an isolated context, whose thunks aren't updated,
+  // keyed by the address of the function in the program.
+  std::unordered_map<const void *, void *> functionAddresses;
+
+  // Values of @dynamicCompileConst variables overridden for this context,
+  // keyed by the address of the variable.
+  std::unordered_map<const void *, std::vector<char>> constOverrides;
+
   struct BindDesc final {
     void *originalFunc;
     void *exampleFunc;
@@ -97,26 +143,97 @@ private:
   };
   llvm::MapVector<void *, BindDesc> bindInstances;
 
+  // Parsed and verified modules of the program keyed by their IR data, which
+  // are cloned by subsequent compilations instead of being parsed again.
+  std::unordered_map<const char *, std::pair<std::size_t,
+                                             std::unique_ptr<llvm::Module>>>
+      parsedModules;
+
   struct ListenerCleaner final {
     JITContext &owner;
-    ListenerCleaner(JITContext &o, llvm::raw_ostream *stream);
+    ListenerCleaner(JITContext &o, llvm::raw_ostream *stream,
+                    StatisticsCollector *statistics);
     ~ListenerCleaner();
   };
 
 public:
+  using CompiledObject = llvm::orc::SimpleCompiler::CompileResult;
+
   JITContext();
   ~JITContext();
 
+  std::mutex &getMutex() { return mutex; }
   llvm::TargetMachine &getTargetMachine() { return *targetmachine; }
   const llvm::DataLayout &getDataLayout() const { return dataLayout; }
+  DiskObjectCache &getObjectCache() { return objectCache; }
+  JitProfile &getProfile() { return profile; }
+  JitEventNotifier &getEventNotifier() { return eventNotifier; }
+
+  // Backs subsequently allocated code regions with huge pages.
+  void setHugePages(bool enable) { codePool->setHugePages(enable); }
+
+  // Creates a target machine for the host, e.g. for compiling on another
+  // thread.
+  std::unique_ptr<llvm::TargetMachine> createTargetMachine() const;
+
+  // Starts a new module group, subsequently added modules and objects are
+  // put into it.
+  void beginModuleGroup();
 
   bool addModule(std::unique_ptr<llvm::Module> module,
-                 llvm::raw_ostream *asmListener);
+                 llvm::raw_ostream *asmListener,
+                 StatisticsCollector *statistics = nullptr);
+
+  bool addObject(CompiledObject object, llvm::raw_ostream *asmListener,
+                 StatisticsCollector *statistics = nullptr);
+
+  // Links all modules of the current group.
+  bool finalizeModuleGroup();
 
+  // Looks up `name` in the current module group.
   llvm::JITSymbol findSymbol(const std::string &name);
 
+  // Returns the address of a previously compiled entry point if it was
+  // compiled from IR with the same hash, null otherwise.
+  void *getCompiledEntry(const std::string &key, llvm::StringRef hash) const;
+
+  // Records an entry point compiled into the current module group,
+  // `bindHandle` is null for thunked functions.
+  void addCompiledEntry(const std::string &key, std::string hash,
+                        void *address, void *bindHandle);
+
+  // Forgets entry points not in `liveKeys` and removes module groups which do
+  // not contain any entry point anymore.
+  void removeStaleModules(const std::unordered_set<std::string> &liveKeys);
+
+  // Removes module groups which do not contain any entry point anymore, e.g.
+  // because all bind instances using them were destroyed.
+  void removeUnusedModules();
+
   llvm::LLVMContext &getContext() { return context; }
 
+  // Returns the module parsed from `irData` before, null if there is none.
+  const llvm::Module *getParsedModule(llvm::StringRef irData) const;
+
+  // Keeps `module` parsed from `irData`, which must not be changed anymore.
+  void addParsedModule(llvm::StringRef irData,
+                       std::unique_ptr<llvm::Module> module);
+
+  // Returns the jitted code of the thunked function `func` of an isolated
+  // context, null if it wasn't compiled.
+  void *getFunctionAddress(const void *func) const;
+
+  // Replaces the addresses returned by getFunctionAddress().
+  void setFunctionAddresses(std::unordered_map<const void *, void *> addrs);
+
+  // Compiles the @dynamicCompileConst variable at `var` with a copy of `value`
+  // instead of its current value.
+  void setConstOverride(const void *var, const void *value, std::size_t size);
+
+  // Returns the value to compile the @dynamicCompileConst variable at `var`
+  // with.
+  const void *getConstValue(const void *var) const;
+
   void clearSymMap();
 
   void addSymbol(std::string &&name, void *value);
@@ -0,0 +1,191 @@
+//===-- jit_events.cpp ----------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "jit_events.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+
+namespace {
+
+const char *const envVarName = "LDC_DYNAMIC_COMPILE_PROFILER";
+
+// Parses a comma-separated list of "perfmap", "jitdump" and "intel".
+unsigned getEnvEvents() {
+  const char *env = std::getenv(envVarName);
+  if (nullptr == env) {
+    return 0;
+  }
+  llvm::SmallVector<llvm::StringRef, 3> names;
+  llvm::StringRef(env).split(names, ',', -1, false);
+  unsigned ret = 0;
+  for (auto &&name : names) {
+    const auto trimmed = name.trim();
+    if (trimmed == "perfmap") {
+      ret |= ProfilerEventsPerfMap;
+    } else if (trimmed == "jitdump") {
+      ret |= ProfilerEventsJitDump;
+    } else if (trimmed == "intel") {
+      ret |= ProfilerEventsIntelJit;
+    }
+  }
+  return ret;
+}
+
+int getProcessId() {
+#ifdef _WIN32
+  return _getpid();
+#else
+  return static_cast<int>(getpid());
+#endif
+}
+
+// /tmp/perf-<pid>.map, shared by all contexts of the process.
+class PerfMap final {
+  std::mutex mutex;
+  std::FILE *file = nullptr;
+  bool opened = false;
+
+public:
+  ~PerfMap() {
+    if (nullptr != file) {
+      std::fclose(file);
+    }
+  }
+
+  void write(uint64_t address, uint64_t size, const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!opened) {
+      opened = true;
+      const auto path = "/tmp/perf-" + std::to_string(getProcessId()) + ".map";
+      file = std::fopen(path.c_str(), "a");
+    }
+    if (nullptr == file) {
+      return;
+    }
+    std::fprintf(file, "%" PRIx64 " %" PRIx64 " %s\n", address, size,
+                 name.c_str());
+    // perf may read the map while the process is still running.
+    std::fflush(file);
+  }
+};
+
+PerfMap &getPerfMap() {
+  static PerfMap map;
+  return map;
+}
+
+std::string demangle(DemangleHandlerT handler, const std::string &name) {
+  if (nullptr != handler) {
+    char buffer[1024];
+    const auto len = handler(name.c_str(), buffer, sizeof(buffer));
+    if (0 != len) {
+      return std::string(buffer, std::min(len, sizeof(buffer)));
+    }
+  }
+  return name;
+}
+
+} // anon namespace
+
+JitEventNotifier::JitEventNotifier(const llvm::DataLayout &layout)
+    : globalPrefix(layout.getGlobalPrefix()) {}
+
+JitEventNotifier::~JitEventNotifier() {}
+
+void JitEventNotifier::setEvents(unsigned contextEvents,
+                                 DemangleHandlerT demangler) {
+  events = contextEvents | getEnvEvents();
+  demangleHandler = demangler;
+#if LDC_LLVM_VER >= 700
+  // Null if LLVM was built without LLVM_USE_PERF.
+  if ((events & ProfilerEventsJitDump) != 0 && nullptr == perfListener) {
+    perfListener = llvm::JITEventListener::createPerfJITEventListener();
+  }
+#endif
+  // Null if LLVM was built without LLVM_USE_INTEL_JITEVENTS.
+  if ((events & ProfilerEventsIntelJit) != 0 && nullptr == intelListener) {
+    intelListener.reset(llvm::JITEventListener::createIntelJITEventListener());
+  }
+}
+
+void JitEventNotifier::notifyLoaded(
+    const llvm::object::ObjectFile &object,
+    const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+  if ((events & ProfilerEventsPerfMap) != 0) {
+    writePerfMap(object, info);
+  }
+  if ((events & ProfilerEventsJitDump) != 0 && nullptr != perfListener) {
+    perfListener->NotifyObjectEmitted(object, info);
+  }
+  if ((events & ProfilerEventsIntelJit) != 0 && nullptr != intelListener) {
+    intelListener->NotifyObjectEmitted(object, info);
+  }
+}
+
+void JitEventNotifier::writePerfMap(
+    const llvm::object::ObjectFile &object,
+    const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+  for (auto &&sym : llvm::object::computeSymbolSizes(object)) {
+    auto type = sym.first.getType();
+    if (!type) {
+      llvm::consumeError(type.takeError());
+      continue;
+    }
+    if (llvm::object::SymbolRef::ST_Function != *type || 0 == sym.second) {
+      continue;
+    }
+    auto name = sym.first.getName();
+    if (!name) {
+      llvm::consumeError(name.takeError());
+      continue;
+    }
+    auto section = sym.first.getSection();
+    if (!section) {
+      llvm::consumeError(section.takeError());
+      continue;
+    }
+    auto address = sym.first.getAddress();
+    if (!address) {
+      llvm::consumeError(address.takeError());
+      continue;
+    }
+    if (object.section_end() == *section) {
+      continue;
+    }
+    const uint64_t loadAddress = info.getSectionLoadAddress(**section);
+    if (0 == loadAddress) {
+      continue;
+    }
+
+    auto str = *name;
+    if ('\0' != globalPrefix && !str.empty() && globalPrefix == str.front()) {
+      str = str.drop_front();
+    }
+    getPerfMap().write(loadAddress + (*address - (*section)->getAddress()),
+                       sym.second, demangle(demangleHandler, str.str()));
+  }
+}
@@ -0,0 +1,57 @@
+//===-- jit_events.h - jit support ------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Jit runtime - shared library part.
+// Reports jitted code to external profilers.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef JIT_EVENTS_H
+#define JIT_EVENTS_H
+
+#include <memory>
+
+#include "llvm/ExecutionEngine/RuntimeDyld.h"
+
+#include "context.h"
+
+namespace llvm {
+class DataLayout;
+class JITEventListener;
+namespace object {
+class ObjectFile;
+}
+} // namespace llvm
+
+// Tells profilers selected by Context::profilerEvents and the
+// LDC_DYNAMIC_COMPILE_PROFILER environment variable about loaded objects.
+// Freed code isn't reported, perf maps and jitdumps have no means for that.
+class JitEventNotifier final {
+  const char globalPrefix;
+  unsigned events = 0;
+  DemangleHandlerT demangleHandler = nullptr;
+  // Owned by LLVM.
+  llvm::JITEventListener *perfListener = nullptr;
+  std::unique_ptr<llvm::JITEventListener> intelListener;
+
+  void writePerfMap(const llvm::object::ObjectFile &object,
+                    const llvm::RuntimeDyld::LoadedObjectInfo &info);
+
+public:
+  explicit JitEventNotifier(const llvm::DataLayout &layout);
+  ~JitEventNotifier();
+
+  // Selects the events reported for subsequently loaded objects.
+  void setEvents(unsigned contextEvents, DemangleHandlerT demangler);
+
+  void notifyLoaded(const llvm::object::ObjectFile &object,
+                    const llvm::RuntimeDyld::LoadedObjectInfo &info);
+};
+
+#endif // JIT_EVENTS_H
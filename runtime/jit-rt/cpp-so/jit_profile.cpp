@@ -0,0 +1,126 @@
+//===-- jit_profile.cpp ---------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "jit_profile.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Module.h"
+
+namespace {
+
+std::vector<llvm::BranchInst *> getConditionalBranches(llvm::Function &func) {
+  std::vector<llvm::BranchInst *> ret;
+  for (auto &&bb : func) {
+    auto br = llvm::dyn_cast<llvm::BranchInst>(bb.getTerminator());
+    if (br != nullptr && br->isConditional()) {
+      ret.push_back(br);
+    }
+  }
+  return ret;
+}
+
+void emitIncrement(llvm::IRBuilder<> &builder, llvm::Value *counters,
+                   llvm::Value *index) {
+  auto ptr = builder.CreateInBoundsGEP(counters, index);
+  auto val = builder.CreateLoad(ptr);
+  builder.CreateStore(builder.CreateAdd(val, builder.getInt64(1)), ptr);
+}
+
+} // anon namespace
+
+JitProfile::JitProfile() {}
+
+JitProfile::~JitProfile() {}
+
+uint64_t *JitProfile::getCounters(const std::string &name, std::size_t size) {
+  auto &counters = functions[name];
+  if (counters.size != size) {
+    if (counters.data != nullptr) {
+      retired.push_back(std::move(counters.data));
+    }
+    counters.data.reset(new uint64_t[size]());
+    counters.size = size;
+  }
+  return counters.data.get();
+}
+
+void JitProfile::instrument(llvm::Module &module) {
+  auto &context = module.getContext();
+  auto counterPtrType = llvm::Type::getInt64PtrTy(context);
+  auto intPtrType = module.getDataLayout().getIntPtrType(context);
+  for (auto &&func : module.functions()) {
+    if (func.isDeclaration()) {
+      continue;
+    }
+    auto branches = getConditionalBranches(func);
+    auto counters = getCounters(func.getName().str(), 1 + 2 * branches.size());
+    auto base = llvm::ConstantExpr::getIntToPtr(
+        llvm::ConstantInt::get(intPtrType,
+                               reinterpret_cast<uintptr_t>(counters)),
+        counterPtrType);
+
+    auto it = func.getEntryBlock().getFirstInsertionPt();
+    while (llvm::isa<llvm::AllocaInst>(*it)) {
+      ++it;
+    }
+    llvm::IRBuilder<> builder(&*it);
+    emitIncrement(builder, base, builder.getInt64(0));
+
+    for (std::size_t i = 0; i < branches.size(); ++i) {
+      auto br = branches[i];
+      builder.SetInsertPoint(br);
+      auto index =
+          builder.CreateSelect(br->getCondition(), builder.getInt64(1 + 2 * i),
+                               builder.getInt64(2 + 2 * i));
+      emitIncrement(builder, base, index);
+    }
+  }
+}
+
+void JitProfile::apply(llvm::Module &module) const {
+  llvm::MDBuilder mdBuilder(module.getContext());
+  for (auto &&func : module.functions()) {
+    if (func.isDeclaration()) {
+      continue;
+    }
+    auto it = functions.find(func.getName().str());
+    if (functions.end() == it) {
+      continue;
+    }
+    auto branches = getConditionalBranches(func);
+    auto &counters = it->second;
+    if (counters.size != 1 + 2 * branches.size()) {
+      continue;
+    }
+
+    func.setEntryCount(counters.data[0]);
+    for (std::size_t i = 0; i < branches.size(); ++i) {
+      uint64_t taken = counters.data[1 + 2 * i];
+      uint64_t notTaken = counters.data[2 + 2 * i];
+      if (taken == 0 && notTaken == 0) {
+        continue;
+      }
+      // Branch weights are 32 bit.
+      const uint64_t max = std::numeric_limits<uint32_t>::max();
+      const uint64_t scale = std::max(taken, notTaken) / max + 1;
+      branches[i]->setMetadata(
+          llvm::LLVMContext::MD_prof,
+          mdBuilder.createBranchWeights(static_cast<uint32_t>(taken / scale),
+                                        static_cast<uint32_t>(notTaken / scale)));
+    }
+  }
+}
@@ -0,0 +1,56 @@
+//===-- jit_profile.h - jit support -----------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Jit runtime - shared library part.
+// In-process edge profile of jitted functions.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef JIT_PROFILE_H
+#define JIT_PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+class Module;
+}
+
+// Each instrumented function gets an entry counter and a pair of counters for
+// each conditional branch, in host memory so they survive the jitted code.
+// The counters of a function are matched by name and branch count, which is
+// stable as long as the unoptimized IR doesn't change.
+class JitProfile final {
+  struct Counters final {
+    std::unique_ptr<uint64_t[]> data;
+    std::size_t size = 0;
+  };
+  std::unordered_map<std::string, Counters> functions;
+  // Counters replaced by differently shaped ones, older jitted code may still
+  // reference them.
+  std::vector<std::unique_ptr<uint64_t[]>> retired;
+
+  uint64_t *getCounters(const std::string &name, std::size_t size);
+
+public:
+  JitProfile();
+  ~JitProfile();
+
+  // Adds counter increments to all functions of the unoptimized module.
+  void instrument(llvm::Module &module);
+
+  // Attaches the collected counts as function entry counts and branch weights.
+  void apply(llvm::Module &module) const;
+};
+
+#endif // JIT_PROFILE_H
@@ -0,0 +1,248 @@
+//===-- memory_manager.cpp ------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "memory_manager.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <string>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Process.h"
+
+namespace {
+
+const std::size_t hugePageSize = 2 * 1024 * 1024;
+
+const unsigned readWrite =
+    llvm::sys::Memory::MF_READ | llvm::sys::Memory::MF_WRITE;
+
+std::size_t getPageSize() {
+  return static_cast<std::size_t>(llvm::sys::Process::getPageSize());
+}
+
+char *blockBegin(const llvm::sys::MemoryBlock &block) {
+  return static_cast<char *>(block.base());
+}
+
+char *blockEnd(const llvm::sys::MemoryBlock &block) {
+  return blockBegin(block) + block.size();
+}
+
+} // anon namespace
+
+MemoryPool::MemoryPool(bool exec) : executable(exec) {}
+
+MemoryPool::~MemoryPool() {
+  for (auto &&region : regions) {
+    llvm::sys::Memory::releaseMappedMemory(region.mapping);
+  }
+}
+
+void MemoryPool::addRegion(std::size_t size) {
+  const std::size_t regionSize =
+      llvm::alignTo(std::max(size, hugePageSize), hugePageSize);
+  // Keep regions close to each other, jitted code may reference other
+  // modules with 32-bit displacements.
+  const llvm::sys::MemoryBlock *near =
+      regions.empty() ? nullptr : &regions.back().mapping;
+  std::error_code ec;
+  if (executable && hugePages) {
+    // Over-allocate to align the region to the huge page size.
+    auto mapping = llvm::sys::Memory::allocateMappedMemory(
+        regionSize + hugePageSize, near,
+        readWrite | llvm::sys::Memory::MF_EXEC, ec);
+    if (!ec) {
+      auto base = reinterpret_cast<char *>(
+          llvm::alignTo(reinterpret_cast<uintptr_t>(mapping.base()),
+                        hugePageSize));
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+      madvise(base, regionSize, MADV_HUGEPAGE);
+#endif
+      regions.push_back({mapping, true});
+      insertFree({llvm::sys::MemoryBlock(base, regionSize), true});
+      return;
+    }
+    // Writable and executable mappings may be forbidden, fall back to small
+    // pages.
+  }
+  auto mapping =
+      llvm::sys::Memory::allocateMappedMemory(regionSize, near, readWrite, ec);
+  if (ec) {
+    return;
+  }
+  regions.push_back({mapping, false});
+  insertFree({mapping, false});
+}
+
+void MemoryPool::insertFree(Chunk chunk) {
+  auto base = blockBegin(chunk.block);
+  auto size = chunk.block.size();
+  auto next = freeChunks.lower_bound(base);
+  if (freeChunks.end() != next && base + size == next->first &&
+      next->second.writableCode == chunk.writableCode) {
+    size += next->second.block.size();
+    next = freeChunks.erase(next);
+  }
+  if (freeChunks.begin() != next) {
+    auto prev = std::prev(next);
+    if (blockEnd(prev->second.block) == base &&
+        prev->second.writableCode == chunk.writableCode) {
+      prev->second.block = llvm::sys::MemoryBlock(
+          prev->first, prev->second.block.size() + size);
+      return;
+    }
+  }
+  freeChunks.insert(
+      next, {base, {llvm::sys::MemoryBlock(base, size), chunk.writableCode}});
+}
+
+MemoryPool::Chunk MemoryPool::allocate(std::size_t size) {
+  size = llvm::alignTo(std::max<std::size_t>(size, 1), getPageSize());
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    for (auto it = freeChunks.begin(); it != freeChunks.end(); ++it) {
+      if (it->second.block.size() < size) {
+        continue;
+      }
+      Chunk ret = it->second;
+      freeChunks.erase(it);
+      if (ret.block.size() > size) {
+        insertFree({llvm::sys::MemoryBlock(blockBegin(ret.block) + size,
+                                           ret.block.size() - size),
+                    ret.writableCode});
+      }
+      ret.block = llvm::sys::MemoryBlock(ret.block.base(), size);
+      return ret;
+    }
+    addRegion(size);
+  }
+  return Chunk();
+}
+
+void MemoryPool::release(Chunk chunk) {
+  if (nullptr == chunk.block.base()) {
+    return;
+  }
+  if (!chunk.writableCode) {
+    llvm::sys::Memory::protectMappedMemory(chunk.block, readWrite);
+  }
+  insertFree(chunk);
+}
+
+PooledMemoryManager::PooledMemoryManager(std::shared_ptr<MemoryPool> code,
+                                         std::shared_ptr<MemoryPool> data)
+    : codePool(std::move(code)), dataPool(std::move(data)) {
+  assert(nullptr != codePool);
+  assert(nullptr != dataPool);
+}
+
+PooledMemoryManager::~PooledMemoryManager() {
+  for (auto &&allocation : code) {
+    codePool->release(allocation.chunk);
+  }
+  for (auto &&allocation : roData) {
+    dataPool->release(allocation.chunk);
+  }
+  for (auto &&allocation : rwData) {
+    dataPool->release(allocation.chunk);
+  }
+}
+
+void PooledMemoryManager::reserveAllocationSpace(
+    uintptr_t codeSize, uint32_t codeAlign, uintptr_t roDataSize,
+    uint32_t roDataAlign, uintptr_t rwDataSize, uint32_t rwDataAlign) {
+  auto reserve = [](MemoryPool &pool, std::vector<Allocation> &allocations,
+                    uintptr_t size, uint32_t alignment) {
+    if (0 == size) {
+      return;
+    }
+    Allocation allocation;
+    allocation.chunk = pool.allocate(size + alignment);
+    if (nullptr != allocation.chunk.block.base()) {
+      allocations.push_back(allocation);
+    }
+  };
+  reserve(*codePool, code, codeSize, codeAlign);
+  reserve(*dataPool, roData, roDataSize, roDataAlign);
+  reserve(*dataPool, rwData, rwDataSize, rwDataAlign);
+}
+
+uint8_t *PooledMemoryManager::allocateIn(MemoryPool &pool,
+                                         std::vector<Allocation> &allocations,
+                                         uintptr_t size, unsigned alignment) {
+  if (0 == alignment) {
+    alignment = 16;
+  }
+  if (!allocations.empty()) {
+    auto &last = allocations.back();
+    const auto base = reinterpret_cast<uintptr_t>(last.chunk.block.base());
+    const auto start = llvm::alignTo(base + last.used, alignment);
+    if (start + size <= base + last.chunk.block.size()) {
+      last.used = static_cast<std::size_t>(start + size - base);
+      return reinterpret_cast<uint8_t *>(start);
+    }
+  }
+  // Not reserved beforehand.
+  Allocation allocation;
+  allocation.chunk = pool.allocate(size + alignment);
+  if (nullptr == allocation.chunk.block.base()) {
+    return nullptr;
+  }
+  allocations.push_back(allocation);
+  return allocateIn(pool, allocations, size, alignment);
+}
+
+uint8_t *PooledMemoryManager::allocateCodeSection(uintptr_t size,
+                                                  unsigned alignment,
+                                                  unsigned /*sectionID*/,
+                                                  llvm::StringRef) {
+  return allocateIn(*codePool, code, size, alignment);
+}
+
+uint8_t *PooledMemoryManager::allocateDataSection(uintptr_t size,
+                                                  unsigned alignment,
+                                                  unsigned /*sectionID*/,
+                                                  llvm::StringRef,
+                                                  bool isReadOnly) {
+  return allocateIn(*dataPool, isReadOnly ? roData : rwData, size, alignment);
+}
+
+bool PooledMemoryManager::finalizeMemory(std::string *errMsg) {
+  auto protect = [&](const std::vector<Allocation> &allocations,
+                     unsigned flags) {
+    for (auto &&allocation : allocations) {
+      if (allocation.chunk.writableCode) {
+        continue;
+      }
+      if (auto ec = llvm::sys::Memory::protectMappedMemory(
+              allocation.chunk.block, flags)) {
+        if (nullptr != errMsg) {
+          *errMsg = ec.message();
+        }
+        return false;
+      }
+    }
+    return true;
+  };
+  if (!protect(code, llvm::sys::Memory::MF_READ |
+                         llvm::sys::Memory::MF_EXEC) ||
+      !protect(roData, llvm::sys::Memory::MF_READ)) {
+    return true;
+  }
+  for (auto &&allocation : code) {
+    llvm::sys::Memory::InvalidateInstructionCache(allocation.chunk.block.base(),
+                                                  allocation.used);
+  }
+  return false;
+}
@@ -0,0 +1,111 @@
+//===-- memory_manager.h - jit support --------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Jit runtime - shared library part.
+// Pooled memory for jitted code and data.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef MEMORY_MANAGER_H
+#define MEMORY_MANAGER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/Support/Memory.h"
+
+// Page-granular chunks carved out of large mappings, which are only unmapped
+// when the pool is destroyed. Chunks freed by removed modules are reused,
+// lowest address first, so that the code of the current modules stays packed
+// into as few pages as possible.
+class MemoryPool final {
+public:
+  struct Chunk final {
+    llvm::sys::MemoryBlock block;
+    // Part of a huge page region mapped writable and executable, whose
+    // protection is never changed so that it isn't split into small pages.
+    bool writableCode = false;
+  };
+
+private:
+  struct Region final {
+    llvm::sys::MemoryBlock mapping;
+    bool writableCode;
+  };
+  std::vector<Region> regions;
+  // Free chunks by address, adjacent ones of the same kind are merged.
+  std::map<char *, Chunk> freeChunks;
+  const bool executable;
+  bool hugePages = false;
+
+  void addRegion(std::size_t size);
+  void insertFree(Chunk chunk);
+
+public:
+  // Regions of executable pools may be backed by huge pages.
+  explicit MemoryPool(bool executable);
+  ~MemoryPool();
+
+  // Maps subsequently added regions of executable pools to 2 MB aligned
+  // huge pages where supported (transparent huge pages on Linux).
+  void setHugePages(bool enable) { hugePages = enable; }
+
+  // Returns a readable and writable chunk of at least `size` bytes.
+  Chunk allocate(std::size_t size);
+
+  // Returns a chunk, which must not be in use anymore, to the pool.
+  void release(Chunk chunk);
+};
+
+// Memory manager of one loaded object. The sections are placed into one
+// chunk per kind (code, read-only and writable data), sized as reserved by
+// RuntimeDyld beforehand, and returned to the pools when the object is
+// removed.
+class PooledMemoryManager final : public llvm::RTDyldMemoryManager {
+  struct Allocation final {
+    MemoryPool::Chunk chunk;
+    std::size_t used = 0;
+  };
+  std::shared_ptr<MemoryPool> codePool;
+  std::shared_ptr<MemoryPool> dataPool;
+  std::vector<Allocation> code;
+  std::vector<Allocation> roData;
+  std::vector<Allocation> rwData;
+
+  uint8_t *allocateIn(MemoryPool &pool, std::vector<Allocation> &allocations,
+                      uintptr_t size, unsigned alignment);
+
+public:
+  PooledMemoryManager(std::shared_ptr<MemoryPool> codePool,
+                      std::shared_ptr<MemoryPool> dataPool);
+  ~PooledMemoryManager() override;
+
+  bool needsToReserveAllocationSpace() override { return true; }
+
+  void reserveAllocationSpace(uintptr_t codeSize, uint32_t codeAlign,
+                              uintptr_t roDataSize, uint32_t roDataAlign,
+                              uintptr_t rwDataSize,
+                              uint32_t rwDataAlign) override;
+
+  uint8_t *allocateCodeSection(uintptr_t size, unsigned alignment,
+                               unsigned sectionID,
+                               llvm::StringRef sectionName) override;
+
+  uint8_t *allocateDataSection(uintptr_t size, unsigned alignment,
+                               unsigned sectionID, llvm::StringRef sectionName,
+                               bool isReadOnly) override;
+
+  bool finalizeMemory(std::string *errMsg = nullptr) override;
+};
+
+#endif // MEMORY_MANAGER_H
@@ -0,0 +1,148 @@
+//===-- object_cache.cpp --------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "object_cache.h"
+
+#include <cassert>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+namespace {
+
+std::string computeKey(const llvm::Module &module,
+                       llvm::TargetMachine &targetMachine, unsigned optLevel,
+                       unsigned sizeLevel) {
+  llvm::SmallString<0> bitcode;
+  {
+    llvm::raw_svector_ostream os(bitcode);
+#if LDC_LLVM_VER >= 700
+    llvm::WriteBitcodeToFile(module, os);
+#else
+    llvm::WriteBitcodeToFile(&module, os);
+#endif
+  }
+
+  llvm::MD5 hash;
+  hash.update(LLVM_VERSION_STRING);
+  hash.update(targetMachine.getTargetTriple().str());
+  hash.update(targetMachine.getTargetCPU());
+  hash.update(targetMachine.getTargetFeatureString());
+  const uint8_t levels[] = {static_cast<uint8_t>(optLevel),
+                            static_cast<uint8_t>(sizeLevel)};
+  hash.update(levels);
+  hash.update(bitcode);
+
+  llvm::MD5::MD5Result result;
+  hash.final(result);
+  llvm::SmallString<32> str;
+  llvm::MD5::stringifyResult(result, str);
+  return str.str().str();
+}
+
+} // anon namespace
+
+DiskObjectCache::DiskObjectCache() {}
+
+DiskObjectCache::~DiskObjectCache() {}
+
+std::string DiskObjectCache::getObjectPath(llvm::StringRef key) const {
+  llvm::SmallString<128> path(cacheDir);
+  llvm::sys::path::append(path, "ldc-jit-" + key + ".o");
+  return path.str().str();
+}
+
+void DiskObjectCache::setCacheDir(const char *dir) {
+  cacheDir = (dir != nullptr ? dir : "");
+}
+
+bool DiskObjectCache::lookup(const llvm::Module &module,
+                             llvm::TargetMachine &targetMachine,
+                             unsigned optLevel, unsigned sizeLevel) {
+  assert(enabled());
+  reset();
+  currentModule = &module;
+  currentKey = computeKey(module, targetMachine, optLevel, sizeLevel);
+
+  auto buffer = llvm::MemoryBuffer::getFile(getObjectPath(currentKey), -1,
+                                            /*RequiresNullTerminator*/ false);
+  if (!buffer) {
+    return false;
+  }
+
+  // Don't trust truncated or otherwise broken files, such an object would be
+  // silently recompiled from the unoptimized module.
+  auto obj = llvm::object::ObjectFile::createObjectFile(
+      (*buffer)->getMemBufferRef());
+  if (!obj) {
+    llvm::consumeError(obj.takeError());
+    return false;
+  }
+
+  cachedObject = std::move(*buffer);
+  return true;
+}
+
+void DiskObjectCache::reset() {
+  currentKey.clear();
+  currentModule = nullptr;
+  cachedObject.reset();
+}
+
+void DiskObjectCache::notifyObjectCompiled(const llvm::Module *module,
+                                           llvm::MemoryBufferRef object) {
+  if (module != currentModule || currentKey.empty() || cachedObject) {
+    return;
+  }
+
+  if (llvm::sys::fs::create_directories(cacheDir)) {
+    return;
+  }
+
+  // Write to a temporary file first so concurrent processes never see a
+  // partially written object.
+  llvm::SmallString<128> tempPath(cacheDir);
+  llvm::sys::path::append(tempPath, "ldc-jit-%%%%%%%%.tmp");
+  int fd = -1;
+  if (llvm::sys::fs::createUniqueFile(tempPath, fd, tempPath)) {
+    return;
+  }
+
+  {
+    llvm::raw_fd_ostream os(fd, /*shouldClose*/ true);
+    os << object.getBuffer();
+    os.close();
+    if (os.has_error()) {
+      os.clear_error();
+      llvm::sys::fs::remove(tempPath);
+      return;
+    }
+  }
+
+  if (llvm::sys::fs::rename(tempPath, getObjectPath(currentKey))) {
+    llvm::sys::fs::remove(tempPath);
+  }
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+DiskObjectCache::getObject(const llvm::Module *module) {
+  if (module != currentModule || !cachedObject) {
+    return nullptr;
+  }
+  return std::move(cachedObject);
+}
@@ -0,0 +1,65 @@
+//===-- object_cache.h - jit support ----------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Jit runtime - shared library part.
+// Persistent on-disk cache for jitted object files.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef OBJECT_CACHE_H
+#define OBJECT_CACHE_H
+
+#include <memory>
+#include <string>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+
+namespace llvm {
+class MemoryBuffer;
+class Module;
+class TargetMachine;
+} // namespace llvm
+
+// Objects are keyed by a hash of the final module before optimization (which
+// already has all @dynamicCompileConst values and bound parameters folded in),
+// the optimization settings and the host target. Lookup happens before the
+// module is optimized so a hit skips both optimization and codegen; the
+// compile layer then picks the object up through the llvm::ObjectCache
+// interface. All file system errors are ignored, the cache is best-effort.
+class DiskObjectCache final : public llvm::ObjectCache {
+  std::string cacheDir;
+  std::string currentKey;
+  const llvm::Module *currentModule = nullptr;
+  std::unique_ptr<llvm::MemoryBuffer> cachedObject;
+
+  std::string getObjectPath(llvm::StringRef key) const;
+
+public:
+  DiskObjectCache();
+  ~DiskObjectCache();
+
+  void setCacheDir(const char *dir);
+  bool enabled() const { return !cacheDir.empty(); }
+
+  // Computes the key of `module` and returns true if the cache has an object
+  // for it, which will be returned when the module is compiled.
+  bool lookup(const llvm::Module &module, llvm::TargetMachine &targetMachine,
+              unsigned optLevel, unsigned sizeLevel);
+
+  void reset();
+
+  void notifyObjectCompiled(const llvm::Module *module,
+                            llvm::MemoryBufferRef object) override;
+
+  std::unique_ptr<llvm::MemoryBuffer>
+  getObject(const llvm::Module *module) override;
+};
+
+#endif // OBJECT_CACHE_H
@@ -0,0 +1,157 @@
+//===-- statistics.cpp ----------------------------------------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "statistics.h"
+
+#include <cassert>
+
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Object/SymbolSize.h"
+
+namespace {
+
+uint64_t countInstructions(const llvm::Function &func) {
+  uint64_t ret = 0;
+  for (auto &&bb : func) {
+    ret += bb.size();
+  }
+  return ret;
+}
+
+} // anon namespace
+
+StatisticsCollector::StatisticsCollector(const Context &c,
+                                         const llvm::DataLayout &layout)
+    : context(c), dataLayout(layout), start(Clock::now()) {}
+
+bool StatisticsCollector::enabled() const {
+  return nullptr != context.statistics ||
+         nullptr != context.functionStatsHandler;
+}
+
+void StatisticsCollector::addTime(CompileStage stage,
+                                  Clock::duration duration) {
+  const auto ns = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+  switch (stage) {
+  case CompileStage::Parse:
+    stats.parseTime += ns;
+    break;
+  case CompileStage::Link:
+    stats.linkTime += ns;
+    break;
+  case CompileStage::Bind:
+    stats.bindTime += ns;
+    break;
+  case CompileStage::Optimize:
+    stats.optimizeTime += ns;
+    break;
+  case CompileStage::Codegen:
+    stats.codegenTime += ns;
+    break;
+  case CompileStage::Resolve:
+    stats.resolveTime += ns;
+    break;
+  }
+}
+
+void StatisticsCollector::addIrSize(uint64_t size) { stats.irSize += size; }
+
+void StatisticsCollector::countModule(const llvm::Module &module) {
+  if (!enabled()) {
+    return;
+  }
+  for (auto &&func : module.functions()) {
+    stats.instructions += countInstructions(func);
+  }
+}
+
+void StatisticsCollector::countOptimizedModule(const llvm::Module &module) {
+  if (!enabled()) {
+    return;
+  }
+  for (auto &&func : module.functions()) {
+    if (func.isDeclaration()) {
+      continue;
+    }
+    const auto count = countInstructions(func);
+    stats.optimizedInstructions += count;
+    functions[func.getName().str()].instructions += count;
+  }
+}
+
+void StatisticsCollector::countObject(const llvm::object::ObjectFile &object) {
+  if (!enabled()) {
+    return;
+  }
+  for (auto &&section : object.sections()) {
+    if (section.isText()) {
+      stats.codeSize += section.getSize();
+    }
+  }
+
+  const char prefix = dataLayout.getGlobalPrefix();
+  for (auto &&sym : llvm::object::computeSymbolSizes(object)) {
+    auto type = sym.first.getType();
+    if (!type) {
+      llvm::consumeError(type.takeError());
+      continue;
+    }
+    if (llvm::object::SymbolRef::ST_Function != *type) {
+      continue;
+    }
+    auto name = sym.first.getName();
+    if (!name) {
+      llvm::consumeError(name.takeError());
+      continue;
+    }
+    auto str = *name;
+    if ('\0' != prefix && !str.empty() && prefix == str.front()) {
+      str = str.drop_front();
+    }
+    functions[str.str()].codeSize += sym.second;
+  }
+}
+
+void StatisticsCollector::setFunctions(uint64_t total, uint64_t compiled) {
+  stats.functions = static_cast<uint32_t>(total);
+  stats.compiledFunctions = static_cast<uint32_t>(compiled);
+}
+
+void StatisticsCollector::setBindSpecializations(uint64_t count) {
+  stats.bindSpecializations = static_cast<uint32_t>(count);
+}
+
+void StatisticsCollector::setObjectCacheHit() { stats.objectCacheHit = true; }
+
+void StatisticsCollector::report() {
+  if (nullptr != context.statistics) {
+    stats.totalTime = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             start)
+            .count());
+    *context.statistics = stats;
+  }
+  if (nullptr != context.functionStatsHandler) {
+    for (auto &&func : functions) {
+      context.functionStatsHandler(context.functionStatsHandlerData,
+                                   func.first.c_str(), func.second.instructions,
+                                   func.second.codeSize);
+    }
+  }
+}
+
+StageTimer::StageTimer(StatisticsCollector &c, CompileStage s)
+    : collector(c), stage(s), start(StatisticsCollector::Clock::now()) {}
+
+StageTimer::~StageTimer() {
+  collector.addTime(stage, StatisticsCollector::Clock::now() - start);
+}
@@ -0,0 +1,93 @@
+//===-- statistics.h - jit support ------------------------------*- C++ -*-===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the Boost Software License. See the LICENSE
+// file for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Jit runtime - shared library part.
+// Timing and size statistics of a compilation.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "context.h"
+
+namespace llvm {
+class DataLayout;
+class Module;
+namespace object {
+class ObjectFile;
+}
+} // namespace llvm
+
+enum class CompileStage : int {
+  Parse,
+  Link,
+  Bind,
+  Optimize,
+  Codegen,
+  Resolve,
+};
+
+// Collects statistics if the context asks for them, all methods do nothing
+// otherwise.
+class StatisticsCollector final {
+public:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  const Context &context;
+  const llvm::DataLayout &dataLayout;
+  Statistics stats;
+  Clock::time_point start;
+
+  struct FunctionSizes final {
+    uint64_t instructions = 0;
+    uint64_t codeSize = 0;
+  };
+  // Keyed by symbol name.
+  std::map<std::string, FunctionSizes> functions;
+
+public:
+  StatisticsCollector(const Context &context,
+                      const llvm::DataLayout &dataLayout);
+
+  bool enabled() const;
+
+  void addTime(CompileStage stage, Clock::duration duration);
+
+  void addIrSize(uint64_t size);
+  void countModule(const llvm::Module &module);
+  void countOptimizedModule(const llvm::Module &module);
+  void countObject(const llvm::object::ObjectFile &object);
+
+  void setFunctions(uint64_t total, uint64_t compiled);
+  void setBindSpecializations(uint64_t count);
+  void setObjectCacheHit();
+
+  // Writes the statistics to the context and reports per-function sizes.
+  void report();
+};
+
+// Adds the time between construction and destruction to a stage.
+class StageTimer final {
+  StatisticsCollector &collector;
+  CompileStage stage;
+  StatisticsCollector::Clock::time_point start;
+
+public:
+  StageTimer(StatisticsCollector &collector, CompileStage stage);
+  ~StageTimer();
+};
+
+#endif // STATISTICS_H
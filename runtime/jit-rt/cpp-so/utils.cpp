@@ -37,7 +37,12 @@ void interruptPoint(const Context &context, const char *desc,
   }
 }
 
-void verifyModule(const Context &context, llvm::Module &module) {
+void verifyModule(const Context &context, llvm::Module &module, bool input) {
+  if (context.verifyMode == VerifyMode::None ||
+      (input && context.verifyMode == VerifyMode::Generated)) {
+    return;
+  }
+
   std::string err;
   llvm::raw_string_ostream errstream(err);
   if (llvm::verifyModule(module, &errstream)) {
@@ -24,6 +24,9 @@ class Module;
 void fatal(const Context &context, const std::string &reason);
 void interruptPoint(const Context &context, const char *desc,
                     const char *object = "");
-void verifyModule(const Context &context, llvm::Module &module);
+/// Verifies the module as selected by Context::verifyMode; input modules are
+/// the ones loaded from the program, all others were generated by the jit.
+void verifyModule(const Context &context, llvm::Module &module,
+                  bool input = false);
 
 #endif // UTILS_HPP
@@ -33,6 +33,17 @@ struct ParamSlice;
 #define JIT_UNREG_BIND_PAYLOAD                                                 \
   MAKE_JIT_API_CALL(unregisterBindPayloadImplSo,                               \
                     LDC_DYNAMIC_COMPILE_API_VERSION)
+#define JIT_RELEASE_UNUSED_CODE                                                \
+  MAKE_JIT_API_CALL(releaseUnusedCodeImplSo, LDC_DYNAMIC_COMPILE_API_VERSION)
+#define JIT_CREATE_CONTEXT                                                     \
+  MAKE_JIT_API_CALL(createJitContextImplSo, LDC_DYNAMIC_COMPILE_API_VERSION)
+#define JIT_DESTROY_CONTEXT                                                    \
+  MAKE_JIT_API_CALL(destroyJitContextImplSo, LDC_DYNAMIC_COMPILE_API_VERSION)
+#define JIT_SET_CONTEXT_CONST                                                  \
+  MAKE_JIT_API_CALL(setJitContextConstImplSo, LDC_DYNAMIC_COMPILE_API_VERSION)
+#define JIT_GET_CONTEXT_FUNCTION                                               \
+  MAKE_JIT_API_CALL(getJitContextFunctionImplSo,                               \
+                    LDC_DYNAMIC_COMPILE_API_VERSION)
 
 extern "C" {
 
@@ -50,6 +61,17 @@ EXTERNAL void JIT_REG_BIND_PAYLOAD(void *handle, void *originalFunc,
 
 EXTERNAL void JIT_UNREG_BIND_PAYLOAD(void *handle);
 
+EXTERNAL void JIT_RELEASE_UNUSED_CODE();
+
+EXTERNAL void *JIT_CREATE_CONTEXT();
+
+EXTERNAL void JIT_DESTROY_CONTEXT(void *jitContext);
+
+EXTERNAL void JIT_SET_CONTEXT_CONST(void *jitContext, const void *var,
+                                    const void *value, std::size_t size);
+
+EXTERNAL void *JIT_GET_CONTEXT_FUNCTION(void *jitContext, const void *func);
+
 void rtCompileProcessImpl(const Context *context, std::size_t contextSize) {
   JIT_API_ENTRYPOINT(dynamiccompile_modules_head, context, contextSize);
 }
@@ -60,4 +82,19 @@ void registerBindPayload(void *handle, void *originalFunc,
 }
 
 void unregisterBindPayload(void *handle) { JIT_UNREG_BIND_PAYLOAD(handle); }
+
+void releaseUnusedCode() { JIT_RELEASE_UNUSED_CODE(); }
+
+void *createJitContext() { return JIT_CREATE_CONTEXT(); }
+
+void destroyJitContext(void *jitContext) { JIT_DESTROY_CONTEXT(jitContext); }
+
+void setJitContextConst(void *jitContext, const void *var, const void *value,
+                        std::size_t size) {
+  JIT_SET_CONTEXT_CONST(jitContext, var, value, size);
+}
+
+void *getJitContextFunction(void *jitContext, const void *func) {
+  return JIT_GET_CONTEXT_FUNCTION(jitContext, func);
+}
 }
@@ -0,0 +1,39 @@
+if("${TARGET_SYSTEM}" MATCHES "Linux" AND (NOT "${TARGET_SYSTEM}" MATCHES "Android"))
+    file(GLOB LDC_XRAYRT_D ${XRAYRT_DIR}/d/ldc/*.d)
+
+    # Builds the static ldc-xray-rt library (the ldc.xray tracing runtime on top
+    # of compiler-rt's XRay runtime), which is linked in with -fxray-instrument.
+    function(build_xray_runtime d_flags c_flags ld_flags path_suffix outlist_targets)
+        get_target_suffix("" "${path_suffix}" target_suffix)
+        set(output_path ${CMAKE_BINARY_DIR}/lib${path_suffix})
+
+        set(xrayrt_d_o "")
+        set(xrayrt_d_bc "")
+        dc("${LDC_XRAYRT_D}"
+           "${XRAYRT_DIR}/d"
+           "${d_flags}"
+           "${PROJECT_BINARY_DIR}/objects${target_suffix}"
+           "OFF"
+           "${COMPILE_ALL_D_FILES_AT_ONCE}"
+           xrayrt_d_o
+           xrayrt_d_bc
+        )
+
+        add_library(ldc-xray-rt${target_suffix} STATIC ${xrayrt_d_o})
+        set_common_library_properties(ldc-xray-rt${target_suffix}
+            ldc-xray-rt ${output_path}
+            "${c_flags}"
+            "${ld_flags}"
+            OFF
+        )
+
+        list(APPEND ${outlist_targets} "ldc-xray-rt${target_suffix}")
+        set(${outlist_targets} ${${outlist_targets}} PARENT_SCOPE)
+    endfunction()
+
+    # Install D interface files
+    install(DIRECTORY ${XRAYRT_DIR}/d/ldc DESTINATION ${INCLUDE_INSTALL_DIR} FILES_MATCHING PATTERN "*.d")
+else()
+    function(build_xray_runtime d_flags c_flags ld_flags path_suffix outlist_targets)
+    endfunction()
+endif()
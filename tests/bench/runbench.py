@@ -0,0 +1,298 @@
+#!/usr/bin/env python
+"""Compile-time and generated-code benchmarks for LDC.
+
+Compiles a fixed corpus - Phobos, a template-heavy synthetic module and a
+large generated module - in a debug and a release configuration, recording
+wall time, the -ftime-trace phase times, peak RSS and object file sizes of
+each compilation. Then builds and runs the microbenchmarks in micro/ (AAs,
+array appending, dynamic casts, closures, exceptions), which print
+`BENCH <name> <ns/op>` lines.
+
+All results are written to a single JSON file, to be compared between LDC
+versions/builds, e.g.:
+
+    runbench.py --ldc=bin/ldc2 --phobos=../runtime/phobos --output=new.json
+"""
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import platform
+import shutil
+import subprocess
+import sys
+import time
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+
+CONFIGS = [
+    ('debug', ['-g', '-O0']),
+    ('release', ['-O3', '-release']),
+]
+
+MICRO_BENCHMARKS = [
+    'aa',
+    'array_append',
+    'closures',
+    'dynamic_cast',
+    'exceptions',
+]
+
+
+def run_and_measure(cmd):
+    """Runs a command, returning its exit status, wall time in seconds, peak
+    RSS in KiB (None if unavailable) and stdout."""
+    start = time.time()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE)
+    output = proc.stdout.read()
+    peak_rss = None
+    if hasattr(os, 'wait4'):
+        _, status, rusage = os.wait4(proc.pid, 0)
+        proc.returncode = (os.WEXITSTATUS(status) if os.WIFEXITED(status)
+                           else -os.WTERMSIG(status))
+        peak_rss = rusage.ru_maxrss
+        # bytes on Darwin, KiB elsewhere
+        if sys.platform == 'darwin':
+            peak_rss //= 1024
+    else:
+        proc.wait()
+    wall = time.time() - start
+    return proc.returncode, wall, peak_rss, output.decode('utf-8', 'replace')
+
+
+def read_phase_times(trace_file):
+    """Sums up the -ftime-trace durations per phase, in milliseconds."""
+    with open(trace_file) as f:
+        trace = json.load(f)
+    phases = {}
+    for event in trace.get('traceEvents', []):
+        name = event.get('name')
+        if name is None:
+            continue
+        phases[name] = phases.get(name, 0.0) + event.get('dur', 0) / 1000.0
+    return dict((name, round(ms, 3)) for name, ms in phases.items())
+
+
+def total_size(paths):
+    return sum(os.path.getsize(p) for p in paths if os.path.isfile(p))
+
+
+def collect_objects(directory):
+    objects = []
+    for root, _, files in os.walk(directory):
+        for name in files:
+            if name.endswith('.o') or name.endswith('.obj'):
+                objects.append(os.path.join(root, name))
+    return objects
+
+
+def generate_template_corpus(path, count):
+    """A module dominated by template instantiation, CTFE and mixins."""
+    with open(path, 'w') as f:
+        f.write('module templates;\n\n')
+        f.write('import std.algorithm, std.conv, std.meta, std.range, '
+                'std.traits, std.typecons;\n\n')
+        f.write('struct Wrap(T, size_t n)\n{\n'
+                '    T[n] values;\n'
+                '    auto sum()() const { return values[].sum; }\n'
+                '    auto mapped(alias f)() const '
+                '{ return values[].map!f.array; }\n'
+                '}\n\n')
+        f.write('template Fib(size_t n)\n{\n'
+                '    static if (n < 2) enum Fib = n;\n'
+                '    else enum Fib = Fib!(n - 1) + Fib!(n - 2);\n'
+                '}\n\n')
+        f.write('string genFields(size_t n)\n{\n'
+                '    string s;\n'
+                '    foreach (i; 0 .. n) s ~= "int f" ~ i.to!string ~ ";";\n'
+                '    return s;\n'
+                '}\n\n')
+        for i in range(count):
+            f.write('struct S%d { mixin(genFields(%d)); }\n' % (i, 4 + i % 8))
+            f.write('auto use%d()\n{\n' % i)
+            f.write('    Wrap!(S%d, %d) w;\n' % (i, 1 + i % 5))
+            f.write('    alias Fields = FieldNameTuple!S%d;\n' % i)
+            f.write('    auto t = tuple(Fib!%d, Fields.length, '
+                    'w.values.length);\n' % (i % 20))
+            f.write('    return iota(%d).filter!(x => x %% 3 == 0)'
+                    '.map!(x => x * t[0]).sum + cast(int) t[1];\n' % (i + 10))
+            f.write('}\n\n')
+
+
+def generate_large_module(path, count):
+    """A module with many mid-sized, non-generic functions."""
+    with open(path, 'w') as f:
+        f.write('module large;\n\n')
+        for i in range(count):
+            f.write('int func%d(int a, int b)\n{\n' % i)
+            f.write('    int r = a * %d + b;\n' % (i + 1))
+            f.write('    foreach (j; 0 .. b & 15)\n'
+                    '        r ^= (r << 3) + j;\n')
+            f.write('    switch (a & 7)\n    {\n')
+            for c in range(8):
+                f.write('    case %d: r += %d; break;\n' % (c, (i * 7 + c) % 97))
+            f.write('    default: break;\n    }\n')
+            if i > 0:
+                f.write('    if (r & 1) r += func%d(b, a);\n' % (i - 1))
+            f.write('    return r;\n}\n\n')
+
+
+def phobos_sources(phobos_dir):
+    std_dir = os.path.join(phobos_dir, 'std')
+    excluded = [os.path.join(std_dir, 'windows'),
+                os.path.join(std_dir, 'c', 'windows'),
+                os.path.join(std_dir, 'internal', 'windows')]
+    if platform.system() == 'Windows':
+        excluded = []
+    sources = []
+    for root, _, files in os.walk(std_dir):
+        if any(root.startswith(e) for e in excluded):
+            continue
+        for name in files:
+            if name.endswith('.d'):
+                sources.append(os.path.join(root, name))
+    return sorted(sources)
+
+
+def bench_compile(args, name, sources, extra_flags):
+    results = []
+    for config, flags in CONFIGS:
+        out_dir = os.path.join(args.work_dir, 'compile', name, config)
+        best = None
+        for _ in range(args.repeat):
+            if os.path.isdir(out_dir):
+                shutil.rmtree(out_dir)
+            os.makedirs(out_dir)
+            trace = os.path.join(out_dir, 'trace.json')
+            cmd = ([args.ldc, '-c', '-od=' + out_dir, '-ftime-trace',
+                    '-ftime-trace-file=' + trace] + flags + extra_flags +
+                   sources)
+            status, wall, rss, _ = run_and_measure(cmd)
+            if status != 0:
+                print('error: compiling %s (%s) failed with status %d' %
+                      (name, config, status), file=sys.stderr)
+                return results, False
+            result = {
+                'corpus': name,
+                'config': config,
+                'wall_ms': round(wall * 1000, 1),
+                'peak_rss_kib': rss,
+                'object_bytes': total_size(collect_objects(out_dir)),
+                'phases_ms': read_phase_times(trace),
+            }
+            if best is None or result['wall_ms'] < best['wall_ms']:
+                best = result
+        print('%-10s %-8s %10.1f ms %10s KiB %12d bytes' %
+              (name, config, best['wall_ms'], best['peak_rss_kib'],
+               best['object_bytes']))
+        results.append(best)
+    return results, True
+
+
+def bench_micro(args):
+    results = []
+    ok = True
+    micro_dir = os.path.join(SCRIPT_DIR, 'micro')
+    out_dir = os.path.join(args.work_dir, 'micro')
+    if not os.path.isdir(out_dir):
+        os.makedirs(out_dir)
+    for name in MICRO_BENCHMARKS:
+        exe = os.path.join(out_dir, name + ('.exe' if os.name == 'nt' else ''))
+        cmd = [args.ldc, '-O3', '-release', '-I' + micro_dir,
+               '-od=' + out_dir, '-of=' + exe,
+               os.path.join(micro_dir, name + '.d'),
+               os.path.join(micro_dir, 'common.d')]
+        if subprocess.call(cmd) != 0:
+            print('error: building microbenchmark %s failed' % name,
+                  file=sys.stderr)
+            ok = False
+            continue
+        status, _, _, output = run_and_measure([exe])
+        if status != 0:
+            print('error: microbenchmark %s failed with status %d' %
+                  (name, status), file=sys.stderr)
+            ok = False
+            continue
+        for line in output.splitlines():
+            parts = line.split()
+            if len(parts) != 3 or parts[0] != 'BENCH':
+                continue
+            print('%-32s %12s ns/op' % (parts[1], parts[2]))
+            results.append({'benchmark': parts[1],
+                            'ns_per_op': float(parts[2])})
+    return results, ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--ldc', required=True, help='ldc2 executable')
+    parser.add_argument('--phobos', help='Phobos source root directory')
+    parser.add_argument('--work-dir', default='bench-work',
+                        help='directory for generated sources and outputs')
+    parser.add_argument('--output', default='bench.json',
+                        help='JSON output file')
+    parser.add_argument('--repeat', type=int, default=1,
+                        help='compile each corpus N times, keep the fastest')
+    parser.add_argument('--template-count', type=int, default=300,
+                        help='size of the synthetic template corpus')
+    parser.add_argument('--large-count', type=int, default=5000,
+                        help='number of functions in the large module')
+    parser.add_argument('--no-compile', action='store_true',
+                        help='skip the compile-time benchmarks')
+    parser.add_argument('--no-micro', action='store_true',
+                        help='skip the generated-code microbenchmarks')
+    args = parser.parse_args()
+
+    args.ldc = os.path.abspath(args.ldc)
+    args.work_dir = os.path.abspath(args.work_dir)
+    gen_dir = os.path.join(args.work_dir, 'generated')
+    if not os.path.isdir(gen_dir):
+        os.makedirs(gen_dir)
+
+    version = subprocess.check_output([args.ldc, '--version'])
+    report = {
+        'ldc_version': version.decode('utf-8', 'replace').splitlines()[0],
+        'host': platform.platform(),
+        'compile': [],
+        'micro': [],
+    }
+    ok = True
+
+    if not args.no_compile:
+        corpora = []
+        if args.phobos and os.path.isdir(os.path.join(args.phobos, 'std')):
+            corpora.append(('phobos', phobos_sources(args.phobos),
+                            ['-I' + args.phobos]))
+        else:
+            print('warning: Phobos sources not found, skipping that corpus',
+                  file=sys.stderr)
+
+        templates = os.path.join(gen_dir, 'templates.d')
+        generate_template_corpus(templates, args.template_count)
+        corpora.append(('templates', [templates], []))
+
+        large = os.path.join(gen_dir, 'large.d')
+        generate_large_module(large, args.large_count)
+        corpora.append(('large', [large], []))
+
+        for name, sources, flags in corpora:
+            results, success = bench_compile(args, name, sources, flags)
+            report['compile'] += results
+            ok = ok and success
+
+    if not args.no_micro:
+        results, success = bench_micro(args)
+        report['micro'] = results
+        ok = ok and success
+
+    with open(args.output, 'w') as f:
+        json.dump(report, f, indent=2, sort_keys=True)
+        f.write('\n')
+    print('Results written to ' + args.output)
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,47 @@
+//===-- funcEntryCallPassPlugin.cpp - Test pass plugin --------------------===//
+//
+//                         LDC – the LLVM D compiler
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See the LICENSE file for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+using namespace llvm;
+
+namespace {
+
+struct FuncEntryCallPass : public PassInfoMixin<FuncEntryCallPass> {
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &) {
+    // Add call to `__test_funcentrycall(void)` at the start of every function
+    // the optimizer is run on.
+    Module &M = *F.getParent();
+    auto functionType =
+        FunctionType::get(Type::getVoidTy(M.getContext()), false);
+    auto funcToCallUponEntry =
+        M.getOrInsertFunction("__test_funcentrycall", functionType);
+
+    BasicBlock &block = F.getEntryBlock();
+    IRBuilder<> builder(&block, block.begin());
+    builder.CreateCall(funcToCallUponEntry);
+    return PreservedAnalyses::none();
+  }
+};
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "FuncEntryCall", LLVM_VERSION_STRING,
+          [](PassBuilder &builder) {
+            builder.registerVectorizerStartEPCallback(
+                [](FunctionPassManager &fpm, PassBuilder::OptimizationLevel) {
+                  fpm.addPass(FuncEntryCallPass());
+                });
+          }};
+}